@@ -39,6 +39,19 @@ const uint8_t* esp_bt_dev_get_address(void);
 String BTConfig::_btname = "";
 String BTConfig::_btclient = "";
 
+#ifdef BT_STREAM
+uint32_t BTConfig::_rx_bytes = 0;
+uint32_t BTConfig::_tx_bytes = 0;
+uint32_t BTConfig::_connect_ms = 0;
+
+// Output is gathered here and sent as one SPP packet when a line has waited BT_STREAM_TX_FLUSH_MS,
+// or the buffer is full. BluetoothSerial sends each write as its own packet otherwise.
+static uint8_t bt_tx_buffer[BT_STREAM_TX_BUFFER_SIZE];
+static size_t bt_tx_len = 0;
+static uint32_t bt_tx_first_ms = 0; // When the oldest byte in the buffer was written
+static SemaphoreHandle_t bt_tx_mutex = NULL;
+#endif
+
 BTConfig::BTConfig() {
 }
 
@@ -54,13 +67,23 @@ static void my_spp_cb(esp_spp_cb_event_t event, esp_spp_cb_param_t* param) {
         uint8_t* addr = param->srv_open.rem_bda;
         sprintf(str, "%02X:%02X:%02X:%02X:%02X:%02X", addr[0], addr[1], addr[2], addr[3], addr[4], addr[5]);
         BTConfig::_btclient = str;
+#ifdef BT_STREAM
+        BTConfig::connected();
+#endif
         grbl_sendf(CLIENT_ALL, "[MSG:BT Connected with %s]\r\n", str);
     }
     break;
     case ESP_SPP_CLOSE_EVT://Client connection closed
+#ifdef BT_STREAM
+        BTConfig::disconnected();
+#else
         grbl_send(CLIENT_ALL, "[MSG:BT Disconnected]\r\n");
+#endif
         BTConfig::_btclient = "";
         break;
+    case ESP_SPP_DATA_IND_EVT: // Data received. BluetoothSerial has queued it before calling this.
+        serial_notify_data();
+        break;
     default:
         break;
     }
@@ -76,9 +99,12 @@ const char* BTConfig::info() {
         result += "(";
         result += device_address();
         result += "):Status=";
-        if (SerialBT.hasClient())
+        if (SerialBT.hasClient()) {
             result += "Connected with " + _btclient;
-        else result += "Not connected";
+#ifdef BT_STREAM
+            result += ":RX=" + String(rate(_rx_bytes)) + "B/s:TX=" + String(rate(_tx_bytes)) + "B/s";
+#endif
+        } else result += "Not connected";
     } else result += "No BT";
     result += "]\r\n";
     return result.c_str();
@@ -115,6 +141,10 @@ void BTConfig::begin() {
     //stop active services
     end();
     _btname = bt_name->get();
+#ifdef BT_STREAM
+    if (bt_tx_mutex == NULL)
+        bt_tx_mutex = xSemaphoreCreateMutex();
+#endif
     if (wifi_radio_mode->get() == ESP_BT) {
         if (!SerialBT.begin(_btname))
             report_status_message(STATUS_BT_FAIL_BEGIN, CLIENT_ALL);
@@ -152,10 +182,78 @@ bool BTConfig::Is_BT_on() {
  * Handle not critical actions that must be done in sync environement
  */
 void BTConfig::handle() {
+#ifdef BT_STREAM
+    if (bt_tx_mutex != NULL && bt_tx_len != 0) {
+        xSemaphoreTake(bt_tx_mutex, portMAX_DELAY);
+        if (bt_tx_len != 0 && millis() - bt_tx_first_ms >= BT_STREAM_TX_FLUSH_MS)
+            send_tx();
+        xSemaphoreGive(bt_tx_mutex);
+    }
+#endif
     //If needed
     COMMANDS::wait(0);
 }
 
+#ifdef BT_STREAM
+// Sends the buffered output. Called with bt_tx_mutex held. When the link is congested,
+// BluetoothSerial holds the packet until the stack takes more.
+void BTConfig::send_tx() {
+    if (SerialBT.hasClient())
+        SerialBT.write(bt_tx_buffer, bt_tx_len);
+    bt_tx_len = 0;
+}
+
+// Adds output for the BT client to the buffer, sending it once a full packet is there
+// or a complete line has waited long enough.
+void BTConfig::write(const uint8_t* data, size_t len) {
+    if (bt_tx_mutex == NULL) {
+        SerialBT.write(data, len);
+        return;
+    }
+    xSemaphoreTake(bt_tx_mutex, portMAX_DELAY);
+    _tx_bytes += len;
+    while (len) {
+        if (bt_tx_len == 0)
+            bt_tx_first_ms = millis();
+        size_t n = MIN(len, BT_STREAM_TX_BUFFER_SIZE - bt_tx_len);
+        memcpy(&bt_tx_buffer[bt_tx_len], data, n);
+        bt_tx_len += n;
+        data += n;
+        len -= n;
+        if (bt_tx_len == BT_STREAM_TX_BUFFER_SIZE)
+            send_tx();
+    }
+    if (bt_tx_len != 0 && bt_tx_buffer[bt_tx_len - 1] == '\n' && millis() - bt_tx_first_ms >= BT_STREAM_TX_FLUSH_MS)
+        send_tx();
+    xSemaphoreGive(bt_tx_mutex);
+}
+
+uint32_t BTConfig::tx_wait_ms() {
+    if (bt_tx_mutex == NULL || bt_tx_len == 0)
+        return UINT32_MAX;
+    uint32_t waited = millis() - bt_tx_first_ms;
+    return waited < BT_STREAM_TX_FLUSH_MS ? BT_STREAM_TX_FLUSH_MS - waited : 0;
+}
+
+// Returns the average rate of bytes since the client connected, in bytes per second.
+uint32_t BTConfig::rate(uint32_t bytes) {
+    uint32_t elapsed = millis() - _connect_ms;
+    return elapsed ? (uint64_t)bytes * 1000 / elapsed : 0;
+}
+
+void BTConfig::connected() {
+    _rx_bytes = 0;
+    _tx_bytes = 0;
+    _connect_ms = millis();
+}
+
+// Reports the rates the closed connection reached. Output still buffered for it is dropped
+// by the next send_tx(), without waiting here on a writer the stack may be holding up.
+void BTConfig::disconnected() {
+    grbl_sendf(CLIENT_ALL, "[MSG:BT Disconnected:RX=%uB/s:TX=%uB/s]\r\n", rate(_rx_bytes), rate(_tx_bytes));
+}
+#endif
+
 
 #endif // ENABLE_BLUETOOTH
 
@@ -32,6 +32,18 @@
 #define BT_EVENT_DISCONNECTED 0
 #define BT_EVENT_CONNECTED 1
 
+// Buffers of the Bluetooth streaming mode. See BT_STREAM in config.h.
+// The TX buffer matches the largest write BluetoothSerial sends as one SPP packet.
+#ifndef BT_STREAM_RX_BUFFER_SIZE
+    #define BT_STREAM_RX_BUFFER_SIZE 4096
+#endif
+#ifndef BT_STREAM_TX_BUFFER_SIZE
+    #define BT_STREAM_TX_BUFFER_SIZE 330
+#endif
+#ifndef BT_STREAM_TX_FLUSH_MS
+    #define BT_STREAM_TX_FLUSH_MS 5
+#endif
+
 
 #ifndef _BT_CONFIG_H
 #define _BT_CONFIG_H
@@ -53,8 +65,23 @@ class BTConfig {
     static void reset_settings();
     static bool Is_BT_on();
     static String _btclient;
+#ifdef BT_STREAM
+    static void write(const uint8_t* data, size_t len);
+    static void count_rx(size_t len) { _rx_bytes += len; }
+    // Milliseconds until handle() sends the buffered output, or UINT32_MAX with none buffered.
+    static uint32_t tx_wait_ms();
+    static void connected();
+    static void disconnected();
+#endif
   private :
     static String _btname;
+#ifdef BT_STREAM
+    static uint32_t _rx_bytes;
+    static uint32_t _tx_bytes;
+    static uint32_t _connect_ms;
+    static uint32_t rate(uint32_t bytes);
+    static void send_tx();
+#endif
 };
 
 extern BTConfig bt_config;
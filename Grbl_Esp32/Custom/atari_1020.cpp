@@ -71,21 +71,26 @@ void machine_init() {
 }
 
 // this task tracks the Z position and sets the solenoid
+// It sleeps until the stepper ISR sees Z cross zero, see pen_z_crossed_isr(). Only while the
+// pull-in power is on does it wake every SOLENOID_TASK_FREQ to count it down.
 void solenoidSyncTask(void* pvParameters) {
     int32_t current_position[N_AXIS]; // copy of current location
     float m_pos[N_AXIS];			  // machine position in mm
-    TickType_t xLastWakeTime;
-    const TickType_t xSolenoidFrequency = SOLENOID_TASK_FREQ; // in ticks (typically ms)
-    xLastWakeTime = xTaskGetTickCount(); // Initialise the xLastWakeTime variable with the current time.
     while (true) {
         // don't ever return from this or the task dies
         memcpy(current_position, sys_position, sizeof(sys_position)); // get current position in step
         system_convert_array_steps_to_mpos(m_pos, current_position);  // convert to millimeters
         calc_solenoid(m_pos[Z_AXIS]);								  // calculate kinematics and move the servos
-        vTaskDelayUntil(&xLastWakeTime, xSolenoidFrequency);
+        bool pulling = (ledcRead(solenoid_pwm_chan_num) == SOLENOID_PULSE_LEN_PULL);
+        ulTaskNotifyTake(pdTRUE, pulling ? SOLENOID_TASK_FREQ : SOLENOID_STATE_CHECK_TICKS);
     }
 }
 
+void IRAM_ATTR pen_z_crossed_isr() {
+    if (solenoidSyncTaskHandle)
+        vTaskNotifyGiveFromISR(solenoidSyncTaskHandle, NULL);
+}
+
 // to do...have this return a true or false. This could be used by the normal homing feature to
 // continue with regular homing after setup
 // return true if this completes homing
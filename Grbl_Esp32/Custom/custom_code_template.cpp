@@ -114,6 +114,23 @@ void kinematics_post_homing()
 }
 #endif
 
+#ifdef USE_KINEMATICS_BATCH
+/*
+  inverse_kinematics_batch() converts count cartesian points to joint
+  space in place. Arc segments, and the segments your inverse_kinematics()
+  passes to mc_line_kins_batch(), come here a batch at a time and are
+  planned together.
+
+    points = count N_AXIS arrays, in the order of the motion
+    pl_data = a copy of the planner data. Set the feed rate for the batch here.
+    position = the cartesian location the first point starts from
+*/
+void inverse_kinematics_batch(float (*points)[N_AXIS], uint8_t count, plan_line_data_t *pl_data, const float *position)
+{
+  // this leaves the points cartesian. Replace with your kinematics.
+}
+#endif
+
 #ifdef USE_FWD_KINEMATIC
 /*
   The status command uses forward_kinematics() to convert
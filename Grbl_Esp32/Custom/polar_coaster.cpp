@@ -61,6 +61,16 @@ float abs_angle(float ang);
 static float last_angle = 0;
 static float last_radius = 0;
 
+// Converts a cartesian machine position to polar, for mc_kins_segment_count().
+static void polar_transform(const float *cartesian, float *polar) {
+    float xyz[N_AXIS];
+    memcpy(xyz, cartesian, sizeof(xyz));
+    xyz[X_AXIS] -= gc_state.coord_system[X_AXIS] + gc_state.coord_offset[X_AXIS];
+    xyz[Z_AXIS] -= gc_state.coord_system[Z_AXIS] + gc_state.coord_offset[Z_AXIS];
+    memcpy(polar, xyz, sizeof(xyz));  // axes above Z are unchanged
+    calc_polar(xyz, polar, last_angle);
+}
+
 // this get called before homing
 // return false to complete normal home
 // return true to exit normal homing
@@ -87,64 +97,84 @@ void kinematics_post_homing() {
 
 */
 void inverse_kinematics(float *target, plan_line_data_t *pl_data, float *position) {
-    //static float last_angle = 0;
-    //static float last_radius = 0;
-    float dx, dy, dz;                                                                // distances in each cartesian axis
-    float p_dx, p_dy, p_dz;                                                          // distances in each polar axis
-    float dist, polar_dist;                                                          // the distances in both systems...used to determine feed rate
     uint32_t segment_count;                                                          // number of segments the move will be broken in to.
-    float seg_target[N_AXIS];                                                        // The target of the current segment
-    float polar[N_AXIS];                                                             // target location in polar coordinates
-    float x_offset = gc_state.coord_system[X_AXIS] + gc_state.coord_offset[X_AXIS];  // offset from machine coordinate system
-    float z_offset = gc_state.coord_system[Z_AXIS] + gc_state.coord_offset[Z_AXIS];  // offset from machine coordinate system
-    //grbl_sendf(CLIENT_SERIAL, "Position: %4.2f %4.2f %4.2f \r\n", position[X_AXIS] - x_offset, position[Y_AXIS], position[Z_AXIS]);
-    //grbl_sendf(CLIENT_SERIAL, "Target: %4.2f %4.2f %4.2f \r\n", target[X_AXIS] - x_offset, target[Y_AXIS], target[Z_AXIS]);
-    // calculate cartesian move distance for each axis
-    dx = target[X_AXIS] - position[X_AXIS];
-    dy = target[Y_AXIS] - position[Y_AXIS];
-    dz = target[Z_AXIS] - position[Z_AXIS];
-    // calculate the total X,Y axis move distance
-    // Z axis is the same in both coord systems, so it is ignored
-    dist = sqrt((dx * dx) + (dy * dy) + (dz * dz));
+    float batch[ARC_BATCH_SIZE][N_AXIS];                                             // The targets of the next segments
+    uint8_t batch_count = 0;
+    float from[N_AXIS];                                                              // The start of the next batch
+    memcpy(from, position, sizeof(from));
     if (pl_data->condition & PL_COND_FLAG_RAPID_MOTION) {
         segment_count = 1;  // rapid G0 motion is not used to draw, so skip the segmentation
     } else {
-        segment_count = ceil(dist / SEGMENT_LENGTH);  // determine the number of segments we need	... round up so there is at least 1
+        // as few segments as keep the move within the arc tolerance, each at most SEGMENT_LENGTH
+        segment_count = mc_kins_segment_count(position, target, SEGMENT_LENGTH, hot_settings->arc_tolerance, polar_transform);
     }
-    dist /= segment_count;  // segment distance
     for (uint32_t segment = 1; segment <= segment_count; segment++) {
         // determine this segment's target
-        seg_target[X_AXIS] = position[X_AXIS] + (dx / float(segment_count) * segment) - x_offset;
-        seg_target[Y_AXIS] = position[Y_AXIS] + (dy / float(segment_count) * segment);
-        seg_target[Z_AXIS] = position[Z_AXIS] + (dz / float(segment_count) * segment) - z_offset;
+        for (uint8_t idx = 0; idx < N_AXIS; idx++)
+            batch[batch_count][idx] = position[idx] + ((target[idx] - position[idx]) / float(segment_count) * segment);
+        batch_count++;
+        // convert and plan the segments a batch at a time
+        if (batch_count == ARC_BATCH_SIZE || segment == segment_count) {
+            mc_line_kins_batch(batch, batch_count, pl_data, from);
+            batch_count = 0;
+            if (sys.abort)
+                return;
+        }
+    }
+    // TO DO don't need a feedrate for rapids
+}
+
+/*
+ Convert a batch of segment targets to polar in place
+
+ float points: 					The segment targets in machine space, in order
+ plan_line_data_t *pl_data:		A copy of the plan information. The feed rate is set for the batch
+ float *position:				The "from" location of the first segment
+
+ The feed rate is scaled by the ratio of the polar and cartesian lengths of the whole batch.
+ The segments of a batch are short, so its ratio is close to the ratio of each segment.
+*/
+void inverse_kinematics_batch(float (*points)[N_AXIS], uint8_t count, plan_line_data_t *pl_data, const float *position) {
+    float p_dx, p_dy, p_dz;                                                          // distances in each polar axis
+    float dist = 0, polar_dist = 0;                                                  // the distances in both systems...used to determine feed rate
+    float from[N_AXIS];                                                              // The cartesian start of the current segment
+    float seg_target[N_AXIS];                                                        // The target of the current segment
+    float polar[N_AXIS];                                                             // target location in polar coordinates
+    float x_offset = gc_state.coord_system[X_AXIS] + gc_state.coord_offset[X_AXIS];  // offset from machine coordinate system
+    float z_offset = gc_state.coord_system[Z_AXIS] + gc_state.coord_offset[Z_AXIS];  // offset from machine coordinate system
+    memcpy(from, position, sizeof(from));
+    for (uint8_t i = 0; i < count; i++) {
+        float dx = points[i][X_AXIS] - from[X_AXIS];
+        float dy = points[i][Y_AXIS] - from[Y_AXIS];
+        float dz = points[i][Z_AXIS] - from[Z_AXIS];
+        dist += sqrt((dx * dx) + (dy * dy) + (dz * dz));
+        memcpy(from, points[i], sizeof(from));
+        memcpy(seg_target, points[i], sizeof(seg_target));
+        seg_target[X_AXIS] -= x_offset;
+        seg_target[Z_AXIS] -= z_offset;
+        memcpy(polar, points[i], sizeof(polar));  // axes above Z are unchanged
         calc_polar(seg_target, polar, last_angle);
-        // begin determining new feed rate
-        // calculate move distance for each axis
+        polar[RADIUS_AXIS] += x_offset;
+        polar[Z_AXIS] += z_offset;
+        // calculate move distance for each polar axis
         p_dx = polar[RADIUS_AXIS] - last_radius;
         p_dy = polar[POLAR_AXIS] - last_angle;
         p_dz = dz;
-        polar_dist = sqrt((p_dx * p_dx) + (p_dy * p_dy) + (p_dz * p_dz));  // calculate the total move distance
-        float polar_rate_multiply = 1.0;                                   // fail safe rate
-        if (polar_dist == 0 || dist == 0) {
-            // prevent 0 feed rate and division by 0
-            polar_rate_multiply = 1.0;  // default to same feed rate
-        } else {
-            // calc a feed rate multiplier
-            polar_rate_multiply = polar_dist / dist;
-            if (polar_rate_multiply < 0.5) {
-                // prevent much slower speed
-                polar_rate_multiply = 0.5;
-            }
-        }
-        pl_data->feed_rate *= polar_rate_multiply;  // apply the distance ratio between coord systems
-        // end determining new feed rate
-        polar[RADIUS_AXIS] += x_offset;
-        polar[Z_AXIS] += z_offset;
+        polar_dist += sqrt((p_dx * p_dx) + (p_dy * p_dy) + (p_dz * p_dz));
         last_radius = polar[RADIUS_AXIS];
         last_angle = polar[POLAR_AXIS];
-        mc_line(polar, pl_data);
+        memcpy(points[i], polar, sizeof(polar));
     }
-    // TO DO don't need a feedrate for rapids
+    float polar_rate_multiply = 1.0;  // fail safe rate
+    if (polar_dist != 0 && dist != 0) {
+        // calc a feed rate multiplier
+        polar_rate_multiply = polar_dist / dist;
+        if (polar_rate_multiply < 0.5) {
+            // prevent much slower speed
+            polar_rate_multiply = 0.5;
+        }
+    }
+    pl_data->feed_rate *= polar_rate_multiply;  // apply the distance ratio between coord systems
 }
 
 /*
@@ -42,8 +42,12 @@ Spindle *spindle;
 
 
 void setup() {
+    boot_mark("Startup"); // From power-on to setup()
 #ifdef USE_I2S_OUT
-    i2s_out_init();    // The I2S out must be initialized before it can access the expanded GPIO port
+    // The I2S out must be initialized before it can access the expanded GPIO port.
+    // The stepper enables, spindle and coolant may be on it, so it comes first, with the
+    // outputs at their initial value. The stream is added once the settings that time it load.
+    i2s_out_init_passthrough();
 #endif
     WiFi.persistent(false);
     WiFi.disconnect(true);
@@ -62,9 +66,31 @@ void setup() {
   #endif
     report_machine_type(CLIENT_SERIAL);
 #endif
+    boot_mark("Serial");
     settings_init(); // Load Grbl settings from EEPROM
+    task_map_init(); // The serial tasks started before the settings get their priorities
+#ifdef USE_I2S_OUT_STREAM
+    // The outputs keep their value while the stream is added
+    i2s_out_init(i2s_pulse_usec->get(), i2s_dmabuf_count->get(), i2s_dmabuf_len->get());
+    grbl_msg_sendf(CLIENT_SERIAL,
+                   MSG_LEVEL_INFO,
+                   "I2S stream: %d us/pulse, %d steps/s max, %d ms latency",
+                   i2s_out_get_pulse_usec(),
+                   1000000 / (2 * i2s_out_get_pulse_usec()),
+                   i2s_out_get_delay_ms());
+    boot_mark("I2S");
+#endif
+#ifdef MACHINE_CONFIG
+    machine_config_init(); // Motors and pins from SPIFFS, before the steppers and motors use them
+    boot_mark("Machine config");
+#endif
+    serial_alloc_buffers(); // Size the client receive buffers from settings
+    plan_init();     // Allocate the planner buffer from settings
+    boot_mark("Buffers");
     stepper_init();  // Configure stepper pins and interrupt timers
+    boot_mark("stepper_init");
     init_motors();
+    boot_mark("init_motors");
     system_ini();   // Configure pinout pins and pin-change interrupt (Renamed due to conflict with esp32 files)
     memset(sys_position, 0, sizeof(sys_position)); // Clear machine position.
 #ifdef USE_PEN_SERVO
@@ -76,6 +102,12 @@ void setup() {
 #ifdef USE_PEN_SOLENOID
     solenoid_init();
 #endif
+#ifdef USE_ENCODER_FEEDBACK
+    encoder_init();
+#endif
+#ifdef USE_MPG
+    mpg_init();
+#endif
 #ifdef USE_MACHINE_INIT
     machine_init(); // user supplied function for special initialization
 #endif
@@ -96,14 +128,13 @@ void setup() {
 #ifdef HOMING_INIT_LOCK
     if (homing_enable->get())  sys.state = STATE_ALARM;
 #endif
+    boot_mark("System");
     spindle_select();
-#ifdef ENABLE_WIFI
-    wifi_config.begin();
-#endif
-#ifdef ENABLE_BLUETOOTH
-    bt_config.begin();
-#endif
+    boot_mark("spindle init");
     inputBuffer.begin();
+    task_map_report(CLIENT_SERIAL, false);
+    boot_start_network(); // Last, so that motion and serial are ready before WiFi connects
+    boot_mark("Network start");
 }
 
 void loop() {
@@ -115,6 +146,9 @@ void loop() {
     sys.r_override = DEFAULT_RAPID_OVERRIDE; // Set to 100%
     sys.spindle_speed_ovr = DEFAULT_SPINDLE_SPEED_OVERRIDE; // Set to 100%
     memset(sys_probe_position, 0, sizeof(sys_probe_position)); // Clear probe position.
+#ifdef PROBE_EDGE_CAPTURE
+    memset(probe_edge_offset, 0, sizeof(probe_edge_offset));
+#endif
     sys_probe_state = 0;
     sys_rt_exec_state = 0;
     sys_rt_exec_alarm = 0;
@@ -123,9 +157,11 @@ void loop() {
     // Reset Grbl primary systems.
     serial_reset_read_buffer(CLIENT_ALL); // Clear serial read buffer
     gc_init(); // Set g-code parser to default state
-    spindle->stop();
+    spindle_stop_all();
     coolant_init();
+    int64_t limits_us = esp_timer_get_time();
     limits_init();
+    boot_phase("limits_init", limits_us);
     probe_init();
     plan_reset(); // Clear block buffer and planner variables
     st_reset(); // Clear stepper subsystem variables
@@ -134,6 +170,7 @@ void loop() {
     gc_sync_position();
     // put your main code here, to run repeatedly:
     report_init_message(CLIENT_ALL);
+    boot_report_banner();
     // Start Grbl main loop. Processes program inputs and executes them.
     protocol_main_loop();
 }
@@ -3,17 +3,46 @@
 #include "grbl.h"
 
 #include "JSONencoder.h"
+#include "espresponse.h"
 
 // Constructor.  If _pretty is true, newlines are
 // inserted into the JSON string for easy reading.
 JSONencoder::JSONencoder(bool pretty) :
+    JSONencoder(pretty, &own)
+{ }
+
+// Constructor that encodes into a caller's string.
+JSONencoder::JSONencoder(bool pretty, String* out) :
+    pretty(pretty),
+    level(0),
+    str(out),
+    stream(NULL),
+    chunk_len(0)
+{
+    *str = "";
+    count[level] = 0;
+}
+
+// Constructor that encodes onto a response stream.
+JSONencoder::JSONencoder(bool pretty, ESPResponseStream* out) :
     pretty(pretty),
     level(0),
-    str("")
+    str(&own),
+    stream(out),
+    chunk_len(0)
 {
     count[level] = 0;
 }
 
+// Private function to send the encoded chunk to the stream
+void JSONencoder::flush_chunk() {
+    if (chunk_len) {
+        chunk[chunk_len] = '\0';
+        stream->print(chunk);
+        chunk_len = 0;
+    }
+}
+
 // Private function to add commas between
 // elements as needed, omitting the comma
 // before the first element in a list.
@@ -41,7 +70,13 @@ void JSONencoder::comma() {
 void JSONencoder::quoted(const char *s)
 {
     add('"');
-    str.concat(s);
+    if (stream) {
+        while (*s) {
+            add(*s++);
+        }
+    } else {
+        str->concat(s);
+    }
     add('"');
 }
 
@@ -83,10 +118,13 @@ void JSONencoder::begin() {
 }
 
 // Finishes the JSON encoding process, closing the unnamed object
-// and returning the encoded string
+// and returning the encoded string, or sending the rest of it
 String JSONencoder::end() {
     end_object();
-    return str;
+    if (stream) {
+        flush_chunk();
+    }
+    return *str;
 }
 
 // Starts a member element.
@@ -2,13 +2,33 @@
 
 #pragma once
 #define MAX_JSON_LEVEL 16
+// Size of the chunks an encoder writing to a stream sends
+#ifndef JSON_CHUNK_SIZE
+    #define JSON_CHUNK_SIZE 256
+#endif
+class ESPResponseStream;
 class JSONencoder {
   private:
     bool pretty;
     int level;
-    String str;
+    String own;
+    String* str;
+    ESPResponseStream* stream;
+    char chunk[JSON_CHUNK_SIZE];
+    size_t chunk_len;
     int count[MAX_JSON_LEVEL];
-    void add(char c) { str += c; }
+    void add(char c) {
+        if (stream) {
+            chunk[chunk_len++] = c;
+            if (chunk_len == JSON_CHUNK_SIZE - 1) {
+                flush_chunk();
+            }
+        } else {
+            HEAP_TAG_SCOPE(HEAP_TAG_JSON);
+            *str += c;
+        }
+    }
+    void flush_chunk();
     void comma_line();
     void comma();
     void quoted(const char *s);
@@ -20,6 +40,12 @@ class JSONencoder {
     JSONencoder(bool pretty);
     // If you don't set _pretty it defaults to false
     JSONencoder();
+    // Encodes into out instead of a string of its own. out is emptied
+    // but keeps its allocation, so a reused buffer does not churn the heap.
+    JSONencoder(bool pretty, String* out);
+    // Sends the encoding to out in JSON_CHUNK_SIZE chunks as it goes,
+    // so no string holds the whole document. end() then returns "".
+    JSONencoder(bool pretty, ESPResponseStream* out);
 
     // begin() starts the encoding process.
     void begin();
@@ -40,6 +40,9 @@
 #define TRINAMIC_RUN_MODE           TRINAMIC_MODE_COOLSTEP
 #define TRINAMIC_HOMING_MODE        TRINAMIC_MODE_COOLSTEP
 
+// Stop homing axes from the limit (DIAG) pin interrupt
+#define HOMING_AXIS_LOCK_ISR
+
 
 #define X_TRINAMIC_DRIVER       2130
 #define X_DISABLE_PIN           I2SO(0)
@@ -136,6 +136,7 @@
 #define SOLENOID_PULSE_LEN_HOLD 40 // solenoid hold level ... typically a lower value to prevent overheating
 
 #define SOLENOID_TASK_FREQ 50 // this is milliseconds
+#define PEN_Z_EVENTS // The stepper wakes the solenoid task when Z crosses zero
 
 #define MAX_PEN_NUMBER 4
 #define BUMPS_PER_PEN_CHANGE 3
@@ -33,8 +33,9 @@
 #define RADIUS_AXIS 0
 #define POLAR_AXIS 1
 
-#define SEGMENT_LENGTH 0.5 // segment length in mm
+#define SEGMENT_LENGTH 10.0 // longest segment in mm. Most are shorter, see GCode/ArcTolerance
 #define USE_KINEMATICS
+#define USE_KINEMATICS_BATCH // convert segments a batch at a time
 #define USE_FWD_KINEMATIC // report in cartesian
 #define USE_M30
 
@@ -209,6 +209,17 @@
 // so non-Cartesian machines can be implemented.
 // #define USE_KINEMATICS
 
+// USE_KINEMATICS_BATCH enables inverse_kinematics_batch(), which
+// converts several cartesian points to joint space in one call, so
+// the points are planned together like cartesian arc segments.
+// Requires USE_KINEMATICS.
+// #define USE_KINEMATICS_BATCH
+
+// MACHINE_KINEMATICS fixes the motor kinematics at compile time
+// instead of following the Machine/Type setting, e.g. for a
+// CoreXY or H-bot machine. See kinematics_linear.h.
+// #define MACHINE_KINEMATICS MACHINE_COREXY
+
 // USE_FWD_KINEMATIC enables the forward_kinematics() function
 // that converts motor positions in non-Cartesian coordinate
 // systems back to Cartesian form, for status reports.
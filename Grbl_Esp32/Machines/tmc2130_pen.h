@@ -38,6 +38,9 @@
 #define TRINAMIC_RUN_MODE           TRINAMIC_MODE_COOLSTEP
 #define TRINAMIC_HOMING_MODE        TRINAMIC_MODE_COOLSTEP
 
+// Stop homing axes from the limit (DIAG) pin interrupt
+#define HOMING_AXIS_LOCK_ISR
+
 #define X_STEP_PIN              GPIO_NUM_12
 #define X_DIRECTION_PIN         GPIO_NUM_26
 #define X_TRINAMIC_DRIVER       2130        // Which Driver Type?
@@ -47,10 +47,17 @@ rmt_item32_t rmtItem[2];
 rmt_config_t rmtConfig;
 
 bool motor_class_steps; // true if at least one motor class is handling steps
+#ifdef SERVO_SEGMENT_UPDATE
+uint8_t servo_axis_mask = 0;
+#endif
 
-void init_motors() {
-    grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Init Motors");
+// Filled by readSgTask, emptied by $SG
+static stallguard_sample_t stallguard_sample_slots[STALLGUARD_SAMPLE_COUNT];
+SPSCRing<stallguard_sample_t, uint16_t> stallguard_samples;
+volatile uint32_t stallguard_samples_dropped = 0;
 
+// Makes the motors of the machine definition
+static void init_machine_motors() {
 #ifdef X_TRINAMIC_DRIVER
     myMotor[X_AXIS][0] = new TrinamicDriver(X_AXIS, X_STEP_PIN, X_DIRECTION_PIN, X_DISABLE_PIN, X_CS_PIN, X_TRINAMIC_DRIVER, X_RSENSE, get_next_trinamic_driver_index());
 #elif defined(X_SERVO_PIN)
@@ -202,6 +209,21 @@ void init_motors() {
     myMotor[C_AXIS][1] = new Nullmotor();
 #endif
 
+}
+
+void init_motors() {
+    grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Init Motors");
+
+#ifdef MACHINE_CONFIG
+    if (machine_config_loaded()) {
+        for (uint8_t axis = X_AXIS; axis < MAX_AXES; axis++) {
+            for (uint8_t gang_index = 0; gang_index < MAX_GANGED; gang_index++)
+                myMotor[axis][gang_index] = machine_config_motor(axis, gang_index);
+        }
+    } else
+#endif
+        init_machine_motors();
+
 
 #ifdef USE_STEPSTICK
     grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Using StepStick Mode");
@@ -254,6 +276,9 @@ void init_motors() {
     }
 
     // certain motors need features to be turned on. Check them here
+#ifdef TRINAMIC_DAISY_CHAIN
+    trinamic_chain_begin(); // The setup of all chained drivers goes out together
+#endif
     for (uint8_t axis = X_AXIS; axis < N_AXIS; axis++) {
         for (uint8_t gang_index = 0; gang_index < 2; gang_index++) {
 
@@ -266,33 +291,33 @@ void init_motors() {
                 myMotor[axis][gang_index]->init();
         }
     }
+#ifdef TRINAMIC_DAISY_CHAIN
+    trinamic_chain_flush();
+#endif
 
     // some motor objects require a step signal
     motor_class_steps = motors_have_type_id(UNIPOLAR_MOTOR);
 
     if (motors_have_type_id(TRINAMIC_SPI_MOTOR)) {
         grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "TMCStepper Library Ver. 0x%06x", TMCSTEPPER_VERSION);
-        xTaskCreatePinnedToCore(readSgTask,     // task
-                                "readSgTask", // name for task
-                                4096,   // size of task stack
-                                NULL,   // parameters
-                                1, // priority
-                                &readSgTaskHandle,
-                                0 // core
-                               );
+        stallguard_samples.init(stallguard_sample_slots, STALLGUARD_SAMPLE_COUNT);
+        task_create(TASK_STALLGUARD, readSgTask, 4096, NULL, &readSgTaskHandle);
         if (stallguard_debug_mask->get() != 0)
             grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Stallguard debug enabled: %d", stallguard_debug_mask->get());
     }
 
     if (motors_have_type_id(RC_SERVO_MOTOR)) {
-        xTaskCreatePinnedToCore(servoUpdateTask,     // task
-                                "servoUpdateTask", // name for task
-                                4096,   // size of task stack
-                                NULL,   // parameters
-                                1, // priority
-                                &servoUpdateTaskHandle,
-                                0 // core
-                               );
+#ifdef SERVO_SEGMENT_UPDATE
+        for (uint8_t axis = X_AXIS; axis < N_AXIS; axis++) {
+            for (uint8_t gang_index = 0; gang_index < 2; gang_index++) {
+                if (myMotor[axis][gang_index]->type_id == RC_SERVO_MOTOR) {
+                    myMotor[axis][gang_index]->update(); // make the duty map before the ISR uses it
+                    servo_axis_mask |= bit(axis);
+                }
+            }
+        }
+#endif
+        task_create(TASK_SERVO_UPDATE, servoUpdateTask, 4096, NULL, &servoUpdateTaskHandle);
     }
 }
 
@@ -329,7 +354,7 @@ bool motors_have_type_id(motor_class_id_t id) {
 }
 
 
-void motors_set_disable(bool disable) {
+void IRAM_ATTR motors_set_disable(bool disable) {
     static bool previous_state = false;
 
     if (previous_state == disable)
@@ -337,40 +362,67 @@ void motors_set_disable(bool disable) {
 
     previous_state = disable;
 
-    if (step_enable_invert->get()) {
+    if (hot_settings->step_enable_invert) {
         disable = !disable;    // Apply pin invert.
     }
 
     digitalWrite(STEPPERS_DISABLE_PIN, disable);
 
+#ifdef TRINAMIC_DAISY_CHAIN
+    trinamic_chain_begin();
+#endif
     // now loop through all the motors to see if they can individually diable
     for (uint8_t gang_index = 0; gang_index < MAX_GANGED; gang_index++) {
         for (uint8_t axis = X_AXIS; axis < N_AXIS; axis++)
             myMotor[axis][gang_index]->set_disable(disable);
     }
+#ifdef TRINAMIC_DAISY_CHAIN
+    trinamic_chain_flush(); // one transfer for all the drivers in the chain
+#endif
+}
+
+static volatile uint8_t motor_settings_changed_mask = 0; // Axes whose motors must reread their settings
+
+// Called by the settings code. readSgTask() does the rereading, because the
+// driver transfers are slow and must not hold up the settings command.
+void motors_settings_changed(uint8_t axis_mask) {
+    __atomic_or_fetch(&motor_settings_changed_mask, axis_mask, __ATOMIC_RELAXED);
 }
 
-void motors_read_settings() {
+void motors_read_settings(uint8_t axis_mask) {
     //grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Read Settings");
+#ifdef TRINAMIC_DAISY_CHAIN
+    trinamic_chain_begin();
+#endif
     for (uint8_t gang_index = 0; gang_index < 2; gang_index++) {
         for (uint8_t axis = X_AXIS; axis < N_AXIS; axis++)
-            myMotor[axis][gang_index]->read_settings();
+            if (bit(axis) & axis_mask)
+                myMotor[axis][gang_index]->read_settings();
     }
+#ifdef TRINAMIC_DAISY_CHAIN
+    trinamic_chain_flush();
+#endif
 }
 
 // use this to tell all the motors what the current homing mode is
 // They can use this to setup things like Stall
 void motors_set_homing_mode(uint8_t homing_mask, bool isHoming) {
     //grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "motors_set_homing_mode(%d)", is_homing);
+#ifdef TRINAMIC_DAISY_CHAIN
+    trinamic_chain_begin();
+#endif
     for (uint8_t gang_index = 0; gang_index < 2; gang_index++) {
         for (uint8_t axis = X_AXIS; axis < N_AXIS; axis++)
             if (bit(axis) & homing_mask)
                 myMotor[axis][gang_index]->set_homing_mode(homing_mask, isHoming);
     }
+#ifdef TRINAMIC_DAISY_CHAIN
+    trinamic_chain_flush();
+#endif
 }
 
 
-void motors_set_direction_pins(uint8_t onMask) {
+void IRAM_ATTR motors_set_direction_pins(uint8_t onMask) {
     static uint8_t previous_val = 255;  // should never be this value
     if (previous_val == onMask)
         return;
@@ -378,10 +430,15 @@ void motors_set_direction_pins(uint8_t onMask) {
 
     //grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "motors_set_direction_pins:0x%02X", onMask);
 
+#ifdef STATIC_MOTOR_DISPATCH
+#define MOTOR_SET_DIRECTION_PINS(dispatch, axis, gang_index) dispatch::set_direction_pins(myMotor[axis][gang_index], onMask)
+    MOTOR_DISPATCH_ALL(MOTOR_SET_DIRECTION_PINS);
+#else
     for (uint8_t gang_index = 0; gang_index < MAX_GANGED; gang_index++) {
         for (uint8_t axis = X_AXIS; axis < N_AXIS; axis++)
             myMotor[axis][gang_index]->set_direction_pins(onMask);
     }
+#endif
 }
 
 // for testing
@@ -398,42 +455,101 @@ uint8_t get_next_trinamic_driver_index() {
 }
 
 // some motor objects, like unipolar need step signals
-void motors_step(uint8_t step_mask, uint8_t dir_mask) {
+void IRAM_ATTR motors_step(uint8_t step_mask, uint8_t dir_mask) {
+#ifdef STATIC_MOTOR_DISPATCH
+    // Only the motors that handle steps, like UnipolarMotor, generate any code here
+#define MOTOR_STEP(dispatch, axis, gang_index) dispatch::step(myMotor[axis][gang_index], step_mask, dir_mask)
+    MOTOR_DISPATCH_ALL(MOTOR_STEP);
+#else
     if (motor_class_steps) { // determined in init_motors if any motors need to handle steps
         for (uint8_t gang_index = 0; gang_index < 2; gang_index++) {
             for (uint8_t axis = X_AXIS; axis < N_AXIS; axis++)
                 myMotor[axis][gang_index]->step(step_mask, dir_mask);
         }
     }
+#endif
 }
 
 /*
     This will print StallGuard data that is useful for tuning.
+    When Report/StallGuardRate is set, the StallGuard axes are instead sampled at that rate
+    into stallguard_samples, which is read in bulk with $SG.
 */
 void readSgTask(void* pvParameters) {
     TickType_t xLastWakeTime;
+    TickType_t xLastMessage;
     const TickType_t xreadSg = 200;  // in ticks (typically ms)
 
     xLastWakeTime = xTaskGetTickCount(); // Initialise the xLastWakeTime variable with the current time.
+    xLastMessage = xLastWakeTime;
     while (true) { // don't ever return from this or the task dies
-        if (motorSettingChanged) {
-            motors_read_settings();
-            motorSettingChanged = false;
-        }
+        uint8_t changed_axes = __atomic_exchange_n(&motor_settings_changed_mask, 0, __ATOMIC_RELAXED);
+        if (changed_axes)
+            motors_read_settings(changed_axes);
+
+        uint32_t sample_rate = stallguard_sample_rate->get();
+        bool message_due = (xLastWakeTime - xLastMessage) >= xreadSg;
+        if (message_due)
+            xLastMessage = xLastWakeTime;
 
-        if (stallguard_debug_mask->get() != 0) {
+        if (stallguard_debug_mask->get() != 0 && (sample_rate != 0 || message_due)) {
             if (sys.state == STATE_CYCLE || sys.state == STATE_HOMING || sys.state == STATE_JOG) {
+#ifdef TRINAMIC_DAISY_CHAIN
+                if (sample_rate != 0)
+                    trinamic_chain_sample_stallguard(stallguard_debug_mask->get()); // One read for the chain
+                else
+#endif
                 for (uint8_t axis = X_AXIS; axis < N_AXIS; axis++) {
                     if (stallguard_debug_mask->get() & bit(axis)) {
                         //grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "SG:%d", stallguard_debug_mask->get());
-                        for (uint8_t gang_index = 0; gang_index < 2; gang_index++)
-                            myMotor[axis][gang_index]->debug_message();
+                        for (uint8_t gang_index = 0; gang_index < 2; gang_index++) {
+                            if (sample_rate != 0)
+                                myMotor[axis][gang_index]->sample_stallguard();
+                            else
+                                myMotor[axis][gang_index]->debug_message();
+                        }
                     }
                 }
             } // sys.state
         } // if mask
-        vTaskDelayUntil(&xLastWakeTime, xreadSg);
+
+        TickType_t xPeriod = xreadSg;
+        if (sample_rate != 0) {
+            xPeriod = configTICK_RATE_HZ / sample_rate;
+            if (xPeriod < 1)
+                xPeriod = 1;
+        }
+        vTaskDelayUntil(&xLastWakeTime, xPeriod);
+    }
+}
+
+/*
+    Sends and empties the buffered StallGuard samples, 16 to a line, as hex encoded
+    stallguard_sample_t records in ESP32 (little endian) byte order:
+        [SG:<samples>,<dropped>]
+        [SGD:<hex>]...
+*/
+void motors_report_stallguard_samples(uint8_t client) {
+    const uint8_t samples_per_line = 16;
+    char line[samples_per_line * sizeof(stallguard_sample_t) * 2 + 1];
+    uint8_t in_line = 0;
+
+    // Take only the samples present now, so a fast sampler cannot keep this going
+    uint16_t count = stallguard_samples.count();
+    grbl_sendf(client, "[SG:%d,%d]\r\n", count, stallguard_samples_dropped);
+    stallguard_samples_dropped = 0;
+    while (count-- > 0) {
+        const uint8_t* bytes = (const uint8_t*)stallguard_samples.consumer_slot();
+        for (uint8_t i = 0; i < sizeof(stallguard_sample_t); i++)
+            sprintf(&line[(in_line * sizeof(stallguard_sample_t) + i) * 2], "%02x", bytes[i]);
+        stallguard_samples.pop();
+        if (++in_line == samples_per_line) {
+            grbl_sendf(client, "[SGD:%s]\r\n", line);
+            in_line = 0;
+        }
     }
+    if (in_line != 0)
+        grbl_sendf(client, "[SGD:%s]\r\n", line);
 }
 
 
@@ -461,10 +577,11 @@ void Motor :: init() {
 
 void Motor :: config_message() {}
 void Motor :: debug_message() {}
+void Motor :: sample_stallguard() {}
 void Motor :: read_settings() {}
-void Motor :: set_disable(bool disable) {}
-void Motor :: set_direction_pins(uint8_t onMask) {}
-void Motor :: step(uint8_t step_mask, uint8_t dir_mask) {}
+void IRAM_ATTR Motor :: set_disable(bool disable) {}
+void IRAM_ATTR Motor :: set_direction_pins(uint8_t onMask) {}
+void IRAM_ATTR Motor :: step(uint8_t step_mask, uint8_t dir_mask) {}
 bool Motor :: test() {return true;}; // true = OK
 void Motor :: update() {}
 
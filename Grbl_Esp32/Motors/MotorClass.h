@@ -34,6 +34,7 @@
 #include <TMCStepper.h> // https://github.com/teemuatlut/TMCStepper
 #include "TrinamicDriverClass.h"
 #include "RcServoClass.h"
+#include "../spsc_ring.h"
 //#include "SolenoidClass.h"
 
 extern uint8_t rmt_chan_num[MAX_AXES][2];
@@ -50,19 +51,71 @@ typedef enum {
     SOLENOID
 } motor_class_id_t;
 
+#ifdef UNIPOLAR_LEDC_MICROSTEPS
+    #ifndef UNIPOLAR_MICROSTEPS
+        #define UNIPOLAR_MICROSTEPS 16 // Per full step. Must be a power of 2.
+    #endif
+    #ifndef UNIPOLAR_PWM_FREQ
+        #define UNIPOLAR_PWM_FREQ 20000 // Hz. Above the audible range.
+    #endif
+    #ifndef UNIPOLAR_PWM_RES_BITS
+        #define UNIPOLAR_PWM_RES_BITS 8
+    #endif
+#endif
+
+// StallGuard samples are taken in readSgTask, so the rate is limited by the FreeRTOS tick.
+#ifndef STALLGUARD_SAMPLE_RATE_MAX
+    #define STALLGUARD_SAMPLE_RATE_MAX configTICK_RATE_HZ
+#endif
+
+#ifndef STALLGUARD_SAMPLE_COUNT
+    #define STALLGUARD_SAMPLE_COUNT 512 // Samples buffered between $SG reads
+#endif
+
+#define STALLGUARD_SAMPLE_GANGED 0x80 // Set in motor for the ganged (X2 type) motor
+
+// One StallGuard reading, reported in this binary layout by $SG
+typedef struct {
+    uint32_t time_us;   // esp_timer time of the reading
+    uint16_t sg_result; // SG_RESULT from DRV_STATUS
+    uint8_t cs_actual;  // CS_ACTUAL from DRV_STATUS
+    uint8_t motor;      // Axis index, plus STALLGUARD_SAMPLE_GANGED
+} stallguard_sample_t;
+
+extern SPSCRing<stallguard_sample_t, uint16_t> stallguard_samples;
+extern volatile uint32_t stallguard_samples_dropped; // Samples lost to a full ring since the last $SG
+
 // These are used for setup and to talk to the motors as a group.
 void init_motors();
 uint8_t get_next_trinamic_driver_index();
 bool motors_have_type_id(motor_class_id_t id);
 void readSgTask(void* pvParameters);
-void motors_read_settings();
+void motors_settings_changed(uint8_t axis_mask);
+void motors_read_settings(uint8_t axis_mask);
 void motors_set_homing_mode(uint8_t homing_mask, bool isHoming);
 void motors_set_disable(bool disable);
 void motors_set_direction_pins(uint8_t onMask);
 void motors_step(uint8_t step_mask, uint8_t dir_mask);
 void servoUpdateTask(void* pvParameters);
+void motors_report_stallguard_samples(uint8_t client);
+#ifdef TRINAMIC_DAISY_CHAIN
+// Queues the register writes of the chained drivers until the matching trinamic_chain_flush(),
+// which sends them for the whole chain at once. Calls can nest.
+void trinamic_chain_begin();
+void trinamic_chain_flush();
+// Reads the register at address of every chained driver into reply, indexed by spi_index.
+void trinamic_chain_read(uint8_t address, uint32_t* reply);
+// Takes a StallGuard sample of the chained drivers of the axes in axis_mask with one read.
+void trinamic_chain_sample_stallguard(uint8_t axis_mask);
+#endif
+#ifdef SERVO_SEGMENT_UPDATE
+void motors_servo_segment_update(const int32_t* target);
+#endif
 
 extern bool motor_class_steps; // true if at least one motor class is handling steps
+#ifdef SERVO_SEGMENT_UPDATE
+extern uint8_t servo_axis_mask; // Axes with an RC servo. The stepper ISR sends these their segment targets.
+#endif
 
 // ==================== Motor Classes ====================
 
@@ -73,6 +126,7 @@ class Motor {
     virtual void init(); // not in constructor because this also gets called when $$ settings change
     virtual void config_message();
     virtual void debug_message();
+    virtual void sample_stallguard();
     virtual void read_settings();
     virtual void set_homing_mode(uint8_t homing_mask, bool isHoming);
     virtual void set_disable(bool disable);
@@ -135,6 +189,9 @@ class TrinamicDriver : public StandardStepper {
     void trinamic_test_response();
     void trinamic_stepper_enable(bool enable);
     void debug_message();
+    void sample_stallguard();
+    void push_stallguard_sample(uint32_t drv_status);
+    bool on_axes(uint8_t axis_mask) { return bit(axis_index) & axis_mask; }
     void set_homing_mode(uint8_t homing_mask, bool ishoming);
     void set_disable(bool disable);
     bool test();
@@ -164,6 +221,11 @@ class UnipolarMotor : public Motor {
     void step(uint8_t step_mask, uint8_t dir_mask); // only used on Unipolar right now
 
   private:
+#ifdef UNIPOLAR_LEDC_MICROSTEPS
+    inline void write_phase_duties();
+    uint8_t _phase_chan[4];  // LEDC channel of each phase
+    uint16_t _micro_index;   // Position in the UNIPOLAR_MICROSTEPS * 4 electrical cycle
+#endif
     uint8_t _pin_phase0;
     uint8_t _pin_phase1;
     uint8_t _pin_phase2;
@@ -184,10 +246,22 @@ class RcServo : public Motor {
     virtual void update();
     void read_settings();
     void set_homing_mode(bool is_homing, bool isHoming);
+#ifdef SERVO_SEGMENT_UPDATE
+    void segment_write(int32_t steps);
+#endif
 
   protected:
     void set_location();
     void _get_calibration();
+#ifdef SERVO_SEGMENT_UPDATE
+    // The position to duty map of set_location(), as duty = base + steps * per_step, so the
+    // stepper ISR can apply it without floats. Both are 16.16 fixed point.
+    int64_t _duty_base_q16;
+    int32_t _duty_per_step_q16;
+    uint32_t _duty_low;
+    uint32_t _duty_high;
+    bool _segment_hold; // Leave the output alone, as set_location() does in alarm
+#endif
 
     uint8_t _pwm_pin;
     uint8_t _channel_num;
@@ -202,6 +276,231 @@ class RcServo : public Motor {
     float _pwm_pulse_max;
 };
 
+#ifdef STATIC_MOTOR_DISPATCH
+/*
+    Static motor dispatch. The motor class of each motor is known from the machine definition,
+    picked the same way as in init_motors(), so motors_step() and motors_set_direction_pins()
+    can call the class methods directly. Motors with nothing to do for a call, like Nullmotor
+    for both or StandardStepper for step(), compile to nothing.
+*/
+#if defined(X_TRINAMIC_DRIVER)
+    #define X_MOTOR_CLASS TrinamicDriver
+#elif defined(X_SERVO_PIN)
+    #define X_MOTOR_CLASS RcServo
+#elif defined(X_UNIPOLAR)
+    #define X_MOTOR_CLASS UnipolarMotor
+#elif defined(X_STEP_PIN)
+    #define X_MOTOR_CLASS StandardStepper
+#else
+    #define X_MOTOR_CLASS Nullmotor
+#endif
+
+#if defined(X2_TRINAMIC_DRIVER)
+    #define X2_MOTOR_CLASS TrinamicDriver
+#elif defined(X2_SERVO_PIN)
+    #define X2_MOTOR_CLASS RcServo
+#elif defined(X2_UNIPOLAR)
+    #define X2_MOTOR_CLASS UnipolarMotor
+#elif defined(X2_STEP_PIN)
+    #define X2_MOTOR_CLASS StandardStepper
+#else
+    #define X2_MOTOR_CLASS Nullmotor
+#endif
+
+#if defined(Y_TRINAMIC_DRIVER)
+    #define Y_MOTOR_CLASS TrinamicDriver
+#elif defined(Y_SERVO_PIN)
+    #define Y_MOTOR_CLASS RcServo
+#elif defined(Y_UNIPOLAR)
+    #define Y_MOTOR_CLASS UnipolarMotor
+#elif defined(Y_STEP_PIN)
+    #define Y_MOTOR_CLASS StandardStepper
+#else
+    #define Y_MOTOR_CLASS Nullmotor
+#endif
+
+#if defined(Y2_TRINAMIC_DRIVER)
+    #define Y2_MOTOR_CLASS TrinamicDriver
+#elif defined(Y2_SERVO_PIN)
+    #define Y2_MOTOR_CLASS RcServo
+#elif defined(Y2_UNIPOLAR)
+    #define Y2_MOTOR_CLASS UnipolarMotor
+#elif defined(Y2_STEP_PIN)
+    #define Y2_MOTOR_CLASS StandardStepper
+#else
+    #define Y2_MOTOR_CLASS Nullmotor
+#endif
+
+#if defined(Z_TRINAMIC_DRIVER)
+    #define Z_MOTOR_CLASS TrinamicDriver
+#elif defined(Z_SERVO_PIN)
+    #define Z_MOTOR_CLASS RcServo
+#elif defined(Z_UNIPOLAR)
+    #define Z_MOTOR_CLASS UnipolarMotor
+#elif defined(Z_STEP_PIN)
+    #define Z_MOTOR_CLASS StandardStepper
+#else
+    #define Z_MOTOR_CLASS Nullmotor
+#endif
+
+#if defined(Z2_TRINAMIC_DRIVER)
+    #define Z2_MOTOR_CLASS TrinamicDriver
+#elif defined(Z2_SERVO_PIN)
+    #define Z2_MOTOR_CLASS RcServo
+#elif defined(Z2_UNIPOLAR)
+    #define Z2_MOTOR_CLASS UnipolarMotor
+#elif defined(Z2_STEP_PIN)
+    #define Z2_MOTOR_CLASS StandardStepper
+#else
+    #define Z2_MOTOR_CLASS Nullmotor
+#endif
+
+#if defined(A_TRINAMIC_DRIVER)
+    #define A_MOTOR_CLASS TrinamicDriver
+#elif defined(A_SERVO_PIN)
+    #define A_MOTOR_CLASS RcServo
+#elif defined(A_UNIPOLAR)
+    #define A_MOTOR_CLASS UnipolarMotor
+#elif defined(A_STEP_PIN)
+    #define A_MOTOR_CLASS StandardStepper
+#else
+    #define A_MOTOR_CLASS Nullmotor
+#endif
+
+#if defined(A2_TRINAMIC_DRIVER)
+    #define A2_MOTOR_CLASS TrinamicDriver
+#elif defined(A2_SERVO_PIN)
+    #define A2_MOTOR_CLASS RcServo
+#elif defined(A2_UNIPOLAR)
+    #define A2_MOTOR_CLASS UnipolarMotor
+#elif defined(A2_STEP_PIN)
+    #define A2_MOTOR_CLASS StandardStepper
+#else
+    #define A2_MOTOR_CLASS Nullmotor
+#endif
+
+#if defined(B_TRINAMIC_DRIVER)
+    #define B_MOTOR_CLASS TrinamicDriver
+#elif defined(B_SERVO_PIN)
+    #define B_MOTOR_CLASS RcServo
+#elif defined(B_UNIPOLAR)
+    #define B_MOTOR_CLASS UnipolarMotor
+#elif defined(B_STEP_PIN)
+    #define B_MOTOR_CLASS StandardStepper
+#else
+    #define B_MOTOR_CLASS Nullmotor
+#endif
+
+#if defined(B2_TRINAMIC_DRIVER)
+    #define B2_MOTOR_CLASS TrinamicDriver
+#elif defined(B2_SERVO_PIN)
+    #define B2_MOTOR_CLASS RcServo
+#elif defined(B2_UNIPOLAR)
+    #define B2_MOTOR_CLASS UnipolarMotor
+#elif defined(B2_STEP_PIN)
+    #define B2_MOTOR_CLASS StandardStepper
+#else
+    #define B2_MOTOR_CLASS Nullmotor
+#endif
+
+#if defined(C_TRINAMIC_DRIVER)
+    #define C_MOTOR_CLASS TrinamicDriver
+#elif defined(C_SERVO_PIN)
+    #define C_MOTOR_CLASS RcServo
+#elif defined(C_UNIPOLAR)
+    #define C_MOTOR_CLASS UnipolarMotor
+#elif defined(C_STEP_PIN)
+    #define C_MOTOR_CLASS StandardStepper
+#else
+    #define C_MOTOR_CLASS Nullmotor
+#endif
+
+#if defined(C2_TRINAMIC_DRIVER)
+    #define C2_MOTOR_CLASS TrinamicDriver
+#elif defined(C2_SERVO_PIN)
+    #define C2_MOTOR_CLASS RcServo
+#elif defined(C2_UNIPOLAR)
+    #define C2_MOTOR_CLASS UnipolarMotor
+#elif defined(C2_STEP_PIN)
+    #define C2_MOTOR_CLASS StandardStepper
+#else
+    #define C2_MOTOR_CLASS Nullmotor
+#endif
+
+// By default a motor does nothing per step and sets its direction pins, if it has any.
+template <class M>
+struct MotorDispatch {
+    static inline void step(Motor* motor, uint8_t step_mask, uint8_t dir_mask) {}
+    static inline void set_direction_pins(Motor* motor, uint8_t onMask) {}
+};
+
+template <>
+struct MotorDispatch<StandardStepper> {
+    static inline void step(Motor* motor, uint8_t step_mask, uint8_t dir_mask) {}
+    static inline void set_direction_pins(Motor* motor, uint8_t onMask) {
+        static_cast<StandardStepper*>(motor)->StandardStepper::set_direction_pins(onMask);
+    }
+};
+
+template <>
+struct MotorDispatch<TrinamicDriver> : MotorDispatch<StandardStepper> {};
+
+template <>
+struct MotorDispatch<UnipolarMotor> {
+    static inline void step(Motor* motor, uint8_t step_mask, uint8_t dir_mask) {
+        static_cast<UnipolarMotor*>(motor)->UnipolarMotor::step(step_mask, dir_mask);
+    }
+    static inline void set_direction_pins(Motor* motor, uint8_t onMask) {}
+};
+
+// Expands call(dispatch, axis, gang_index) for every motor of the N_AXIS axes
+#if (N_AXIS >= 6)
+    #define MOTOR_DISPATCH_ALL(call) \
+    call(MotorDispatch<X_MOTOR_CLASS>, X_AXIS, 0); \
+    call(MotorDispatch<X2_MOTOR_CLASS>, X_AXIS, 1); \
+    call(MotorDispatch<Y_MOTOR_CLASS>, Y_AXIS, 0); \
+    call(MotorDispatch<Y2_MOTOR_CLASS>, Y_AXIS, 1); \
+    call(MotorDispatch<Z_MOTOR_CLASS>, Z_AXIS, 0); \
+    call(MotorDispatch<Z2_MOTOR_CLASS>, Z_AXIS, 1); \
+    call(MotorDispatch<A_MOTOR_CLASS>, A_AXIS, 0); \
+    call(MotorDispatch<A2_MOTOR_CLASS>, A_AXIS, 1); \
+    call(MotorDispatch<B_MOTOR_CLASS>, B_AXIS, 0); \
+    call(MotorDispatch<B2_MOTOR_CLASS>, B_AXIS, 1); \
+    call(MotorDispatch<C_MOTOR_CLASS>, C_AXIS, 0); \
+    call(MotorDispatch<C2_MOTOR_CLASS>, C_AXIS, 1);
+#elif (N_AXIS == 5)
+    #define MOTOR_DISPATCH_ALL(call) \
+    call(MotorDispatch<X_MOTOR_CLASS>, X_AXIS, 0); \
+    call(MotorDispatch<X2_MOTOR_CLASS>, X_AXIS, 1); \
+    call(MotorDispatch<Y_MOTOR_CLASS>, Y_AXIS, 0); \
+    call(MotorDispatch<Y2_MOTOR_CLASS>, Y_AXIS, 1); \
+    call(MotorDispatch<Z_MOTOR_CLASS>, Z_AXIS, 0); \
+    call(MotorDispatch<Z2_MOTOR_CLASS>, Z_AXIS, 1); \
+    call(MotorDispatch<A_MOTOR_CLASS>, A_AXIS, 0); \
+    call(MotorDispatch<A2_MOTOR_CLASS>, A_AXIS, 1); \
+    call(MotorDispatch<B_MOTOR_CLASS>, B_AXIS, 0); \
+    call(MotorDispatch<B2_MOTOR_CLASS>, B_AXIS, 1);
+#elif (N_AXIS == 4)
+    #define MOTOR_DISPATCH_ALL(call) \
+    call(MotorDispatch<X_MOTOR_CLASS>, X_AXIS, 0); \
+    call(MotorDispatch<X2_MOTOR_CLASS>, X_AXIS, 1); \
+    call(MotorDispatch<Y_MOTOR_CLASS>, Y_AXIS, 0); \
+    call(MotorDispatch<Y2_MOTOR_CLASS>, Y_AXIS, 1); \
+    call(MotorDispatch<Z_MOTOR_CLASS>, Z_AXIS, 0); \
+    call(MotorDispatch<Z2_MOTOR_CLASS>, Z_AXIS, 1); \
+    call(MotorDispatch<A_MOTOR_CLASS>, A_AXIS, 0); \
+    call(MotorDispatch<A2_MOTOR_CLASS>, A_AXIS, 1);
+#elif (N_AXIS == 3)
+    #define MOTOR_DISPATCH_ALL(call) \
+    call(MotorDispatch<X_MOTOR_CLASS>, X_AXIS, 0); \
+    call(MotorDispatch<X2_MOTOR_CLASS>, X_AXIS, 1); \
+    call(MotorDispatch<Y_MOTOR_CLASS>, Y_AXIS, 0); \
+    call(MotorDispatch<Y2_MOTOR_CLASS>, Y_AXIS, 1); \
+    call(MotorDispatch<Z_MOTOR_CLASS>, Z_AXIS, 0); \
+    call(MotorDispatch<Z2_MOTOR_CLASS>, Z_AXIS, 1);
+#endif
+#endif
+
 class Solenoid : public RcServo {
   public:
     Solenoid();
@@ -92,7 +92,7 @@ void RcServo::_write_pwm(uint32_t duty) {
 }
 
 // sets the PWM to zero. This allows most servos to be manually moved
-void RcServo::set_disable(bool disable) {
+void IRAM_ATTR RcServo::set_disable(bool disable) {
     return;
     _disabled = disable;
     if (_disabled)
@@ -119,6 +119,40 @@ void RcServo::update() {
     set_location();
 }
 
+#ifdef SERVO_SEGMENT_UPDATE
+static portMUX_TYPE servo_map_spinlock = portMUX_INITIALIZER_UNLOCKED;
+
+// Writes the duty for a position in steps with the map made by set_location().
+// NOTE: Called with servo_map_spinlock held, from the stepper ISR or servoUpdateTask.
+void IRAM_ATTR RcServo::segment_write(int32_t steps) {
+    if (_segment_hold)
+        return;
+    int64_t duty = (_duty_base_q16 + (int64_t)_duty_per_step_q16 * steps) >> 16;
+    if (duty < _duty_low)
+        duty = _duty_low;
+    else if (duty > _duty_high)
+        duty = _duty_high;
+    if (duty == _current_pwm_duty)
+        return;
+    _current_pwm_duty = duty;
+    sys_ledc_write_isr(_channel_num, duty);
+}
+
+// Sends all servos the position they will be at when the segment just loaded is done.
+void IRAM_ATTR motors_servo_segment_update(const int32_t* target) {
+    portENTER_CRITICAL_ISR(&servo_map_spinlock);
+    for (uint8_t axis = X_AXIS; axis < N_AXIS; axis++) {
+        if (!(servo_axis_mask & bit(axis)))
+            continue;
+        for (uint8_t gang_index = 0; gang_index < 2; gang_index++) {
+            if (myMotor[axis][gang_index]->type_id == RC_SERVO_MOTOR)
+                static_cast<RcServo*>(myMotor[axis][gang_index])->segment_write(target[axis]);
+        }
+    }
+    portEXIT_CRITICAL_ISR(&servo_map_spinlock);
+}
+#endif
+
 void RcServo::set_location() {
     uint32_t servo_pulse_len;
     float servo_pos, mpos, offset;
@@ -127,6 +161,28 @@ void RcServo::set_location() {
     //grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "locate");
     _get_calibration();
 
+#ifdef SERVO_SEGMENT_UPDATE
+    // During motion, the stepper ISR writes the duty as each segment is loaded, so here only the
+    // map is updated for coordinate system and calibration changes. Otherwise the output is
+    // written here, which covers position changes made outside of motion, like homing.
+    float steps_per_mm = axis_settings[axis_index]->steps_per_mm->get();
+    offset = gc_state.coord_system[axis_index] + gc_state.coord_offset[axis_index];
+    float duty_per_mm = (_pwm_pulse_max - _pwm_pulse_min) / (_position_max - _position_min);
+    int64_t duty_base_q16 = llroundf((_pwm_pulse_min - (offset + _position_min) * duty_per_mm) * 65536.0f);
+    int32_t duty_per_step_q16 = lroundf(duty_per_mm / steps_per_mm * 65536.0f);
+
+    portENTER_CRITICAL(&servo_map_spinlock);
+    _duty_base_q16 = duty_base_q16;
+    _duty_per_step_q16 = duty_per_step_q16;
+    _duty_low = (uint32_t)min(_pwm_pulse_min, _pwm_pulse_max);
+    _duty_high = (uint32_t)max(_pwm_pulse_min, _pwm_pulse_max);
+    _segment_hold = (sys.state == STATE_ALARM);
+    if (!(sys.state & (STATE_CYCLE | STATE_HOLD | STATE_JOG | STATE_SAFETY_DOOR)))
+        segment_write(sys_position[axis_index]);
+    portEXIT_CRITICAL(&servo_map_spinlock);
+    return;
+#endif
+
     if (sys.state == STATE_ALARM) {
         set_disable(true);
         return;
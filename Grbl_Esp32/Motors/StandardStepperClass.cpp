@@ -98,10 +98,10 @@ void StandardStepper :: config_message() {
                    pinName(disable_pin).c_str());
 }
 
-void StandardStepper :: set_direction_pins(uint8_t onMask) {
+void IRAM_ATTR StandardStepper :: set_direction_pins(uint8_t onMask) {
     digitalWrite(dir_pin, (onMask & bit(axis_index)));
 }
 
-void StandardStepper :: set_disable(bool disable) {
+void IRAM_ATTR StandardStepper :: set_disable(bool disable) {
     digitalWrite(disable_pin, disable);
 }
@@ -20,6 +20,166 @@
 #include <TMCStepper.h>
 #include "TrinamicDriverClass.h"
 
+#ifdef TRINAMIC_DAISY_CHAIN
+/*
+    All drivers in a daisy chain share one CS pin and form one long shift register. TMCStepper
+    sends each register access as a full chain length transfer with empty datagrams for the
+    other drivers, so touching every driver costs one complete transfer per driver and register.
+
+    Between trinamic_chain_begin() and trinamic_chain_flush() the register writes of TMCStepper
+    are queued here by spi_index instead, and the flush sends one queued register of every driver
+    per transfer. Setting up N drivers with k registers each then takes k transfers, not N * k.
+    A register written again before the flush is only sent once, with its last value. Drivers
+    with nothing left to send get an empty datagram, which is a harmless GCONF read.
+
+    A read returns its register in the transfer after it, so trinamic_chain_read() reads the same
+    register of every driver with two transfers and hands back each driver's reply.
+*/
+typedef struct {
+    uint8_t address;
+    uint32_t data;
+} trinamic_datagram_t;
+
+typedef struct {
+    trinamic_datagram_t datagram[TRINAMIC_CHAIN_QUEUE];
+    uint8_t count;
+} trinamic_chain_slot_t;
+
+static trinamic_chain_slot_t chain_slot[TRINAMIC_CHAIN_MAX + 1]; // spi_index starts at 1
+static TrinamicDriver* chain_driver[TRINAMIC_CHAIN_MAX + 1];
+static uint8_t chain_length = 0;
+static uint8_t chain_cs_pin = UNDEFINED_PIN;
+static uint8_t chain_batch = 0; // Open trinamic_chain_begin() calls
+static bool chain_pending = false;
+
+static void chain_send();
+
+static void chain_queue(int8_t spi_index, uint8_t address, uint32_t data) {
+    trinamic_chain_slot_t* slot = &chain_slot[spi_index];
+    address |= TRINAMIC_WRITE_FLAG;
+    for (uint8_t i = 0; i < slot->count; i++) {
+        if (slot->datagram[i].address == address) {
+            slot->datagram[i].data = data;
+            return;
+        }
+    }
+    if (slot->count == TRINAMIC_CHAIN_QUEUE)
+        chain_send(); // Keeps the writes of this driver in order
+    slot->datagram[slot->count].address = address;
+    slot->datagram[slot->count].data = data;
+    slot->count++;
+    chain_pending = true;
+}
+
+// A TMCStepper driver whose register writes are queued while a chain batch is open.
+template <class T>
+class TrinamicChainStepper : public T {
+  public:
+    TrinamicChainStepper(uint16_t cs_pin, float r_sense, int8_t spi_index) :
+        T(cs_pin, r_sense, spi_index), _spi_index(spi_index) {}
+
+  protected:
+    void write(uint8_t address, uint32_t data) override {
+        if (chain_batch == 0)
+            T::write(address, data);
+        else
+            chain_queue(_spi_index, address, data);
+    }
+
+  private:
+    int8_t _spi_index;
+};
+
+// Shifts out[index] into each driver of the chain in one transfer. The first datagram shifted
+// out ends up in the driver at the far end of the chain, so they are sent from the highest
+// spi_index down, and the replies come back in the same order. If reply is not NULL, each
+// driver's reply to the datagram it had before is stored there by spi_index.
+static void chain_transfer(const trinamic_datagram_t* out, uint32_t* reply) {
+    SPI.beginTransaction(SPISettings(chain_cs_pin >= I2S_OUT_PIN_BASE ? TRINAMIC_SPI_FREQ : 16000000 / 8, MSBFIRST, SPI_MODE3));
+    digitalWrite(chain_cs_pin, LOW);
+#ifdef USE_I2S_OUT
+    i2s_out_delay();
+#endif
+    for (uint8_t index = chain_length; index > 0; index--) {
+        const trinamic_datagram_t* datagram = &out[index];
+        uint32_t data = 0;
+        SPI.transfer(datagram->address); // The SPI status byte comes back
+        data |= (uint32_t)SPI.transfer((datagram->data >> 24) & 0xFF) << 24;
+        data |= (uint32_t)SPI.transfer((datagram->data >> 16) & 0xFF) << 16;
+        data |= (uint32_t)SPI.transfer((datagram->data >> 8) & 0xFF) << 8;
+        data |= SPI.transfer(datagram->data & 0xFF);
+        if (reply != NULL)
+            reply[index] = data;
+    }
+    digitalWrite(chain_cs_pin, HIGH);
+#ifdef USE_I2S_OUT
+    i2s_out_delay();
+#endif
+    SPI.endTransaction();
+}
+
+// Sends all queued datagrams, one of every driver per transfer.
+static void chain_send() {
+    trinamic_datagram_t out[TRINAMIC_CHAIN_MAX + 1];
+    if (!chain_pending)
+        return;
+    chain_pending = false;
+    for (uint8_t round = 0; round < TRINAMIC_CHAIN_QUEUE; round++) {
+        bool any = false;
+        for (uint8_t index = 1; index <= chain_length; index++) {
+            trinamic_chain_slot_t* slot = &chain_slot[index];
+            if (round < slot->count) {
+                out[index] = slot->datagram[round];
+                any = true;
+            } else {
+                out[index].address = 0;
+                out[index].data = 0;
+            }
+        }
+        if (!any)
+            break;
+        chain_transfer(out, NULL);
+    }
+    for (uint8_t index = 1; index <= chain_length; index++)
+        chain_slot[index].count = 0;
+}
+
+void trinamic_chain_begin() {
+    chain_batch++;
+}
+
+void trinamic_chain_flush() {
+    if (chain_batch != 0 && --chain_batch != 0)
+        return; // An outer batch sends them
+    chain_send();
+}
+
+void trinamic_chain_read(uint8_t address, uint32_t* reply) {
+    trinamic_datagram_t out[TRINAMIC_CHAIN_MAX + 1];
+    for (uint8_t index = 1; index <= chain_length; index++) {
+        out[index].address = address;
+        out[index].data = 0;
+    }
+    chain_transfer(out, NULL);
+    chain_transfer(out, reply);
+}
+
+// One DRV_STATUS read for every driver in the chain, instead of one per driver.
+void trinamic_chain_sample_stallguard(uint8_t axis_mask) {
+    uint32_t drv_status[TRINAMIC_CHAIN_MAX + 1];
+    trinamic_chain_read(TRINAMIC_DRV_STATUS_ADDR, drv_status);
+    for (uint8_t index = 1; index <= chain_length; index++) {
+        TrinamicDriver* driver = chain_driver[index];
+        if (driver != NULL && driver->on_axes(axis_mask))
+            driver->push_stallguard_sample(drv_status[index]);
+    }
+}
+
+    #define TRINAMIC_STEPPER(part) TrinamicChainStepper<part>
+#else
+    #define TRINAMIC_STEPPER(part) part
+#endif
+
 TrinamicDriver :: TrinamicDriver(uint8_t axis_index,
                                  uint8_t step_pin,
                                  uint8_t dir_pin,
@@ -38,14 +198,20 @@ TrinamicDriver :: TrinamicDriver(uint8_t axis_index,
     this->disable_pin = disable_pin;
     this->cs_pin = cs_pin;
     this->spi_index = spi_index;
+#ifdef TRINAMIC_DAISY_CHAIN
+    if (spi_index > chain_length)
+        chain_length = spi_index;
+    chain_cs_pin = cs_pin;
+    chain_driver[spi_index] = this;
+#endif
 
     _homing_mode =  TRINAMIC_HOMING_MODE;
     _homing_mask = 0; // no axes homing
 
     if (_driver_part_number == 2130)
-        tmcstepper = new TMC2130Stepper(cs_pin, _r_sense, spi_index);
+        tmcstepper = new TRINAMIC_STEPPER(TMC2130Stepper)(cs_pin, _r_sense, spi_index);
     else if (_driver_part_number == 5160)
-        tmcstepper = new TMC5160Stepper(cs_pin, _r_sense, spi_index);
+        tmcstepper = new TRINAMIC_STEPPER(TMC5160Stepper)(cs_pin, _r_sense, spi_index);
     else {
         grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Trinamic unsupported p/n:%d", _driver_part_number);
         return;
@@ -132,7 +298,6 @@ void TrinamicDriver :: read_settings() {
 
     tmcstepper->microsteps(axis_settings[axis_index]->microsteps->get());
     tmcstepper->rms_current(run_i_ma, hold_i_percent);
-    
 }
 
 void TrinamicDriver :: set_homing_mode(uint8_t homing_mask, bool isHoming) {
@@ -207,6 +372,33 @@ void TrinamicDriver :: debug_message() {
                    axis_settings[axis_index]->stallguard->get());
 }
 
+/*
+    Queues one StallGuard reading for $SG. SG_RESULT and CS_ACTUAL both come from a single
+    DRV_STATUS read, so this is one SPI transfer per motor. A daisy chain reads them for all its
+    drivers at once with trinamic_chain_sample_stallguard() instead.
+*/
+void TrinamicDriver :: sample_stallguard() {
+    if (stallguard_samples.full()) {
+        stallguard_samples_dropped++;
+        return;
+    }
+    push_stallguard_sample(tmcstepper->DRV_STATUS());
+}
+
+void TrinamicDriver :: push_stallguard_sample(uint32_t drv_status) {
+    if (stallguard_samples.full()) {
+        stallguard_samples_dropped++;
+        return;
+    }
+
+    stallguard_sample_t* sample = stallguard_samples.producer_slot();
+    sample->time_us = (uint32_t)esp_timer_get_time();
+    sample->sg_result = drv_status & 0x3FF;         // bits 0..9
+    sample->cs_actual = (drv_status >> 16) & 0x1F;  // bits 16..20
+    sample->motor = axis_index | (dual_axis_index ? STALLGUARD_SAMPLE_GANGED : 0);
+    stallguard_samples.push();
+}
+
 // calculate a tstep from a rate
 // tstep = TRINAMIC_FCLK / (time between 1/256 steps)
 // This is used to set the stallguard window from the homing speed.
@@ -227,14 +419,16 @@ void TrinamicDriver :: set_disable(bool disable) {
     digitalWrite(disable_pin, disable);
 
 #ifdef USE_TRINAMIC_ENABLE
+    uint8_t toff;
     if (disable)
-        tmcstepper->toff(TRINAMIC_TOFF_DISABLE);
+        toff = TRINAMIC_TOFF_DISABLE;
     else {
         if (_mode == TRINAMIC_MODE_STEALTHCHOP)
-            tmcstepper->toff(TRINAMIC_TOFF_STEALTHCHOP);
+            toff = TRINAMIC_TOFF_STEALTHCHOP;
         else
-            tmcstepper->toff(TRINAMIC_TOFF_COOLSTEP);
+            toff = TRINAMIC_TOFF_COOLSTEP;
     }
+    tmcstepper->toff(toff); // With a daisy chain, sent for all drivers by motors_set_disable()
 #endif
     // the pin based enable could be added here.
     // This would be for individual motors, not the single pin for all motors.
@@ -31,6 +31,15 @@
 
 #define TRINAMIC_FCLK       12700000.0 // Internal clock Approx (Hz) used to calculate TSTEP from homing rate
 
+#define TRINAMIC_DRV_STATUS_ADDR    0x6F    // Same address on the TMC2130 and TMC5160
+#define TRINAMIC_WRITE_FLAG         0x80
+
+#define TRINAMIC_CHAIN_MAX          (MAX_AXES * MAX_GANGED) // Drivers a daisy chain can have
+// Registers of each chained driver that can wait for trinamic_chain_flush(). More are sent early.
+#ifndef TRINAMIC_CHAIN_QUEUE
+    #define TRINAMIC_CHAIN_QUEUE    8
+#endif
+
 // ==== defaults OK to define them in your machine definition ====
 #ifndef TRINAMIC_RUN_MODE
     #define TRINAMIC_RUN_MODE           TRINAMIC_MODE_COOLSTEP
@@ -1,3 +1,29 @@
+#ifdef UNIPOLAR_LEDC_MICROSTEPS
+#define UNIPOLAR_CYCLE_LEN  (UNIPOLAR_MICROSTEPS * 4) // Microsteps per electrical cycle (4 full steps)
+#define UNIPOLAR_CYCLE_MASK (UNIPOLAR_CYCLE_LEN - 1)
+
+// Duty of a phase over the electrical cycle. Each phase carries the positive half of a cosine,
+// a quarter cycle apart: A at 0, B at 90, C at 180 and D at 270 degrees.
+static uint32_t unipolar_duty[UNIPOLAR_CYCLE_LEN];
+static bool unipolar_duty_ready = false;
+
+static void unipolar_init_duty_table() {
+    if (unipolar_duty_ready)
+        return;
+    const uint32_t max_duty = (1 << UNIPOLAR_PWM_RES_BITS) - 1;
+    for (uint16_t i = 0; i < UNIPOLAR_CYCLE_LEN; i++) {
+        float c = cosf(2.0f * M_PI * i / UNIPOLAR_CYCLE_LEN);
+        unipolar_duty[i] = c > 0.0f ? lroundf(c * max_duty) : 0;
+    }
+    unipolar_duty_ready = true;
+}
+
+inline void IRAM_ATTR UnipolarMotor :: write_phase_duties() {
+    for (uint8_t phase = 0; phase < 4; phase++)
+        sys_ledc_write_isr(_phase_chan[phase], unipolar_duty[(_micro_index - phase * UNIPOLAR_MICROSTEPS) & UNIPOLAR_CYCLE_MASK]);
+}
+#endif
+
 UnipolarMotor :: UnipolarMotor() {
 
 }
@@ -20,10 +46,30 @@ UnipolarMotor :: UnipolarMotor(uint8_t axis_index, uint8_t pin_phase0, uint8_t p
 }
 
 void UnipolarMotor :: init() {
+#ifdef UNIPOLAR_LEDC_MICROSTEPS
+    // The four channels must start on an even channel, so they have their two timers to themselves
+    uint8_t pins[4] = { _pin_phase0, _pin_phase1, _pin_phase2, _pin_phase3 };
+    int8_t chan = sys_get_next_PWM_chan_num();
+    if (chan & 1)
+        chan = sys_get_next_PWM_chan_num();
+    for (uint8_t phase = 0; phase < 4; phase++) {
+        if (phase != 0)
+            chan = sys_get_next_PWM_chan_num();
+        if (chan < 0)
+            return; // sys_get_next_PWM_chan_num() reported the error
+        _phase_chan[phase] = chan;
+        ledcSetup(chan, UNIPOLAR_PWM_FREQ, UNIPOLAR_PWM_RES_BITS);
+        ledcAttachPin(pins[phase], chan);
+        ledcWrite(chan, 0);
+    }
+    unipolar_init_duty_table();
+    _micro_index = 0;
+#else
     pinMode(_pin_phase0, OUTPUT);
     pinMode(_pin_phase1, OUTPUT);
     pinMode(_pin_phase2, OUTPUT);
     pinMode(_pin_phase3, OUTPUT);
+#endif
     _current_phase = 0;
 }
 
@@ -36,9 +82,20 @@ void UnipolarMotor :: config_message() {
                    pinName(_pin_phase1).c_str(),
                    pinName(_pin_phase2).c_str(),
                    pinName(_pin_phase3).c_str());
+#ifdef UNIPOLAR_LEDC_MICROSTEPS
+    grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "%s Axis unipolar PWM %d microsteps per step", _axis_name, UNIPOLAR_MICROSTEPS);
+#endif
 }
 
-void UnipolarMotor :: set_disable(bool disable) {
+void IRAM_ATTR UnipolarMotor :: set_disable(bool disable) {
+#ifdef UNIPOLAR_LEDC_MICROSTEPS
+    if (disable) {
+        for (uint8_t phase = 0; phase < 4; phase++)
+            sys_ledc_write_isr(_phase_chan[phase], 0);
+    }
+    _enabled = !disable;
+    return;
+#endif
     if (disable) {
         digitalWrite(_pin_phase0, 0);
         digitalWrite(_pin_phase1, 0);
@@ -48,7 +105,7 @@ void UnipolarMotor :: set_disable(bool disable) {
     _enabled = !disable;
 }
 
-void UnipolarMotor::step(uint8_t step_mask, uint8_t dir_mask) {
+void IRAM_ATTR UnipolarMotor::step(uint8_t step_mask, uint8_t dir_mask) {
     uint8_t _phase[8] = {0, 0, 0, 0, 0, 0, 0, 0}; // temporary phase values...all start as off
     uint8_t phase_max;
 
@@ -58,6 +115,15 @@ void UnipolarMotor::step(uint8_t step_mask, uint8_t dir_mask) {
     if (!_enabled)
         return;	// don't do anything, phase is not changed or lost
 
+#ifdef UNIPOLAR_LEDC_MICROSTEPS
+    if (dir_mask & bit(axis_index)) // count up
+        _micro_index = (_micro_index + 1) & UNIPOLAR_CYCLE_MASK;
+    else // count down
+        _micro_index = (_micro_index - 1) & UNIPOLAR_CYCLE_MASK;
+    write_phase_duties();
+    return;
+#endif
+
     if (_half_step)
         phase_max = 7;
     else
@@ -1,5 +1,9 @@
 #include "grbl.h"
 #include <map>
+#include <SPIFFS.h>
+#if defined (ENABLE_WIFI) && defined (ENABLE_HTTP)
+    #include "web_server.h"
+#endif
 
 // WG Readable and writable as guest
 // WU Readable and writable as user and admin
@@ -53,6 +57,7 @@ void settings_restore(uint8_t restore_flag) {
                     s->setDefault();
             }
         }
+        update_hot_settings();
     }
     if (restore_flag & SETTINGS_RESTORE_PARAMETERS) {
         uint8_t idx;
@@ -70,21 +75,252 @@ void settings_restore(uint8_t restore_flag) {
 // Get settings values from non volatile storage into memory
 void load_settings()
 {
+#ifdef SETTINGS_NVS_BLOB
+    uint32_t start_us = micros();
+    bool from_blob = Setting::begin_load();
+#endif
     for (Setting *s = Setting::List; s; s = s->next()) {
         s->load();
     }
+#ifdef SETTINGS_NVS_BLOB
+    Setting::end_load();
+    grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Settings loaded %s in %dus",
+                   from_blob ? "from blob" : "by key", micros() - start_us);
+#endif
+    update_hot_settings();
 }
 
 extern void make_settings();
 extern void make_grbl_commands();
 extern void make_web_settings();
+
+#ifdef SETTINGS_NAME_INDEX
+// A hash index of the setting and command names, so a name is found with a hash and
+// usually one compare instead of by scanning the lists. Slots point to the setting or
+// command, and the kind of slot says which of its names it holds. There are about
+// three slots for every two names, so probes are short.
+typedef enum : uint8_t {
+    INDEX_SETTING_NAME = 1,
+    INDEX_SETTING_GRBL_NAME,
+    INDEX_COMMAND_NAME, // Either name of a command
+} index_kind_t;
+
+typedef struct {
+    Word* word;
+    index_kind_t kind;
+} index_slot_t;
+
+static index_slot_t* name_index = NULL;
+static uint16_t name_index_size = 0;
+
+static uint32_t name_hash(const char* name, index_kind_t kind) {
+    uint32_t hash = 2166136261 ^ kind; // FNV-1a, case-insensitive as the compares are
+    while (*name) {
+        hash = (hash ^ (uint8_t)tolower(*name++)) * 16777619;
+    }
+    return hash;
+}
+
+static const char* slot_name(const index_slot_t* slot, const char* name) {
+    if (slot->kind == INDEX_SETTING_GRBL_NAME) {
+        return slot->word->getGrblName();
+    }
+    if (slot->kind == INDEX_COMMAND_NAME && strcasecmp(slot->word->getName(), name) != 0) {
+        return slot->word->getGrblName();
+    }
+    return slot->word->getName();
+}
+
+// Returns the slot that holds name, or the free slot where it belongs.
+static index_slot_t* name_index_slot(const char* name, index_kind_t kind) {
+    uint16_t i = name_hash(name, kind) % name_index_size;
+    while (name_index[i].word) {
+        const char* slotName = slot_name(&name_index[i], name);
+        if (name_index[i].kind == kind && slotName && strcasecmp(slotName, name) == 0) {
+            break;
+        }
+        if (++i == name_index_size) {
+            i = 0;
+        }
+    }
+    return &name_index[i];
+}
+
+static void name_index_add(Word* word, const char* name, index_kind_t kind) {
+    if (!name) {
+        return;
+    }
+    index_slot_t* slot = name_index_slot(name, kind);
+    if (!slot->word) { // Otherwise the earlier one in the list wins, as with a scan
+        slot->word = word;
+        slot->kind = kind;
+    }
+}
+
+static void build_name_index() {
+    uint16_t names = 0;
+    for (Setting *s = Setting::List; s; s = s->next()) {
+        names += s->getGrblName() ? 2 : 1;
+    }
+    for (Command *cp = Command::List; cp; cp = cp->next()) {
+        names += cp->getGrblName() ? 2 : 1;
+    }
+    name_index_size = names + names / 2 + 1;
+    name_index = (index_slot_t*)calloc(name_index_size, sizeof(index_slot_t));
+    if (!name_index) {
+        return; // Names are looked up by scanning the lists
+    }
+    for (Setting *s = Setting::List; s; s = s->next()) {
+        name_index_add(s, s->getName(), INDEX_SETTING_NAME);
+        name_index_add(s, s->getGrblName(), INDEX_SETTING_GRBL_NAME);
+    }
+    for (Command *cp = Command::List; cp; cp = cp->next()) {
+        name_index_add(cp, cp->getName(), INDEX_COMMAND_NAME);
+        name_index_add(cp, cp->getGrblName(), INDEX_COMMAND_NAME);
+    }
+}
+#endif
+
+// Returns the setting with the text name key, or NULL.
+static Setting* find_setting(const char* key) {
+#ifdef SETTINGS_NAME_INDEX
+    if (name_index) {
+        return static_cast<Setting*>(name_index_slot(key, INDEX_SETTING_NAME)->word);
+    }
+#endif
+    for (Setting *s = Setting::List; s; s = s->next()) {
+        if (strcasecmp(s->getName(), key) == 0) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+// Returns the setting with the compatible name key, such as 100 for $100, or NULL.
+static Setting* find_grbl_setting(const char* key) {
+#ifdef SETTINGS_NAME_INDEX
+    if (name_index) {
+        return static_cast<Setting*>(name_index_slot(key, INDEX_SETTING_GRBL_NAME)->word);
+    }
+#endif
+    for (Setting *s = Setting::List; s; s = s->next()) {
+        if (s->getGrblName() && strcasecmp(s->getGrblName(), key) == 0) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+// Returns the command with either name key, or NULL.
+static Command* find_command(const char* key) {
+#ifdef SETTINGS_NAME_INDEX
+    if (name_index) {
+        return static_cast<Command*>(name_index_slot(key, INDEX_COMMAND_NAME)->word);
+    }
+#endif
+    for (Command *cp = Command::List; cp; cp = cp->next()) {
+        if (  (strcasecmp(cp->getName(), key) == 0)
+           || (cp->getGrblName()
+               && strcasecmp(cp->getGrblName(), key) == 0
+              )
+           ) {
+            return cp;
+        }
+    }
+    return NULL;
+}
+
+#ifdef ESP_COMMAND_TABLE
+// The settings and commands with an ESPnnn name, indexed by nnn, so the burst of [ESPnnn]
+// commands of a WebUI page load is dispatched without comparing names. esp_slots holds one
+// more than the index of the word in esp_words, or 0 when nnn is not used.
+#define ESP_COMMAND_NUMBERS 1000
+
+typedef struct {
+    Word* word;
+    bool setting;
+} esp_word_t;
+
+static uint8_t* esp_slots = NULL;
+static esp_word_t* esp_words = NULL;
+
+// Returns nnn for the name ESPnnn, without leading zeros, or -1 for any other name.
+static int esp_number(const char* name) {
+    if (!name || strncasecmp(name, "ESP", 3) != 0) {
+        return -1;
+    }
+    name += 3;
+    size_t digits = strlen(name);
+    if (digits == 0 || digits > 3 || (digits > 1 && name[0] == '0')) {
+        return -1;
+    }
+    int number = 0;
+    for (; *name; name++) {
+        if (!isdigit(*name)) {
+            return -1;
+        }
+        number = number * 10 + (*name - '0');
+    }
+    return number;
+}
+
+static void esp_table_add(Word* word, bool setting, uint8_t* count) {
+    int number = esp_number(word->getGrblName());
+    if (number < 0 || esp_slots[number] || *count == 255) {
+        return; // Otherwise the earlier one wins, as with a scan, settings before commands
+    }
+    esp_words[*count].word = word;
+    esp_words[*count].setting = setting;
+    esp_slots[number] = ++*count;
+}
+
+static void build_esp_table() {
+    uint16_t words = 0;
+    for (Setting *s = Setting::List; s; s = s->next()) {
+        words += esp_number(s->getGrblName()) >= 0;
+    }
+    for (Command *cp = Command::List; cp; cp = cp->next()) {
+        words += esp_number(cp->getGrblName()) >= 0;
+    }
+    esp_slots = (uint8_t*)calloc(ESP_COMMAND_NUMBERS, 1);
+    esp_words = (esp_word_t*)calloc(words ? words : 1, sizeof(esp_word_t));
+    if (!esp_slots || !esp_words) {
+        free(esp_slots);
+        free(esp_words);
+        esp_slots = NULL;
+        esp_words = NULL;
+        return; // ESPnnn names are looked up like the others
+    }
+    uint8_t count = 0;
+    for (Setting *s = Setting::List; s; s = s->next()) {
+        esp_table_add(s, true, &count);
+    }
+    for (Command *cp = Command::List; cp; cp = cp->next()) {
+        esp_table_add(cp, false, &count);
+    }
+}
+#endif
+
 void settings_init()
 {
     EEPROM.begin(EEPROM_SIZE);
+    settings_init_coord_data();
+#ifdef TOOL_TABLE
+    tool_table_init();
+#endif
+    boot_mark("NVS");
     make_settings();
     make_web_settings();
     make_grbl_commands();
+#ifdef SETTINGS_NAME_INDEX
+    build_name_index();
+#endif
+#ifdef ESP_COMMAND_TABLE
+    build_esp_table();
+#endif
+    boot_mark("Settings make");
     load_settings();
+    boot_mark("Settings load");
 }
 
 // TODO Settings - jog may need to be special-cased in the parser, since
@@ -296,10 +532,446 @@ err_t restore_settings(const char* value, auth_t auth_level, ESPResponseStream*
     return STATUS_OK;
 }
 
+// Settings transactions. Between settings_begin() and settings_commit(), changed
+// settings take effect in RAM at once but are written to NVS only at the commit,
+// once each, however often they changed. The subsystems that depend on the
+// batch are refreshed once, at the commit.
+void settings_begin() {
+    Setting::begin_transaction();
+}
+
+// Refreshes the subsystems that depend on the settings changed since the last
+// call, see Setting::setDependents(). Only the motors of the changed axes reread
+// their settings, and a setting like $110 touches nothing but the hot settings.
+static void apply_setting_changes() {
+    update_hot_settings();
+    uint8_t axes;
+    uint8_t dependents = Setting::take_changes(&axes);
+    if (dependents & SETTING_DEP_MOTORS) {
+        motors_settings_changed(axes);
+    }
+    if (dependents & SETTING_DEP_SPINDLE_TYPE) {
+        spindle_select(); // Also initializes the new spindle
+    } else if (dependents & SETTING_DEP_SPINDLE) {
+#ifdef SPINDLE2_TYPE
+        spindle_init_all();
+#else
+        spindle->init();
+#endif
+    }
+}
+
+// Sets a setting and refreshes what depends on it, or leaves that for
+// settings_commit() if a transaction is open.
+static err_t set_setting(Setting* s, char* value) {
+    err_t err = s->setStringValue(value);
+    if (Setting::in_transaction()) {
+        update_hot_settings(); // Cheap, so done for any setting
+    } else {
+        apply_setting_changes();
+    }
+    return err;
+}
+
+uint8_t settings_commit() {
+    err_t result = STATUS_OK;
+    for (Setting *s = Setting::List; s; s = s->next()) {
+        if (s->isStaged()) {
+            if (err_t err = s->commit()) {
+                result = err;
+            }
+        }
+    }
+    Setting::end_transaction();
+    apply_setting_changes();
+    return result;
+}
+
+// Returns the settings changed since settings_begin() to their stored values.
+void settings_abort() {
+    for (Setting *s = Setting::List; s; s = s->next()) {
+        if (s->isStaged()) {
+            s->abort();
+        }
+    }
+    Setting::end_transaction();
+    uint8_t axes;
+    Setting::take_changes(&axes); // The stored values were never applied
+    update_hot_settings();
+}
+
+err_t begin_settings(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    settings_begin();
+    return STATUS_OK;
+}
+err_t commit_settings(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    return settings_commit();
+}
+err_t abort_settings(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    settings_abort();
+    return STATUS_OK;
+}
+
+// Settings bundles. $Settings/Export writes the GRBL and EXTENDED settings to a
+// SPIFFS file as $name=value lines, and $Settings/Import applies such a file in
+// one transaction. A machine is cloned with one file transfer, for example with
+// the WebUI upload, and one NVS commit. WEBSET settings are left out, because
+// they hold the network identity and passwords of the machine.
+static String bundle_path(const char* value) {
+    String path = value ? value : "";
+    path.trim();
+    if (path.length() == 0) {
+        return SETTINGS_BUNDLE_PATH;
+    }
+    if (path[0] != '/') {
+        path = "/" + path;
+    }
+    return path;
+}
+
+err_t export_settings(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    String path = bundle_path(value);
+    if (!SPIFFS.begin(true)) {
+        return STATUS_SD_FAILED_MOUNT;
+    }
+    File file = SPIFFS.open(path, FILE_WRITE);
+    if (!file) {
+        return STATUS_SD_FAILED_OPEN_FILE;
+    }
+    file.printf("; Grbl_ESP32 %s settings\n", GRBL_VERSION);
+    int count = 0;
+    for (Setting *s = Setting::List; s; s = s->next()) {
+        if (s->getType() == GRBL || s->getType() == EXTENDED) {
+            file.printf("$%s=%s\n", s->getName(), s->getStringValue());
+            count++;
+        }
+    }
+    file.close();
+#if defined (ENABLE_WIFI) && defined (ENABLE_HTTP)
+    web_server.spiffs_changed();
+#endif
+    grbl_sendf(out->client(), "[MSG:%d settings exported to %s]\r\n", count, path.c_str());
+    return STATUS_OK;
+}
+
+// Applies a bundle in one pass per priority. Machine/Type and the axis settings
+// go first, and every name is checked then, so a bundle for another machine
+// fails before anything else has changed. Any error restores all the values.
+err_t import_settings(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    String path = bundle_path(value);
+    if (!SPIFFS.begin(true)) {
+        return STATUS_SD_FAILED_MOUNT;
+    }
+    File file = SPIFFS.open(path, FILE_READ);
+    if (!file) {
+        return STATUS_SD_FILE_NOT_FOUND;
+    }
+    settings_begin();
+    err_t err = STATUS_OK;
+    int count = 0;
+    for (int pass = 0; pass < 2 && !err; pass++) {
+        file.seek(0);
+        int lineNumber = 0;
+        while (file.available() && !err) {
+            String line = file.readStringUntil('\n');
+            lineNumber++;
+            line.trim();
+            if (line.length() == 0 || line[0] == ';') {
+                continue;
+            }
+            int equals = line.indexOf('=');
+            Setting* s = NULL;
+            if (line[0] == '$' && equals > 1) {
+                s = find_setting(line.substring(1, equals).c_str());
+            }
+            if (!s) {
+                err = STATUS_INVALID_STATEMENT;
+            } else if ((s == machineType || s->getAxis() != NO_AXIS) == (pass == 0)) {
+                String settingValue = line.substring(equals + 1);
+                if (auth_failed(s, settingValue.c_str(), auth_level)) {
+                    err = STATUS_AUTHENTICATION_FAILED;
+                } else {
+                    err = set_setting(s, (char *)settingValue.c_str());
+                }
+                count++;
+            }
+            if (err) {
+                grbl_sendf(out->client(), "[MSG:Settings import stopped at %s line %d]\r\n", path.c_str(), lineNumber);
+            }
+        }
+    }
+    file.close();
+    if (err) {
+        settings_abort();
+        return err;
+    }
+    err = settings_commit();
+    grbl_sendf(out->client(), "[MSG:%d settings imported from %s]\r\n", count, path.c_str());
+    return err;
+}
+
+#ifdef SPINDLE_TACH_PIN
+// Runs the spindle through its duty range and stores the measured speeds as Spindle/Curve
+err_t calibrate_spindle(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    if (sys.state != STATE_IDLE)
+        return STATUS_IDLE_ERROR;
+    if (!spindle->segment_duty)
+        return STATUS_SETTING_DISABLED; // Not a spindle with a PWM duty
+    String curve;
+    if (!static_cast<PWMSpindle*>(spindle)->calibrate(curve))
+        return STATUS_SETTING_DISABLED;
+    grbl_sendf(out->client(), "[MSG:Spindle/Curve=%s]\r\n", curve.c_str());
+    return set_setting(spindle_curve, (char*)curve.c_str());
+}
+#endif
+#ifdef SPINDLE_CAPTURE
+// =ON clears the records and starts recording, =OFF stops. Without a value, sends the records.
+err_t capture_spindle(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    if (value == NULL) {
+        spindle_capture_report(out->client());
+        return STATUS_OK;
+    }
+    if (strcasecmp(value, "ON") == 0)
+        spindle_capture_start();
+    else if (strcasecmp(value, "OFF") == 0)
+        spindle_capture_stop();
+    else
+        return STATUS_INVALID_VALUE;
+    return STATUS_OK;
+}
+#endif
+#ifdef PROBE_SEQUENCE
+static uint8_t probe_sequence_client;
+
+static void report_probe_sequence_hit(uint16_t point, const float* position) {
+    report_probe_parameters(probe_sequence_client);
+}
+
+// Probes the x,y points of value, in work coordinates. See PROBE_SEQUENCE in config.h.
+err_t probe_sequence(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    if (sys.state != STATE_IDLE)
+        return STATUS_IDLE_ERROR;
+    if (value == NULL)
+        return STATUS_INVALID_VALUE;
+    float xy[2 * PROBE_SEQUENCE_MAX_POINTS];
+    uint16_t n_values = 0;
+    uint8_t char_counter = 0;
+    while (value[char_counter] != '\0') {
+        if (n_values == 2 * PROBE_SEQUENCE_MAX_POINTS || !read_float(value, &char_counter, &xy[n_values]))
+            return STATUS_INVALID_VALUE;
+        n_values++;
+        if (value[char_counter] == ',')
+            char_counter++;
+        else if (value[char_counter] != '\0')
+            return STATUS_INVALID_VALUE;
+    }
+    if (n_values < 2 || (n_values & 1))
+        return STATUS_INVALID_VALUE;
+    // Work to machine coordinates, like the WCO of the status report
+    for (uint16_t i = 0; i < n_values; i++) {
+        uint8_t idx = (i & 1) ? Y_AXIS : X_AXIS;
+        xy[i] += gc_state.coord_system[idx] + gc_state.coord_offset[idx];
+    }
+    float z_floor = system_convert_axis_steps_to_mpos(sys_position, Z_AXIS) - probe_depth->get();
+    probe_sequence_client = out->client();
+    mc_probe_sequence(xy, n_values / 2, z_floor, probe_clearance->get(), probe_feed->get(), report_probe_sequence_hit);
+    return STATUS_OK;
+}
+#endif
+#ifdef HEIGHT_MAP
+// Probes the map over x0,y0,x1,y1 in work coordinates, with nx by ny points
+err_t probe_height_map(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    if (sys.state != STATE_IDLE)
+        return STATUS_IDLE_ERROR;
+    if (value == NULL)
+        return STATUS_INVALID_VALUE;
+    float values[6];
+    uint8_t char_counter = 0;
+    for (uint8_t i = 0; i < 6; i++) {
+        if (!read_float(value, &char_counter, &values[i]))
+            return STATUS_INVALID_VALUE;
+        if (value[char_counter] != ((i < 5) ? ',' : '\0'))
+            return STATUS_INVALID_VALUE;
+        char_counter++;
+    }
+    float wco_x = gc_state.coord_system[X_AXIS] + gc_state.coord_offset[X_AXIS];
+    float wco_y = gc_state.coord_system[Y_AXIS] + gc_state.coord_offset[Y_AXIS];
+    if (values[4] < 2 || values[5] < 2 || values[4] * values[5] > HEIGHT_MAP_MAX_POINTS)
+        return STATUS_INVALID_VALUE;
+    if (!height_map_probe(values[0] + wco_x, values[1] + wco_y, values[2] + wco_x, values[3] + wco_y, values[4], values[5]))
+        return STATUS_INVALID_VALUE;
+    return STATUS_OK;
+}
+// =ON and =OFF turn the compensation on and off, =CLEAR drops the map. Without a value, sends it.
+err_t height_map(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    if (value == NULL) {
+        height_map_report(out->client());
+        return STATUS_OK;
+    }
+    if (sys.state != STATE_IDLE)
+        return STATUS_IDLE_ERROR;
+    if (strcasecmp(value, "ON") == 0) {
+        if (!height_map_enable(true))
+            return STATUS_SETTING_DISABLED; // Nothing probed
+    } else if (strcasecmp(value, "OFF") == 0)
+        height_map_enable(false);
+    else if (strcasecmp(value, "CLEAR") == 0)
+        height_map_clear();
+    else
+        return STATUS_INVALID_VALUE;
+    return STATUS_OK;
+}
+#endif
+#ifdef JOG_VELOCITY
+// vx,vy,vz,... in mm/min. Axes left out do not move.
+err_t jog_velocity_command(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    if (value == NULL)
+        return STATUS_INVALID_VALUE;
+    float velocity[N_AXIS] = {};
+    uint8_t char_counter = 0;
+    for (uint8_t idx = 0; idx < N_AXIS && value[char_counter] != '\0'; idx++) {
+        if (!read_float(value, &char_counter, &velocity[idx]))
+            return STATUS_INVALID_VALUE;
+        if (value[char_counter] == ',')
+            char_counter++;
+    }
+    if (value[char_counter] != '\0')
+        return STATUS_INVALID_VALUE;
+    return jog_velocity(velocity);
+}
+#endif
 err_t showState(const char* value, auth_t auth_level, ESPResponseStream* out) {
     grbl_sendf(out->client(), "State 0x%x\r\n", sys.state);
     return STATUS_OK;
 }
+#ifdef STEPPER_ISR_PROFILE
+err_t report_stepper_isr_cycles(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    st_report_isr_cycles(out->client());
+    return STATUS_OK;
+}
+#endif
+#ifdef USE_ENCODER_FEEDBACK
+err_t report_encoders(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    encoder_report(out->client());
+    return STATUS_OK;
+}
+#endif
+err_t report_boot_times(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    boot_report_phases(out->client());
+    return STATUS_OK;
+}
+#ifdef TOOL_TABLE
+err_t report_tool_table(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    tool_table_report(out->client());
+    return STATUS_OK;
+}
+#endif
+err_t report_memory(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    report_memory_map(out->client());
+    return STATUS_OK;
+}
+err_t report_task_list(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    report_tasks(out->client());
+    return STATUS_OK;
+}
+err_t report_task_map(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    task_map_report(out->client(), true);
+    return STATUS_OK;
+}
+err_t report_starvation(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    report_starvation_counters(out->client());
+    return STATUS_OK;
+}
+err_t report_stallguard_samples(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    motors_report_stallguard_samples(out->client());
+    return STATUS_OK;
+}
+#ifdef PLANNER_PROFILE
+err_t report_planner_cycles(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    plan_report_recalculate_cycles(out->client());
+    return STATUS_OK;
+}
+#endif
+#ifdef LOOP_PROFILE
+err_t report_loop_times(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    protocol_report_loop_times(out->client());
+    return STATUS_OK;
+}
+#endif
+#ifdef BENCHMARK
+err_t run_bench_all(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    return bench_run(BENCH_ALL, value, out->client());
+}
+err_t run_bench_parse(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    return bench_run(BENCH_PARSE, value, out->client());
+}
+err_t run_bench_plan(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    return bench_run(BENCH_PLAN, value, out->client());
+}
+err_t run_bench_prep(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    return bench_run(BENCH_PREP, value, out->client());
+}
+err_t run_bench_step(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    return bench_run(BENCH_STEP, value, out->client());
+}
+err_t run_bench_report(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    return bench_run(BENCH_REPORT, value, out->client());
+}
+err_t run_bench_stream(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    return bench_stream_start(value, out->client());
+}
+#ifdef BENCH_LOOPBACK_PIN
+err_t run_bench_jitter(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    return bench_jitter_start(value, out->client());
+}
+#endif
+#endif
+#ifdef PLANNER_BLOCK_REPORT
+err_t report_planner_blocks(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    if (value == NULL) {
+        plan_report_blocks(out->client());
+        return STATUS_OK;
+    }
+    char* end;
+    uint32_t interval = strtoul(value, &end, 10);
+    if (end == value || *end != '\0')
+        return STATUS_BAD_NUMBER_FORMAT;
+    return plan_subscribe_block_report(out->client(), interval);
+}
+#endif
+#ifdef LINE_TRACE
+err_t report_line_trace(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    line_trace_report(out->client());
+    return STATUS_OK;
+}
+#endif
+#ifdef REPORT_STATUS_PUSH
+err_t subscribe_status(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    if (value == NULL)
+        return STATUS_INVALID_STATEMENT;
+    char* end;
+    uint32_t interval = strtoul(value, &end, 10);
+    uint32_t fields = RT_FIELD_ALL;
+    if (end == value)
+        return STATUS_BAD_NUMBER_FORMAT;
+    if (*end == ',') {
+        value = end + 1;
+        fields = strtoul(value, &end, 10);
+        if (end == value)
+            return STATUS_BAD_NUMBER_FORMAT;
+    }
+    if (*end != '\0')
+        return STATUS_INVALID_STATEMENT;
+    if (fields > (RT_FIELD_ALL | RT_FIELD_FRAME))
+        return STATUS_NUMBER_RANGE;
+    return report_subscribe(out->client(), interval, fields);
+}
+#endif
+#ifdef LASER_RASTER
+err_t stage_raster(const char* value, auth_t auth_level, ESPResponseStream* out) {
+    return raster_stage(value);
+}
+#endif
 err_t doJog(const char* value, auth_t auth_level, ESPResponseStream* out) {
     // For jogging, you must give gc_execute_line() a line that
     // begins with $J=.  There are several ways we can get here,
@@ -370,6 +1042,16 @@ std::map<uint8_t, const char*> ErrorCodes = {
     { STATUS_MESSAGE_FAILED , "Failed to send message", },
     { STATUS_NVS_SET_FAILED , "Failed to store setting", },
     { STATUS_AUTHENTICATION_FAILED, "Authentication failed!", },
+    { STATUS_BAD_FRAME, "Bad binary frame", },
+    { STATUS_BAD_RASTER, "Bad raster data", },
+    { STATUS_SD_COMPILED_MISMATCH, "Compiled SD file start does not match", },
+    { STATUS_OWORD_SYNTAX, "Bad O-word line", },
+    { STATUS_OWORD_UNDEFINED, "Undefined subroutine", },
+    { STATUS_OWORD_OVERFLOW, "O-word store full or nesting too deep", },
+    { STATUS_EXPRESSION_SYNTAX, "Bad expression", },
+    { STATUS_EXPRESSION_MATH, "Expression math error", },
+    { STATUS_PARAMETER_INVALID, "Bad parameter number", },
+    { STATUS_SD_QUEUE_FULL, "SD job queue full", },
 };
 
 const char* errorString(err_t errorNumber) {
@@ -413,6 +1095,9 @@ void make_grbl_commands() {
     new GrblCommand("",    "Help",  show_grbl_help, ANY_STATE);
     new GrblCommand("T",   "State", showState, ANY_STATE);
     new GrblCommand("J",   "Jog",   doJog, IDLE_OR_JOG);
+    #ifdef JOG_VELOCITY
+        new GrblCommand("JV",  "Jog/Velocity", jog_velocity_command, IDLE_OR_JOG);
+    #endif
 
     new GrblCommand("$",   "GrblSettings/List", report_normal_settings, NOT_CYCLE_OR_HOLD);
     new GrblCommand("+",   "ExtendedSettings/List", report_extended_settings, NOT_CYCLE_OR_HOLD);
@@ -426,6 +1111,9 @@ void make_grbl_commands() {
     new GrblCommand("NVX", "Settings/Erase", Setting::eraseNVS, IDLE_OR_ALARM, WA);
     new GrblCommand("V",   "Settings/Stats", Setting::report_nvs_stats, IDLE_OR_ALARM);
     new GrblCommand("#",   "GCode/Offsets",  report_ngc, IDLE_OR_ALARM);
+#ifdef TOOL_TABLE
+    new GrblCommand("TT",  "ToolTable/List", report_tool_table, IDLE_OR_ALARM);
+#endif
     new GrblCommand("H",   "Home",           home_all, IDLE_OR_ALARM);
     #ifdef HOMING_SINGLE_AXIS_COMMANDS
         new GrblCommand("HX",  "Home/X", home_x, IDLE_OR_ALARM);
@@ -445,6 +1133,66 @@ void make_grbl_commands() {
     new GrblCommand("I",   "Build/Info", get_report_build_info, IDLE_OR_ALARM);
     new GrblCommand("N",   "GCode/StartupLines", report_startup_lines, IDLE_OR_ALARM);
     new GrblCommand("RST", "Settings/Restore", restore_settings, IDLE_OR_ALARM, WA);
+    new GrblCommand(NULL,  "Settings/Begin",  begin_settings,  IDLE_OR_ALARM);
+    new GrblCommand(NULL,  "Settings/Commit", commit_settings, IDLE_OR_ALARM);
+    new GrblCommand(NULL,  "Settings/Abort",  abort_settings,  IDLE_OR_ALARM);
+    new GrblCommand(NULL,  "Settings/Export", export_settings, IDLE_OR_ALARM);
+    new GrblCommand(NULL,  "Settings/Import", import_settings, IDLE_OR_ALARM, WA);
+    new GrblCommand("SG",  "StallGuard/Samples", report_stallguard_samples, ANY_STATE);
+    new GrblCommand("ST",  "Stepper/Starvation", report_starvation, ANY_STATE);
+    new GrblCommand("BT",  "Boot/Times", report_boot_times, ANY_STATE);
+    new GrblCommand("MM",  "Memory/Map", report_memory, ANY_STATE);
+    new GrblCommand(NULL,  "Tasks",      report_task_list, ANY_STATE);
+    new GrblCommand(NULL,  "Tasks/Map",  report_task_map, ANY_STATE);
+    #ifdef USE_ENCODER_FEEDBACK
+        new GrblCommand("EF",  "Encoder/Error", report_encoders, ANY_STATE);
+    #endif
+    #ifdef STEPPER_ISR_PROFILE
+        new GrblCommand("SC",  "Stepper/ISRCycles", report_stepper_isr_cycles, ANY_STATE);
+    #endif
+    #ifdef PLANNER_PROFILE
+        new GrblCommand("PC",  "Planner/Cycles", report_planner_cycles, ANY_STATE);
+    #endif
+    #ifdef LOOP_PROFILE
+        new GrblCommand("LP",  "Protocol/LoopTimes", report_loop_times, ANY_STATE);
+    #endif
+    #ifdef BENCHMARK
+        new GrblCommand(NULL,  "Bench",        run_bench_all,    IDLE_OR_ALARM);
+        new GrblCommand(NULL,  "Bench/Parse",  run_bench_parse,  IDLE_OR_ALARM);
+        new GrblCommand(NULL,  "Bench/Plan",   run_bench_plan,   IDLE_OR_ALARM);
+        new GrblCommand(NULL,  "Bench/Prep",   run_bench_prep,   IDLE_OR_ALARM);
+        new GrblCommand(NULL,  "Bench/Step",   run_bench_step,   IDLE_OR_ALARM);
+        new GrblCommand(NULL,  "Bench/Report", run_bench_report, IDLE_OR_ALARM);
+        new GrblCommand(NULL,  "Bench/Stream", run_bench_stream, IDLE_OR_ALARM);
+        #ifdef BENCH_LOOPBACK_PIN
+            new GrblCommand(NULL,  "Bench/Jitter", run_bench_jitter, ANY_STATE);
+        #endif
+    #endif
+    #ifdef PLANNER_BLOCK_REPORT
+        new GrblCommand("PB",  "Planner/Buffer", report_planner_blocks, ANY_STATE);
+    #endif
+    #ifdef LINE_TRACE
+        new GrblCommand("LT",  "Report/LineTrace", report_line_trace, ANY_STATE);
+    #endif
+    #ifdef REPORT_STATUS_PUSH
+        new GrblCommand("RI",  "Report/Interval", subscribe_status, ANY_STATE);
+    #endif
+    #ifdef LASER_RASTER
+        new GrblCommand("R",   "Laser/Raster", stage_raster, ANY_STATE);
+    #endif
+    #ifdef SPINDLE_TACH_PIN
+        new GrblCommand(NULL,  "Spindle/Calibrate", calibrate_spindle, IDLE_OR_ALARM);
+    #endif
+    #ifdef SPINDLE_CAPTURE
+        new GrblCommand(NULL,  "Spindle/Capture", capture_spindle, ANY_STATE);
+    #endif
+    #ifdef PROBE_SEQUENCE
+        new GrblCommand(NULL,  "Probe/Sequence", probe_sequence, IDLE_OR_ALARM);
+    #endif
+    #ifdef HEIGHT_MAP
+        new GrblCommand(NULL,  "HeightMap", height_map, IDLE_OR_ALARM);
+        new GrblCommand(NULL,  "HeightMap/Probe", probe_height_map, IDLE_OR_ALARM);
+    #endif
 };
 
 // normalize_key puts a key string into canonical form -
@@ -480,6 +1228,25 @@ char *normalize_key(char *start) {
     return start;
 }
 
+// Sets s, found by its compatible name, or displays it in compatible mode without a value.
+static err_t do_grbl_setting(Setting* s, char* value, auth_t auth_level, ESPResponseStream* out) {
+    if (auth_failed(s, value, auth_level)) {
+        return STATUS_AUTHENTICATION_FAILED;
+    }
+    if (value) {
+        return set_setting(s, value);
+    }
+    show_setting(s->getGrblName(), s->getCompatibleValue(), NULL, out);
+    return STATUS_OK;
+}
+
+static err_t do_command(Command* cp, char* value, auth_t auth_level, ESPResponseStream* out) {
+    if (auth_failed(cp, value, auth_level)) {
+        return STATUS_AUTHENTICATION_FAILED;
+    }
+    return cp->action(value, auth_level, out);
+}
+
 // This is the handler for all forms of settings commands,
 // $..= and [..], with and without a value.
 err_t do_command_or_setting(const char *key, char *value, auth_t auth_level, ESPResponseStream* out) {
@@ -489,51 +1256,46 @@ err_t do_command_or_setting(const char *key, char *value, auth_t auth_level, ESP
     // $key= with nothing following the = .  It is important to distinguish
     // those cases so that you can say "$N0=" to clear a startup line.
 
-    // First search the settings list by text name.  If found, set a new
+#ifdef ESP_COMMAND_TABLE
+    // ESPnnn is only ever a compatible name, and partial matches do not apply to it
+    int number = esp_slots ? esp_number(key) : -1;
+    if (number >= 0) {
+        if (!esp_slots[number]) {
+            return STATUS_INVALID_STATEMENT;
+        }
+        const esp_word_t* esp = &esp_words[esp_slots[number] - 1];
+        return esp->setting ? do_grbl_setting(static_cast<Setting*>(esp->word), value, auth_level, out)
+                            : do_command(static_cast<Command*>(esp->word), value, auth_level, out);
+    }
+#endif
+
+    // First search the settings by text name.  If found, set a new
     // value if one is given, otherwise display the current value
-    for (Setting *s = Setting::List; s; s = s->next()) {
-        if (strcasecmp(s->getName(), key) == 0) {
-            if (auth_failed(s, value, auth_level)) {
-                return STATUS_AUTHENTICATION_FAILED;
-            }
-            if (value) {
-                return s->setStringValue(value);
-            } else {
-                show_setting(s->getName(), s->getStringValue(), NULL, out);
-                return STATUS_OK;
-            }
+    Setting *s = find_setting(key);
+    if (s) {
+        if (auth_failed(s, value, auth_level)) {
+            return STATUS_AUTHENTICATION_FAILED;
+        }
+        if (value) {
+            return set_setting(s, value);
+        } else {
+            show_setting(s->getName(), s->getStringValue(), NULL, out);
+            return STATUS_OK;
         }
     }
 
-    // Then search the setting list by compatible name.  If found, set a new
+    // Then search the settings by compatible name.  If found, set a new
     // value if one is given, otherwise display the current value in compatible mode
-    for (Setting *s = Setting::List; s; s = s->next()) {
-        if (s->getGrblName() && strcasecmp(s->getGrblName(), key) == 0) {
-            if (auth_failed(s, value, auth_level)) {
-                return STATUS_AUTHENTICATION_FAILED;
-            }
-            if (value) {
-                return s->setStringValue(value);
-            } else {
-                show_setting(s->getGrblName(), s->getCompatibleValue(), NULL, out);
-                return STATUS_OK;
-            }
-        }
+    s = find_grbl_setting(key);
+    if (s) {
+        return do_grbl_setting(s, value, auth_level, out);
     }
     // If we did not find a setting, look for a command.  Commands
     // handle values internally; you cannot determine whether to set
     // or display solely based on the presence of a value.
-    for (Command *cp = Command::List; cp; cp = cp->next()) {
-        if (  (strcasecmp(cp->getName(), key) == 0)
-           || (cp->getGrblName()
-               && strcasecmp(cp->getGrblName(), key) == 0
-              )
-           ) {
-            if (auth_failed(cp, value, auth_level)) {
-                return STATUS_AUTHENTICATION_FAILED;
-            }
-            return cp->action(value, auth_level, out);
-        }
+    Command *cp = find_command(key);
+    if (cp) {
+        return do_command(cp, value, auth_level, out);
     }
 
     // If we did not find an exact match and there is no value,
@@ -605,7 +1367,8 @@ uint8_t system_execute_line(char* line, ESPResponseStream* out, auth_t auth_leve
     return do_command_or_setting(key, value, auth_level, out);
 }
 uint8_t system_execute_line(char* line, uint8_t client, auth_t auth_level) {
-    return system_execute_line(line, new ESPResponseStream(client, true), auth_level);
+    ESPResponseStream out(client, true);
+    return system_execute_line(line, &out, auth_level);
 }
 
 void system_execute_startup(char* line) {
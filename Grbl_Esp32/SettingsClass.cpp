@@ -1,6 +1,8 @@
 #include "grbl.h"
 #include "JSONencoder.h"
 #include <map>
+#include <vector>
+#include <new>
 #include "nvs.h"
 
 Word::Word(type_t type, permissions_t permissions, const char* description, const char* grblName, const char* fullName)
@@ -46,6 +48,54 @@ Setting::Setting(const char* description, type_t type, permissions_t permissions
     }
 }
 
+bool Setting::_staging = false;
+uint8_t Setting::_changedDependents = SETTING_DEP_NONE;
+uint8_t Setting::_changedAxes = 0;
+
+// Stores a new current value, or leaves it for commit() if a transaction is open.
+err_t Setting::changed() {
+    if (_dependents) {
+        _changedDependents |= _dependents;
+        if (_axis != NO_AXIS)
+            _changedAxes |= bit(_axis);
+    }
+    if (_staging) {
+        _staged = true;
+        return STATUS_OK;
+    }
+    return store();
+}
+
+// Opens a settings transaction. New values take effect at once, but are
+// kept in RAM until commit(), so a batch of changes writes each key once.
+void Setting::begin_transaction() {
+    _staging = true;
+}
+
+// Stores the value of a setting changed in the transaction.
+err_t Setting::commit() {
+    _staged = false;
+    return store();
+}
+
+// Returns a setting changed in the transaction to its stored value.
+void Setting::abort() {
+    _staged = false;
+    load();
+}
+
+uint8_t Setting::take_changes(uint8_t* axes) {
+    uint8_t dependents = _changedDependents;
+    *axes = _changedAxes;
+    _changedDependents = SETTING_DEP_NONE;
+    _changedAxes = 0;
+    return dependents;
+}
+
+void Setting::end_transaction() {
+    _staging = false;
+}
+
 err_t Setting::check(char *s) {
     if (sys.state != STATE_IDLE && !(sys.state & STATE_ALARM)) {
         return STATUS_IDLE_ERROR;
@@ -66,6 +116,202 @@ void Setting::init() {
     }
 }
 
+#ifdef SETTINGS_NVS_BLOB
+// The stored settings are also packed into one NVS blob, so that a boot reads them all
+// with a single nvs_get_blob() instead of a lookup per key. The per-key entries remain
+// the authority. Changing a setting writes its key and erases the blob, and the next
+// boot loads by key and packs a new blob from what it read.
+//
+// The blob is a header followed by an entry per stored key, in Setting::List order:
+// key length, key, value type, value length (2 bytes), value.
+#define SETTINGS_BLOB_KEY "_blob"
+#define SETTINGS_BLOB_VERSION 1
+
+typedef struct {
+    uint32_t version;
+    uint32_t keys_hash; // Of all the setting keys, so a blob from other firmware is not used
+} settings_blob_header_t;
+
+enum : uint8_t {
+    BLOB_I32 = 1,
+    BLOB_I8,
+    BLOB_STR,
+};
+
+static bool blob_valid = false;       // The blob in NVS matches the per-key entries
+static uint8_t* blob_data = NULL;     // The blob being read by load_settings()
+static size_t blob_size = 0;
+static size_t blob_cursor = 0;        // Where the next key is likely to be
+static bool blob_packing = false;     // Loading by key, packing what is read into blob_out
+static std::vector<uint8_t> blob_out;
+
+static uint32_t blob_keys_hash() {
+    uint32_t hash = 2166136261; // FNV-1a
+    for (Setting* s = Setting::List; s; s = s->next()) {
+        for (const char* p = s->getKeyName(); *p; p++)
+            hash = (hash ^ (uint8_t)*p) * 16777619;
+        hash = (hash ^ 0) * 16777619;
+    }
+    return hash;
+}
+
+// Returns the value of key in the blob being read, or NULL if it is not stored.
+static const uint8_t* blob_find(const char* key, uint8_t type, size_t* len) {
+    size_t keylen = strlen(key);
+    size_t pos = blob_cursor;
+    // Keys are looked up in the order they were packed, so the search starts where the last one
+    // ended and wraps around once.
+    for (int pass = 0; pass < 2; pass++) {
+        while (pos + 4 <= blob_size) {
+            const uint8_t* e = &blob_data[pos];
+            size_t klen = e[0];
+            if (pos + 4 + klen > blob_size)
+                return NULL;
+            size_t vlen = e[klen + 2] | (e[klen + 3] << 8);
+            size_t next = pos + 4 + klen + vlen;
+            if (next > blob_size)
+                return NULL;
+            if (klen == keylen && memcmp(&e[1], key, klen) == 0) {
+                blob_cursor = next;
+                if (e[klen + 1] != type)
+                    return NULL; // As nvs_get_*() fails on a type mismatch
+                *len = vlen;
+                return &e[klen + 4];
+            }
+            pos = next;
+        }
+        pos = sizeof(settings_blob_header_t);
+    }
+    return NULL;
+}
+
+static void blob_pack(const char* key, uint8_t type, const void* value, size_t len) {
+    size_t keylen = strlen(key);
+    blob_out.push_back(keylen);
+    blob_out.insert(blob_out.end(), key, key + keylen);
+    blob_out.push_back(type);
+    blob_out.push_back(len & 0xff);
+    blob_out.push_back(len >> 8);
+    blob_out.insert(blob_out.end(), (const uint8_t*)value, (const uint8_t*)value + len);
+}
+
+bool Setting::begin_load() {
+    uint32_t hash = blob_keys_hash();
+    size_t len = 0;
+    if (nvs_get_blob(_handle, SETTINGS_BLOB_KEY, NULL, &len) == ESP_OK && len >= sizeof(settings_blob_header_t)) {
+        blob_data = (uint8_t*)malloc(len);
+        if (blob_data && nvs_get_blob(_handle, SETTINGS_BLOB_KEY, blob_data, &len) == ESP_OK) {
+            settings_blob_header_t* header = (settings_blob_header_t*)blob_data;
+            if (header->version == SETTINGS_BLOB_VERSION && header->keys_hash == hash) {
+                blob_size = len;
+                blob_cursor = sizeof(settings_blob_header_t);
+                blob_valid = true;
+                return true;
+            }
+        }
+        free(blob_data);
+        blob_data = NULL;
+    }
+    settings_blob_header_t header = { SETTINGS_BLOB_VERSION, hash };
+    blob_out.clear();
+    blob_out.insert(blob_out.end(), (uint8_t*)&header, (uint8_t*)&header + sizeof(header));
+    blob_packing = true;
+    return false;
+}
+
+void Setting::end_load() {
+    if (blob_data) {
+        free(blob_data);
+        blob_data = NULL;
+        blob_size = 0;
+    }
+    if (blob_packing) {
+        blob_packing = false;
+        if (nvs_set_blob(_handle, SETTINGS_BLOB_KEY, blob_out.data(), blob_out.size()) == ESP_OK)
+            blob_valid = true;
+        std::vector<uint8_t>().swap(blob_out);
+    }
+}
+#endif
+
+// Called before a key is written or erased, so the blob is not used until it is packed again.
+void Setting::blob_stale() {
+#ifdef SETTINGS_NVS_BLOB
+    if (blob_valid) {
+        nvs_erase_key(_handle, SETTINGS_BLOB_KEY);
+        blob_valid = false;
+    }
+#endif
+}
+
+esp_err_t Setting::load_i32(const char* key, int32_t* value) {
+#ifdef SETTINGS_NVS_BLOB
+    if (blob_data) {
+        size_t len;
+        const uint8_t* v = blob_find(key, BLOB_I32, &len);
+        if (!v || len != sizeof(*value))
+            return ESP_ERR_NVS_NOT_FOUND;
+        memcpy(value, v, sizeof(*value));
+        return ESP_OK;
+    }
+#endif
+    esp_err_t err = nvs_get_i32(_handle, key, value);
+#ifdef SETTINGS_NVS_BLOB
+    if (!err && blob_packing)
+        blob_pack(key, BLOB_I32, value, sizeof(*value));
+#endif
+    return err;
+}
+
+esp_err_t Setting::load_i8(const char* key, int8_t* value) {
+#ifdef SETTINGS_NVS_BLOB
+    if (blob_data) {
+        size_t len;
+        const uint8_t* v = blob_find(key, BLOB_I8, &len);
+        if (!v || len != sizeof(*value))
+            return ESP_ERR_NVS_NOT_FOUND;
+        *value = (int8_t)*v;
+        return ESP_OK;
+    }
+#endif
+    esp_err_t err = nvs_get_i8(_handle, key, value);
+#ifdef SETTINGS_NVS_BLOB
+    if (!err && blob_packing)
+        blob_pack(key, BLOB_I8, value, sizeof(*value));
+#endif
+    return err;
+}
+
+esp_err_t Setting::load_str(const char* key, String* value) {
+#ifdef SETTINGS_NVS_BLOB
+    if (blob_data) {
+        size_t len;
+        const uint8_t* v = blob_find(key, BLOB_STR, &len);
+        if (!v)
+            return ESP_ERR_NVS_NOT_FOUND;
+        char buf[len + 1];
+        memcpy(buf, v, len);
+        buf[len] = '\0';
+        *value = buf;
+        return ESP_OK;
+    }
+#endif
+    size_t len = 0;
+    esp_err_t err = nvs_get_str(_handle, key, NULL, &len);
+    if (err)
+        return err;
+    char buf[len];
+    err = nvs_get_str(_handle, key, buf, &len);
+    if (err)
+        return err;
+    *value = buf;
+#ifdef SETTINGS_NVS_BLOB
+    if (blob_packing)
+        blob_pack(key, BLOB_STR, buf, strlen(buf));
+#endif
+    return ESP_OK;
+}
+
 IntSetting::IntSetting(const char *description, type_t type, permissions_t permissions, const char* grblName, const char* name, int32_t defVal, int32_t minVal, int32_t maxVal, bool (*checker)(char *) = NULL)
     : Setting(description, type, permissions, grblName, name, checker)
     , _defaultValue(defVal)
@@ -75,7 +321,7 @@ IntSetting::IntSetting(const char *description, type_t type, permissions_t permi
 { }
 
 void IntSetting::load() {
-    esp_err_t err = nvs_get_i32(_handle, _keyName, &_storedValue);
+    esp_err_t err = load_i32(_keyName, &_storedValue);
     if (err) {
         _storedValue = std::numeric_limits<int32_t>::min();
         _currentValue = _defaultValue;
@@ -87,6 +333,7 @@ void IntSetting::load() {
 void IntSetting::setDefault() {
     _currentValue = _defaultValue;
     if (_storedValue != _currentValue) {
+        blob_stale();
         nvs_erase_key(_handle, _keyName);
     }
 }
@@ -105,10 +352,16 @@ err_t IntSetting::setStringValue(char* s) {
         return STATUS_NUMBER_RANGE;
     }
     _currentValue = convertedValue;
+    return changed();
+}
+
+err_t IntSetting::store() {
     if (_storedValue != _currentValue) {
         if (_currentValue == _defaultValue) {
+            blob_stale();
             nvs_erase_key(_handle, _keyName);
         } else {
+            blob_stale();
             if (nvs_set_i32(_handle, _keyName, _currentValue)) {
                 return STATUS_NVS_SET_FAILED;
             }
@@ -138,7 +391,7 @@ AxisMaskSetting::AxisMaskSetting(const char *description, type_t type, permissio
 { }
 
 void AxisMaskSetting::load() {
-    esp_err_t err = nvs_get_i32(_handle, _keyName, &_storedValue);
+    esp_err_t err = load_i32(_keyName, &_storedValue);
     if (err) {
         _storedValue = -1;
         _currentValue = _defaultValue;
@@ -150,6 +403,7 @@ void AxisMaskSetting::load() {
 void AxisMaskSetting::setDefault() {
     _currentValue = _defaultValue;
     if (_storedValue != _currentValue) {
+        blob_stale();
         nvs_erase_key(_handle, _keyName);
     }
 }
@@ -179,10 +433,16 @@ err_t AxisMaskSetting::setStringValue(char* s) {
         }
     }
     _currentValue = convertedValue;
+    return changed();
+}
+
+err_t AxisMaskSetting::store() {
     if (_storedValue != _currentValue) {
         if (_currentValue == _defaultValue) {
+            blob_stale();
             nvs_erase_key(_handle, _keyName);
         } else {
+            blob_stale();
             if (nvs_set_i32(_handle, _keyName, _currentValue)) {
                 return STATUS_NVS_SET_FAILED;
             }
@@ -231,7 +491,7 @@ void FloatSetting::load() {
         int32_t ival;
         float   fval;
     } v;
-    if (nvs_get_i32(_handle, _keyName, &v.ival)) {
+    if (load_i32(_keyName, &v.ival)) {
         _currentValue = _defaultValue;
     } else {
         _currentValue = v.fval;
@@ -241,6 +501,7 @@ void FloatSetting::load() {
 void FloatSetting::setDefault() {
     _currentValue = _defaultValue;
     if (_storedValue != _currentValue) {
+        blob_stale();
         nvs_erase_key(_handle, _keyName);
     }
 }
@@ -263,8 +524,13 @@ err_t FloatSetting::setStringValue(char* s) {
         return STATUS_NUMBER_RANGE;
     }
     _currentValue = convertedValue;
+    return changed();
+}
+
+err_t FloatSetting::store() {
     if (_storedValue != _currentValue) {
         if (_currentValue == _defaultValue) {
+            blob_stale();
             nvs_erase_key(_handle, _keyName);
         } else {
             union {
@@ -272,6 +538,7 @@ err_t FloatSetting::setStringValue(char* s) {
                 float   fval;
             } v;
             v.fval = _currentValue;
+            blob_stale();
             if (nvs_set_i32(_handle, _keyName, v.ival)) {
                 return STATUS_NVS_SET_FAILED;
             }
@@ -303,38 +570,57 @@ StringSetting::StringSetting(const char *description, type_t type, permissions_t
     : Setting(description, type, permissions, grblName, name, checker)
 {
     _defaultValue = defVal;
-    _currentValue = defVal;
     _minLength = min;
     _maxLength = max;
+    _loaded = type != WEBSET;
+    if (_loaded) {
+        _currentValue = defVal;
+    }
  };
 
+// WEBSET settings, the WiFi, Bluetooth, notification and password strings, are
+// not needed on a machine that only uses USB, so they stay out of RAM until used.
 void StringSetting::load() {
-    size_t len = 0;
-    esp_err_t err = nvs_get_str(_handle, _keyName, NULL, &len);
-    if(err) {
-        _storedValue = _defaultValue;
-        _currentValue = _defaultValue;
+    if (_type == WEBSET) {
+        _loaded = false;
         return;
     }
-    char buf[len];
-    err = nvs_get_str(_handle, _keyName, buf, &len);
-    if (err) {
+    read();
+}
+
+void StringSetting::read() {
+    _loaded = true;
+    if (load_str(_keyName, &_storedValue)) {
         _storedValue = _defaultValue;
         _currentValue = _defaultValue;
         return;
     }
-    _storedValue = String(buf);
     _currentValue = _storedValue;
 }
 
+void StringSetting::release() {
+    if (!_loaded || _staged) {
+        return;
+    }
+    // String keeps its buffer when assigned, so rebuild the two values empty
+    _currentValue.~String();
+    new (&_currentValue) String((const char *)NULL);
+    _storedValue.~String();
+    new (&_storedValue) String((const char *)NULL);
+    _loaded = false;
+}
+
 void StringSetting::setDefault() {
+    ensureLoaded();
     _currentValue = _defaultValue;
     if (_storedValue != _currentValue) {
+        blob_stale();
         nvs_erase_key(_handle, _keyName);
     }
 }
 
 err_t StringSetting::setStringValue(char* s) {
+    ensureLoaded();
     if (_minLength && _maxLength && (strlen(s) < _minLength || strlen(s) > _maxLength)) {
         return STATUS_BAD_NUMBER_FORMAT;
     }
@@ -342,11 +628,18 @@ err_t StringSetting::setStringValue(char* s) {
         return err;
     }
    _currentValue = s;
+    return changed();
+}
+
+err_t StringSetting::store() {
+    ensureLoaded();
     if (_storedValue != _currentValue) {
         if (_currentValue == _defaultValue) {
+            blob_stale();
             nvs_erase_key(_handle, _keyName);
             _storedValue = _defaultValue;
         } else {
+            blob_stale();
             if (nvs_set_str(_handle, _keyName, _currentValue.c_str())) {
                 return STATUS_NVS_SET_FAILED;
             }
@@ -363,11 +656,16 @@ const char* StringSetting::getStringValue() {
        #ifdef ENABLE_WIFI
          _checker == (bool (*)(char *))WiFiConfig::isPasswordValid
          ||
+       #endif
+       #ifdef UDP_REALTIME
+         _checker == udp_realtime_key_valid
+         ||
        #endif
          _checker == (bool (*)(char *))COMMANDS::isLocalPasswordValid
          )) {
         return "******";
     }
+    ensureLoaded();
     return _currentValue.c_str();
 }
 
@@ -390,7 +688,7 @@ EnumSetting::EnumSetting(const char *description, type_t type, permissions_t per
 { }
 
 void EnumSetting::load() {
-    esp_err_t err = nvs_get_i8(_handle, _keyName, &_storedValue);
+    esp_err_t err = load_i8(_keyName, &_storedValue);
     if (err) {
         _storedValue = -1;
         _currentValue = _defaultValue;
@@ -402,6 +700,7 @@ void EnumSetting::load() {
 void EnumSetting::setDefault() {
     _currentValue = _defaultValue;
     if (_storedValue != _currentValue) {
+        blob_stale();
         nvs_erase_key(_handle, _keyName);
     }
 }
@@ -436,10 +735,16 @@ err_t EnumSetting::setStringValue(char* s) {
         }
     }
     _currentValue = it->second;
+    return changed();
+}
+
+err_t EnumSetting::store() {
     if (_storedValue != _currentValue) {
         if (_storedValue == _defaultValue) {
+            blob_stale();
             nvs_erase_key(_handle, _keyName);
         } else {
+            blob_stale();
             if (nvs_set_i8(_handle, _keyName, _currentValue)) {
                 return STATUS_NVS_SET_FAILED;
             }
@@ -483,7 +788,7 @@ FlagSetting::FlagSetting(const char *description, type_t type, permissions_t per
 { }
 
 void FlagSetting::load() {
-    esp_err_t err = nvs_get_i8(_handle, _keyName, &_storedValue);
+    esp_err_t err = load_i8(_keyName, &_storedValue);
     if (err) {
         _storedValue = -1;  // Neither well-formed false (0) nor true (1)
         _currentValue = _defaultValue;
@@ -494,6 +799,7 @@ void FlagSetting::load() {
 void FlagSetting::setDefault() {
     _currentValue = _defaultValue;
     if (_storedValue != _currentValue) {
+        blob_stale();
         nvs_erase_key(_handle, _keyName);
     }
 }
@@ -505,12 +811,18 @@ err_t FlagSetting::setStringValue(char* s) {
     || (strcasecmp(s, "enabled") == 0)
     || (strcasecmp(s, "yes") == 0)
     || (strcasecmp(s, "1") == 0);
+    return changed();
+}
+
+err_t FlagSetting::store() {
     // _storedValue is -1, 0, or 1
     // _currentValue is 0 or 1
     if (_storedValue != (int8_t)_currentValue) {
         if (_currentValue == _defaultValue) {
+            blob_stale();
             nvs_erase_key(_handle, _keyName);
         } else {
+            blob_stale();
             if (nvs_set_i8(_handle, _keyName, _currentValue)) {
                 return STATUS_NVS_SET_FAILED;
             }
@@ -548,7 +860,7 @@ IPaddrSetting::IPaddrSetting(const char *description, type_t type, permissions_t
 }
 
 void IPaddrSetting::load() {
-    esp_err_t err = nvs_get_i32(_handle, _keyName, (int32_t *)&_storedValue);
+    esp_err_t err = load_i32(_keyName, (int32_t *)&_storedValue);
     if (err) {
         _storedValue = 0x000000ff;  // Unreasonable value for any IP thing
         _currentValue = _defaultValue;
@@ -560,6 +872,7 @@ void IPaddrSetting::load() {
 void IPaddrSetting::setDefault() {
     _currentValue = _defaultValue;
     if (_storedValue != _currentValue) {
+        blob_stale();
         nvs_erase_key(_handle, _keyName);
     }
 }
@@ -574,10 +887,16 @@ err_t IPaddrSetting::setStringValue(char* s) {
         return STATUS_INVALID_VALUE;
     }
     _currentValue = ipaddr;
+    return changed();
+}
+
+err_t IPaddrSetting::store() {
     if (_storedValue != _currentValue) {
         if (_currentValue == _defaultValue) {
+            blob_stale();
             nvs_erase_key(_handle, _keyName);
         } else {
+            blob_stale();
             if (nvs_set_i32(_handle, _keyName, (int32_t)_currentValue)) {
                 return STATUS_NVS_SET_FAILED;
             }
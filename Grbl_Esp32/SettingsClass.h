@@ -36,6 +36,15 @@ typedef enum : uint8_t {
 } permissions_t;
 typedef uint8_t axis_t;
 
+// The subsystems that cache a setting and must refresh when it changes.
+// Settings with none, like $110, are read live or through update_hot_settings().
+typedef enum : uint8_t {
+    SETTING_DEP_NONE = 0,
+    SETTING_DEP_MOTORS = bit(0),        // The motors of the setting's axis reread their settings
+    SETTING_DEP_SPINDLE = bit(1),       // The spindle is reinitialized
+    SETTING_DEP_SPINDLE_TYPE = bit(2),  // Another spindle is selected and initialized
+} setting_dep_t;
+
 class Word {
 protected:
     const char*  _description;
@@ -75,12 +84,32 @@ protected:
     static nvs_handle _handle;
     // group_t _group;
     axis_t _axis = NO_AXIS;
+    uint8_t _dependents = SETTING_DEP_NONE;
     Setting *link;  // linked list of setting objects
 
     bool (*_checker)(char *);
     const char* _keyName;
+
+    // Reads a stored value, from the settings blob while load_settings() has it.
+    static esp_err_t load_i32(const char* key, int32_t* value);
+    static esp_err_t load_i8(const char* key, int8_t* value);
+    static esp_err_t load_str(const char* key, String* value);
+    static void blob_stale();
+
+    static bool _staging; // A settings transaction is open
+    bool _staged = false; // Changed in the transaction and not yet stored
+    static uint8_t _changedDependents; // Subsystems to refresh, see take_changes()
+    static uint8_t _changedAxes;
+    err_t changed();
 public:
     static void init();
+#ifdef SETTINGS_NVS_BLOB
+    // Bracket the load() calls of load_settings(). begin_load() returns true if
+    // the values come from the settings blob, false if they are read by key.
+    static bool begin_load();
+    static void end_load();
+#endif
+    const char* getKeyName() { return _keyName; }
     static Setting* List;
     Setting* next() { return link; }
 
@@ -105,6 +134,7 @@ public:
     }
 
     static err_t eraseNVS(const char* value, auth_t auth_level, ESPResponseStream* out) {
+        blob_stale();
         nvs_erase_all(_handle);
         //        return STATUS_OK;
         return 0;
@@ -115,6 +145,12 @@ public:
     Setting(const char *description, type_t type, permissions_t permissions, const char * grblName, const char* fullName, bool (*checker)(char *));
     axis_t getAxis() { return _axis; }
     void setAxis(axis_t axis) { _axis = axis; }
+    uint8_t getDependents() { return _dependents; }
+    void setDependents(uint8_t dependents) { _dependents = dependents; }
+
+    // Returns the dependents of the settings changed since the last call, and
+    // in axes the axes of those settings, then forgets them.
+    static uint8_t take_changes(uint8_t* axes);
 
     // load() reads the backing store to get the current
     // value of the setting.  This could be slow so it
@@ -126,6 +162,19 @@ public:
     // Derived classes may override it to do something.
     virtual void addWebui(JSONencoder *) {};
 
+    // store() writes the current value to the backing store if it differs
+    // from the stored one. setStringValue() calls it through changed(), or
+    // leaves it for commit() while a transaction is open.
+    virtual err_t store() { return STATUS_OK; }
+
+    // Settings transactions. See settings_begin() and settings_commit().
+    static void begin_transaction();
+    static void end_transaction();
+    static bool in_transaction() { return _staging; }
+    bool isStaged() { return _staged; }
+    err_t commit();
+    void abort();
+
     virtual err_t setStringValue(char* value) =0;
     err_t setStringValue(String s) {  return setStringValue(s.c_str());  }
     virtual const char* getStringValue() =0;
@@ -151,6 +200,7 @@ public:
     void setDefault();
     void addWebui(JSONencoder *);
     err_t setStringValue(char* value);
+    err_t store();
     const char* getStringValue();
 
     int32_t get() {  return _currentValue;  }
@@ -173,6 +223,7 @@ public:
     void setDefault();
     void addWebui(JSONencoder *);
     err_t setStringValue(char* value);
+    err_t store();
     const char* getCompatibleValue();
     const char* getStringValue();
 
@@ -198,6 +249,7 @@ public:
     // There are no Float settings in WebUI
     void addWebui(JSONencoder *) {}
     err_t setStringValue(char* value);
+    err_t store();
     const char* getStringValue();
 
     float get() {  return _currentValue;  }
@@ -211,7 +263,14 @@ private:
     String _storedValue;
     int _minLength;
     int _maxLength;
+    bool _loaded;  // WEBSET values are read from NVS on first use, see load()
     void _setStoredValue(const char *s);
+    void read();
+    void ensureLoaded() {
+        if (!_loaded) {
+            read();
+        }
+    }
 public:
     StringSetting(const char *description, type_t type, permissions_t permissions, const char* grblName, const char* name, const char* defVal, int min, int max, bool (*checker)(char *));
 
@@ -223,9 +282,13 @@ public:
     void setDefault();
     void addWebui(JSONencoder *);
     err_t setStringValue(char* value);
+    err_t store();
     const char* getStringValue();
 
-    const char* get() { return _currentValue.c_str();  }
+    // Frees the strings of a setting whose service is off. The next use reads it again.
+    void release();
+
+    const char* get() { ensureLoaded(); return _currentValue.c_str();  }
 };
 struct cmp_str
 {
@@ -253,6 +316,7 @@ public:
     void setDefault();
     void addWebui(JSONencoder *);
     err_t setStringValue(char* value);
+    err_t store();
     const char* getStringValue();
 
     int8_t get() { return _currentValue;  }
@@ -275,6 +339,7 @@ public:
     // The booleans are expressed as Enums
     void addWebui(JSONencoder *) {}
     err_t setStringValue(char* value);
+    err_t store();
     const char* getCompatibleValue();
     const char* getStringValue();
 
@@ -295,6 +360,7 @@ public:
     void setDefault();
     void addWebui(JSONencoder *);
     err_t setStringValue(char* value);
+    err_t store();
     const char* getStringValue();
 
     uint32_t get() {  return _currentValue;  }
@@ -311,6 +377,13 @@ public:
     FloatSetting *hold_current;
     IntSetting *microsteps;
     IntSetting *stallguard;
+#ifdef INPUT_SHAPING
+    FloatSetting *shaper_frequency;
+    FloatSetting *shaper_damping;
+#endif
+#ifdef BACKLASH_COMPENSATION
+    FloatSetting *backlash;
+#endif
 
     AxisSettings(const char *axisName);
 };
@@ -1,19 +1,108 @@
 #include "grbl.h"
 
-bool motorSettingChanged = false;
+static hot_settings_t hot_settings_copies[2];
+const hot_settings_t* volatile hot_settings = &hot_settings_copies[0];
+
+// NOTE: There is a single writer, the task processing settings commands. A reader that holds the
+// published copy across two updates could see the second one being written, but readers only hold
+// it for the length of an ISR call or a block computation.
+void update_hot_settings() {
+    hot_settings_t* next = (hot_settings == &hot_settings_copies[0]) ? &hot_settings_copies[1] : &hot_settings_copies[0];
+    next->pulse_microseconds = pulse_microseconds->get();
+    next->direction_setup_microseconds = direction_setup_microseconds->get();
+    next->idle_lock_time = stepper_idle_lock_time->get();
+    next->step_enable_invert = step_enable_invert->get();
+    next->step_invert_mask = step_invert_mask->get();
+    next->dir_invert_mask = dir_invert_mask->get();
+    next->accel_profile = accel_profile->get();
+    next->machine_type = machineType->get();
+    next->limit_enable_mask = limitSwitch->get();
+    next->limit_invert_mask = limitType->get();
+    next->soft_limits = soft_limits->get();
+    next->arc_adaptive = arc_adaptive->get();
+    next->arc_tolerance = arc_tolerance->get();
+    next->junction_deviation = junction_deviation->get();
+    next->planner_merge_tolerance = planner_merge_tolerance->get();
+#ifdef INPUT_SHAPING
+    next->shaper_type = shaper_type->get();
+    for (uint8_t idx = 0; idx < N_AXIS; idx++) {
+        next->shaper_frequency[idx] = axis_settings[idx]->shaper_frequency->get();
+        next->shaper_damping[idx] = axis_settings[idx]->shaper_damping->get();
+    }
+#endif
+#ifdef BACKLASH_COMPENSATION
+    for (uint8_t idx = 0; idx < N_AXIS; idx++) {
+        float steps_per_mm = axis_settings[idx]->steps_per_mm->get();
+        next->backlash_steps[idx] = lroundf(axis_settings[idx]->backlash->get() * steps_per_mm);
+        next->backlash_rate[idx] = axis_settings[idx]->max_rate->get() * steps_per_mm;
+    }
+#endif
+    for (uint8_t idx = 0; idx < N_AXIS; idx++) {
+        float travel = axis_settings[idx]->max_travel->get();
+#ifdef HOMING_FORCE_SET_ORIGIN
+        // When homing forced set origin is enabled, soft limits checks need to account for directionality.
+        bool positive = bit_istrue(homing_dir_mask->get(), bit(idx));
+#elif defined(HOMING_FORCE_POSITIVE_SPACE)
+        bool positive = true;
+#else
+        bool positive = false;
+#endif
+        next->travel_min[idx] = positive ? 0.0f : -travel;
+        next->travel_max[idx] = positive ? travel : 0.0f;
+    }
+    __atomic_store_n(&hot_settings, next, __ATOMIC_RELEASE);
+    update_axis_limits();
+}
 
 StringSetting* startup_line_0;
 StringSetting* startup_line_1;
 StringSetting* build_info;
 
 IntSetting* pulse_microseconds;
+IntSetting* direction_setup_microseconds;
 IntSetting* stepper_idle_lock_time;
+IntSetting* stepper_segments;
+IntSetting* planner_blocks;
+IntSetting* serial_rx_buffer;
+IntSetting* client_line_rate;
+IntSetting* task_class_core[TASK_CLASS_COUNT];
+IntSetting* task_class_priority[TASK_CLASS_COUNT];
+#ifdef USE_I2S_OUT_STREAM
+IntSetting* i2s_pulse_usec;
+IntSetting* i2s_dmabuf_count;
+IntSetting* i2s_dmabuf_len;
+#endif
+FloatSetting* planner_merge_tolerance;
 
 AxisMaskSetting* step_invert_mask;
 AxisMaskSetting* dir_invert_mask;
 // TODO Settings - need to call st_generate_step_invert_masks;
 AxisMaskSetting* homing_dir_mask;
 AxisMaskSetting* stallguard_debug_mask;
+IntSetting* stallguard_sample_rate;
+#ifdef USE_ENCODER_FEEDBACK
+FloatSetting* encoder_max_error;
+#endif
+#ifdef USE_MPG
+EnumSetting* mpg_axis;
+FloatSetting* mpg_step;
+FloatSetting* mpg_rate;
+enum_opt_t mpgAxes = {
+    { "OFF", MPG_AXIS_OFF, },
+    { "X", X_AXIS, },
+    { "Y", Y_AXIS, },
+    { "Z", Z_AXIS, },
+#if (N_AXIS > A_AXIS)
+    { "A", A_AXIS, },
+#endif
+#if (N_AXIS > B_AXIS)
+    { "B", B_AXIS, },
+#endif
+#if (N_AXIS > C_AXIS)
+    { "C", C_AXIS, },
+#endif
+};
+#endif
 
 FlagSetting* step_enable_invert;
 FlagSetting* limit_invert;
@@ -31,6 +120,7 @@ FlagSetting* laser_mode;
 IntSetting* status_mask;
 FloatSetting* junction_deviation;
 FloatSetting* arc_tolerance;
+FlagSetting* arc_adaptive;
 
 FloatSetting* homing_feed_rate;
 FloatSetting* homing_seek_rate;
@@ -44,6 +134,31 @@ FloatSetting* spindle_pwm_off_value;
 FloatSetting* spindle_pwm_min_value;
 FloatSetting* spindle_pwm_max_value;
 IntSetting* spindle_pwm_bit_precision;
+StringSetting* spindle_curve;
+FloatSetting* spindle_besc_ramp_time;
+#ifdef SPINDLE2_TYPE
+EnumSetting* spindle2_type;
+IntSetting* spindle2_tool;
+FloatSetting* spindle2_rpm_min;
+FloatSetting* spindle2_rpm_max;
+#endif
+#ifdef PROBE_SEQUENCE
+FloatSetting* probe_feed;
+FloatSetting* probe_depth;
+FloatSetting* probe_clearance;
+#endif
+#ifdef TOOL_CHANGE_SEQUENCE
+FloatSetting* tool_change_x;
+FloatSetting* tool_change_y;
+FloatSetting* tool_change_z;
+FlagSetting* tool_change_probe_enable;
+FloatSetting* tool_change_probe_x;
+FloatSetting* tool_change_probe_y;
+FloatSetting* tool_change_probe_z;
+FloatSetting* tool_change_probe_depth;
+FloatSetting* tool_change_probe_feed;
+FloatSetting* tool_change_probe_reference;
+#endif
 
 IntSetting* xboard_em_pwm_hold_val;// [XBoard]
 FloatSetting* xboard_servo_max_angle;// [XBoard]
@@ -58,6 +173,9 @@ enum_opt_t spindleTypes = {
     { "LASER", SPINDLE_TYPE_LASER, },
     { "DAC", SPINDLE_TYPE_DAC, },
     { "HUANYANG", SPINDLE_TYPE_HUANYANG, },
+    { "H100", SPINDLE_TYPE_H100, },
+    { "YL620", SPINDLE_TYPE_YL620, },
+    { "DELTA", SPINDLE_TYPE_DELTA, },
     { "BESC", SPINDLE_TYPE_BESC, },
     { "10V", SPINDLE_TYPE_10V, },
     { "EM", SPINDLE_TYPE_XB_EM, },// [XBoard]
@@ -70,6 +188,20 @@ enum_opt_t machineTypes = {
     { "CoreXY", MACHINE_COREXY},// [XBoard]
 };
 
+EnumSetting* accel_profile;
+enum_opt_t accelProfiles = {
+    { "Trapezoid", ACCEL_PROFILE_TRAPEZOID, },
+    { "Smoothstep", ACCEL_PROFILE_SMOOTHSTEP, },
+};
+
+#ifdef INPUT_SHAPING
+EnumSetting* shaper_type;
+enum_opt_t shaperTypes = {
+    { "ZV", SHAPER_ZV, },
+    { "ZVD", SHAPER_ZVD, },
+};
+#endif
+
 EnumSetting* limitSwitch;
 // N:NC, ZYX
 enum_opt_t limitSwitchs = {
@@ -115,6 +247,9 @@ typedef struct {
     float hold_current;
     uint16_t microsteps;
     uint16_t stallguard;
+    float shaper_frequency;
+    float shaper_damping;
+    float backlash;
 } axis_defaults_t;
 axis_defaults_t axis_defaults[] = {
     {
@@ -126,7 +261,10 @@ axis_defaults_t axis_defaults[] = {
         DEFAULT_X_CURRENT,
         DEFAULT_X_HOLD_CURRENT,
         DEFAULT_X_MICROSTEPS,
-        DEFAULT_X_STALLGUARD
+        DEFAULT_X_STALLGUARD,
+        DEFAULT_X_SHAPER_FREQUENCY,
+        DEFAULT_X_SHAPER_DAMPING,
+        DEFAULT_X_BACKLASH
     },
     {
         "Y",
@@ -137,7 +275,10 @@ axis_defaults_t axis_defaults[] = {
         DEFAULT_Y_CURRENT,
         DEFAULT_Y_HOLD_CURRENT,
         DEFAULT_Y_MICROSTEPS,
-        DEFAULT_Y_STALLGUARD
+        DEFAULT_Y_STALLGUARD,
+        DEFAULT_Y_SHAPER_FREQUENCY,
+        DEFAULT_Y_SHAPER_DAMPING,
+        DEFAULT_Y_BACKLASH
     },
     {
         "Z",
@@ -148,7 +289,10 @@ axis_defaults_t axis_defaults[] = {
         DEFAULT_Z_CURRENT,
         DEFAULT_Z_HOLD_CURRENT,
         DEFAULT_Z_MICROSTEPS,
-        DEFAULT_Z_STALLGUARD
+        DEFAULT_Z_STALLGUARD,
+        DEFAULT_Z_SHAPER_FREQUENCY,
+        DEFAULT_Z_SHAPER_DAMPING,
+        DEFAULT_Z_BACKLASH
     },
     {
         "A",
@@ -159,7 +303,10 @@ axis_defaults_t axis_defaults[] = {
         DEFAULT_A_CURRENT,
         DEFAULT_A_HOLD_CURRENT,
         DEFAULT_A_MICROSTEPS,
-        DEFAULT_A_STALLGUARD
+        DEFAULT_A_STALLGUARD,
+        DEFAULT_A_SHAPER_FREQUENCY,
+        DEFAULT_A_SHAPER_DAMPING,
+        DEFAULT_A_BACKLASH
     },
     {
         "B",
@@ -170,7 +317,10 @@ axis_defaults_t axis_defaults[] = {
         DEFAULT_B_CURRENT,
         DEFAULT_B_HOLD_CURRENT,
         DEFAULT_B_MICROSTEPS,
-        DEFAULT_B_STALLGUARD
+        DEFAULT_B_STALLGUARD,
+        DEFAULT_B_SHAPER_FREQUENCY,
+        DEFAULT_B_SHAPER_DAMPING,
+        DEFAULT_B_BACKLASH
     },
     {
         "C",
@@ -181,7 +331,10 @@ axis_defaults_t axis_defaults[] = {
         DEFAULT_C_CURRENT,
         DEFAULT_C_HOLD_CURRENT,
         DEFAULT_C_MICROSTEPS,
-        DEFAULT_C_STALLGUARD
+        DEFAULT_C_STALLGUARD,
+        DEFAULT_C_SHAPER_FREQUENCY,
+        DEFAULT_C_SHAPER_DAMPING,
+        DEFAULT_C_BACKLASH
     }
 };
 
@@ -196,45 +349,26 @@ static const char *makename(const char *axisName, const char *tail) {
     return strcat(retval, tail);
 }
 
+static bool checkSpindleCurve(char* value) {
+    float rpm[SPINDLE_CURVE_MAX_POINTS];
+    float percent[SPINDLE_CURVE_MAX_POINTS];
+    int points = spindle_parse_curve(value, rpm, percent, SPINDLE_CURVE_MAX_POINTS);
+    return points == 0 || points >= 2;
+}
+
 static bool checkStartupLine(char* value) {
     if (sys.state != STATE_IDLE)
         return STATUS_IDLE_ERROR;
     return gc_execute_line(value, CLIENT_SERIAL) == 0;
 }
 
-static bool checkStallguard(char* value) {
-    motorSettingChanged = true;
-    return true;
-}
-
-static bool checkMicrosteps(char* value) {
-    motorSettingChanged = true;
-    return true;
-}
-
-static bool checkRunCurrent(char* value) {
-    motorSettingChanged = true;
-    return true;
-}
-
-static bool checkHoldcurrent(char* value) {
-    motorSettingChanged = true;
-    return true;
-}
-
-
-static bool checkStallguardDebugMask(char* val) {
-    motorSettingChanged = true;
-    return true;
-}
-
 // Generates a string like "122" from axisNum 2 and base 120
 static const char* makeGrblName(int axisNum, int base) {
     // To omit A,B,C axes:
     // if (axisNum > 2) return NULL;
     char buf[4];
     snprintf(buf, 4, "%d", axisNum + base);
-    char* retval = (char*)malloc(strlen(buf));
+    char* retval = (char*)malloc(strlen(buf) + 1);
     return strcpy(retval, buf);
 }
 
@@ -255,28 +389,54 @@ void make_settings() {
     a_axis_settings = axis_settings[A_AXIS];
     b_axis_settings = axis_settings[B_AXIS];
     c_axis_settings = axis_settings[C_AXIS];
+#ifdef INPUT_SHAPING
     for (axis = N_AXIS - 1; axis >= 0; axis--) {
         def = &axis_defaults[axis];
-        auto setting = new IntSetting(EXTENDED, WG, makeGrblName(axis, 170), makename(def->name, "StallGuard"), def->stallguard, -64, 63, checkStallguard);
+        auto setting = new FloatSetting(EXTENDED, WG, makeGrblName(axis, 190), makename(def->name, "Shaper/Damping"), def->shaper_damping, 0.0, INPUT_SHAPING_MAX_DAMPING);
         setting->setAxis(axis);
+        axis_settings[axis]->shaper_damping = setting;
+    }
+    for (axis = N_AXIS - 1; axis >= 0; axis--) {
+        def = &axis_defaults[axis];
+        auto setting = new FloatSetting(EXTENDED, WG, makeGrblName(axis, 180), makename(def->name, "Shaper/Frequency"), def->shaper_frequency, 0.0, INPUT_SHAPING_MAX_FREQUENCY); // Hz
+        setting->setAxis(axis);
+        axis_settings[axis]->shaper_frequency = setting;
+    }
+#endif
+#ifdef BACKLASH_COMPENSATION
+    for (axis = N_AXIS - 1; axis >= 0; axis--) {
+        def = &axis_defaults[axis];
+        auto setting = new FloatSetting(EXTENDED, WG, makeGrblName(axis, 200), makename(def->name, "Backlash"), def->backlash, 0.0, BACKLASH_MAX); // mm
+        setting->setAxis(axis);
+        axis_settings[axis]->backlash = setting;
+    }
+#endif
+    for (axis = N_AXIS - 1; axis >= 0; axis--) {
+        def = &axis_defaults[axis];
+        auto setting = new IntSetting(EXTENDED, WG, makeGrblName(axis, 170), makename(def->name, "StallGuard"), def->stallguard, -64, 63);
+        setting->setAxis(axis);
+        setting->setDependents(SETTING_DEP_MOTORS);
         axis_settings[axis]->stallguard = setting;
     }
     for (axis = N_AXIS - 1; axis >= 0; axis--) {
         def = &axis_defaults[axis];
-        auto setting = new IntSetting(EXTENDED, WG, makeGrblName(axis, 160), makename(def->name, "Microsteps"), def->microsteps, 0, 256, checkMicrosteps);
+        auto setting = new IntSetting(EXTENDED, WG, makeGrblName(axis, 160), makename(def->name, "Microsteps"), def->microsteps, 0, 256);
         setting->setAxis(axis);
+        setting->setDependents(SETTING_DEP_MOTORS);
         axis_settings[axis]->microsteps = setting;
     }
     for (axis = N_AXIS - 1; axis >= 0; axis--) {
         def = &axis_defaults[axis];
-        auto setting = new FloatSetting(EXTENDED, WG, makeGrblName(axis, 150), makename(def->name, "Current/Hold"), def->hold_current, 0.05, 20.0, checkHoldcurrent); // Amps
+        auto setting = new FloatSetting(EXTENDED, WG, makeGrblName(axis, 150), makename(def->name, "Current/Hold"), def->hold_current, 0.05, 20.0); // Amps
         setting->setAxis(axis);
+        setting->setDependents(SETTING_DEP_MOTORS);
         axis_settings[axis]->hold_current = setting;
     }
     for (axis = N_AXIS - 1; axis >= 0; axis--) {
         def = &axis_defaults[axis];
-        auto setting = new FloatSetting(EXTENDED, WG, makeGrblName(axis, 140), makename(def->name, "Current/Run"), def->run_current, 0.0, 20.0, checkRunCurrent); // Amps
+        auto setting = new FloatSetting(EXTENDED, WG, makeGrblName(axis, 140), makename(def->name, "Current/Run"), def->run_current, 0.0, 20.0); // Amps
         setting->setAxis(axis);
+        setting->setDependents(SETTING_DEP_MOTORS);
         axis_settings[axis]->run_current = setting;
     }
     for (axis = N_AXIS - 1; axis >= 0; axis--) {
@@ -310,6 +470,15 @@ void make_settings() {
     spindle_pwm_off_value = new FloatSetting(EXTENDED, WG, "34", "Spindle/PWM/Off", DEFAULT_SPINDLE_OFF_VALUE, 0.0, 100.0); // these are percentages
     // IntSetting spindle_pwm_bit_precision(EXTENDED, WG, "Spindle/PWM/Precision", DEFAULT_SPINDLE_BIT_PRECISION, 1, 16);
     spindle_pwm_freq = new FloatSetting(EXTENDED, WG, "33", "Spindle/PWM/Frequency", DEFAULT_SPINDLE_FREQ, 0, 100000);
+    spindle_pwm_max_value->setDependents(SETTING_DEP_SPINDLE);
+    spindle_pwm_min_value->setDependents(SETTING_DEP_SPINDLE);
+    spindle_pwm_off_value->setDependents(SETTING_DEP_SPINDLE);
+    spindle_pwm_freq->setDependents(SETTING_DEP_SPINDLE);
+    // Duty percent at measured speeds, for spindles whose speed is not linear in the duty
+    spindle_curve = new StringSetting(EXTENDED, WG, NULL, "Spindle/Curve", DEFAULT_SPINDLE_CURVE, checkSpindleCurve);
+    spindle_curve->setDependents(SETTING_DEP_SPINDLE);
+    spindle_besc_ramp_time = new FloatSetting(EXTENDED, WG, NULL, "Spindle/BESC/RampTime", DEFAULT_SPINDLE_BESC_RAMP_TIME, 0, 60);
+    spindle_besc_ramp_time->setDependents(SETTING_DEP_SPINDLE);
 
     // GRBL Non-numbered settings
     startup_line_0 = new StringSetting(GRBL, WG, "N0", "GCode/Line0", "", checkStartupLine);
@@ -320,6 +489,8 @@ void make_settings() {
     // TODO Settings - also need to call my_spindle->init();
     rpm_min = new FloatSetting(GRBL, WG, "31", "GCode/MinS", DEFAULT_SPINDLE_RPM_MIN, 0, 100000);
     rpm_max = new FloatSetting(GRBL, WG, "30", "GCode/MaxS", DEFAULT_SPINDLE_RPM_MAX, 0, 100000);
+    rpm_min->setDependents(SETTING_DEP_SPINDLE);
+    rpm_max->setDependents(SETTING_DEP_SPINDLE);
 
 
     homing_pulloff = new FloatSetting(GRBL, WG, "27", "Homing/Pulloff", DEFAULT_HOMING_PULLOFF, 0, 1000);
@@ -349,13 +520,85 @@ void make_settings() {
     step_invert_mask = new AxisMaskSetting(GRBL, WG, "2", "Stepper/StepInvert", DEFAULT_STEPPING_INVERT_MASK);
     stepper_idle_lock_time = new IntSetting(GRBL, WG, "1", "Stepper/IdleTime", DEFAULT_STEPPER_IDLE_LOCK_TIME, 0, 255);
     pulse_microseconds = new IntSetting(GRBL, WG, "0", "Stepper/Pulse", DEFAULT_STEP_PULSE_MICROSECONDS, 3, 1000);
+    // Set to the longest direction setup time of the drivers. Only delays steps after a reversal.
+    direction_setup_microseconds = new IntSetting(EXTENDED, WG, NULL, "Stepper/DirSetup", DEFAULT_DIRECTION_SETUP_MICROSECONDS, 0, 100);
     spindle_type = new EnumSetting(NULL, EXTENDED, WG, NULL, "Spindle/Type", SPINDLE_TYPE_NONE, &spindleTypes);
-    machineType = new EnumSetting(NULL, EXTENDED, WG, NULL, "Machine/Type", MACHINE_XYZ, &machineTypes);
+    spindle_type->setDependents(SETTING_DEP_SPINDLE_TYPE);
+#ifdef SPINDLE2_TYPE
+    spindle2_rpm_max = new FloatSetting(EXTENDED, WG, NULL, "Spindle2/MaxS", DEFAULT_SPINDLE2_RPM_MAX, 0, 100000);
+    spindle2_rpm_max->setDependents(SETTING_DEP_SPINDLE);
+    spindle2_rpm_min = new FloatSetting(EXTENDED, WG, NULL, "Spindle2/MinS", DEFAULT_SPINDLE2_RPM_MIN, 0, 100000);
+    spindle2_rpm_min->setDependents(SETTING_DEP_SPINDLE);
+    spindle2_tool = new IntSetting(EXTENDED, WG, NULL, "Spindle2/Tool", DEFAULT_SPINDLE2_TOOL, 0, 255);
+    spindle2_type = new EnumSetting(NULL, EXTENDED, WG, NULL, "Spindle2/Type", SPINDLE2_TYPE, &spindleTypes);
+    spindle2_type->setDependents(SETTING_DEP_SPINDLE_TYPE);
+#endif
+#ifdef PROBE_SEQUENCE
+    probe_clearance = new FloatSetting(EXTENDED, WG, NULL, "Probe/Clearance", DEFAULT_PROBE_CLEARANCE, 0.1, 100);
+    probe_depth = new FloatSetting(EXTENDED, WG, NULL, "Probe/Depth", DEFAULT_PROBE_DEPTH, 0.1, 1000);
+    probe_feed = new FloatSetting(EXTENDED, WG, NULL, "Probe/Feed", DEFAULT_PROBE_FEED, 1, 10000);
+#endif
+#ifdef TOOL_CHANGE_SEQUENCE
+    tool_change_probe_reference = new FloatSetting(EXTENDED, WG, NULL, "ToolChange/Probe/Reference", DEFAULT_TOOL_CHANGE_PROBE_REFERENCE, -10000, 10000);
+    tool_change_probe_feed = new FloatSetting(EXTENDED, WG, NULL, "ToolChange/Probe/Feed", DEFAULT_TOOL_CHANGE_PROBE_FEED, 1, 10000);
+    tool_change_probe_depth = new FloatSetting(EXTENDED, WG, NULL, "ToolChange/Probe/Depth", DEFAULT_TOOL_CHANGE_PROBE_DEPTH, 0.1, 1000);
+    tool_change_probe_z = new FloatSetting(EXTENDED, WG, NULL, "ToolChange/Probe/Z", DEFAULT_TOOL_CHANGE_PROBE_Z, -10000, 10000);
+    tool_change_probe_y = new FloatSetting(EXTENDED, WG, NULL, "ToolChange/Probe/Y", DEFAULT_TOOL_CHANGE_PROBE_Y, -10000, 10000);
+    tool_change_probe_x = new FloatSetting(EXTENDED, WG, NULL, "ToolChange/Probe/X", DEFAULT_TOOL_CHANGE_PROBE_X, -10000, 10000);
+    tool_change_probe_enable = new FlagSetting(EXTENDED, WG, NULL, "ToolChange/Probe", DEFAULT_TOOL_CHANGE_PROBE);
+    tool_change_z = new FloatSetting(EXTENDED, WG, NULL, "ToolChange/Z", DEFAULT_TOOL_CHANGE_Z, -10000, 10000);
+    tool_change_y = new FloatSetting(EXTENDED, WG, NULL, "ToolChange/Y", DEFAULT_TOOL_CHANGE_Y, -10000, 10000);
+    tool_change_x = new FloatSetting(EXTENDED, WG, NULL, "ToolChange/X", DEFAULT_TOOL_CHANGE_X, -10000, 10000);
+#endif
+    machineType = new EnumSetting(NULL, EXTENDED, WG, NULL, "Machine/Type", DEFAULT_MACHINE_TYPE, &machineTypes);
     limitSwitch = new EnumSetting(NULL, EXTENDED, WG, NULL, "Limit/Switch", LIMIT_S_NNN, &limitSwitchs);
     limitType = new EnumSetting(NULL, EXTENDED, WG, NULL, "Limit/Type", LIMIT_T_CCC, &limitTypes);
     xboard_em_pwm_hold_val = new IntSetting(EXTENDED, WG, NULL, "Spindle/EMHoldVal", 300, 0, 1024);
     xboard_servo_max_angle = new FloatSetting(EXTENDED, WG, NULL, "Spindle/ServoMaxAngle", 90, 1, 180);
     xboard_servo_invert = new FlagSetting(EXTENDED, WG, NULL, "Spindle/ServoInvert", 0);
+    xboard_em_pwm_hold_val->setDependents(SETTING_DEP_SPINDLE);
+    xboard_servo_max_angle->setDependents(SETTING_DEP_SPINDLE);
+    xboard_servo_invert->setDependents(SETTING_DEP_SPINDLE);
     
-    stallguard_debug_mask = new AxisMaskSetting(EXTENDED, WG, NULL, "Report/StallGuard", 0, checkStallguardDebugMask);
+    stallguard_debug_mask = new AxisMaskSetting(EXTENDED, WG, NULL, "Report/StallGuard", 0);
+    // Samples per second for the Report/StallGuard axes, pulled with $SG. 0 keeps the text messages.
+#ifdef USE_ENCODER_FEEDBACK
+    // Largest allowed difference between the step and encoder positions in mm. 0 only reports it.
+    encoder_max_error = new FloatSetting(EXTENDED, WG, NULL, "Encoder/MaxError", DEFAULT_ENCODER_MAX_ERROR, 0.0, 100.0);
+#endif
+#ifdef USE_MPG
+    mpg_rate = new FloatSetting(EXTENDED, WG, NULL, "MPG/Rate", DEFAULT_MPG_RATE, 1.0, 100000.0);
+    mpg_step = new FloatSetting(EXTENDED, WG, NULL, "MPG/Step", DEFAULT_MPG_STEP, 0.001, 100.0);
+    mpg_axis = new EnumSetting(NULL, EXTENDED, WG, NULL, "MPG/Axis", DEFAULT_MPG_AXIS, &mpgAxes);
+#endif
+    stallguard_sample_rate = new IntSetting(EXTENDED, WG, NULL, "Report/StallGuardRate", 0, 0, STALLGUARD_SAMPLE_RATE_MAX);
+
+    // Buffer depths. Read once at boot, so changes take effect after a restart.
+    stepper_segments = new IntSetting(EXTENDED, WG, NULL, "Stepper/Segments", SEGMENT_BUFFER_SIZE, SEGMENT_BUFFER_SIZE, SEGMENT_BUFFER_SIZE_MAX);
+    planner_blocks = new IntSetting(EXTENDED, WG, NULL, "Planner/Blocks", BLOCK_BUFFER_SIZE, BLOCK_BUFFER_SIZE, BLOCK_BUFFER_SIZE_MAX);
+    serial_rx_buffer = new IntSetting(EXTENDED, WG, NULL, "Serial/RxBuffer", RX_BUFFER_SIZE, RX_BUFFER_SIZE, RX_BUFFER_SIZE_MAX);
+    // Lines per second the clients not streaming g-code may send during a job. 0 is no limit.
+    client_line_rate = new IntSetting(EXTENDED, WG, NULL, "Serial/ClientRate", 0, 0, 1000);
+    // The core and priority of the tasks of each class of the task map, read as the tasks start.
+    // -1 is the default of each task, see task_map.h.
+    for (int8_t task_class = TASK_CLASS_COUNT - 1; task_class >= 0; task_class--) {
+        const char* name = makename("Tasks", task_class_name(task_class));
+        task_class_priority[task_class] = new IntSetting(EXTENDED, WG, NULL, makename(name, "Priority"), -1, -1, configMAX_PRIORITIES - 1);
+        task_class_core[task_class] = new IntSetting(EXTENDED, WG, NULL, makename(name, "Core"), -1, -1, portNUM_PROCESSORS - 1);
+    }
+#ifdef USE_I2S_OUT_STREAM
+    // I2S stream timing, also read once at boot. A shorter pulse time gives finer step timing
+    // and fewer or shorter DMA buffers lower the I/O latency, at the cost of more refills.
+    i2s_pulse_usec = new IntSetting(EXTENDED, WG, NULL, "I2SO/PulseUsec", I2S_OUT_USEC_PER_PULSE, I2S_OUT_USEC_PER_PULSE_MIN, I2S_OUT_USEC_PER_PULSE_MAX);
+    i2s_dmabuf_count = new IntSetting(EXTENDED, WG, NULL, "I2SO/DMABufCount", I2S_OUT_DMABUF_COUNT, I2S_OUT_DMABUF_COUNT_MIN, I2S_OUT_DMABUF_COUNT_MAX);
+    i2s_dmabuf_len = new IntSetting(EXTENDED, WG, NULL, "I2SO/DMABufLen", I2S_OUT_DMABUF_LEN, I2S_OUT_DMABUF_LEN_MIN, I2S_OUT_DMABUF_LEN_MAX);
+#endif
+
+    accel_profile = new EnumSetting(NULL, EXTENDED, WG, NULL, "Stepper/AccelProfile", ACCEL_PROFILE_TRAPEZOID, &accelProfiles);
+#ifdef INPUT_SHAPING
+    // ZVD cancels a wider band around the frequencies than ZV, with twice the delay
+    shaper_type = new EnumSetting(NULL, EXTENDED, WG, NULL, "Stepper/Shaper", SHAPER_ZV, &shaperTypes);
+#endif
+    arc_adaptive = new FlagSetting(EXTENDED, WG, NULL, "GCode/ArcAdaptive", false);
+    planner_merge_tolerance = new FloatSetting(EXTENDED, WG, NULL, "Planner/MergeTolerance", 0.0, 0.0, 1.0);
 }
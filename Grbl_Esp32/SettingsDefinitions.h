@@ -1,5 +1,4 @@
 #pragma once
-extern bool motorSettingChanged;
 
 extern AxisSettings* x_axis_settings;
 extern AxisSettings* y_axis_settings;
@@ -14,7 +13,24 @@ extern StringSetting* startup_line_1;
 extern StringSetting* build_info;
 
 extern IntSetting* pulse_microseconds;
+extern IntSetting* direction_setup_microseconds;
 extern IntSetting* stepper_idle_lock_time;
+extern IntSetting* stepper_segments;
+extern IntSetting* planner_blocks;
+extern IntSetting* serial_rx_buffer;
+extern IntSetting* client_line_rate;
+extern IntSetting* task_class_core[TASK_CLASS_COUNT];
+extern IntSetting* task_class_priority[TASK_CLASS_COUNT];
+#ifdef USE_I2S_OUT_STREAM
+extern IntSetting* i2s_pulse_usec;
+extern IntSetting* i2s_dmabuf_count;
+extern IntSetting* i2s_dmabuf_len;
+#endif
+extern FloatSetting* planner_merge_tolerance;
+extern EnumSetting* accel_profile;
+#ifdef INPUT_SHAPING
+extern EnumSetting* shaper_type;
+#endif
 
 extern AxisMaskSetting* step_invert_mask;
 extern AxisMaskSetting* dir_invert_mask;
@@ -32,6 +48,7 @@ extern FlagSetting* laser_mode;
 extern IntSetting* status_mask;
 extern FloatSetting* junction_deviation;
 extern FloatSetting* arc_tolerance;
+extern FlagSetting* arc_adaptive;
 
 extern FloatSetting* homing_feed_rate;
 extern FloatSetting* homing_seek_rate;
@@ -45,8 +62,33 @@ extern FloatSetting* spindle_pwm_off_value;
 extern FloatSetting* spindle_pwm_min_value;
 extern FloatSetting* spindle_pwm_max_value;
 extern IntSetting* spindle_pwm_bit_precision;
+extern StringSetting* spindle_curve;
+extern FloatSetting* spindle_besc_ramp_time;
 
 extern EnumSetting* spindle_type;
+#ifdef SPINDLE2_TYPE
+extern EnumSetting* spindle2_type;
+extern IntSetting* spindle2_tool;
+extern FloatSetting* spindle2_rpm_min;
+extern FloatSetting* spindle2_rpm_max;
+#endif
+#ifdef PROBE_SEQUENCE
+extern FloatSetting* probe_feed;
+extern FloatSetting* probe_depth;
+extern FloatSetting* probe_clearance;
+#endif
+#ifdef TOOL_CHANGE_SEQUENCE
+extern FloatSetting* tool_change_x;
+extern FloatSetting* tool_change_y;
+extern FloatSetting* tool_change_z;
+extern FlagSetting* tool_change_probe_enable;
+extern FloatSetting* tool_change_probe_x;
+extern FloatSetting* tool_change_probe_y;
+extern FloatSetting* tool_change_probe_z;
+extern FloatSetting* tool_change_probe_depth;
+extern FloatSetting* tool_change_probe_feed;
+extern FloatSetting* tool_change_probe_reference;
+#endif
 extern EnumSetting* machineType;// [XBoard]
 extern EnumSetting* limitSwitch;// [XBoard]
 extern EnumSetting* limitType;  // [XBoard]
@@ -55,3 +97,47 @@ extern FloatSetting* xboard_servo_max_angle;// [XBoard]
 extern FlagSetting* xboard_servo_invert;// [XBoard]
 
 extern AxisMaskSetting* stallguard_debug_mask;
+extern IntSetting* stallguard_sample_rate;
+#ifdef USE_ENCODER_FEEDBACK
+extern FloatSetting* encoder_max_error;
+#endif
+#ifdef USE_MPG
+extern EnumSetting* mpg_axis;
+extern FloatSetting* mpg_step;
+extern FloatSetting* mpg_rate;
+#endif
+
+// Copies of the settings read by the stepper ISR, the segment prep and the motion code, so those
+// read plain fields instead of going through the setting objects. update_hot_settings() fills
+// the copy that is not in use and then publishes it, so a reader always sees one consistent set.
+// NOTE: Must be refreshed whenever a setting changes. See ProcessSettings.cpp.
+typedef struct {
+    uint32_t pulse_microseconds;
+    uint32_t direction_setup_microseconds;
+    uint8_t idle_lock_time;
+    bool step_enable_invert;
+    uint8_t step_invert_mask;
+    uint8_t dir_invert_mask;
+    uint8_t accel_profile;
+    uint8_t machine_type;
+    uint8_t limit_enable_mask; // [XBoard] The limit inputs in use, from Limit/Switch
+    uint8_t limit_invert_mask; // [XBoard] The normally open limit switches, from Limit/Type
+    bool soft_limits;
+    bool arc_adaptive;
+    float arc_tolerance;
+    float junction_deviation;
+    float planner_merge_tolerance;
+    float travel_min[N_AXIS]; // The soft limit box, from max_travel and the homing directions
+    float travel_max[N_AXIS];
+#ifdef INPUT_SHAPING
+    uint8_t shaper_type;
+    float shaper_frequency[N_AXIS];
+    float shaper_damping[N_AXIS];
+#endif
+#ifdef BACKLASH_COMPENSATION
+    uint32_t backlash_steps[N_AXIS]; // The slack, from <axis>/Backlash
+    float backlash_rate[N_AXIS];     // The most steps/min to take it up at, from <axis>/MaxRate
+#endif
+} hot_settings_t;
+extern const hot_settings_t* volatile hot_settings;
+void update_hot_settings();
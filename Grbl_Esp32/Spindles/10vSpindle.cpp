@@ -60,8 +60,13 @@ void _10vSpindle :: init() {
     pinMode(_forward_pin, OUTPUT);
     pinMode(_reverse_pin, OUTPUT);
 
+    init_duty_table();
     set_rpm(0);
 
+    init_tach();
+
+    segment_duty = true;
+
     config_message();
 
     is_reversable = true; // these VFDs are always reversable
@@ -81,29 +86,16 @@ void _10vSpindle :: config_message() {
                    _pwm_precision);
 }
 
-uint32_t _10vSpindle::set_rpm(uint32_t rpm) {
+uint32_t IRAM_ATTR _10vSpindle::set_rpm(uint32_t rpm) {
     uint32_t pwm_value;
 
     if (_output_pin == UNDEFINED_PIN)
         return rpm;
 
-    // apply speed overrides
-    rpm = rpm * sys.spindle_speed_ovr / 100; // Scale by spindle speed override value (percent)
-
-    // apply limits limits
-    if ((_min_rpm >= _max_rpm) || (rpm >= _max_rpm))
-        rpm = _max_rpm;
-    else if (rpm != 0 && rpm <= _min_rpm)
-        rpm = _min_rpm;
+    // apply speed overrides and limits, and determine the pwm value
+    pwm_value = rpm_to_duty(&rpm);
     sys.spindle_speed = rpm;
 
-    // determine the pwm value
- if (rpm == 0) {
-        pwm_value = _pwm_off_value;
-    } else {
-        pwm_value = map_uint32_t(rpm, _min_rpm, _max_rpm, _pwm_min_value, _pwm_max_value);
-    }
-
     set_output(pwm_value);
     return rpm;
 }
@@ -29,8 +29,13 @@
     BESC_MIN_PULSE_SECS is typically 1ms (0.001 sec) or less
     BESC_MAX_PULSE_SECS is typically 2ms (0.002 sec) or more
 
+    Spindle/BESC/RampTime is the time in seconds from off to full speed.
+    Speed changes are then faded by the LEDC hardware, so the ESC does not
+    lose sync, and M3 and S changes wait for the ramp instead of a G4.
+
 */
 #include "SpindleClass.h"
+#include <driver/ledc.h>
 
 
 // don't change these
@@ -75,8 +80,22 @@ void BESCSpindle :: init() {
 
     pinMode(_enable_pin, OUTPUT);
 
+    init_duty_table();
+    _ramp_ms = 0; // Arm the ESC with the off pulse at once
     set_rpm(0);
 
+    _ramp_ms = spindle_besc_ramp_time->get() * 1000.0;
+    _ramp_end_ms = millis();
+    if (_ramp_ms) {
+        static bool fade_installed = false;
+        if (!fade_installed)
+            fade_installed = (ledc_fade_func_install(0) == ESP_OK);
+        if (!fade_installed)
+            _ramp_ms = 0;
+    }
+
+    segment_duty = true;
+
     config_message();
 }
 
@@ -92,29 +111,53 @@ void BESCSpindle :: config_message() {
                    _pwm_precision);
 }
 
-uint32_t BESCSpindle::set_rpm(uint32_t rpm) {
+// Fades to the new duty over its share of the ramp time. The stepper ISR cannot start a fade,
+// so a speed override applied from there still jumps, as does a spindle without a ramp.
+void BESCSpindle::set_output(uint32_t duty) {
+    if (_ramp_ms == 0 || xPortInIsrContext()) {
+        write_duty(duty);
+        return;
+    }
+    if (_output_pin == UNDEFINED_PIN || duty == _current_pwm_duty)
+        return;
+
+    uint32_t change = abs((int32_t)duty - _current_pwm_duty);
+    uint32_t fade_ms = (uint64_t)_ramp_ms * change / (_pwm_max_value - _pwm_off_value);
+    if (fade_ms == 0) {
+        write_duty(duty);
+        return;
+    }
+    _current_pwm_duty = duty;
+    if (_invert_pwm)
+        duty = (1 << _pwm_precision) - duty;
+
+    ledc_mode_t mode = (_spindle_pwm_chan_num < 8) ? LEDC_HIGH_SPEED_MODE : LEDC_LOW_SPEED_MODE;
+    ledc_channel_t channel = (ledc_channel_t)(_spindle_pwm_chan_num % 8);
+    ledc_set_fade_with_time(mode, channel, duty, fade_ms);
+    ledc_fade_start(mode, channel, LEDC_FADE_NO_WAIT);
+    _ramp_end_ms = millis() + fade_ms;
+}
+
+// Waits for the ramp to the new speed, so a program needs no G4 after M3 or S
+void BESCSpindle::spindle_sync(uint8_t state, uint32_t rpm) {
+    Spindle::spindle_sync(state, rpm);
+    if (sys.state == STATE_CHECK_MODE || state == SPINDLE_DISABLE)
+        return;
+    int32_t remaining_ms = (int32_t)(_ramp_end_ms - millis());
+    if (remaining_ms > 0)
+        delay_sec(remaining_ms / 1000.0, DELAY_MODE_DWELL);
+}
+
+uint32_t IRAM_ATTR BESCSpindle::set_rpm(uint32_t rpm) {
     uint32_t pwm_value;
 
     if (_output_pin == UNDEFINED_PIN)
         return rpm;
 
-    // apply speed overrides
-    rpm = rpm * sys.spindle_speed_ovr / 100; // Scale by spindle speed override value (percent)
-
-    // apply limits limits
-    if ((_min_rpm >= _max_rpm) || (rpm >= _max_rpm))
-        rpm = _max_rpm;
-    else if (rpm != 0 && rpm <= _min_rpm)
-        rpm = _min_rpm;
+    // apply speed overrides and limits, and determine the pwm value
+    pwm_value = rpm_to_duty(&rpm);
     sys.spindle_speed = rpm;
 
-    // determine the pwm value
- if (rpm == 0) {
-        pwm_value = _pwm_off_value;
-    } else {
-        pwm_value = map_uint32_t(rpm, _min_rpm, _max_rpm, _pwm_min_value, _pwm_max_value);
-    }
-
     set_output(pwm_value);
     return rpm;
 }
@@ -28,7 +28,7 @@ void NullSpindle :: init() {
     is_reversable = false;
     config_message();
 }
-uint32_t NullSpindle :: set_rpm(uint32_t rpm) {
+uint32_t IRAM_ATTR NullSpindle :: set_rpm(uint32_t rpm) {
     return rpm;
 }
 void NullSpindle :: set_state(uint8_t state, uint32_t rpm) {}
@@ -20,6 +20,9 @@
 
 */
 #include "SpindleClass.h"
+#ifdef SPINDLE_TACH_PIN
+    #include <driver/pcnt.h>
+#endif
 
 // ======================= PWMSpindle ==============================
 /*
@@ -50,9 +53,62 @@ void PWMSpindle :: init() {
     pinMode(_enable_pin, OUTPUT);
     pinMode(_direction_pin, OUTPUT);
 
+    init_tach();
+
+    init_duty_table();
+    segment_duty = true;
+
     config_message();
 }
 
+#ifdef SPINDLE_TACH_PIN
+static bool tach_ready = false; // Only the spindles whose init() calls init_tach() count
+static int64_t tach_read_us; // When the tach counter was last read and cleared
+#endif
+
+// Counts the rising edges of SPINDLE_TACH_PIN, if the machine has one, for get_actual_rpm()
+void PWMSpindle :: init_tach() {
+#ifdef SPINDLE_TACH_PIN
+    if (slot != 0)
+        return; // The tachometer is on the first spindle
+    pcnt_config_t config = {};
+    config.pulse_gpio_num = SPINDLE_TACH_PIN;
+    config.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+    config.unit = SPINDLE_TACH_PCNT_UNIT;
+    config.channel = PCNT_CHANNEL_0;
+    config.pos_mode = PCNT_COUNT_INC;
+    config.neg_mode = PCNT_COUNT_DIS;
+    config.lctrl_mode = PCNT_MODE_KEEP;
+    config.hctrl_mode = PCNT_MODE_KEEP;
+    config.counter_h_lim = INT16_MAX;
+    config.counter_l_lim = 0;
+    pcnt_unit_config(&config);
+    pcnt_counter_clear(SPINDLE_TACH_PCNT_UNIT);
+    pcnt_counter_resume(SPINDLE_TACH_PCNT_UNIT);
+    tach_read_us = esp_timer_get_time();
+    tach_ready = true;
+#endif
+}
+
+// The RPM over the time since the last call. Call it at least every few
+// hundred ms while waiting, so the 16 bit counter cannot overflow.
+bool PWMSpindle :: get_actual_rpm(uint32_t* rpm) {
+#ifdef SPINDLE_TACH_PIN
+    if (!tach_ready || slot != 0)
+        return false;
+    int16_t count;
+    pcnt_get_counter_value(SPINDLE_TACH_PCNT_UNIT, &count);
+    pcnt_counter_clear(SPINDLE_TACH_PCNT_UNIT);
+    int64_t now = esp_timer_get_time();
+    int64_t elapsed_us = now - tach_read_us;
+    tach_read_us = now;
+    *rpm = elapsed_us > 0 ? (uint32_t)(count * 60000000LL / (elapsed_us * SPINDLE_TACH_PULSES_PER_REV)) : 0;
+    return true;
+#else
+    return false;
+#endif
+}
+
 // Get the GPIO from the machine definition
 void PWMSpindle :: get_pins_and_settings() {
     // setup all the pins
@@ -68,6 +124,7 @@ void PWMSpindle :: get_pins_and_settings() {
 #else
     _invert_pwm = false;
 #endif
+    _dac_channel = -1;
 
 #ifdef SPINDLE_ENABLE_PIN
     _enable_pin = SPINDLE_ENABLE_PIN;
@@ -103,28 +160,51 @@ void PWMSpindle :: get_pins_and_settings() {
 #ifdef ENABLE_PIECEWISE_LINEAR_SPINDLE
     _min_rpm = RPM_MIN;
     _max_rpm = RPM_MAX;
-    _piecewide_linear = true;
 #else
     _min_rpm = rpm_min->get();
     _max_rpm = rpm_max->get();
-    _piecewide_linear = false;
 #endif
+    _duty_table_used = false;
     // The pwm_gradient is the pwm duty cycle units per rpm
     // _pwm_gradient = (_pwm_max_value - _pwm_min_value) / (_max_rpm - _min_rpm);
 
     _spindle_pwm_chan_num = 0; // Channel 0 is reserved for spindle use
 
+#ifdef SPINDLE2_TYPE
+    if (slot == 1) {
+        _output_pin = SPINDLE2_OUTPUT_PIN;
+        _invert_pwm = false;
+        _enable_pin = SPINDLE2_ENABLE_PIN;
+        _off_with_zero_speed = false;
+        _direction_pin = SPINDLE2_DIR_PIN;
+        is_reversable = (_direction_pin != UNDEFINED_PIN);
+        _min_rpm = spindle2_rpm_min->get();
+        _max_rpm = spindle2_rpm_max->get();
+        _spindle_pwm_chan_num = SPINDLE2_PWM_CHANNEL;
+    }
+#endif
 
 }
 
-uint32_t PWMSpindle::set_rpm(uint32_t rpm) {
-    uint32_t pwm_value;
-
+uint32_t IRAM_ATTR PWMSpindle::set_rpm(uint32_t rpm) {
     if (_output_pin == UNDEFINED_PIN)
         return rpm;
 
     //grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Set rpm %d", rpm);
 
+    uint32_t pwm_value = rpm_to_duty(&rpm);
+    sys.spindle_speed = rpm;
+    set_output(pwm_value);
+
+    return 0;
+}
+
+// Applies the override and limits to rpm, in place, and returns its duty.
+// The stepper calls this for every segment it prepares, see segment_duty.
+uint32_t IRAM_ATTR PWMSpindle::rpm_to_duty(uint32_t* rpm_ptr) {
+    uint32_t rpm = *rpm_ptr;
+    uint32_t pwm_value;
+
     // apply override
     rpm = rpm * sys.spindle_speed_ovr / 100; // Scale by spindle speed override value (uint8_t percent)
 
@@ -134,23 +214,165 @@ uint32_t PWMSpindle::set_rpm(uint32_t rpm) {
     else if (rpm != 0 && rpm <= _min_rpm)
         rpm = _min_rpm;
 
-    sys.spindle_speed = rpm;
+    *rpm_ptr = rpm;
+
+    if (rpm == 0)
+        pwm_value = _pwm_off_value;
+    else if (_duty_table_used) {
+        // rpm is within the limits, so the table step is at most SPINDLE_DUTY_TABLE_SIZE
+        uint32_t position = (rpm - _min_rpm) * _duty_table_scale;
+        uint32_t step = position >> 16;
+        if (step >= SPINDLE_DUTY_TABLE_SIZE)
+            pwm_value = _duty_table[SPINDLE_DUTY_TABLE_SIZE];
+        else {
+            int32_t rise = (int32_t)_duty_table[step + 1] - (int32_t)_duty_table[step];
+            pwm_value = _duty_table[step] + (int32_t)(((int64_t)rise * (position & 0xFFFF)) >> 16);
+        }
+    } else
+        pwm_value = map_uint32_t(rpm, _min_rpm, _max_rpm, _pwm_min_value, _pwm_max_value);
+
+    return pwm_value;
+}
 
-    if (_piecewide_linear) {
-        //pwm_value = piecewise_linear_fit(rpm); TODO
-        pwm_value = 0;
-        grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Warning: Linear fit not implemented yet.");
+// Parses a Spindle/Curve value, like "0:0 6000:20 24000:100", into rpm and duty percent
+// pairs. Returns the number of points, or -1 if the value is malformed, the rpms do not
+// increase or there are more than max_points.
+int spindle_parse_curve(const char* value, float* rpm, float* percent, int max_points) {
+    int points = 0;
+    while (true) {
+        while (*value == ' ')
+            value++;
+        if (*value == '\0')
+            return points;
+        if (points == max_points)
+            return -1;
+        char* end;
+        rpm[points] = strtof(value, &end);
+        if (end == value || *end != ':')
+            return -1;
+        value = end + 1;
+        percent[points] = strtof(value, &end);
+        if (end == value || (*end != ' ' && *end != '\0'))
+            return -1;
+        if (percent[points] < 0.0 || percent[points] > 100.0)
+            return -1;
+        if (points > 0 && rpm[points] <= rpm[points - 1])
+            return -1;
+        value = end;
+        points++;
+    }
+}
 
-    } else {
-        if (rpm == 0)
-            pwm_value = _pwm_off_value;
-        else
-            pwm_value = map_uint32_t(rpm, _min_rpm, _max_rpm, _pwm_min_value, _pwm_max_value);
+// The percent of the curve at rpm, on the line between the points around it
+static float curve_percent(float rpm, const float* rpms, const float* percents, int points) {
+    if (rpm <= rpms[0])
+        return percents[0];
+    for (int i = 1; i < points; i++) {
+        if (rpm <= rpms[i])
+            return percents[i - 1] + (percents[i] - percents[i - 1]) * (rpm - rpms[i - 1]) / (rpms[i] - rpms[i - 1]);
     }
+    return percents[points - 1];
+}
 
-    set_output(pwm_value);
+#ifdef ENABLE_PIECEWISE_LINEAR_SPINDLE
+// The fit_nonlinear_spindle.py solution, an 8 bit PWM value (0-255)
+static float piecewise_linear_fit(float rpm) {
+    #if (N_PIECES > 3)
+    if (rpm > RPM_POINT34)
+        return RPM_LINE_A4 * rpm - RPM_LINE_B4;
+    #endif
+    #if (N_PIECES > 2)
+    if (rpm > RPM_POINT23)
+        return RPM_LINE_A3 * rpm - RPM_LINE_B3;
+    #endif
+    #if (N_PIECES > 1)
+    if (rpm > RPM_POINT12)
+        return RPM_LINE_A2 * rpm - RPM_LINE_B2;
+    #endif
+    return RPM_LINE_A1 * rpm - RPM_LINE_B1;
+}
+#endif
 
-    return 0;
+// Samples the Spindle/Curve setting, or else the ENABLE_PIECEWISE_LINEAR_SPINDLE solution,
+// into the duty table, so rpm_to_duty() costs one lookup and one interpolation. Without
+// either, the duty is the straight line from $35 to $36.
+void PWMSpindle :: init_duty_table() {
+    float rpms[SPINDLE_CURVE_MAX_POINTS];
+    float percents[SPINDLE_CURVE_MAX_POINTS];
+    // Spindle/Curve and the piecewise fit are of the first spindle
+    int points = (slot == 0) ? spindle_parse_curve(spindle_curve->get(), rpms, percents, SPINDLE_CURVE_MAX_POINTS) : 0;
+
+    _duty_table_used = false;
+    if (_min_rpm >= _max_rpm)
+        return;
+#ifdef ENABLE_PIECEWISE_LINEAR_SPINDLE
+    if (points < 2 && slot != 0)
+        return;
+#else
+    if (points < 2)
+        return;
+#endif
+
+    for (int i = 0; i <= SPINDLE_DUTY_TABLE_SIZE; i++) {
+        float rpm = _min_rpm + (float)(_max_rpm - _min_rpm) * i / SPINDLE_DUTY_TABLE_SIZE;
+        float duty;
+#ifdef ENABLE_PIECEWISE_LINEAR_SPINDLE
+        if (points < 2)
+            duty = piecewise_linear_fit(rpm) * _pwm_period / 255.0;
+        else
+#endif
+            duty = curve_percent(rpm, rpms, percents, points) * _pwm_period / 100.0;
+        _duty_table[i] = constrain(duty, 0, _pwm_period);
+    }
+    _duty_table_scale = ((uint32_t)SPINDLE_DUTY_TABLE_SIZE << 16) / (_max_rpm - _min_rpm);
+    _duty_table_used = true;
+}
+
+// Measures the speed at SPINDLE_CALIBRATE_POINTS duties from $35 to $36 with the
+// tachometer, and returns them as a Spindle/Curve value. Duties below the speed the
+// spindle starts at are left out. Returns false if the spindle has no tachometer, or
+// on a reset.
+bool PWMSpindle :: calibrate(String& curve) {
+    uint32_t rpm;
+    if (_output_pin == UNDEFINED_PIN || !get_actual_rpm(&rpm))
+        return false;
+
+    float min_percent = spindle_pwm_min_value->get();
+    float max_percent = spindle_pwm_max_value->get();
+    uint32_t last_rpm = 0;
+    char point[24];
+
+    curve = "";
+    set_spindle_dir_pin(true);
+    sys.spindle_speed = _max_rpm; // So SPINDLE_ENABLE_OFF_WITH_ZERO_SPEED leaves it enabled
+    set_enable_pin(true);
+    for (int i = 0; i < SPINDLE_CALIBRATE_POINTS; i++) {
+        float percent = min_percent + (max_percent - min_percent) * i / (SPINDLE_CALIBRATE_POINTS - 1);
+        set_output(_pwm_period * percent / 100.0);
+        vTaskDelay(SPINDLE_CALIBRATE_SETTLE_MS / portTICK_PERIOD_MS);
+        get_actual_rpm(&rpm); // Restarts the count, so settling is not measured
+        uint32_t total = 0;
+        for (int sample = 0; sample < SPINDLE_CALIBRATE_SAMPLES; sample++) {
+            vTaskDelay(SPINDLE_AT_SPEED_SAMPLE_MS / portTICK_PERIOD_MS);
+            get_actual_rpm(&rpm);
+            total += rpm;
+        }
+        if (sys_rt_exec_state & EXEC_RESET) {
+            stop();
+            sys.spindle_speed = 0;
+            return false;
+        }
+        rpm = total / SPINDLE_CALIBRATE_SAMPLES;
+        grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Spindle duty %4.1f%% RPM %d", percent, rpm);
+        if (rpm > last_rpm) {
+            snprintf(point, sizeof(point), "%s%d:%.1f", curve.length() ? " " : "", rpm, percent);
+            curve += point;
+            last_rpm = rpm;
+        }
+    }
+    stop();
+    sys.spindle_speed = 0;
+    return true;
 }
 
 void PWMSpindle::set_state(uint8_t state, uint32_t rpm) {
@@ -166,6 +388,7 @@ void PWMSpindle::set_state(uint8_t state, uint32_t rpm) {
     }
 
     set_enable_pin(state != SPINDLE_DISABLE);
+    pin_state = state;
 
     sys.report_ovr_counter = 0; // Set to report change immediately
 }
@@ -181,6 +404,7 @@ uint8_t PWMSpindle::get_state() {
 void PWMSpindle::stop() {
     // inverts are delt with in methods
     set_enable_pin(false);
+    pin_state = SPINDLE_DISABLE;
     set_output(_pwm_off_value);
 }
 
@@ -197,7 +421,12 @@ void PWMSpindle :: config_message() {
 }
 
 
-void PWMSpindle::set_output(uint32_t duty) {
+void IRAM_ATTR PWMSpindle::set_output(uint32_t duty) {
+    write_duty(duty);
+}
+
+// Not virtual, so the stepper ISR can call it without going through set_rpm()
+void IRAM_ATTR PWMSpindle::write_duty(uint32_t duty) {
     if (_output_pin == UNDEFINED_PIN)
         return;
 
@@ -209,10 +438,15 @@ void PWMSpindle::set_output(uint32_t duty) {
 
     _current_pwm_duty = duty;
 
+    if (_dac_channel >= 0) {
+        sys_dac_write_isr(_dac_channel, duty);
+        return;
+    }
+
      if (_invert_pwm)
         duty = (1 << _pwm_precision) - duty;
 
-    ledcWrite(_spindle_pwm_chan_num, duty);
+    sys_ledc_write_isr(_spindle_pwm_chan_num, duty); // Called by the stepper ISR
 
 }
 
@@ -37,6 +37,8 @@ void RelaySpindle::init() {
 
     is_reversable = (_direction_pin != UNDEFINED_PIN);
 
+    init_tach();
+
     config_message();
 }
 
@@ -50,7 +52,7 @@ void RelaySpindle :: config_message() {
                    pinName(_direction_pin).c_str());
 }
 
-uint32_t RelaySpindle::set_rpm(uint32_t rpm) {
+uint32_t IRAM_ATTR RelaySpindle::set_rpm(uint32_t rpm) {
     if (_output_pin == UNDEFINED_PIN)
         return rpm;
 
@@ -61,7 +63,7 @@ uint32_t RelaySpindle::set_rpm(uint32_t rpm) {
     return rpm;
 }
 
-void RelaySpindle::set_output(uint32_t duty) {
+void IRAM_ATTR RelaySpindle::set_output(uint32_t duty) {
 #ifdef INVERT_SPINDLE_PWM
     duty = (duty == 0); // flip duty
 #endif
@@ -32,7 +32,7 @@
 #include "DacSpindle.cpp"
 #include "RelaySpindle.cpp"
 #include "Laser.cpp"
-#include "HuanyangSpindle.cpp"
+#include "VFDSpindle.cpp"
 #include "BESCSpindle.cpp"
 #include "10vSpindle.cpp"
 #include "XBoard_ElectromagnetSpindle.cpp" // [XBoard]
@@ -45,53 +45,137 @@ PWMSpindle pwm_spindle;
 RelaySpindle relay_spindle;
 Laser laser;
 DacSpindle dac_spindle;
-HuanyangSpindle huanyang_spindle;
+VFDSpindle huanyang_spindle(&huanyang_registers);
+VFDSpindle h100_spindle(&h100_registers);
+VFDSpindle yl620_spindle(&yl620_registers);
+VFDSpindle delta_spindle(&delta_registers);
 BESCSpindle besc_spindle;
 _10vSpindle _10v_spindle;
 XBoard_ElectromagnetSpindle xboard_electromagnet_spindle;// [XBoard]
 XBoard_ServoSpindle xboard_servo_spindle;// [XBoard]
 
-void spindle_select() {
-    
-    switch (spindle_type->get()) {
+#ifdef SPINDLE2_TYPE
+static Spindle* first_spindle = &null_spindle;  // Of Spindle/Type
+static Spindle* second_spindle = &null_spindle; // Of Spindle2/Type
+#endif
+
+static Spindle* spindle_of_type(uint8_t type) {
+    Spindle* selected;
+    switch (type) {
     case SPINDLE_TYPE_PWM:
-        spindle = &pwm_spindle;
+        selected = &pwm_spindle;
         break;
     case SPINDLE_TYPE_RELAY:
-        spindle = &relay_spindle;
+        selected = &relay_spindle;
         break;
     // [XBoard]
 	case SPINDLE_TYPE_XB_EM:
-		spindle = &xboard_electromagnet_spindle;
+		selected = &xboard_electromagnet_spindle;
 		break;
 	// [XBoard]
 	case SPINDLE_TYPE_XB_SERVO:
-		spindle = &xboard_servo_spindle;
+		selected = &xboard_servo_spindle;
 		break;
     case SPINDLE_TYPE_LASER:
-        spindle = &laser;
+        selected = &laser;
         break;
     case SPINDLE_TYPE_DAC:
-        spindle = &dac_spindle;
+        selected = &dac_spindle;
         break;
     case SPINDLE_TYPE_HUANYANG:
-        spindle = &huanyang_spindle;
+        selected = &huanyang_spindle;
+        break;
+    case SPINDLE_TYPE_H100:
+        selected = &h100_spindle;
+        break;
+    case SPINDLE_TYPE_YL620:
+        selected = &yl620_spindle;
+        break;
+    case SPINDLE_TYPE_DELTA:
+        selected = &delta_spindle;
         break;
     case SPINDLE_TYPE_BESC:
-        spindle = &besc_spindle;
+        selected = &besc_spindle;
         break;
     case SPINDLE_TYPE_10V:
-        spindle = &_10v_spindle;
+        selected = &_10v_spindle;
         break;
     case SPINDLE_TYPE_NONE:
     default:
-        spindle = &null_spindle;
+        selected = &null_spindle;
+        break;
+    }
+    return selected;
+}
+
+void spindle_select() {
+#ifdef SPINDLE2_TYPE
+    bool second_selected = (spindle == second_spindle && second_spindle != &null_spindle);
+    spindle_stop_all();
+    first_spindle = spindle_of_type(spindle_type->get());
+    second_spindle = &null_spindle;
+    switch (spindle2_type->get()) {
+    case SPINDLE_TYPE_NONE:
+        break;
+    case SPINDLE_TYPE_PWM:
+    case SPINDLE_TYPE_RELAY:
+    case SPINDLE_TYPE_LASER:
+    case SPINDLE_TYPE_DAC:
+    case SPINDLE_TYPE_BESC:
+        second_spindle = spindle_of_type(spindle2_type->get());
+        if (second_spindle != first_spindle)
+            break;
+        second_spindle = &null_spindle; // Each type has one instance
+    // fall through
+    default:
+        grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Warning: Spindle2/Type must be a PWM type other than Spindle/Type");
         break;
     }
-    
+    first_spindle->slot = 0;
+    second_spindle->slot = 1;
+    spindle = second_selected ? second_spindle : first_spindle;
+    spindle_init_all();
+#else
+    spindle = spindle_of_type(spindle_type->get());
     spindle->init();
+#endif
+}
+
+// Stops every spindle, for a reset
+void spindle_stop_all() {
+#ifdef SPINDLE2_TYPE
+    first_spindle->stop();
+    second_spindle->stop();
+#else
+    spindle->stop();
+#endif
 }
 
+#ifdef SPINDLE2_TYPE
+// Rereads the settings of both spindles. The selected spindle is initialized last, so its
+// config message is the last one.
+void spindle_init_all() {
+    Spindle* other = (spindle == first_spindle) ? second_spindle : first_spindle;
+    if (other != &null_spindle)
+        other->init();
+    spindle->init();
+}
+
+// M6. Switches to the spindle of tool, after the motion of the old one is done. The old one is
+// stopped and the new one is left off for the next M3 or M4. Switching is only a pointer change,
+// both spindles were initialized with their settings. Returns true if the spindle changed.
+bool spindle_select_tool(uint8_t tool) {
+    Spindle* selected = (tool == spindle2_tool->get()) ? second_spindle : first_spindle;
+    if (selected == spindle || sys.state == STATE_CHECK_MODE)
+        return false;
+    protocol_buffer_synchronize(); // The stepper writes the spindle of the segments it runs
+    spindle->stop();
+    spindle = selected;
+    spindle->config_message();
+    return true;
+}
+#endif
+
 // ========================= Spindle ==================================
 
 bool Spindle::isRateAdjusted() {
@@ -103,4 +187,56 @@ void Spindle :: spindle_sync(uint8_t state, uint32_t rpm) {
         return;
     protocol_buffer_synchronize(); // Empty planner buffer to ensure spindle is set when programmed.
     set_state(state, rpm);
+    if (state != SPINDLE_DISABLE)
+        wait_at_speed(DELAY_MODE_DWELL);
+}
+
+// In laser mode, the planner blocks carry the laser state in their condition, and the stepper
+// sets the power as each block starts. So M3, M4 and M5 need no buffer sync while the enable
+// and direction pins are already right, and a vector job does not stop at every M5. M5 leaves
+// the laser enabled at zero power, and protocol disables it when the motion before it is done.
+// Returns false if the change needs spindle_sync().
+bool Spindle :: laser_toggle(uint8_t state) {
+    if (!isRateAdjusted())
+        return false;
+    if (sys.state == STATE_CHECK_MODE)
+        return true;
+    if (state == SPINDLE_DISABLE) {
+        if (sys.state == STATE_IDLE && plan_get_current_block() == NULL)
+            set_state(SPINDLE_DISABLE, 0); // Nothing left to finish at power
+        return true;
+    }
+    return (pin_state == state) || (pin_state != SPINDLE_DISABLE && !is_reversable);
+}
+
+bool Spindle :: get_actual_rpm(uint32_t* rpm) {
+    return false;
+}
+
+// Waits until the measured RPM is within SPINDLE_AT_SPEED_TOLERANCE of sys.spindle_speed,
+// which set_rpm() has set to the programmed RPM after overrides and limits. Returns false
+// at once if SPINDLE_AT_SPEED is off or the spindle cannot measure its speed, so the caller
+// can fall back on a fixed delay. mode is passed on to delay_sec().
+bool Spindle :: wait_at_speed(uint8_t mode) {
+#ifdef SPINDLE_AT_SPEED
+    uint32_t actual;
+    if (!get_actual_rpm(&actual))
+        return false;
+    uint32_t target = sys.spindle_speed;
+    if (target == 0)
+        return true;
+    uint32_t tolerance = target * SPINDLE_AT_SPEED_TOLERANCE / 100;
+    for (uint32_t waited = 0; waited < SPINDLE_AT_SPEED_TIMEOUT_MS; waited += SPINDLE_AT_SPEED_SAMPLE_MS) {
+        get_actual_rpm(&actual);
+        if (actual + tolerance >= target && actual <= target + tolerance)
+            return true;
+        delay_sec(SPINDLE_AT_SPEED_SAMPLE_MS / 1000.0, mode);
+        if (sys.abort || (sys.suspend & SUSPEND_RESTART_RETRACT))
+            return true;
+    }
+    grbl_msg_sendf(CLIENT_ALL, MSG_LEVEL_INFO, "Spindle not at speed: %d of %d RPM", actual, target);
+    return true;
+#else
+    return false;
+#endif
 }
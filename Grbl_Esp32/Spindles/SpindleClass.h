@@ -39,6 +39,9 @@
 #define SPINDLE_TYPE_10V        7
 #define SPINDLE_TYPE_XB_SERVO   8 // [XBoard]
 #define SPINDLE_TYPE_XB_EM      9 // [XBoard]
+#define SPINDLE_TYPE_H100       10
+#define SPINDLE_TYPE_YL620      11
+#define SPINDLE_TYPE_DELTA      12
 
 #ifndef SPINDLE_CLASS_H
 #define SPINDLE_CLASS_H
@@ -47,6 +50,59 @@
 #include <driver/dac.h>
 #include "driver/uart.h"
 
+// See SPINDLE_AT_SPEED in config.h
+#ifndef SPINDLE_AT_SPEED_TOLERANCE
+    #define SPINDLE_AT_SPEED_TOLERANCE  5       // percent of the programmed RPM
+#endif
+#ifndef SPINDLE_AT_SPEED_TIMEOUT_MS
+    #define SPINDLE_AT_SPEED_TIMEOUT_MS 10000
+#endif
+#ifndef SPINDLE_AT_SPEED_SAMPLE_MS
+    #define SPINDLE_AT_SPEED_SAMPLE_MS  100
+#endif
+
+// A PWM spindle tachometer on SPINDLE_TACH_PIN is counted by this PCNT unit.
+// Encoders use the units from 0 up, one per axis.
+#ifndef SPINDLE_TACH_PULSES_PER_REV
+    #define SPINDLE_TACH_PULSES_PER_REV 1
+#endif
+#define SPINDLE_TACH_PCNT_UNIT PCNT_UNIT_7
+
+// The Spindle/Curve setting maps RPM to duty with up to this many "rpm:percent" points.
+// It is resampled into a table of SPINDLE_DUTY_TABLE_SIZE equal RPM steps from $31 to $30.
+#define SPINDLE_CURVE_MAX_POINTS 16
+#define SPINDLE_DUTY_TABLE_SIZE  32
+
+// A second spindle, for machines that carry two tools like a router and a laser. The machine
+// definition enables it by defining SPINDLE2_TYPE, the default of Spindle2/Type, and its pins.
+// Both spindles are initialized at boot, and M6 switches between them without an init(): a T
+// word equal to Spindle2/Tool selects the second, any other tool the first. Only the spindles
+// driven by the PWMSpindle code, on LEDC channel 1, can be the second one. It has its own
+// Spindle2/MinS and Spindle2/MaxS, and shares the PWM frequency and duty settings.
+#ifdef SPINDLE2_TYPE
+    #ifndef SPINDLE2_OUTPUT_PIN
+        #define SPINDLE2_OUTPUT_PIN UNDEFINED_PIN
+    #endif
+    #ifndef SPINDLE2_ENABLE_PIN
+        #define SPINDLE2_ENABLE_PIN UNDEFINED_PIN
+    #endif
+    #ifndef SPINDLE2_DIR_PIN
+        #define SPINDLE2_DIR_PIN    UNDEFINED_PIN
+    #endif
+    #define SPINDLE2_PWM_CHANNEL 1 // sys_get_next_PWM_chan_num() starts at 2
+#endif
+
+// $Spindle/Calibrate measures this many points from $35 to $36 with the tachometer
+#ifndef SPINDLE_CALIBRATE_POINTS
+    #define SPINDLE_CALIBRATE_POINTS   8
+#endif
+#ifndef SPINDLE_CALIBRATE_SETTLE_MS
+    #define SPINDLE_CALIBRATE_SETTLE_MS 3000 // Time to reach each speed before it is measured
+#endif
+#ifndef SPINDLE_CALIBRATE_SAMPLES
+    #define SPINDLE_CALIBRATE_SAMPLES  10    // Tach readings of SPINDLE_AT_SPEED_SAMPLE_MS averaged per point
+#endif
+
 
 // ===============  No floats! ===========================
 // ================ NO FLOATS! ==========================
@@ -62,8 +118,18 @@ class Spindle {
     virtual void config_message();
     virtual bool isRateAdjusted();
     virtual void spindle_sync(uint8_t state, uint32_t rpm);
+    bool laser_toggle(uint8_t state);
+
+    // Returns false if the spindle cannot measure its speed
+    virtual bool get_actual_rpm(uint32_t* rpm);
+    bool wait_at_speed(uint8_t mode);
 
     bool is_reversable;
+    uint8_t pin_state = SPINDLE_DISABLE; // The state set_state() last put the enable and direction pins in
+    // Set by spindles whose speed is only a PWM duty, so the stepper can convert the rpm of
+    // each segment with PWMSpindle::rpm_to_duty() as it is prepared and the ISR only writes it.
+    bool segment_duty = false;
+    uint8_t slot = 0; // 1 for the spindle of Spindle2/Type, see SPINDLE2_TYPE
 };
 
 // This is a dummy spindle that has no I/O.
@@ -87,6 +153,11 @@ class PWMSpindle : public Spindle {
     uint8_t get_state();
     void stop();
     void config_message();
+    bool get_actual_rpm(uint32_t* rpm);
+
+    uint32_t rpm_to_duty(uint32_t* rpm);
+    void write_duty(uint32_t duty);
+    bool calibrate(String& curve);
 
   private:   
     void set_spindle_dir_pin(bool Clockwise);
@@ -105,14 +176,19 @@ class PWMSpindle : public Spindle {
     uint32_t _pwm_freq;
     uint32_t _pwm_period; // how many counts in 1 period
     uint8_t _pwm_precision;
-    bool _piecewide_linear;
+    bool _duty_table_used;
+    uint32_t _duty_table[SPINDLE_DUTY_TABLE_SIZE + 1]; // Duties at equal steps from _min_rpm to _max_rpm
+    uint32_t _duty_table_scale; // Table steps per rpm, in 16.16 fixed point
     bool _off_with_zero_speed;
     bool _invert_pwm;
+    int8_t _dac_channel; // For DacSpindle, the DAC channel written instead of the PWM, or -1
     //uint32_t _pwm_gradient; // Precalulated value to speed up rpm to PWM conversions.
 
     virtual void set_output(uint32_t duty);
     void set_enable_pin(bool enable_pin);
     void get_pins_and_settings();
+    void init_tach();
+    void init_duty_table();
     uint8_t calc_pwm_precision(uint32_t freq);
 };
 
@@ -152,6 +228,8 @@ private:
 	uint8_t pwm_precision;
   float max_angle;
   bool dir_invert;
+  float duty_min;       // The duty at 0 degrees
+  float duty_per_angle; // Made by init(), so set_rpm() does no pow()
 };
 
 // this is the same as a PWM spindle but the M4 compensation is supported.
@@ -162,43 +240,74 @@ class Laser : public PWMSpindle {
 };
 
 // This uses one of the (2) DAC pins on ESP32 to output a voltage
+// The PWMSpindle rpm mapping and segment_duty path are used, with DAC counts as the duty.
 class DacSpindle : public PWMSpindle {
   public:
     void init();
     void config_message();
-    uint32_t set_rpm(uint32_t rpm);
-  private:
-    bool _gpio_ok; // DAC is on a valid pin
-  protected:
-    void set_output(uint32_t duty); // sets DAC instead of PWM
 };
 
-class HuanyangSpindle : public Spindle {
+// RS485 Modbus RTU frames, see VFDSpindle.cpp
+#define VFD_MAX_MSG_SIZE   10   // more than enough for a modbus message
+
+typedef struct {
+    uint8_t tx_length;
+    uint8_t rx_length;
+    char msg[VFD_MAX_MSG_SIZE];
+} vfd_command_t;
+
+typedef enum : uint8_t {
+    VFD_FRAMING_MODBUS,    // ADDR FN REG_HI REG_LO VALUE_HI VALUE_LO CRC
+    VFD_FRAMING_HUANYANG,  // ADDR FN LEN DATA CRC, where a read puts the parameter in DATA
+} vfd_framing_t;
+
+typedef struct {
+    uint8_t function;
+    uint16_t reg;    // Not used by writes with VFD_FRAMING_HUANYANG
+    uint16_t value;  // Not used by set_speed and read_speed
+} vfd_write_t;
+
+// Everything that differs between VFD models
+typedef struct {
+    const char* name;
+    vfd_framing_t framing;
+    vfd_write_t run_cw;
+    vfd_write_t run_ccw;
+    vfd_write_t stop;
+    vfd_write_t set_speed;
+    vfd_write_t read_speed;    // Output frequency
+    uint16_t units_per_hz;     // Of the frequency registers, 100 for 0.01 Hz
+} vfd_register_map_t;
+
+extern const vfd_register_map_t huanyang_registers;
+extern const vfd_register_map_t h100_registers;
+extern const vfd_register_map_t yl620_registers;
+extern const vfd_register_map_t delta_registers;
+
+// A VFD on RS485, described by its register map
+class VFDSpindle : public Spindle {
   private:
-    uint16_t  ModRTU_CRC(char* buf, int len);
-    void add_ModRTU_CRC(char* buf, int full_msg_len);
     bool set_mode(uint8_t mode);
+    bool queue_write(const vfd_write_t* write, uint16_t value, uint8_t len);
     bool get_pins_and_settings();
 
+    const vfd_register_map_t* _map;
     uint32_t _current_pwm_rpm;
     uint8_t _txd_pin;
     uint8_t _rxd_pin;
     uint8_t _rts_pin;
     uint8_t _state;
-    bool _task_running;
 
   public:
-    HuanyangSpindle() {
-        _task_running = false;
-    }
+    VFDSpindle(const vfd_register_map_t* map) : _map(map) {}
     void init();
     void config_message();
     void set_state(uint8_t state, uint32_t rpm);
     uint8_t get_state();
     uint32_t set_rpm(uint32_t rpm);
     void stop();
-
-
+    bool get_actual_rpm(uint32_t* rpm);
+    static void add_ModRTU_CRC(char* buf, int full_msg_len);
 };
 
 class BESCSpindle : public PWMSpindle {
@@ -206,6 +315,12 @@ class BESCSpindle : public PWMSpindle {
     void init();
     void config_message();
     uint32_t set_rpm(uint32_t rpm);
+    void spindle_sync(uint8_t state, uint32_t rpm);
+  protected:
+    void set_output(uint32_t duty); // fades over the ramp time
+  private:
+    uint32_t _ramp_ms;     // Time from off to full speed, 0 for no ramp
+    uint32_t _ramp_end_ms; // millis() when the last fade is done
 };
 
 class _10vSpindle : public PWMSpindle {
@@ -234,11 +349,18 @@ extern XBoard_ElectromagnetSpindle xboard_electromagnet_spindle;// [XBoard]
 extern XBoard_ServoSpindle xboard_servo_spindle;// [XBoard]
 extern Laser laser;
 extern DacSpindle dac_spindle;
-extern HuanyangSpindle huanyang_spindle;
+extern VFDSpindle huanyang_spindle;
 extern BESCSpindle besc_spindle;
 extern _10vSpindle _10v_spindle;
 
 void spindle_select();
+void spindle_stop_all();
+#ifdef SPINDLE2_TYPE
+void spindle_init_all();
+bool spindle_select_tool(uint8_t tool);
+#endif
+
+int spindle_parse_curve(const char* value, float* rpm, float* percent, int max_points);
 
 // in HuanyangSpindle.cpp
 void vfd_cmd_task(void* pvParameters);
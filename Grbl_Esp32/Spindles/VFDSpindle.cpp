@@ -0,0 +1,451 @@
+/*
+    VFDSpindle.cpp
+
+    This is for VFD based spindles controlled via RS485 Modbus RTU.
+    Each VFD model is a register map, see the end of this file. The
+    spindles share one RS485 port, one command queue and one task.
+
+    Part of Grbl_ESP32
+    2020 -	Bart Dring
+
+    Grbl is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    Grbl is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+    You should have received a copy of the GNU General Public License
+    along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+                         WARNING!!!!
+    VFDs are very dangerous. They have high voltages and are very powerful
+    Remove power before changing bits.
+
+    VFD frequencies are in Hz. Multiply by 60 for RPM
+
+    The VFD must be setup for RS485 control of run commands and frequency,
+    at the address and baud rate below, 8N1. See the register maps.
+
+    TODO
+        Returning errors to Grbl and handling them in Grbl.
+        What happens if the VFD does not respond
+*/
+#include "SpindleClass.h"
+
+#include "driver/uart.h"
+
+#define VFD_RS485_UART_PORT     UART_NUM_2      // hard coded for this port right now
+#define VFD_RS485_BUF_SIZE      127
+#define RESPONSE_WAIT_TICKS     50 // how long to wait for a response
+
+// OK to change these
+// #define them in your machine definition file if you want different values.
+// The HUANYANG_ names are from before other VFDs were supported.
+#ifndef VFD_RS485_ADDR
+    #ifdef HUANYANG_ADDR
+        #define VFD_RS485_ADDR      HUANYANG_ADDR
+    #else
+        #define VFD_RS485_ADDR      0x01
+    #endif
+#endif
+
+#ifndef VFD_RS485_BAUD_RATE
+    #ifdef HUANYANG_BAUD_RATE
+        #define VFD_RS485_BAUD_RATE HUANYANG_BAUD_RATE
+    #else
+        #define VFD_RS485_BAUD_RATE 9600   // Huanyang PD164 setting
+    #endif
+#endif
+
+#if !defined(VFD_RS485_TXD_PIN) && defined(HUANYANG_TXD_PIN)
+    #define VFD_RS485_TXD_PIN HUANYANG_TXD_PIN
+#endif
+#if !defined(VFD_RS485_RXD_PIN) && defined(HUANYANG_RXD_PIN)
+    #define VFD_RS485_RXD_PIN HUANYANG_RXD_PIN
+#endif
+#if !defined(VFD_RS485_RTS_PIN) && defined(HUANYANG_RTS_PIN)
+    #define VFD_RS485_RTS_PIN HUANYANG_RTS_PIN
+#endif
+
+#ifndef VFD_POLL_TICKS
+    #define VFD_POLL_TICKS          250    // Read the output frequency after this long without a command
+#endif
+
+#define VFD_QUEUE_LENGTH        10
+#define VFD_QUEUE_WAIT_TICKS    20   // How long set_state() waits for room in the queue
+
+// Modbus RTU frames are separated by 3.5 character times of silence, 11 bits each
+#define VFD_FRAME_GAP_TICKS (pdMS_TO_TICKS(38500 / VFD_RS485_BAUD_RATE) + 1)
+
+// communication task and queue stuff
+QueueHandle_t vfd_cmd_queue;
+
+static TaskHandle_t vfd_cmdTaskHandle = 0;
+
+static const vfd_register_map_t* volatile vfd_map = NULL; // Of the spindle in use, for the polls
+static volatile bool vfd_spindle_on = false;  // Set by set_mode(), the VFD is polled only while it runs
+static volatile uint32_t vfd_output_rpm = 0;  // From the last poll
+
+// Builds the frame that reads the output frequency
+static void vfd_poll_command(const vfd_register_map_t* map, vfd_command_t* cmd) {
+    uint16_t reg = map->read_speed.reg;
+    cmd->msg[0] = VFD_RS485_ADDR;
+    cmd->msg[1] = map->read_speed.function;
+    if (map->framing == VFD_FRAMING_HUANYANG) {
+        // ADDR 0x04 0x03 REG 0x00 0x00 CRC, answered by ADDR 0x04 0x03 REG HI LO CRC
+        cmd->msg[2] = 0x03;
+        cmd->msg[3] = reg;
+        cmd->msg[4] = 0x00;
+        cmd->msg[5] = 0x00;
+        cmd->tx_length = 8;
+        cmd->rx_length = 8;
+    } else {
+        // ADDR FN REG_HI REG_LO 0x00 0x01 CRC, answered by ADDR FN 0x02 HI LO CRC
+        cmd->msg[2] = reg >> 8;
+        cmd->msg[3] = reg & 0xFF;
+        cmd->msg[4] = 0x00;
+        cmd->msg[5] = 0x01;
+        cmd->tx_length = 8;
+        cmd->rx_length = 7;
+    }
+    VFDSpindle::add_ModRTU_CRC(cmd->msg, cmd->tx_length);
+}
+
+static uint32_t vfd_poll_rpm(const vfd_register_map_t* map, const uint8_t* rx_message) {
+    const uint8_t* value = &rx_message[map->framing == VFD_FRAMING_HUANYANG ? 4 : 3];
+    return ((value[0] << 8) | value[1]) * 60 / map->units_per_hz;
+}
+
+// The communications task. It sleeps on the queue, so a command is sent as soon
+// as it is queued, and queued commands go out back to back with only the Modbus
+// frame gap between them. When no command comes for VFD_POLL_TICKS while the
+// spindle runs, the output frequency is read to check that the VFD still answers.
+void vfd_cmd_task(void* pvParameters) {
+    vfd_command_t next_cmd;
+    uint8_t rx_message[VFD_MAX_MSG_SIZE];
+    bool unresponsive = false;
+
+    while (true) {
+        bool polling = false;
+        const vfd_register_map_t* map = vfd_map;
+        if (xQueueReceive(vfd_cmd_queue, &next_cmd, VFD_POLL_TICKS) != pdTRUE) {
+            if (!vfd_spindle_on || !map)
+                continue;
+            vfd_poll_command(map, &next_cmd);
+            polling = true;
+        }
+        //report_hex_msg(next_cmd.msg, "To VFD:", next_cmd.tx_length);  // TODO for debugging comment out
+        uart_flush_input(VFD_RS485_UART_PORT); // Drop a late answer to an earlier command
+        TRACE_BEGIN(TRACE_SPINDLE, next_cmd.tx_length);
+        uart_write_bytes(VFD_RS485_UART_PORT, next_cmd.msg, next_cmd.tx_length);
+
+        uint16_t read_length = uart_read_bytes(VFD_RS485_UART_PORT, rx_message, next_cmd.rx_length, RESPONSE_WAIT_TICKS);
+        TRACE_END(TRACE_SPINDLE);
+
+        if (read_length < next_cmd.rx_length) {
+            if (!unresponsive)
+                grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Spindle RS485 Unresponsive");
+            unresponsive = true;
+            vfd_output_rpm = 0;
+            // TODO Do something with this error
+            // system_set_exec_alarm(EXEC_ALARM_SPINDLE_CONTROL);
+        } else {
+            if (unresponsive)
+                grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Spindle RS485 Responding");
+            unresponsive = false;
+            // The CRC over a whole frame, its own CRC included, is 0
+            if (polling && crc16_modbus(rx_message, read_length) == 0)
+                vfd_output_rpm = vfd_poll_rpm(map, rx_message);
+        }
+        vTaskDelay(VFD_FRAME_GAP_TICKS);
+    }
+}
+
+// ================== Class methods ==================================
+
+void VFDSpindle :: init() {
+
+    if (! vfd_cmdTaskHandle) { // init can happen many times, we only want to start one task
+        vfd_cmd_queue = xQueueCreate(VFD_QUEUE_LENGTH, sizeof(vfd_command_t));
+        task_create(TASK_VFD, vfd_cmd_task, 2048, NULL, &vfd_cmdTaskHandle);
+    }
+
+    // fail if required items are not defined
+    if (!get_pins_and_settings()) {
+        grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "%s spindle errors", _map->name);
+        return;
+    }
+
+    // this allows us to init() again later.
+    // If you change certain settings, init() gets called agian
+    uart_driver_delete(VFD_RS485_UART_PORT);
+
+    uart_config_t uart_config = {
+        .baud_rate = VFD_RS485_BAUD_RATE,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .rx_flow_ctrl_thresh = 122,
+    };
+
+    uart_param_config(VFD_RS485_UART_PORT, &uart_config);
+
+    uart_set_pin(VFD_RS485_UART_PORT,
+                 _txd_pin,
+                 _rxd_pin,
+                 _rts_pin,
+                 UART_PIN_NO_CHANGE);
+
+    uart_driver_install(VFD_RS485_UART_PORT,
+                        VFD_RS485_BUF_SIZE * 2,
+                        0,
+                        0,
+                        NULL,
+                        0);
+
+    uart_set_mode(VFD_RS485_UART_PORT, UART_MODE_RS485_HALF_DUPLEX);
+
+    is_reversable = true; // these VFDs are always reversable
+
+    //
+    _current_pwm_rpm = 0;
+    _state = SPINDLE_DISABLE;
+    vfd_map = _map;
+
+    config_message();
+}
+
+// Checks for all the required pin definitions
+// It returns a message for each missing pin
+// Returns true if all pins are defined.
+bool VFDSpindle :: get_pins_and_settings() {
+    bool pins_ok = true;
+
+#ifdef VFD_RS485_TXD_PIN
+    _txd_pin = VFD_RS485_TXD_PIN;
+#else
+    grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Missing VFD_RS485_TXD_PIN");
+    pins_ok = false;
+#endif
+
+#ifdef VFD_RS485_RXD_PIN
+    _rxd_pin = VFD_RS485_RXD_PIN;
+#else
+    grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "No VFD_RS485_RXD_PIN");
+    pins_ok = false;
+#endif
+
+#ifdef VFD_RS485_RTS_PIN
+    _rts_pin = VFD_RS485_RTS_PIN;
+#else
+    grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "No VFD_RS485_RTS_PIN");
+    pins_ok = false;
+#endif
+
+    return pins_ok;
+}
+
+void VFDSpindle :: config_message() {
+    grbl_msg_sendf(CLIENT_SERIAL,
+                    MSG_LEVEL_INFO,
+                    "%s Spindle Tx:%s Rx:%s RTS:%s",
+                    _map->name,
+                    pinName(_txd_pin).c_str(),
+                    pinName(_rxd_pin).c_str(),
+                    pinName(_rts_pin).c_str());
+}
+
+void VFDSpindle :: set_state(uint8_t state, uint32_t rpm) {
+    if (sys.abort)
+        return;   // Block during abort.
+
+    if (state != _state) { // already at the desired state. This function gets called a lot.
+        if (!set_mode(state))
+            return; // The queue is full, so the next call tries again
+        _state = state; // store locally for faster get_state()
+        if (state == SPINDLE_DISABLE) {
+            sys.spindle_speed = 0;
+            _current_pwm_rpm = 0; // So the next start sends the speed again
+            return;
+        }
+    }
+
+    set_rpm(rpm);
+    sys.report_ovr_counter = 0; // Set to report change immediately
+
+    return;
+}
+
+// Queues a write of value. A Huanyang write has len data bytes and no register.
+bool VFDSpindle :: queue_write(const vfd_write_t* write, uint16_t value, uint8_t len) {
+    vfd_command_t cmd;
+
+    cmd.msg[0] = VFD_RS485_ADDR;
+    cmd.msg[1] = write->function;
+    if (_map->framing == VFD_FRAMING_HUANYANG) {
+        // ADDR FN LEN DATA CRC, echoed back
+        cmd.msg[2] = len;
+        if (len == 1) {
+            cmd.msg[3] = value;
+        } else {
+            cmd.msg[3] = value >> 8;
+            cmd.msg[4] = value & 0xFF;
+        }
+        cmd.tx_length = 3 + len + 2;
+        cmd.rx_length = 6;
+    } else {
+        // ADDR FN REG_HI REG_LO VALUE_HI VALUE_LO CRC, echoed back
+        cmd.msg[2] = write->reg >> 8;
+        cmd.msg[3] = write->reg & 0xFF;
+        cmd.msg[4] = value >> 8;
+        cmd.msg[5] = value & 0xFF;
+        cmd.tx_length = 8;
+        cmd.rx_length = 8;
+    }
+
+    add_ModRTU_CRC(cmd.msg, cmd.tx_length);
+
+    if (xQueueSend(vfd_cmd_queue, &cmd, VFD_QUEUE_WAIT_TICKS) != pdTRUE) {
+        grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "VFD Queue Full");
+        return false;
+    }
+    return true;
+}
+
+bool VFDSpindle :: set_mode(uint8_t mode) {
+    const vfd_write_t* write;
+
+    if (mode == SPINDLE_ENABLE_CW)
+        write = &_map->run_cw;
+    else if (mode == SPINDLE_ENABLE_CCW)
+        write = &_map->run_ccw;
+    else    //SPINDLE_DISABLE
+        write = &_map->stop;
+
+    if (!queue_write(write, write->value, 1))
+        return false;
+    vfd_spindle_on = (mode != SPINDLE_DISABLE);
+    vfd_output_rpm = 0; // Stale until the next poll
+    return true;
+}
+
+uint32_t VFDSpindle :: set_rpm(uint32_t rpm) {
+    if (rpm == _current_pwm_rpm) // prevent setting same RPM twice
+        return rpm;
+
+    _current_pwm_rpm = rpm;
+
+    // TODO add the speed modifiers override, linearization, etc.
+
+    uint16_t data = (uint16_t)(rpm * _map->units_per_hz / 60);
+
+    sys.spindle_speed = rpm;
+
+    if (!queue_write(&_map->set_speed, data, 2))
+        _current_pwm_rpm = 0; // Send it again next time
+
+    return rpm;
+}
+
+void VFDSpindle ::stop() {
+    set_mode(SPINDLE_DISABLE);
+}
+
+// state is cached rather than read right now to prevent delays
+uint8_t VFDSpindle :: get_state() {
+    return _state;
+}
+
+// The RPM the VFD reported at the last poll, 0 if it did not answer
+bool VFDSpindle :: get_actual_rpm(uint32_t* rpm) {
+    *rpm = vfd_output_rpm;
+    return true;
+}
+
+// Calculate the CRC on all of the byte except the last 2
+// It then added the CRC to those last 2 bytes
+// full_msg_len This is the length of the message including the 2 crc bytes
+void VFDSpindle :: add_ModRTU_CRC(char* buf, int full_msg_len) {
+    uint16_t crc = crc16_modbus((const uint8_t*)buf, full_msg_len - 2);
+    // add the calculated Crc to the message
+    buf[full_msg_len - 1] = (crc & 0xFF00) >> 8;
+    buf[full_msg_len - 2] = (crc & 0xFF);
+}
+
+// ================== Register maps ==================================
+
+/*
+    Huanyang, with its own framing: ADDR FN LEN DATA CRC
+
+    before using spindle, VFD must be setup for RS485 and match your spindle
+    PD001   2   RS485 Control of run commands
+    PD002   2   RS485 Control of operating frequency
+    PD005   400 Maximum frequency Hz (Typical for spindles)
+    PD011   120 Min Speed (Recommend Aircooled=120 Water=100)
+    PD014   10  Acceleration time (Test to optimize)
+    PD015   10  Deceleration time (Test to optimize)
+    PD023   1   Reverse run enabled
+    PD142   3.7 Max current Amps (0.8kw=3.7 1.5kw=7.0, 2.2kw=??)
+    PD163   1   RS485 Address: 1 (Typical. OK to change...see below)
+    PD164   1   RS485 Baud rate: 9600 (Typical. OK to change...see below)
+    PD165   3   RS485 Mode: RTU, 8N1
+
+    ADDR    CMD     LEN     DATA        CRC
+    0x01    0x03    0x01    0x01        0x31 0x88               Start spindle clockwise
+    0x01    0x03    0x01    0x08        0xF1 0x8E               Stop spindle
+    0x01    0x03    0x01    0x11        0x30 0x44               Start spindle counter-clockwise
+    0x01    0x05    0x02    0x09 0xC4   0xBF 0x0F               Write Frequency (0x9C4 = 2500 = 25.00HZ)
+    0x01    0x04    0x03    0x01 0x00 0x00                      Read output frequency
+
+    Some references....
+    Manual: http://www.hy-electrical.com/bf/inverter.pdf
+    Reference: https://github.com/Smoothieware/Smoothieware/blob/edge/src/modules/tools/spindle/HuanyangSpindleControl.cpp
+    Refernece: https://gist.github.com/Bouni/803492ed0aab3f944066
+    VFD settings: https://www.hobbytronics.co.za/Content/external/1159/Spindle_Settings.pdf
+*/
+const vfd_register_map_t huanyang_registers = {
+    "Huanyang", VFD_FRAMING_HUANYANG,
+    { 0x03, 0, 0x01 },      // run_cw
+    { 0x03, 0, 0x11 },      // run_ccw
+    { 0x03, 0, 0x08 },      // stop
+    { 0x05, 0, 0 },         // set_speed
+    { 0x04, 0x01, 0 },      // read_speed, output frequency
+    100,                    // 0.01 Hz
+};
+
+// H100: coils 0x49-0x4B start forward, start reverse and stop,
+// frequency in 0.1 Hz set in register 0x0201 and read from input register 0x0000
+const vfd_register_map_t h100_registers = {
+    "H100", VFD_FRAMING_MODBUS,
+    { 0x05, 0x0049, 0xFF00 },
+    { 0x05, 0x004A, 0xFF00 },
+    { 0x05, 0x004B, 0xFF00 },
+    { 0x06, 0x0201, 0 },
+    { 0x04, 0x0000, 0 },
+    10,
+};
+
+// YL620: control word 0x2000, frequency in 0.1 Hz set in 0x2001 and read from 0x200B
+const vfd_register_map_t yl620_registers = {
+    "YL620", VFD_FRAMING_MODBUS,
+    { 0x06, 0x2000, 0x0012 },
+    { 0x06, 0x2000, 0x0022 },
+    { 0x06, 0x2000, 0x0001 },
+    { 0x06, 0x2001, 0 },
+    { 0x03, 0x200B, 0 },
+    10,
+};
+
+// Delta VFD-E and MS300: control word 0x2000, frequency in 0.01 Hz set in 0x2001 and read from 0x2103
+const vfd_register_map_t delta_registers = {
+    "Delta", VFD_FRAMING_MODBUS,
+    { 0x06, 0x2000, 0x0012 },
+    { 0x06, 0x2000, 0x0022 },
+    { 0x06, 0x2000, 0x0001 },
+    { 0x06, 0x2001, 0 },
+    { 0x03, 0x2103, 0 },
+    100,
+};
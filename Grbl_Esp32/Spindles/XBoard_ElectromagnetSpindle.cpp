@@ -61,14 +61,7 @@ void Electromagnet_Hold_Task(void* pvParameters)
 
 void XBoard_ElectromagnetSpindle::Electromagnet_Hold_Task_Init()
 {
-	xTaskCreatePinnedToCore(Electromagnet_Hold_Task,	// task
-		"Electromagnet_Hold_TaskHandle",				// name for task
-		4096,   // size of task stack
-		NULL,   // parameters
-		1,		// priority
-		&Electromagnet_Hold_TaskHandle,
-		0		// core
-	);
+	task_create(TASK_ELECTROMAGNET, Electromagnet_Hold_Task, 4096, NULL, &Electromagnet_Hold_TaskHandle);
 }
 
 void XBoard_ElectromagnetSpindle::init() {
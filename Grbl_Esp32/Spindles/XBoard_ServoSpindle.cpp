@@ -36,6 +36,8 @@ void XBoard_ServoSpindle::init() {
 	max_angle = xboard_servo_max_angle->get();
 	dir_invert = xboard_servo_invert->get();
 #endif
+	duty_min = (0.5 / 20.0) * (1 << pwm_precision);
+	duty_per_angle = ((0.5 / 45.0) / 20.0) * (1 << pwm_precision);
 
 	ledcSetup(spindle_pwm_chan_num, (double)pwm_freq, pwm_precision); // setup the channel
 	ledcAttachPin(output_pin, spindle_pwm_chan_num); // attach the PWM to the pin
@@ -63,9 +65,8 @@ void XBoard_ServoSpindle:: config_message() {
 uint32_t XBoard_ServoSpindle::angle2duty(float angle)
 {
 	if(dir_invert == true)
-		return (uint32_t)(((0.5 + ((max_angle - angle)/45.0)*0.5) / 20.0)*pow(2, pwm_precision));
-	else
-		return (uint32_t)(((0.5 + (angle/45.0)*0.5) / 20.0)*pow(2, pwm_precision));
+		angle = max_angle - angle;
+	return (uint32_t)(duty_min + angle * duty_per_angle);
 }
 
 uint32_t XBoard_ServoSpindle::set_rpm(uint32_t rpm) {
@@ -27,6 +27,8 @@
 #include <SPIFFS.h>
 #include <esp_wifi.h>
 #include <esp_ota_ops.h>
+#include <esp_heap_caps.h>
+#include <new>
 
 #include "espresponse.h"
 #include "web_server.h"
@@ -62,6 +64,12 @@ enum_opt_t staModeOptions = {
 
 #ifdef WIFI_OR_BLUETOOTH
 EnumSetting* wifi_radio_mode;
+#ifdef ENABLE_ETHERNET
+EnumSetting* eth_enable;
+#endif
+#ifdef UDP_REALTIME
+StringSetting* udp_realtime_key;
+#endif
 enum_opt_t radioOptions = {
     { "None", ESP_RADIO_OFF, },
     { "STA", ESP_WIFI_STA, },
@@ -170,6 +178,23 @@ err_t WebCommand::action(char* value, auth_t auth_level, ESPResponseStream* out)
     return _action(value, auth_level);
 };
 
+// Encoders for the response stream. They come from the request arena when the
+// stream has one, and from the heap otherwise.
+static JSONencoder* new_json() {
+    bool pretty = espresponse->client() != CLIENT_WEBUI;
+    void* mem = espresponse->alloc(sizeof(JSONencoder));
+    return mem ? new (mem) JSONencoder(pretty, espresponse) : new JSONencoder(pretty, espresponse);
+}
+
+static void end_json(JSONencoder* j) {
+    j->end();
+    if (espresponse->owns(j)) {
+        j->~JSONencoder();
+    } else {
+        delete j;
+    }
+}
+
 static int webColumn = 0;
 // We create a variety of print functions to make the rest
 // of the code more compact and readable.
@@ -230,26 +255,6 @@ static void webPrintln(const char *s, String s2)
     webPrintln(s, s2.c_str());
 }
 
-char *trim(char *str)
-{
-    char *end;
-    // Trim leading space
-    while(isspace((unsigned char)*str)) {
-        str++;
-    }
-    if(*str == 0)  {  // All spaces?
-        return str;
-    }
-    // Trim trailing space
-    end = str + strlen(str) - 1;
-    while(end > str && isspace((unsigned char)*end)) {
-        end--;
-    }
-    // Write new null terminator character
-    end[1] = '\0';
-    return str;
-}
-
 static void print_mac(const char *s, String mac)
 {
     webPrint(s);
@@ -314,6 +319,9 @@ static err_t formatSpiffs(char *parameter, auth_t auth_level) { // ESP710
     }
     webPrint("Formatting");
     SPIFFS.format();
+#if defined (ENABLE_WIFI) && defined (ENABLE_HTTP)
+    web_server.spiffs_changed();
+#endif
     webPrintln("...Done");
     return STATUS_OK;
 }
@@ -386,7 +394,7 @@ static err_t sendMessage(char *parameter, auth_t auth_level) { // ESP600
         return STATUS_INVALID_VALUE;
     }
     if (!notificationsservice.sendMSG("GRBL Notification", parameter)) {
-        webPrintln("Cannot send message!");
+        webPrintln("Cannot queue message!");
         return STATUS_MESSAGE_FAILED;
     }
     return STATUS_OK;
@@ -418,16 +426,35 @@ static err_t setSystemMode(char *parameter, auth_t auth_level) { // ESP444
     return STATUS_OK;
 }
 
+#ifdef HEAP_TRACE
+static err_t showHeapTrace(char *parameter, auth_t auth_level) { // ESP421
+    if (*parameter != '\0') {
+        if (strcasecmp(parameter, "RESET") != 0)
+            return STATUS_INVALID_VALUE;
+        heap_trace_clear();
+        webPrintln("Heap trace counts cleared");
+        return STATUS_OK;
+    }
+    heap_trace_report([](const char* line) { webPrintln(line); });
+    return STATUS_OK;
+}
+#endif
+
 static err_t showSysStats(char *parameter, auth_t auth_level) { // ESP420
     webPrintln("Chip ID: ", String((uint16_t)(ESP.getEfuseMac() >> 32)));
     webPrintln("CPU Frequency: ", String(ESP.getCpuFreqMHz()) + "Mhz");
     webPrintln("CPU Temperature: ", String(temperatureRead(), 1) + "C");
     webPrintln("Free memory: ", ESPResponseStream::formatBytes(ESP.getFreeHeap()));
+    webPrintln("Largest free block: ", ESPResponseStream::formatBytes(heap_caps_get_largest_free_block(MALLOC_CAP_8BIT)));
+    webPrintln("Lowest free memory: ", ESPResponseStream::formatBytes(ESP.getMinFreeHeap()));
+#if defined (ENABLE_WIFI) && defined (ENABLE_HTTP) && defined (WEB_REQUEST_ARENA)
+    webPrintln("Web request arena peak: ", ESPResponseStream::formatBytes(web_arena.high_water()) + " of " + ESPResponseStream::formatBytes(web_arena.size()));
+#endif
     webPrintln("SDK: ", ESP.getSdkVersion());
     webPrintln("Flash Size: ", ESPResponseStream::formatBytes(ESP.getFlashChipSize()));
 
     // Round baudRate to nearest 100 because ESP32 can say e.g. 115201
-    webPrintln("Baud rate: ", String((Serial.baudRate()/100) * 100));
+    webPrintln("Baud rate: ", String((serial_uart_baud_rate()/100) * 100));
     webPrintln("Sleep mode: ", WiFi.getSleep() ? "Modem" : "None");
 
 #ifdef ENABLE_WIFI
@@ -589,7 +616,7 @@ static err_t showSysStats(char *parameter, auth_t auth_level) { // ESP420
 
 #ifdef ENABLE_WIFI
 static err_t listAPs(char *parameter, auth_t auth_level) { // ESP410
-    JSONencoder* j = new JSONencoder(espresponse->client() != CLIENT_WEBUI);
+    JSONencoder* j = new_json();
     j->begin();
     j->begin_array("AP_LIST");
     // An initial async scanNetworks was issued at startup, so there
@@ -620,8 +647,7 @@ static err_t listAPs(char *parameter, auth_t auth_level) { // ESP410
             break;
     }
     j->end_array();
-    webPrint(j->end());
-    delete j;
+    end_json(j);
     if (espresponse->client() != CLIENT_WEBUI) {
         espresponse->println("");
     }
@@ -646,7 +672,7 @@ static err_t setWebSetting(char *parameter, auth_t auth_level) { // ESP401
 }
 
 static err_t listSettings(char *parameter, auth_t auth_level) { // ESP400
-    JSONencoder* j = new JSONencoder(espresponse->client() != CLIENT_WEBUI);
+    JSONencoder* j = new_json();
     j->begin();
     j->begin_array("EEPROM");
     for (Setting *js = Setting::List; js; js = js->next()) {
@@ -655,14 +681,28 @@ static err_t listSettings(char *parameter, auth_t auth_level) { // ESP400
         }
     }
     j->end_array();
-    webPrint(j->end());
-    delete j;
+    end_json(j);
     return STATUS_OK;
 }
 
 #ifdef ENABLE_SD_CARD
 static err_t runSDFile(char *parameter, auth_t auth_level) { // ESP220
     parameter = trim(parameter);
+#ifdef SD_RESUME
+    // file,line=N runs the file from line N
+    uint32_t line = 0;
+    char* line_option = strstr(parameter, ",line=");
+    if (line_option) {
+        char* end;
+        line = strtoul(line_option + 6, &end, 10);
+        if (end == line_option + 6 || *end != '\0' || line == 0) {
+            webPrintln("Bad line number");
+            return STATUS_BAD_NUMBER_FORMAT;
+        }
+        *line_option = '\0';
+        parameter = trim(parameter);
+    }
+#endif
     if (*parameter == '\0') {
         webPrintln("Missing file name!");
         return STATUS_INVALID_VALUE;
@@ -681,25 +721,137 @@ static err_t runSDFile(char *parameter, auth_t auth_level) { // ESP220
         webPrintln("Busy");
         return STATUS_IDLE_ERROR;
     }
+#ifdef SD_RESUME
+    if (line != 0) {
+        err_t err = sd_resume(SD, parameter, line, (espresponse) ? espresponse->client() : CLIENT_ALL);
+        if (err != STATUS_OK) {
+            webPrintln("");
+            return err;
+        }
+    } else if (openFile(SD, parameter))
+        sd_index_begin(SD, parameter);
+    else {
+        report_status_message(STATUS_SD_FAILED_READ, (espresponse) ? espresponse->client() : CLIENT_ALL);
+        webPrintln("");
+        return STATUS_OK;
+    }
+#else
     if (!openFile(SD, parameter)) {
         report_status_message(STATUS_SD_FAILED_READ, (espresponse) ? espresponse->client() : CLIENT_ALL);
         webPrintln("");
         return STATUS_OK;
     }
-    char fileLine[255];
-    if (!readFileLine(fileLine, 255)) {
+#endif
+#ifdef SD_COMPILE
+    if (sd_job_compiled() && sd_compiled_start_check() != STATUS_OK) {
+        closeFile();
+        webPrintln("Compiled at another position or offsets");
+        return STATUS_SD_COMPILED_MISMATCH;
+    }
+#endif
+    SD_client = (espresponse) ? espresponse->client() : CLIENT_ALL;
+    uint8_t status;
+    if (!sd_run_next(&status)) {
         //No need notification here it is just a macro
         closeFile();
         webPrintln("");
         return STATUS_OK;
     }
-    SD_client = (espresponse) ? espresponse->client() : CLIENT_ALL;
-    report_status_message(gc_execute_line(fileLine, (espresponse) ? espresponse->client() : CLIENT_ALL), (espresponse) ? espresponse->client() : CLIENT_ALL); // execute the first line
+    report_status_message(status, SD_client); // execute the first line
     report_realtime_status((espresponse) ? espresponse->client() : CLIENT_ALL);
     webPrintln("");
     return STATUS_OK;
 }
 
+#ifdef SD_JOB_QUEUE
+static err_t queueSDFile(char *parameter, auth_t auth_level) { // ESP224
+    parameter = trim(parameter);
+    uint8_t client = (espresponse) ? espresponse->client() : CLIENT_ALL;
+    if (*parameter == '\0') {
+        sd_queue_report(client);
+        return STATUS_OK;
+    }
+    // file,count=N queues N runs of the file
+    uint32_t runs = 1;
+    char* count_option = strstr(parameter, ",count=");
+    if (count_option) {
+        char* end;
+        runs = strtoul(count_option + 7, &end, 10);
+        if (end == count_option + 7 || *end != '\0' || runs == 0 || runs > 0xFFFF) {
+            webPrintln("Bad count");
+            return STATUS_BAD_NUMBER_FORMAT;
+        }
+        *count_option = '\0';
+        parameter = trim(parameter);
+    }
+    if (*parameter == '\0') {
+        webPrintln("Missing file name!");
+        return STATUS_INVALID_VALUE;
+    }
+    return sd_queue_add(parameter, runs, client);
+}
+
+static err_t clearSDQueue(char *parameter, auth_t auth_level) { // ESP225
+    sd_queue_clear();
+    webPrintln("SD queue cleared");
+    return STATUS_OK;
+}
+#endif
+
+#ifdef SD_COMPILE
+static err_t compileSDFile(char *parameter, auth_t auth_level) { // ESP221
+    parameter = trim(parameter);
+    if (*parameter == '\0') {
+        webPrintln("Missing file name!");
+        return STATUS_INVALID_VALUE;
+    }
+    int8_t state = get_sd_state(true);
+    if (state != SDCARD_IDLE) {
+        webPrintln((state == SDCARD_NOT_PRESENT) ? "No SD Card" : "SD Card Busy");
+        return (state == SDCARD_NOT_PRESENT) ? STATUS_SD_FAILED_MOUNT : STATUS_SD_FAILED_BUSY;
+    }
+    if (sys.state != STATE_IDLE) {
+        webPrintln("Busy");
+        return STATUS_IDLE_ERROR;
+    }
+    String path = parameter;
+    if (parameter[0] != '/')
+        path = "/" + path;
+    return sd_compile_file(SD, path.c_str(), (espresponse) ? espresponse->client() : CLIENT_ALL);
+}
+#endif
+
+#ifdef SD_BENCHMARK
+static err_t benchOrSimulateSDFile(char *parameter, bool simulate) {
+    parameter = trim(parameter);
+    if (*parameter == '\0') {
+        webPrintln("Missing file name!");
+        return STATUS_INVALID_VALUE;
+    }
+    int8_t state = get_sd_state(true);
+    if (state != SDCARD_IDLE) {
+        webPrintln((state == SDCARD_NOT_PRESENT) ? "No SD Card" : "SD Card Busy");
+        return (state == SDCARD_NOT_PRESENT) ? STATUS_SD_FAILED_MOUNT : STATUS_SD_FAILED_BUSY;
+    }
+    if (sys.state != STATE_IDLE) {
+        webPrintln("Busy");
+        return STATUS_IDLE_ERROR;
+    }
+    String path = parameter;
+    if (parameter[0] != '/')
+        path = "/" + path;
+    return sd_bench_file(SD, path.c_str(), (espresponse) ? espresponse->client() : CLIENT_ALL, simulate);
+}
+
+static err_t benchSDFile(char *parameter, auth_t auth_level) { // ESP222
+    return benchOrSimulateSDFile(parameter, false);
+}
+
+static err_t simulateSDFile(char *parameter, auth_t auth_level) { // ESP223
+    return benchOrSimulateSDFile(parameter, true);
+}
+#endif
+
 static err_t deleteSDObject(char *parameter, auth_t auth_level) { // ESP215
     parameter = trim(parameter);
     if (*parameter == '\0') {
@@ -734,6 +886,9 @@ static err_t deleteSDObject(char *parameter, auth_t auth_level) { // ESP215
         webPrintln("File deleted.");
     }
     file2del.close();
+#ifdef SD_DIR_CACHE
+    sd_dir_cache_removed(path.c_str());
+#endif
     return STATUS_OK;
 }
 
@@ -791,7 +946,7 @@ static void listDirJSON(fs::FS& fs, const char* dirname, uint8_t levels, JSONenc
 }
 
 static err_t listLocalFilesJSON(char *parameter, auth_t auth_level) { // No ESP command
-    JSONencoder* j = new JSONencoder(espresponse->client() != CLIENT_WEBUI);
+    JSONencoder* j = new_json();
     j->begin();
     j->begin_array("files");
     listDirJSON(SPIFFS, "/", 4, j);
@@ -799,7 +954,7 @@ static err_t listLocalFilesJSON(char *parameter, auth_t auth_level) { // No ESP
     j->member("total", SPIFFS.totalBytes());
     j->member("used", SPIFFS.usedBytes());
     j->member("occupation", String(100 * SPIFFS.usedBytes() / SPIFFS.totalBytes()));
-    webPrint(j->end());
+    end_json(j);
     if (espresponse->client() != CLIENT_WEBUI) {
         webPrintln("");
     }
@@ -991,6 +1146,9 @@ void make_web_settings()
         new WebCommand("RESTART", WEBCMD, WA, "ESP444", "System/Control",setSystemMode);
         new WebCommand(NULL,      WEBCMD, WU, "ESP420", "System/Stats", showSysStats);
     #endif
+    #ifdef HEAP_TRACE
+        new WebCommand("RESET",   WEBCMD, WU, "ESP421", "System/HeapTrace", showHeapTrace);
+    #endif
     #ifdef ENABLE_WIFI
         new WebCommand(NULL,      WEBCMD, WU, "ESP410", "WiFi/ListAPs", listAPs);
     #endif
@@ -1001,6 +1159,18 @@ void make_web_settings()
     #endif
     #ifdef ENABLE_SD_CARD
         new WebCommand("path",    WEBCMD, WU, "ESP220", "SD/Run",       runSDFile);
+    #ifdef SD_COMPILE
+        new WebCommand("path",    WEBCMD, WU, "ESP221", "SD/Compile",   compileSDFile);
+    #endif
+    #ifdef SD_JOB_QUEUE
+        new WebCommand("path[,count=N]",
+                                  WEBCMD, WU, "ESP224", "SD/Queue",     queueSDFile);
+        new WebCommand(NULL,      WEBCMD, WU, "ESP225", "SD/Queue/Clear", clearSDQueue);
+    #endif
+    #ifdef SD_BENCHMARK
+        new WebCommand("path",    WEBCMD, WU, "ESP222", "SD/Bench",     benchSDFile);
+        new WebCommand("path",    WEBCMD, WU, "ESP223", "SD/Simulate",  simulateSDFile);
+    #endif
         new WebCommand("file_or_directory_path",
                                   WEBCMD, WU, "ESP215", "SD/Delete",    deleteSDObject);
         new WebCommand(NULL,      WEBCMD, WU, "ESP210", "SD/List",      listSDFiles);
@@ -1059,4 +1229,53 @@ void make_web_settings()
         wifi_sta_password = new StringSetting("Station Password",       WEBSET, WA, "ESP101", "Sta/Password",  DEFAULT_STA_PWD,  MIN_PASSWORD_LENGTH, MAX_PASSWORD_LENGTH, (bool (*)(char*))WiFiConfig::isPasswordValid);
         wifi_sta_ssid     = new StringSetting("Station SSID",           WEBSET, WA, "ESP100", "Sta/SSID",      DEFAULT_STA_SSID, MIN_SSID_LENGTH, MAX_SSID_LENGTH, (bool (*)(char*))WiFiConfig::isSSIDValid);
     #endif
+    #ifdef ENABLE_ETHERNET
+        // applied at the next reset
+        eth_enable        = new EnumSetting("Ethernet Enable",          WEBSET, WA, NULL,     "Ethernet/Enable",   DEFAULT_ETH_STATE, &onoffOptions);
+    #endif
+    #ifdef UDP_REALTIME
+        // no get, admin to set, empty to close the port
+        udp_realtime_key  = new StringSetting("UDP Realtime Key",       WEBSET, WA, NULL,     "UDP/Key",           DEFAULT_UDP_REALTIME_KEY, MIN_UDP_REALTIME_KEY_LENGTH, MAX_UDP_REALTIME_KEY_LENGTH, udp_realtime_key_valid);
+    #endif
+}
+
+// Frees the WEBSET strings of the services that are off, so a machine used over
+// USB only keeps none of them in RAM. Call it after the services have started.
+// A setting that is used later, for example by an [ESP] command, is read again.
+void release_web_settings() {
+#ifdef WIFI_OR_BLUETOOTH
+    int8_t radio_mode = wifi_radio_mode->get();
+#endif
+    bool wired = false; // Ethernet uses the hostname and the WebUI passwords too
+#ifdef ENABLE_ETHERNET
+    wired = eth_enable->get() != 0;
+#endif
+#ifdef ENABLE_WIFI
+    if (radio_mode != ESP_WIFI_STA && radio_mode != ESP_WIFI_AP) {
+        wifi_sta_ssid->release();
+        wifi_sta_password->release();
+        wifi_ap_ssid->release();
+        wifi_ap_password->release();
+        if (!wired)
+            wifi_hostname->release();
+    }
+#endif
+#ifdef ENABLE_BLUETOOTH
+    if (radio_mode != ESP_BT) {
+        bt_name->release();
+    }
+#endif
+#if defined (ENABLE_AUTHENTICATION) && defined (WIFI_OR_BLUETOOTH)
+    if (radio_mode == ESP_RADIO_OFF && !wired) {
+        user_password->release();
+        admin_password->release();
+    }
+#endif
+#ifdef ENABLE_NOTIFICATIONS
+    if (notification_type->get() == 0) { // NONE
+        notification_t1->release();
+        notification_t2->release();
+        notification_ts->release();
+    }
+#endif
 }
@@ -20,6 +20,8 @@
 
 #pragma once
 
+void release_web_settings();
+
 extern StringSetting* wifi_sta_ssid;
 extern StringSetting* wifi_sta_password;
 
@@ -43,6 +45,14 @@ extern EnumSetting* telnet_enable;
 extern IntSetting* telnet_port;
 #endif
 
+#ifdef ENABLE_ETHERNET
+extern EnumSetting* eth_enable;
+#endif
+
+#ifdef UDP_REALTIME
+extern StringSetting* udp_realtime_key;
+#endif
+
 #ifdef WIFI_OR_BLUETOOTH
 extern EnumSetting* wifi_radio_mode;
 #endif
@@ -0,0 +1,67 @@
+/*
+  arena.h - bump allocator for the short-lived memory of a request
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef arena_h
+#define arena_h
+
+// Hands out blocks in order from one buffer and takes them all back at once with reset(),
+// at the end of a request. Nothing is freed one by one, so requests leave no holes in the
+// heap and use no more than the arena size. The buffer is taken from the heap on first use
+// and kept, so it is one long-lived block.
+//
+// NOTE: Not thread safe. An arena belongs to the one task that serves its requests.
+class Arena {
+  public:
+    Arena(size_t size) : _size(size) {}
+
+    // Returns size bytes, aligned for any type, or NULL if the arena is full.
+    void* alloc(size_t size) {
+        if (_base == NULL) {
+            _base = (uint8_t*)malloc(_size);
+            if (_base == NULL)
+                return NULL;
+        }
+        size = (size + 7) & ~(size_t)7;
+        if (size > _size - _used)
+            return NULL;
+        void* block = &_base[_used];
+        _used += size;
+        if (_used > _high_water)
+            _high_water = _used;
+        return block;
+    }
+
+    // Returns true if block came from this arena.
+    bool owns(const void* block) const {
+        return _base != NULL && block >= _base && block < _base + _size;
+    }
+
+    // Takes back every block. Objects in the arena must have been destroyed.
+    void reset() { _used = 0; }
+
+    size_t size() const { return _size; }
+    size_t high_water() const { return _high_water; }
+
+  private:
+    uint8_t* _base = NULL;
+    size_t _size;
+    size_t _used = 0;
+    size_t _high_water = 0; // The most any request has used
+};
+
+#endif
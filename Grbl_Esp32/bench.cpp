@@ -0,0 +1,527 @@
+/*
+  bench.cpp - synthetic benchmarks of the parser, planner, segment prep, stepper ISR and reports
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef BENCHMARK
+
+// The workloads are fixed, and the random motions come from a fixed seed, so the rates can be
+// compared between boards, F_STEPPER_TIMER values and config.h options. Work is timed in batches
+// of BENCH_BATCH, and the realtime commands are served between batches, outside the timing.
+//
+// Parse: the lines of bench_lines[] in check mode, as the protocol hands them over. They are
+//   incremental and end where they started, so soft limits only matter at the edge of travel.
+// Plan: random motions within 10mm of the current position. The oldest block is discarded
+//   whenever the planner is full, so each new block is planned against a full buffer.
+// Prep: the same motions, with their segments prepared and dropped whenever the planner is full.
+// Step: the stepper ISR, with its step outputs muted, at rising rates until it falls behind. The
+//   CPU time of each tick is measured, and with BENCH_LOOPBACK_PIN the X step pin pulses and the
+//   periods between its pulses are timed on that pin by an RMT receiver.
+// Report: the status report of '?', built and not sent.
+// Stream: the lines a sender streams on the client that asked, parsed in check mode. Times the
+//   transport, the client buffer and the protocol together, from the end of $Bench/Stream to the
+//   last line, with the ok responses going back as in a job.
+// Afterwards the planner and steppers are reset and the parser goes back to where it was.
+
+#define BENCH_BATCH 100
+#define BENCH_STEP_RATE_START 5000
+#define BENCH_STEP_RATE_MAX 1000000
+
+static const char* const bench_lines[] = {
+    "G1X1.250Y0.500F1500",
+    "X-0.250Y0.750Z-0.100",
+    "G1X-1.000Y-1.250Z0.100F1200S8000",
+    "G0X0.125Y0.125",
+    "G1X-0.125Y-0.125F900",
+    "M8",
+    "N120G1X0.500Y-0.250F2000",
+    "X-0.500Y0.250",
+    "M9",
+};
+#define BENCH_LINES (sizeof(bench_lines) / sizeof(bench_lines[0]))
+
+static uint32_t bench_seed;
+
+static uint32_t bench_random() {
+    bench_seed = bench_seed * 1664525 + 1013904223;
+    return bench_seed >> 8;
+}
+
+static uint32_t bench_rate(uint32_t count, int64_t us) {
+    return us ? (uint32_t)(count * 1000000LL / us) : 0;
+}
+
+// Returns false if a reset came in. Called between batches.
+static bool bench_realtime() {
+    protocol_execute_realtime();
+    return !sys.abort;
+}
+
+static void bench_parse(uint32_t count, uint8_t client) {
+    parser_state_t start_state = gc_state;
+    uint8_t state = sys.state;
+    sys.state = STATE_CHECK_MODE;
+    char line[LINE_BUFFER_SIZE];
+    strcpy(line, "G91");
+    err_t status = gc_execute_line(line, client);
+    int64_t us = 0;
+    uint32_t done = 0;
+    while (status == STATUS_OK && done < count && bench_realtime()) {
+        uint32_t batch = MIN(count - done, BENCH_BATCH);
+        int64_t start = esp_timer_get_time();
+        for (uint32_t i = 0; i < batch && status == STATUS_OK; i++) {
+            strcpy(line, bench_lines[(done + i) % BENCH_LINES]);
+            status = gc_execute_line(line, client);
+        }
+        us += esp_timer_get_time() - start;
+        done += batch;
+    }
+    gc_state = start_state;
+    sys.state = state;
+    if (status != STATUS_OK)
+        grbl_msg_sendf(client, MSG_LEVEL_INFO, "Bench parse error:%d on %s", status, bench_lines[done % BENCH_LINES]);
+    else
+        grbl_msg_sendf(client, MSG_LEVEL_INFO, "Bench parse: %d lines %d lines/s", done, bench_rate(done, us));
+}
+
+// Plans the next random motion and returns the time it took.
+static int64_t bench_plan_motion(const float* origin) {
+    float target[N_AXIS];
+    for (uint8_t axis = 0; axis < N_AXIS; axis++)
+        target[axis] = origin[axis] + (bench_random() % 20001) / 1000.0f - 10.0f;
+    plan_line_data_t pl_data;
+    memset(&pl_data, 0, sizeof(pl_data));
+    pl_data.feed_rate = 500 + bench_random() % 4500;
+    int64_t start = esp_timer_get_time();
+    plan_buffer_line(target, &pl_data);
+    return esp_timer_get_time() - start;
+}
+
+// Plans count random motions. With prep, the segment prep runs whenever the planner is full, and
+// count is of segments, else the oldest block is discarded.
+static void bench_plan(uint32_t count, bool prep, uint8_t client) {
+    float origin[N_AXIS];
+    system_convert_array_steps_to_mpos(origin, sys_position);
+    bench_seed = 1;
+    plan_sync_position();
+    int64_t plan_us = 0, prep_us = 0;
+    uint32_t motions = 0, segments = 0;
+    uint32_t done = 0;
+    bool stuck = false;
+    while (done < count && !stuck && bench_realtime()) {
+        uint32_t batch = MIN(count - done, BENCH_BATCH);
+        for (uint32_t i = 0; i < batch && !stuck; i++) {
+            while (plan_check_full_buffer() && !stuck) {
+                if (!prep) {
+                    plan_discard_current_block();
+                    break;
+                }
+                int64_t start = esp_timer_get_time();
+                uint32_t prepared = st_bench_prep();
+                prep_us += esp_timer_get_time() - start;
+                segments += prepared;
+                stuck = prepared == 0; // Not seen, but the loop would never end
+            }
+            if (stuck)
+                break;
+            plan_us += bench_plan_motion(origin);
+            motions++;
+        }
+        done = prep ? segments : motions;
+    }
+    st_reset();
+    plan_reset();
+    plan_sync_position();
+    if (prep)
+        grbl_msg_sendf(client, MSG_LEVEL_INFO, "Bench prep: %d segments %d segments/s", segments, bench_rate(segments, prep_us));
+    else
+        grbl_msg_sendf(client, MSG_LEVEL_INFO, "Bench plan: %d motions %d motions/s", motions, bench_rate(motions, plan_us));
+}
+
+#ifdef BENCH_LOOPBACK_PIN
+// The receiver counts APB clocks / BENCH_RMT_DIV, 0.1us. A level can last up to 3.2ms, so rates
+// from about 300 steps/s are timed. One memory block holds 64 items, 63 step periods.
+#define BENCH_RMT_DIV 8
+#define BENCH_RMT_TICKS_PER_US (APB_CLK_FREQ / 1000000 / BENCH_RMT_DIV)
+#define BENCH_RMT_ITEMS 64
+
+static int8_t bench_rmt_channel = -1;
+static uint32_t bench_loopback_rate;
+
+// The step to step periods of a capture, in RMT ticks
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    float mean;
+    float deviation;
+} bench_periods_t;
+static bench_periods_t bench_periods;
+
+static bool bench_loopback_init() {
+    if (bench_rmt_channel >= 0)
+        return true;
+    bench_rmt_channel = sys_get_next_RMT_chan_num();
+    if (bench_rmt_channel < 0)
+        return false;
+    rmt_config_t config = {};
+    config.rmt_mode = RMT_MODE_RX;
+    config.channel = (rmt_channel_t)bench_rmt_channel;
+    config.gpio_num = (gpio_num_t)BENCH_LOOPBACK_PIN;
+    config.clk_div = BENCH_RMT_DIV;
+    config.mem_block_num = 1;
+    config.rx_config.filter_en = false;
+    config.rx_config.idle_threshold = 0x7fff; // Ends the capture when the steps stop
+    rmt_config(&config);
+    return true;
+}
+
+// Clears the receiver memory and starts a capture
+static void bench_loopback_arm() {
+    rmt_channel_t channel = (rmt_channel_t)bench_rmt_channel;
+    rmt_set_memory_owner(channel, RMT_MEM_OWNER_TX);
+    for (uint8_t i = 0; i < BENCH_RMT_ITEMS; i++)
+        RMTMEM.chan[channel].data32[i].val = 0;
+    rmt_rx_start(channel, true);
+}
+
+// Stops the capture and writes the periods it holds, in RMT ticks. Returns their count.
+static uint32_t bench_loopback_read(uint32_t* periods) {
+    rmt_channel_t channel = (rmt_channel_t)bench_rmt_channel;
+    rmt_rx_stop(channel);
+    // Each item holds two levels. The periods are taken between the starts of the levels like the
+    // first one, whatever the step pin inversion. The first level may have begun before the
+    // receiver did, so the first period starts at the next edge like it.
+    uint32_t count = 0;
+    uint32_t time = 0, last_edge = 0;
+    bool edge_seen = false;
+    uint8_t first_level = RMTMEM.chan[channel].data32[0].level0;
+    for (uint8_t i = 0; i < BENCH_RMT_ITEMS * 2; i++) {
+        volatile rmt_item32_t* item = &RMTMEM.chan[channel].data32[i / 2];
+        uint32_t duration = (i & 1) ? item->duration1 : item->duration0;
+        uint8_t level = (i & 1) ? item->level1 : item->level0;
+        if (duration == 0)
+            break; // The end of the capture
+        if (level == first_level && i > 0) {
+            if (edge_seen)
+                periods[count++] = time - last_edge;
+            last_edge = time;
+            edge_seen = true;
+        }
+        time += duration;
+    }
+    return count;
+}
+
+// Times the periods between the pulses that come back on BENCH_LOOPBACK_PIN. Called by
+// st_bench_isr_rate() once the steps run. Waits while the receiver fills its memory.
+static void bench_loopback_capture() {
+    bench_loopback_arm();
+    // Stops short of a full memory, so the capture ends with a zero duration
+    int64_t until = esp_timer_get_time() + (int64_t)(BENCH_RMT_ITEMS - 4) * 1000000 / bench_loopback_rate;
+    int64_t now;
+    while ((now = esp_timer_get_time()) < until) {
+        if (until - now > 2000)
+            vTaskDelay(1);
+    }
+    uint32_t periods[BENCH_RMT_ITEMS];
+    bench_periods_t* p = &bench_periods;
+    memset(p, 0, sizeof(bench_periods_t));
+    p->min = UINT32_MAX;
+    p->count = bench_loopback_read(periods);
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < p->count; i++) {
+        p->min = MIN(p->min, periods[i]);
+        p->max = MAX(p->max, periods[i]);
+        total += periods[i];
+    }
+    if (p->count == 0)
+        return;
+    p->mean = (float)total / p->count;
+    float squares = 0;
+    for (uint32_t i = 0; i < p->count; i++)
+        squares += (periods[i] - p->mean) * (periods[i] - p->mean);
+    p->deviation = sqrtf(squares / p->count);
+}
+
+// $Bench/Jitter: captures the X steps of whatever runs, a job or a jog, from an esp_timer every
+// BENCH_JITTER_MS, so the protocol keeps running. The ideal time of a step is taken halfway
+// between the steps before and after it, which follows the acceleration ramps. The distance from
+// it goes into a histogram of 0.1us bins, for the percentiles.
+#define BENCH_JITTER_MS 20
+#define BENCH_JITTER_BINS 256 // Up to 25.5us. Larger ones go in the last bin.
+
+static struct {
+    esp_timer_handle_t timer;
+    volatile bool active;
+    uint8_t client;
+    int64_t end_us;
+    uint32_t steps;
+    uint32_t max; // RMT ticks
+    uint32_t bins[BENCH_JITTER_BINS];
+} bench_jitter;
+
+static void bench_jitter_percentile(char* text, const char* name, uint32_t per_mille) {
+    uint64_t wanted = ((uint64_t)bench_jitter.steps * per_mille + 999) / 1000;
+    uint64_t seen = 0;
+    uint32_t bin = 0;
+    for (; bin < BENCH_JITTER_BINS - 1; bin++) {
+        seen += bench_jitter.bins[bin];
+        if (seen >= wanted)
+            break;
+    }
+    sprintf(text + strlen(text), " %s %.1fus%s", name, (float)bin / BENCH_RMT_TICKS_PER_US,
+            bin == BENCH_JITTER_BINS - 1 ? "+" : "");
+}
+
+static void bench_jitter_report() {
+    uint8_t client = bench_jitter.client;
+    if (bench_jitter.steps == 0) {
+        grbl_msg_sendf(client, MSG_LEVEL_INFO, "Bench jitter: no X steps on the loopback pin");
+        return;
+    }
+    char text[100] = "";
+    bench_jitter_percentile(text, "p50", 500);
+    bench_jitter_percentile(text, "p90", 900);
+    bench_jitter_percentile(text, "p99", 990);
+    bench_jitter_percentile(text, "p99.9", 999);
+    grbl_msg_sendf(client, MSG_LEVEL_INFO, "Bench jitter: %d steps%s max %.1fus", bench_jitter.steps, text,
+                   (float)bench_jitter.max / BENCH_RMT_TICKS_PER_US);
+}
+
+static void bench_jitter_tick(void* arg) {
+    uint32_t periods[BENCH_RMT_ITEMS];
+    uint32_t count = bench_loopback_read(periods);
+    for (uint32_t i = 1; i < count; i++) {
+        // Step i ends period i - 1. Ideally it is halfway between the steps around it.
+        int32_t off = (int32_t)periods[i - 1] - (int32_t)(periods[i - 1] + periods[i]) / 2;
+        uint32_t jitter = abs(off);
+        bench_jitter.bins[MIN(jitter, BENCH_JITTER_BINS - 1)]++;
+        bench_jitter.max = MAX(bench_jitter.max, jitter);
+        bench_jitter.steps++;
+    }
+    if (esp_timer_get_time() < bench_jitter.end_us && !sys.abort) {
+        bench_loopback_arm();
+        return;
+    }
+    esp_timer_stop(bench_jitter.timer);
+    bench_jitter.active = false;
+    bench_jitter_report();
+}
+#endif
+
+
+// Runs the stepper ISR for ms at each rate, from BENCH_STEP_RATE_START up by a quarter each time,
+// until it falls behind. Reports the CPU time of the ticks at each rate, and the step periods on
+// BENCH_LOOPBACK_PIN.
+static void bench_step(uint32_t ms, uint8_t client) {
+    const char* backend =
+#ifdef USE_RMT_STEPS
+        "RMT";
+#elif defined(USE_I2S_OUT_STREAM)
+        "I2S stream";
+#elif defined(USE_I2S_OUT)
+        "I2S static";
+#else
+        "GPIO";
+#endif
+    bool step = false;
+    void (*capture)() = NULL;
+#ifdef BENCH_LOOPBACK_PIN
+    if (bench_loopback_init()) {
+        step = true;
+        capture = bench_loopback_capture;
+    } else
+        grbl_msg_sendf(client, MSG_LEVEL_INFO, "Bench step: no RMT channel for the loopback pin");
+#endif
+    grbl_msg_sendf(client, MSG_LEVEL_INFO, "Bench step: %s steps%s", backend, step ? ", X step pin looped back" : ", muted");
+    int32_t position[N_AXIS];
+    memcpy(position, sys_position, sizeof(position));
+    uint32_t kept = 0;
+    uint32_t rate;
+    bool ok = true;
+    for (rate = BENCH_STEP_RATE_START; rate <= BENCH_STEP_RATE_MAX && bench_realtime(); rate += rate / 4) {
+        st_bench_run_t run;
+#ifdef BENCH_LOOPBACK_PIN
+        bench_loopback_rate = rate;
+        bench_periods.count = 0;
+#endif
+        ok = st_bench_isr_rate(rate, (uint64_t)rate * ms / 1000, step, capture, &run);
+        memcpy(sys_position, position, sizeof(position));
+        if (run.isr_ticks && run.us > 0) {
+            float mhz = ESP.getCpuFreqMHz();
+            char line[120];
+            snprintf(line, sizeof(line), "Bench step %d steps/s: ISR avg %.2fus max %.2fus, CPU %.1f%%", rate,
+                     (float)run.isr_cycles / run.isr_ticks / mhz, run.isr_cycles_max / mhz, run.isr_cycles / mhz / run.us * 100);
+#ifdef BENCH_LOOPBACK_PIN
+            bench_periods_t* p = &bench_periods;
+            if (p->count)
+                snprintf(line + strlen(line), sizeof(line) - strlen(line), ", period %.2fus jitter %.2fus p-p %.2fus sd",
+                         p->mean / BENCH_RMT_TICKS_PER_US, (float)(p->max - p->min) / BENCH_RMT_TICKS_PER_US,
+                         p->deviation / BENCH_RMT_TICKS_PER_US);
+#endif
+            grbl_msg_sendf(client, MSG_LEVEL_INFO, "%s", line);
+        }
+        if (!ok)
+            break;
+        kept = rate;
+    }
+    plan_sync_position();
+    if (ok)
+        grbl_msg_sendf(client, MSG_LEVEL_INFO, "Bench step: kept %d steps/s, the highest rate tried", kept);
+    else
+        grbl_msg_sendf(client, MSG_LEVEL_INFO, "Bench step: kept %d steps/s, fell behind at %d steps/s", kept, rate);
+}
+
+static void bench_report(uint32_t count, uint8_t client) {
+    char status[REPORT_STATUS_LINE_SIZE];
+    int64_t us = 0;
+    uint32_t done = 0;
+    while (done < count && bench_realtime()) {
+        uint32_t batch = MIN(count - done, BENCH_BATCH);
+        int64_t start = esp_timer_get_time();
+        for (uint32_t i = 0; i < batch; i++)
+            report_format_realtime_status(status, sizeof(status));
+        us += esp_timer_get_time() - start;
+        done += batch;
+    }
+    grbl_msg_sendf(client, MSG_LEVEL_INFO, "Bench report: %d reports %d reports/s, %d bytes", done, bench_rate(done, us), strlen(status));
+}
+
+// Parses the count of a $Bench command. It stays 0 when value is NULL.
+static err_t bench_count(const char* value, uint32_t* count) {
+    *count = 0;
+    if (value == NULL)
+        return STATUS_OK;
+    char* end;
+    *count = strtoul(value, &end, 10);
+    if (end == value || *end != '\0')
+        return STATUS_BAD_NUMBER_FORMAT;
+    if (*count == 0)
+        return STATUS_NUMBER_RANGE;
+    return STATUS_OK;
+}
+
+err_t bench_run(uint8_t benchmarks, const char* value, uint8_t client) {
+    uint32_t count;
+    err_t status = bench_count(value, &count);
+    if (status != STATUS_OK)
+        return status;
+    if (sys.state != STATE_IDLE || plan_get_current_block() != NULL)
+        return STATUS_IDLE_ERROR;
+#ifdef BENCH_LOOPBACK_PIN
+    if ((benchmarks & BENCH_STEP) && bench_jitter.active)
+        return STATUS_IDLE_ERROR; // The loopback pin is taken
+#endif
+    grbl_msg_sendf(client, MSG_LEVEL_INFO, "Bench CPU %d MHz, stepper timer %d Hz", ESP.getCpuFreqMHz(), F_STEPPER_TIMER);
+    if (benchmarks & BENCH_PARSE)
+        bench_parse(count ? count : BENCH_DEFAULT_COUNT, client);
+    if ((benchmarks & BENCH_PLAN) && !sys.abort)
+        bench_plan(count ? count : BENCH_DEFAULT_COUNT, false, client);
+    if ((benchmarks & BENCH_PREP) && !sys.abort)
+        bench_plan(count ? count : BENCH_DEFAULT_COUNT, true, client);
+    if ((benchmarks & BENCH_STEP) && !sys.abort)
+        bench_step(count ? count : BENCH_STEP_DEFAULT_MS, client);
+    if ((benchmarks & BENCH_REPORT) && !sys.abort)
+        bench_report(count ? count : BENCH_DEFAULT_COUNT, client);
+    return STATUS_OK;
+}
+
+static struct {
+    bool active;
+    uint8_t client;
+    uint32_t count;
+    uint32_t lines; // Lines with text. The empty line of a CR LF pair only adds its byte.
+    uint32_t bytes; // With one end of line character each
+    int64_t start_us;
+    parser_state_t gc_state;
+} bench_stream;
+
+err_t bench_stream_start(const char* value, uint8_t client) {
+    uint32_t count;
+    err_t status = bench_count(value, &count);
+    if (status != STATUS_OK)
+        return status;
+    if (sys.state != STATE_IDLE || plan_get_current_block() != NULL || bench_stream.active)
+        return STATUS_IDLE_ERROR;
+    bench_stream.client = client;
+    bench_stream.count = count ? count : BENCH_DEFAULT_COUNT;
+    bench_stream.lines = 0;
+    bench_stream.bytes = 0;
+    bench_stream.start_us = 0;
+    bench_stream.gc_state = gc_state;
+    bench_stream.active = true;
+    sys.state = STATE_CHECK_MODE;
+    grbl_msg_sendf(client, MSG_LEVEL_INFO, "Bench stream: send %d lines", bench_stream.count);
+    return STATUS_OK;
+}
+
+void bench_stream_line(uint8_t client, size_t len) {
+    if (!bench_stream.active || client != bench_stream.client)
+        return;
+    if (sys.state != STATE_CHECK_MODE) {
+        bench_stream.active = false; // Ended by a reset
+        return;
+    }
+    if (bench_stream.start_us == 0) {
+        bench_stream.start_us = esp_timer_get_time(); // After $Bench/Stream itself
+        return;
+    }
+    bench_stream.bytes += len + 1;
+    if (len == 0 || ++bench_stream.lines < bench_stream.count)
+        return;
+    int64_t us = esp_timer_get_time() - bench_stream.start_us;
+    bench_stream.active = false;
+    gc_state = bench_stream.gc_state;
+    sys.state = STATE_IDLE;
+    static const char* const transports[CLIENT_COUNT] = { "USB serial", "Bluetooth", "WebUI", "Telnet", "Input", "TCP stream" };
+    grbl_msg_sendf(client, MSG_LEVEL_INFO, "Bench stream %s: %d lines %d lines/s, %d bytes %d bytes/s, RX buffer %d bytes",
+                   transports[client], bench_stream.lines, bench_rate(bench_stream.lines, us), bench_stream.bytes,
+                   bench_rate(bench_stream.bytes, us), serial_get_rx_buffer_size(client));
+}
+
+#ifdef BENCH_LOOPBACK_PIN
+err_t bench_jitter_start(const char* value, uint8_t client) {
+    uint32_t seconds;
+    err_t status = bench_count(value, &seconds);
+    if (status != STATUS_OK)
+        return status;
+    if (bench_jitter.active)
+        return STATUS_IDLE_ERROR;
+    if (!bench_loopback_init())
+        return STATUS_SETTING_DISABLED; // No RMT channel left
+    if (bench_jitter.timer == NULL) {
+        esp_timer_create_args_t args = {};
+        args.callback = bench_jitter_tick;
+        args.name = "bench_jitter";
+        esp_timer_create(&args, &bench_jitter.timer);
+    }
+    memset(bench_jitter.bins, 0, sizeof(bench_jitter.bins));
+    bench_jitter.steps = 0;
+    bench_jitter.max = 0;
+    bench_jitter.client = client;
+    bench_jitter.end_us = esp_timer_get_time() + (int64_t)(seconds ? seconds : BENCH_JITTER_DEFAULT_SEC) * 1000000;
+    bench_jitter.active = true;
+    grbl_msg_sendf(client, MSG_LEVEL_INFO, "Bench jitter: capturing X steps for %d sec", seconds ? seconds : BENCH_JITTER_DEFAULT_SEC);
+    bench_loopback_arm();
+    esp_timer_start_periodic(bench_jitter.timer, BENCH_JITTER_MS * 1000);
+    return STATUS_OK;
+}
+#endif
+
+#endif
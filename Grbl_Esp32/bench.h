@@ -0,0 +1,65 @@
+/*
+  bench.h - synthetic benchmarks of the parser, planner, segment prep, stepper ISR and reports
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef bench_h
+#define bench_h
+
+#ifdef BENCHMARK
+
+// Items run by a benchmark, when $Bench/... has no count
+#ifndef BENCH_DEFAULT_COUNT
+    #define BENCH_DEFAULT_COUNT 1000
+#endif
+
+// Seconds that $Bench/Jitter captures the steps, when it has no count
+#ifndef BENCH_JITTER_DEFAULT_SEC
+    #define BENCH_JITTER_DEFAULT_SEC 10
+#endif
+
+// Milliseconds that $Bench/Step runs the stepper ISR at each rate, when it has no count
+#ifndef BENCH_STEP_DEFAULT_MS
+    #define BENCH_STEP_DEFAULT_MS 100
+#endif
+
+// The benchmarks of bench_run()
+#define BENCH_PARSE bit(0)  // Parse lines from RAM
+#define BENCH_PLAN bit(1)   // Plan random motions
+#define BENCH_PREP bit(2)   // Prepare step segments
+#define BENCH_STEP bit(3)   // Run the stepper ISR up to the rate it falls behind
+#define BENCH_REPORT bit(4) // Build status reports
+#define BENCH_ALL (BENCH_PARSE | BENCH_PLAN | BENCH_PREP | BENCH_STEP | BENCH_REPORT)
+
+// Runs the benchmarks and reports them to client. value is the count, or NULL for the
+// default. Must be called in the idle state.
+err_t bench_run(uint8_t benchmarks, const char* value, uint8_t client);
+
+// Enters check mode and times the next lines client sends, value of them or BENCH_DEFAULT_COUNT.
+// Must be called in the idle state. See $Bench/Stream.
+err_t bench_stream_start(const char* value, uint8_t client);
+// Called by the protocol after it ran a line of len characters from client
+void bench_stream_line(uint8_t client, size_t len);
+
+#ifdef BENCH_LOOPBACK_PIN
+// Captures the X steps on BENCH_LOOPBACK_PIN for value seconds, or BENCH_JITTER_DEFAULT_SEC, in
+// the background, then reports their jitter percentiles to client. See $Bench/Jitter.
+err_t bench_jitter_start(const char* value, uint8_t client);
+#endif
+
+#endif
+
+#endif
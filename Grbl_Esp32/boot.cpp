@@ -0,0 +1,115 @@
+/*
+  boot.cpp - staged start of the subsystems and boot time report
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+// Times are from esp_timer, which starts early in the boot, after the ROM bootloader.
+static volatile bool network_ready = false;
+static uint32_t network_ms = 0; // Time the network services were up, 0 until then
+static uint32_t banner_ms = 0;
+
+typedef struct {
+    const char* name;
+    int64_t start_us;
+    int64_t end_us;
+} boot_phase_t;
+
+static boot_phase_t phases[BOOT_PHASES_MAX];
+static uint8_t phase_count = 0;
+static portMUX_TYPE phase_mux = portMUX_INITIALIZER_UNLOCKED;
+static int64_t mark_us = 0; // End of the previous phase of setup()
+
+static uint32_t boot_ms() {
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+void boot_phase(const char* name, int64_t start_us) {
+    int64_t end_us = esp_timer_get_time();
+    portENTER_CRITICAL(&phase_mux);
+    uint8_t i;
+    for (i = 0; i < phase_count && phases[i].name != name; i++) {}
+    if (i == phase_count && phase_count < BOOT_PHASES_MAX) {
+        phases[i] = { name, start_us, end_us };
+        phase_count++;
+    }
+    portEXIT_CRITICAL(&phase_mux);
+}
+
+void boot_mark(const char* name) {
+    int64_t start_us = mark_us;
+    mark_us = esp_timer_get_time();
+    boot_phase(name, start_us);
+}
+
+void boot_report_phases(uint8_t client) {
+    uint8_t count = phase_count;
+    for (uint8_t i = 0; i < count; i++) {
+        grbl_sendf(client, "[MSG:Boot %s at:%ums time:%uus]\r\n", phases[i].name,
+                   (uint32_t)(phases[i].start_us / 1000), (uint32_t)(phases[i].end_us - phases[i].start_us));
+    }
+    grbl_sendf(client, "[MSG:Boot banner:%ums network:%ums]\r\n", banner_ms, network_ms);
+}
+
+static void start_network() {
+#ifdef ENABLE_WIFI
+    int64_t wifi_us = esp_timer_get_time();
+    wifi_config.begin();
+    boot_phase("WiFi", wifi_us); // Includes the HTTP phase
+#endif
+#ifdef ENABLE_ETHERNET
+    eth_config.begin(); // The link and DHCP come later, in the background
+#endif
+#ifdef ENABLE_BLUETOOTH
+    int64_t bt_us = esp_timer_get_time();
+    bt_config.begin();
+    boot_phase("BT", bt_us);
+#endif
+    network_ms = boot_ms();
+    release_web_settings();
+    network_ready = true;
+}
+
+#ifdef BOOT_DEFER_NETWORK
+static void bootNetworkTask(void* pvParameters) {
+    start_network();
+    grbl_msg_sendf(CLIENT_ALL, MSG_LEVEL_INFO, "Network services up after %d ms", network_ms);
+    vTaskDelete(NULL);
+}
+#endif
+
+void boot_start_network() {
+#ifdef BOOT_DEFER_NETWORK
+    // Core 0, with the WiFi stack, so that joining a network never competes with the main loop
+    task_create(TASK_BOOT_NETWORK, bootNetworkTask, BOOT_NETWORK_TASK_STACK, NULL, NULL);
+#else
+    start_network();
+#endif
+}
+
+bool boot_network_ready() {
+    return network_ready;
+}
+
+void boot_report_banner() {
+    static bool reported = false;
+    if (reported)
+        return;
+    reported = true;
+    banner_ms = boot_ms();
+    grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Boot: %d ms to Grbl banner", banner_ms);
+}
@@ -0,0 +1,55 @@
+/*
+  boot.h - staged start of the subsystems and boot time report
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef boot_h
+#define boot_h
+
+#include <esp_timer.h>
+
+// Stack of the task that starts the network services. See BOOT_DEFER_NETWORK in config.h.
+#ifndef BOOT_NETWORK_TASK_STACK
+    #define BOOT_NETWORK_TASK_STACK 8192
+#endif
+
+// Number of boot phases whose times are kept for $Boot/Times.
+#ifndef BOOT_PHASES_MAX
+    #define BOOT_PHASES_MAX 24
+#endif
+
+// Records a phase of the boot that began at start_us, a time from esp_timer_get_time(), and
+// ends now. Only the first run of each phase is kept, so phases that run again after a reset or
+// a reconnect report their boot time. name must be a string constant. Safe from any task.
+void boot_phase(const char* name, int64_t start_us);
+
+// Records a phase of setup() that began at the previous mark and ends now.
+void boot_mark(const char* name);
+
+// Reports the start and the duration of each recorded phase, in order of their end.
+void boot_report_phases(uint8_t client);
+
+// Starts WiFi and Bluetooth with their services. With BOOT_DEFER_NETWORK this happens in a
+// task and returns at once, so Grbl takes G-code over USB while WiFi connects.
+void boot_start_network();
+
+// Returns true once the network services are started and may be polled.
+bool boot_network_ready();
+
+// Reports the time from power-on to the first Grbl banner. Called after each banner.
+void boot_report_banner();
+
+#endif
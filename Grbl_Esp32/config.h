@@ -76,6 +76,9 @@ Some features should not be changed. See notes below.
 // For example B1101 will invert the function of the Reset pin.
 #define INVERT_CONTROL_PIN_MASK   B1111
 
+// Debounces the control pins. Reset, feed hold and safety door still act on their first edge,
+// in the pin interrupt. Only their release, and the other pins, wait CONTROL_SW_DEBOUNCE_PERIOD
+// for a timer to read the pins again.
 #define ENABLE_CONTROL_SW_DEBOUNCE // Default disabled. Uncomment to enable.
 #define CONTROL_SW_DEBOUNCE_PERIOD 32 // in milliseconds default 32 microseconds
 
@@ -134,6 +137,13 @@ Some features should not be changed. See notes below.
 #define ENABLE_SERIAL2SOCKET_IN
 #define ENABLE_SERIAL2SOCKET_OUT
 
+// Wired Ethernet through a LAN8720 or other RMII PHY, for shop floors where WiFi
+// drops. Telnet, HTTP and the websocket are served on it, with or without WiFi.
+// It needs ENABLE_WIFI. The RMII bus takes GPIO 0, 18, 19, 21, 22, 23, 25, 26
+// and 27, so the machine file must not use them; see ethconfig.h for the PHY
+// pins. The address comes from DHCP. $Ethernet/Enable turns it off, at the next reset.
+//#define ENABLE_ETHERNET
+
 // Captive portal is used when WiFi is in access point mode.  It lets the
 // WebUI come up automatically in the browser, instead of requiring the user
 // to browse manually to a default URL.  It works like airport and hotel
@@ -147,6 +157,29 @@ Some features should not be changed. See notes below.
 // as effective security against malice.
 //#define ENABLE_AUTHENTICATION
 //CONFIGURE_EYECATCH_END (DO NOT MODIFY THIS LINE)
+
+// The native build (pio run -e native) runs the parser, planner and segment prep on the host,
+// for the benchmarks, tests and simulator of tests/native. It has no radios, card or web server.
+#ifdef GRBL_NATIVE
+    #undef ENABLE_BLUETOOTH
+    #undef ENABLE_SD_CARD
+    #undef ENABLE_WIFI
+    #undef WIFI_OR_BLUETOOTH
+    #undef ENABLE_HTTP
+    #undef ENABLE_OTA
+    #undef ENABLE_TELNET
+    #undef ENABLE_TELNET_WELCOME_MSG
+    #undef ENABLE_MDNS
+    #undef ENABLE_SSDP
+    #undef ENABLE_NOTIFICATIONS
+    #undef ENABLE_SERIAL2SOCKET_IN
+    #undef ENABLE_SERIAL2SOCKET_OUT
+    #undef ENABLE_CAPTIVE_PORTAL
+    #undef ENABLE_AUTHENTICATION
+    #undef USE_RMT_STEPS
+    #define SD_BENCHMARK
+    #define SD_BENCH_MAX_MOTIONS 200000 // All of the motions of the files in tests/
+#endif
 #define NAMESPACE "GRBL"
 
 #ifdef ENABLE_AUTHENTICATION
@@ -201,6 +234,7 @@ Some features should not be changed. See notes below.
 #define CMD_SAFETY_DOOR 0x84
 #define CMD_JOG_CANCEL  0x85
 #define CMD_DEBUG_REPORT 0x86 // Only when DEBUG enabled, sends debug report in '{}' braces.
+#define CMD_STATUS_FRAME 0x87 // Only when REPORT_STATUS_FRAMES enabled, sends a binary status frame.
 #define CMD_FEED_OVR_RESET 0x90         // Restores feed override value to 100%.
 #define CMD_FEED_OVR_COARSE_PLUS 0x91
 #define CMD_FEED_OVR_COARSE_MINUS 0x92
@@ -300,6 +334,13 @@ Some features should not be changed. See notes below.
 #define SAFETY_DOOR_SPINDLE_DELAY 4.0 // Float (seconds)
 #define SAFETY_DOOR_COOLANT_DELAY 1.0 // Float (seconds)
 
+// Enable to hold motion after M3/M4, and after a safety door restore, until the spindle is at speed
+// rather than for a fixed time. Spindles with RPM feedback, the Huanyang VFD and PWM spindles with a
+// SPINDLE_TACH_PIN, are read until they are within SPINDLE_AT_SPEED_TOLERANCE percent of the
+// programmed RPM. Other spindles do not wait, and the door restore keeps SAFETY_DOOR_SPINDLE_DELAY.
+// After SPINDLE_AT_SPEED_TIMEOUT_MS without reaching speed, motion resumes with a message.
+// #define SPINDLE_AT_SPEED // Default disabled. Uncomment to enable.
+
 // Enable CoreXY kinematics. Use ONLY with CoreXY machines.
 // IMPORTANT: If homing is enabled, you must reconfigure the homing cycle #defines above to
 // #define HOMING_CYCLE_0 bit(X_AXIS) and #define HOMING_CYCLE_1 bit(Y_AXIS)
@@ -369,6 +410,12 @@ Some features should not be changed. See notes below.
 #define SPINDLE_OVERRIDE_COARSE_INCREMENT  10 // (1-99). Usually 10%.
 #define SPINDLE_OVERRIDE_FINE_INCREMENT     1 // (1-99). Usually 1%.
 
+// Applies a feed or rapid override change to the step segments already prepared, by changing their
+// step rate, so the new speed starts within a few milliseconds instead of after the segment
+// buffer. Only segments cruising at the nominal speed are re-timed, ramping to the new speed at
+// the block acceleration. Laser mode segments keep their timing, since their power follows it.
+// #define RETIME_QUEUED_SEGMENTS // Default disabled. Uncomment to enable.
+
 // When a M2 or M30 program end command is executed, most g-code states are restored to their defaults.
 // This compile-time option includes the restoring of the feed, rapid, and spindle speed override values
 // to their default values at program end.
@@ -410,6 +457,23 @@ Some features should not be changed. See notes below.
 // certain the step segment buffer is increased/decreased to account for these changes.
 #define ACCELERATION_TICKS_PER_SECOND 100
 
+// Shapes the step output of each axis with a ZV or ZVD input shaper, which cancels the ringing of
+// the machine at the <axis>/Shaper/Frequency ($180-$185) with the <axis>/Shaper/Damping ($190-$195)
+// of that resonance, so a gantry that rings can take a higher acceleration. Stepper/Shaper selects
+// the shaper. Each axis arrives at the programmed position a half period (ZV) or a full period
+// (ZVD) of its frequency late. Homing is not shaped. While shaping, segments are cut at
+// INPUT_SHAPING_TICKS_PER_SECOND, so Stepper/Segments should be raised to about 24.
+// See input_shaping.cpp.
+// #define INPUT_SHAPING // Default disabled. Uncomment to enable.
+
+// Takes up the mechanical slack of the axes when they reverse. <axis>/Backlash is the slack in mm.
+// When the motor of an axis turns the other way, the segments that follow step it that much extra,
+// spread over BACKLASH_SEGMENTS segments. The extra steps are not counted in the machine position,
+// so the reported positions and the work coordinates are those of the tool. An axis is not taken
+// up on its first motion after boot, as the side of the slack it rests on is not known. Homing
+// is not taken up, but leaves the axes on a known side. See st_backlash_steps() in stepper.cpp.
+// #define BACKLASH_COMPENSATION // Default disabled. Uncomment to enable.
+
 // Adaptive Multi-Axis Step Smoothing (AMASS) is an advanced feature that does what its name implies,
 // smoothing the stepping of multi-axis motions. This feature smooths motion particularly at low step
 // frequencies below 10kHz, where the aliasing between axes of multi-axis motions can cause audible
@@ -417,6 +481,38 @@ Some features should not be changed. See notes below.
 // step smoothing. See stepper.c for more details on the AMASS system works.
 #define ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING  // Default enabled. Comment to disable.
 
+// The number of AMASS levels, and the highest rate the ISR is over-driven to by them. More levels
+// smooth down to lower step rates: each one halves the step rate it starts at. These are compile
+// time, as cutoffs in timer ticks computed from F_STEPPER_TIMER. With high microsteps, the steps
+// are small enough that a higher AMASS_ISR_FREQUENCY with more levels can pay off. See stepper.h.
+// #define MAX_AMASS_LEVEL 3 // Default 3, up to 6
+// #define AMASS_ISR_FREQUENCY 16000 // Default 16000 Hz
+
+// Only smooths segments that step more than one axis. A single axis steps on every Bresenham tick
+// anyway, so AMASS only over-drives the ISR for it. Its segments take the lowest level that keeps
+// the timer period in range instead, which leaves the ISR at the step rate at low speeds.
+// #define AMASS_MULTI_AXIS_ONLY // Default disabled. Uncomment to enable.
+
+// Measures the number of CPU cycles spent in the stepper pulse ISR on every step tick, using the
+// Xtensa cycle counter. The last, average and maximum counts are reported with the $SC command, which
+// also resets the statistics. Use this to compare the ISR cost between builds and board files.
+// The average cost of preparing a step segment in st_prep_buffer() and the resulting segments per
+// millisecond are reported too. With USE_RMT_STEPS, so is the largest skew, in cycles, between the
+// first and the last RMT channel started in one tick.
+// Also counted are the ticks that overran the step period and the timer interrupts dropped by the
+// busy flag. So are the segment buffer underruns, where the ISR ran out of segments while the
+// planner still had a block, and the minimum and average fill of the segment buffer. The status
+// report gets an |ISR:avg,max,overruns,underruns field.
+// NOTE: Adds a few cycles of overhead to every ISR tick. Not for production use.
+// #define STEPPER_ISR_PROFILE // Default disabled. Uncomment to enable.
+
+// By default, the stepper ISR updates the machine position on every step of every axis. This option
+// instead counts the steps of the executing segment locally and adds them to the machine position when
+// the segment completes, which removes a shared read-modify-write from each step at high step rates.
+// Probing and homing cycles still update the position on every step, since they need the exact position.
+// NOTE: Status reports may lag the true position by up to one segment (1/ACCELERATION_TICKS_PER_SECOND sec).
+// #define DEFER_POSITION_UPDATES // Default disabled. Uncomment to enable.
+
 // Sets the maximum step rate allowed to be written as a Grbl setting. This option enables an error
 // check in the settings module to prevent settings values that will exceed this limitation. The maximum
 // step rate is strictly limited by the CPU speed and will change if something other than an AVR running
@@ -488,6 +584,13 @@ Some features should not be changed. See notes below.
 // bogged down by too many trig calculations.
 #define N_ARC_CORRECTION 12 // Integer (1-255)
 
+// Plans arc segments in batches. The chord end points of up to ARC_BATCH_SIZE segments are generated
+// in one pass and added to the planner together, with a single replan for the whole batch instead of
+// one per segment. This leaves more time for the planner to stay ahead on arc-heavy jobs with short
+// segments. Not used with USE_KINEMATICS, where each segment goes through the kinematics, unless the
+// machine also defines USE_KINEMATICS_BATCH and converts whole batches.
+// #define ARC_BATCHED_PLANNING // Default disabled. Uncomment to enable.
+
 // The arc G2/3 g-code standard is problematic by definition. Radius-based arcs have horrible numerical
 // errors when arc at semi-circles(pi) or full-circles(2*pi). Offset-based arcs are much more accurate
 // but still have a problem when arcs are full-circles (2*pi). This define accounts for the floating
@@ -526,19 +629,387 @@ Some features should not be changed. See notes below.
 // must use #define USE_RMT_STEPS for this to work
 //#define STEP_PULSE_DELAY 10 // Step pulse delay in microseconds. Default disabled.
 
+// When neither RMT nor I2S steps are used, the stepper ISR busy-waits for the step pulse time before
+// it turns the step pins off. This option instead arms a second hardware timer (TIMER_1 of the step
+// timer group) when the pulse starts. Its interrupt ends the pulse, so the stepper ISR returns
+// right away and GPIO stepping can reach higher step rates.
+// NOTE: Has no effect with USE_RMT_STEPS or USE_I2S_OUT_STREAM.
+// #define USE_STEP_PULSE_OFF_TIMER // Default disabled. Uncomment to enable.
+
+// With USE_I2S_OUT_STREAM, the steps are generated a few DMA buffers ahead of the motors. The probe
+// position is always corrected for the steps still queued in the DMA buffers when the probe
+// triggers. This option also stops the probing motion right away, at the next DMA buffer boundary,
+// instead of decelerating, and takes the discarded steps back out of the machine position. The
+// overtravel then no longer depends on the DMA buffer count.
+// NOTE: The stop is abrupt. Only use it with probe feed rates the motors can stop from.
+// #define I2S_OUT_PROBE_FAST_STOP // Default disabled. Uncomment to enable.
+
+// Catches the probe edge with a pin interrupt and refines the probe position within the step
+// interval the stepper timer is in, instead of taking it at the next stepper ISR tick at whole
+// step resolution. The error no longer grows with the step interval, so faster probe feed rates
+// give the same repeatability. The PRB report then has sub-step resolution.
+// NOTE: Not with USE_I2S_OUT_STREAM, whose steps are not timed by the stepper timer.
+// #define PROBE_EDGE_CAPTURE // Default disabled. Uncomment to enable.
+
+// Adds the $Probe/Sequence=x,y,x,y,... command, which probes down at each XY point, in work
+// coordinates, without a host round trip per point. After each hit, the retract by
+// $Probe/Clearance, the travel to the next point and its approach are planned at once and run as
+// one motion. Each approach goes at most $Probe/Depth below the Z the sequence started at, at
+// $Probe/Feed. Every hit is reported as a [PRB:] message.
+// NOTE: The travel is at the retract height of the last hit. Set the clearance above the height
+// changes between neighbouring points.
+// #define PROBE_SEQUENCE // Default disabled. Uncomment to enable.
+#define PROBE_SEQUENCE_MAX_POINTS 32
+
+// Probes a grid on the controller and compensates Z from it, for PCB milling without leveling the
+// G-code on the host. $HeightMap/Probe=x0,y0,x1,y1,nx,ny probes nx by ny points over the rectangle,
+// in work coordinates, with the $Probe/ settings of PROBE_SEQUENCE. The map is kept in RAM, and is
+// lost at power off. Once probed, mc_line() splits each line into HEIGHT_MAP_SEGMENT_LENGTH pieces
+// and raises each by the map height at its end, interpolated bilinearly, relative to the first
+// point. $HeightMap=OFF and $HeightMap=ON turn the compensation off and on, $HeightMap=CLEAR
+// drops the map and $HeightMap reports it. Jogs, homing and parking are not compensated.
+// NOTE: Needs PROBE_SEQUENCE.
+// #define HEIGHT_MAP // Default disabled. Uncomment to enable.
+#define HEIGHT_MAP_MAX_POINTS 100
+#define HEIGHT_MAP_SEGMENT_LENGTH 2.0 // mm
+
+// Adds the O-word subroutines and loops of LinuxCNC: oN sub/endsub, call, return, repeat [n]/
+// endrepeat, while [n]/endwhile, break and continue, with numbered oN or named o<name> words.
+// The lines of a sub or loop are kept in RAM once, split into words, and run from there without
+// being parsed again. A sub stays defined until the program ends. Calling an undefined o<name>
+// loads /name.nc from the SD card, or else from SPIFFS, and keeps it like the subs of the
+// program. See oword.cpp.
+// NOTE: The lines of a sub or loop are kept as they arrive, so $ commands within them run at once.
+// #define OWORD_SUBROUTINES // Default disabled. Uncomment to enable.
+
+// Adds the numbered parameters #1-#999 and the [expr] expressions of LinuxCNC to the words of a
+// line, like G1 X[#1 * 2] or #1=[#1 + 1], with the read-only machine values from #5000 up. The
+// parameters are kept in RAM until power off. Lines with # or [ are compiled to a stack code,
+// which the lines kept by OWORD_SUBROUTINES keep, so a loop only evaluates it. With both, repeat
+// and while take expressions, and the arguments of an O-word call are #1-#30 within the sub.
+// See expression.cpp.
+// #define GCODE_EXPRESSIONS // Default disabled. Uncomment to enable.
+
+// Adds a tool table of lengths and diameters, kept in RAM and stored in NVS once the machine is
+// idle. G10 L1 Pn Z<length> R<radius> sets tool n, with the word of TOOL_LENGTH_OFFSET_AXIS for
+// the length. G43 Hn applies the length of tool n as the tool length offset, and G43 alone that
+// of the tool of the last T word. $TT lists the table. See tool_table.cpp.
+// #define TOOL_TABLE // Default disabled. Uncomment to enable.
+
+// Runs the tool change of M6 on the controller: retract and park at the $ToolChange/ position
+// with the spindle and coolant off, wait for a cycle start, or call user_tool_change() with
+// USE_TOOL_CHANGE, probe the new tool length on a tool setter if $ToolChange/Probe is on, then
+// go back and restore the spindle and coolant. The moves are planned as rapids, so no host
+// commands are needed. With TOOL_TABLE, tools with a length in the table are not probed again.
+// See tool_change.cpp.
+// #define TOOL_CHANGE_SEQUENCE // Default disabled. Uncomment to enable.
+
+// Adds continuous jogging for pendants: $JV=vx,vy,vz,... sets a jog velocity in mm/min per axis,
+// and the controller keeps only JOG_VELOCITY_BLOCKS short blocks planned ahead in that direction,
+// each covering JOG_VELOCITY_PERIOD_MS plus its share of the stop distance. $JV=0 stops at once,
+// like a jog cancel, and so does not sending $JV again within JOG_VELOCITY_TIMEOUT_MS, so a lost
+// pendant stops the machine. A new direction is taken within the few planned blocks, whatever the
+// planner size. Soft limits end the jog before the limit.
+// #define JOG_VELOCITY // Default disabled. Uncomment to enable.
+#define JOG_VELOCITY_BLOCKS 3
+#define JOG_VELOCITY_PERIOD_MS 50
+#define JOG_VELOCITY_TIMEOUT_MS 250
+
+// With USE_RMT_STEPS, a segment of a single-axis motion is sent as trains of up to RMT_STEP_TRAIN_MAX
+// pulses, written into the RMT channel memory at the segment's step period. The stepper ISR then runs
+// once per train instead of once per step, which cuts its load on long single-axis moves and rapids.
+// The steps of a train are added to the machine position when the train starts. Probing and homing
+// motions, AMASS-smoothed segments and pulses too long for the step period still step one at a time.
+// NOTE: Requires USE_RMT_STEPS. Not compatible with STEP_PULSE_DELAY.
+// #define USE_RMT_STEP_TRAINS // Default disabled. Uncomment to enable.
+
+// By default, the step segment buffer is refilled by the main loop between g-code parsing, SD card
+// reads and status reports, which adds jitter to when segments are ready. This option refills it
+// from a dedicated FreeRTOS task on core 1 that runs above the main loop priority and is woken by
+// the stepper ISR each time a segment is freed. The planner is locked against segment prep while
+// blocks are added or replanned.
+// #define USE_SEGMENT_PREP_TASK // Default disabled. Uncomment to enable.
+
+// Reads SD card jobs in SD_READ_BLOCK_SIZE blocks from a background task, while the lines of the
+// block read before run from RAM. Without it, each byte of a job is a separate read through the
+// SD and FAT file system code. Takes SD_READ_BLOCKS blocks of RAM once the first job is run.
+// #define SD_READ_AHEAD // Default disabled. Uncomment to enable.
+
+// Sends ok to the client that started an SD job for each line of the job that runs without error.
+// By default only the errors are reported.
+// #define REPORT_SD_LINE_OK // Default disabled. Uncomment to enable.
+
+// Adds $SD/Compile=<file>, which checks an SD job with the parser and writes <file>.gcb next to
+// it. $SD/Run=<file>.gcb then runs the motion lines as planner motions without parsing them.
+// The other lines, like spindle, coolant or dwell, are still run as text. A compiled file only
+// runs from the position and work offsets it was compiled at. See grbl_sd.cpp.
+// #define SD_COMPILE // Default disabled. Uncomment to enable.
+
+// Adds $SD/Run=<file>,line=<n>, which runs a job from line n after a broken tool or other stop.
+// The parser state of the lines before n, like G90/G91, units, work offsets, feed and spindle, is
+// found by running them in check mode, from the closest entry of the line index <file>.idx. The
+// index is written each time the job runs from the start. The machine then moves to the position
+// before line n, from above, and the spindle and coolant are turned back on.
+// #define SD_RESUME // Default disabled. Uncomment to enable.
+
+// Estimates the run time of an SD job with the planner's acceleration model, from a low priority
+// task that reads the job again once it starts. When the estimate is done, the SD percentage in
+// the status report is the share of the run time before the current line rather than the share
+// of the file read, and |ETA:<seconds> is added after it. See sd_estimate.cpp.
+// #define SD_ESTIMATE // Default disabled. Uncomment to enable.
+
+// Adds $SD/Bench=<file>, which measures the parser, the planner and the step segment prep on an
+// SD job without moving the machine. The job is parsed in check mode, and then its first
+// SD_BENCH_MAX_MOTIONS motions are planned and prepared into segments that are thrown away.
+// Reports parsed lines/s, planner blocks/s and segments/s, so builds can be compared on the
+// files in tests/. The native build runs the same passes on the host, see tests/native.
+// $SD/Simulate=<file> also replays the steps of the segments on a virtual step
+// timer and reports the feed, acceleration and step rate histogram they make, and whether the
+// steps end where the planner did. See sd_bench.cpp.
+// #define SD_BENCHMARK // Default disabled. Uncomment to enable.
+
+// Adds $Bench, which runs fixed synthetic workloads on the board and reports their rates, so
+// boards, F_STEPPER_TIMER values and build options can be compared in the field. $Bench/Parse,
+// $Bench/Plan, $Bench/Prep and $Bench/Report parse lines from RAM, plan random motions, prepare
+// step segments and build status reports, BENCH_DEFAULT_COUNT of them or $Bench/...=<count>.
+// $Bench/Step runs the stepper ISR with the step outputs muted, for BENCH_STEP_DEFAULT_MS or
+// =<ms> at each rate, at rising rates until it falls behind. The drivers are enabled and the
+// direction pins may change, but the motors are not stepped. $Bench runs them all.
+// $Bench/Stream=<lines> times the transport instead: it enters check mode, and the sender then
+// streams that many lines on the same connection. The last one reports lines/s and bytes/s for
+// the connection and its RX buffer size, and ends check mode. Run it on each of USB, Bluetooth,
+// telnet and the WebUI, and again after changing Serial/RxBuffer. Only in the idle state. See
+// bench.cpp.
+// #define BENCHMARK // Default disabled. Uncomment to enable.
+
+// $Bench/Step names the step backend of the build, GPIO, RMT or I2S, and reports the CPU time of
+// the ISR ticks and its CPU load at each rate. Each backend is a build option, so run it on one
+// build per backend to compare them. To also measure the step to step jitter, wire the X step
+// output to a free input pin and name it here. $Bench/Step then pulses the X step pin, with the
+// drivers disabled, and an RMT receiver times the pulses. Disconnect the X driver if its enable
+// pin is not wired. $Bench/Jitter=<sec> also captures the X steps of real motion in the
+// background, during a job with WiFi or SD reads for instance, and then reports the p50, p90,
+// p99 and p99.9 distance of the steps from their ideal times, halfway between the steps around
+// them.
+// #define BENCH_LOOPBACK_PIN GPIO_NUM_34 // Default disabled. Uncomment to enable.
+
+// Runs gzip compressed SD jobs, like job.nc.gz or job.gcode.gz, inflating the lines as they are
+// read. G-code compresses several times over, so jobs take less card space and upload faster.
+// Takes about 48KB of RAM once the first compressed job is run. Compressed jobs are not indexed
+// for $SD/Run=<file>,line=<n>, which then checks every line from the start.
+// #define SD_GZIP // Default disabled. Uncomment to enable.
+
+// Adds $SD/Queue=<file>[,count=<n>], which queues n runs of an SD job, or of a /spiffs/<file>
+// job on the local file system. The jobs run back to back: when one reads its last line the
+// next one is opened and its lines are planned behind the last blocks of the first, so the
+// planner never drains between them. $SD/Queue lists the queue and $SD/Queue/Clear empties it.
+// A reset or an error in a job also empties it.
+// #define SD_JOB_QUEUE // Default disabled. Uncomment to enable.
+
+// Puts the planner, step segment and client receive buffers in static DRAM instead of the heap, so
+// WiFi and web requests can never take the memory motion needs. The Planner/Blocks,
+// Stepper/Segments and Serial/RxBuffer settings are then limited to PLANNER_STATIC_BLOCKS,
+// STEPPER_STATIC_SEGMENTS and SERIAL_STATIC_RX_SIZE, and the TCP and BT stream clients get no
+// larger buffers. $Memory/Map lists the buffers either way.
+// #define STATIC_MOTION_BUFFERS // Default disabled. Uncomment to enable.
+
+// Starts WiFi, Bluetooth and the web services from a task on core 0 after the rest of the boot,
+// so the Grbl banner comes and USB G-code is taken without waiting for WiFi to join a network.
+// The time from power-on to the banner is reported at boot either way.
+// #define BOOT_DEFER_NETWORK // Default disabled. Uncomment to enable.
+
+// Runs the web server and the WebUI websocket in their own task on core 0, next to the WiFi stack.
+// By default they are served from the task that reads the G-code clients, so a file list, upload
+// or download holds up the command input of every client until it is done.
+// #define WEB_SERVER_TASK // Default disabled. Uncomment to enable.
+
+// Serves the short-lived memory of WebUI commands, such as the response chunk buffer and JSON
+// encoders, from a WEB_ARENA_SIZE arena that is reset at the end of each request, instead of
+// allocating and freeing it on the heap for every request.
+// #define WEB_REQUEST_ARENA // Default disabled. Uncomment to enable.
+
+// Lets browsers cache the WebUI pages. SPIFFS files and the embedded page are sent with an ETag
+// and Cache-Control: max-age=WEB_CACHE_MAX_AGE, and a reload the browser already has gets a 304
+// with no body, instead of the whole index.html.gz again.
+// #define WEB_CACHE_STATIC // Default disabled. Uncomment to enable.
+
+// Serves the WebUI page, /index.html.gz of SPIFFS, from a copy in a data partition labelled
+// WEBUI_PARTITION_LABEL that is mapped into memory, instead of reading it through SPIFFS. The
+// copy is made and checked by the firmware, so the page is still uploaded to SPIFFS as before.
+// The page is sent with Accept-Ranges, and a Range request gets the bytes it asks for, so a
+// browser can resume a page load cut off by a weak WiFi link. The partition table needs an
+// entry like "webui, data, 0x40, , 0x30000" (192KB), taken from SPIFFS or the app partitions.
+// Without one, the page is served from SPIFFS.
+// #define WEBUI_PARTITION // Default disabled. Uncomment to enable.
+
+// Keeps the last WebUI listing of a SPIFFS directory until SPIFFS is written, so a page that polls
+// the file list gets it without SPIFFS being walked again.
+// #define SPIFFS_LIST_CACHE // Default disabled. Uncomment to enable.
+
+// Adds a plain TCP port, TCP_STREAM_PORT, for streaming jobs as CLIENT_TCP. The socket is read only
+// as the client buffer, TCP_STREAM_RX_BUFFER_SIZE, has room, so the TCP window paces the sender
+// and it can write the job without counting ok lines. With TCP_STREAM_QUIET_OK the ok lines are
+// not sent to it at all, only the errors. See tcp_stream.cpp.
+// #define TCP_STREAM_SERVER // Default disabled. Uncomment to enable.
+// #define TCP_STREAM_QUIET_OK // Default disabled. Uncomment to enable.
+
+// Adds a UDP port, UDP_REALTIME_PORT, for the realtime commands alone, so a feed hold or an
+// override from a pendant never waits behind the job lines of a telnet or TCP stream. Each
+// request is signed with HMAC-SHA256 keyed with $UDP/Key, and is answered with a binary status
+// frame. The port stays closed while $UDP/Key is empty. Needs ENABLE_WIFI and
+// REPORT_STATUS_FRAMES. See udp_realtime.h for the datagrams.
+// #define UDP_REALTIME // Default disabled. Uncomment to enable.
+
+// Packs the stored settings into one NVS blob as well, so a boot loads them with one read instead
+// of a lookup per setting. Changing a setting erases the blob, and the next boot loads by key and
+// packs it again. The load time is reported at boot, for either path.
+// #define SETTINGS_NVS_BLOB // Default disabled. Uncomment to enable.
+
+// Indexes the names of settings and commands in a hash table at boot, so $100=, $Name= and the
+// WebUI settings commands find their setting directly instead of scanning the lists. About 12 bytes
+// of RAM per name.
+// #define SETTINGS_NAME_INDEX // Default disabled. Uncomment to enable.
+
+// Dispatches [ESPnnn] and $ESPnnn through a table indexed by nnn, built at boot, instead of
+// comparing the name with every setting and command. Takes 1KB of RAM for the numbers and
+// 8 bytes for each ESP setting or command.
+// #define ESP_COMMAND_TABLE // Default disabled. Uncomment to enable.
+
+// Bluetooth streaming mode. The BT client gets a BT_STREAM_RX_BUFFER_SIZE line buffer, and its
+// output is gathered into SPP packets of up to BT_STREAM_TX_BUFFER_SIZE bytes, sent when a line
+// has waited BT_STREAM_TX_FLUSH_MS, instead of a packet per message. The rates a client reaches
+// are in the BT line of $I and in the disconnect message.
+// #define BT_STREAM // Default disabled. Uncomment to enable.
+
+// Adds a job streaming channel to the WebUI websocket. A browser sends batches of lines and gets
+// back acknowledgments with the bytes it may send next, so it keeps WS_STREAM_BUFFER_SIZE bytes in
+// flight without waiting for the ok of each line. See ws_stream.cpp for the messages.
+// #define WEBSOCKET_STREAM // Default disabled. Uncomment to enable.
+
+// The WebUI console output is sent in binary websocket frames, gathered for up to 500ms. With this,
+// a frame is sent as soon as it holds an ok, an error:, an ALARM: or a status report, and other
+// output is gathered for SERIAL2SOCKET_COALESCE_MS. Each frame goes to every connected browser.
+// #define SERIAL2SOCKET_ADAPTIVE_FLUSH // Default disabled. Uncomment to enable.
+
+// Turns the WiFi modem sleep off while the machine moves or runs an SD job and back on at idle,
+// so the packets of a streamed job are not held until the next beacon. The captive portal DNS
+// waits for the end of the job, and so does the reconnect of a lost connection during SD jobs.
+// #define WIFI_POWER_POLICY // Default disabled. Uncomment to enable.
+
+// With both WiFi and Bluetooth, the serial task calls wifi_config.handle() and bt_config.handle()
+// on every loop. With this, during a cycle only the transport the job streams over keeps that
+// pace, and the other is polled every RADIO_COEX_POLL_MS. When both radios are on, the shared
+// antenna is given to the streaming one first. $I reports the state. See radio_coex.cpp.
+// #define RADIO_COEX_POLICY // Default disabled. Uncomment to enable.
+
+// Keeps the listings of SD card directories in RAM, walked by a low priority task, and edits them
+// in place on uploads and deletes. The WebUI file browser and $SD/List read them instead of
+// walking the card each time, and the WebUI can list files while a job runs. The WebUI listing
+// takes start=<n>&count=<n> arguments to send a page of a long directory. See sd_dir_cache.cpp.
+// #define SD_DIR_CACHE // Default disabled. Uncomment to enable.
+
+// Gathers the chunks of WebUI uploads to the SD card in a SD_UPLOAD_BUFFER_SIZE RAM buffer and
+// writes them in whole sectors. Without it, each HTTP chunk of about 1.4KB is a separate write
+// that rewrites the partial sectors at both of its ends. The buffer is only taken while uploading.
+// Each upload reports its bytes per second in a [MSG:] line to compare with and without.
+// #define SD_UPLOAD_BUFFER // Default disabled. Uncomment to enable.
+
+// Firmware updates from the WebUI are only accepted while the machine is idle or in alarm and no
+// SD job runs, and fail if it is started while they run. The upload is gathered in chunks of
+// whole flash sectors, written by a background task that reports the progress. ArduinoOTA
+// invitations are only answered while idle. See ota_writer.cpp.
+// #define OTA_WRITER // Default disabled. Uncomment to enable.
+
+// With OTA_WRITER, a firmware image uploaded gzip compressed, like made by
+// gzip -9 -k firmware.bin, is inflated as it is written. A firmware image compresses to a little
+// over half its size, so it uploads in about half the time. Takes about 43KB of RAM during a compressed
+// update. Updates that are not compressed are written as before.
+// #define OTA_GZIP // Default disabled. Uncomment to enable.
+
 // The number of linear motions in the planner buffer to be planned at any give time. The vast
 // majority of RAM that Grbl uses is based on this buffer size. Only increase if there is extra
 // available RAM, like when re-compiling for a Mega2560. Or decrease if the Arduino begins to
 // crash due to the lack of available RAM or if the CPU is having trouble keeping up with planning
 // new incoming motions as they are executed.
+// NOTE: On the ESP32 this is the default and minimum depth. The depth used at run time is set at boot
+// by the Planner/Blocks setting, up to BLOCK_BUFFER_SIZE_MAX.
 // #define BLOCK_BUFFER_SIZE 16 // Uncomment to override default in planner.h.
 
+// Stops the reverse pass of the planner as soon as a block's entry speed comes out unchanged, since
+// no block before it can change either, and starts the forward pass from that block. With deep planner
+// buffers this keeps the cost of adding a block close to constant instead of growing with the depth.
+#define PLANNER_INCREMENTAL_RECALCULATE // Default enabled. Comment to disable.
+
+// Measures the CPU cycles spent replanning for every block added to the planner. The last, average
+// and maximum counts and the average number of blocks visited are reported with the $PC command, which
+// also resets the statistics.
+// #define PLANNER_PROFILE // Default disabled. Uncomment to enable.
+
+// Times each pass of the main protocol loop and its phases: SD lines, client lines, auto cycle
+// start, realtime commands and the housekeeping after them. $LP reports a histogram of each, in
+// power of two microsecond bins, with the average and maximum, and resets them. A long pass
+// delays the realtime commands, so this shows which feature makes them under load.
+// #define LOOP_PROFILE // Default disabled. Uncomment to enable.
+
+// Adds $PB, which sends the blocks in the planner buffer, the executing one first, to see where
+// the planner limits the speed when tuning the junction deviation and acceleration. $PB=<ms>
+// sends them to that client every <ms> milliseconds, from PLANNER_BLOCK_REPORT_MIN_MS, and $PB=0
+// stops. See plan_report_blocks() for the format.
+// #define PLANNER_BLOCK_REPORT // Default disabled. Uncomment to enable.
+
+// Reports when each job ends, SD or streamed, its time and the time spent moving, the share of
+// the motion time in acceleration, cruise and deceleration, the time-weighted mean feed against
+// the programmed feed, and the stops from the planner running empty. Many stops with a low feed
+// mean the job is limited by the data, a low feed without stops by the machine settings. A
+// streamed job ends after JOB_STATS_IDLE_MS idle. See job_stats.cpp.
+// #define JOB_STATS // Default disabled. Uncomment to enable.
+
+// Serves /metrics from the web server in the Prometheus text format, so a fleet of controllers
+// can be scraped into one dashboard: planner fill, segment underruns and planner starvations,
+// the longest stepper ISR tick with STEPPER_ISR_PROFILE, client lines executed, receive buffer
+// overflows of each client, heap free and largest block, WiFi RSSI, the machine state, whether
+// an SD job runs, the spindle speed and the uptime.
+// #define WEB_METRICS // Default disabled. Uncomment to enable.
+
+// Counts the heap allocations of the web server, the WebSockets library, JSONencoder, the
+// notifications and the motion path, which should make none: allocations, frees, failures, the
+// bytes still allocated and their peak. [ESP421] reports them and [ESP421]RESET clears them, so a
+// slow decline of the free heap over days can be traced to its source. malloc() and free() are
+// wrapped by the linker, which needs these in build_flags in platformio.ini:
+//   -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc -Wl,--wrap=free
+// Takes 4KB of RAM and some time on every allocation. See heap_trace.cpp.
+// #define HEAP_TRACE // Default disabled. Uncomment to enable.
+
+// Records when each received line arrived, was read to its end, was parsed, had its first planner
+// block accepted and was done. The last LINE_TRACE_SIZE lines are reported with the $LT command,
+// which also clears them. See line_trace.cpp for the report format.
+// #define LINE_TRACE // Default disabled. Uncomment to enable.
+
+// Records the spindle speed, the duty written and the mean feed rate of each step segment as
+// the stepper ISR loads it, with its time. $Spindle/Capture=ON clears the records and starts
+// recording, =OFF stops it and $Spindle/Capture sends the last SPINDLE_CAPTURE_SIZE segments as
+// CSV. With the web server they are also at /spindle_capture.csv. Used to check laser rate
+// adjust and the PWM frequency and resolution of a spindle without burning test pieces.
+// #define SPINDLE_CAPTURE // Default disabled. Uncomment to enable.
+
+// Keeps the last EVENT_TRACE_SIZE events of the control path in a RAM ring: the segment loads and
+// underruns of the stepper ISR, the segment prep, the planner, the parser, the lines of each
+// client, the received and sent bytes, the status reports and the VFD commands. Each record takes
+// 8 bytes and is stamped with the cycle counter. With the web server, /trace.json sends them as a
+// Chrome trace, for chrome://tracing or ui.perfetto.dev, so jitter and stalls under real load can
+// be looked at afterwards. EVENT_TRACE_STEP_ISR also traces every stepper ISR tick, which fills
+// the ring within milliseconds at high step rates. See event_trace.cpp.
+// #define EVENT_TRACE // Default disabled. Uncomment to enable.
+// #define EVENT_TRACE_STEP_ISR // Default disabled. Uncomment to enable.
+
 // Governs the size of the intermediary step segment buffer between the step execution algorithm
 // and the planner blocks. Each segment is set of steps executed at a constant velocity over a
 // fixed time defined by ACCELERATION_TICKS_PER_SECOND. They are computed such that the planner
 // block velocity profile is traced exactly. The size of this buffer governs how much step
 // execution lead time there is for other Grbl processes have to compute and do their thing
 // before having to come back and refill this buffer, currently at ~50msec of step moves.
+// NOTE: On the ESP32 this is the default and minimum depth. The depth used at run time is set at boot
+// by the Stepper/Segments setting, up to SEGMENT_BUFFER_SIZE_MAX.
 // #define SEGMENT_BUFFER_SIZE 6 // Uncomment to override default in stepper.h.
 
 // Line buffer size from the serial input stream to be executed. Also, governs the size of
@@ -549,7 +1020,10 @@ Some features should not be changed. See notes below.
 // can be too small and g-code blocks can get truncated. Officially, the g-code standards
 // support up to 256 characters. In future versions, this default will be increased, when
 // we know how much extra memory space we can re-invest into this.
-// #define LINE_BUFFER_SIZE 80  // Uncomment to override default in protocol.h
+// #define LINE_BUFFER_SIZE 80  // Uncomment to override the default below
+#ifndef LINE_BUFFER_SIZE
+    #define LINE_BUFFER_SIZE 80
+#endif
 
 // Serial send and receive buffer size. The receive buffer is often used as another streaming
 // buffer to store incoming blocks to be processed by Grbl when its ready. Most streaming
@@ -561,15 +1035,91 @@ Some features should not be changed. See notes below.
 // 115200 baud will take 5 msec to transmit a typical 55 character report. Worst case reports are
 // around 90-100 characters. As long as the serial TX buffer doesn't get continually maxed, Grbl
 // will continue operating efficiently. Size the TX buffer around the size of a worst-case report.
-// #define RX_BUFFER_SIZE 128 // (1-254) Uncomment to override defaults in serial.h
+// Accepts binary g-code frames on every client, next to the ASCII lines. A frame carries the
+// words of one block as letters and float32 values, with a CRC, and goes to the parser without
+// any text parsing. See protocol.h for the frame format.
+// #define BINARY_GCODE_FRAMES // Default disabled. Uncomment to enable.
+
+// While a motion waits for room in the planner, whole lines of the streaming client are moved
+// from its receive buffer to a queue of PROTOCOL_READ_AHEAD_LINES lines, so a character-counting
+// sender can keep sending. G-code lines without comments or expressions are also split into words
+// then. They still run in order, once the planner has room.
+// #define PROTOCOL_READ_AHEAD // Default disabled. Uncomment to enable.
+
+// The client receive buffers are sized at boot by the Serial/RxBuffer setting, from RX_BUFFER_SIZE
+// up to RX_BUFFER_SIZE_MAX. Senders using character counting read the size from $I.
+// #define RX_BUFFER_SIZE 128 // Uncomment to override defaults in serial.h
 // #define TX_BUFFER_SIZE 100 // (1-254)
 
-// A simple software debouncing feature for hard limit switches. When enabled, the limit
-// switch interrupt unblock a waiting task which will recheck the limit switch pins after
-// a short delay. Default disabled
+// A simple software debouncing feature for hard limit switches. When enabled, the first limit
+// switch edge feed holds a running cycle at once, and a timer rechecks the limit switch pins
+// after DEBOUNCE_PERIOD. A switch that is still triggered raises the hard limit alarm, otherwise
+// the hold is resumed. Default disabled
 //#define ENABLE_SOFTWARE_DEBOUNCE // Default disabled. Uncomment to enable.
 #define DEBOUNCE_PERIOD 32 // in milliseconds default 32 microseconds
 
+// Counts a quadrature encoder per axis with the PCNT peripheral and raises an alarm when an axis
+// falls behind its step position by more than Encoder/MaxError. The encoder pins come from the
+// machine definition. See encoder.h.
+// #define USE_ENCODER_FEEDBACK // Default disabled. Uncomment to enable.
+
+// Jogs from a quadrature handwheel (MPG) counted with the PCNT peripheral, planned straight from
+// the counts without G-code. The pins come from the machine definition. See mpg.h.
+// #define USE_MPG // Default disabled. Uncomment to enable.
+
+// Drives the four phases of UnipolarMotor axes with LEDC PWM channels following a cosine table,
+// for UNIPOLAR_MICROSTEPS (default 16) microsteps per full step, instead of full or half steps
+// with digitalWrite(). The steps/mm settings of those axes must be scaled to match. Each motor
+// takes four of the LEDC channels. See Motors/UnipolarMotorClass.cpp.
+// #define UNIPOLAR_LEDC_MICROSTEPS // Default disabled. Uncomment to enable.
+
+// Updates RC servo axes from the stepper ISR as each step segment is loaded, with the position
+// the axis will reach at the end of that segment, instead of from the position polled by
+// servoUpdateTask. All servo duties are written together, so servo axes stay in step with the
+// stepper axes. servoUpdateTask still tracks work offsets and calibration, and moves the servos
+// when no motion is running. The servo axes of USE_SERVO_AXES are updated the same way, with
+// servosSyncTask in the place of servoUpdateTask.
+// #define SERVO_SEGMENT_UPDATE // Default disabled. Uncomment to enable.
+
+// Calls the motor class step() and set_direction_pins() methods of each motor directly from
+// motors_step() and motors_set_direction_pins(), based on the motor classes chosen by the machine
+// definition, instead of through the virtual methods of every motor. Motors that have nothing to
+// do, like Nullmotor, are left out at compile time.
+// NOTE: Do not use with custom code that replaces the motors created by init_motors().
+// #define STATIC_MOTOR_DISPATCH // Default disabled. Uncomment to enable.
+
+// Reads the motor classes, motor and limit pins and axis count from /machine.cfg on SPIFFS at
+// boot, so one build can run several machines. Without the file, the machine definition is used.
+// The file format is in machine_config.h. Only the axes up to N_AXIS can be used, so build with
+// the largest axis count of the machines.
+// #define MACHINE_CONFIG // Default disabled. Uncomment to enable.
+
+// Lets the limit pin interrupt lock out a homing axis in sys.homing_axis_lock as soon as its
+// pin changes during the homing approach, instead of waiting for the homing loop to poll the
+// pins between st_prep_buffer() calls. This shortens the stop distance at high seek rates,
+// especially with sensorless (StallGuard DIAG) homing. The homing loop still polls the pins.
+// NOTE: The limit pin interrupts are attached even when hard limits are disabled.
+// #define HOMING_AXIS_LOCK_ISR // Default disabled. Uncomment to enable.
+
+// Latches the position of each homing axis in the limit interrupt, at the switch edge, and sets
+// the homed position from that edge rather than from where the axis came to a stop. The stop
+// distance no longer matters, so N_HOMING_LOCATE_CYCLE can be 0 for homing with the seek pass
+// alone. A locate pass still runs if configured, but only pulls off HOMING_LATCH_CLEARANCE mm
+// beyond the latched edge first, so its slow approach is short. The clearance must release the
+// switch, or homing fails with the pull-off alarm. Not used for CoreXY and bipolar machines.
+// NOTE: Needs HOMING_AXIS_LOCK_ISR.
+// #define HOMING_LATCH_POSITION // Default disabled. Uncomment to enable.
+#define HOMING_LATCH_CLEARANCE 0.5 // mm
+
+// Homes the axes of all the HOMING_CYCLE_x masks in one pass instead of one cycle after the
+// other. Each axis seeks at the lower of $Homing/Seek and its own max rate, over its own search
+// distance, and is locked out by its own switch without stopping the others. Homing takes as
+// long as the slowest axis rather than the sum of the cycles. Only for machines where the axes
+// can home in any order without colliding, the Z first rule of the default cycles is lost.
+// NOTE: Ganged axes home with both motors in the pass, and then square one motor at a time.
+// There is one limit pin per axis, so the two motors can not square in the same pass.
+// #define HOMING_PARALLEL // Default disabled. Uncomment to enable.
+
 // Configures the position after a probing cycle during Grbl's check mode. Disabled sets
 // the position to the probe target, when enabled sets the position to the start position.
 // #define SET_CHECK_MODE_PROBE_TO_START // Default disabled. Uncomment to enable.
@@ -638,6 +1188,13 @@ Some features should not be changed. See notes below.
 // job. At this time, this option only forces a planner buffer sync with these g-code commands.
 #define FORCE_BUFFER_SYNC_DURING_EEPROM_WRITE // Default enabled. Comment to disable.
 
+// Keeps the coordinate data written by G10 L2/L20, G28.1 and G30.1 while motion runs in RAM, and
+// stores it once motion stops. A flash write turns off the flash cache, which holds off the
+// stepper ISR, so it is never done mid-motion. The values are used at once, and there is no
+// buffer sync, so FORCE_BUFFER_SYNC_DURING_EEPROM_WRITE is then ignored. A reset or power loss
+// before the machine is idle loses the pending values.
+// #define FLASH_WRITE_DEFER // Default disabled. Uncomment to enable.
+
 // In Grbl v0.9 and prior, there is an old outstanding bug where the `WPos:` work position reported
 // may not correlate to what is executing, because `WPos:` is based on the g-code parser state, which
 // can be several motions behind. This option forces the planner buffer to empty, sync, and stop
@@ -685,15 +1242,48 @@ Some features should not be changed. See notes below.
 // #define ENABLE_PARKING_OVERRIDE_CONTROL   // Default disabled. Uncomment to enable
 // #define DEACTIVATE_PARKING_UPON_INIT // Default disabled. Uncomment to enable.
 
+// Restarts the spindle as the safety door restore moves back down to the pull-out position, so
+// SAFETY_DOOR_SPINDLE_DELAY runs during that motion, and only what is left of it is waited after.
+// NOTE: PARKING_ENABLE is required. The spindle turns while the tool comes down, with the door closed.
+// #define PARKING_RESTORE_SPINUP // Default disabled. Uncomment to enable.
+
 // This option will automatically disable the laser during a feed hold by invoking a spindle stop
 // override immediately after coming to a stop. However, this also means that the laser still may
 // be reenabled by disabling the spindle stop override, if needed. This is purely a safety feature
 // to ensure the laser doesn't inadvertently remain powered while at a stop and cause a fire.
 #define DISABLE_LASER_DURING_HOLD // Default enabled. Comment to disable.
 
+// Sends the output to the clients from a transmit task. Each message is copied once into a
+// reference counted buffer and queued for every client it goes to, so a broadcast costs the
+// same however many clients are connected. Each client has its own bounded queue and task, so a
+// stalled Bluetooth or telnet link does not hold up the others or the protocol loop. Status
+// reports are dropped for a client that is not keeping up, and other messages after waiting
+// TX_QUEUE_WAIT_MS. See serial.h.
+// #define CLIENT_TX_QUEUES // Default disabled. Uncomment to enable.
+
+// Lets a client ask for status reports to be pushed to it at a fixed interval with
+// $RI=<milliseconds>[,<fields>], instead of polling with '?'. fields is a bit mask of the
+// RT_FIELD_* values in report.h and defaults to all of them. $RI=0 stops the reports. Each report
+// is formatted once for all the clients that are due with the same fields.
+// #define REPORT_STATUS_PUSH // Default disabled. Uncomment to enable.
+
+// Enables binary status frames for DRO and pendant clients. The CMD_STATUS_FRAME realtime
+// command sends one, and with REPORT_STATUS_PUSH, $RI= with the RT_FIELD_FRAME bit pushes them at
+// up to 100 Hz. The frame carries the raw step counts, so no floats are formatted. See report.h.
+// #define REPORT_STATUS_FRAMES // Default disabled. Uncomment to enable.
+
+// Enables laser raster lines. The $R= command stages a line of pixel powers, as base64 of
+// run-length (count, power) pairs, and the next G1 in laser mode spreads them evenly over its
+// length as a single planner block. The stepper ISR changes the laser power at each pixel, so a
+// raster row costs one block instead of a block for every power change. See raster.cpp.
+// #define LASER_RASTER // Default disabled. Uncomment to enable.
+
 // Enables a piecewise linear model of the spindle PWM/speed output. Requires a solution by the
 // 'fit_nonlinear_spindle.py' script in the /doc/script folder of the repo. See file comments
 // on how to gather spindle data and run the script to generate a solution.
+// NOTE: The Spindle/Curve setting does the same at runtime, as "rpm:percent" points, and
+// takes precedence when it is set. With SPINDLE_TACH_PIN, $Spindle/Calibrate measures it.
+// Either is sampled into a lookup table when the spindle is initialized.
 // #define ENABLE_PIECEWISE_LINEAR_SPINDLE  // Default disabled. Uncomment to enable.
 
 // N_PIECES, RPM_MAX, RPM_MIN, RPM_POINTxx, and RPM_LINE_XX constants are all set and given by
@@ -112,10 +112,34 @@ void coolant_set_state(uint8_t mode) {
 }
 
 
-// G-code parser entry-point for setting coolant state. Forces a planner buffer sync and bails
-// if an abort or check-mode is active.
+// Sets the pins to exactly mode, COOLANT_FLOOD_ENABLE and COOLANT_MIST_ENABLE flags. Called by
+// the stepper ISR as the first block with a new coolant condition starts, so it is in IRAM.
+void IRAM_ATTR coolant_write(uint8_t mode) {
+#ifdef COOLANT_FLOOD_PIN
+#ifdef INVERT_COOLANT_FLOOD_PIN
+    digitalWrite(COOLANT_FLOOD_PIN, !(mode & COOLANT_FLOOD_ENABLE));
+#else
+    digitalWrite(COOLANT_FLOOD_PIN, (mode & COOLANT_FLOOD_ENABLE) != 0);
+#endif
+#endif
+#ifdef COOLANT_MIST_PIN
+#ifdef INVERT_COOLANT_MIST_PIN
+    digitalWrite(COOLANT_MIST_PIN, !(mode & COOLANT_MIST_ENABLE));
+#else
+    digitalWrite(COOLANT_MIST_PIN, (mode & COOLANT_MIST_ENABLE) != 0);
+#endif
+#endif
+    sys.report_ovr_counter = 0; // Set to report change immediately
+}
+
+
+// G-code parser entry-point for setting coolant state. Bails if check-mode is active.
+// The planner blocks carry the coolant state in their condition, and the stepper switches the
+// pins as the first block after the change starts, so motion does not stop for M7/M8/M9.
+// With nothing queued, the pins are set here, and when a cycle ends with no block after the
+// change, protocol sets them.
 void coolant_sync(uint8_t mode) {
     if (sys.state == STATE_CHECK_MODE)  return;
-    protocol_buffer_synchronize(); // Ensure coolant turns on when specified in program.
-    coolant_set_state(mode);
+    if (sys.state == STATE_IDLE && plan_get_current_block() == NULL)
+        coolant_set_state(mode);
 }
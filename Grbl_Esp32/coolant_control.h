@@ -44,6 +44,9 @@ void coolant_stop();
 // Sets the coolant pins according to state specified.
 void coolant_set_state(uint8_t mode);
 
+// Sets the coolant pins to exactly the state specified. Safe to call from the stepper ISR.
+void coolant_write(uint8_t mode);
+
 // G-code parser entry-point for setting coolant states. Checks for and executes additional conditions.
 void coolant_sync(uint8_t mode);
 
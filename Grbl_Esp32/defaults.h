@@ -42,6 +42,34 @@
         #define DEFAULT_STEP_PULSE_MICROSECONDS 3 // $0
     #endif
 
+    #ifndef DEFAULT_ENCODER_MAX_ERROR
+        #define DEFAULT_ENCODER_MAX_ERROR 1.0 // mm. 0 = report only
+    #endif
+
+    #ifndef DEFAULT_MPG_AXIS
+        #define DEFAULT_MPG_AXIS X_AXIS // See mpg.h
+    #endif
+
+    #ifndef DEFAULT_MPG_STEP
+        #define DEFAULT_MPG_STEP 0.01 // mm per detent
+    #endif
+
+    #ifndef DEFAULT_MPG_RATE
+        #define DEFAULT_MPG_RATE 1000.0 // mm/min
+    #endif
+
+    #ifndef DEFAULT_DIRECTION_SETUP_MICROSECONDS
+        #define DEFAULT_DIRECTION_SETUP_MICROSECONDS 0 // Direction to step setup time. 0 = none
+    #endif
+
+    #ifndef DEFAULT_MACHINE_TYPE
+        #ifdef MACHINE_KINEMATICS
+            #define DEFAULT_MACHINE_TYPE MACHINE_KINEMATICS // The kinematics the firmware is built for
+        #else
+            #define DEFAULT_MACHINE_TYPE MACHINE_XYZ
+        #endif
+    #endif
+
     #ifndef DEFAULT_STEPPER_IDLE_LOCK_TIME
         #define DEFAULT_STEPPER_IDLE_LOCK_TIME 250 // $1 msec (0-254, 255 keeps steppers enabled)
     #endif
@@ -147,6 +175,81 @@
         #define DEFAULT_SPINDLE_MAX_VALUE 100.0 // $36 Percent of full period (extended set)
     #endif
 
+    #ifndef DEFAULT_SPINDLE_BESC_RAMP_TIME
+        #define DEFAULT_SPINDLE_BESC_RAMP_TIME 0.0 // seconds from off to full speed, 0 for no ramp (extended set)
+    #endif
+
+    #ifndef DEFAULT_SPINDLE_CURVE
+        #define DEFAULT_SPINDLE_CURVE "" // rpm:percent points, empty for the $35 to $36 line (extended set)
+    #endif
+
+    // See SPINDLE2_TYPE in Spindles/SpindleClass.h
+    #ifndef DEFAULT_SPINDLE2_TOOL
+        #define DEFAULT_SPINDLE2_TOOL 2 // M6 T2 selects the second spindle (extended set)
+    #endif
+
+    #ifndef DEFAULT_SPINDLE2_RPM_MIN
+        #define DEFAULT_SPINDLE2_RPM_MIN 0.0 // rpm (extended set)
+    #endif
+
+    #ifndef DEFAULT_SPINDLE2_RPM_MAX
+        #define DEFAULT_SPINDLE2_RPM_MAX 1000.0 // rpm (extended set)
+    #endif
+
+    // See PROBE_SEQUENCE in config.h
+    #ifndef DEFAULT_PROBE_FEED
+        #define DEFAULT_PROBE_FEED 100.0 // mm/min (extended set)
+    #endif
+
+    #ifndef DEFAULT_PROBE_DEPTH
+        #define DEFAULT_PROBE_DEPTH 10.0 // mm (extended set)
+    #endif
+
+    #ifndef DEFAULT_PROBE_CLEARANCE
+        #define DEFAULT_PROBE_CLEARANCE 2.0 // mm (extended set)
+    #endif
+
+    // See TOOL_CHANGE_SEQUENCE in config.h. Positions are in machine coordinates.
+    #ifndef DEFAULT_TOOL_CHANGE_X
+        #define DEFAULT_TOOL_CHANGE_X 0.0 // mm (extended set)
+    #endif
+
+    #ifndef DEFAULT_TOOL_CHANGE_Y
+        #define DEFAULT_TOOL_CHANGE_Y 0.0 // mm (extended set)
+    #endif
+
+    #ifndef DEFAULT_TOOL_CHANGE_Z
+        #define DEFAULT_TOOL_CHANGE_Z -1.0 // mm (extended set)
+    #endif
+
+    #ifndef DEFAULT_TOOL_CHANGE_PROBE
+        #define DEFAULT_TOOL_CHANGE_PROBE 0 // boolean (extended set)
+    #endif
+
+    #ifndef DEFAULT_TOOL_CHANGE_PROBE_X
+        #define DEFAULT_TOOL_CHANGE_PROBE_X 0.0 // mm (extended set)
+    #endif
+
+    #ifndef DEFAULT_TOOL_CHANGE_PROBE_Y
+        #define DEFAULT_TOOL_CHANGE_PROBE_Y 0.0 // mm (extended set)
+    #endif
+
+    #ifndef DEFAULT_TOOL_CHANGE_PROBE_Z
+        #define DEFAULT_TOOL_CHANGE_PROBE_Z -1.0 // mm (extended set)
+    #endif
+
+    #ifndef DEFAULT_TOOL_CHANGE_PROBE_DEPTH
+        #define DEFAULT_TOOL_CHANGE_PROBE_DEPTH 50.0 // mm (extended set)
+    #endif
+
+    #ifndef DEFAULT_TOOL_CHANGE_PROBE_FEED
+        #define DEFAULT_TOOL_CHANGE_PROBE_FEED 100.0 // mm/min (extended set)
+    #endif
+
+    #ifndef DEFAULT_TOOL_CHANGE_PROBE_REFERENCE
+        #define DEFAULT_TOOL_CHANGE_PROBE_REFERENCE 0.0 // mm, 0 to take it from the first probe (extended set)
+    #endif
+
     // ================  user settings =====================
     #ifndef DEFAULT_USER_INT_80
         #define DEFAULT_USER_INT_80 0 // $80 User integer setting
@@ -357,6 +460,66 @@
         #define DEFAULT_C_STALLGUARD 16 // $175 stallguard (extended set)
     #endif
 
+    // ========== Input shaping (INPUT_SHAPING in config.h) ================
+
+    #ifndef  DEFAULT_X_SHAPER_FREQUENCY
+        #define DEFAULT_X_SHAPER_FREQUENCY 0.0 // $180 Hz, 0 is unshaped (extended set)
+    #endif
+    #ifndef  DEFAULT_Y_SHAPER_FREQUENCY
+        #define DEFAULT_Y_SHAPER_FREQUENCY 0.0 // $181 Hz, 0 is unshaped (extended set)
+    #endif
+    #ifndef  DEFAULT_Z_SHAPER_FREQUENCY
+        #define DEFAULT_Z_SHAPER_FREQUENCY 0.0 // $182 Hz, 0 is unshaped (extended set)
+    #endif
+    #ifndef  DEFAULT_A_SHAPER_FREQUENCY
+        #define DEFAULT_A_SHAPER_FREQUENCY 0.0 // $183 Hz, 0 is unshaped (extended set)
+    #endif
+    #ifndef  DEFAULT_B_SHAPER_FREQUENCY
+        #define DEFAULT_B_SHAPER_FREQUENCY 0.0 // $184 Hz, 0 is unshaped (extended set)
+    #endif
+    #ifndef  DEFAULT_C_SHAPER_FREQUENCY
+        #define DEFAULT_C_SHAPER_FREQUENCY 0.0 // $185 Hz, 0 is unshaped (extended set)
+    #endif
+    #ifndef  DEFAULT_X_SHAPER_DAMPING
+        #define DEFAULT_X_SHAPER_DAMPING 0.1 // $190 damping ratio (extended set)
+    #endif
+    #ifndef  DEFAULT_Y_SHAPER_DAMPING
+        #define DEFAULT_Y_SHAPER_DAMPING 0.1 // $191 damping ratio (extended set)
+    #endif
+    #ifndef  DEFAULT_Z_SHAPER_DAMPING
+        #define DEFAULT_Z_SHAPER_DAMPING 0.1 // $192 damping ratio (extended set)
+    #endif
+    #ifndef  DEFAULT_A_SHAPER_DAMPING
+        #define DEFAULT_A_SHAPER_DAMPING 0.1 // $193 damping ratio (extended set)
+    #endif
+    #ifndef  DEFAULT_B_SHAPER_DAMPING
+        #define DEFAULT_B_SHAPER_DAMPING 0.1 // $194 damping ratio (extended set)
+    #endif
+    #ifndef  DEFAULT_C_SHAPER_DAMPING
+        #define DEFAULT_C_SHAPER_DAMPING 0.1 // $195 damping ratio (extended set)
+    #endif
+
+    // ========== Backlash (BACKLASH_COMPENSATION in config.h) ================
+
+    #ifndef  DEFAULT_X_BACKLASH
+        #define DEFAULT_X_BACKLASH 0.0 // $200 mm (extended set)
+    #endif
+    #ifndef  DEFAULT_Y_BACKLASH
+        #define DEFAULT_Y_BACKLASH 0.0 // $201 mm (extended set)
+    #endif
+    #ifndef  DEFAULT_Z_BACKLASH
+        #define DEFAULT_Z_BACKLASH 0.0 // $202 mm (extended set)
+    #endif
+    #ifndef  DEFAULT_A_BACKLASH
+        #define DEFAULT_A_BACKLASH 0.0 // $203 mm (extended set)
+    #endif
+    #ifndef  DEFAULT_B_BACKLASH
+        #define DEFAULT_B_BACKLASH 0.0 // $204 mm (extended set)
+    #endif
+    #ifndef  DEFAULT_C_BACKLASH
+        #define DEFAULT_C_BACKLASH 0.0 // $205 mm (extended set)
+    #endif
+
    
 // ==================  pin defaults ========================
 
@@ -425,4 +588,66 @@
     #define C_LIMIT_PIN UNDEFINED_PIN
 #endif
 
+#ifndef X_ENCODER_A_PIN
+    #define X_ENCODER_A_PIN UNDEFINED_PIN
+#endif
+#ifndef X_ENCODER_B_PIN
+    #define X_ENCODER_B_PIN UNDEFINED_PIN
+#endif
+#ifndef X_ENCODER_COUNTS_PER_MM
+    #define X_ENCODER_COUNTS_PER_MM 0.0
+#endif
+#ifndef Y_ENCODER_A_PIN
+    #define Y_ENCODER_A_PIN UNDEFINED_PIN
+#endif
+#ifndef Y_ENCODER_B_PIN
+    #define Y_ENCODER_B_PIN UNDEFINED_PIN
+#endif
+#ifndef Y_ENCODER_COUNTS_PER_MM
+    #define Y_ENCODER_COUNTS_PER_MM 0.0
+#endif
+#ifndef Z_ENCODER_A_PIN
+    #define Z_ENCODER_A_PIN UNDEFINED_PIN
+#endif
+#ifndef Z_ENCODER_B_PIN
+    #define Z_ENCODER_B_PIN UNDEFINED_PIN
+#endif
+#ifndef Z_ENCODER_COUNTS_PER_MM
+    #define Z_ENCODER_COUNTS_PER_MM 0.0
+#endif
+#ifndef A_ENCODER_A_PIN
+    #define A_ENCODER_A_PIN UNDEFINED_PIN
+#endif
+#ifndef A_ENCODER_B_PIN
+    #define A_ENCODER_B_PIN UNDEFINED_PIN
+#endif
+#ifndef A_ENCODER_COUNTS_PER_MM
+    #define A_ENCODER_COUNTS_PER_MM 0.0
+#endif
+#ifndef B_ENCODER_A_PIN
+    #define B_ENCODER_A_PIN UNDEFINED_PIN
+#endif
+#ifndef B_ENCODER_B_PIN
+    #define B_ENCODER_B_PIN UNDEFINED_PIN
+#endif
+#ifndef B_ENCODER_COUNTS_PER_MM
+    #define B_ENCODER_COUNTS_PER_MM 0.0
+#endif
+#ifndef C_ENCODER_A_PIN
+    #define C_ENCODER_A_PIN UNDEFINED_PIN
+#endif
+#ifndef C_ENCODER_B_PIN
+    #define C_ENCODER_B_PIN UNDEFINED_PIN
+#endif
+#ifndef C_ENCODER_COUNTS_PER_MM
+    #define C_ENCODER_COUNTS_PER_MM 0.0
+#endif
+
+#ifndef MPG_A_PIN
+    #define MPG_A_PIN UNDEFINED_PIN
+#endif
+#ifndef MPG_B_PIN
+    #define MPG_B_PIN UNDEFINED_PIN
+#endif
+
 #endif
@@ -0,0 +1,195 @@
+/*
+  encoder.cpp - quadrature encoder feedback for missed step detection
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+  See encoder.h for usage.
+*/
+
+#include "grbl.h"
+
+#ifdef USE_ENCODER_FEEDBACK
+
+#include <driver/pcnt.h>
+
+typedef struct {
+    uint8_t pin_a;
+    uint8_t pin_b;
+    float counts_per_mm;
+} encoder_axis_t;
+
+static const encoder_axis_t encoder_axes[] = {
+    { X_ENCODER_A_PIN, X_ENCODER_B_PIN, X_ENCODER_COUNTS_PER_MM },
+    { Y_ENCODER_A_PIN, Y_ENCODER_B_PIN, Y_ENCODER_COUNTS_PER_MM },
+    { Z_ENCODER_A_PIN, Z_ENCODER_B_PIN, Z_ENCODER_COUNTS_PER_MM },
+    { A_ENCODER_A_PIN, A_ENCODER_B_PIN, A_ENCODER_COUNTS_PER_MM },
+    { B_ENCODER_A_PIN, B_ENCODER_B_PIN, B_ENCODER_COUNTS_PER_MM },
+    { C_ENCODER_A_PIN, C_ENCODER_B_PIN, C_ENCODER_COUNTS_PER_MM },
+};
+
+static uint8_t encoder_mask = 0; // Axes with an encoder. The PCNT unit number is the axis index.
+static volatile int32_t encoder_overflow[N_AXIS]; // Counts carried by the ISR at ENCODER_PCNT_LIMIT
+static int32_t encoder_offset[N_AXIS];  // Count at machine position zero
+static float encoder_error_max[N_AXIS]; // Largest following error since the last $EF, in mm
+
+static TaskHandle_t encoderCheckTaskHandle = 0;
+
+// Carries the count when a counter reaches a limit and the PCNT resets it to zero.
+static void IRAM_ATTR encoder_isr(void* arg) {
+    uint32_t intr_status = PCNT.int_st.val;
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        if (intr_status & bit(axis)) {
+            uint32_t status = PCNT.status_unit[axis].val;
+            if (status & PCNT_STATUS_H_LIM_M)
+                encoder_overflow[axis] += ENCODER_PCNT_LIMIT;
+            if (status & PCNT_STATUS_L_LIM_M)
+                encoder_overflow[axis] -= ENCODER_PCNT_LIMIT;
+            PCNT.int_clr.val = bit(axis);
+        }
+    }
+}
+
+// NOTE: A read right at a counter reset, before the ISR has carried it, is off by the limit.
+// The next check reads it right.
+static int32_t encoder_get_count(uint8_t axis) {
+    int32_t overflow;
+    int16_t count;
+    do {
+        overflow = encoder_overflow[axis];
+        pcnt_get_counter_value((pcnt_unit_t)axis, &count);
+    } while (overflow != encoder_overflow[axis]);
+    return overflow + count;
+}
+
+static float encoder_get_mpos(uint8_t axis) {
+    return (encoder_get_count(axis) - encoder_offset[axis]) / encoder_axes[axis].counts_per_mm;
+}
+
+// Sets up both channels of the axis PCNT unit for 4 counts per encoder line.
+static void encoder_init_axis(uint8_t axis) {
+    const encoder_axis_t* encoder = &encoder_axes[axis];
+    pcnt_config_t config;
+    config.unit = (pcnt_unit_t)axis;
+    config.counter_h_lim = ENCODER_PCNT_LIMIT;
+    config.counter_l_lim = -ENCODER_PCNT_LIMIT;
+    config.lctrl_mode = PCNT_MODE_REVERSE;
+    config.hctrl_mode = PCNT_MODE_KEEP;
+
+    config.channel = PCNT_CHANNEL_0;
+    config.pulse_gpio_num = encoder->pin_a;
+    config.ctrl_gpio_num = encoder->pin_b;
+    config.pos_mode = PCNT_COUNT_DEC;
+    config.neg_mode = PCNT_COUNT_INC;
+    pcnt_unit_config(&config);
+
+    config.channel = PCNT_CHANNEL_1;
+    config.pulse_gpio_num = encoder->pin_b;
+    config.ctrl_gpio_num = encoder->pin_a;
+    config.pos_mode = PCNT_COUNT_INC;
+    config.neg_mode = PCNT_COUNT_DEC;
+    pcnt_unit_config(&config);
+
+    pcnt_set_filter_value(config.unit, ENCODER_PCNT_FILTER);
+    pcnt_filter_enable(config.unit);
+    pcnt_event_enable(config.unit, PCNT_EVT_H_LIM);
+    pcnt_event_enable(config.unit, PCNT_EVT_L_LIM);
+    pcnt_counter_pause(config.unit);
+    pcnt_counter_clear(config.unit);
+    pcnt_intr_enable(config.unit);
+    pcnt_counter_resume(config.unit);
+
+    grbl_msg_sendf(CLIENT_SERIAL,
+                   MSG_LEVEL_INFO,
+                   "%c Axis Encoder A:%s B:%s Counts/mm:%4.3f",
+                   report_get_axis_letter(axis),
+                   pinName(encoder->pin_a).c_str(),
+                   pinName(encoder->pin_b).c_str(),
+                   encoder->counts_per_mm);
+}
+
+void encoder_init() {
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        if (encoder_axes[axis].pin_a != UNDEFINED_PIN && encoder_axes[axis].pin_b != UNDEFINED_PIN &&
+                encoder_axes[axis].counts_per_mm != 0.0) {
+            encoder_mask |= bit(axis);
+            encoder_init_axis(axis);
+        }
+    }
+    if (encoder_mask == 0) {
+        grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "No encoders defined");
+        return;
+    }
+    pcnt_isr_register(encoder_isr, NULL, 0, NULL);
+    encoder_sync();
+    task_create(TASK_ENCODER, encoderCheckTask, 2048, NULL, &encoderCheckTaskHandle);
+}
+
+void encoder_sync() {
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        if (encoder_mask & bit(axis)) {
+            float mpos = system_convert_axis_steps_to_mpos(sys_position, axis);
+            encoder_offset[axis] = encoder_get_count(axis) - lround(mpos * encoder_axes[axis].counts_per_mm);
+        }
+    }
+}
+
+/*
+    Compares the encoders with sys_position. The step position is redefined by homing and may
+    be lost by the reset that goes with an alarm, so the encoders are resynced after either.
+*/
+void encoderCheckTask(void* pvParameters) {
+    TickType_t xLastWakeTime;
+    const TickType_t xCheck = ENCODER_CHECK_PERIOD_MS / portTICK_PERIOD_MS;
+    uint8_t last_state = STATE_ALARM;
+
+    xLastWakeTime = xTaskGetTickCount(); // Initialise the xLastWakeTime variable with the current time.
+    while (true) { // don't ever return from this or the task dies
+        uint8_t state = sys.state;
+        if (state & (STATE_ALARM | STATE_HOMING)) {
+            // Wait for the position to be defined again
+        } else if (last_state & (STATE_ALARM | STATE_HOMING)) {
+            encoder_sync();
+        } else {
+            float max_error = encoder_max_error->get();
+            for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+                if (encoder_mask & bit(axis)) {
+                    float error = fabs(system_convert_axis_steps_to_mpos(sys_position, axis) - encoder_get_mpos(axis));
+                    if (error > encoder_error_max[axis])
+                        encoder_error_max[axis] = error;
+                    if (max_error > 0.0 && error > max_error && !sys_rt_exec_alarm) {
+                        grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "%c Axis following error %4.3fmm", report_get_axis_letter(axis), error);
+                        mc_reset(); // Initiate system kill.
+                        system_set_exec_alarm(EXEC_ALARM_ENCODER_FOLLOWING_ERROR);
+                        break;
+                    }
+                }
+            }
+        }
+        last_state = state;
+        vTaskDelayUntil(&xLastWakeTime, xCheck);
+    }
+}
+
+// Reports the encoder position of each axis and the largest following error since the last report.
+void encoder_report(uint8_t client) {
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        if (encoder_mask & bit(axis)) {
+            grbl_sendf(client, "[ENC:%c,%4.3f,%4.3f]\r\n", report_get_axis_letter(axis), encoder_get_mpos(axis), encoder_error_max[axis]);
+            encoder_error_max[axis] = 0.0;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*
+  encoder.h - quadrature encoder feedback for missed step detection
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+	Encoder Feedback
+
+	Counts a quadrature encoder per axis with the ESP32 PCNT peripheral, so counting costs no
+	CPU time. A low priority task compares the encoder positions with sys_position and raises
+	EXEC_ALARM_ENCODER_FOLLOWING_ERROR when an axis is off by more than Encoder/MaxError mm.
+	$EF reports the encoder positions and the largest following errors seen.
+
+	Usage
+
+	1. In config.h un-comment #define USE_ENCODER_FEEDBACK
+
+	2. In the machine definition file in Machines/, define the encoder pins and resolution
+	   of each axis with an encoder like this ....
+				#define X_ENCODER_A_PIN				GPIO_NUM_34
+				#define X_ENCODER_B_PIN				GPIO_NUM_35
+				#define X_ENCODER_COUNTS_PER_MM		400.0 // 4 counts per line. Negative to reverse.
+
+	The encoder positions are set to match sys_position at boot and whenever the machine
+	leaves the homing or alarm state, because the step position is redefined there.
+*/
+
+#ifndef encoder_h
+#define encoder_h
+
+#ifndef ENCODER_CHECK_PERIOD_MS
+    #define ENCODER_CHECK_PERIOD_MS 10
+#endif
+
+// The PCNT counters are 16 bit. They are reset at these counts and the ISR carries the overflow.
+#define ENCODER_PCNT_LIMIT  30000
+// Glitches shorter than this many APB clocks (12.5ns) are ignored. Max 1023.
+#ifndef ENCODER_PCNT_FILTER
+    #define ENCODER_PCNT_FILTER 100
+#endif
+
+void encoder_init();
+void encoder_sync(); // Makes the encoder positions match sys_position
+void encoder_report(uint8_t client);
+void encoderCheckTask(void* pvParameters);
+
+#endif
@@ -25,27 +25,41 @@
 #endif
 
 #if defined (ENABLE_HTTP) && defined(ENABLE_WIFI)
-ESPResponseStream::ESPResponseStream(WebServer* webserver) {
+ESPResponseStream::ESPResponseStream(WebServer* webserver, Arena* arena) {
     _header_sent = false;
     _webserver = webserver;
     _client = CLIENT_WEBUI;
+    _arena = arena;
+    _chunk = NULL;
+    _chunk_len = 0;
+}
+
+ESPResponseStream::~ESPResponseStream() {
+    if (_chunk && !owns(_chunk))
+        free(_chunk);
 }
 #endif
 
 ESPResponseStream::ESPResponseStream() {
     _client = CLIENT_INPUT;
+    _arena = NULL;
 #if defined (ENABLE_HTTP) && defined(ENABLE_WIFI)
     _header_sent = false;
     _webserver = NULL;
+    _chunk = NULL;
+    _chunk_len = 0;
 #endif
 }
 
 ESPResponseStream::ESPResponseStream(uint8_t client, bool byid) {
     (void)byid; //fake parameter to avoid confusion with pointer one (NULL == 0)
     _client = client;
+    _arena = NULL;
 #if defined (ENABLE_HTTP) && defined(ENABLE_WIFI)
     _header_sent = false;
     _webserver = NULL;
+    _chunk = NULL;
+    _chunk_len = 0;
 #endif
 }
 
@@ -77,14 +91,26 @@ void ESPResponseStream::print(const char* data) {
             _webserver->sendHeader("Cache-Control", "no-cache");
             _webserver->send(200);
             _header_sent = true;
+            if (_chunk == NULL) {
+                _chunk = (char*)alloc(ESPRESPONSE_CHUNK_SIZE);
+                if (_chunk == NULL)
+                    _chunk = (char*)malloc(ESPRESPONSE_CHUNK_SIZE);
+            }
         }
-        _buffer += data;
-        if (_buffer.length() > 1200) {
+        size_t len = strlen(data);
+        if (_chunk_len + len > ESPRESPONSE_CHUNK_SIZE || _chunk == NULL) {
             //send data
-            _webserver->sendContent(_buffer);
-            //reset buffer
-            _buffer = "";
+            if (_chunk_len > 0) {
+                _webserver->sendContent_P(_chunk, _chunk_len);
+                _chunk_len = 0;
+            }
+            if (len > ESPRESPONSE_CHUNK_SIZE || _chunk == NULL) {
+                _webserver->sendContent_P(data, len);
+                return;
+            }
         }
+        memcpy(&_chunk[_chunk_len], data, len);
+        _chunk_len += len;
         return;
     }
 #endif
@@ -97,12 +123,12 @@ void ESPResponseStream::flush() {
     if (_webserver) {
         if (_header_sent) {
             //send data
-            if (_buffer.length() > 0)_webserver->sendContent(_buffer);
+            if (_chunk_len > 0)_webserver->sendContent_P(_chunk, _chunk_len);
             //close connection
             _webserver->sendContent("");
         }
         _header_sent = false;
-        _buffer = "";
+        _chunk_len = 0;
     }
 #endif
 }
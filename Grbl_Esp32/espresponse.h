@@ -21,10 +21,17 @@
 #ifndef ESPRESPONSE_h
 #define ESPRESPONSE_h
 
+#include "arena.h"
+
 #if defined (ENABLE_HTTP) && defined(ENABLE_WIFI)
     class WebServer;
 #endif
 
+// Web responses are sent in chunks of up to this size, gathered in a buffer taken once per response
+#ifndef ESPRESPONSE_CHUNK_SIZE
+    #define ESPRESPONSE_CHUNK_SIZE 1200
+#endif
+
 class ESPResponseStream {
   public:
     void print(const char* data);
@@ -33,17 +40,24 @@ class ESPResponseStream {
     bool anyOutput() { return _header_sent; }
     static String formatBytes(uint64_t bytes);
     uint8_t client() {return _client;}
+    // Memory for the rest of the request, from the request arena if there is one.
+    // Returns NULL if there is no arena or it is full, so callers fall back to the heap.
+    void* alloc(size_t size) { return _arena ? _arena->alloc(size) : NULL; }
+    bool owns(const void* block) { return _arena && _arena->owns(block); }
 #if defined (ENABLE_HTTP) && defined(ENABLE_WIFI)
-    ESPResponseStream(WebServer* webserver);
+    ESPResponseStream(WebServer* webserver, Arena* arena = NULL);
+    ~ESPResponseStream();
 #endif
     ESPResponseStream(uint8_t client, bool byid = true);
     ESPResponseStream();
   private:
     uint8_t _client;
     bool _header_sent;
+    Arena* _arena;
 #if defined (ENABLE_HTTP) && defined(ENABLE_WIFI)
     WebServer* _webserver;
-    String _buffer;
+    char* _chunk; // ESPRESPONSE_CHUNK_SIZE bytes, taken when the response starts
+    size_t _chunk_len;
 #endif
 };
 
@@ -0,0 +1,104 @@
+/*
+  ethconfig.cpp - wired Ethernet through an RMII PHY, for the network services of WiFi
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef ENABLE_ETHERNET
+
+#include "wifiservices.h"
+
+// The telnet, HTTP and websocket servers listen on every interface, so when WiFi is on they
+// serve the Ethernet clients too. With the radio off or used for Bluetooth, the services are
+// started here once the link has an address. The address comes from DHCP, and the hostname
+// is that of WiFi. The driver cannot be stopped again, so a change of Ethernet/Enable is
+// applied at the next reset.
+
+EthConfig eth_config;
+
+bool EthConfig::_started = false;
+volatile bool EthConfig::_connected = false;
+
+// Called from the event task of the network stack
+void EthConfig::EthEvent(WiFiEvent_t event) {
+    switch (event) {
+    case SYSTEM_EVENT_ETH_START:
+        ETH.setHostname(wifi_hostname->get());
+        break;
+    case SYSTEM_EVENT_ETH_CONNECTED:
+        grbl_send(CLIENT_ALL, "[MSG:Ethernet link up]\r\n");
+        break;
+    case SYSTEM_EVENT_ETH_GOT_IP:
+        grbl_sendf(CLIENT_ALL, "[MSG:Ethernet connected with %s]\r\n", ETH.localIP().toString().c_str());
+        _connected = true;
+        break;
+    case SYSTEM_EVENT_ETH_DISCONNECTED:
+        grbl_send(CLIENT_ALL, "[MSG:Ethernet link down]\r\n");
+        _connected = false;
+        break;
+    case SYSTEM_EVENT_ETH_STOP:
+        _connected = false;
+        break;
+    default:
+        break;
+    }
+}
+
+void EthConfig::begin() {
+    if (_started || eth_enable->get() == 0)
+        return;
+    WiFi.onEvent(EthConfig::EthEvent);
+    if (!ETH.begin(ETH_PHY_ADDR, ETH_PHY_POWER, ETH_PHY_MDC, ETH_PHY_MDIO, ETH_PHY_TYPE, ETH_CLK_MODE)) {
+        grbl_send(CLIENT_ALL, "[MSG:Ethernet failed to start]\r\n");
+        return;
+    }
+    _started = true;
+}
+
+/**
+ * Starts the services for Ethernet when WiFi has not, or has stopped them with the radio
+ */
+void EthConfig::handle() {
+    if (_connected && !WiFiServices::started())
+        wifi_services.begin();
+}
+
+const char* EthConfig::info() {
+    static String result;
+    result = "[MSG:Mode=ETH:Status=";
+    if (!_started)
+        result += "Off";
+    else if (!_connected)
+        result += ETH.linkUp() ? "No address" : "No link";
+    else {
+        result += "Connected:IP=";
+        result += ETH.localIP().toString();
+        result += ":Speed=";
+        result += String(ETH.linkSpeed());
+        result += ETH.fullDuplex() ? "Mbps full" : "Mbps half";
+    }
+    if (_started) {
+        String mac = ETH.macAddress();
+        mac.replace(":", "-");
+        result += ":MAC=";
+        result += mac;
+    }
+    result += "]\r\n";
+    return result.c_str();
+}
+
+#endif
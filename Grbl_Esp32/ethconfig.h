@@ -0,0 +1,55 @@
+/*
+  ethconfig.h - wired Ethernet through an RMII PHY, for the network services of WiFi
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ethconfig_h
+#define ethconfig_h
+
+#if defined(ENABLE_ETHERNET) && !defined(ENABLE_WIFI)
+    #error "ENABLE_ETHERNET needs ENABLE_WIFI, which has the network services"
+#endif
+
+#ifdef ENABLE_ETHERNET
+
+#include <ETH.h>
+
+// The PHY and its wiring are ETH_PHY_TYPE, ETH_PHY_ADDR, ETH_PHY_POWER, ETH_PHY_MDC, ETH_PHY_MDIO
+// and ETH_CLK_MODE. ETH.h defaults those the machine file, which config.h includes first, left
+// out. They are those of the LAN8720 boards, like the WT32-ETH01: the 50MHz clock in on GPIO0,
+// MDC on GPIO23, MDIO on GPIO18 and PHY address 0.
+
+#define DEFAULT_ETH_STATE 1
+
+class EthConfig {
+  public:
+    static void begin();
+    static void handle();
+    static const char* info();
+    // True while the link is up and has an address
+    static bool connected() { return _connected; }
+
+  private:
+    static void EthEvent(WiFiEvent_t event);
+    static bool _started;
+    static volatile bool _connected;
+};
+
+extern EthConfig eth_config;
+
+#endif
+
+#endif
@@ -0,0 +1,118 @@
+/*
+  event_trace.cpp - timestamped events of the control path, dumped as a Chrome trace
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+#include <esp_ipc.h>
+
+#ifdef EVENT_TRACE
+
+// The time of a record is the CCOUNT cycle counter of the core that wrote it, which takes a
+// single instruction to read. The two cores count apart, so trace_hold() reads each counter
+// together with esp_timer_get_time(), and every record is placed that many cycles before it.
+// This holds for records less than 2^32 cycles old, about 17 seconds at 240MHz. Older ones come
+// out too late.
+// NOTE: The events of each core are one thread of the trace, so the spans of an ISR or of a task
+// that preempts another nest inside the span that was running.
+typedef struct {
+    uint32_t ccount;
+    uint16_t arg;
+    uint8_t event;
+    uint8_t phase; // TRACE_PHASE_*, with the core in bit 7
+} trace_record_t;
+static trace_record_t trace_records[EVENT_TRACE_SIZE];
+static volatile uint32_t trace_next = 0; // Records written, wrapping
+static volatile bool trace_on = true;
+
+static const char* const trace_event_names[TRACE_EVENT_COUNT] = {
+    "step_isr", "segment_load", "segment_underrun", "prep", "segment_prep", "plan",
+    "line", "parse", "rx", "tx", "status", "spindle",
+};
+static const char trace_phases[] = "BEi";
+
+const char* const trace_json_header = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+const char* const trace_json_footer = "]}\n";
+
+// The counter and the time of each core, read by trace_hold()
+typedef struct {
+    uint32_t ccount;
+    int64_t us;
+} trace_clock_t;
+static trace_clock_t trace_clocks[portNUM_PROCESSORS];
+static uint32_t trace_count;
+static uint32_t trace_cpu_mhz;
+static bool trace_held_on = false; // trace_on when trace_hold() paused it
+
+void IRAM_ATTR trace_event(uint8_t event, uint8_t phase, uint16_t arg) {
+    if (!trace_on)
+        return;
+    uint32_t index = __atomic_fetch_add(&trace_next, 1, __ATOMIC_RELAXED);
+    trace_record_t* record = &trace_records[index & (EVENT_TRACE_SIZE - 1)];
+    record->ccount = xthal_get_ccount();
+    record->arg = arg;
+    record->event = event;
+    record->phase = phase | (xPortGetCoreID() << 7);
+}
+
+static void trace_read_clock(void* arg) {
+    trace_clock_t* clock = &trace_clocks[xPortGetCoreID()];
+    clock->ccount = xthal_get_ccount();
+    clock->us = esp_timer_get_time();
+}
+
+uint32_t trace_hold() {
+    trace_held_on = trace_on;
+    trace_on = false;
+    // An ISR on the other core may be inside trace_event(). It is done within a microsecond.
+    vTaskDelay(1);
+    trace_read_clock(NULL);
+    for (uint32_t core = 0; core < portNUM_PROCESSORS; core++) {
+        if (core != xPortGetCoreID())
+            esp_ipc_call_blocking(core, trace_read_clock, NULL);
+    }
+    trace_cpu_mhz = ESP.getCpuFreqMHz();
+    trace_count = MIN(trace_next, EVENT_TRACE_SIZE);
+    return trace_count;
+}
+
+bool trace_json(uint32_t index, char* line, size_t size) {
+    if (index >= trace_count)
+        return false;
+    const trace_record_t* record = &trace_records[(trace_next - trace_count + index) & (EVENT_TRACE_SIZE - 1)];
+    uint8_t core = record->phase >> 7;
+    uint8_t phase = record->phase & 0x7f;
+    const trace_clock_t* clock = &trace_clocks[core];
+    double us = clock->us - (double)(uint32_t)(clock->ccount - record->ccount) / trace_cpu_mhz;
+    const char* name = record->event < TRACE_EVENT_COUNT ? trace_event_names[record->event] : "?";
+    int len = snprintf(line, size, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":0,\"tid\":%d",
+                       index ? ",\n" : "", name, trace_phases[phase], us, core);
+    if (len > 0 && (size_t)len < size) {
+        if (phase == TRACE_PHASE_MARK)
+            snprintf(line + len, size - len, ",\"s\":\"t\",\"args\":{\"arg\":%u}}", record->arg);
+        else if (phase == TRACE_PHASE_BEGIN)
+            snprintf(line + len, size - len, ",\"args\":{\"arg\":%u}}", record->arg);
+        else
+            snprintf(line + len, size - len, "}");
+    }
+    return true;
+}
+
+void trace_release() {
+    trace_on = trace_held_on;
+}
+
+#endif
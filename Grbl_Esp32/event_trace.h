@@ -0,0 +1,94 @@
+/*
+  event_trace.h - timestamped events of the control path, dumped as a Chrome trace
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef event_trace_h
+#define event_trace_h
+
+#ifdef EVENT_TRACE
+
+// The number of event records kept, 8 bytes each. The oldest are overwritten. A power of 2.
+#ifndef EVENT_TRACE_SIZE
+    #define EVENT_TRACE_SIZE 2048
+#endif
+
+#if (EVENT_TRACE_SIZE & (EVENT_TRACE_SIZE - 1)) != 0
+    #error "EVENT_TRACE_SIZE must be a power of 2"
+#endif
+
+// The events. Spans have a begin and an end, marks are one point. trace_event_names[] in
+// event_trace.cpp has their names, in the same order.
+enum trace_event_t : uint8_t {
+    TRACE_STEP_ISR = 0,     // Span. Each stepper ISR tick, only with EVENT_TRACE_STEP_ISR.
+    TRACE_SEGMENT_LOAD,     // Mark. The stepper ISR loaded a segment. arg: its step events
+    TRACE_SEGMENT_UNDERRUN, // Mark. The stepper ISR had no segment while the planner had blocks
+    TRACE_PREP,             // Span. st_prep_buffer()
+    TRACE_SEGMENT_PREP,     // Mark. The prep made a segment. arg: its step events
+    TRACE_PLAN,             // Span. plan_buffer_line() and plan_buffer_lines(). arg: lines
+    TRACE_LINE,             // Span. A line from a client, parsed and executed. arg: client
+    TRACE_PARSE,            // Span. gc_execute_line()
+    TRACE_RX,               // Mark. Bytes of a client went to its receive buffer. arg: count
+    TRACE_TX,               // Span. A message written to a client. arg: client
+    TRACE_STATUS,           // Span. A status report built
+    TRACE_SPINDLE,          // Span. A VFD command sent and its answer read
+    TRACE_EVENT_COUNT
+};
+
+#define TRACE_PHASE_BEGIN 0
+#define TRACE_PHASE_END 1
+#define TRACE_PHASE_MARK 2
+
+// Records an event of this core. Safe from ISRs and from both cores.
+void trace_event(uint8_t event, uint8_t phase, uint16_t arg);
+
+// Ends its span when it goes out of scope, for functions with many returns
+struct trace_scope_t {
+    uint8_t event;
+    trace_scope_t(uint8_t event, uint16_t arg) : event(event) { trace_event(event, TRACE_PHASE_BEGIN, arg); }
+    ~trace_scope_t() { trace_event(event, TRACE_PHASE_END, 0); }
+};
+
+#define TRACE_BEGIN(event, arg) trace_event(event, TRACE_PHASE_BEGIN, arg)
+#define TRACE_END(event) trace_event(event, TRACE_PHASE_END, 0)
+#define TRACE_MARK(event, arg) trace_event(event, TRACE_PHASE_MARK, arg)
+#define TRACE_SCOPE(event, arg) trace_scope_t trace_scope(event, arg)
+
+// Reading side. trace_hold() pauses the recording, so the records stay still while they are
+// read, and returns their number. trace_json() formats record index, 0 being the oldest, as a
+// Chrome trace event and returns false past the last one. trace_release() resumes recording.
+uint32_t trace_hold();
+bool trace_json(uint32_t index, char* line, size_t size);
+void trace_release();
+
+// What goes before and after the events, for a JSON file that chrome://tracing or Perfetto opens
+extern const char* const trace_json_header;
+extern const char* const trace_json_footer;
+
+#else
+
+#define TRACE_BEGIN(event, arg)
+#define TRACE_END(event)
+#define TRACE_MARK(event, arg)
+#define TRACE_SCOPE(event, arg)
+
+#endif
+
+#if defined(EVENT_TRACE_STEP_ISR) && !defined(EVENT_TRACE)
+    #error "EVENT_TRACE_STEP_ISR requires EVENT_TRACE"
+#endif
+
+#endif
@@ -0,0 +1,433 @@
+/*
+  expression.cpp - numbered parameters and [expr] expressions of g-code, compiled to a stack code
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef GCODE_EXPRESSIONS
+
+// The expressions of LinuxCNC, in brackets, with angles in degrees:
+//   binary    ** (highest), * / MOD, + -, EQ NE GT GE LT LE, AND OR XOR (lowest)
+//   unary     -x, +x, #x, ABS ACOS ASIN COS EXP FIX FUP LN ROUND SIN SQRT TAN of [x], ATAN[y]/[x]
+// A word value is a number, a #parameter or an [expr], with a sign. #n=value sets a parameter.
+//   A line, or the number or expression of a word, is compiled once to a code for a stack of
+// floats: a byte for each op, and the float of a constant after its op. Lines kept by the O-word
+// subs and loops are kept compiled, so a loop only evaluates them. The depth of the stack is
+// found when compiling, so the evaluation needs no checks for it.
+// Read-only parameters, in the units of G20/G21 and the work coordinates:
+//   #5061-#5066  last probe position        #5070       1 if the last probe hit
+//   #5220        G54-G59 in use, 1-6         #5221-#5226 G54 offsets, #5241-#5246 G55, ... G59
+//   #5400        tool number                 #5420-#5425 current position
+
+#define EXPR_CONST 1 // Followed by the float
+#define EXPR_PARAM 2 // x becomes #x
+#define EXPR_NEG 3
+#define EXPR_ABS 4
+#define EXPR_ACOS 5
+#define EXPR_ASIN 6
+#define EXPR_COS 7
+#define EXPR_EXP 8
+#define EXPR_FIX 9
+#define EXPR_FUP 10
+#define EXPR_LN 11
+#define EXPR_ROUND 12
+#define EXPR_SIN 13
+#define EXPR_SQRT 14
+#define EXPR_TAN 15
+#define EXPR_ATAN 16 // The binary ops from here
+#define EXPR_POW 17
+#define EXPR_MUL 18
+#define EXPR_DIV 19
+#define EXPR_MOD 20
+#define EXPR_ADD 21
+#define EXPR_SUB 22
+#define EXPR_EQ 23
+#define EXPR_NE 24
+#define EXPR_GT 25
+#define EXPR_GE 26
+#define EXPR_LT 27
+#define EXPR_LE 28
+#define EXPR_AND 29
+#define EXPR_OR 30
+#define EXPR_XOR 31
+
+typedef struct {
+    const char* name;
+    uint8_t op;
+    uint8_t precedence; // Of a binary op, higher binds first
+} expr_op_t;
+
+// Longer names first where one starts another
+static const expr_op_t expr_binary_ops[] = {
+    { "**", EXPR_POW, 5 }, { "*", EXPR_MUL, 4 },  { "/", EXPR_DIV, 4 },  { "MOD", EXPR_MOD, 4 }, { "+", EXPR_ADD, 3 },
+    { "-", EXPR_SUB, 3 },  { "EQ", EXPR_EQ, 2 },  { "NE", EXPR_NE, 2 },  { "GT", EXPR_GT, 2 },   { "GE", EXPR_GE, 2 },
+    { "LT", EXPR_LT, 2 },  { "LE", EXPR_LE, 2 },  { "AND", EXPR_AND, 1 }, { "OR", EXPR_OR, 1 },  { "XOR", EXPR_XOR, 1 },
+};
+
+static const expr_op_t expr_functions[] = {
+    { "ABS", EXPR_ABS, 0 },   { "ACOS", EXPR_ACOS, 0 }, { "ASIN", EXPR_ASIN, 0 }, { "ATAN", EXPR_ATAN, 0 }, { "COS", EXPR_COS, 0 },
+    { "EXP", EXPR_EXP, 0 },   { "FIX", EXPR_FIX, 0 },   { "FUP", EXPR_FUP, 0 },   { "LN", EXPR_LN, 0 },     { "ROUND", EXPR_ROUND, 0 },
+    { "SIN", EXPR_SIN, 0 },   { "SQRT", EXPR_SQRT, 0 }, { "TAN", EXPR_TAN, 0 },
+};
+
+#define EXPR_COUNT(table) (sizeof(table) / sizeof(table[0]))
+
+static float parameters[EXPR_PARAMETERS];
+
+typedef struct {
+    const char* line;
+    uint8_t pos;
+    uint8_t* code;
+    uint16_t length;
+    uint16_t room;
+    uint8_t depth; // Of the stack, once the code so far has run
+    uint8_t status;
+} expr_compiler_t;
+
+static void expr_emit(expr_compiler_t* ec, uint8_t op) {
+    if (ec->length == ec->room) {
+        ec->status = STATUS_OVERFLOW;
+        return;
+    }
+    ec->code[ec->length++] = op;
+    if (op == EXPR_CONST && ++ec->depth > EXPR_STACK_SIZE)
+        ec->status = STATUS_OVERFLOW;
+    else if (op >= EXPR_ATAN)
+        ec->depth--;
+}
+
+static void expr_emit_const(expr_compiler_t* ec, float value) {
+    expr_emit(ec, EXPR_CONST);
+    if (ec->status != STATUS_OK)
+        return;
+    if (ec->length + sizeof(float) > ec->room) {
+        ec->status = STATUS_OVERFLOW;
+        return;
+    }
+    memcpy(ec->code + ec->length, &value, sizeof(float));
+    ec->length += sizeof(float);
+}
+
+// Matches one of the names of table at the position, and moves past it
+static const expr_op_t* expr_match(expr_compiler_t* ec, const expr_op_t* table, uint8_t count) {
+    const char* at = ec->line + ec->pos;
+    for (uint8_t i = 0; i < count; i++) {
+        size_t length = strlen(table[i].name);
+        if (strncmp(at, table[i].name, length) == 0) {
+            ec->pos += length;
+            return &table[i];
+        }
+    }
+    return NULL;
+}
+
+static void expr_expect(expr_compiler_t* ec, char c) {
+    if (ec->line[ec->pos] == c)
+        ec->pos++;
+    else
+        ec->status = STATUS_EXPRESSION_SYNTAX;
+}
+
+static void expr_binary(expr_compiler_t* ec, uint8_t precedence);
+
+static void expr_operand(expr_compiler_t* ec) {
+    if (ec->status != STATUS_OK)
+        return;
+    char c = ec->line[ec->pos];
+    if (c == '[') {
+        ec->pos++;
+        expr_binary(ec, 1);
+        expr_expect(ec, ']');
+    } else if (c == '#') {
+        ec->pos++;
+        expr_operand(ec);
+        expr_emit(ec, EXPR_PARAM);
+    } else if (c == '-') {
+        ec->pos++;
+        expr_operand(ec);
+        expr_emit(ec, EXPR_NEG);
+    } else if (c == '+') {
+        ec->pos++;
+        expr_operand(ec);
+    } else if ((c >= '0' && c <= '9') || c == '.') {
+        float value;
+        if (!read_float(ec->line, &ec->pos, &value))
+            ec->status = STATUS_BAD_NUMBER_FORMAT;
+        else
+            expr_emit_const(ec, value);
+    } else {
+        const expr_op_t* function = expr_match(ec, expr_functions, EXPR_COUNT(expr_functions));
+        if (!function || ec->line[ec->pos] != '[') {
+            ec->status = STATUS_EXPRESSION_SYNTAX;
+            return;
+        }
+        expr_operand(ec);
+        if (function->op == EXPR_ATAN) {
+            expr_expect(ec, '/');
+            if (ec->status == STATUS_OK && ec->line[ec->pos] != '[')
+                ec->status = STATUS_EXPRESSION_SYNTAX;
+            expr_operand(ec);
+        }
+        expr_emit(ec, function->op);
+    }
+}
+
+// Compiles the binary ops of at least precedence, each taking the operands on its left first
+static void expr_binary(expr_compiler_t* ec, uint8_t precedence) {
+    expr_operand(ec);
+    while (ec->status == STATUS_OK) {
+        uint8_t pos = ec->pos;
+        const expr_op_t* op = expr_match(ec, expr_binary_ops, EXPR_COUNT(expr_binary_ops));
+        if (!op || op->precedence < precedence) {
+            ec->pos = pos;
+            return;
+        }
+        expr_binary(ec, op->precedence + 1);
+        expr_emit(ec, op->op);
+    }
+}
+
+uint8_t expr_compile(const char* line, uint8_t* char_counter, uint8_t* code, uint16_t* length, uint16_t room) {
+    expr_compiler_t ec = { line, *char_counter, code, *length, room, 0, STATUS_OK };
+    expr_operand(&ec);
+    expr_emit(&ec, EXPR_END);
+    *char_counter = ec.pos;
+    *length = ec.length;
+    return ec.status;
+}
+
+// The offset of the work coordinates of an axis from the machine coordinates
+static float expr_work_offset(uint8_t axis) {
+    float offset = gc_state.coord_system[axis] + gc_state.coord_offset[axis];
+    if (axis == TOOL_LENGTH_OFFSET_AXIS)
+        offset += gc_state.tool_length_offset;
+    return offset;
+}
+
+static float expr_in_units(float mm) {
+    return gc_state.modal.units == UNITS_MODE_INCHES ? mm / MM_PER_INCH : mm;
+}
+
+// The number of a parameter that can be set, from 1 to EXPR_PARAMETERS - 1
+static uint8_t expr_settable(float number, uint32_t* index) {
+    if (number < 0.5f || number >= EXPR_PARAMETERS - 0.5f)
+        return STATUS_PARAMETER_INVALID;
+    *index = lroundf(number);
+    return STATUS_OK;
+}
+
+static uint8_t expr_read_parameter(float number, float* value) {
+    if (number < 0.0f)
+        return STATUS_PARAMETER_INVALID;
+    uint32_t n = lroundf(number);
+    if (n < EXPR_PARAMETERS) {
+        *value = parameters[n];
+        return STATUS_OK;
+    }
+    if (n >= 5061 && n < 5061 + N_AXIS) {
+        float position[N_AXIS];
+        probe_get_position(position);
+        *value = expr_in_units(position[n - 5061] - expr_work_offset(n - 5061));
+    } else if (n == 5070)
+        *value = sys.probe_succeeded ? 1.0f : 0.0f;
+    else if (n == 5220)
+        *value = gc_state.modal.coord_select + 1;
+    else if (n >= 5221 && n < 5221 + 20 * N_COORDINATE_SYSTEM && (n - 5221) % 20 < N_AXIS) {
+        float coord[N_AXIS];
+        if (!settings_read_coord_data((n - 5221) / 20, coord))
+            return STATUS_SETTING_READ_FAIL;
+        *value = expr_in_units(coord[(n - 5221) % 20]);
+    } else if (n == 5400)
+        *value = gc_state.tool;
+    else if (n >= 5420 && n < 5420 + N_AXIS)
+        *value = expr_in_units(gc_state.position[n - 5420] - expr_work_offset(n - 5420));
+    else
+        return STATUS_PARAMETER_INVALID;
+    return STATUS_OK;
+}
+
+uint8_t expr_set_parameter(float number, float value) {
+    uint32_t n;
+    uint8_t status = expr_settable(number, &n);
+    if (status == STATUS_OK)
+        parameters[n] = value;
+    return status;
+}
+
+void expr_save_locals(float* saved) {
+    memcpy(saved, &parameters[1], EXPR_LOCALS * sizeof(float));
+}
+
+void expr_restore_locals(const float* saved) {
+    memcpy(&parameters[1], saved, EXPR_LOCALS * sizeof(float));
+}
+
+static inline float expr_radians(float degrees) {
+    return degrees * (float)(M_PI / 180.0);
+}
+
+static inline float expr_degrees(float radians) {
+    return radians * (float)(180.0 / M_PI);
+}
+
+uint8_t expr_eval(const uint8_t** code, float* value) {
+    float stack[EXPR_STACK_SIZE];
+    uint8_t sp = 0; // Values on the stack
+    const uint8_t* pc = *code;
+    for (;;) {
+        uint8_t op = *pc++;
+        if (op == EXPR_END)
+            break;
+        if (op == EXPR_CONST) {
+            memcpy(&stack[sp++], pc, sizeof(float));
+            pc += sizeof(float);
+            continue;
+        }
+        float& x = stack[sp - 1];
+        if (op < EXPR_ATAN) {
+            switch (op) {
+                case EXPR_PARAM: {
+                    uint8_t status = expr_read_parameter(x, &x);
+                    if (status != STATUS_OK)
+                        return status;
+                    break;
+                }
+                case EXPR_NEG: x = -x; break;
+                case EXPR_ABS: x = fabsf(x); break;
+                case EXPR_ACOS:
+                case EXPR_ASIN:
+                    if (x < -1.0f || x > 1.0f)
+                        return STATUS_EXPRESSION_MATH;
+                    x = expr_degrees(op == EXPR_ACOS ? acosf(x) : asinf(x));
+                    break;
+                case EXPR_COS: x = cosf(expr_radians(x)); break;
+                case EXPR_EXP: x = expf(x); break;
+                case EXPR_FIX: x = floorf(x); break;
+                case EXPR_FUP: x = ceilf(x); break;
+                case EXPR_LN:
+                    if (x <= 0.0f)
+                        return STATUS_EXPRESSION_MATH;
+                    x = logf(x);
+                    break;
+                case EXPR_ROUND: x = roundf(x); break;
+                case EXPR_SIN: x = sinf(expr_radians(x)); break;
+                case EXPR_SQRT:
+                    if (x < 0.0f)
+                        return STATUS_EXPRESSION_MATH;
+                    x = sqrtf(x);
+                    break;
+                case EXPR_TAN: x = tanf(expr_radians(x)); break;
+            }
+            continue;
+        }
+        float y = stack[--sp];
+        float& a = stack[sp - 1];
+        switch (op) {
+            case EXPR_ATAN: a = expr_degrees(atan2f(a, y)); break;
+            case EXPR_POW: a = powf(a, y); break;
+            case EXPR_MUL: a *= y; break;
+            case EXPR_DIV:
+                if (y == 0.0f)
+                    return STATUS_EXPRESSION_MATH;
+                a /= y;
+                break;
+            case EXPR_MOD:
+                if (y == 0.0f)
+                    return STATUS_EXPRESSION_MATH;
+                a = fmodf(a, y);
+                if (a < 0.0f)
+                    a += fabsf(y); // LinuxCNC keeps the result positive
+                break;
+            case EXPR_ADD: a += y; break;
+            case EXPR_SUB: a -= y; break;
+            case EXPR_EQ: a = (a == y); break;
+            case EXPR_NE: a = (a != y); break;
+            case EXPR_GT: a = (a > y); break;
+            case EXPR_GE: a = (a >= y); break;
+            case EXPR_LT: a = (a < y); break;
+            case EXPR_LE: a = (a <= y); break;
+            case EXPR_AND: a = (a != 0.0f && y != 0.0f); break;
+            case EXPR_OR: a = (a != 0.0f || y != 0.0f); break;
+            case EXPR_XOR: a = ((a != 0.0f) != (y != 0.0f)); break;
+        }
+    }
+    *value = stack[0];
+    *code = pc;
+    return STATUS_OK;
+}
+
+// The code of a line is, for each word, its letter and the code of its value. An assignment
+// is a '#', the code of the parameter number and the code of the value.
+uint8_t expr_compile_line(char* line, uint8_t* code, uint16_t room, uint16_t* length) {
+    collapseGCode(line);
+    uint8_t char_counter = 0;
+    *length = 0;
+    while (line[char_counter] != '\0') {
+        char letter = line[char_counter++];
+        if ((letter < 'A' || letter > 'Z') && letter != '#')
+            return STATUS_EXPECTED_COMMAND_LETTER;
+        if (*length == room)
+            return STATUS_OVERFLOW;
+        code[(*length)++] = letter;
+        uint8_t status = expr_compile(line, &char_counter, code, length, room);
+        if (status == STATUS_OK && letter == '#') {
+            if (line[char_counter++] != '=')
+                return STATUS_EXPRESSION_SYNTAX;
+            status = expr_compile(line, &char_counter, code, length, room);
+        }
+        if (status != STATUS_OK)
+            return status;
+    }
+    return STATUS_OK;
+}
+
+uint8_t expr_run_line(const uint8_t* code, uint16_t length, gc_word_t* words, uint8_t* word_count) {
+    struct {
+        uint32_t index;
+        float value;
+    } assignments[GC_MAX_WORDS];
+    uint8_t assignment_count = 0;
+    uint8_t count = 0;
+    const uint8_t* end = code + length;
+    while (code < end) {
+        char letter = *code++;
+        float value;
+        uint8_t status = expr_eval(&code, &value);
+        if (status != STATUS_OK)
+            return status;
+        if (letter == '#') {
+            if (assignment_count == GC_MAX_WORDS)
+                return STATUS_OVERFLOW;
+            status = expr_settable(value, &assignments[assignment_count].index);
+            if (status == STATUS_OK)
+                status = expr_eval(&code, &assignments[assignment_count++].value);
+            if (status != STATUS_OK)
+                return status;
+        } else {
+            if (count == GC_MAX_WORDS)
+                return STATUS_BAD_NUMBER_FORMAT;
+            words[count].letter = letter;
+            words[count++].value = value;
+        }
+    }
+    for (uint8_t i = 0; i < assignment_count; i++)
+        parameters[assignments[i].index] = assignments[i].value;
+    *word_count = count;
+    return STATUS_OK;
+}
+
+#endif
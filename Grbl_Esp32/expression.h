@@ -0,0 +1,68 @@
+/*
+  expression.h - numbered parameters and [expr] expressions of g-code, compiled to a stack code
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef expression_h
+#define expression_h
+
+#ifdef GCODE_EXPRESSIONS
+
+// The parameters #1 to #(EXPR_PARAMETERS - 1) can be set. #0 is always 0. The numbers from 5000
+// up are the read-only values of the machine, see expression.cpp.
+#ifndef EXPR_PARAMETERS
+    #define EXPR_PARAMETERS 1000
+#endif
+
+// #1 to #EXPR_LOCALS are the arguments of an O-word call, and are restored after it
+#define EXPR_LOCALS 30
+
+// Values an expression may have on the stack at once. Deeper ones do not compile.
+#define EXPR_STACK_SIZE 16
+
+// Bytes of the code of a line. A number takes 5 bytes, and an operator 1.
+#define EXPR_LINE_CODE_SIZE (LINE_BUFFER_SIZE * 4)
+
+#define EXPR_END 0 // The last op of the code of an expression
+
+// The line has parameters or expressions, so it is run through expr_compile_line()
+inline bool expr_line_has_expressions(const char* line) {
+    return strpbrk(line, "#[") != NULL;
+}
+
+// Compiles a number, #parameter or [expr] of the collapsed line at *char_counter, moving it
+// past. Its code and an EXPR_END are appended to code at *length, within room bytes.
+uint8_t expr_compile(const char* line, uint8_t* char_counter, uint8_t* code, uint16_t* length, uint16_t room);
+
+// Evaluates the code of one expression, and moves code past its end
+uint8_t expr_eval(const uint8_t** code, float* value);
+
+// Collapses the line and compiles its words and #n=value assignments into code
+uint8_t expr_compile_line(char* line, uint8_t* code, uint16_t room, uint16_t* length);
+
+// Evaluates the code of a line into its words, for gc_execute_words(). The assignments take
+// effect once all the values of the line are evaluated, as in LinuxCNC.
+uint8_t expr_run_line(const uint8_t* code, uint16_t length, gc_word_t* words, uint8_t* word_count);
+
+// Copies #1 to #EXPR_LOCALS out and back in, around an O-word call
+void expr_save_locals(float* saved);
+void expr_restore_locals(const float* saved);
+
+uint8_t expr_set_parameter(float number, float value);
+
+#endif
+
+#endif
@@ -47,6 +47,9 @@ void gc_init() {
     // Load default G54 coordinate system.
     if (!(settings_read_coord_data(gc_state.modal.coord_select, gc_state.coord_system)))
         report_status_message(STATUS_SETTING_READ_FAIL, CLIENT_SERIAL);
+#ifdef OWORD_SUBROUTINES
+    oword_reset();
+#endif
 }
 
 
@@ -116,6 +119,139 @@ void collapseGCode(char *line) {
     *outPtr = '\0';
 }
 
+// Reads a line the way collapseGCode() rewrites it, one character at a time, so the line can be
+// split into words in the same pass. Comments are reported as they are passed.
+typedef struct {
+    char* in;    // Next character to look at
+    char* paren; // If non-NULL, the address of the character after (
+} gc_lexer_t;
+
+// Returns the next character collapseGCode() would keep, in upper case, or '\0' at the end.
+static char gc_next_char_slow(gc_lexer_t* lx) {
+    char c;
+    while ((c = *lx->in) != '\0') {
+        char* p = lx->in++;
+        if (isspace(c))
+            continue;
+        switch (c) {
+            case ')':
+                if (lx->paren) {
+                    // Terminate comment by replacing ) with NUL
+                    *p = '\0';
+                    report_gcode_comment(lx->paren);
+                    lx->paren = NULL;
+                }
+                break;
+            case '(':
+                lx->paren = p + 1;
+                break;
+            case ';':
+#ifdef REPORT_SEMICOLON_COMMENTS
+                report_gcode_comment(p + 1);
+#endif
+                lx->in = p + strlen(p);
+                lx->paren = NULL;
+                return '\0';
+            case '%':
+            case '\r':
+                break;
+            default:
+                if (!lx->paren)
+                    return toupper(c);
+        }
+    }
+    if (lx->paren) {
+        // Handle unterminated ( comments
+        report_gcode_comment(lx->paren);
+        lx->paren = NULL;
+    }
+    return '\0';
+}
+static inline char gc_next_char(gc_lexer_t* lx) {
+    // Fast path for the characters of the words themselves
+    char c = *lx->in;
+    if (!lx->paren && ((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '.' || c == '-')) {
+        lx->in++;
+        return c;
+    }
+    return gc_next_char_slow(lx);
+}
+
+// Splits a line into letter and value words in one pass, skipping whitespace and comments on
+// the way. Numbers are read as read_float() reads them, so the words and errors are the same
+// as for the collapsed line.
+uint8_t gc_tokenize_line(char* line, gc_word_t* words, uint8_t* word_count) {
+    gc_lexer_t lx = { line, NULL };
+    uint8_t status = STATUS_OK;
+    uint8_t count = 0;
+    char c = gc_next_char(&lx);
+    while (c != '\0') {
+        char letter = c;
+        bool isnegative = false;
+        c = gc_next_char(&lx);
+        if (c == '-' || c == '+') {
+            isnegative = (c == '-');
+            c = gc_next_char(&lx);
+        }
+        // Extract number into fast integer. Track decimal in terms of exponent value.
+        uint32_t intval = 0;
+        int8_t exp = 0;
+        uint8_t ndigit = 0;
+        bool isdecimal = false;
+        for (;; c = gc_next_char(&lx)) {
+            if (c >= '0' && c <= '9') {
+                ndigit++;
+                if (ndigit <= MAX_INT_DIGITS) {
+                    if (isdecimal)  exp--;
+                    intval = (((intval << 2) + intval) << 1) + (c - '0'); // intval*10 + c
+                } else {
+                    if (!(isdecimal))  exp++;    // Drop overflow digits
+                }
+            } else if (c == '.' && !isdecimal)
+                isdecimal = true;
+            else
+                break;
+        }
+        // After an error, the rest of the line is only read for its comments
+        if (status != STATUS_OK)
+            continue;
+        if ((letter < 'A') || (letter > 'Z'))
+            status = STATUS_EXPECTED_COMMAND_LETTER;    // [Expected word letter]
+        else if (!ndigit || count == GC_MAX_WORDS)
+            status = STATUS_BAD_NUMBER_FORMAT;    // [Expected word value]
+        else {
+            float fval = decimal_to_float(intval, exp);
+            words[count].letter = letter;
+            words[count++].value = isnegative ? -fval : fval;
+        }
+    }
+    *word_count = count;
+    return status;
+}
+
+#ifdef SD_COMPILE
+bool gc_line_is_motion_only(char* line) {
+    gc_word_t words[GC_MAX_WORDS];
+    uint8_t word_count;
+    if (gc_tokenize_line(line, words, &word_count) != STATUS_OK)
+        return false;
+    for (uint8_t i = 0; i < word_count; i++) {
+        switch (words[i].letter) {
+        case 'G':
+            if (words[i].value != 0 && words[i].value != 1 && words[i].value != 2 && words[i].value != 3)
+                return false;
+            break;
+        case 'X': case 'Y': case 'Z': case 'A': case 'B': case 'C':
+        case 'I': case 'J': case 'K': case 'R': case 'P': case 'F': case 'N':
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
 // Executes one line of NUL-terminated G-Code.
 // The line may contain whitespace and comments, which are first removed,
 // and lower case characters, which are converted to upper case.
@@ -123,12 +259,77 @@ void collapseGCode(char *line) {
 // exported to grbl's internal functions in terms of (mm, mm/min) and absolute machine
 // coordinates, respectively.
 uint8_t gc_execute_line(char* line, uint8_t client) {
-    // Step 0 - remove whitespace and comments and convert to upper case
+    TRACE_SCOPE(TRACE_PARSE, 0);
+#ifdef REPORT_ECHO_LINE_RECEIVED
+    // The echo shows the line without whitespace and comments. The words are taken from it below.
     collapseGCode(line);
+    report_echo_line_received(line, client);
+#endif
+    // Step 0 - split the line into words, skipping whitespace and comments.
+    // NOTE: `$J=` already parsed when passed to this function. The words start after it.
+    bool is_jog = (line[0] == '$');
+#ifdef OWORD_SUBROUTINES
+    uint8_t oword_status;
+    if (!is_jog && oword_take_line(line, client, &oword_status))
+        return oword_status;
+#endif
+    gc_word_t words[GC_MAX_WORDS];
+    uint8_t word_count;
+    char* text = is_jog ? line + 3 : line;
+    uint8_t token_status;
+#ifdef GCODE_EXPRESSIONS
+    if (expr_line_has_expressions(text)) {
+        uint8_t code[EXPR_LINE_CODE_SIZE];
+        uint16_t length;
+        token_status = expr_compile_line(text, code, sizeof(code), &length);
+        if (token_status == STATUS_OK)
+            token_status = expr_run_line(code, length, words, &word_count);
+    } else
+#endif
+        token_status = gc_tokenize_line(text, words, &word_count);
+    if (token_status != STATUS_OK) {
+        FAIL(token_status);
+    }
+    return gc_execute_words(words, word_count, is_jog, client);
+}
+
+#ifdef PROTOCOL_READ_AHEAD
+bool gc_tokenize_ahead(char* line, gc_tokens_t* tokens) {
+    if (strpbrk(line, "(;") != NULL)
+        return false;
+#ifdef GCODE_EXPRESSIONS
+    if (expr_line_has_expressions(line))
+        return false;
+#endif
+#ifdef OWORD_SUBROUTINES
+    if (strpbrk(line, "Oo") != NULL)
+        return false;
+#endif
+    tokens->status = gc_tokenize_line(line, tokens->words, &tokens->word_count);
+    return true;
+}
+
+// The line is only read for the echo and for a subroutine body being kept, as in gc_execute_line().
+uint8_t gc_execute_tokens(char* line, const gc_tokens_t* tokens, uint8_t client) {
+    TRACE_SCOPE(TRACE_PARSE, 0);
 #ifdef REPORT_ECHO_LINE_RECEIVED
+    collapseGCode(line);
     report_echo_line_received(line, client);
 #endif
+#ifdef OWORD_SUBROUTINES
+    uint8_t oword_status;
+    if (oword_take_line(line, client, &oword_status))
+        return oword_status;
+#endif
+    if (tokens->status != STATUS_OK) {
+        FAIL(tokens->status);
+    }
+    return gc_execute_words(tokens->words, tokens->word_count, false, client);
+}
+#endif
 
+// Executes one block of g-code words, from gc_execute_line() or a binary frame.
+uint8_t gc_execute_words(const gc_word_t* words, uint8_t word_count, bool is_jog, uint8_t client) {
     /* -------------------------------------------------------------------------------------
        STEP 1: Initialize parser block struct and copy current g-code state modes. The parser
        updates these modes and commands as the block line is parser and will only be used and
@@ -144,11 +345,11 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
     uint8_t axis_words = 0; // XYZ tracking
     uint8_t ijk_words = 0; // IJK tracking
     // Initialize command and value words and parser flags variables.
-    uint16_t command_words = 0; // Tracks G and M command words. Also used for modal group violations.
-    uint16_t value_words = 0; // Tracks value words.
+    uint32_t command_words = 0; // Tracks G and M command words. Also used for modal group violations.
+    uint32_t value_words = 0; // Tracks value words.
     uint8_t gc_parser_flags = GC_PARSER_NONE;
     // Determine if the line is a jogging motion or a normal g-code block.
-    if (line[0] == '$') { // NOTE: `$J=` already parsed when passed to this function.
+    if (is_jog) {
         // Set G1 and G94 enforced modes to ensure accurate error checks.
         gc_parser_flags |= GC_PARSER_JOG_MOTION;
         gc_block.modal.motion = MOTION_MODE_LINEAR;
@@ -163,25 +364,14 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
        perform initial error-checks for command word modal group violations, for any repeated
        words, and for negative values set for the value words F, N, P, T, and S. */
     uint8_t word_bit = 0; // Bit-value for assigning tracking variables
-    uint8_t char_counter;
     char letter;
     float value;
     uint8_t int_value = 0;
     uint16_t mantissa = 0;
-    if (gc_parser_flags & GC_PARSER_JOG_MOTION) {
-        char_counter = 3;    // Start parsing after `$J=`
-    } else
-        char_counter = 0;
-    while (line[char_counter] != 0) { // Loop until no more g-code words in line.
-        // Import the next g-code word, expecting a letter followed by a value. Otherwise, error out.
-        letter = line[char_counter];
-        if ((letter < 'A') || (letter > 'Z')) {
-            FAIL(STATUS_EXPECTED_COMMAND_LETTER);    // [Expected word letter]
-        }
-        char_counter++;
-        if (!read_float(line, &char_counter, &value)) {
-            FAIL(STATUS_BAD_NUMBER_FORMAT);    // [Expected word value]
-        }
+    for (uint8_t word_index = 0; word_index < word_count; word_index++) {
+        // Import the next g-code word, a letter followed by a value.
+        letter = words[word_index].letter;
+        value = words[word_index].value;
         // Convert values to smaller uint8 significand and mantissa values for parsing this word.
         // NOTE: Mantissa is multiplied by 100 to catch non-integer command values. This is more
         // accurate than the NIST gcode requirement of x10 when used for commands, but not quite
@@ -228,14 +418,19 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
             case 1:
             case 2:
             case 3:
+            case 5:
             case 38:
+            case 73:
+            case 81:
+            case 82:
+            case 83:
 #ifndef PROBE_PIN //only allow G38 "Probe" commands if a probe pin is defined.
                 if (int_value == 38) {
                     grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "No probe pin defined");
                     FAIL(STATUS_GCODE_UNSUPPORTED_COMMAND); // [Unsupported G command]
                 }
 #endif
-                // Check for G0/1/2/3/38 being called with G10/28/30/92 on same block.
+                // Check for G0/1/2/3/5/38/73/81-83 being called with G10/28/30/92 on same block.
                 // * G43.1 is also an axis command but is not explicitly defined this way.
                 if (axis_command) {
                     FAIL(STATUS_GCODE_AXIS_COMMAND_CONFLICT);    // [Axis word/command conflict]
@@ -251,6 +446,9 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
                     }
                     gc_block.modal.motion += (mantissa / 10) + 100;
                     mantissa = 0; // Set to zero to indicate valid non-integer G command.
+                } else if ((int_value == 5) && (mantissa == 10)) {
+                    gc_block.modal.motion = MOTION_MODE_QUADRATIC_SPLINE;
+                    mantissa = 0; // Set to zero to indicate valid non-integer G command.
                 }
                 break;
             case 17:
@@ -273,11 +471,20 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
                     // Otherwise, arc IJK incremental mode is default. G91.1 does nothing.
                 }
                 break;
+            case 98:
+            case 99:
+                word_bit = MODAL_GROUP_G10;
+                gc_block.modal.retract = int_value - 98;
+                break;
             case 93:
             case 94:
                 word_bit = MODAL_GROUP_G5;
                 gc_block.modal.feed_rate = 94 - int_value;
                 break;
+            case 95:
+                word_bit = MODAL_GROUP_G5;
+                gc_block.modal.feed_rate = FEED_RATE_MODE_UNITS_PER_REV;
+                break;
             case 20:
             case 21:
                 word_bit = MODAL_GROUP_G6;
@@ -303,6 +510,10 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
                     gc_block.modal.tool_length = TOOL_LENGTH_OFFSET_CANCEL;
                 else if (mantissa == 10)   // G43.1
                     gc_block.modal.tool_length = TOOL_LENGTH_OFFSET_ENABLE_DYNAMIC;
+#ifdef TOOL_TABLE
+                else if (mantissa == 0)   // G43
+                    gc_block.modal.tool_length = TOOL_LENGTH_OFFSET_ENABLE;
+#endif
                 else {
                     FAIL(STATUS_GCODE_UNSUPPORTED_COMMAND);    // [Unsupported G43.x command]
                 }
@@ -466,7 +677,16 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
                 word_bit = WORD_F;
                 gc_block.values.f = value;
                 break;
+#ifdef TOOL_TABLE
+            case 'H':
+                word_bit = WORD_H;
+                if (value > MAX_TOOL_NUMBER)
+                    FAIL(STATUS_GCODE_MAX_VALUE_EXCEEDED);
+                gc_block.values.h = int_value;
+                break;
+#else
             // case 'H': // Not supported
+#endif
             case 'I':
                 word_bit = WORD_I;
                 gc_block.values.ijk[X_AXIS] = value;
@@ -495,7 +715,10 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
                 gc_block.values.p = value;
                 break;
             // NOTE: For certain commands, P value must be an integer, but none of these commands are supported.
-            // case 'Q': // Not supported
+            case 'Q':
+                word_bit = WORD_Q;
+                gc_block.values.q = value;
+                break;
             case 'R':
                 word_bit = WORD_R;
                 gc_block.values.r = value;
@@ -533,9 +756,10 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
             if (bit_istrue(value_words, bit(word_bit))) {
                 FAIL(STATUS_GCODE_WORD_REPEATED);    // [Word repeated]
             }
-            // Check for invalid negative values for words F, N, P, T, and S.
-            // NOTE: Negative value check is done here simply for code-efficiency.
-            if (bit(word_bit) & (bit(WORD_F) | bit(WORD_N) | bit(WORD_P) | bit(WORD_T) | bit(WORD_S))) {
+            // Check for invalid negative values for words F, N, T, and S.
+            // NOTE: Negative value check is done here simply for code-efficiency. P is checked in STEP 3,
+            // since it may be negative for G5.
+            if (bit(word_bit) & (bit(WORD_F) | bit(WORD_N) | bit(WORD_T) | bit(WORD_S))) {
                 if (value < 0.0) {
                     FAIL(STATUS_NEGATIVE_VALUE);    // [Word value cannot be negative]
                 }
@@ -576,6 +800,12 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
             axis_command = AXIS_COMMAND_MOTION_MODE;    // Assign implicit motion-mode
         }
     }
+    // Check for a negative P value. Only a G5 spline offset may be negative.
+    if (bit_istrue(value_words, bit(WORD_P)) && (gc_block.values.p < 0.0)) {
+        if (!((axis_command == AXIS_COMMAND_MOTION_MODE) && (gc_block.modal.motion == MOTION_MODE_CUBIC_SPLINE))) {
+            FAIL(STATUS_NEGATIVE_VALUE);    // [Word value cannot be negative]
+        }
+    }
     // Check for valid line number N value.
     if (bit_istrue(value_words, bit(WORD_N))) {
         // Line number value cannot be less than zero (done) or greater than max line number.
@@ -620,16 +850,20 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
             // value in the block. If no F word is passed with a motion command that requires a feed rate, this will error
             // out in the motion modes error-checking. However, if no F word is passed with NO motion command that requires
             // a feed rate, we simply move on and the state feed rate value gets updated to zero and remains undefined.
-        } else { // = G94
+        } else { // = G94 or G95
             // - In units per mm mode: If F word passed, ensure value is in mm/min, otherwise push last state value.
-            if (gc_state.modal.feed_rate == FEED_RATE_MODE_UNITS_PER_MIN) { // Last state is also G94
+            // G95 is the same with mm per revolution. Switching between them leaves F undefined.
+            if (gc_state.modal.feed_rate == gc_block.modal.feed_rate) { // Last state is the same mode
                 if (bit_istrue(value_words, bit(WORD_F))) {
                     if (gc_block.modal.units == UNITS_MODE_INCHES)
                         gc_block.values.f *= MM_PER_INCH;
                 } else {
                     gc_block.values.f = gc_state.feed_rate; // Push last state feed rate
                 }
-            } // Else, switching to G94 from G93, so don't push last state feed rate. Its undefined or the passed F word value.
+            } else if (bit_istrue(value_words, bit(WORD_F))) {
+                if (gc_block.modal.units == UNITS_MODE_INCHES)
+                    gc_block.values.f *= MM_PER_INCH;
+            } // Else, switching to G94 from G93 or G95, so don't push last state feed rate. Its undefined or the passed F word value.
         }
     }
     // bit_false(value_words,bit(WORD_F)); // NOTE: Single-meaning value word. Set at end of error-checking.
@@ -694,16 +928,29 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
     // [G40 Errors]: G2/3 arc is programmed after a G40. The linear move after disabling is less than tool diameter.
     //   NOTE: Since cutter radius compensation is never enabled, these G40 errors don't apply. Grbl supports G40
     //   only for the purpose to not error when G40 is sent with a g-code program header to setup the default modes.
-    // [14. Cutter length compensation ]: G43 NOT SUPPORTED, but G43.1 and G49 are.
+    // [14. Cutter length compensation ]: G43.1 and G49 are supported, and G43 with TOOL_TABLE.
     // [G43.1 Errors]: Motion command in same line.
     //   NOTE: Although not explicitly stated so, G43.1 should be applied to only one valid
     //   axis that is configured (in config.h). There should be an error if the configured axis
     //   is absent or if any of the other axis words are present.
+    // [G43 Errors]: Axis words. H, or the tool of the last T word without H, not in the table.
     if (axis_command == AXIS_COMMAND_TOOL_LENGTH_OFFSET) {  // Indicates called in block.
         if (gc_block.modal.tool_length == TOOL_LENGTH_OFFSET_ENABLE_DYNAMIC) {
             if (axis_words ^ bit(TOOL_LENGTH_OFFSET_AXIS))
                 FAIL(STATUS_GCODE_G43_DYNAMIC_AXIS_ERROR);
         }
+#ifdef TOOL_TABLE
+        if (gc_block.modal.tool_length == TOOL_LENGTH_OFFSET_ENABLE) {
+            if (axis_words)
+                FAIL(STATUS_GCODE_AXIS_WORDS_EXIST);
+            tool_entry_t entry;
+            if (!tool_table_get(bit_istrue(value_words, bit(WORD_H)) ? gc_block.values.h : gc_state.tool, &entry))
+                FAIL(STATUS_GCODE_MAX_VALUE_EXCEEDED);
+            // Taken like the axis word of G43.1
+            gc_block.values.xyz[TOOL_LENGTH_OFFSET_AXIS] = entry.length;
+            bit_false(value_words, bit(WORD_H));
+        }
+#endif
     }
     // [15. Coordinate system selection ]: *N/A. Error, if cutter radius comp is active.
     // TODO: An EEPROM read of the coordinate data may require a buffer sync when the cycle
@@ -723,7 +970,7 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
     }
     // [16. Set path control mode ]: N/A. Only G61. G61.1 and G64 NOT SUPPORTED.
     // [17. Set distance mode ]: N/A. Only G91.1. G90.1 NOT SUPPORTED.
-    // [18. Set retract mode ]: NOT SUPPORTED.
+    // [18. Set retract mode ]: N/A. G98/G99 only apply to the canned cycles.
     // [19. Remaining non-modal actions ]: Check go to predefined position, set G10, or set axis offsets.
     // NOTE: We need to separate the non-modal commands that are axis word-using (G10/G28/G30/G92), as these
     // commands all treat axis words differently. G10 as absolute offsets or computes current position as
@@ -734,6 +981,33 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
         // [G10 Errors]: L missing and is not 2 or 20. P word missing. (Negative P value done.)
         // [G10 L2 Errors]: R word NOT SUPPORTED. P value not 0 to nCoordSys(max 9). Axis words missing.
         // [G10 L20 Errors]: P must be 0 to nCoordSys(max 9). Axis words missing.
+#ifdef TOOL_TABLE
+        // [G10 L1 Errors]: P word missing, or P not a tool of the table. Axis words other than the
+        //   tool length offset axis. The length and radius R are kept when absent.
+        if (gc_block.values.l == 1) {
+            if (bit_isfalse(value_words, bit(WORD_P)))
+                FAIL(STATUS_GCODE_VALUE_WORD_MISSING);
+            if (axis_words & ~bit(TOOL_LENGTH_OFFSET_AXIS))
+                FAIL(STATUS_GCODE_AXIS_WORDS_EXIST);
+            if (gc_block.values.p < 0 || gc_block.values.p >= TOOL_TABLE_SIZE)
+                FAIL(STATUS_GCODE_MAX_VALUE_EXCEEDED);
+            coord_select = trunc(gc_block.values.p); // The tool
+            tool_entry_t entry;
+            tool_table_get(coord_select, &entry);
+            if (axis_words)
+                entry.length = gc_block.values.xyz[TOOL_LENGTH_OFFSET_AXIS];
+            if (bit_istrue(value_words, bit(WORD_R))) {
+                entry.diameter = 2 * gc_block.values.r;
+                if (gc_block.modal.units == UNITS_MODE_INCHES)
+                    entry.diameter *= MM_PER_INCH;
+            }
+            // NOTE: Stored in IJK values, as for L2 and L20
+            gc_block.values.ijk[0] = entry.length;
+            gc_block.values.ijk[1] = entry.diameter;
+            bit_false(value_words, (bit(WORD_L) | bit(WORD_P) | bit(WORD_R)));
+            break;
+        }
+#endif
         if (!axis_words) {
             FAIL(STATUS_GCODE_NO_AXIS_WORDS)
         }; // [No axis words]
@@ -867,6 +1141,7 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
         }
     }
     // [20. Motion modes ]:
+    canned_cycle_t cycle;
     if (gc_block.modal.motion == MOTION_MODE_NONE) {
         // [G80 Errors]: Axis word are programmed while G80 is active.
         // NOTE: Even non-modal commands or TLO that use axis words will throw this strict error.
@@ -888,6 +1163,11 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
             if (gc_block.values.f == 0.0) {
                 FAIL(STATUS_GCODE_UNDEFINED_FEED_RATE);    // [Feed rate undefined]
             }
+            // A feed per revolution needs a turning spindle
+            if (gc_block.modal.feed_rate == FEED_RATE_MODE_UNITS_PER_REV &&
+                    (gc_block.modal.spindle == SPINDLE_DISABLE || gc_block.values.s == 0.0)) {
+                FAIL(STATUS_GCODE_UNDEFINED_FEED_RATE);
+            }
             switch (gc_block.modal.motion) {
             case MOTION_MODE_LINEAR:
                 // [G1 Errors]: Feed rate undefined. Axis letter not configured or without real value.
@@ -1036,6 +1316,144 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
                     }
                 }
                 break;
+            case MOTION_MODE_CUBIC_SPLINE:
+            case MOTION_MODE_QUADRATIC_SPLINE:
+                // [G5/G5.1 Errors]: Feed rate undefined. Plane is not G17. No axis words in plane.
+                // [G5 Errors]: P or Q missing. I and J both missing, when the last motion mode was not G5.
+                // [G5.1 Errors]: I and J both missing. P or Q exist (unused words).
+                // NOTE: I,J is the offset from the current position to the first control point and P,Q the offset
+                //   from the target to the second one. G5.1 has a single control point, given by I,J. A G5 without
+                //   I,J continues the last G5 smoothly, with its control point mirrored around the current position.
+                if (gc_block.modal.plane_select != PLANE_SELECT_XY) {
+                    FAIL(STATUS_GCODE_UNSUPPORTED_COMMAND);    // [G5 only in the XY plane]
+                }
+                if (!(axis_words & (bit(X_AXIS) | bit(Y_AXIS)))) {
+                    FAIL(STATUS_GCODE_NO_AXIS_WORDS_IN_PLANE);    // [No axis words in plane]
+                }
+                if (gc_block.modal.units == UNITS_MODE_INCHES) {
+                    gc_block.values.ijk[X_AXIS] *= MM_PER_INCH;
+                    gc_block.values.ijk[Y_AXIS] *= MM_PER_INCH;
+                    gc_block.values.p *= MM_PER_INCH;
+                    gc_block.values.q *= MM_PER_INCH;
+                }
+                if (gc_block.modal.motion == MOTION_MODE_CUBIC_SPLINE) {
+                    if (bit_isfalse(value_words, bit(WORD_P)) || bit_isfalse(value_words, bit(WORD_Q))) {
+                        FAIL(STATUS_GCODE_VALUE_WORD_MISSING);    // [P/Q word missing]
+                    }
+                    bit_false(value_words, (bit(WORD_P) | bit(WORD_Q)));
+                    if (!(ijk_words & (bit(X_AXIS) | bit(Y_AXIS)))) {
+                        if (gc_state.modal.motion != MOTION_MODE_CUBIC_SPLINE) {
+                            FAIL(STATUS_GCODE_VALUE_WORD_MISSING);    // [I/J word missing]
+                        }
+                        gc_block.values.ijk[X_AXIS] = -gc_state.spline_pq[0];
+                        gc_block.values.ijk[Y_AXIS] = -gc_state.spline_pq[1];
+                    }
+                } else if (!(ijk_words & (bit(X_AXIS) | bit(Y_AXIS)))) {
+                    FAIL(STATUS_GCODE_VALUE_WORD_MISSING);    // [I/J word missing]
+                }
+                bit_false(value_words, (bit(WORD_I) | bit(WORD_J)));
+                break;
+            case MOTION_MODE_DRILL_CHIP_BREAK:
+            case MOTION_MODE_DRILL:
+            case MOTION_MODE_DRILL_DWELL:
+            case MOTION_MODE_DRILL_PECK: {
+                // [G73/G81-G83 Errors]: Feed rate undefined. Inverse time feed rate mode. Axis words
+                //   other than those of the plane and the drilling axis. R or Z missing, when the last
+                //   motion mode was not a canned cycle. L is not a positive integer. Z is not below R.
+                // [G82 Errors]: Likewise P missing. [G73/G83 Errors]: Likewise Q missing. Q is not positive.
+                // NOTE: The drilling axis is normal to the plane. Z is its word in G17, Y in G18, X in G19.
+                //   R, Z, P and Q carry over to the next canned cycles of the motion mode. In G91, R is
+                //   from the start and Z from R, and the holes repeated by L are spaced by the increments.
+                if (gc_block.modal.feed_rate == FEED_RATE_MODE_INVERSE_TIME) {
+                    FAIL(STATUS_GCODE_UNSUPPORTED_COMMAND);    // [Canned cycles not in G93]
+                }
+                if (axis_words & ~(bit(axis_0) | bit(axis_1) | bit(axis_linear))) {
+                    FAIL(STATUS_GCODE_UNUSED_WORDS);    // [Axis words off the plane and drilling axis]
+                }
+                bool continued = gc_motion_is_canned_cycle(gc_state.modal.motion);
+                float start = gc_state.position[axis_linear];
+                // The offsets of the drilling axis, to get back to the programmed Z
+                float offset = block_coord_system[axis_linear] + gc_state.coord_offset[axis_linear];
+                if (axis_linear == TOOL_LENGTH_OFFSET_AXIS)
+                    offset += gc_state.tool_length_offset;
+                if (gc_block.modal.distance == DISTANCE_MODE_INCREMENTAL)
+                    offset = start;
+                float z = gc_state.cycle_z;
+                if (bit_istrue(axis_words, bit(axis_linear)))
+                    z = gc_block.values.xyz[axis_linear] - offset;
+                else if (!continued) {
+                    FAIL(STATUS_GCODE_VALUE_WORD_MISSING);    // [Z word missing]
+                }
+                float r = gc_state.cycle_r;
+                if (bit_istrue(value_words, bit(WORD_R))) {
+                    r = gc_block.values.r;
+                    if (gc_block.modal.units == UNITS_MODE_INCHES)
+                        r *= MM_PER_INCH;
+                } else if (!continued) {
+                    FAIL(STATUS_GCODE_VALUE_WORD_MISSING);    // [R word missing]
+                }
+                float q = gc_state.cycle_q;
+                if (bit_istrue(value_words, bit(WORD_Q))) {
+                    q = gc_block.values.q;
+                    if (gc_block.modal.units == UNITS_MODE_INCHES)
+                        q *= MM_PER_INCH;
+                } else if ((gc_block.modal.motion == MOTION_MODE_DRILL_PECK) || (gc_block.modal.motion == MOTION_MODE_DRILL_CHIP_BREAK)) {
+                    if (gc_state.modal.motion != gc_block.modal.motion) {
+                        FAIL(STATUS_GCODE_VALUE_WORD_MISSING);    // [Q word missing]
+                    }
+                }
+                float p = gc_state.cycle_p;
+                if (bit_istrue(value_words, bit(WORD_P)))
+                    p = gc_block.values.p;
+                else if ((gc_block.modal.motion == MOTION_MODE_DRILL_DWELL) && (gc_state.modal.motion != MOTION_MODE_DRILL_DWELL)) {
+                    FAIL(STATUS_GCODE_VALUE_WORD_MISSING);    // [P word missing]
+                }
+                cycle.repeats = 1;
+                if (bit_istrue(value_words, bit(WORD_L))) {
+                    if (gc_block.values.l < 1) {
+                        FAIL(STATUS_NEGATIVE_VALUE);    // [L not positive]
+                    }
+                    cycle.repeats = gc_block.values.l;
+                }
+                bit_false(value_words, (bit(WORD_R) | bit(WORD_Q) | bit(WORD_P) | bit(WORD_L)));
+                if (((gc_block.modal.motion == MOTION_MODE_DRILL_PECK) || (gc_block.modal.motion == MOTION_MODE_DRILL_CHIP_BREAK)) && (q <= 0.0)) {
+                    FAIL(STATUS_NEGATIVE_VALUE);    // [Q not positive]
+                }
+                cycle.motion = gc_block.modal.motion;
+                cycle.axis = axis_linear;
+                cycle.axis_0 = axis_0;
+                cycle.axis_1 = axis_1;
+                cycle.r = offset + r;
+                cycle.depth = (gc_block.modal.distance == DISTANCE_MODE_INCREMENTAL) ? cycle.r + z : offset + z;
+                if (cycle.depth >= cycle.r) {
+                    FAIL(STATUS_GCODE_INVALID_TARGET);    // [Z not below R]
+                }
+                cycle.clear = ((gc_block.modal.retract == RETRACT_MODE_OLD_Z) && (start > cycle.r)) ? start : cycle.r;
+                cycle.peck = q;
+                cycle.dwell = p;
+                // The first hole. Other axes keep their position.
+                for (idx = 0; idx < N_AXIS; idx++) {
+                    if (bit_isfalse(axis_words, bit(idx)))
+                        gc_block.values.xyz[idx] = gc_state.position[idx];
+                }
+                cycle.hole[0] = gc_block.values.xyz[axis_0];
+                cycle.hole[1] = gc_block.values.xyz[axis_1];
+                cycle.step[0] = 0.0;
+                cycle.step[1] = 0.0;
+                if (gc_block.modal.distance == DISTANCE_MODE_INCREMENTAL) {
+                    cycle.step[0] = cycle.hole[0] - gc_state.position[axis_0];
+                    cycle.step[1] = cycle.hole[1] - gc_state.position[axis_1];
+                }
+                // The parser position after the cycle, above the last hole
+                gc_block.values.xyz[axis_0] = cycle.hole[0] + (cycle.repeats - 1) * cycle.step[0];
+                gc_block.values.xyz[axis_1] = cycle.hole[1] + (cycle.repeats - 1) * cycle.step[1];
+                gc_block.values.xyz[axis_linear] = cycle.clear;
+                gc_block.values.r = r;
+                gc_block.values.q = q;
+                gc_block.values.p = p;
+                gc_block.values.ijk[axis_linear] = z; // NOTE: Free, as canned cycles take no IJK.
+                break;
+            }
             case MOTION_MODE_PROBE_TOWARD_NO_ERROR:
             case MOTION_MODE_PROBE_AWAY_NO_ERROR:
                 gc_parser_flags |= GC_PARSER_PROBE_IS_NO_ERROR; // No break intentional.
@@ -1078,6 +1496,9 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
        Assumes that all error-checking has been completed and no failure modes exist. We just
        need to update the state and execute the block according to the order-of-execution.
     */
+#ifdef LINE_TRACE
+    line_trace_parsed();
+#endif
     // Initialize planner data struct for motion blocks.
     plan_line_data_t plan_data;
     plan_line_data_t* pl_data = &plan_data;
@@ -1105,7 +1526,8 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
     // If in laser mode, setup laser power based on current and past parser conditions.
     if (laser_mode->get()) {
         if (!((gc_block.modal.motion == MOTION_MODE_LINEAR) || (gc_block.modal.motion == MOTION_MODE_CW_ARC)
-                || (gc_block.modal.motion == MOTION_MODE_CCW_ARC)))
+                || (gc_block.modal.motion == MOTION_MODE_CCW_ARC) || (gc_block.modal.motion == MOTION_MODE_CUBIC_SPLINE)
+                || (gc_block.modal.motion == MOTION_MODE_QUADRATIC_SPLINE)))
             gc_parser_flags |= GC_PARSER_LASER_DISABLE;
         // Any motion mode with axis words is allowed to be passed from a spindle speed update.
         // NOTE: G1 and G0 without axis words sets axis_command to none. G28/30 are intentionally omitted.
@@ -1117,7 +1539,8 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
             // a G1/2/3 motion mode state and vice versa when there is no motion in the line.
             if (gc_state.modal.spindle == SPINDLE_ENABLE_CW) {
                 if ((gc_state.modal.motion == MOTION_MODE_LINEAR) || (gc_state.modal.motion == MOTION_MODE_CW_ARC)
-                        || (gc_state.modal.motion == MOTION_MODE_CCW_ARC)) {
+                        || (gc_state.modal.motion == MOTION_MODE_CCW_ARC) || (gc_state.modal.motion == MOTION_MODE_CUBIC_SPLINE)
+                        || (gc_state.modal.motion == MOTION_MODE_QUADRATIC_SPLINE)) {
                     if (bit_istrue(gc_parser_flags, GC_PARSER_LASER_DISABLE)) {
                         gc_parser_flags |= GC_PARSER_LASER_FORCE_SYNC; // Change from G1/2/3 motion mode.
                     }
@@ -1138,9 +1561,10 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
     // [1. Comments feedback ]:  NOT SUPPORTED
     // [2. Set feed rate mode ]:
     gc_state.modal.feed_rate = gc_block.modal.feed_rate;
-    if (gc_state.modal.feed_rate) {
+    if (gc_state.modal.feed_rate == FEED_RATE_MODE_INVERSE_TIME) {
         pl_data->condition |= PL_COND_FLAG_INVERSE_TIME;    // Set condition flag for planner use.
-    }
+    } else if (gc_state.modal.feed_rate == FEED_RATE_MODE_UNITS_PER_REV)
+        pl_data->feed_per_rev = true;
     // [3. Set feed rate ]:
     gc_state.feed_rate = gc_block.values.f; // Always copy this value. See feed rate error-checking.
     pl_data->feed_rate = gc_state.feed_rate; // Record data for planner use.
@@ -1164,16 +1588,29 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
     //	gc_state.tool = gc_block.values.t;
     // [6. Change tool ]: NOT SUPPORTED
     if (gc_block.modal.tool_change == TOOL_CHANGE) {
-#ifdef USE_TOOL_CHANGE
+#ifdef SPINDLE2_TYPE
+        if (spindle_select_tool(gc_state.tool))
+            gc_state.modal.spindle = SPINDLE_DISABLE; // An M3 or M4 in this block starts the new one
+#endif
+#ifdef TOOL_CHANGE_SEQUENCE
+        tool_change_run(gc_state.tool); // Calls user_tool_change() with USE_TOOL_CHANGE
+#elif defined(USE_TOOL_CHANGE)
         user_tool_change(gc_state.tool);
 #endif
     }
     // [7. Spindle control ]:
     if (gc_state.modal.spindle != gc_block.modal.spindle) {
         // Update spindle control and apply spindle speed when enabling it in this block.
-        // NOTE: All spindle state changes are synced, even in laser mode. Also, pl_data,
-        // rather than gc_state, is used to manage laser state for non-laser motions.
-        spindle->spindle_sync(gc_block.modal.spindle, (uint32_t)pl_data->spindle_speed);
+        // NOTE: pl_data, rather than gc_state, is used to manage laser state for non-laser motions.
+        // In laser mode, M5 and an M3/M4 whose power comes with a motion, or is zero anyway, are
+        // carried by the planner blocks and not synced. See Spindle::laser_toggle(). An M3 that
+        // burns at the current position, in G1 mode without axis words, is still synced.
+        bool laser_toggled = false;
+        if (laser_mode->get() && ((gc_block.modal.spindle == SPINDLE_DISABLE) ||
+                                  bit_istrue(gc_parser_flags, (GC_PARSER_LASER_ISMOTION | GC_PARSER_LASER_DISABLE))))
+            laser_toggled = spindle->laser_toggle(gc_block.modal.spindle);
+        if (!laser_toggled)
+            spindle->spindle_sync(gc_block.modal.spindle, (uint32_t)pl_data->spindle_speed);
         gc_state.modal.spindle = gc_block.modal.spindle;
     }
     pl_data->condition |= gc_state.modal.spindle; // Set condition flag for planner use.
@@ -1211,15 +1648,14 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
     gc_state.modal.units = gc_block.modal.units;
     // [13. Cutter radius compensation ]: G41/42 NOT SUPPORTED
     // gc_state.modal.cutter_comp = gc_block.modal.cutter_comp; // NOTE: Not needed since always disabled.
-    // [14. Cutter length compensation ]: G43.1 and G49 supported. G43 NOT SUPPORTED.
-    // NOTE: If G43 were supported, its operation wouldn't be any different from G43.1 in terms
-    // of execution. The error-checking step would simply load the offset value into the correct
-    // axis of the block XYZ value array.
+    // [14. Cutter length compensation ]: G43.1 and G49 supported, and G43 with TOOL_TABLE.
+    // NOTE: G43 runs as G43.1. The error-checking step loaded the length from the tool table into
+    // the correct axis of the block XYZ value array.
     if (axis_command == AXIS_COMMAND_TOOL_LENGTH_OFFSET) {  // Indicates a change.
         gc_state.modal.tool_length = gc_block.modal.tool_length;
         if (gc_state.modal.tool_length == TOOL_LENGTH_OFFSET_CANCEL)   // G49
             gc_block.values.xyz[TOOL_LENGTH_OFFSET_AXIS] = 0.0;
-        // else G43.1
+        // else G43.1 or G43
         if (gc_state.tool_length_offset != gc_block.values.xyz[TOOL_LENGTH_OFFSET_AXIS]) {
             gc_state.tool_length_offset = gc_block.values.xyz[TOOL_LENGTH_OFFSET_AXIS];
             system_flag_wco_change();
@@ -1235,10 +1671,18 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
     // gc_state.modal.control = gc_block.modal.control; // NOTE: Always default.
     // [17. Set distance mode ]:
     gc_state.modal.distance = gc_block.modal.distance;
-    // [18. Set retract mode ]: NOT SUPPORTED
+    // [18. Set retract mode ]:
+    gc_state.modal.retract = gc_block.modal.retract;
     // [19. Go to predefined position, Set G10, or Set axis offsets ]:
     switch (gc_block.non_modal_command) {
     case NON_MODAL_SET_COORDINATE_DATA:
+#ifdef TOOL_TABLE
+        if (gc_block.values.l == 1) {
+            tool_entry_t entry = { gc_block.values.ijk[0], gc_block.values.ijk[1] };
+            tool_table_set(coord_select, &entry);
+            break;
+        }
+#endif
         settings_write_coord_data(coord_select, gc_block.values.ijk);
         // Update system coordinate system if currently active.
         if (gc_state.modal.coord_select == coord_select) {
@@ -1280,8 +1724,15 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
         if (axis_command == AXIS_COMMAND_MOTION_MODE) {
             uint8_t gc_update_pos = GC_UPDATE_POS_TARGET;
             if (gc_state.modal.motion == MOTION_MODE_LINEAR) {
+#ifdef LASER_RASTER
+                // In laser mode, the pixels staged by $R= are spread over this motion.
+                pl_data->raster = spindle->isRateAdjusted() && (raster_staged_pixels() != 0);
+#endif
                 //mc_line(gc_block.values.xyz, pl_data);
                 mc_line_kins(gc_block.values.xyz, pl_data, gc_state.position);
+#ifdef LASER_RASTER
+                raster_clear_staged(); // Not planned in check mode or off laser mode
+#endif
             } else if (gc_state.modal.motion == MOTION_MODE_SEEK) {
                 pl_data->condition |= PL_COND_FLAG_RAPID_MOTION; // Set rapid motion condition flag.
                 //mc_line(gc_block.values.xyz, pl_data);
@@ -1289,6 +1740,34 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
             } else if ((gc_state.modal.motion == MOTION_MODE_CW_ARC) || (gc_state.modal.motion == MOTION_MODE_CCW_ARC)) {
                 mc_arc(gc_block.values.xyz, pl_data, gc_state.position, gc_block.values.ijk, gc_block.values.r,
                        axis_0, axis_1, axis_linear, bit_istrue(gc_parser_flags, GC_PARSER_ARC_IS_CLOCKWISE));
+            } else if ((gc_state.modal.motion == MOTION_MODE_CUBIC_SPLINE) || (gc_state.modal.motion == MOTION_MODE_QUADRATIC_SPLINE)) {
+                float control_1[2], control_2[2];
+                if (gc_state.modal.motion == MOTION_MODE_CUBIC_SPLINE) {
+                    control_1[0] = gc_state.position[X_AXIS] + gc_block.values.ijk[X_AXIS];
+                    control_1[1] = gc_state.position[Y_AXIS] + gc_block.values.ijk[Y_AXIS];
+                    control_2[0] = gc_block.values.xyz[X_AXIS] + gc_block.values.p;
+                    control_2[1] = gc_block.values.xyz[Y_AXIS] + gc_block.values.q;
+                    gc_state.spline_pq[0] = gc_block.values.p;
+                    gc_state.spline_pq[1] = gc_block.values.q;
+                } else {
+                    // Raise the quadratic to a cubic. Its control points lie 2/3 of the way from each end
+                    // point to the quadratic control point.
+                    float control_x = gc_state.position[X_AXIS] + gc_block.values.ijk[X_AXIS];
+                    float control_y = gc_state.position[Y_AXIS] + gc_block.values.ijk[Y_AXIS];
+                    control_1[0] = gc_state.position[X_AXIS] + (2.0 / 3.0) * gc_block.values.ijk[X_AXIS];
+                    control_1[1] = gc_state.position[Y_AXIS] + (2.0 / 3.0) * gc_block.values.ijk[Y_AXIS];
+                    control_2[0] = gc_block.values.xyz[X_AXIS] + (2.0 / 3.0) * (control_x - gc_block.values.xyz[X_AXIS]);
+                    control_2[1] = gc_block.values.xyz[Y_AXIS] + (2.0 / 3.0) * (control_y - gc_block.values.xyz[Y_AXIS]);
+                }
+                mc_spline(gc_block.values.xyz, pl_data, gc_state.position, control_1, control_2);
+            } else if (gc_motion_is_canned_cycle(gc_state.modal.motion)) {
+                gc_state.cycle_r = gc_block.values.r;
+                gc_state.cycle_z = gc_block.values.ijk[axis_linear];
+                gc_state.cycle_q = gc_block.values.q;
+                gc_state.cycle_p = gc_block.values.p;
+                float position[N_AXIS];
+                memcpy(position, gc_state.position, sizeof(position));
+                mc_canned_cycle(&cycle, pl_data, position);
             } else {
                 // NOTE: gc_block.values.xyz is returned from mc_probe_cycle with the updated position value. So
                 // upon a successful probing cycle, the machine position and the returned value should be the same.
@@ -1353,6 +1832,9 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
                 coolant_set_state(COOLANT_DISABLE);
             }
             report_feedback_message(MESSAGE_PROGRAM_END);
+#ifdef OWORD_SUBROUTINES
+            oword_reset();
+#endif
 #ifdef USE_M30
             user_m30();
 #endif
@@ -1367,7 +1849,7 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
 /*
   Not supported:
 
-  - Canned cycles
+  - Canned cycles other than G73 and G81-G83
   - Tool radius compensation
   - A,B,C-axes
   - Evaluation of expressions
@@ -1378,13 +1860,12 @@ uint8_t gc_execute_line(char* line, uint8_t client) {
 
    (*) Indicates optional parameter, enabled through config.h and re-compile
    group 0 = {G92.2, G92.3} (Non modal: Cancel and re-enable G92 offsets)
-   group 1 = {G81 - G89} (Motion modes: Canned cycles)
+   group 1 = {G76, G84 - G89} (Motion modes: Canned cycles)
    group 4 = {M1} (Optional stop, ignored)
    group 6 = {M6} (Tool change)
    group 7 = {G41, G42} cutter radius compensation (G40 is supported)
-   group 8 = {G43} tool length offset (G43.1/G49 are supported)
+   group 8 = {G43} tool length offset (G43.1/G49 are supported, and G43 Hn with TOOL_TABLE)
    group 8 = {M7*} enable mist coolant (* Compile-option)
    group 9 = {M48, M49} enable/disable feed and speed override switches
-   group 10 = {G98, G99} return mode canned cycles
    group 13 = {G61.1, G64} path control mode (G61 is supported)
 */
@@ -32,11 +32,11 @@
 // and are similar/identical to other g-code interpreters by manufacturers (Haas,Fanuc,Mazak,etc).
 // NOTE: Modal group define values must be sequential and starting from zero.
 #define MODAL_GROUP_G0 0 // [G4,G10,G28,G28.1,G30,G30.1,G53,G92,G92.1] Non-modal
-#define MODAL_GROUP_G1 1 // [G0,G1,G2,G3,G38.2,G38.3,G38.4,G38.5,G80] Motion
+#define MODAL_GROUP_G1 1 // [G0,G1,G2,G3,G38.2,G38.3,G38.4,G38.5,G73,G80,G81,G82,G83] Motion
 #define MODAL_GROUP_G2 2 // [G17,G18,G19] Plane selection
 #define MODAL_GROUP_G3 3 // [G90,G91] Distance mode
 #define MODAL_GROUP_G4 4 // [G91.1] Arc IJK distance mode
-#define MODAL_GROUP_G5 5 // [G93,G94] Feed rate mode
+#define MODAL_GROUP_G5 5 // [G93,G94,G95] Feed rate mode
 #define MODAL_GROUP_G6 6 // [G20,G21] Units
 #define MODAL_GROUP_G7 7 // [G40] Cutter radius compensation mode. G41/42 NOT SUPPORTED.
 #define MODAL_GROUP_G8 8 // [G43.1,G49] Tool length offset
@@ -49,6 +49,7 @@
 #define MODAL_GROUP_M8 13 // [M7,M8,M9] Coolant control
 #define MODAL_GROUP_M9 14 // [M56] Override control
 #define MODAL_GROUP_M10 15 // [M62, M63] User Defined http://linuxcnc.org/docs/html/gcode/overview.html#_modal_groups
+#define MODAL_GROUP_G10 16 // [G98,G99] Return mode in canned cycles
 
 // #define OTHER_INPUT_F 14
 // #define OTHER_INPUT_S 15
@@ -78,11 +79,17 @@
 #define MOTION_MODE_LINEAR 1 // G1 (Do not alter value)
 #define MOTION_MODE_CW_ARC 2  // G2 (Do not alter value)
 #define MOTION_MODE_CCW_ARC 3  // G3 (Do not alter value)
+#define MOTION_MODE_CUBIC_SPLINE 5 // G5 (Do not alter value)
+#define MOTION_MODE_QUADRATIC_SPLINE 51 // G5.1
 #define MOTION_MODE_PROBE_TOWARD 140 // G38.2 (Do not alter value)
 #define MOTION_MODE_PROBE_TOWARD_NO_ERROR 141 // G38.3 (Do not alter value)
 #define MOTION_MODE_PROBE_AWAY 142 // G38.4 (Do not alter value)
 #define MOTION_MODE_PROBE_AWAY_NO_ERROR 143 // G38.5 (Do not alter value)
 #define MOTION_MODE_NONE 80 // G80 (Do not alter value)
+#define MOTION_MODE_DRILL_CHIP_BREAK 73 // G73 (Do not alter value)
+#define MOTION_MODE_DRILL 81 // G81 (Do not alter value)
+#define MOTION_MODE_DRILL_DWELL 82 // G82 (Do not alter value)
+#define MOTION_MODE_DRILL_PECK 83 // G83 (Do not alter value)
 
 // Modal Group G2: Plane select
 #define PLANE_SELECT_XY 0 // G17 (Default: Must be zero)
@@ -96,6 +103,10 @@
 // Modal Group G4: Arc IJK distance mode
 #define DISTANCE_ARC_MODE_INCREMENTAL 0 // G91.1 (Default: Must be zero)
 
+// Modal Group G10: Return mode in canned cycles
+#define RETRACT_MODE_OLD_Z 0 // G98 (Default: Must be zero)
+#define RETRACT_MODE_R 1 // G99 (Do not alter value)
+
 // Modal Group M4: Program flow
 #define PROGRAM_FLOW_RUNNING 0 // (Default: Must be zero)
 #define PROGRAM_FLOW_PAUSED 3 // M0
@@ -106,6 +117,7 @@
 // Modal Group G5: Feed rate mode
 #define FEED_RATE_MODE_UNITS_PER_MIN  0 // G94 (Default: Must be zero)
 #define FEED_RATE_MODE_INVERSE_TIME   1 // G93 (Do not alter value)
+#define FEED_RATE_MODE_UNITS_PER_REV  2 // G95
 
 // Modal Group G6: Units mode
 #define UNITS_MODE_MM 0 // G21 (Default: Must be zero)
@@ -144,6 +156,7 @@
 // Modal Group G8: Tool length offset
 #define TOOL_LENGTH_OFFSET_CANCEL 0 // G49 (Default: Must be zero)
 #define TOOL_LENGTH_OFFSET_ENABLE_DYNAMIC 1 // G43.1
+#define TOOL_LENGTH_OFFSET_ENABLE 2 // G43, from the tool table
 
 #define TOOL_CHANGE 1
 
@@ -167,6 +180,8 @@
 #define WORD_A  13
 #define WORD_B  14
 #define WORD_C  15
+#define WORD_Q  16
+#define WORD_H  17
 
 // Define g-code parser position updating flags
 #define GC_UPDATE_POS_TARGET   0 // Must be zero
@@ -198,7 +213,7 @@
 
 // NOTE: When this struct is zeroed, the above defines set the defaults for the system.
 typedef struct {
-    uint8_t motion;          // {G0,G1,G2,G3,G38.2,G80}
+    uint8_t motion;          // {G0,G1,G2,G3,G5,G5.1,G38.2,G73,G80,G81,G82,G83}
     uint8_t feed_rate;       // {G93,G94}
     uint8_t units;           // {G20,G21}
     uint8_t distance;        // {G90,G91}
@@ -208,6 +223,7 @@ typedef struct {
     uint8_t tool_length;     // {G43.1,G49}
     uint8_t coord_select;    // {G54,G55,G56,G57,G58,G59}
     // uint8_t control;      // {G61} NOTE: Don't track. Only default supported.
+    uint8_t retract;         // {G98,G99}
     uint8_t program_flow;    // {M0,M1,M2,M30}
     uint8_t coolant;         // {M7,M8,M9}
     uint8_t spindle;         // {M3,M4,M5}
@@ -218,11 +234,12 @@ typedef struct {
 
 typedef struct {
     float f;         // Feed
+    uint8_t h;       // G43 tool table entry
     float ijk[N_AXIS];    // I,J,K Axis arc offsets
     uint8_t l;       // G10 or canned cycles parameters
     int32_t n;       // Line number
-    float p;         // G10 or dwell parameters
-    // float q;      // G82 peck drilling
+    float p;         // G10, dwell or G5 spline parameters
+    float q;         // G5 spline parameters
     float r;         // Arc radius
     float s;         // Spindle speed
     uint8_t t;       // Tool selection
@@ -245,6 +262,12 @@ typedef struct {
     float coord_offset[N_AXIS];    // Retains the G92 coordinate offset (work coordinates) relative to
     // machine zero in mm. Non-persistent. Cleared upon reset and boot.
     float tool_length_offset;      // Tracks tool length offset value when enabled.
+    float spline_pq[2];            // P,Q offsets of the last G5 spline in mm. Reflected as the I,J default of
+    // a following G5.
+    float cycle_r;                 // R, Z, Q and P of the last canned cycle, as programmed in mm and seconds.
+    float cycle_z;                 // The defaults of the canned cycles that follow in the motion mode.
+    float cycle_q;
+    float cycle_p;
 } parser_state_t;
 extern parser_state_t gc_state;
 
@@ -256,11 +279,52 @@ typedef struct {
 } parser_block_t;
 
 
+// A letter and value word of a g-code block, as split off the line by the parser.
+typedef struct {
+    char letter;
+    float value;
+} gc_word_t;
+#define GC_MAX_WORDS (LINE_BUFFER_SIZE / 2) // Each word takes at least two characters
+
+// The words of a line, split before the line runs. See gc_tokenize_ahead().
+typedef struct {
+    gc_word_t words[GC_MAX_WORDS];
+    uint8_t word_count;
+    uint8_t status; // Of gc_tokenize_line()
+} gc_tokens_t;
+
+// The motion mode is a canned cycle, G73 or G81-G83
+inline bool gc_motion_is_canned_cycle(uint8_t motion) {
+    return (motion == MOTION_MODE_DRILL_CHIP_BREAK) || ((motion >= MOTION_MODE_DRILL) && (motion <= MOTION_MODE_DRILL_PECK));
+}
+
 // Initialize the parser
 void gc_init();
 
 // Execute one block of rs275/ngc/g-code
 uint8_t gc_execute_line(char* line, uint8_t client);
+// Execute one block already split into words. is_jog gives it the checks of a $J= line.
+uint8_t gc_execute_words(const gc_word_t* words, uint8_t word_count, bool is_jog, uint8_t client);
+// Splits a line into words, skipping whitespace and comments, without running it. The words
+// are kept up to the first error, which is returned.
+uint8_t gc_tokenize_line(char* line, gc_word_t* words, uint8_t* word_count);
+// Edit GCode line in-place, removing whitespace and comments and converting to uppercase
+void collapseGCode(char* line);
+
+#ifdef PROTOCOL_READ_AHEAD
+// Splits a g-code line into words before it runs, if its words cannot depend on when it runs.
+// Returns false, and leaves the line to gc_execute_line(), if it has comments, which are reported
+// as they are read, expressions, which read the parameters, or O-words.
+bool gc_tokenize_ahead(char* line, gc_tokens_t* tokens);
+// gc_execute_line() for a line split by gc_tokenize_ahead()
+uint8_t gc_execute_tokens(char* line, const gc_tokens_t* tokens, uint8_t client);
+#endif
+
+#ifdef SD_COMPILE
+// Returns true if the line only has G0-G3 motion, axis, arc, F and N words, so that running it has
+// no effect beyond its motions and the parser state. Comments and empty lines are motion only.
+bool gc_line_is_motion_only(char* line);
+#endif
 
 // Set g-code parser position. Input in steps.
 void gc_sync_position();
@@ -44,30 +44,53 @@
 #include "authentication.h"
 #include "system.h"
 
+#include "raster.h"
 #include "planner.h"
 #include "coolant_control.h"
 #include "grbl_eeprom.h"
 #include "gcode.h"
+#include "expression.h"
+#include "oword.h"
+#include "tool_table.h"
+#include "tool_change.h"
 #include "grbl_limits.h"
 #include "motion_control.h"
 #include "print.h"
 #include "probe.h"
 #include "protocol.h"
+#include "line_trace.h"
+#include "spindle_capture.h"
+#include "event_trace.h"
+#include "job_stats.h"
+#include "heap_trace.h"
+#include "height_map.h"
 #include "report.h"
+#include "task_map.h"
 #include "serial.h"
 #include "Pins.h"
 #include "Spindles/SpindleClass.h"
 #include "Motors/MotorClass.h"
+#include "machine_config.h"
 #include "stepper.h"
+#include "input_shaping.h"
 #include "jog.h"
 #include "inputbuffer.h"
 #include "commands.h"
 #include "SettingsClass.h"
 #include "SettingsDefinitions.h"
+#include "kinematics_linear.h"
 #include "WebSettings.h"
 
 // Do not guard this because it is needed for local files too
 #include "grbl_sd.h"
+#include "sd_estimate.h"
+#include "sd_dir_cache.h"
+#include "sd_bench.h"
+#include "bench.h"
+#include "boot.h"
+#include "ota_writer.h"
+#include "udp_realtime.h"
+#include "radio_coex.h"
 
 #ifdef ENABLE_BLUETOOTH
     #include "BTconfig.h"
@@ -75,12 +98,18 @@
 
 #ifdef ENABLE_WIFI
     #include "wificonfig.h"
+    #include "ethconfig.h"
     #ifdef ENABLE_HTTP
         #include "serial2socket.h"
+        #include "ws_stream.h"
+        #include "webui_partition.h"
     #endif
     #ifdef ENABLE_TELNET
         #include "telnet_server.h"
     #endif
+    #ifdef TCP_STREAM_SERVER
+        #include "tcp_stream.h"
+    #endif
     #ifdef ENABLE_NOTIFICATIONS
         #include "notifications_service.h"
     #endif
@@ -92,6 +121,14 @@
     #include "servo_axis.h"
 #endif
 
+#ifdef USE_ENCODER_FEEDBACK
+    #include "encoder.h"
+#endif
+
+#ifdef USE_MPG
+    #include "mpg.h"
+#endif
+
 #ifdef USE_TRINAMIC
     #include "grbl_trinamic.h"
 #endif
@@ -115,6 +152,9 @@ void inverse_kinematics(float* target, plan_line_data_t* pl_data, float* positio
 bool kinematics_pre_homing(uint8_t cycle_mask);
 void kinematics_post_homing();
 
+// Called if USE_KINEMATICS_BATCH is defined. See mc_line_kins_batch().
+void inverse_kinematics_batch(float (*points)[N_AXIS], uint8_t count, plan_line_data_t* pl_data, const float* position);
+
 // Called if USE_FWD_KINEMATIC is defined
 void forward_kinematics(float* position);
 
@@ -23,7 +23,7 @@
 void memcpy_to_eeprom_with_checksum(unsigned int destination, const char* source, unsigned int size) {
     unsigned char checksum = 0;
     for (; size > 0; size--) {
-        checksum = (checksum << 1) || (checksum >> 7);
+        checksum = (checksum << 1) | (checksum >> 7);
         checksum += *source;
         EEPROM.write(destination++, *(source++));
     }
@@ -31,13 +31,18 @@ void memcpy_to_eeprom_with_checksum(unsigned int destination, const char* source
     EEPROM.commit();
 }
 
+// NOTE: Data written before the checksum rotate was fixed has a checksum made with a logical OR.
+// Both are accepted.
 int memcpy_from_eeprom_with_checksum(char* destination, unsigned int source, unsigned int size) {
-    unsigned char data, checksum = 0;
+    unsigned char data, checksum = 0, legacy_checksum = 0;
     for (; size > 0; size--) {
         data = EEPROM.read(source++);
-        checksum = (checksum << 1) || (checksum >> 7);
+        checksum = (checksum << 1) | (checksum >> 7);
         checksum += data;
+        legacy_checksum = (legacy_checksum << 1) || (legacy_checksum >> 7);
+        legacy_checksum += data;
         *(destination++) = data;
     }
-    return (checksum == EEPROM.read(source));
+    unsigned char stored = EEPROM.read(source);
+    return (checksum == stored || legacy_checksum == stored);
 }
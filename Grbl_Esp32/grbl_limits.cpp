@@ -26,10 +26,20 @@
 */
 
 #include "grbl.h"
+#include <soc/gpio_struct.h>
 
 uint8_t n_homing_locate_cycle = N_HOMING_LOCATE_CYCLE;
 
-xQueueHandle limit_sw_queue;  // used by limit switch debouncing
+#ifdef ENABLE_SOFTWARE_DEBOUNCE
+// The first limit edge holds the motion at once, and this timer checks the switches again after
+// DEBOUNCE_PERIOD. It is an esp_timer, so the check runs when the hardware timer expires instead
+// of when a sleeping task is scheduled again.
+static esp_timer_handle_t limit_debounce_timer = NULL;
+static volatile bool limit_debouncing = false; // The timer is running
+static volatile bool limit_held = false;       // The first edge held a running cycle
+static uint32_t limit_hold_request = 0;        // system_hold_requests() after that hold
+static void limit_debounce_expired(void* arg);
+#endif
 
 // Homing axis search distance multiplier. Computed by this value times the cycle travel.
 #ifndef HOMING_AXIS_SEARCH_SCALAR
@@ -39,7 +49,80 @@ xQueueHandle limit_sw_queue;  // used by limit switch debouncing
     #define HOMING_AXIS_LOCATE_SCALAR  5.0 // Must be > 1 to ensure limit switch is cleared.
 #endif
 
+#ifdef HOMING_AXIS_LOCK_ISR
+// Set up by limits_go_home() during the homing approach, so isr_limit_switches() can lock out
+// the triggered axes. The spinlock keeps the ISR and the homing loop from undoing each other's
+// changes to sys.homing_axis_lock.
+static uint8_t homing_isr_step_pin[N_AXIS];
+static volatile bool homing_isr_armed = false;
+static portMUX_TYPE homing_lock_spinlock = portMUX_INITIALIZER_UNLOCKED;
+static bool hard_limits_armed = false; // The limit interrupts are attached without hard limits
+#endif
+
+#ifdef HOMING_LATCH_POSITION
+#ifndef HOMING_AXIS_LOCK_ISR
+    #error "HOMING_LATCH_POSITION needs HOMING_AXIS_LOCK_ISR"
+#endif
+// sys_position of each axis when it was locked out during the homing approach, in the steps of
+// that pass. The stop comes later than the switch edge, so this is the exact switch position.
+static int32_t homing_latch[N_AXIS];
+static volatile uint8_t homing_latched = 0; // Axes with a latch in this pass
+
+// Latches the axes that axislock lost between before and after. Called with the lock spinlock held.
+static void IRAM_ATTR limits_latch_axes(uint8_t before, uint8_t after, const uint8_t* step_pin) {
+    uint8_t unlocked = before & ~after;
+    if (!unlocked)
+        return;
+    for (uint8_t idx = 0; idx < N_AXIS; idx++) {
+        if ((unlocked & step_pin[idx]) && !(homing_latched & bit(idx))) {
+            homing_latch[idx] = sys_position[idx];
+            homing_latched |= bit(idx);
+        }
+    }
+}
+#endif
+
+// Returns axislock with the step pins of the axes set in limit_state removed.
+static uint8_t IRAM_ATTR limits_lock_axes(uint8_t axislock, uint8_t limit_state, const uint8_t* step_pin) {
+    for (uint8_t idx = 0; idx < N_AXIS; idx++) {
+        if (axislock & step_pin[idx]) {
+            if (limit_state & bit(idx)) {
+// #ifdef COREXY
+//                 if (idx == Z_AXIS)  axislock &= ~(step_pin[Z_AXIS]);
+//                 else  axislock &= ~(step_pin[A_MOTOR] | step_pin[B_MOTOR]);
+// #else
+//                 axislock &= ~(step_pin[idx]);
+// #endif
+                if (kinematics_mixed())
+                {
+                    if (idx == Z_AXIS)  axislock &= ~(step_pin[Z_AXIS]);
+                    else  axislock &= ~(step_pin[A_MOTOR] | step_pin[B_MOTOR]);
+                }else
+                {
+                    axislock &= ~(step_pin[idx]); 
+                }
+            }
+        }
+    }
+    return axislock;
+}
+
 void IRAM_ATTR isr_limit_switches() {
+#ifdef HOMING_AXIS_LOCK_ISR
+    if (homing_isr_armed) {
+        uint8_t limit_state = limits_get_state();
+        portENTER_CRITICAL_ISR(&homing_lock_spinlock);
+        uint8_t axislock = limits_lock_axes(sys.homing_axis_lock, limit_state, homing_isr_step_pin);
+#ifdef HOMING_LATCH_POSITION
+        limits_latch_axes(sys.homing_axis_lock, axislock, homing_isr_step_pin);
+#endif
+        sys.homing_axis_lock = axislock;
+        portEXIT_CRITICAL_ISR(&homing_lock_spinlock);
+        return;
+    }
+    if (!hard_limits_armed)
+        return;
+#endif
     // Ignore limit switches if already in an alarm state or in-process of executing an alarm.
     // When in the alarm state, Grbl should have been reset or will force a reset, so any pending
     // moves in the planner and serial buffers are all cleared and newly sent blocks will be
@@ -48,9 +131,18 @@ void IRAM_ATTR isr_limit_switches() {
     if ((sys.state != STATE_ALARM) & (bit_isfalse(sys.state, STATE_HOMING))) {
         if (!(sys_rt_exec_alarm)) {
 #ifdef ENABLE_SOFTWARE_DEBOUNCE
-            // we will start a task that will recheck the switches after a small delay
-            int evt;
-            xQueueSendFromISR(limit_sw_queue, &evt, NULL);
+            // A real trip is already decelerating when the debounce confirms it. A glitch only
+            // costs a short hold, which limit_debounce_expired() resumes.
+            if (!limit_debouncing && limits_get_state()) {
+                limit_debouncing = true;
+                // A hold pending from another source is left to be resumed by the operator
+                if (sys.state == STATE_CYCLE && !sys.suspend && !(sys_rt_exec_state & EXEC_HOLD_MASK)) {
+                    system_set_exec_state_flag(EXEC_FEED_HOLD);
+                    limit_hold_request = system_hold_requests();
+                    limit_held = true;
+                }
+                esp_timer_start_once(limit_debounce_timer, DEBOUNCE_PERIOD * 1000);
+            }
 #else
 #ifdef HARD_LIMIT_FORCE_STATE_CHECK
             // Check limit pin state.
@@ -97,11 +189,11 @@ void limits_go_home(uint8_t cycle_mask) {
 // #ifdef COREXY
 //         if ((idx == A_MOTOR) || (idx == B_MOTOR))  step_pin[idx] = (get_step_pin_mask(X_AXIS) | get_step_pin_mask(Y_AXIS));
 // #endif
-        if(machineType->get() == MACHINE_COREXY)
+        if (kinematics_mixed())
         {
             if ((idx == A_MOTOR) || (idx == B_MOTOR))  step_pin[idx] = (get_step_pin_mask(X_AXIS) | get_step_pin_mask(Y_AXIS)); 
         }
-        if(machineType->get() == MACHINE_BIPOLAR)
+        if(hot_settings->machine_type == MACHINE_BIPOLAR)
         {
             if ((idx == A_MOTOR) || (idx == B_MOTOR))  step_pin[idx] = (get_step_pin_mask(X_AXIS) | get_step_pin_mask(Y_AXIS)); 
         }
@@ -111,10 +203,35 @@ void limits_go_home(uint8_t cycle_mask) {
             max_travel = MAX(max_travel, (HOMING_AXIS_SEARCH_SCALAR) * axis_settings[idx]->max_travel->get());
         }
     }
+#ifdef HOMING_PARALLEL
+    // Search distance of each axis for the seek approach. Each axis seeks at the lower of the
+    // seek rate and its own max rate, and the distances are scaled so that every axis runs at
+    // its rate until the one that needs the longest has covered its search travel.
+    float seek_distance[N_AXIS] = {};
+    float seek_time = 0.0;
+    float seek_rate_sqr = 0.0;
+    for (idx = 0; idx < N_AXIS; idx++) {
+        if (bit_istrue(cycle_mask, bit(idx))) {
+            seek_distance[idx] = MIN(homing_seek_rate->get(), axis_settings[idx]->max_rate->get());
+            seek_time = MAX(seek_time, (HOMING_AXIS_SEARCH_SCALAR) * axis_settings[idx]->max_travel->get() / seek_distance[idx]);
+        }
+    }
+    for (idx = 0; idx < N_AXIS; idx++) {
+        seek_rate_sqr += seek_distance[idx] * seek_distance[idx];
+        seek_distance[idx] *= seek_time;
+    }
+    bool seek = true; // The first approach
+#endif
     // Set search mode with approach at seek rate to quickly engage the specified cycle_mask limit switches.
     bool approach = true;
     float homing_rate = homing_seek_rate->get();
     uint8_t limit_state, axislock, n_active_axis;
+#ifdef HOMING_LATCH_POSITION
+    // Steps each axis ran past its switch edge in the last approach. Not used for the coupled
+    // motors of CoreXY and bipolar machines, whose axes have no motor of their own.
+    int32_t overshoot[N_AXIS] = {};
+    bool latch = (!kinematics_mixed() && hot_settings->machine_type != MACHINE_BIPOLAR);
+#endif
     do {
         system_convert_array_steps_to_mpos(target, sys_position);
         // Initialize and declare variables needed for homing routine.
@@ -137,7 +254,7 @@ void limits_go_home(uint8_t cycle_mask) {
 // #else
 //                 sys_position[idx] = 0;
 // #endif
-                if(machineType->get() == MACHINE_COREXY)
+                if (kinematics_mixed())
                 {
                     if (idx == X_AXIS) {
                             int32_t axis_position = system_convert_corexy_to_y_axis_steps(sys_position);
@@ -156,6 +273,9 @@ void limits_go_home(uint8_t cycle_mask) {
                 // Set target direction based on cycle mask and homing cycle approach state.
                 // NOTE: This happens to compile smaller than any other implementation tried.
                 auto mask = homing_dir_mask->get();
+#ifdef HOMING_PARALLEL
+                if (seek)  max_travel = seek_distance[idx];
+#endif
                 if (bit_istrue(mask, bit(idx))) {
                     if (approach)  target[idx] = -max_travel;
                     else  target[idx] = max_travel;
@@ -167,8 +287,22 @@ void limits_go_home(uint8_t cycle_mask) {
                 axislock |= step_pin[idx];
             }
         }
+#ifdef HOMING_PARALLEL
+        // The block rate that moves each axis at its own seek rate
+        if (seek)  homing_rate = sqrt(seek_rate_sqr);
+        else
+#endif
         homing_rate *= sqrt(n_active_axis); // [sqrt(N_AXIS)] Adjust so individual axes all move at homing rate.
         sys.homing_axis_lock = axislock;
+#ifdef HOMING_AXIS_LOCK_ISR
+        if (approach) {
+            memcpy(homing_isr_step_pin, step_pin, sizeof(step_pin));
+#ifdef HOMING_LATCH_POSITION
+            homing_latched = 0;
+#endif
+            homing_isr_armed = true;
+        }
+#endif
         // Perform homing cycle. Planner buffer should be empty, as required to initiate the homing cycle.
         pl_data->feed_rate = homing_rate; // Set current homing rate.
         plan_buffer_line(target, pl_data); // Bypass mc_line(). Directly plan homing motion.
@@ -179,27 +313,19 @@ void limits_go_home(uint8_t cycle_mask) {
             if (approach) {
                 // Check limit state. Lock out cycle axes when they change.
                 limit_state = limits_get_state();
-                for (idx = 0; idx < N_AXIS; idx++) {
-                    if (axislock & step_pin[idx]) {
-                        if (limit_state & bit(idx)) {
-// #ifdef COREXY
-//                             if (idx == Z_AXIS)  axislock &= ~(step_pin[Z_AXIS]);
-//                             else  axislock &= ~(step_pin[A_MOTOR] | step_pin[B_MOTOR]);
-// #else
-//                             axislock &= ~(step_pin[idx]);
-// #endif
-                            if(machineType->get() == MACHINE_COREXY)
-                            {
-                                if (idx == Z_AXIS)  axislock &= ~(step_pin[Z_AXIS]);
-                                else  axislock &= ~(step_pin[A_MOTOR] | step_pin[B_MOTOR]);
-                            }else
-                            {
-                                axislock &= ~(step_pin[idx]); 
-                            }
-                        }
-                    }
-                }
+#ifdef HOMING_AXIS_LOCK_ISR
+                // The limit ISR may have locked out axes already, so start from its lock
+                portENTER_CRITICAL(&homing_lock_spinlock);
+                axislock = limits_lock_axes(sys.homing_axis_lock, limit_state, step_pin);
+#ifdef HOMING_LATCH_POSITION
+                limits_latch_axes(sys.homing_axis_lock, axislock, step_pin);
+#endif
                 sys.homing_axis_lock = axislock;
+                portEXIT_CRITICAL(&homing_lock_spinlock);
+#else
+                axislock = limits_lock_axes(axislock, limit_state, step_pin);
+                sys.homing_axis_lock = axislock;
+#endif
             }
             st_prep_buffer(); // Check and prep segment buffer. NOTE: Should take no longer than 200us.
             // Exit routines: No time to run protocol_execute_realtime() in this loop.
@@ -214,6 +340,9 @@ void limits_go_home(uint8_t cycle_mask) {
                 // Homing failure condition: Limit switch not found during approach.
                 if (approach && (rt_exec & EXEC_CYCLE_STOP))  system_set_exec_alarm(EXEC_ALARM_HOMING_FAIL_APPROACH);
                 if (sys_rt_exec_alarm) { 
+#ifdef HOMING_AXIS_LOCK_ISR
+                    homing_isr_armed = false;
+#endif
                     motors_set_homing_mode(cycle_mask, false); // tell motors homing is done...failed   
                     mc_reset(); // Stop motors, if they are running.
                     protocol_execute_realtime();
@@ -225,15 +354,30 @@ void limits_go_home(uint8_t cycle_mask) {
                 }
             }
         } while (STEP_MASK & axislock);
+#ifdef HOMING_AXIS_LOCK_ISR
+        homing_isr_armed = false;
+#endif
+#ifdef HOMING_LATCH_POSITION
+        float overshoot_mm = 0.0;
+        if (approach && latch) {
+            for (idx = 0; idx < N_AXIS; idx++) {
+                overshoot[idx] = (homing_latched & bit(idx)) ? sys_position[idx] - homing_latch[idx] : 0;
+                overshoot_mm = MAX(overshoot_mm, labs(overshoot[idx]) / axis_settings[idx]->steps_per_mm->get());
+            }
+        }
+#endif
 #ifdef USE_I2S_OUT_STREAM
         if (!approach) {
-            delay_ms(I2S_OUT_DELAY_MS);
+            delay_ms(i2s_out_get_delay_ms());
         }
 #endif
         st_reset(); // Immediately force kill steppers and reset step segment buffer.
         delay_ms(homing_debounce->get()); // Delay to allow transient dynamics to dissipate.
         // Reverse direction and reset homing rate for locate cycle(s).
         approach = !approach;
+#ifdef HOMING_PARALLEL
+        seek = false;
+#endif
         // After first cycle, homing enters locating phase. Shorten search to pull-off distance.
         if (approach) {
             max_travel = homing_pulloff->get() * HOMING_AXIS_LOCATE_SCALAR;
@@ -241,6 +385,12 @@ void limits_go_home(uint8_t cycle_mask) {
         } else {
             max_travel = homing_pulloff->get();
             homing_rate = homing_seek_rate->get();
+#ifdef HOMING_LATCH_POSITION
+            // The switch edge is known, so a locate approach only needs to start a little before
+            // it. The last pull-off keeps its full distance, it sets the homed position.
+            if (latch && n_cycle > 0)
+                max_travel = MIN(max_travel, overshoot_mm + HOMING_LATCH_CLEARANCE);
+#endif
         }
     } while (n_cycle-- > 0);
     // The active cycle axes should now be homed and machine limits have been located. By
@@ -288,7 +438,7 @@ void limits_go_home(uint8_t cycle_mask) {
 // #else
 //             sys_position[idx] = set_axis_position;
 // #endif
-            if(machineType->get() == MACHINE_COREXY)
+            if (kinematics_mixed())
             {
                 if (idx == X_AXIS) {
                     int32_t off_axis_position = system_convert_corexy_to_y_axis_steps(sys_position);
@@ -302,6 +452,11 @@ void limits_go_home(uint8_t cycle_mask) {
                     sys_position[idx] = set_axis_position;
             }else
             {
+#ifdef HOMING_LATCH_POSITION
+            // set_axis_position is for the pull-off distance from where the last approach
+            // stopped. Measure it from the switch edge instead.
+            set_axis_position += overshoot[idx];
+#endif
             sys_position[idx] = set_axis_position; 
             }
         }
@@ -321,19 +476,44 @@ uint8_t limit_pins[] = {
 
 uint8_t limit_mask = 0;
 
+// The GPIO input bit of each enabled limit pin, in GPIO.in for GPIO 0-31 and in GPIO.in1 for
+// GPIO 32-39, and the invert mask. Built by limits_init() at every reset, so limits_get_state()
+// reads one or two registers and no settings.
+static uint32_t limit_gpio_bit[N_AXIS];
+static uint8_t limit_gpio_in1_axes = 0; // Axes whose pin is in GPIO.in1
+static uint8_t limit_state_invert = 0;
+
 void limits_init() {
     limit_mask = 0;
+    limit_gpio_in1_axes = 0;
+    const uint8_t limit_enable = hot_settings->limit_enable_mask;
+    limit_state_invert = hot_settings->limit_invert_mask;
     int mode = INPUT_PULLUP;
 #ifdef DISABLE_LIMIT_PIN_PULL_UP
     mode = INPUT;
 #endif
     for (int i=0; i<N_AXIS; i++) {
         uint8_t pin;
+        limit_gpio_bit[i] = 0;
+#ifdef MACHINE_CONFIG
+        if (machine_config_loaded())
+            limit_pins[i] = machine_config_limit_pin(i);
+#endif
         if ((pin = limit_pins[i]) != UNDEFINED_PIN) {
             limit_mask |= bit(i);
-            if(limitSwitch->get() & (0x01<<i))pinMode(pin, mode);
-            if (hard_limits->get()) {
-                if(limitSwitch->get() & (0x01<<i))attachInterrupt(pin, isr_limit_switches, CHANGE);
+            if (limit_enable & (0x01 << i)) {
+                limit_gpio_bit[i] = bit(pin & 31);
+                if (pin >= 32)
+                    limit_gpio_in1_axes |= bit(i);
+            }
+            if(limit_enable & (0x01<<i))pinMode(pin, mode);
+            bool attach = hard_limits->get();
+#ifdef HOMING_AXIS_LOCK_ISR
+            hard_limits_armed = attach;
+            attach = true; // Also needed by the homing approach
+#endif
+            if (attach) {
+                if(limit_enable & (0x01<<i))attachInterrupt(pin, isr_limit_switches, CHANGE);
             } else {
                 detachInterrupt(pin);
             }
@@ -341,25 +521,28 @@ void limits_init() {
     }
 
     grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Limit Status:X %s, Y %s, Z %s",
-    (limitSwitch->get() & (0x01<<0))?"Enable":"Disable",
-    (limitSwitch->get() & (0x01<<1))?"Enable":"Disable",
-    (limitSwitch->get() & (0x01<<2))?"Enable":"Disable"
+    (limit_enable & (0x01<<0))?"Enable":"Disable",
+    (limit_enable & (0x01<<1))?"Enable":"Disable",
+    (limit_enable & (0x01<<2))?"Enable":"Disable"
     );
 
     grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Limit Type:X %s, Y %s, Z %s",
-    (limitType->get() & (0x01<<0))?"NO":"NC",
-    (limitType->get() & (0x01<<1))?"NO":"NC",
-    (limitType->get() & (0x01<<2))?"NO":"NC"
+    (limit_state_invert & (0x01<<0))?"NO":"NC",
+    (limit_state_invert & (0x01<<1))?"NO":"NC",
+    (limit_state_invert & (0x01<<2))?"NO":"NC"
     );
 
-    // setup task used for debouncing
-    limit_sw_queue = xQueueCreate(10, sizeof(int));
-    xTaskCreate(limitCheckTask,
-                "limitCheckTask",
-                2048,
-                NULL,
-                5, // priority
-                NULL);
+#ifdef ENABLE_SOFTWARE_DEBOUNCE
+    if (limit_debounce_timer == NULL) {
+        esp_timer_create_args_t args = {};
+        args.callback = limit_debounce_expired;
+        args.name = "limit_debounce";
+        esp_timer_create(&args, &limit_debounce_timer);
+    }
+    esp_timer_stop(limit_debounce_timer);
+    limit_debouncing = false;
+    limit_held = false;
+#endif
 }
 
 // Disables hard limits.
@@ -374,13 +557,14 @@ void limits_disable() {
 // Returns limit state as a bit-wise uint8 variable. Each bit indicates an axis limit, where
 // triggered is 1 and not triggered is 0. Invert mask is applied. Axes are defined by their
 // number in bit position, i.e. Z_AXIS is bit(2), and Y_AXIS is bit(1).
-uint8_t limits_get_state() {
+// NOTE: Also called by isr_limit_switches(), so it stays in IRAM and reads no settings.
+uint8_t IRAM_ATTR limits_get_state() {
     uint8_t pinMask = 0;
+    uint32_t in = GPIO.in;
+    uint32_t in1 = limit_gpio_in1_axes ? GPIO.in1.val : 0;
     for (int i=0; i<N_AXIS; i++) {
-        uint8_t pin;
-        if ((pin = limit_pins[i]) != UNDEFINED_PIN) {
-            if(limitSwitch->get() & (0x01<<i))pinMask += digitalRead(pin) << i;
-        }
+        if (((limit_gpio_in1_axes & bit(i)) ? in1 : in) & limit_gpio_bit[i])
+            pinMask |= bit(i);
     }
 
 // #ifdef INVERT_LIMIT_PIN_MASK // not normally used..unless you have both normal and inverted switches
@@ -390,7 +574,7 @@ uint8_t limits_get_state() {
 //         pinMask ^= limit_mask;
 //     }
 
-    pinMask ^= limitType->get();
+    pinMask ^= limit_state_invert;
 
     return (pinMask);
 }
@@ -427,20 +611,23 @@ void limits_soft_check(float* target) {
 }
 
 // this is the task
-void limitCheckTask(void* pvParameters) {
-    while (true) {
-        int evt;
-        xQueueReceive(limit_sw_queue, &evt, portMAX_DELAY); // block until receive queue
-        vTaskDelay(DEBOUNCE_PERIOD / portTICK_PERIOD_MS);   // delay a while
-        uint8_t switch_state;
-        switch_state = limits_get_state();
-        if (switch_state) {
-            grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Limit Switch State %08d", switch_state);
-            mc_reset(); // Initiate system kill.
-            system_set_exec_alarm(EXEC_ALARM_HARD_LIMIT); // Indicate hard limit critical event
-        }
-    }
+#ifdef ENABLE_SOFTWARE_DEBOUNCE
+// Runs in the esp_timer task DEBOUNCE_PERIOD after the first limit edge. A switch that is still
+// triggered is a hard limit. Otherwise the edge was noise and the hold it made is resumed, unless
+// another hold, from the operator, a pin or the door, came during the debounce period.
+static void limit_debounce_expired(void* arg) {
+    uint8_t switch_state = limits_get_state();
+    bool held = limit_held;
+    limit_held = false;
+    limit_debouncing = false;
+    if (switch_state) {
+        grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Limit Switch State %08d", switch_state);
+        mc_reset(); // Initiate system kill.
+        system_set_exec_alarm(EXEC_ALARM_HARD_LIMIT); // Indicate hard limit critical event
+    } else if (held && system_hold_requests() == limit_hold_request && !(sys.suspend & SUSPEND_SAFETY_DOOR_AJAR))
+        system_set_exec_state_flag(EXEC_CYCLE_START);
 }
+#endif
 
 // return true if the axis is defined as a squared axis
 // Squaring: is used on gantry type axes that have two motors
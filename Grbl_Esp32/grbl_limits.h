@@ -53,7 +53,4 @@ void isr_limit_switches();
 
 bool axis_is_squared(uint8_t axis_mask);
 
-// A task that runs after a limit switch interrupt.
-void limitCheckTask(void* pvParameters);
-
 #endif
\ No newline at end of file
@@ -19,6 +19,9 @@
 */
 
 #include "grbl_sd.h"
+#ifdef SD_JOB_QUEUE
+    #include "SPIFFS.h"
+#endif
 
 File myFile;
 bool SD_ready_next = false; // Grbl has processed a line and is waiting for another
@@ -26,6 +29,314 @@ uint8_t SD_client = CLIENT_SERIAL;
 uint32_t sd_current_line_number; // stores the most recent line number read from the SD
 static char comment[LINE_BUFFER_SIZE]; // Line to be executed. Zero-terminated.
 
+#ifdef SD_COMPILE
+// A compiled file is a header followed by records, each a type byte and its struct:
+//   SD_RECORD_MOTION - a planner motion of a motion only line, see gc_line_is_motion_only()
+//   SD_RECORD_STATE  - the parser state, written before each text record and at the end
+//   SD_RECORD_TEXT   - a line with other effects, like spindle, coolant or dwell, run as text
+// The motions are machine positions, so the file only runs from the parser position and offsets
+// it was compiled at. The layout is that of this build, which the header checks.
+#define SD_COMPILED_MAGIC 0x31424347 // "GCB1"
+typedef struct {
+    uint32_t magic;
+    uint8_t n_axis;
+    uint16_t state_size;
+    parser_state_t start;
+} sd_compiled_header_t;
+
+enum : uint8_t {
+    SD_RECORD_MOTION = 'M',
+    SD_RECORD_STATE = 'S',
+    SD_RECORD_TEXT = 'T',
+};
+
+typedef struct {
+    float target[N_AXIS];
+    float feed_rate;
+    uint32_t spindle_speed;
+    uint32_t line;        // Line of the source file, for errors and the report
+    int32_t line_number;  // N word
+    uint8_t condition;
+} sd_motion_record_t;
+
+typedef struct {
+    uint32_t line;
+    uint8_t len; // Followed by len characters
+} sd_text_record_t;
+
+static bool sd_compiled = false; // The open job is a compiled file
+static parser_state_t sd_compiled_start;
+static bool sd_is_compiled_path(const char* path);
+static bool sd_read_compiled_header();
+#endif
+
+#ifdef SD_RESUME
+// The line index of a job, <file>SD_INDEX_SUFFIX. It is written each time the job runs from the
+// start, with an entry every SD_INDEX_STRIDE lines: the lines before it, its byte offset and the
+// parser state there. A run from line N starts at the last entry before N. See sd_resume().
+#define SD_INDEX_MAGIC 0x31584449 // "IDX1"
+typedef struct {
+    uint32_t magic;
+    uint32_t file_size;
+    uint16_t stride;
+    uint16_t state_size;
+} sd_index_header_t;
+
+typedef struct {
+    uint32_t line;   // Lines before this one
+    uint32_t offset; // Byte offset of the line
+    parser_state_t state;
+} sd_index_entry_t;
+
+static File sd_index;
+static bool sd_indexing = false; // Writing the index of the running job
+static void sd_index_close() {
+    sd_indexing = false;
+    if (sd_index)
+        sd_index.close();
+}
+#endif
+
+#ifdef SD_READ_AHEAD
+// The file is read in blocks by sdReadTask while the lines of the previous block run. Blocks go
+// around two queues: sd_empty to be filled by the task and sd_full to be taken by readFileLine().
+// A NULL on sd_empty asks the task to close the file, so closeFile() never waits on the card and
+// is safe from the reset paths. A block with len 0 is the end of the file.
+typedef struct {
+    uint8_t* data;
+    size_t len;
+} sd_block_t;
+static sd_block_t sd_blocks[SD_READ_BLOCKS];
+static QueueHandle_t sd_empty = NULL;
+static QueueHandle_t sd_full = NULL;
+static TaskHandle_t sdReadTaskHandle = NULL;
+static sd_block_t* sd_current = NULL; // The block readFileLine() takes lines from
+static size_t sd_current_pos;
+static bool sd_open = false;          // A file is open for readFileLine()
+static volatile bool sd_closed = true; // The task has closed the last file
+static uint32_t sd_bytes_done;        // Bytes handed out as lines, for the percentage
+static uint32_t sd_file_size;
+
+static void sdReadTask(void* pvParameters) {
+    sd_block_t* block;
+    while (true) {
+        if (xQueueReceive(sd_empty, &block, portMAX_DELAY) != pdTRUE)
+            continue;
+        if (block == NULL) {
+            myFile.close();
+#ifdef SD_RESUME
+            sd_index_close();
+#endif
+            sd_closed = true;
+            continue;
+        }
+        int len = myFile.read(block->data, SD_READ_BLOCK_SIZE);
+        block->len = len > 0 ? len : 0;
+        xQueueSend(sd_full, &block, portMAX_DELAY); // Never waits. There is room for every block.
+    }
+}
+
+// Allocates the blocks and starts the read task the first time a file is opened.
+static bool sd_read_ahead_init() {
+    if (sdReadTaskHandle != NULL)
+        return true;
+    for (uint8_t i = 0; i < SD_READ_BLOCKS; i++) {
+        if (sd_blocks[i].data == NULL)
+            sd_blocks[i].data = (uint8_t*)malloc(SD_READ_BLOCK_SIZE);
+        if (sd_blocks[i].data == NULL)
+            return false;
+    }
+    sd_empty = xQueueCreate(SD_READ_BLOCKS + 1, sizeof(sd_block_t*)); // With room for the close
+    sd_full = xQueueCreate(SD_READ_BLOCKS, sizeof(sd_block_t*));
+    task_create(TASK_SD_READ, sdReadTask, 4096, NULL, &sdReadTaskHandle);
+    return sdReadTaskHandle != NULL;
+}
+
+// Returns the next byte of the file, or -1 at the end.
+static int sd_read_byte() {
+    if (sd_current != NULL && sd_current_pos == sd_current->len) {
+        if (sd_current->len == 0)
+            return -1; // The end. The block stays here until the file is closed.
+        xQueueSend(sd_empty, &sd_current, portMAX_DELAY);
+        sd_current = NULL;
+    }
+    if (sd_current == NULL) {
+        xQueueReceive(sd_full, &sd_current, portMAX_DELAY);
+        sd_current_pos = 0;
+        if (sd_current->len == 0)
+            return -1;
+    }
+    sd_bytes_done++;
+    return sd_current->data[sd_current_pos++];
+}
+
+// Returns true if the file has more bytes. May wait for the next block.
+static bool sd_available() {
+    if (sd_current != NULL && sd_current_pos < sd_current->len)
+        return true;
+    if (sd_current != NULL && sd_current->len == 0)
+        return false;
+    if (sd_current != NULL) {
+        xQueueSend(sd_empty, &sd_current, portMAX_DELAY);
+        sd_current = NULL;
+    }
+    xQueueReceive(sd_full, &sd_current, portMAX_DELAY);
+    sd_current_pos = 0;
+    return sd_current->len != 0;
+}
+#endif
+
+#if defined(SD_COMPILE) || defined(SD_GZIP)
+// Reads up to len bytes of the open file. Returns the number read.
+static size_t sd_read(void* data, size_t len) {
+#ifdef SD_READ_AHEAD
+    uint8_t* bytes = (uint8_t*)data;
+    size_t count = 0;
+    int c;
+    while (count < len && (c = sd_read_byte()) >= 0)
+        bytes[count++] = c;
+    return count;
+#else
+    int count = myFile.read((uint8_t*)data, len);
+    return count > 0 ? count : 0;
+#endif
+}
+
+#endif
+
+#ifdef SD_GZIP
+// A job named *.gz is inflated as its lines are read, with the inflater in the ESP32 ROM. The
+// inflater writes into a ring of TINFL_LZ_DICT_SIZE bytes, which is also the window the deflate
+// data refers back into, and the lines are read straight from it. The buffers are taken the
+// first time a compressed job runs and kept. The percentage is that of the compressed file read.
+static tinfl_decompressor* sd_gz_inflater = NULL;
+static uint8_t* sd_gz_in = NULL;    // Compressed bytes, SD_GZIP_IN_SIZE
+static uint8_t* sd_gz_ring = NULL;  // Inflated bytes, TINFL_LZ_DICT_SIZE
+static size_t sd_gz_in_pos, sd_gz_in_len;
+static bool sd_gz_in_end;           // The whole file is in sd_gz_in
+static size_t sd_gz_ring_pos;       // Next byte to write into the ring
+static size_t sd_gz_out_pos, sd_gz_out_len; // Inflated bytes not read yet, from sd_gz_out_pos
+static bool sd_gz_end;              // The end of the deflate data
+static bool sd_gzip = false;        // The open job is compressed
+
+static bool sd_is_gzip_path(const char* path) {
+    size_t len = strlen(path);
+    return len > 3 && strcasecmp(path + len - 3, ".gz") == 0;
+}
+
+static bool sd_gz_fill() {
+    if (sd_gz_in_pos < sd_gz_in_len || sd_gz_in_end)
+        return sd_gz_in_pos < sd_gz_in_len;
+    sd_gz_in_len = sd_read(sd_gz_in, SD_GZIP_IN_SIZE);
+    sd_gz_in_pos = 0;
+    sd_gz_in_end = sd_gz_in_len < SD_GZIP_IN_SIZE;
+    return sd_gz_in_len != 0;
+}
+
+// Returns the next compressed byte, or -1 at the end of the file.
+static int sd_gz_in_byte() {
+    if (!sd_gz_fill())
+        return -1;
+    return sd_gz_in[sd_gz_in_pos++];
+}
+
+// Skips the gzip header to the deflate data. See RFC 1952.
+static bool sd_gz_header() {
+    uint8_t header[10];
+    for (uint8_t i = 0; i < sizeof(header); i++) {
+        int c = sd_gz_in_byte();
+        if (c < 0)
+            return false;
+        header[i] = c;
+    }
+    if (header[0] != 0x1f || header[1] != 0x8b || header[2] != 8) // 8 is deflate
+        return false;
+    uint8_t flags = header[3];
+    if (flags & bit(2)) { // FEXTRA
+        int lo = sd_gz_in_byte(), hi = sd_gz_in_byte();
+        if (lo < 0 || hi < 0)
+            return false;
+        for (uint16_t n = lo | (hi << 8); n; n--) {
+            if (sd_gz_in_byte() < 0)
+                return false;
+        }
+    }
+    for (uint8_t name_bit = 3; name_bit <= 4; name_bit++) { // FNAME and FCOMMENT
+        if (!(flags & bit(name_bit)))
+            continue;
+        int c;
+        while ((c = sd_gz_in_byte()) > 0) {}
+        if (c < 0)
+            return false;
+    }
+    if (flags & bit(1)) { // FHCRC
+        if (sd_gz_in_byte() < 0 || sd_gz_in_byte() < 0)
+            return false;
+    }
+    return true;
+}
+
+static bool sd_gz_begin() {
+    if (sd_gz_inflater == NULL) {
+        sd_gz_inflater = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+        sd_gz_in = (uint8_t*)malloc(SD_GZIP_IN_SIZE);
+        sd_gz_ring = (uint8_t*)malloc(TINFL_LZ_DICT_SIZE);
+        if (sd_gz_inflater == NULL || sd_gz_in == NULL || sd_gz_ring == NULL) {
+            free(sd_gz_inflater);
+            free(sd_gz_in);
+            free(sd_gz_ring);
+            sd_gz_inflater = NULL;
+            return false;
+        }
+    }
+    tinfl_init(sd_gz_inflater);
+    sd_gz_in_pos = sd_gz_in_len = 0;
+    sd_gz_in_end = false;
+    sd_gz_ring_pos = sd_gz_out_pos = sd_gz_out_len = 0;
+    sd_gz_end = false;
+    return sd_gz_header();
+}
+
+// Inflates more bytes if none are left to read. Returns false at the end or on bad data.
+static bool sd_gz_available() {
+    while (sd_gz_out_len == 0 && !sd_gz_end) {
+        sd_gz_fill();
+        size_t in_bytes = sd_gz_in_len - sd_gz_in_pos;
+        size_t out_bytes = TINFL_LZ_DICT_SIZE - sd_gz_ring_pos;
+        tinfl_status status = tinfl_decompress(sd_gz_inflater, sd_gz_in + sd_gz_in_pos, &in_bytes,
+                                               sd_gz_ring, sd_gz_ring + sd_gz_ring_pos, &out_bytes,
+                                               sd_gz_in_end ? 0 : TINFL_FLAG_HAS_MORE_INPUT);
+        sd_gz_in_pos += in_bytes;
+        sd_gz_out_pos = sd_gz_ring_pos;
+        sd_gz_out_len = out_bytes;
+        sd_gz_ring_pos = (sd_gz_ring_pos + out_bytes) & (TINFL_LZ_DICT_SIZE - 1);
+        if (status == TINFL_STATUS_DONE)
+            sd_gz_end = true;
+        else if (status < TINFL_STATUS_DONE) {
+            sd_gz_end = true;
+            report_status_message(STATUS_SD_FAILED_READ, SD_client); // Bad or cut short
+        }
+    }
+    return sd_gz_out_len != 0;
+}
+
+static boolean sd_gz_read_line(char* line, int maxlen) {
+    sd_current_line_number += 1;
+    int len = 0;
+    while (sd_gz_available()) {
+        char c = sd_gz_ring[sd_gz_out_pos++];
+        sd_gz_out_len--;
+        if (c == '\n')
+            break;
+        line[len++] = c;
+        if (len >= maxlen)
+            return false;
+    }
+    line[len] = '\0';
+    return len || sd_gz_available();
+}
+#endif
+
 // attempt to mount the SD card
 /*bool sd_mount()
 {
@@ -37,6 +348,22 @@ static char comment[LINE_BUFFER_SIZE]; // Line to be executed. Zero-terminated.
 }*/
 
 void listDir(fs::FS& fs, const char* dirname, uint8_t levels, uint8_t client) {
+#ifdef SD_DIR_CACHE
+    // Listed from RAM if the directory is cached, else walked below while the task lists it
+    const sd_dir_entry_t* entries;
+    uint32_t count;
+    if (&fs == &SD && sd_dir_cache_get(dirname, &entries, &count) == SD_DIR_READY) {
+        for (uint32_t i = 0; i < count; i++) {
+            String path = String(dirname) + (strcmp(dirname, "/") ? "/" : "") + entries[i].name;
+            if (!entries[i].is_dir)
+                grbl_sendf(CLIENT_ALL, "[FILE:%s|SIZE:%d]\r\n", path.c_str(), entries[i].size);
+            else if (levels)
+                listDir(fs, path.c_str(), levels - 1, client);
+        }
+        sd_dir_cache_release(entries);
+        return;
+    }
+#endif
     //char temp_filename[128]; // to help filter by extension	TODO: 128 needs a definition based on something
     File root = fs.open(dirname);
     if (!root) {
@@ -58,26 +385,95 @@ void listDir(fs::FS& fs, const char* dirname, uint8_t levels, uint8_t client) {
     }
 }
 
-boolean openFile(fs::FS& fs, const char* path) {
+boolean openFile(fs::FS& fs, const char* path, uint32_t offset) {
+#ifdef SD_READ_AHEAD
+    if (!sd_read_ahead_init())
+        return false;
+    while (!sd_closed)
+        vTaskDelay(1); // The task is still closing the last file
+#endif
     myFile = fs.open(path);
     if (!myFile) {
         //report_status_message(STATUS_SD_FAILED_READ, CLIENT_SERIAL);
         return false;
     }
+    if (offset != 0 && !myFile.seek(offset)) {
+        myFile.close();
+        return false;
+    }
+#ifdef SD_READ_AHEAD
+    xQueueReset(sd_empty);
+    xQueueReset(sd_full);
+    sd_current = NULL;
+    sd_bytes_done = offset;
+    sd_file_size = myFile.size();
+    sd_closed = false;
+    sd_open = true;
+    for (uint8_t i = 0; i < SD_READ_BLOCKS; i++) {
+        sd_block_t* block = &sd_blocks[i];
+        xQueueSend(sd_empty, &block, 0);
+    }
+#endif
     set_sd_state(SDCARD_BUSY_PRINTING);
     SD_ready_next = false; // this will get set to true when Grbl issues "ok" message
     sd_current_line_number = 0;
+#ifdef SD_COMPILE
+    sd_compiled = sd_is_compiled_path(path);
+    if (sd_compiled && !sd_read_compiled_header()) {
+        closeFile();
+        return false;
+    }
+#endif
+#ifdef SD_GZIP
+    sd_gzip = sd_is_gzip_path(path);
+    if (sd_gzip && (offset != 0 || !sd_gz_begin())) {
+        closeFile();
+        return false;
+    }
+#endif
+#ifdef SD_ESTIMATE
+#ifdef SD_COMPILE
+    if (sd_compiled)
+        return true;
+#endif
+#ifdef SD_GZIP
+    if (sd_gzip)
+        return true; // The estimate reads the file as text
+#endif
+    sd_estimate_start(fs, path);
+#endif
     return true;
 }
 
 boolean closeFile() {
+#ifdef SD_ESTIMATE
+    sd_estimate_stop();
+#endif
+#ifdef SD_GZIP
+    sd_gzip = false;
+#endif
+#ifdef SD_READ_AHEAD
+    if (!sd_open)
+        return false;
+    sd_open = false;
+    set_sd_state(SDCARD_IDLE);
+    SD_ready_next = false;
+    sd_current_line_number = 0;
+    sd_block_t* close = NULL;
+    xQueueSend(sd_empty, &close, 0); // The task closes the file after the blocks being read
+    return true;
+#else
     if (!myFile)
         return false;
     set_sd_state(SDCARD_IDLE);
     SD_ready_next = false;
     sd_current_line_number = 0;
     myFile.close();
+#ifdef SD_RESUME
+    sd_index_close();
+#endif
     return true;
+#endif
 }
 
 /*
@@ -88,6 +484,28 @@ boolean closeFile() {
   return true if a line is
 */
 boolean readFileLine(char* line, int maxlen) {
+#ifdef SD_GZIP
+    if (sd_gzip)
+        return sd_gz_read_line(line, maxlen);
+#endif
+#ifdef SD_READ_AHEAD
+    if (!sd_open) {
+        report_status_message(STATUS_SD_FAILED_READ, SD_client);
+        return false;
+    }
+    sd_current_line_number += 1;
+    int len = 0;
+    int c;
+    while ((c = sd_read_byte()) >= 0) {
+        if (c == '\n')
+            break;
+        line[len++] = c;
+        if (len >= maxlen)
+            return false;
+    }
+    line[len] = '\0';
+    return len || sd_available();
+#else
     if (!myFile) {
         report_status_message(STATUS_SD_FAILED_READ, SD_client);
         return false;
@@ -106,10 +524,386 @@ boolean readFileLine(char* line, int maxlen) {
     }
     line[len] = '\0';
     return len || myFile.available();
+#endif
+}
+
+#ifdef SD_COMPILE
+static bool sd_is_compiled_path(const char* path) {
+    size_t len = strlen(path);
+    size_t suffix_len = strlen(SD_COMPILED_SUFFIX);
+    return len > suffix_len && strcasecmp(path + len - suffix_len, SD_COMPILED_SUFFIX) == 0;
+}
+
+static bool sd_read_compiled_header() {
+    sd_compiled_header_t header;
+    if (sd_read(&header, sizeof(header)) != sizeof(header))
+        return false;
+    if (header.magic != SD_COMPILED_MAGIC || header.n_axis != N_AXIS || header.state_size != sizeof(parser_state_t))
+        return false;
+    sd_compiled_start = header.start;
+    return true;
+}
+
+static bool sd_float_matches(const float* a, const float* b, uint8_t count) {
+    for (uint8_t i = 0; i < count; i++) {
+        if (fabs(a[i] - b[i]) > SD_COMPILED_TOLERANCE)
+            return false;
+    }
+    return true;
+}
+
+bool sd_job_compiled() {
+    return sd_compiled;
+}
+
+err_t sd_compiled_start_check() {
+    // The motions are machine positions worked out from these when the file was compiled
+    if (!sd_float_matches(gc_state.position, sd_compiled_start.position, N_AXIS) ||
+            !sd_float_matches(gc_state.coord_system, sd_compiled_start.coord_system, N_AXIS) ||
+            !sd_float_matches(gc_state.coord_offset, sd_compiled_start.coord_offset, N_AXIS) ||
+            !sd_float_matches(&gc_state.tool_length_offset, &sd_compiled_start.tool_length_offset, 1))
+        return STATUS_SD_COMPILED_MISMATCH;
+    return STATUS_OK;
+}
+
+// Runs the records up to and including the next motion or text line.
+static bool sd_run_compiled(uint8_t* status) {
+    uint8_t type;
+    while (sd_read(&type, 1) == 1) {
+        switch (type) {
+        case SD_RECORD_MOTION: {
+            sd_motion_record_t motion;
+            if (sd_read(&motion, sizeof(motion)) != sizeof(motion))
+                return false;
+            sd_current_line_number = motion.line;
+            plan_line_data_t plan_data;
+            memset(&plan_data, 0, sizeof(plan_line_data_t));
+            plan_data.feed_rate = motion.feed_rate;
+            plan_data.spindle_speed = motion.spindle_speed;
+            plan_data.condition = motion.condition;
+#ifdef USE_LINE_NUMBERS
+            plan_data.line_number = motion.line_number;
+#endif
+            mc_line(motion.target, &plan_data);
+            *status = STATUS_OK;
+            return true;
+        }
+        case SD_RECORD_STATE:
+            if (sd_read(&gc_state, sizeof(gc_state)) != sizeof(gc_state))
+                return false;
+            system_flag_wco_change();
+            break;
+        case SD_RECORD_TEXT: {
+            sd_text_record_t text;
+            char line[256];
+            if (sd_read(&text, sizeof(text)) != sizeof(text) || sd_read(line, text.len) != text.len)
+                return false;
+            line[text.len] = '\0';
+            sd_current_line_number = text.line;
+            *status = gc_execute_line(line, SD_client);
+            return true;
+        }
+        default:
+            return false;
+        }
+    }
+    return false;
+}
+
+// Compiling. The file is run through the parser in check mode. Motions arrive at
+// sd_compile_motion() from mc_line().
+static File sd_compile_out;
+static bool sd_compiling = false;
+static uint32_t sd_compile_line;
+static uint32_t sd_compile_blocks;
+
+void sd_compile_motion(float* target, plan_line_data_t* pl_data) {
+    if (!sd_compiling)
+        return;
+    sd_motion_record_t motion;
+    memset(&motion, 0, sizeof(motion));
+    memcpy(motion.target, target, sizeof(motion.target));
+    motion.feed_rate = pl_data->feed_rate;
+    motion.spindle_speed = pl_data->spindle_speed;
+    motion.condition = pl_data->condition;
+    motion.line = sd_compile_line;
+#ifdef USE_LINE_NUMBERS
+    motion.line_number = pl_data->line_number;
+#endif
+    uint8_t type = SD_RECORD_MOTION;
+    sd_compile_out.write(&type, 1);
+    sd_compile_out.write((const uint8_t*)&motion, sizeof(motion));
+    sd_compile_blocks++;
+}
+
+static void sd_compile_state() {
+    uint8_t type = SD_RECORD_STATE;
+    sd_compile_out.write(&type, 1);
+    sd_compile_out.write((const uint8_t*)&gc_state, sizeof(gc_state));
+}
+
+err_t sd_compile_file(fs::FS& fs, const char* path, uint8_t client) {
+    File source = fs.open(path);
+    if (!source)
+        return STATUS_SD_FAILED_OPEN_FILE;
+    String out_path = String(path) + SD_COMPILED_SUFFIX;
+    sd_compile_out = fs.open(out_path.c_str(), FILE_WRITE);
+    if (!sd_compile_out) {
+        source.close();
+        return STATUS_SD_FAILED_OPEN_FILE;
+    }
+#ifdef SD_DIR_CACHE
+    if (&fs == &SD)
+        sd_dir_cache_invalidate(out_path.c_str());
+#endif
+    set_sd_state(SDCARD_BUSY_PARSING);
+    sd_compiled_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = SD_COMPILED_MAGIC;
+    header.n_axis = N_AXIS;
+    header.state_size = sizeof(parser_state_t);
+    header.start = gc_state;
+    sd_compile_out.write((const uint8_t*)&header, sizeof(header));
+    uint8_t state = sys.state;
+    sys.state = STATE_CHECK_MODE;
+    sd_compiling = true;
+    sd_compile_line = 0;
+    sd_compile_blocks = 0;
+    err_t status = STATUS_OK;
+    char line[256];
+    char text[256];
+    int len = 0;
+    while (status == STATUS_OK) {
+        int c = source.read();
+        if (c >= 0 && c != '\n') {
+            if (len == sizeof(line) - 1) {
+                status = STATUS_OVERFLOW;
+                break;
+            }
+            line[len++] = c;
+            continue;
+        }
+        if (c < 0 && len == 0)
+            break;
+        line[len] = '\0';
+        len = 0;
+        sd_compile_line++;
+        protocol_execute_realtime();
+        if (sys.abort) {
+            status = STATUS_SD_FAILED_READ;
+            break;
+        }
+        strcpy(text, line);
+        if (!gc_line_is_motion_only(text)) {
+            // Run as text, in the state the parser had here
+            sd_compile_state();
+            sd_text_record_t record = { sd_compile_line, (uint8_t)strlen(line) };
+            uint8_t type = SD_RECORD_TEXT;
+            sd_compile_out.write(&type, 1);
+            sd_compile_out.write((const uint8_t*)&record, sizeof(record));
+            sd_compile_out.write((const uint8_t*)line, record.len);
+        }
+        status = gc_execute_line(line, client);
+        if (status == STATUS_GCODE_UNSUPPORTED_COMMAND)
+            status = STATUS_OK; // Tolerated when the job runs, see report_status_message()
+        if (c < 0)
+            break;
+    }
+    sd_compile_state(); // Leaves the parser as the last line did
+    sd_compiling = false;
+    sd_compile_out.close();
+    source.close();
+    // The parser goes back to where it was. The compiled file sets it as it runs.
+    gc_state = header.start;
+    sys.state = state;
+    set_sd_state(SDCARD_IDLE);
+    if (status != STATUS_OK) {
+        fs.remove(out_path.c_str());
+        grbl_sendf(client, "error:%d in SD file at line %d\r\n", status, sd_compile_line);
+        return status;
+    }
+    grbl_msg_sendf(client, MSG_LEVEL_INFO, "Compiled %d lines into %s with %d motions", sd_compile_line, out_path.c_str(), sd_compile_blocks);
+    return STATUS_OK;
+}
+#endif
+
+#ifdef SD_RESUME
+// Returns the byte offset of the next line to be read.
+static uint32_t sd_position() {
+#ifdef SD_READ_AHEAD
+    return sd_bytes_done;
+#else
+    return myFile.position();
+#endif
+}
+
+void sd_index_begin(fs::FS& fs, const char* path) {
+#ifdef SD_COMPILE
+    if (sd_compiled)
+        return; // Compiled files run from the start only
+#endif
+#ifdef SD_GZIP
+    if (sd_gzip)
+        return; // Offsets into a compressed file can't be read from, so resume runs from the start
+#endif
+    String index_path = String(path) + SD_INDEX_SUFFIX;
+    sd_index = fs.open(index_path.c_str(), FILE_WRITE);
+    if (!sd_index)
+        return;
+#ifdef SD_DIR_CACHE
+    if (&fs == &SD)
+        sd_dir_cache_invalidate(index_path.c_str());
+#endif
+    sd_index_header_t header = { SD_INDEX_MAGIC, (uint32_t)myFile.size(), SD_INDEX_STRIDE, sizeof(parser_state_t) };
+    sd_index.write((const uint8_t*)&header, sizeof(header));
+    sd_indexing = true;
+}
+
+// Called before each line is read while the index is written.
+static void sd_index_line() {
+    if (!sd_indexing || sd_current_line_number == 0 || (sd_current_line_number % SD_INDEX_STRIDE) != 0)
+        return;
+    sd_index_entry_t entry;
+    entry.line = sd_current_line_number;
+    entry.offset = sd_position();
+    entry.state = gc_state;
+    sd_index.write((const uint8_t*)&entry, sizeof(entry));
+}
+
+// Finds the last index entry at or before line in the index of the job at path. Returns false
+// if there is no index for the file as it is now or no entry before line.
+static bool sd_index_find(fs::FS& fs, const char* path, uint32_t line, uint32_t file_size, sd_index_entry_t* entry) {
+    String index_path = String(path) + SD_INDEX_SUFFIX;
+    File index = fs.open(index_path.c_str());
+    if (!index)
+        return false;
+    sd_index_header_t header;
+    bool found = false;
+    if (index.read((uint8_t*)&header, sizeof(header)) == sizeof(header) && header.magic == SD_INDEX_MAGIC &&
+            header.file_size == file_size && header.state_size == sizeof(parser_state_t) && header.stride != 0) {
+        // The entries are every stride lines, so the one wanted is found by its position
+        uint32_t count = (index.size() - sizeof(header)) / sizeof(sd_index_entry_t);
+        uint32_t wanted = (line - 1) / header.stride; // Entry n has the (n + 1) * stride lines before it
+        if (wanted != 0) {
+            uint32_t n = MIN(wanted, count) - 1;
+            if (count != 0 && index.seek(sizeof(header) + n * sizeof(sd_index_entry_t)) &&
+                    index.read((uint8_t*)entry, sizeof(*entry)) == sizeof(*entry) && entry->line < line)
+                found = true;
+        }
+    }
+    index.close();
+    return found;
+}
+
+// Moves to the position of the parser, from above if it is lower, and restores the spindle and
+// coolant, for the job to go on from there.
+static void sd_resume_move() {
+    plan_line_data_t plan_data;
+    memset(&plan_data, 0, sizeof(plan_line_data_t));
+    plan_data.condition = PL_COND_FLAG_RAPID_MOTION;
+    float target[N_AXIS];
+    system_convert_array_steps_to_mpos(target, sys_position);
+    if (gc_state.position[Z_AXIS] > target[Z_AXIS]) {
+        target[Z_AXIS] = gc_state.position[Z_AXIS];
+        mc_line(target, &plan_data);
+    }
+    for (uint8_t idx = 0; idx < N_AXIS; idx++) {
+        if (idx != Z_AXIS)
+            target[idx] = gc_state.position[idx];
+    }
+    mc_line(target, &plan_data);
+    spindle->spindle_sync(gc_state.modal.spindle, (uint32_t)gc_state.spindle_speed);
+    coolant_sync(gc_state.modal.coolant);
+    target[Z_AXIS] = gc_state.position[Z_AXIS];
+    if (gc_state.feed_rate > 0.0 && gc_state.modal.feed_rate == FEED_RATE_MODE_UNITS_PER_MIN) {
+        plan_data.condition = gc_state.modal.spindle | gc_state.modal.coolant;
+        plan_data.feed_rate = gc_state.feed_rate;
+        plan_data.spindle_speed = gc_state.spindle_speed;
+    }
+    mc_line(target, &plan_data);
+}
+
+err_t sd_resume(fs::FS& fs, const char* path, uint32_t line, uint8_t client) {
+    File file = fs.open(path);
+    if (!file)
+        return STATUS_SD_FAILED_OPEN_FILE;
+    uint32_t file_size = file.size();
+    file.close();
+    sd_index_entry_t entry;
+    bool indexed = line > 1 && sd_index_find(fs, path, line, file_size, &entry);
+    if (!openFile(fs, path, indexed ? entry.offset : 0))
+        return STATUS_SD_FAILED_READ;
+#ifdef SD_COMPILE
+    if (sd_compiled) {
+        closeFile();
+        return STATUS_INVALID_STATEMENT; // Compiled files have no lines to start from
+    }
+#endif
+    parser_state_t start = gc_state;
+    if (indexed) {
+        sd_current_line_number = entry.line;
+        gc_state = entry.state;
+    }
+    // The lines before line are run in check mode, which gives the parser the state it would
+    // have there without moving.
+    uint8_t state = sys.state;
+    sys.state = STATE_CHECK_MODE;
+    err_t status = STATUS_OK;
+    char fileLine[255];
+    while (sd_current_line_number + 1 < line) {
+        if (!readFileLine(fileLine, 255)) {
+            status = STATUS_SD_FILE_EMPTY; // No such line
+            break;
+        }
+        status = gc_execute_line(fileLine, client);
+        if (status == STATUS_GCODE_UNSUPPORTED_COMMAND)
+            status = STATUS_OK;
+        if (status != STATUS_OK)
+            break;
+    }
+    sys.state = state;
+    if (status != STATUS_OK) {
+        gc_state = start;
+        closeFile();
+        grbl_sendf(client, "error:%d in SD file at line %d\r\n", status, sd_current_line_number);
+        return status;
+    }
+    grbl_msg_sendf(client, MSG_LEVEL_INFO, "Resuming at line %d", line);
+    system_flag_wco_change();
+    sd_resume_move();
+    return STATUS_OK;
+}
+#endif
+
+bool sd_run_next(uint8_t* status) {
+#ifdef SD_COMPILE
+    if (sd_compiled)
+        return sd_run_compiled(status);
+#endif
+#ifdef SD_RESUME
+    sd_index_line();
+#endif
+    char fileLine[255];
+    if (!readFileLine(fileLine, 255))
+        return false;
+    *status = gc_execute_line(fileLine, SD_client);
+    return true;
 }
 
 // return a percentage complete 50.5 = 50.5%
 float sd_report_perc_complete() {
+#ifdef SD_ESTIMATE
+    float percent;
+    uint32_t remaining_s;
+    if (sd_estimate_progress(sd_current_line_number, &percent, &remaining_s))
+        return percent;
+#endif
+#ifdef SD_READ_AHEAD
+    // The file position is ahead of the lines run by the blocks read
+    if (!sd_open || sd_file_size == 0)
+        return 0.0;
+    return ((float)sd_bytes_done / (float)sd_file_size * 100.0);
+#endif
     if (!myFile)
         return 0.0;
     return ((float)myFile.position() / (float)myFile.size() * 100.0);
@@ -136,14 +930,30 @@ uint8_t get_sd_state(bool refresh) {
     if (!refresh) {
         return sd_state;  //to avoid refresh=true + busy to reset SD and waste time
     }
+#ifdef SD_DIR_CACHE
+    if (!sd_dir_cache_lock_card(0))
+        return sd_state; // A directory is being listed from the card
+#endif
     //SD is idle or not detected, let see if still the case
     SD.end();
     sd_state = SDCARD_NOT_PRESENT;
     //using default value for speed ? should be parameter
     //refresh content if card was removed
+    int64_t mount_us = esp_timer_get_time();
     if (SD.begin((GRBL_SPI_SS == -1) ? SS : GRBL_SPI_SS, SPI, GRBL_SPI_FREQ)) {
         if (SD.cardSize() > 0)sd_state = SDCARD_IDLE;
     }
+    boot_phase("SD mount", mount_us); // The card is first mounted when it is first used
+#ifdef SD_DIR_CACHE
+    // The listings are kept while the same card stays in
+    static uint64_t card_size = 0;
+    uint64_t size = (sd_state == SDCARD_IDLE) ? SD.cardSize() : 0;
+    if (size != card_size) {
+        sd_dir_cache_clear();
+        card_size = size;
+    }
+    sd_dir_cache_unlock_card();
+#endif
     return sd_state;
 }
 
@@ -160,3 +970,100 @@ void sd_get_current_filename(char* name) {
 }
 
 
+#ifdef SD_JOB_QUEUE
+typedef struct {
+    char path[SD_QUEUE_PATH_SIZE];
+    uint16_t runs; // Runs left, with the one running
+} sd_queue_job_t;
+static sd_queue_job_t sd_queue[SD_QUEUE_JOBS];
+static uint8_t sd_queue_count = 0;
+static bool sd_queue_running = false; // sd_queue[0] is the job running
+
+// A /spiffs/ path is a file of the local file system, and any other one a file on the card
+static fs::FS& sd_queue_fs(const char* path, const char** fs_path) {
+    if (strncmp(path, "/spiffs/", 8) == 0) {
+        *fs_path = path + 7;
+        return SPIFFS;
+    }
+    *fs_path = path;
+    return SD;
+}
+
+// Opens the job at the front of the queue. The protocol loop runs its lines from the next pass,
+// or at once when a job just ended.
+static bool sd_queue_open(uint8_t client) {
+    const char* path;
+    fs::FS& fs = sd_queue_fs(sd_queue[0].path, &path);
+    if (&fs == &SPIFFS && !SPIFFS.begin(true))
+        return false;
+    if (!openFile(fs, path))
+        return false;
+#ifdef SD_RESUME
+    sd_index_begin(fs, path);
+#endif
+#ifdef SD_COMPILE
+    if (sd_job_compiled() && sd_compiled_start_check() != STATUS_OK) {
+        closeFile();
+        return false;
+    }
+#endif
+    SD_client = client;
+    SD_ready_next = true;
+    grbl_msg_sendf(client, MSG_LEVEL_INFO, "SD queue %s, %d runs left", sd_queue[0].path, sd_queue[0].runs);
+    return true;
+}
+
+err_t sd_queue_add(const char* path, uint16_t runs, uint8_t client) {
+    if (strlen(path) >= SD_QUEUE_PATH_SIZE || runs == 0)
+        return STATUS_INVALID_VALUE;
+    if (sd_queue_count == SD_QUEUE_JOBS)
+        return STATUS_SD_QUEUE_FULL;
+    sd_queue_job_t* job = &sd_queue[sd_queue_count++];
+    strcpy(job->path, path);
+    job->runs = runs;
+    if (sd_queue_running || sys.state != STATE_IDLE)
+        return STATUS_OK;
+    // Only a job that is not from the queue may be running, and the queue follows it
+    const char* fs_path;
+    bool on_card = (&sd_queue_fs(sd_queue[0].path, &fs_path) == &SD);
+    uint8_t state = get_sd_state(on_card);
+    if (state != SDCARD_IDLE && state != SDCARD_NOT_PRESENT)
+        return STATUS_OK;
+    if (state == SDCARD_NOT_PRESENT && on_card) {
+        sd_queue_clear();
+        return STATUS_SD_FAILED_MOUNT;
+    }
+    sd_queue_running = true;
+    if (!sd_queue_open(client)) {
+        sd_queue_clear();
+        return STATUS_SD_FAILED_READ;
+    }
+    return STATUS_OK;
+}
+
+bool sd_queue_next() {
+    if (sd_queue_running && --sd_queue[0].runs == 0) {
+        sd_queue_count--;
+        memmove(&sd_queue[0], &sd_queue[1], sd_queue_count * sizeof(sd_queue_job_t));
+    }
+    sd_queue_running = (sd_queue_count != 0);
+    if (!sd_queue_running)
+        return false;
+    if (sd_queue_open(SD_client))
+        return true;
+    grbl_notifyf("SD queue error", "%s could not be opened, the queue is cleared", sd_queue[0].path);
+    report_status_message(STATUS_SD_FAILED_READ, SD_client);
+    sd_queue_clear();
+    return false;
+}
+
+void sd_queue_clear() {
+    sd_queue_count = 0;
+    sd_queue_running = false;
+}
+
+void sd_queue_report(uint8_t client) {
+    for (uint8_t i = 0; i < sd_queue_count; i++)
+        grbl_sendf(client, "[SDQ:%s|RUNS:%d%s]\r\n", sd_queue[i].path, sd_queue[i].runs, (i == 0 && sd_queue_running) ? "|RUNNING" : "");
+}
+#endif
@@ -33,6 +33,67 @@
 #define SDCARD_BUSY_UPLOADING 4
 #define SDCARD_BUSY_PARSING 8
 
+// The most SD lines run in one pass of the main loop, before the clients are read again.
+#ifndef SD_LINES_PER_PASS
+    #define SD_LINES_PER_PASS 16
+#endif
+
+#ifdef SD_COMPILE
+// Added to the name of a file to name its compiled file. See $SD/Compile.
+    #ifndef SD_COMPILED_SUFFIX
+        #define SD_COMPILED_SUFFIX ".gcb"
+    #endif
+// How far the start position and offsets may be from those of the compile, in mm.
+    #ifndef SD_COMPILED_TOLERANCE
+        #define SD_COMPILED_TOLERANCE 0.001
+    #endif
+#endif
+
+#ifdef SD_RESUME
+// Added to the name of a job to name its line index, with an entry every SD_INDEX_STRIDE lines.
+    #ifndef SD_INDEX_SUFFIX
+        #define SD_INDEX_SUFFIX ".idx"
+    #endif
+    #ifndef SD_INDEX_STRIDE
+        #define SD_INDEX_STRIDE 256
+    #endif
+#endif
+
+#ifdef SD_READ_AHEAD
+// Size and number of the blocks read ahead of the running lines.
+    #ifndef SD_READ_BLOCK_SIZE
+        #define SD_READ_BLOCK_SIZE 8192
+    #endif
+    #ifndef SD_READ_BLOCKS
+        #define SD_READ_BLOCKS 2
+    #endif
+#endif
+
+#ifdef SD_GZIP
+    #include "rom/miniz.h"
+// Size of the buffer the compressed bytes of a *.gz job are read into.
+    #ifndef SD_GZIP_IN_SIZE
+        #define SD_GZIP_IN_SIZE 4096
+    #endif
+#endif
+
+#ifdef SD_JOB_QUEUE
+// Jobs the queue holds, each with a repeat count, and the longest path of one
+    #ifndef SD_QUEUE_JOBS
+        #define SD_QUEUE_JOBS 16
+    #endif
+    #ifndef SD_QUEUE_PATH_SIZE
+        #define SD_QUEUE_PATH_SIZE 64
+    #endif
+#endif
+
+#ifdef SD_UPLOAD_BUFFER
+// Size of the RAM buffer WebUI uploads are written from. Must be a multiple of 512 bytes.
+    #ifndef SD_UPLOAD_BUFFER_SIZE
+        #define SD_UPLOAD_BUFFER_SIZE 16384
+    #endif
+#endif
+
 
 
 extern bool SD_ready_next; // Grbl has processed a line and is waiting for another
@@ -42,7 +103,8 @@ extern  uint8_t SD_client;
 uint8_t get_sd_state(bool refresh);
 uint8_t set_sd_state(uint8_t flag);
 void listDir(fs::FS& fs, const char* dirname, uint8_t levels, uint8_t client);
-boolean openFile(fs::FS& fs, const char* path);
+// Opens a job. It starts at byte offset, which must be the start of a line.
+boolean openFile(fs::FS& fs, const char* path, uint32_t offset = 0);
 boolean closeFile();
 boolean readFileLine(char* line, int len);
 void readFile(fs::FS& fs, const char* path);
@@ -50,4 +112,41 @@ float sd_report_perc_complete();
 uint32_t sd_get_current_line_number();
 void sd_get_current_filename(char* name);
 
+// Reads and runs the next line of the open job. Returns false at the end of the job, and else
+// sets status to that of the line.
+bool sd_run_next(uint8_t* status);
+
+#ifdef SD_RESUME
+// Starts writing the line index of the job just opened at its start.
+void sd_index_begin(fs::FS& fs, const char* path);
+// Opens the job at path to run from line, the first line being 1. The parser state is that of
+// the lines before it, found from the closest index entry. The machine then moves to the position
+// there, from above, and the spindle and coolant are restored.
+err_t sd_resume(fs::FS& fs, const char* path, uint32_t line, uint8_t client);
+#endif
+
+#ifdef SD_JOB_QUEUE
+// Adds runs runs of the job at path, a card path or a /spiffs/ path, to the end of the queue. The
+// queue starts at once when the machine is idle and no job runs, and else after the job running.
+err_t sd_queue_add(const char* path, uint16_t runs, uint8_t client);
+// Called by the protocol loop when a job has run its last line and is closed. Opens the next job
+// of the queue, if any, and returns true. Its lines then follow without waiting for the planner.
+bool sd_queue_next();
+// Empties the queue. The job running goes on, but no other job follows it.
+void sd_queue_clear();
+void sd_queue_report(uint8_t client);
+#endif
+
+#ifdef SD_COMPILE
+// Runs the file at path through the parser in check mode and writes the compiled file next to
+// it. Reports the error and the line it is on, if any.
+err_t sd_compile_file(fs::FS& fs, const char* path, uint8_t client);
+// Called by mc_line() in check mode. Writes the motion to the file being compiled.
+void sd_compile_motion(float* target, plan_line_data_t* pl_data);
+// Returns true if the open job is a compiled file.
+bool sd_job_compiled();
+// Returns STATUS_SD_COMPILED_MISMATCH if the job was compiled at another position or offsets.
+err_t sd_compiled_start_check();
+#endif
+
 #endif
@@ -0,0 +1,259 @@
+/*
+  heap_trace.cpp - counts the heap allocations of the modules that allocate the most
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef HEAP_TRACE
+
+// malloc(), calloc(), realloc() and free() are wrapped by the linker, see HEAP_TRACE in config.h,
+// so new, String and the libraries are seen too. Each allocation is counted for the tag of the
+// HEAP_TAG_SCOPE the calling task is in. The tagged ones are also kept in a hash table of
+// HEAP_TRACE_SLOTS, so their free finds the tag and size again and the live bytes of each tag
+// can be followed. A tag whose live bytes keep growing over days is the leak. Allocations the
+// heap makes directly with heap_caps_malloc(), like those of the WiFi driver, are not seen.
+
+#if HEAP_TRACE_SLOTS & (HEAP_TRACE_SLOTS - 1)
+    #error "HEAP_TRACE_SLOTS must be a power of two"
+#endif
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+}
+
+typedef struct {
+    uint32_t allocs;
+    uint32_t frees; // Of allocations that were followed
+    uint32_t failed;
+    uint64_t bytes; // Requested, over all allocations
+    uint32_t live;  // Bytes allocated and not freed yet
+    uint32_t peak;  // The most live bytes
+    uint32_t largest;
+} heap_tag_stats_t;
+
+typedef struct {
+    void* ptr; // NULL when the slot is free
+    uint32_t size : 24;
+    uint32_t tag : 8;
+} heap_slot_t;
+
+typedef struct {
+    TaskHandle_t task;
+    heap_tag_t tag;
+} heap_task_tag_t;
+
+static heap_tag_stats_t heap_stats[HEAP_TAG_COUNT];
+static heap_slot_t heap_slots[HEAP_TRACE_SLOTS];
+static heap_task_tag_t heap_task_tags[HEAP_TRACE_TASKS];
+static uint32_t heap_slots_used;
+static uint32_t heap_untracked; // Tagged allocations that did not fit in heap_slots
+static portMUX_TYPE heap_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static const char* const heap_tag_names[HEAP_TAG_COUNT] = {
+    "Other", "WebServer", "WebSockets", "JSONencoder", "Notifications", "Motion",
+};
+
+static inline uint32_t heap_slot_home(const void* ptr) {
+    return (((uint32_t)ptr >> 3) * 2654435761u) & (HEAP_TRACE_SLOTS - 1);
+}
+
+// The tag of the calling task. Called with heap_mux held.
+static heap_tag_t heap_current_tag() {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    if (task == NULL)
+        return HEAP_TAG_OTHER; // Before the scheduler started
+    for (uint8_t i = 0; i < HEAP_TRACE_TASKS; i++) {
+        if (heap_task_tags[i].task == task)
+            return heap_task_tags[i].tag;
+    }
+    return HEAP_TAG_OTHER;
+}
+
+HeapTagScope::HeapTagScope(heap_tag_t tag) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    previous = HEAP_TAG_OTHER;
+    portENTER_CRITICAL(&heap_mux);
+    int8_t free_slot = -1;
+    uint8_t i;
+    for (i = 0; i < HEAP_TRACE_TASKS; i++) {
+        if (heap_task_tags[i].task == task)
+            break;
+        if (heap_task_tags[i].task == NULL && free_slot < 0)
+            free_slot = i;
+    }
+    if (i < HEAP_TRACE_TASKS) {
+        previous = heap_task_tags[i].tag;
+        heap_task_tags[i].tag = tag;
+    } else if (free_slot >= 0) {
+        heap_task_tags[free_slot].task = task;
+        heap_task_tags[free_slot].tag = tag;
+    } // Else too many tasks. Its allocations stay Other.
+    portEXIT_CRITICAL(&heap_mux);
+}
+
+HeapTagScope::~HeapTagScope() {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    portENTER_CRITICAL(&heap_mux);
+    for (uint8_t i = 0; i < HEAP_TRACE_TASKS; i++) {
+        if (heap_task_tags[i].task == task) {
+            heap_task_tags[i].tag = previous;
+            if (previous == HEAP_TAG_OTHER)
+                heap_task_tags[i].task = NULL;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&heap_mux);
+}
+
+static void heap_trace_alloc(void* ptr, size_t size) {
+    portENTER_CRITICAL(&heap_mux);
+    heap_tag_t tag = heap_current_tag();
+    heap_tag_stats_t* stats = &heap_stats[tag];
+    if (ptr == NULL) {
+        stats->failed++;
+        portEXIT_CRITICAL(&heap_mux);
+        return;
+    }
+    stats->allocs++;
+    stats->bytes += size;
+    if (size > stats->largest)
+        stats->largest = size;
+    if (tag != HEAP_TAG_OTHER) {
+        // Linear probing. A quarter of the table is kept free, so the probes stay short.
+        uint32_t slot = heap_slot_home(ptr);
+        if (heap_slots_used < HEAP_TRACE_SLOTS - HEAP_TRACE_SLOTS / 4 && size < bit(24)) {
+            while (heap_slots[slot].ptr != NULL)
+                slot = (slot + 1) & (HEAP_TRACE_SLOTS - 1);
+            heap_slots[slot].ptr = ptr;
+            heap_slots[slot].size = size;
+            heap_slots[slot].tag = tag;
+            heap_slots_used++;
+            stats->live += size;
+            if (stats->live > stats->peak)
+                stats->peak = stats->live;
+        } else
+            heap_untracked++;
+    }
+    portEXIT_CRITICAL(&heap_mux);
+}
+
+static void heap_trace_free(void* ptr) {
+    if (ptr == NULL)
+        return;
+    portENTER_CRITICAL(&heap_mux);
+    uint32_t slot = heap_slot_home(ptr);
+    while (heap_slots[slot].ptr != NULL && heap_slots[slot].ptr != ptr)
+        slot = (slot + 1) & (HEAP_TRACE_SLOTS - 1);
+    if (heap_slots[slot].ptr == ptr) {
+        heap_tag_stats_t* stats = &heap_stats[heap_slots[slot].tag];
+        stats->frees++;
+        stats->live -= heap_slots[slot].size;
+        // Removes the slot and moves the later entries of the probe chain back into the hole
+        uint32_t hole = slot;
+        heap_slots[hole].ptr = NULL;
+        heap_slots_used--;
+        for (uint32_t next = (hole + 1) & (HEAP_TRACE_SLOTS - 1); heap_slots[next].ptr != NULL;
+             next = (next + 1) & (HEAP_TRACE_SLOTS - 1)) {
+            uint32_t home = heap_slot_home(heap_slots[next].ptr);
+            // The entry may move if its home is not within (hole, next], cyclically
+            bool stays = (hole <= next) ? (hole < home && home <= next) : (hole < home || home <= next);
+            if (stays)
+                continue;
+            heap_slots[hole] = heap_slots[next];
+            heap_slots[next].ptr = NULL;
+            hole = next;
+        }
+    }
+    portEXIT_CRITICAL(&heap_mux);
+}
+
+extern "C" {
+void* __wrap_malloc(size_t size) {
+    void* ptr = __real_malloc(size);
+    heap_trace_alloc(ptr, size);
+    return ptr;
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    void* ptr = __real_calloc(count, size);
+    heap_trace_alloc(ptr, count * size);
+    return ptr;
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    heap_trace_free(ptr);
+    void* moved = __real_realloc(ptr, size);
+    if (size == 0)
+        return moved; // Freed
+    if (moved == NULL && ptr != NULL)
+        heap_trace_alloc(ptr, heap_caps_get_allocated_size(ptr)); // Failed, the old block stays
+    heap_trace_alloc(moved, size);
+    return moved;
+}
+
+void __wrap_free(void* ptr) {
+    heap_trace_free(ptr);
+    __real_free(ptr);
+}
+}
+
+void heap_trace_report(void (*print)(const char* line)) {
+    heap_tag_stats_t stats[HEAP_TAG_COUNT];
+    portENTER_CRITICAL(&heap_mux);
+    memcpy(stats, heap_stats, sizeof(stats));
+    uint32_t untracked = heap_untracked;
+    portEXIT_CRITICAL(&heap_mux);
+    char line[120];
+    print("Tag           allocs   frees  failed    total KB    live    peak largest");
+    for (uint8_t tag = 0; tag < HEAP_TAG_COUNT; tag++) {
+        heap_tag_stats_t* s = &stats[tag];
+        if (tag == HEAP_TAG_OTHER)
+            snprintf(line, sizeof(line), "%-13s %7u       -  %6u %11u       -       - %7u", heap_tag_names[tag], s->allocs,
+                     s->failed, (uint32_t)(s->bytes / 1024), s->largest);
+        else
+            snprintf(line, sizeof(line), "%-13s %7u %7u  %6u %11u %7u %7u %7u", heap_tag_names[tag], s->allocs, s->frees,
+                     s->failed, (uint32_t)(s->bytes / 1024), s->live, s->peak, s->largest);
+        print(line);
+    }
+    if (untracked) {
+        snprintf(line, sizeof(line), "%u tagged allocations were not followed, the table was full", untracked);
+        print(line);
+    }
+    if (stats[HEAP_TAG_MOTION].allocs) {
+        snprintf(line, sizeof(line), "Warning: %u allocations in the motion path", stats[HEAP_TAG_MOTION].allocs);
+        print(line);
+    }
+    snprintf(line, sizeof(line), "Heap free %u, largest block %u, lowest free %u", ESP.getFreeHeap(),
+             heap_caps_get_largest_free_block(MALLOC_CAP_8BIT), ESP.getMinFreeHeap());
+    print(line);
+}
+
+void heap_trace_clear() {
+    portENTER_CRITICAL(&heap_mux);
+    for (uint8_t tag = 0; tag < HEAP_TAG_COUNT; tag++) {
+        uint32_t live = heap_stats[tag].live;
+        memset(&heap_stats[tag], 0, sizeof(heap_tag_stats_t));
+        heap_stats[tag].live = heap_stats[tag].peak = live;
+    }
+    heap_untracked = 0;
+    portEXIT_CRITICAL(&heap_mux);
+}
+
+#endif
@@ -0,0 +1,68 @@
+/*
+  heap_trace.h - counts the heap allocations of the modules that allocate the most
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef heap_trace_h
+#define heap_trace_h
+
+#ifdef HEAP_TRACE
+
+// Live allocations of the tagged modules that can be followed to their free. Must be a power
+// of two. Each takes 8 bytes.
+#ifndef HEAP_TRACE_SLOTS
+    #define HEAP_TRACE_SLOTS 512
+#endif
+
+// Tasks that can be inside a tagged scope at the same time
+#ifndef HEAP_TRACE_TASKS
+    #define HEAP_TRACE_TASKS 8
+#endif
+
+// Who made an allocation. HEAP_TAG_OTHER is everything outside a tagged scope.
+enum heap_tag_t : uint8_t {
+    HEAP_TAG_OTHER = 0,
+    HEAP_TAG_WEB_SERVER,    // web_server.cpp and the WebServer library under it
+    HEAP_TAG_WEBSOCKETS,    // The WebSockets library
+    HEAP_TAG_JSON,          // JSONencoder
+    HEAP_TAG_NOTIFICATIONS, // notifications_service.cpp
+    HEAP_TAG_MOTION,        // The planner and the segment prep, which should never allocate
+    HEAP_TAG_COUNT,
+};
+
+// Tags the allocations of the calling task until the end of the scope. Scopes nest, the
+// innermost tag wins.
+class HeapTagScope {
+  public:
+    HeapTagScope(heap_tag_t tag);
+    ~HeapTagScope();
+
+  private:
+    heap_tag_t previous;
+};
+
+    #define HEAP_TAG_SCOPE(tag) HeapTagScope heap_tag_scope_(tag)
+
+// Writes the counts of each tag as lines of text. See [ESP421].
+void heap_trace_report(void (*print)(const char* line));
+// Clears the counts, but not the live allocations, which are still followed to their free
+void heap_trace_clear();
+
+#else
+    #define HEAP_TAG_SCOPE(tag)
+#endif
+
+#endif
@@ -0,0 +1,161 @@
+/*
+  height_map.cpp - on-controller surface probing and Z compensation
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef HEIGHT_MAP
+
+// The grid, in machine coordinates. z is row by row from the x0,y0 corner, relative to that
+// first point.
+static float map_x0, map_y0, map_dx, map_dy;
+static uint8_t map_nx = 0, map_ny = 0;
+static float map_z[HEIGHT_MAP_MAX_POINTS];
+static bool map_valid = false;
+static bool map_on = false;
+static bool map_splitting = false; // height_map_line() is planning the pieces of a line
+
+// The probe sequence goes back and forth along the rows, so the travel between points is short.
+static uint8_t map_probe_nx;
+static float map_probe_first_z;
+
+static uint16_t height_map_cell(uint16_t point) {
+    uint8_t row = point / map_probe_nx;
+    uint8_t col = point % map_probe_nx;
+    if (row & 1)
+        col = map_probe_nx - 1 - col;
+    return row * map_probe_nx + col;
+}
+
+static void height_map_hit(uint16_t point, const float* position) {
+    if (point == 0)
+        map_probe_first_z = position[Z_AXIS];
+    map_z[height_map_cell(point)] = position[Z_AXIS] - map_probe_first_z;
+    report_probe_parameters(CLIENT_ALL);
+}
+
+bool height_map_probe(float x0, float y0, float x1, float y1, uint8_t nx, uint8_t ny) {
+    if (nx < 2 || ny < 2 || nx * ny > HEIGHT_MAP_MAX_POINTS || x1 == x0 || y1 == y0)
+        return false;
+    height_map_clear();
+    static float xy[2 * HEIGHT_MAP_MAX_POINTS];
+    float dx = (x1 - x0) / (nx - 1);
+    float dy = (y1 - y0) / (ny - 1);
+    map_probe_nx = nx;
+    for (uint16_t point = 0; point < nx * ny; point++) {
+        uint16_t cell = height_map_cell(point);
+        xy[2 * point] = x0 + (cell % nx) * dx;
+        xy[2 * point + 1] = y0 + (cell / nx) * dy;
+    }
+    float z_floor = system_convert_axis_steps_to_mpos(sys_position, Z_AXIS) - probe_depth->get();
+    if (!mc_probe_sequence(xy, nx * ny, z_floor, probe_clearance->get(), probe_feed->get(), height_map_hit))
+        return true; // The alarm tells what went wrong
+    map_x0 = x0;
+    map_y0 = y0;
+    map_dx = dx;
+    map_dy = dy;
+    map_nx = nx;
+    map_ny = ny;
+    map_valid = true;
+    map_on = true;
+    return true;
+}
+
+void height_map_clear() {
+    map_valid = false;
+    map_on = false;
+}
+
+bool height_map_enable(bool on) {
+    if (on && !map_valid)
+        return false;
+    map_on = on;
+    return true;
+}
+
+bool height_map_active() {
+    return map_on;
+}
+
+// Bilinear interpolation in the cell of x,y. Outside the grid, the nearest edge is extended.
+static float height_map_offset(float x, float y) {
+    float u = (x - map_x0) / map_dx;
+    float v = (y - map_y0) / map_dy;
+    u = MIN(MAX(u, 0.0f), (float)(map_nx - 1));
+    v = MIN(MAX(v, 0.0f), (float)(map_ny - 1));
+    uint8_t col = MIN((uint8_t)u, map_nx - 2);
+    uint8_t row = MIN((uint8_t)v, map_ny - 2);
+    u -= col;
+    v -= row;
+    const float* z = &map_z[row * map_nx + col];
+    float bottom = z[0] + (z[1] - z[0]) * u;
+    float top = z[map_nx] + (z[map_nx + 1] - z[map_nx]) * u;
+    return bottom + (top - bottom) * v;
+}
+
+bool height_map_line(float* target, plan_line_data_t* pl_data) {
+    if (!map_on || map_splitting || sys.state == STATE_JOG || sys.state == STATE_CHECK_MODE)
+        return false;
+    if (pl_data->condition & PL_COND_FLAG_SYSTEM_MOTION)
+        return false;
+#ifdef LASER_RASTER
+    if (pl_data->raster)
+        return false; // The pixel pitch comes from the length of the block
+#endif
+    // The planner position less the offset there is where the line starts on the surface.
+    float start[N_AXIS];
+    plan_get_position(start);
+    start[Z_AXIS] -= height_map_offset(start[X_AXIS], start[Y_AXIS]);
+    float dx = target[X_AXIS] - start[X_AXIS];
+    float dy = target[Y_AXIS] - start[Y_AXIS];
+    uint16_t n_pieces = MAX(1, (uint16_t)ceilf(hypot_f(dx, dy) / HEIGHT_MAP_SEGMENT_LENGTH));
+    // An inverse time feed is the time of the whole line, so each piece runs in a part of it.
+    plan_line_data_t piece_data = *pl_data;
+    if (piece_data.condition & PL_COND_FLAG_INVERSE_TIME)
+        piece_data.feed_rate *= n_pieces;
+    float piece[N_AXIS];
+    map_splitting = true;
+    for (uint16_t i = 1; i <= n_pieces; i++) {
+        float fraction = (float)i / n_pieces;
+        for (uint8_t idx = 0; idx < N_AXIS; idx++)
+            piece[idx] = (i == n_pieces) ? target[idx] : start[idx] + (target[idx] - start[idx]) * fraction;
+        piece[Z_AXIS] += height_map_offset(piece[X_AXIS], piece[Y_AXIS]);
+        mc_line(piece, &piece_data);
+        if (sys.abort)
+            break;
+    }
+    map_splitting = false;
+    return true;
+}
+
+void height_map_report(uint8_t client) {
+    if (!map_valid) {
+        grbl_send(client, "[MSG:No height map]\r\n");
+        return;
+    }
+    grbl_sendf(client, "[HM:%d,%d,%4.3f,%4.3f,%4.3f,%4.3f:%s]\r\n", map_nx, map_ny, map_x0, map_y0, map_dx, map_dy, map_on ? "ON" : "OFF");
+    char line[16 * HEIGHT_MAP_MAX_POINTS / 2];
+    for (uint8_t row = 0; row < map_ny; row++) {
+        strcpy(line, "[HM");
+        for (uint8_t col = 0; col < map_nx; col++)
+            sprintf(line + strlen(line), "%c%4.3f", col ? ',' : ':', map_z[row * map_nx + col]);
+        strcat(line, "]\r\n");
+        grbl_send(client, line);
+    }
+}
+
+#endif
@@ -0,0 +1,48 @@
+/*
+  height_map.h - on-controller surface probing and Z compensation
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef height_map_h
+#define height_map_h
+
+#ifdef HEIGHT_MAP
+
+#ifndef PROBE_SEQUENCE
+    #error "HEIGHT_MAP needs PROBE_SEQUENCE"
+#endif
+
+// Probes nx by ny points over the rectangle from x0,y0 to x1,y1, in machine coordinates, and
+// turns the compensation on if every point was probed. Returns false if the grid is invalid.
+bool height_map_probe(float x0, float y0, float x1, float y1, uint8_t nx, uint8_t ny);
+
+void height_map_clear();
+// Turns the compensation on and off. Returns false when there is no map to turn on.
+bool height_map_enable(bool on);
+
+// Plans target with the compensation, in pieces through mc_line(). Returns false when the line is
+// not compensated, and mc_line() plans it as it is. Called by mc_line().
+bool height_map_line(float* target, plan_line_data_t* pl_data);
+
+// True when lines are compensated
+bool height_map_active();
+
+// Sends the grid and the heights, one row of the map per line. See $HeightMap.
+void height_map_report(uint8_t client);
+
+#endif
+
+#endif
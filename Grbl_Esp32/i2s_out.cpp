@@ -54,6 +54,7 @@
 
 #include "Pins.h"
 #include "i2s_out.h"
+#include "task_map.h"
 
 //
 // Configrations for DMA connected I2S
@@ -68,12 +69,21 @@
 // but on the other hand, it leads to a delay with pulse and/or non-pulse-generated I/Os.
 // The number of I2S_OUT_DMABUF_COUNT should be chosen carefully.
 //
+// The values above are only the defaults. The pulse time and the buffer count and size
+// in use are passed to i2s_out_init(), so they can be tuned at boot without a rebuild.
+//
 // Reference information:
 //   FreeRTOS task time slice = portTICK_PERIOD_MS = 1 ms (ESP32 FreeRTOS port)
 //
 #define I2S_SAMPLE_SIZE   4     /* 4 bytes, 32 bits per sample */
-#define DMA_SAMPLE_COUNT I2S_OUT_DMABUF_LEN / I2S_SAMPLE_SIZE /* number of samples per buffer */
-#define SAMPLE_SAFE_COUNT (20/I2S_OUT_USEC_PER_PULSE) /* prevent buffer overrun (GRBL's $0 should be less than or equal 20) */
+
+// Bitstream timing. Set by i2s_out_init().
+static uint32_t i2s_out_usec_per_pulse = I2S_OUT_USEC_PER_PULSE;
+static uint32_t i2s_out_dmabuf_count = I2S_OUT_DMABUF_COUNT;
+static uint32_t i2s_out_dmabuf_len = I2S_OUT_DMABUF_LEN; /* size in bytes */
+static uint32_t dma_sample_count = I2S_OUT_DMABUF_LEN / I2S_SAMPLE_SIZE; /* number of samples per buffer */
+static uint32_t sample_safe_count = 20 / I2S_OUT_USEC_PER_PULSE; /* prevent buffer overrun (GRBL's $0 should be less than or equal 20) */
+static uint32_t i2s_out_delay_dmabuf_ms = I2S_OUT_DMABUF_LEN / I2S_SAMPLE_SIZE * I2S_OUT_USEC_PER_PULSE / 1000; /* time of one DMA buffer */
 
 #ifdef USE_I2S_OUT_STREAM
 typedef struct {
@@ -82,10 +92,13 @@ typedef struct {
   uint32_t     rw_pos;
   lldesc_t     **desc;
   xQueueHandle queue;
+  lldesc_t     *tx_desc;   // The descriptor being transmitted (updated by the ISR)
+  lldesc_t     *fill_desc; // The descriptor being filled by the task
 } i2s_out_dma_t;
 
 static i2s_out_dma_t o_dma;
 static intr_handle_t i2s_out_isr_handle;
+static bool i2s_out_stream_ready = false; // The DMA buffers, ISR and task are set up
 #endif
 
 // output value
@@ -104,6 +117,7 @@ static int i2s_out_initialized = 0;
 static volatile uint32_t i2s_out_pulse_period;
 static uint32_t i2s_out_remain_time_until_next_pulse; // Time remaining until the next pulse (μsec)
 static volatile i2s_out_pulse_func_t i2s_out_pulse_func;
+static volatile i2s_out_buffer_func_t i2s_out_buffer_func;
 #endif
 
 static uint8_t i2s_out_ws_pin = 255;
@@ -163,26 +177,35 @@ static void IRAM_ATTR i2s_out_reset_fifo() {
 static int IRAM_ATTR i2s_clear_dma_buffer(lldesc_t *dma_desc, uint32_t port_data) {
 
   uint32_t *buf = (uint32_t*)dma_desc->buf;
-  for (int i = 0; i < DMA_SAMPLE_COUNT; i++) {
+  for (int i = 0; i < dma_sample_count; i++) {
     buf[i] = port_data;
   }
   // Restore the buffer length.
   // The length may have been changed short when the data was filled in to prevent buffer overrun.
-  dma_desc->length = I2S_OUT_DMABUF_LEN;
+  dma_desc->length = i2s_out_dmabuf_len;
   return 0;
 }
 
+static uint32_t IRAM_ATTR i2s_out_desc_index(lldesc_t *dma_desc) {
+  for (uint32_t buf_idx = 0; buf_idx < i2s_out_dmabuf_count; buf_idx++) {
+    if (o_dma.desc[buf_idx] == dma_desc) {
+      return buf_idx;
+    }
+  }
+  return 0; // not reached
+}
+
 static int IRAM_ATTR i2s_clear_o_dma_buffers(uint32_t port_data) {
-  for (int buf_idx = 0; buf_idx < I2S_OUT_DMABUF_COUNT; buf_idx++) {
+  for (int buf_idx = 0; buf_idx < i2s_out_dmabuf_count; buf_idx++) {
     // Initialize DMA descriptor
     o_dma.desc[buf_idx]->owner = 1;
     o_dma.desc[buf_idx]->eof = 1; // set to 1 will trigger the interrupt
     o_dma.desc[buf_idx]->sosf = 0;
-    o_dma.desc[buf_idx]->length = I2S_OUT_DMABUF_LEN;
-    o_dma.desc[buf_idx]->size = I2S_OUT_DMABUF_LEN;
+    o_dma.desc[buf_idx]->length = i2s_out_dmabuf_len;
+    o_dma.desc[buf_idx]->size = i2s_out_dmabuf_len;
     o_dma.desc[buf_idx]->buf = (uint8_t *) o_dma.buffers[buf_idx];
     o_dma.desc[buf_idx]->offset = 0;
-    o_dma.desc[buf_idx]->qe.stqe_next = (lldesc_t *)((buf_idx < (I2S_OUT_DMABUF_COUNT - 1)) ? (o_dma.desc[buf_idx + 1]) : o_dma.desc[0]);
+    o_dma.desc[buf_idx]->qe.stqe_next = (lldesc_t *)((buf_idx < (i2s_out_dmabuf_count - 1)) ? (o_dma.desc[buf_idx + 1]) : o_dma.desc[0]);
     i2s_clear_dma_buffer(o_dma.desc[buf_idx], port_data);
   }
   return 0;
@@ -280,13 +303,17 @@ static int IRAM_ATTR i2s_out_start() {
 #endif
 
 #ifdef USE_I2S_OUT_STREAM
-  //reset DMA
-  I2S0.lc_conf.in_rst = 1;
-  I2S0.lc_conf.in_rst = 0;
-  I2S0.lc_conf.out_rst = 1;
-  I2S0.lc_conf.out_rst = 0;
-
-  I2S0.out_link.addr = (uint32_t)o_dma.desc[0];
+  if (i2s_out_stream_ready) {
+    //reset DMA
+    I2S0.lc_conf.in_rst = 1;
+    I2S0.lc_conf.in_rst = 0;
+    I2S0.lc_conf.out_rst = 1;
+    I2S0.lc_conf.out_rst = 0;
+
+    I2S0.out_link.addr = (uint32_t)o_dma.desc[0];
+    o_dma.tx_desc = o_dma.desc[0];
+    o_dma.fill_desc = NULL;
+  }
 #endif
 
   I2S0.conf.tx_reset = 1;
@@ -297,11 +324,13 @@ static int IRAM_ATTR i2s_out_start() {
   I2S0.conf1.tx_stop_en = 1; // BCK and WCK are suppressed while FIFO is empty
 
 #ifdef USE_I2S_OUT_STREAM
-  // Connect DMA to FIFO
-  I2S0.fifo_conf.dscr_en = 1; // Set this bit to enable I2S DMA mode. (R/W)
+  if (i2s_out_stream_ready) {
+    // Connect DMA to FIFO
+    I2S0.fifo_conf.dscr_en = 1; // Set this bit to enable I2S DMA mode. (R/W)
 
-  I2S0.int_clr.val = 0xFFFFFFFF;
-  I2S0.out_link.start = 1;
+    I2S0.int_clr.val = 0xFFFFFFFF;
+    I2S0.out_link.start = 1;
+  }
 #endif
   I2S0.conf.tx_start = 1;
   // Wait for the first FIFO data to prevent the unintentional generation of 0 data
@@ -318,6 +347,10 @@ static int IRAM_ATTR i2s_out_start() {
 static int IRAM_ATTR i2s_fillout_dma_buffer(lldesc_t *dma_desc) {
   uint32_t *buf = (uint32_t*)dma_desc->buf;
   o_dma.rw_pos = 0;
+  o_dma.fill_desc = dma_desc;
+  if (i2s_out_buffer_func != NULL) {
+    (*i2s_out_buffer_func)(i2s_out_desc_index(dma_desc));
+  }
   // It reuses the oldest (just transferred) buffer with the name "current"
   // and fills the buffer for later DMA.
   I2S_OUT_PULSER_ENTER_CRITICAL(); // Lock pulser status
@@ -327,21 +360,21 @@ static int IRAM_ATTR i2s_fillout_dma_buffer(lldesc_t *dma_desc) {
     //
     // To avoid buffer overflow, all of the maximum pulse width (normaly about 10us)
     // is adjusted to be in a single buffer.
-    // DMA_SAMPLE_SAFE_COUNT is referred to as the margin value.
+    // sample_safe_count is referred to as the margin value.
     // Therefore, if a buffer is close to full and it is time to generate a pulse,
     // the generation of the buffer is interrupted (the buffer length is shortened slightly)
     // and the pulse generation is postponed until the next buffer is filled.
     //
     o_dma.rw_pos = 0;
-    while (o_dma.rw_pos < (DMA_SAMPLE_COUNT - SAMPLE_SAFE_COUNT)) {
+    while (o_dma.rw_pos < (dma_sample_count - sample_safe_count)) {
         // no data to read (buffer empty)
-        if (i2s_out_remain_time_until_next_pulse < I2S_OUT_USEC_PER_PULSE) {
+        if (i2s_out_remain_time_until_next_pulse < i2s_out_usec_per_pulse) {
           // pulser status may change in pulse phase func, so I need to check it every time.
           if (i2s_out_pulser_status == STEPPING) {
             // fillout future DMA buffer (tail of the DMA buffer chains)
             if (i2s_out_pulse_func != NULL) {
               I2S_OUT_PULSER_EXIT_CRITICAL(); // Temporarily unlocked status lock as it may be locked in pulse callback.
-              (*i2s_out_pulse_func)(); // should be pushed into buffer max DMA_SAMPLE_SAFE_COUNT
+              (*i2s_out_pulse_func)(); // should be pushed into buffer max sample_safe_count
               I2S_OUT_PULSER_ENTER_CRITICAL(); // Lock again.
               i2s_out_remain_time_until_next_pulse = i2s_out_pulse_period;
               if (i2s_out_pulser_status == WAITING) {
@@ -355,7 +388,7 @@ static int IRAM_ATTR i2s_fillout_dma_buffer(lldesc_t *dma_desc) {
                 // To prevent the pulse function from being called back,
                 // we assume that the buffer is already full.
                 i2s_out_remain_time_until_next_pulse = 0; // There is no need to fill the current buffer.
-                o_dma.rw_pos = DMA_SAMPLE_COUNT; // The buffer is full.
+                o_dma.rw_pos = dma_sample_count; // The buffer is full.
                 break;
               }
               continue;
@@ -363,9 +396,24 @@ static int IRAM_ATTR i2s_fillout_dma_buffer(lldesc_t *dma_desc) {
           }
         }
         // no pulse data in push buffer (pulse off or idle or callback is not defined)
-        buf[o_dma.rw_pos++] = atomic_load(&i2s_out_port_data);
-        if (i2s_out_remain_time_until_next_pulse >= I2S_OUT_USEC_PER_PULSE) {
-          i2s_out_remain_time_until_next_pulse -= I2S_OUT_USEC_PER_PULSE;
+        // Fill all the samples up to the next pulse in one run, as far as the buffer allows,
+        // instead of going around this loop once per sample.
+        uint32_t port_data = atomic_load(&i2s_out_port_data);
+        uint32_t run = i2s_out_remain_time_until_next_pulse / i2s_out_usec_per_pulse;
+        uint32_t space = (dma_sample_count - sample_safe_count) - o_dma.rw_pos;
+        if (run == 0) {
+          run = 1; // No pulse pending. Push a single sample.
+        } else if (run > space) {
+          run = space;
+        }
+        uint32_t *dst = &buf[o_dma.rw_pos];
+        uint32_t *end = dst + run;
+        while (dst < end) {
+          *dst++ = port_data;
+        }
+        o_dma.rw_pos += run;
+        if (i2s_out_remain_time_until_next_pulse >= run * i2s_out_usec_per_pulse) {
+          i2s_out_remain_time_until_next_pulse -= run * i2s_out_usec_per_pulse;
         } else {
           i2s_out_remain_time_until_next_pulse = 0;
         }
@@ -408,6 +456,8 @@ static void IRAM_ATTR i2s_out_intr_handler(void *arg) {
     }
     // Get the descriptor of the last item in the linkedlist
     finish_desc = (lldesc_t*) I2S0.out_eof_des_addr;
+    // The DMA has moved on to the next one
+    o_dma.tx_desc = (lldesc_t*)finish_desc->qe.stqe_next;
 
     // If the queue is full it's because we have an underflow,
     // more than buf_count isr without new data, remove the front buffer
@@ -421,10 +471,10 @@ static void IRAM_ATTR i2s_out_intr_handler(void *arg) {
         port_data = atomic_load(&i2s_out_port_data);
       }
       I2S_OUT_PULSER_EXIT_CRITICAL_ISR();
-      for (int i = 0; i < DMA_SAMPLE_COUNT; i++) {
+      for (int i = 0; i < dma_sample_count; i++) {
         front_desc->buf[i] = port_data;
       }
-      front_desc->length = I2S_OUT_DMABUF_LEN;
+      front_desc->length = i2s_out_dmabuf_len;
     }
 
     // Send a DMA complete event to the I2S bitstreamer task with finished buffer
@@ -456,7 +506,7 @@ static void IRAM_ATTR i2sOutTask(void* parameter) {
       //
       // To avoid buffer overflow, all of the maximum pulse width (normaly about 10us)
       // is adjusted to be in a single buffer.
-      // DMA_SAMPLE_SAFE_COUNT is referred to as the margin value.
+      // sample_safe_count is referred to as the margin value.
       // Therefore, if a buffer is close to full and it is time to generate a pulse,
       // the generation of the buffer is interrupted (the buffer length is shortened slightly)
       // and the pulse generation is postponed until the next buffer is filled.
@@ -500,18 +550,26 @@ void IRAM_ATTR i2s_out_delay() {
   if (i2s_out_pulser_status == PASSTHROUGH) {
     // Depending on the timing, it may not be reflected immediately,
     // so wait twice as long just in case.
-    ets_delay_us(I2S_OUT_USEC_PER_PULSE * 2);
+    ets_delay_us(i2s_out_usec_per_pulse * 2);
   } else {
     // Just wait until the data now registered in the DMA descripter
     // is reflected in the I2S TX module via FIFO.
-    delay(I2S_OUT_DELAY_MS);
+    delay(i2s_out_get_delay_ms());
   }
  I2S_OUT_PULSER_EXIT_CRITICAL();
 #else
-  ets_delay_us(I2S_OUT_USEC_PER_PULSE * 2);
+  ets_delay_us(i2s_out_usec_per_pulse * 2);
 #endif
 }
 
+uint32_t IRAM_ATTR i2s_out_get_pulse_usec() {
+  return i2s_out_usec_per_pulse;
+}
+
+uint32_t IRAM_ATTR i2s_out_get_delay_ms() {
+  return i2s_out_delay_dmabuf_ms * (i2s_out_dmabuf_count + 1);
+}
+
 void IRAM_ATTR i2s_out_write(uint8_t pin, uint8_t val) {
   uint32_t bit = bit(pin);
   if (val) {
@@ -537,7 +595,7 @@ uint8_t IRAM_ATTR i2s_out_state(uint8_t pin) {
 
 uint32_t IRAM_ATTR i2s_out_push_sample(uint32_t num) {
 #ifdef USE_I2S_OUT_STREAM
-  if (num > SAMPLE_SAFE_COUNT) {
+  if (num > sample_safe_count) {
     return 0;
   }
   // push at least one sample (even if num is zero)
@@ -579,7 +637,7 @@ int IRAM_ATTR i2s_out_set_stepping() {
     // Wait for complete DMAs
     for(;;) {
       I2S_OUT_PULSER_EXIT_CRITICAL();
-      delay(I2S_OUT_DELAY_DMABUF_MS);
+      delay(i2s_out_delay_dmabuf_ms);
       I2S_OUT_PULSER_ENTER_CRITICAL();
       if (i2s_out_pulser_status == WAITING) {
         continue;
@@ -624,6 +682,67 @@ int IRAM_ATTR i2s_out_set_pulse_callback(i2s_out_pulse_func_t func) {
   return 0;
 }
 
+int IRAM_ATTR i2s_out_set_buffer_callback(i2s_out_buffer_func_t func) {
+#ifdef USE_I2S_OUT_STREAM
+  i2s_out_buffer_func = func;
+#endif
+  return 0;
+}
+
+#ifdef USE_I2S_OUT_STREAM
+// Collects the buffers from the one after from_desc up to the one being filled.
+static uint32_t IRAM_ATTR i2s_out_queued_mask(lldesc_t *from_desc) {
+  uint32_t mask = 0;
+  if (o_dma.fill_desc == NULL || from_desc == o_dma.fill_desc) {
+    return 0;
+  }
+  lldesc_t *dma_desc = (lldesc_t*)from_desc->qe.stqe_next;
+  for (uint32_t n = 0; dma_desc != NULL && n < i2s_out_dmabuf_count; n++) {
+    mask |= bit(i2s_out_desc_index(dma_desc));
+    if (dma_desc == o_dma.fill_desc) {
+      break;
+    }
+    dma_desc = (lldesc_t*)dma_desc->qe.stqe_next;
+  }
+  return mask;
+}
+#endif
+
+uint32_t IRAM_ATTR i2s_out_get_pending_mask() {
+  uint32_t mask = 0;
+#ifdef USE_I2S_OUT_STREAM
+  I2S_OUT_PULSER_ENTER_CRITICAL();
+  if (i2s_out_pulser_status == STEPPING) {
+    mask = i2s_out_queued_mask(o_dma.tx_desc);
+  }
+  I2S_OUT_PULSER_EXIT_CRITICAL();
+#endif
+  return mask;
+}
+
+uint32_t IRAM_ATTR i2s_out_abort() {
+  uint32_t mask = 0;
+#ifdef USE_I2S_OUT_STREAM
+  I2S_OUT_PULSER_ENTER_CRITICAL();
+  if (i2s_out_pulser_status == STEPPING) {
+    // Keep one buffer after the one being transmitted,
+    // because the DMA may already be reading it.
+    lldesc_t *tail_desc = o_dma.tx_desc;
+    if (tail_desc != o_dma.fill_desc && tail_desc->qe.stqe_next != NULL) {
+      tail_desc = (lldesc_t*)tail_desc->qe.stqe_next;
+    }
+    mask = i2s_out_queued_mask(tail_desc);
+    // Cut the DMA descriptor chain after the kept buffers.
+    // The discarded buffers are never transmitted, and the task handles the tail
+    // in the same way as after i2s_out_set_passthrough().
+    tail_desc->qe.stqe_next = NULL;
+    i2s_out_pulser_status = WAITING;
+  }
+  I2S_OUT_PULSER_EXIT_CRITICAL();
+#endif
+  return mask;
+}
+
 int IRAM_ATTR i2s_out_reset() {
   I2S_OUT_PULSER_ENTER_CRITICAL();
   i2s_out_stop();
@@ -647,19 +766,43 @@ int IRAM_ATTR i2s_out_reset() {
 // Initialize funtion (external function)
 //
 int IRAM_ATTR i2s_out_init(i2s_out_init_t &init_param) {
-  if (i2s_out_initialized) {
+  bool add_stream = false; // Up in the static mode since i2s_out_init_passthrough()
+#ifdef USE_I2S_OUT_STREAM
+  bool stream = !init_param.passthrough_only;
+  add_stream = i2s_out_initialized && !i2s_out_stream_ready && stream;
+#endif
+  if (i2s_out_initialized && !add_stream) {
     // already initialized
     return -1;
   }
 
-  atomic_store(&i2s_out_port_data, init_param.init_val);
+  if (add_stream) {
+    // Shift the current port data out and detach, so the outputs keep their value
+    // while the peripheral is set up again. i2s_out_start() attaches it back.
+    i2s_out_stop();
+    i2s_out_initialized = 0;
+  } else {
+    atomic_store(&i2s_out_port_data, init_param.init_val);
+  }
+
+  // Bitstream timing. Clamp to what the clock divider and the DMA descriptors can do.
+  i2s_out_usec_per_pulse = constrain(init_param.usec_per_pulse, I2S_OUT_USEC_PER_PULSE_MIN, I2S_OUT_USEC_PER_PULSE_MAX);
+  i2s_out_dmabuf_count = constrain(init_param.dmabuf_count, I2S_OUT_DMABUF_COUNT_MIN, I2S_OUT_DMABUF_COUNT_MAX);
+  i2s_out_dmabuf_len = constrain(init_param.dmabuf_len, I2S_OUT_DMABUF_LEN_MIN, I2S_OUT_DMABUF_LEN_MAX);
+  i2s_out_dmabuf_len -= i2s_out_dmabuf_len % I2S_SAMPLE_SIZE; // Whole samples only
+  dma_sample_count = i2s_out_dmabuf_len / I2S_SAMPLE_SIZE;
+  sample_safe_count = 20 / i2s_out_usec_per_pulse;
+  // Round up so that waiting for a buffer never turns into a zero delay.
+  i2s_out_delay_dmabuf_ms = (dma_sample_count * i2s_out_usec_per_pulse + 999) / 1000;
 
   // To make sure hardware is enabled before any hardware register operations.
   periph_module_reset(PERIPH_I2S0_MODULE);
   periph_module_enable(PERIPH_I2S0_MODULE);
 
   // Route the i2s pins to the appropriate GPIO
-  i2s_out_gpio_attach(init_param.ws_pin, init_param.bck_pin, init_param.data_pin);
+  if (!add_stream) {
+    i2s_out_gpio_attach(init_param.ws_pin, init_param.bck_pin, init_param.data_pin);
+  }
 
   /**
    * Each i2s transfer will take
@@ -682,39 +825,45 @@ int IRAM_ATTR i2s_out_init(i2s_out_init_t &init_param) {
    *      N = 5, b/a = 0
    *      M = 2
    *   for fwclk = 1000kHz(16-bit: 1µS pulse time), 500kHz(32-bit: 2μS pulse time)
-   *      N = 2, b/a = 2/1 (N + b/a = 2.5)
+   *      N = 2, b/a = 2/4 (N + b/a = 2.5)
    *      M = 2
+   *
+   *   In general, with M = 2
+   *      N + b/a = 40 x usec_per_pulse / I2S_OUT_NUM_BITS
+   *   which is a whole number of quarters for both 16-bit and 32-bit mode.
    */
 
 #ifdef USE_I2S_OUT_STREAM
-  // Allocate the array of pointers to the buffers
-  o_dma.buffers = (uint32_t **)malloc(sizeof(uint32_t*) * I2S_OUT_DMABUF_COUNT);
-  if (o_dma.buffers == nullptr) return -1;
-
-  // Allocate each buffer that can be used by the DMA controller
-  for (int buf_idx = 0; buf_idx < I2S_OUT_DMABUF_COUNT; buf_idx++) {
-    o_dma.buffers[buf_idx] = (uint32_t*) heap_caps_calloc(1, I2S_OUT_DMABUF_LEN, MALLOC_CAP_DMA);
-    if (o_dma.buffers[buf_idx] == nullptr) return -1;
-  }
+  if (stream) {
+    // Allocate the array of pointers to the buffers
+    o_dma.buffers = (uint32_t **)malloc(sizeof(uint32_t*) * i2s_out_dmabuf_count);
+    if (o_dma.buffers == nullptr) return -1;
+
+    // Allocate each buffer that can be used by the DMA controller
+    for (int buf_idx = 0; buf_idx < i2s_out_dmabuf_count; buf_idx++) {
+      o_dma.buffers[buf_idx] = (uint32_t*) heap_caps_calloc(1, i2s_out_dmabuf_len, MALLOC_CAP_DMA);
+      if (o_dma.buffers[buf_idx] == nullptr) return -1;
+    }
 
-  // Allocate the array of DMA descriptors
-  o_dma.desc = (lldesc_t**) malloc(sizeof(lldesc_t*) * I2S_OUT_DMABUF_COUNT);
-  if (o_dma.desc == nullptr) return -1;
+    // Allocate the array of DMA descriptors
+    o_dma.desc = (lldesc_t**) malloc(sizeof(lldesc_t*) * i2s_out_dmabuf_count);
+    if (o_dma.desc == nullptr) return -1;
 
-  // Allocate each DMA descriptor that will be used by the DMA controller
-  for (int buf_idx = 0; buf_idx < I2S_OUT_DMABUF_COUNT; buf_idx++) {
-    o_dma.desc[buf_idx] = (lldesc_t*) heap_caps_malloc(sizeof(lldesc_t), MALLOC_CAP_DMA);
-    if (o_dma.desc[buf_idx] == nullptr) return -1;
-  }
+    // Allocate each DMA descriptor that will be used by the DMA controller
+    for (int buf_idx = 0; buf_idx < i2s_out_dmabuf_count; buf_idx++) {
+      o_dma.desc[buf_idx] = (lldesc_t*) heap_caps_malloc(sizeof(lldesc_t), MALLOC_CAP_DMA);
+      if (o_dma.desc[buf_idx] == nullptr) return -1;
+    }
 
-  // Initialize
-  i2s_clear_o_dma_buffers(init_param.init_val);
-  o_dma.rw_pos = 0;
-  o_dma.current = NULL;
-  o_dma.queue = xQueueCreate(I2S_OUT_DMABUF_COUNT, sizeof(uint32_t *));
+    // Initialize
+    i2s_clear_o_dma_buffers(add_stream ? 0 : init_param.init_val);
+    o_dma.rw_pos = 0;
+    o_dma.current = NULL;
+    o_dma.queue = xQueueCreate(i2s_out_dmabuf_count, sizeof(uint32_t *));
 
-   // Set the first DMA descriptor
-  I2S0.out_link.addr = (uint32_t)o_dma.desc[0];
+     // Set the first DMA descriptor
+    I2S0.out_link.addr = (uint32_t)o_dma.desc[0];
+  }
 #endif
 
   // stop i2s
@@ -793,7 +942,9 @@ int IRAM_ATTR i2s_out_init(i2s_out_init_t &init_param) {
   I2S0.conf.rx_mono = 0;
 
 #ifdef USE_I2S_OUT_STREAM
-  I2S0.fifo_conf.dscr_en = 1; //connect DMA to fifo
+  if (stream) {
+    I2S0.fifo_conf.dscr_en = 1; //connect DMA to fifo
+  }
 #endif
   I2S0.conf.tx_start = 0;
   I2S0.conf.rx_start = 0;
@@ -818,49 +969,39 @@ int IRAM_ATTR i2s_out_init(i2s_out_init_t &init_param) {
   // i2s_set_clk
   //
 
-  // set clock (fi2s) 160MHz / 5
+  // set clock (fi2s) 160MHz / (N + b/a)
   I2S0.clkm_conf.clka_en = 0;       // Use 160 MHz PLL_D2_CLK as reference
-  // N + b/a = 0
-#if I2S_OUT_NUM_BITS == 16
-  // N = 10
-  I2S0.clkm_conf.clkm_div_num = 10; // minimum value of 2, reset value of 4, max 256 (I²S clock divider’s integral value)
-#else
-  // N = 5
-  I2S0.clkm_conf.clkm_div_num = 5; // minimum value of 2, reset value of 4, max 256 (I²S clock divider’s integral value)
-#endif
-  // b/a = 0
-  I2S0.clkm_conf.clkm_div_b = 0;    // 0 at reset
-  I2S0.clkm_conf.clkm_div_a = 0;    // 0 at reset, what about divide by 0? (not an issue)
+  // N + b/a in quarters (4 usec/pulse: 16-bit N = 10, 32-bit N = 5)
+  uint32_t clkm_div_quarters = 160 * i2s_out_usec_per_pulse / I2S_OUT_NUM_BITS;
+  I2S0.clkm_conf.clkm_div_num = clkm_div_quarters / 4; // minimum value of 2, reset value of 4, max 256 (I²S clock divider’s integral value)
+  I2S0.clkm_conf.clkm_div_b = clkm_div_quarters % 4;    // 0 at reset
+  I2S0.clkm_conf.clkm_div_a = (clkm_div_quarters % 4) ? 4 : 0; // 0 at reset, what about divide by 0? (not an issue)
 
   // Bit clock configuration bit in transmitter mode.
-  // fbck = fi2s / tx_bck_div_num = (160 MHz / 5) / 2 = 16 MHz
+  // fbck = fi2s / tx_bck_div_num = (160 MHz / (N + b/a)) / 2
   I2S0.sample_rate_conf.tx_bck_div_num = 2; // minimum value of 2 defaults to 6
   I2S0.sample_rate_conf.rx_bck_div_num = 2;
 
 #ifdef USE_I2S_OUT_STREAM
-  // Enable TX interrupts (DMA Interrupts)
-  I2S0.int_ena.out_eof = 1; // Triggered when rxlink has finished sending a packet.
-  I2S0.int_ena.out_dscr_err = 0; // Triggered when invalid rxlink descriptors are encountered.
-  I2S0.int_ena.out_total_eof = 1; // Triggered when all transmitting linked lists are used up.
-  I2S0.int_ena.out_done = 0; // Triggered when all transmitted and buffered data have been read.
-
-  // default pulse callback period (μsec)
-  i2s_out_pulse_period = init_param.pulse_period;
-  i2s_out_pulse_func = init_param.pulse_func;
-
-  // Create the task that will feed the buffer
-  xTaskCreatePinnedToCore(i2sOutTask,
-                          "I2SOutTask",
-                          1024 * 10,
-                          NULL,
-                          1,
-                          nullptr,
-                          CONFIG_ARDUINO_RUNNING_CORE  // must run the task on same core
-                          );
-
-  // Allocate and Enable the I2S interrupt
-  esp_intr_alloc(ETS_I2S0_INTR_SOURCE, 0, i2s_out_intr_handler, nullptr, &i2s_out_isr_handle);
-  esp_intr_enable(i2s_out_isr_handle);
+  if (stream) {
+    // Enable TX interrupts (DMA Interrupts)
+    I2S0.int_ena.out_eof = 1; // Triggered when rxlink has finished sending a packet.
+    I2S0.int_ena.out_dscr_err = 0; // Triggered when invalid rxlink descriptors are encountered.
+    I2S0.int_ena.out_total_eof = 1; // Triggered when all transmitting linked lists are used up.
+    I2S0.int_ena.out_done = 0; // Triggered when all transmitted and buffered data have been read.
+
+    // default pulse callback period (μsec)
+    i2s_out_pulse_period = init_param.pulse_period;
+    i2s_out_pulse_func = init_param.pulse_func;
+
+    // Create the task that will feed the buffer
+    task_create(TASK_I2S_OUT, i2sOutTask, 1024 * 10, NULL, NULL);
+
+    // Allocate and Enable the I2S interrupt
+    esp_intr_alloc(ETS_I2S0_INTR_SOURCE, 0, i2s_out_intr_handler, nullptr, &i2s_out_isr_handle);
+    esp_intr_enable(i2s_out_isr_handle);
+    i2s_out_stream_ready = true;
+  }
 #endif
 
   // Remember GPIO pin numbers
@@ -900,8 +1041,54 @@ int IRAM_ATTR i2s_out_init() {
         .pulse_func = NULL,
         .pulse_period = I2S_OUT_USEC_PER_PULSE,
         .init_val = I2S_OUT_INIT_VAL,
+        .usec_per_pulse = I2S_OUT_USEC_PER_PULSE,
+        .dmabuf_count = I2S_OUT_DMABUF_COUNT,
+        .dmabuf_len = I2S_OUT_DMABUF_LEN,
+        .passthrough_only = false,
     };
     return i2s_out_init(default_param);
 }
 
+/*
+  Initialize I2S out by default parameters, in the static mode only.
+
+  return -1 ... already initialized
+*/
+int IRAM_ATTR i2s_out_init_passthrough() {
+    i2s_out_init_t default_param = {
+        .ws_pin = I2S_OUT_WS,
+        .bck_pin = I2S_OUT_BCK,
+        .data_pin = I2S_OUT_DATA,
+        .pulse_func = NULL,
+        .pulse_period = I2S_OUT_USEC_PER_PULSE,
+        .init_val = I2S_OUT_INIT_VAL,
+        .usec_per_pulse = I2S_OUT_USEC_PER_PULSE,
+        .dmabuf_count = I2S_OUT_DMABUF_COUNT,
+        .dmabuf_len = I2S_OUT_DMABUF_LEN,
+        .passthrough_only = true,
+    };
+    return i2s_out_init(default_param);
+}
+
+/*
+  Initialize I2S out by default parameters with the given timing.
+
+  return -1 ... already initialized
+*/
+int IRAM_ATTR i2s_out_init(uint32_t usec_per_pulse, uint32_t dmabuf_count, uint32_t dmabuf_len) {
+    i2s_out_init_t param = {
+        .ws_pin = I2S_OUT_WS,
+        .bck_pin = I2S_OUT_BCK,
+        .data_pin = I2S_OUT_DATA,
+        .pulse_func = NULL,
+        .pulse_period = usec_per_pulse,
+        .init_val = I2S_OUT_INIT_VAL,
+        .usec_per_pulse = usec_per_pulse,
+        .dmabuf_count = dmabuf_count,
+        .dmabuf_len = dmabuf_len,
+        .passthrough_only = false,
+    };
+    return i2s_out_init(param);
+}
+
 #endif
@@ -66,15 +66,32 @@
 
 /* 16-bit mode: 1000000 usec / ((160000000 Hz) / 10 / 2) x 16 bit/pulse x 2(stereo) = 4 usec/pulse */
 /* 32-bit mode: 1000000 usec / ((160000000 Hz) /  5 / 2) x 32 bit/pulse x 2(stereo) = 4 usec/pulse */
-#define I2S_OUT_USEC_PER_PULSE 4
+/* These are the defaults. The values in use are passed to i2s_out_init() at boot. */
+#ifndef I2S_OUT_USEC_PER_PULSE
+  #define I2S_OUT_USEC_PER_PULSE 4
+#endif
 
-#define I2S_OUT_DMABUF_COUNT 5     /* number of DMA buffers to store data */
-#define I2S_OUT_DMABUF_LEN   2000  /* maximum size in bytes (4092 is DMA's limit) */
+/* The clock divider must be at least 2, which limits the shortest pulse */
+#if I2S_OUT_NUM_BITS == 16
+  #define I2S_OUT_USEC_PER_PULSE_MIN 1
+#else
+  #define I2S_OUT_USEC_PER_PULSE_MIN 2
+#endif
+#define I2S_OUT_USEC_PER_PULSE_MAX 20 /* GRBL's $0 should be less than or equal 20 */
 
-#define I2S_OUT_DELAY_DMABUF_MS (I2S_OUT_DMABUF_LEN / sizeof(uint32_t) * I2S_OUT_USEC_PER_PULSE / 1000)
-#define I2S_OUT_DELAY_MS        (I2S_OUT_DELAY_DMABUF_MS * (I2S_OUT_DMABUF_COUNT + 1))
+#ifndef I2S_OUT_DMABUF_COUNT
+  #define I2S_OUT_DMABUF_COUNT 5     /* number of DMA buffers to store data */
+#endif
+#ifndef I2S_OUT_DMABUF_LEN
+  #define I2S_OUT_DMABUF_LEN   2000  /* maximum size in bytes (4092 is DMA's limit) */
+#endif
+#define I2S_OUT_DMABUF_COUNT_MIN 2
+#define I2S_OUT_DMABUF_COUNT_MAX 16
+#define I2S_OUT_DMABUF_LEN_MIN   256
+#define I2S_OUT_DMABUF_LEN_MAX   4092
 
 typedef void (*i2s_out_pulse_func_t)(void);
+typedef void (*i2s_out_buffer_func_t)(uint32_t buf_idx);
 
 typedef struct {
     /*
@@ -96,14 +113,28 @@ typedef struct {
     i2s_out_pulse_func_t pulse_func;
     uint32_t pulse_period; // aka step rate.
     uint32_t init_val;
+    uint32_t usec_per_pulse; // Bitstream resolution. I2S_OUT_USEC_PER_PULSE_MIN .. I2S_OUT_USEC_PER_PULSE_MAX
+    uint32_t dmabuf_count;   // Number of DMA buffers. I2S_OUT_DMABUF_COUNT_MIN .. I2S_OUT_DMABUF_COUNT_MAX
+    uint32_t dmabuf_len;     // DMA buffer size in bytes. I2S_OUT_DMABUF_LEN_MIN .. I2S_OUT_DMABUF_LEN_MAX
+    bool passthrough_only;   // Static mode only, without the DMA stream. See i2s_out_init_passthrough().
 } i2s_out_init_t;
 
 /*
   Initialize I2S out by parameters.
+  Out of range timing parameters are clamped.
+  The DMA buffer time is dmabuf_len / 4 x usec_per_pulse.
+  A shorter pulse gives finer step timing, and fewer or shorter buffers lower
+  the latency of the non-stepping I/Os, but both cost more refill interrupts.
   return -1 ... already initialized
 */
 int i2s_out_init(i2s_out_init_t &init_param);
 
+/*
+  Initialize I2S out by default parameters with the given timing.
+  return -1 ... already initialized
+*/
+int i2s_out_init(uint32_t usec_per_pulse, uint32_t dmabuf_count, uint32_t dmabuf_len);
+
 /*
   Initialize I2S out by default parameters.
     i2s_out_init_t default_param = {
@@ -113,11 +144,35 @@ int i2s_out_init(i2s_out_init_t &init_param);
         .pulse_func = NULL,
         .pulse_period = I2S_OUT_USEC_PER_PULSE,
         .init_val = I2S_OUT_INIT_VAL,
+        .usec_per_pulse = I2S_OUT_USEC_PER_PULSE,
+        .dmabuf_count = I2S_OUT_DMABUF_COUNT,
+        .dmabuf_len = I2S_OUT_DMABUF_LEN,
     };
   return -1 ... already initialized
 */
 int i2s_out_init();
 
+/*
+  Initialize I2S out by default parameters, in the static (passthrough) mode only.
+  For the very start of the boot, so that the expanded outputs are at their
+  initial value before the settings that time the stream are loaded.
+  A later i2s_out_init() adds the stream with its timing, and the outputs keep
+  their value meanwhile. Without USE_I2S_OUT_STREAM, it is i2s_out_init().
+  return -1 ... already initialized
+*/
+int i2s_out_init_passthrough();
+
+/*
+  Get the bitstream resolution in microseconds per sample
+ */
+uint32_t i2s_out_get_pulse_usec();
+
+/*
+  Get the time in milliseconds for the data now in the DMA buffers
+  to reach the shift register pins
+ */
+uint32_t i2s_out_get_delay_ms();
+
 /*
   Get a bit state from the internal pin state var.
   pin: expanded pin No. (0..31)
@@ -133,9 +188,9 @@ void i2s_out_write(uint8_t pin, uint8_t val);
 
 /*
     Set current pin state to the I2S bitstream buffer
-    (This call will generate a future I2S_OUT_USEC_PER_PULSE μs x N bitstream)
+    (This call will generate a future i2s_out_get_pulse_usec() μs x N bitstream)
     num: Number of samples to be generated
-         The number of samples is limited to (20 / I2S_OUT_USEC_PER_PULSE).
+         The number of samples is limited to (20 / i2s_out_get_pulse_usec()).
     return: number of puhsed samples
             0 .. no space for push
  */
@@ -174,6 +229,31 @@ int i2s_out_set_pulse_period(uint32_t period);
  */
 int i2s_out_set_pulse_callback(i2s_out_pulse_func_t func);
 
+/*
+   Register a callback function that is called with the DMA buffer index
+   (0 .. dmabuf_count - 1) each time a buffer starts to be filled with stepping data.
+   The pulse callbacks that follow push their samples into that buffer.
+ */
+int i2s_out_set_buffer_callback(i2s_out_buffer_func_t func);
+
+/*
+   Get a bit mask of the DMA buffers (bit n for buffer index n) that are filled
+   with stepping data but have not started to be transmitted yet,
+   including the buffer being filled now.
+   The buffer being transmitted is not included.
+ */
+uint32_t i2s_out_get_pending_mask();
+
+/*
+   Stop stepping at the next DMA buffer boundary.
+   The buffer being transmitted and the one after it, which the DMA may already
+   have fetched, are still sent. The rest of the queued buffers are discarded
+   and the pulser goes to passthrough once the kept buffers are done.
+   return: bit mask of the discarded buffers (as i2s_out_get_pending_mask())
+           0 .. not stepping
+ */
+uint32_t i2s_out_abort();
+
 /*
    Reset i2s I/O expander
    - Stop ISR/DMA
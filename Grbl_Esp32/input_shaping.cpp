@@ -0,0 +1,165 @@
+/*
+  input_shaping.cpp - ZV and ZVD input shapers for the step output of the segment generator
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef INPUT_SHAPING
+
+// A shaper replaces the motion of an axis by the sum of delayed copies of it, scaled by impulses
+// that add up to one. For a frequency f and damping ratio z, with K = exp(-z * pi / sqrt(1 - z^2))
+// and the damped half period T = 1 / (2 * f * sqrt(1 - z^2)):
+//   ZV:  1 / (1 + K) at 0, K / (1 + K) at T
+//   ZVD: 1 / (1 + K)^2 at 0, 2K / (1 + K)^2 at T, K^2 / (1 + K)^2 at 2T
+// The ringing that each copy starts at f is cancelled by the later ones, so a machine can take
+// a higher acceleration. The axis arrives at the programmed position, T or 2T late, and follows
+// the shortest corners a little inside, as the delayed copy of one motion overlaps the next.
+//   The input motion comes as the axis steps of each prepared segment, spread evenly over its
+// time. Its positions are sampled every INPUT_SHAPING_SAMPLE_MS, and the shaped position at the
+// end of each segment is found from the samples. Positions are counted in steps from where the
+// shaper was last idle.
+
+#define SHAPER_IMPULSES_MAX 3
+
+typedef struct {
+    uint8_t count;
+    float amplitude[SHAPER_IMPULSES_MAX];
+    float delay_ms[SHAPER_IMPULSES_MAX];
+} axis_shaper_t;
+
+static axis_shaper_t shapers[N_AXIS];
+static float history[INPUT_SHAPING_HISTORY][N_AXIS]; // Sampled input positions, in steps
+static uint16_t history_newest;
+static uint16_t history_count;
+static float since_sample_ms;     // Time from the newest sample to the end of the input
+static int32_t position[N_AXIS];  // Input position at the end of the input
+static int32_t shaped_position[N_AXIS];
+static float still_ms;            // Time the input has not moved for
+static float longest_delay_ms;
+
+static void shaper_set_axis(axis_shaper_t* shaper, uint8_t type, float frequency, float damping) {
+    if (frequency <= 0.0f) {
+        shaper->count = 1;
+        shaper->amplitude[0] = 1.0f;
+        shaper->delay_ms[0] = 0.0f;
+        return;
+    }
+    frequency = MAX(frequency, INPUT_SHAPING_MIN_FREQUENCY);
+    float root = sqrtf(1.0f - damping * damping);
+    float k = expf(-damping * (float)M_PI / root);
+    float half_period_ms = 500.0f / (frequency * root);
+    float scale = 1.0f / (1.0f + k);
+    if (type == SHAPER_ZVD) {
+        shaper->count = 3;
+        scale *= scale;
+        shaper->amplitude[0] = scale;
+        shaper->amplitude[1] = 2.0f * k * scale;
+        shaper->amplitude[2] = k * k * scale;
+    } else {
+        shaper->count = 2;
+        shaper->amplitude[0] = scale;
+        shaper->amplitude[1] = k * scale;
+    }
+    for (uint8_t i = 0; i < shaper->count; i++)
+        shaper->delay_ms[i] = i * half_period_ms;
+    if (shaper->delay_ms[shaper->count - 1] > longest_delay_ms)
+        longest_delay_ms = shaper->delay_ms[shaper->count - 1];
+}
+
+bool shaper_begin() {
+    longest_delay_ms = 0.0f;
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        shaper_set_axis(&shapers[axis], hot_settings->shaper_type, hot_settings->shaper_frequency[axis],
+                        hot_settings->shaper_damping[axis]);
+    }
+    shaper_reset();
+    return longest_delay_ms > 0.0f;
+}
+
+bool shaper_idle() {
+    return still_ms >= longest_delay_ms;
+}
+
+void shaper_reset() {
+    history_newest = 0;
+    history_count = 0;
+    since_sample_ms = 0.0f;
+    memset(position, 0, sizeof(position));
+    memset(shaped_position, 0, sizeof(shaped_position));
+    still_ms = longest_delay_ms; // Idle
+}
+
+// The sample back from the newest. The samples from before the shaper started are at 0.
+static inline float shaper_sample(uint8_t axis, uint16_t back) {
+    if (back >= history_count) {
+        if (history_count < INPUT_SHAPING_HISTORY)
+            return 0.0f;
+        back = INPUT_SHAPING_HISTORY - 1;
+    }
+    uint16_t index = (history_newest + INPUT_SHAPING_HISTORY - back) % INPUT_SHAPING_HISTORY;
+    return history[index][axis];
+}
+
+// The input position of an axis age_ms before the end of the input
+static float shaper_position_at(uint8_t axis, float age_ms) {
+    if (age_ms <= 0.0f)
+        return position[axis];
+    float newest = shaper_sample(axis, 0);
+    if (age_ms < since_sample_ms)
+        return position[axis] + (newest - position[axis]) * (age_ms / since_sample_ms);
+    float back = (age_ms - since_sample_ms) / INPUT_SHAPING_SAMPLE_MS;
+    uint16_t older = (uint16_t)back;
+    float from = shaper_sample(axis, older);
+    return from + (shaper_sample(axis, older + 1) - from) * (back - older);
+}
+
+void shaper_segment(const int32_t* steps, float dt_ms, int32_t* shaped) {
+    int32_t start[N_AXIS];
+    bool moved = false;
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        start[axis] = position[axis];
+        position[axis] += steps[axis];
+        moved |= steps[axis] != 0;
+    }
+    // Sample the input at the sample times within the segment
+    float since = INPUT_SHAPING_SAMPLE_MS - since_sample_ms; // From the segment start to the next sample time
+    for (; since <= dt_ms; since += INPUT_SHAPING_SAMPLE_MS) {
+        history_newest = (history_newest + 1) % INPUT_SHAPING_HISTORY;
+        if (history_count < INPUT_SHAPING_HISTORY)
+            history_count++;
+        float fraction = since / dt_ms;
+        for (uint8_t axis = 0; axis < N_AXIS; axis++)
+            history[history_newest][axis] = start[axis] + steps[axis] * fraction;
+    }
+    since_sample_ms = dt_ms - (since - INPUT_SHAPING_SAMPLE_MS);
+    still_ms = moved ? 0.0f : still_ms + dt_ms;
+    bool idle = shaper_idle();
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        int32_t target = position[axis];
+        if (!idle) {
+            const axis_shaper_t* shaper = &shapers[axis];
+            float sum = 0.0f;
+            for (uint8_t i = 0; i < shaper->count; i++)
+                sum += shaper->amplitude[i] * shaper_position_at(axis, shaper->delay_ms[i]);
+            target = lroundf(sum);
+        }
+        shaped[axis] = target - shaped_position[axis];
+        shaped_position[axis] = target;
+    }
+}
+
+#endif
@@ -0,0 +1,71 @@
+/*
+  input_shaping.h - ZV and ZVD input shapers for the step output of the segment generator
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef input_shaping_h
+#define input_shaping_h
+
+#if defined(INPUT_SHAPING) && defined(LASER_RASTER)
+    #error "INPUT_SHAPING cannot be used with LASER_RASTER, the pixels follow the planned steps"
+#endif
+
+#ifdef INPUT_SHAPING
+
+// Shapers of the Stepper/Shaper setting
+#define SHAPER_ZV 0
+#define SHAPER_ZVD 1
+
+// Segments per second of the segment generator while shaping. The shaped motion changes speed
+// only from one segment to the next, so this must be well above the ringing frequencies.
+// NOTE: Segments are shorter than without shaping, so raise Stepper/Segments to keep the same
+// lead time in the segment buffer.
+#ifndef INPUT_SHAPING_TICKS_PER_SECOND
+    #define INPUT_SHAPING_TICKS_PER_SECOND 400
+#endif
+#define DT_SHAPED_SEGMENT (1.0f/(INPUT_SHAPING_TICKS_PER_SECOND*60.0f)) // min/segment
+
+// The input motion is kept at this period for the delayed impulses of the shapers, over
+// INPUT_SHAPING_HISTORY samples. These bound the lowest frequency that can be shaped.
+#define INPUT_SHAPING_SAMPLE_MS 1.0f
+#ifndef INPUT_SHAPING_HISTORY
+    #define INPUT_SHAPING_HISTORY 128
+#endif
+
+// Ranges of the <axis>/Shaper/Frequency and <axis>/Shaper/Damping settings. A frequency of 0
+// leaves the axis unshaped, and one below the minimum is taken as the minimum. The longest
+// delay, that of ZVD at the lowest frequency, fits the history.
+#define INPUT_SHAPING_MIN_FREQUENCY 10.0f // Hz
+#define INPUT_SHAPING_MAX_FREQUENCY 200.0f
+#define INPUT_SHAPING_MAX_DAMPING 0.5f
+
+// Takes the shapers of the axes from the settings. Only called with the shaper idle, so the
+// settings change between motions. Returns false if no axis is shaped.
+bool shaper_begin();
+
+// No input motion is left to shape. The shaped output has come to the input position.
+bool shaper_idle();
+
+// Adds an input segment of dt_ms with the signed axis steps of steps, and gives the signed axis
+// steps of the shaped output over the same time. With no input motion, a segment of zero steps
+// plays out the motion still delayed by the shapers, until shaper_idle().
+void shaper_segment(const int32_t* steps, float dt_ms, int32_t* shaped);
+
+void shaper_reset();
+
+#endif
+
+#endif
@@ -23,18 +23,44 @@
 
 #include "config.h"
 #include "inputbuffer.h"
+#include "serial.h"
 
 InputBuffer inputBuffer;
 
 
 InputBuffer::InputBuffer() {
+    _RXbuffer = _RXstatic;
+    _RXheap = false;
+    _RXcapacity = RXBUFFERSIZE;
     _RXbufferSize = 0;
     _RXbufferpos = 0;
 }
 InputBuffer::~InputBuffer() {
+    if (_RXheap)
+        free(_RXbuffer);
     _RXbufferSize = 0;
     _RXbufferpos = 0;
 }
+
+// Replaces the buffer with an empty one of capacity bytes at storage, or with the built-in one if
+// storage is NULL. heap tells that storage was allocated on the heap, and must be freed once it
+// is replaced in turn. Returns the heap buffer it replaces, for the caller to free, or NULL.
+// NOTE: The caller must keep readers and writers out while this runs. It does not allocate or
+// free, so it can run in a critical section.
+uint8_t* InputBuffer::replace(uint8_t* storage, size_t capacity, bool heap) {
+    uint8_t* old = _RXheap ? _RXbuffer : NULL;
+    if (storage == NULL) {
+        storage = _RXstatic;
+        capacity = RXBUFFERSIZE;
+        heap = false;
+    }
+    _RXbuffer = storage;
+    _RXheap = heap;
+    _RXcapacity = capacity;
+    _RXbufferSize = 0;
+    _RXbufferpos = 0;
+    return old;
+}
 void InputBuffer::begin() {
     _RXbufferSize = 0;
     _RXbufferpos = 0;
@@ -54,15 +80,15 @@ int InputBuffer::available() {
 }
 
 int InputBuffer::availableforwrite() {
-    return (RXBUFFERSIZE - _RXbufferSize);
+    return (_RXcapacity - _RXbufferSize);
 }
 
 size_t InputBuffer::write(uint8_t c) {
-    if ((1 + _RXbufferSize) <= RXBUFFERSIZE) {
+    if ((1 + _RXbufferSize) <= _RXcapacity) {
         int current = _RXbufferpos + _RXbufferSize;
-        if (current > RXBUFFERSIZE)
-            current = current - RXBUFFERSIZE;
-        if (current > (RXBUFFERSIZE - 1))
+        if (current > _RXcapacity)
+            current = current - _RXcapacity;
+        if (current > (_RXcapacity - 1))
             current = 0;
         _RXbuffer[current] = c;
         current ++;
@@ -72,9 +98,21 @@ size_t InputBuffer::write(uint8_t c) {
     return 0;
 }
 
+// Writes as much of buffer as fits. Returns the number of bytes written.
 size_t InputBuffer::write(const uint8_t* buffer, size_t size) {
-    //No need currently
-    //keep for compatibility
+    size_t room = _RXcapacity - _RXbufferSize;
+    if (size > room)
+        size = room;
+    int current = _RXbufferpos + _RXbufferSize;
+    if (current > (_RXcapacity - 1))
+        current -= _RXcapacity;
+    for (size_t i = 0; i < size; i++) {
+        _RXbuffer[current] = buffer[i];
+        current++;
+        if (current > (_RXcapacity - 1))
+            current = 0;
+    }
+    _RXbufferSize += size;
     return size;
 }
 
@@ -85,15 +123,16 @@ int InputBuffer::peek(void) {
 
 bool InputBuffer::push(const char* data) {
     int data_size = strlen(data);
-    if ((data_size + _RXbufferSize) <= RXBUFFERSIZE) {
+    if ((data_size + _RXbufferSize) <= _RXcapacity) {
         int current = _RXbufferpos + _RXbufferSize;
-        if (current > RXBUFFERSIZE) current = current - RXBUFFERSIZE;
+        if (current > _RXcapacity) current = current - _RXcapacity;
         for (int i = 0; i < data_size; i++) {
-            if (current > (RXBUFFERSIZE - 1)) current = 0;
+            if (current > (_RXcapacity - 1)) current = 0;
             _RXbuffer[current] = data[i];
             current ++;
         }
         _RXbufferSize += strlen(data);
+        serial_notify_data();
         return true;
     }
     return false;
@@ -103,12 +142,26 @@ int InputBuffer::read(void) {
     if (_RXbufferSize > 0) {
         int v = _RXbuffer[_RXbufferpos];
         _RXbufferpos++;
-        if (_RXbufferpos > (RXBUFFERSIZE - 1))_RXbufferpos = 0;
+        if (_RXbufferpos > (_RXcapacity - 1))_RXbufferpos = 0;
         _RXbufferSize--;
         return v;
     } else return -1;
 }
 
+// Reads up to size bytes. Returns the number of bytes read.
+size_t InputBuffer::read(uint8_t* buffer, size_t size) {
+    if (size > _RXbufferSize)
+        size = _RXbufferSize;
+    for (size_t i = 0; i < size; i++) {
+        buffer[i] = _RXbuffer[_RXbufferpos];
+        _RXbufferpos++;
+        if (_RXbufferpos > (_RXcapacity - 1))
+            _RXbufferpos = 0;
+    }
+    _RXbufferSize -= size;
+    return size;
+}
+
 void InputBuffer::flush(void) {
     //No need currently
     //keep for compatibility
@@ -52,13 +52,19 @@ class InputBuffer: public Print {
     int availableforwrite();
     int peek(void);
     int read(void);
+    size_t read(uint8_t* buffer, size_t size);
     bool push(const char* data);
     void flush(void);
+    uint8_t* replace(uint8_t* storage, size_t capacity, bool heap);
+    size_t capacity() const { return _RXcapacity; }
     operator bool() const;
   private:
-    uint8_t _RXbuffer[RXBUFFERSIZE];
-    uint16_t _RXbufferSize;
-    uint16_t _RXbufferpos;
+    uint8_t _RXstatic[RXBUFFERSIZE]; // Used until replace() is given a larger buffer
+    uint8_t* _RXbuffer;
+    bool _RXheap; // _RXbuffer was allocated on the heap, and is freed by its owner
+    size_t _RXcapacity;
+    size_t _RXbufferSize;
+    size_t _RXbufferpos;
 };
 
 
@@ -0,0 +1,101 @@
+/*
+  job_stats.cpp - achieved against programmed feed, and motion phase times, of each job
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef JOB_STATS
+
+// The segment prep hands over the time and distance of every segment it makes, which is what
+// st_get_realtime_rate() reports one segment at a time. Summed, they give the time-weighted mean
+// feed exactly, without sampling. The times are of the prep, which runs ahead of the steps by the
+// depth of the segment buffer, so a feed hold shows up as motion time up to that depth.
+// A job starts with the first segment of a cycle. It ends when the machine is idle again, at once
+// after an SD job, else after JOB_STATS_IDLE_MS, so a streamed job that starves the planner is
+// still one job. The stops from starving are counted.
+typedef struct {
+    bool active;
+    bool sd_done;
+    int64_t start_us;
+    int64_t idle_us; // When the machine went idle, or 0 if it is not
+    double motion_min;
+    double mm;
+    double programmed_mm; // The distance at the programmed rates, over the same time
+    double ramp_min[3];   // RAMP_ACCEL, RAMP_CRUISE and RAMP_DECEL
+    uint32_t starved_stops;
+} job_stats_t;
+static job_stats_t job;
+static portMUX_TYPE job_mux = portMUX_INITIALIZER_UNLOCKED; // The prep may run in its own task
+
+void job_stats_segment(float dt, float mm, float programmed_rate, const float* ramp_dt) {
+    if (!(sys.state & (STATE_CYCLE | STATE_HOLD)))
+        return; // Not jogging, homing or parking motions
+    portENTER_CRITICAL(&job_mux);
+    if (!job.active) {
+        memset(&job, 0, sizeof(job));
+        job.active = true;
+        job.start_us = esp_timer_get_time();
+    }
+    job.motion_min += dt;
+    job.mm += mm;
+    job.programmed_mm += programmed_rate * dt;
+    for (uint8_t ramp = 0; ramp < 3; ramp++)
+        job.ramp_min[ramp] += ramp_dt[ramp];
+    portEXIT_CRITICAL(&job_mux);
+}
+
+void job_stats_starved() {
+    portENTER_CRITICAL(&job_mux);
+    if (job.active)
+        job.starved_stops++;
+    portEXIT_CRITICAL(&job_mux);
+}
+
+void job_stats_sd_done() {
+    job.sd_done = true;
+}
+
+void job_stats_poll() {
+    if (!job.active)
+        return;
+    if (!(sys.state == STATE_IDLE || sys.state == STATE_ALARM) || plan_get_current_block() != NULL) {
+        job.idle_us = 0;
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+    if (job.idle_us == 0)
+        job.idle_us = now;
+    if (!job.sd_done && now - job.idle_us < JOB_STATS_IDLE_MS * 1000LL)
+        return;
+    portENTER_CRITICAL(&job_mux);
+    job_stats_t stats = job;
+    job.active = false;
+    portEXIT_CRITICAL(&job_mux);
+    if (stats.motion_min <= 0.0)
+        return;
+    float job_sec = (stats.idle_us - stats.start_us) / 1000000.0f;
+    float motion_sec = stats.motion_min * 60.0;
+    float feed = stats.mm / stats.motion_min;
+    float programmed = stats.programmed_mm / stats.motion_min;
+    grbl_msg_sendf(CLIENT_ALL, MSG_LEVEL_INFO, "Job %.1f sec, moving %.1f sec: accel %.0f%% cruise %.0f%% decel %.0f%%",
+                   job_sec, motion_sec, 100.0 * stats.ramp_min[RAMP_ACCEL] / stats.motion_min,
+                   100.0 * stats.ramp_min[RAMP_CRUISE] / stats.motion_min, 100.0 * stats.ramp_min[RAMP_DECEL] / stats.motion_min);
+    grbl_msg_sendf(CLIENT_ALL, MSG_LEVEL_INFO, "Job feed %.0f of %.0f mm/min programmed (%.0f%%), %d planner starved stops",
+                   feed, programmed, programmed > 0.0f ? 100.0f * feed / programmed : 0.0f, stats.starved_stops);
+}
+
+#endif
@@ -0,0 +1,43 @@
+/*
+  job_stats.h - achieved against programmed feed, and motion phase times, of each job
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef job_stats_h
+#define job_stats_h
+
+#ifdef JOB_STATS
+
+// A streamed job ends when the machine has been idle this long
+#ifndef JOB_STATS_IDLE_MS
+    #define JOB_STATS_IDLE_MS 3000
+#endif
+
+// Segment prep side. A segment of a cycle took dt minutes over mm, in a block programmed at
+// programmed_rate mm/min. ramp_dt is the time of dt in each of RAMP_ACCEL, RAMP_CRUISE and
+// RAMP_DECEL. The first segment starts a job.
+void job_stats_segment(float dt, float mm, float programmed_rate, const float* ramp_dt);
+// The prep ran out of planner blocks during a cycle, so the machine stops
+void job_stats_starved();
+
+// Protocol loop side. job_stats_sd_done() is called when an SD job has read its last line, so the
+// job ends as soon as its motion does. job_stats_poll() ends the job and reports it when due.
+void job_stats_sd_done();
+void job_stats_poll();
+
+#endif
+
+#endif
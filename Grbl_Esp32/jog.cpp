@@ -47,3 +47,94 @@ uint8_t jog_execute(plan_line_data_t* pl_data, parser_block_t* gc_block) {
     }
     return (STATUS_OK);
 }
+
+#ifdef JOG_VELOCITY
+static float jog_v[N_AXIS];        // mm/min
+static float jog_speed = 0.0;      // Length of jog_v, 0 when not jogging
+static uint32_t jog_v_time;        // millis() of the last jog_velocity()
+static bool jog_v_sync = false;    // The parser position waits for the jog to stop
+
+// Ends the continuous jog. With cancel, the planned blocks are dropped with a jog cancel,
+// otherwise they run out.
+static void jog_velocity_stop(bool cancel) {
+    jog_speed = 0.0;
+    jog_v_sync = true;
+    if (cancel && sys.state == STATE_JOG)
+        system_set_exec_state_flag(EXEC_MOTION_CANCEL);
+}
+
+uint8_t jog_velocity(const float* velocity) {
+    float speed_sqr = 0.0;
+    for (uint8_t idx = 0; idx < N_AXIS; idx++)
+        speed_sqr += velocity[idx] * velocity[idx];
+    if (speed_sqr == 0.0) {
+        if (jog_speed != 0.0)
+            jog_velocity_stop(true);
+        return (STATUS_OK);
+    }
+    if (sys.state != STATE_IDLE && sys.state != STATE_JOG)
+        return (STATUS_IDLE_ERROR);
+    memcpy(jog_v, velocity, sizeof(jog_v));
+    jog_speed = sqrtf(speed_sqr);
+    jog_v_time = millis();
+    jog_velocity_update();
+    return (STATUS_OK);
+}
+
+void jog_velocity_update() {
+    if (jog_speed == 0.0) {
+        // Only once the jog is done does the planner position stop moving
+        if (jog_v_sync && sys.state == STATE_IDLE) {
+            gc_sync_position();
+            jog_v_sync = false;
+        }
+        return;
+    }
+    if ((sys.suspend & SUSPEND_JOG_CANCEL) || (sys.state != STATE_IDLE && sys.state != STATE_JOG)) {
+        jog_velocity_stop(false); // Cancelled, or stopped by something else
+        return;
+    }
+    if (millis() - jog_v_time > JOG_VELOCITY_TIMEOUT_MS) {
+        jog_velocity_stop(true);
+        return;
+    }
+    uint8_t queued = plan_get_block_buffer_size() - plan_get_block_buffer_available();
+    if (queued >= JOG_VELOCITY_BLOCKS)
+        return;
+    // Each block runs for the period, and the planned blocks together can also stop from the
+    // jog speed, at the lowest acceleration of the moving axes.
+    float acceleration = SOME_LARGE_VALUE;
+    uint8_t idx;
+    for (idx = 0; idx < N_AXIS; idx++) {
+        if (jog_v[idx] != 0.0)
+            acceleration = MIN(acceleration, axis_settings[idx]->acceleration->get());
+    }
+    float speed = jog_speed / 60.0; // mm/s
+    float length = speed * (JOG_VELOCITY_PERIOD_MS / 1000.0) + (speed * speed) / (2 * acceleration * JOG_VELOCITY_BLOCKS);
+    plan_line_data_t plan_data;
+    plan_line_data_t* pl_data = &plan_data;
+    memset(pl_data, 0, sizeof(plan_line_data_t));
+    pl_data->feed_rate = jog_speed;
+    pl_data->spindle_speed = gc_state.spindle_speed;
+    pl_data->condition = PL_COND_FLAG_NO_FEED_OVERRIDE | gc_state.modal.spindle | gc_state.modal.coolant;
+#ifdef USE_LINE_NUMBERS
+    pl_data->line_number = JOG_LINE_NUMBER;
+#endif
+    float target[N_AXIS];
+    plan_get_position(target);
+    for (; queued < JOG_VELOCITY_BLOCKS; queued++) {
+        for (idx = 0; idx < N_AXIS; idx++)
+            target[idx] += jog_v[idx] / jog_speed * length;
+        if (soft_limits->get() && system_check_travel_limits(target)) {
+            jog_velocity_stop(false); // The planned blocks end inside the limits
+            break;
+        }
+        plan_buffer_line(target, pl_data);
+    }
+    if (sys.state == STATE_IDLE && plan_get_current_block() != NULL) {
+        sys.state = STATE_JOG;
+        st_prep_buffer();
+        st_wake_up();
+    }
+}
+#endif
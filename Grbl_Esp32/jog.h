@@ -32,4 +32,12 @@
 // Sets up valid jog motion received from g-code parser, checks for soft-limits, and executes the jog.
 uint8_t jog_execute(plan_line_data_t *pl_data, parser_block_t *gc_block);
 
+#ifdef JOG_VELOCITY
+// Sets the velocity of continuous jogging, in mm/min per axis. All zero stops the jog.
+uint8_t jog_velocity(const float* velocity);
+
+// Keeps the blocks of a continuous jog planned ahead. Called by protocol_exec_rt_system().
+void jog_velocity_update();
+#endif
+
 #endif
@@ -0,0 +1,94 @@
+/*
+  kinematics_linear.h - motor kinematics that are a constant linear map, such as CoreXY
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef kinematics_linear_h
+#define kinematics_linear_h
+
+// The steps of the A and B motors are a constant 2x2 integer matrix times the steps of the X and Y
+// axes, and the axis steps are the inverse matrix times the motor steps, over inv_div. The other
+// axes drive their own motor. LinearKinematics<type> holds the matrix of a machine type.
+template <uint8_t type> struct LinearKinematics {
+    // Cartesian. Each motor is its axis.
+    static const int32_t xx = 1, xy = 0, yx = 0, yy = 1;
+    static const int32_t inv_xx = 1, inv_xy = 0, inv_yx = 0, inv_yy = 1, inv_div = 1;
+    static const bool mixed = false;
+};
+
+template <> struct LinearKinematics<MACHINE_COREXY> {
+    // A = X + Y, B = X - Y. An H-bot has the same equations.
+    static const int32_t xx = 1, xy = 1, yx = 1, yy = -1;
+    static const int32_t inv_xx = 1, inv_xy = 1, inv_yx = 1, inv_yy = -1, inv_div = 2;
+    static const bool mixed = true;
+};
+
+// motor_steps and axis_steps may be the same array.
+template <class K> inline void linear_kinematics_motor_steps(const int32_t* axis_steps, int32_t* motor_steps) {
+    int32_t x = axis_steps[X_AXIS];
+    int32_t y = axis_steps[Y_AXIS];
+    memmove(motor_steps, axis_steps, N_AXIS * sizeof(int32_t));
+    motor_steps[A_MOTOR] = K::xx * x + K::xy * y;
+    motor_steps[B_MOTOR] = K::yx * x + K::yy * y;
+}
+
+template <class K> inline void linear_kinematics_axis_steps(const int32_t* motor_steps, int32_t* axis_steps) {
+    int32_t a = motor_steps[A_MOTOR];
+    int32_t b = motor_steps[B_MOTOR];
+    memmove(axis_steps, motor_steps, N_AXIS * sizeof(int32_t));
+    axis_steps[X_AXIS] = (K::inv_xx * a + K::inv_xy * b) / K::inv_div;
+    axis_steps[Y_AXIS] = (K::inv_yx * a + K::inv_yy * b) / K::inv_div;
+}
+
+// A machine file that defines MACHINE_KINEMATICS, e.g. as MACHINE_COREXY, fixes the kinematics
+// at compile time. The checks below then fold to constants and the branches of the other types
+// are not compiled. Otherwise they follow the Machine/Type setting.
+
+// True if the A and B motors each move both X and Y.
+// NOTE: Always inlined, so the limit switch ISR can use it from IRAM.
+inline __attribute__((always_inline)) bool kinematics_mixed() {
+#ifdef MACHINE_KINEMATICS
+    return LinearKinematics<MACHINE_KINEMATICS>::mixed;
+#else
+    return hot_settings->machine_type == MACHINE_COREXY;
+#endif
+}
+
+// Converts axis steps to motor steps. The arrays may be the same.
+inline void kinematics_motor_steps(const int32_t* axis_steps, int32_t* motor_steps) {
+#ifdef MACHINE_KINEMATICS
+    linear_kinematics_motor_steps<LinearKinematics<MACHINE_KINEMATICS>>(axis_steps, motor_steps);
+#else
+    if (hot_settings->machine_type == MACHINE_COREXY)
+        linear_kinematics_motor_steps<LinearKinematics<MACHINE_COREXY>>(axis_steps, motor_steps);
+    else
+        linear_kinematics_motor_steps<LinearKinematics<MACHINE_XYZ>>(axis_steps, motor_steps);
+#endif
+}
+
+// Converts motor steps, like sys_position, to axis steps. The arrays may be the same.
+inline void kinematics_axis_steps(const int32_t* motor_steps, int32_t* axis_steps) {
+#ifdef MACHINE_KINEMATICS
+    linear_kinematics_axis_steps<LinearKinematics<MACHINE_KINEMATICS>>(motor_steps, axis_steps);
+#else
+    if (hot_settings->machine_type == MACHINE_COREXY)
+        linear_kinematics_axis_steps<LinearKinematics<MACHINE_COREXY>>(motor_steps, axis_steps);
+    else
+        linear_kinematics_axis_steps<LinearKinematics<MACHINE_XYZ>>(motor_steps, axis_steps);
+#endif
+}
+
+#endif
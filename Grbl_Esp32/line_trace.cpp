@@ -0,0 +1,152 @@
+/*
+  line_trace.cpp - timing of received lines from the transport to the planner
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef LINE_TRACE
+
+// The times are esp_timer_get_time() microseconds, truncated to 32 bits. Only differences are
+// reported, which are right across the wrap.
+static uint32_t line_trace_now() {
+    return (uint32_t)esp_timer_get_time();
+}
+
+// Arrival times. The serial task numbers the lines of each client by the line ends it has seen
+// before them and stores the time the first byte of each line arrived. The protocol loop numbers
+// the lines in the same way, so it finds the time of a line without the two sides having to stay
+// in step: a line whose entry was overwritten or not yet written just has no arrival time.
+// NOTE: Realtime characters and binary frames are taken out first on both sides.
+typedef struct {
+    uint32_t line; // Written after time, with release semantics
+    uint32_t time;
+} line_arrival_t;
+
+typedef struct {
+    line_arrival_t arrivals[LINE_TRACE_ARRIVALS];
+    uint32_t received_lines; // Serial task. Line ends received.
+    bool in_line;            // Serial task. Bytes of the current line were received.
+    uint32_t read_lines;     // Protocol loop. Line ends read.
+} client_trace_t;
+static client_trace_t client_traces[CLIENT_COUNT];
+
+static bool line_trace_is_eol(uint8_t data) {
+    return data == '\r' || data == '\n';
+}
+
+void line_trace_received(uint8_t client, const uint8_t* data, size_t len) {
+    client_trace_t* trace = &client_traces[client];
+    uint32_t now = line_trace_now();
+    for (size_t i = 0; i < len; i++) {
+        if (line_trace_is_eol(data[i])) {
+            trace->received_lines++;
+            trace->in_line = false;
+        } else if (!trace->in_line) {
+            trace->in_line = true;
+            line_arrival_t* arrival = &trace->arrivals[trace->received_lines % LINE_TRACE_ARRIVALS];
+            arrival->time = now;
+            __atomic_store_n(&arrival->line, trace->received_lines, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+uint32_t line_trace_start(uint8_t client) {
+    client_trace_t* trace = &client_traces[client];
+    line_arrival_t* arrival = &trace->arrivals[trace->read_lines % LINE_TRACE_ARRIVALS];
+    uint32_t line = __atomic_load_n(&arrival->line, __ATOMIC_ACQUIRE);
+    uint32_t time = arrival->time;
+    // Re-read the line number in case the entry was rewritten while reading the time
+    if (line != trace->read_lines || __atomic_load_n(&arrival->line, __ATOMIC_ACQUIRE) != line)
+        return 0;
+    return time;
+}
+
+uint32_t line_trace_eol(uint8_t client) {
+    client_traces[client].read_lines++;
+    return line_trace_now();
+}
+
+// A line that ran, with its times. 0 is a time that was not recorded.
+typedef struct {
+    uint8_t client;
+    uint32_t received;
+    uint32_t eol;
+    uint32_t parsed;
+    uint32_t planned;
+    uint32_t done;
+} line_record_t;
+static line_record_t line_records[LINE_TRACE_SIZE];
+static uint16_t line_record_next = 0;
+static uint16_t line_record_count = 0;
+static line_record_t line_current;
+static bool line_open = false;
+
+// All of these run in the protocol loop, so the records need no locking.
+void line_trace_begin(uint8_t client, uint32_t received_us, uint32_t eol_us) {
+    line_current.client = client;
+    line_current.received = received_us;
+    line_current.eol = eol_us;
+    line_current.parsed = line_current.planned = line_current.done = 0;
+    line_open = true;
+}
+
+void line_trace_parsed() {
+    if (line_open && line_current.parsed == 0)
+        line_current.parsed = line_trace_now();
+}
+
+void line_trace_planned() {
+    if (line_open && line_current.planned == 0)
+        line_current.planned = line_trace_now();
+}
+
+void line_trace_end() {
+    if (!line_open)
+        return;
+    line_open = false;
+    line_current.done = line_trace_now();
+    line_records[line_record_next] = line_current;
+    line_record_next = (line_record_next + 1) % LINE_TRACE_SIZE;
+    if (line_record_count < LINE_TRACE_SIZE)
+        line_record_count++;
+}
+
+// Returns the microseconds from eol to time, or -1 if time was not recorded.
+static int32_t line_trace_since_eol(const line_record_t* record, uint32_t time) {
+    return time ? (int32_t)(time - record->eol) : -1;
+}
+
+// One [LT:client,read,parsed,planned,done] line per record. read is the microseconds from the
+// arrival of the first byte of the line to its end being read. The others are the microseconds
+// from the end of the line to that point. -1 is a time that was not recorded.
+void line_trace_report(uint8_t client) {
+    uint16_t count = line_record_count;
+    uint16_t index = (line_record_next + LINE_TRACE_SIZE - count) % LINE_TRACE_SIZE;
+    line_record_count = 0;
+    while (count--) {
+        const line_record_t* record = &line_records[index];
+        index = (index + 1) % LINE_TRACE_SIZE;
+        grbl_sendf(client, "[LT:%d,%d,%d,%d,%d]\r\n",
+                   record->client,
+                   record->received ? (int32_t)(record->eol - record->received) : -1,
+                   line_trace_since_eol(record, record->parsed),
+                   line_trace_since_eol(record, record->planned),
+                   line_trace_since_eol(record, record->done));
+    }
+}
+
+#endif
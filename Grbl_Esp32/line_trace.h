@@ -0,0 +1,54 @@
+/*
+  line_trace.h - timing of received lines from the transport to the planner
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef line_trace_h
+#define line_trace_h
+
+#ifdef LINE_TRACE
+
+// The number of line records kept. The oldest are overwritten.
+#ifndef LINE_TRACE_SIZE
+    #define LINE_TRACE_SIZE 64
+#endif
+
+// Arrival times kept per client for the lines waiting in its receive buffer. A line that waits
+// behind more lines than this gets no arrival time.
+#ifndef LINE_TRACE_ARRIVALS
+    #define LINE_TRACE_ARRIVALS 32
+#endif
+
+// Serial task side. Called for the bytes of client that go to its receive buffer.
+void line_trace_received(uint8_t client, const uint8_t* data, size_t len);
+
+// Protocol loop side. line_trace_start() is called for the first character of a line and
+// line_trace_eol() when the line is complete. Returns the times to keep with the line.
+uint32_t line_trace_start(uint8_t client);
+uint32_t line_trace_eol(uint8_t client);
+
+// Brackets the execution of a line. The times in between are recorded for that line.
+void line_trace_begin(uint8_t client, uint32_t received_us, uint32_t eol_us);
+void line_trace_parsed();  // The g-code parser has checked the block and starts executing it
+void line_trace_planned(); // The planner accepted a block. Only the first one is recorded.
+void line_trace_end();
+
+// Sends the records, oldest first, and clears them. See $LT.
+void line_trace_report(uint8_t client);
+
+#endif
+
+#endif
@@ -0,0 +1,253 @@
+/*
+  machine_config.cpp - motors, pins and axis count of the machine, read from SPIFFS at boot
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef MACHINE_CONFIG
+
+#include "SPIFFS.h"
+
+#define MACHINE_NAME_SIZE 32
+
+static bool loaded = false;
+static char machine_name[MACHINE_NAME_SIZE];
+static uint8_t machine_axes = N_AXIS;
+static machine_motor_t motors[MAX_AXES][MAX_GANGED];
+static uint8_t config_limit_pins[MAX_AXES];
+
+static const char axis_letters[] = "xyzabc";
+
+static void clear_config() {
+    machine_name[0] = '\0';
+    machine_axes = N_AXIS;
+    for (uint8_t axis = 0; axis < MAX_AXES; axis++) {
+        config_limit_pins[axis] = UNDEFINED_PIN;
+        for (uint8_t gang_index = 0; gang_index < MAX_GANGED; gang_index++) {
+            machine_motor_t* m = &motors[axis][gang_index];
+            m->type = MACHINE_MOTOR_NONE;
+            m->step_pin = UNDEFINED_PIN;
+            m->direction_pin = UNDEFINED_PIN;
+            m->disable_pin = UNDEFINED_PIN;
+            m->cs_pin = UNDEFINED_PIN;
+            m->driver = 2130;
+            m->rsense = 0.0f; // The default of the driver
+            for (uint8_t i = 0; i < 4; i++)
+                m->phase_pins[i] = UNDEFINED_PIN;
+            m->servo_pin = UNDEFINED_PIN;
+            m->servo_min = 0.0f;
+            m->servo_max = 1.0f;
+        }
+    }
+}
+
+static bool parse_int(const char* value, int32_t* result) {
+    char* end;
+    *result = strtol(value, &end, 10);
+    return end != value && *end == '\0';
+}
+
+static bool parse_float(const char* value, float* result) {
+    char* end;
+    *result = strtof(value, &end);
+    return end != value && *end == '\0';
+}
+
+// A GPIO number, i2so<n> for the I2S output or none
+static bool parse_pin(const char* value, uint8_t* pin) {
+    int32_t n;
+    if (strcmp(value, "none") == 0) {
+        *pin = UNDEFINED_PIN;
+        return true;
+    }
+#ifdef USE_I2S_OUT
+    if (strncmp(value, "i2so", 4) == 0) {
+        if (!parse_int(value + 4, &n) || n < 0 || n >= I2S_OUT_NUM_BITS)
+            return false;
+        *pin = I2SO(n);
+        return true;
+    }
+#endif
+    if (!parse_int(value, &n) || n < 0 || n > 39)
+        return false;
+    *pin = n;
+    return true;
+}
+
+static bool parse_motor_type(const char* value, uint8_t* type) {
+    static const char* const names[] = { "none", "stepper", "trinamic", "unipolar", "servo" };
+    for (uint8_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strcmp(value, names[i]) == 0) {
+            *type = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Sets the motor field of a <motor>_<field> key, where motor is an axis letter with a 2 for the
+// ganged motor
+static bool parse_motor_key(const char* key, const char* value) {
+    const char* letter = strchr(axis_letters, key[0]);
+    if (key[0] == '\0' || !letter)
+        return false;
+    uint8_t axis = letter - axis_letters;
+    uint8_t gang_index = 0;
+    key++;
+    if (*key == '2') {
+        gang_index = 1;
+        key++;
+    }
+    if (*key++ != '_' || axis >= N_AXIS)
+        return false;
+    machine_motor_t* m = &motors[axis][gang_index];
+    int32_t n;
+    if (strcmp(key, "motor") == 0)
+        return parse_motor_type(value, &m->type);
+    if (strcmp(key, "step_pin") == 0)
+        return parse_pin(value, &m->step_pin);
+    if (strcmp(key, "direction_pin") == 0)
+        return parse_pin(value, &m->direction_pin);
+    if (strcmp(key, "disable_pin") == 0)
+        return parse_pin(value, &m->disable_pin);
+    if (strcmp(key, "cs_pin") == 0)
+        return parse_pin(value, &m->cs_pin);
+    if (strcmp(key, "driver") == 0) {
+        if (!parse_int(value, &n) || (n != 2130 && n != 5160))
+            return false;
+        m->driver = n;
+        return true;
+    }
+    if (strcmp(key, "rsense") == 0)
+        return parse_float(value, &m->rsense) && m->rsense > 0.0f;
+    if (strncmp(key, "phase", 5) == 0 && key[5] >= '0' && key[5] <= '3' && strcmp(key + 6, "_pin") == 0)
+        return parse_pin(value, &m->phase_pins[key[5] - '0']);
+    if (strcmp(key, "servo_pin") == 0)
+        return parse_pin(value, &m->servo_pin);
+    if (strcmp(key, "servo_min") == 0)
+        return parse_float(value, &m->servo_min);
+    if (strcmp(key, "servo_max") == 0)
+        return parse_float(value, &m->servo_max);
+    if (strcmp(key, "limit_pin") == 0 && gang_index == 0)
+        return parse_pin(value, &config_limit_pins[axis]);
+    return false;
+}
+
+// Takes a line of the file, trimmed and in lower case
+static bool parse_line(char* line) {
+    if (line[0] == '\0' || line[0] == ';' || line[0] == '#')
+        return true;
+    char* value = strchr(line, '=');
+    if (!value)
+        return false;
+    *value++ = '\0';
+    char* comment = strchr(value, ';');
+    if (comment)
+        *comment = '\0';
+    for (char* c = value + strlen(value); c > value && c[-1] == ' '; c--)
+        c[-1] = '\0';
+    for (char* c = line + strlen(line); c > line && c[-1] == ' '; c--)
+        c[-1] = '\0';
+    while (*value == ' ')
+        value++;
+    if (strcmp(line, "name") == 0) {
+        strncpy(machine_name, value, MACHINE_NAME_SIZE - 1);
+        machine_name[MACHINE_NAME_SIZE - 1] = '\0';
+        return true;
+    }
+    if (strcmp(line, "axes") == 0) {
+        int32_t n;
+        if (!parse_int(value, &n) || n < 1 || n > N_AXIS)
+            return false;
+        machine_axes = n;
+        return true;
+    }
+    return parse_motor_key(line, value);
+}
+
+void machine_config_init() {
+    clear_config();
+    if (!SPIFFS.begin(true) || !SPIFFS.exists(MACHINE_CONFIG_FILE))
+        return;
+    File file = SPIFFS.open(MACHINE_CONFIG_FILE, FILE_READ);
+    if (!file)
+        return;
+    char line[LINE_BUFFER_SIZE];
+    uint8_t length = 0;
+    uint16_t line_number = 1;
+    bool ok = true;
+    while (ok) {
+        int ch = file.read();
+        if (ch < 0 || ch == '\n') {
+            line[length] = '\0';
+            ok = parse_line(line);
+            if (ch < 0 || !ok)
+                break;
+            length = 0;
+            line_number++;
+        } else if (ch == '\r' || (ch == ' ' && length == 0))
+            continue;
+        else if (length < LINE_BUFFER_SIZE - 1)
+            line[length++] = tolower(ch);
+        else
+            ok = false;
+    }
+    file.close();
+    if (!ok) {
+        grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Error in %s line %d, using %s", MACHINE_CONFIG_FILE, line_number, MACHINE_NAME);
+        clear_config();
+        return;
+    }
+    // The axes left out have no motors or limits
+    for (uint8_t axis = machine_axes; axis < MAX_AXES; axis++) {
+        config_limit_pins[axis] = UNDEFINED_PIN;
+        motors[axis][0].type = motors[axis][1].type = MACHINE_MOTOR_NONE;
+    }
+    loaded = true;
+    grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Machine config %s: %s, %d axes", MACHINE_CONFIG_FILE, machine_name, machine_axes);
+}
+
+bool machine_config_loaded() {
+    return loaded;
+}
+
+Motor* machine_config_motor(uint8_t axis, uint8_t gang_index) {
+    const machine_motor_t* m = &motors[axis][gang_index];
+    uint8_t motor_index = axis + (gang_index ? MAX_AXES : 0); // X2_AXIS and so on for ganged motors
+    switch (m->type) {
+    case MACHINE_MOTOR_STEPPER:
+        return new StandardStepper(motor_index, m->step_pin, m->direction_pin, m->disable_pin);
+    case MACHINE_MOTOR_TRINAMIC: {
+        float rsense = m->rsense;
+        if (rsense == 0.0f)
+            rsense = (m->driver == 5160) ? TMC5160_RSENSE_DEFAULT : TMC2130_RSENSE_DEFAULT;
+        return new TrinamicDriver(motor_index, m->step_pin, m->direction_pin, m->disable_pin, m->cs_pin, m->driver, rsense, get_next_trinamic_driver_index());
+    }
+    case MACHINE_MOTOR_UNIPOLAR:
+        return new UnipolarMotor(motor_index, m->phase_pins[0], m->phase_pins[1], m->phase_pins[2], m->phase_pins[3]);
+    case MACHINE_MOTOR_SERVO:
+        return new RcServo(motor_index, m->servo_pin, m->servo_min, m->servo_max);
+    default:
+        return new Nullmotor();
+    }
+}
+
+uint8_t machine_config_limit_pin(uint8_t axis) {
+    return config_limit_pins[axis];
+}
+
+#endif
@@ -0,0 +1,92 @@
+/*
+  machine_config.h - motors, pins and axis count of the machine, read from SPIFFS at boot
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef machine_config_h
+#define machine_config_h
+
+#if defined(MACHINE_CONFIG) && defined(STATIC_MOTOR_DISPATCH)
+    #error "MACHINE_CONFIG cannot be used with STATIC_MOTOR_DISPATCH, the motor classes are chosen at boot"
+#endif
+
+#ifdef MACHINE_CONFIG
+
+/*
+    The file has one name=value per line, in any case. Blank lines and those starting with ; or #
+    are skipped.
+
+        name=3 axis router
+        axes=3
+        x_motor=trinamic           ; stepper, trinamic, unipolar, servo or none
+        x_step_pin=12
+        x_direction_pin=26
+        x_disable_pin=i2so0        ; i2so<n> is bit n of the I2S output, with USE_I2S_OUT
+        x_cs_pin=17
+        x_driver=2130              ; 2130 or 5160
+        x_rsense=0.11
+        x_limit_pin=2
+        y2_motor=stepper           ; x2 to c2 are the ganged motors
+        z_motor=servo
+        z_servo_pin=27
+        z_servo_min=0              ; the travel of the servo, in mm
+        z_servo_max=5
+        a_motor=unipolar
+        a_phase0_pin=32            ; to a_phase3_pin
+
+    A motor with no <motor>_motor line is a Nullmotor, so the file describes the whole machine.
+    The motors of the axes from axes up to N_AXIS are left out.
+*/
+#ifndef MACHINE_CONFIG_FILE
+    #define MACHINE_CONFIG_FILE "/machine.cfg"
+#endif
+
+// The motor classes a file can pick
+#define MACHINE_MOTOR_NONE 0
+#define MACHINE_MOTOR_STEPPER 1
+#define MACHINE_MOTOR_TRINAMIC 2
+#define MACHINE_MOTOR_UNIPOLAR 3
+#define MACHINE_MOTOR_SERVO 4
+
+typedef struct {
+    uint8_t type;
+    uint8_t step_pin;
+    uint8_t direction_pin;
+    uint8_t disable_pin;
+    uint8_t cs_pin;         // Trinamic
+    uint16_t driver;        // Trinamic part number
+    float rsense;           // Trinamic
+    uint8_t phase_pins[4];  // Unipolar
+    uint8_t servo_pin;
+    float servo_min;
+    float servo_max;
+} machine_motor_t;
+
+// Reads MACHINE_CONFIG_FILE, before stepper_init() and init_motors(). Without the file, or with
+// an error in it, the compile-time machine definition is used.
+void machine_config_init();
+
+// Motors and pins come from the file
+bool machine_config_loaded();
+
+// Makes the motor of the file for the axis and gang index, for init_motors()
+Motor* machine_config_motor(uint8_t axis, uint8_t gang_index);
+
+uint8_t machine_config_limit_pin(uint8_t axis);
+
+#endif
+
+#endif
@@ -33,6 +33,34 @@
 
 uint8_t ganged_mode = SQUARING_MODE_DUAL;
 
+// Set while every segment of the current arc or spline is known to be inside the soft limits, so
+// mc_line() does not check each one.
+static bool mc_soft_limits_clear = false;
+
+// Writes the box spanned by the straight move from position to target.
+static void mc_motion_box(const float* position, const float* target, float* lo, float* hi) {
+    for (uint8_t idx = 0; idx < N_AXIS; idx++) {
+        lo[idx] = MIN(position[idx], target[idx]);
+        hi[idx] = MAX(position[idx], target[idx]);
+    }
+}
+
+// Returns true if soft limits are on and the box lo..hi is inside them. The soft limits are a box
+// too, so this only needs its two corners.
+static bool mc_box_within_soft_limits(float* lo, float* hi) {
+#ifdef USE_KINEMATICS
+    return false; // The soft limits apply to the joint positions of the segments
+#else
+    if (!hot_settings->soft_limits || sys.state == STATE_JOG)
+        return false;
+#ifdef HEIGHT_MAP
+    if (height_map_active())
+        return false; // Z compensation moves the segments
+#endif
+    return !system_check_travel_limits(lo) && !system_check_travel_limits(hi);
+#endif
+}
+
 
 // this allows kinematics to be used.
 void mc_line_kins(float* target, plan_line_data_t* pl_data, float* position) {
@@ -51,14 +79,27 @@ void mc_line_kins(float* target, plan_line_data_t* pl_data, float* position) {
 // mc_line and plan_buffer_line is done primarily to place non-planner-type functions from being
 // in the planner and to let backlash compensation or canned cycle integration simple and direct.
 void mc_line(float* target, plan_line_data_t* pl_data) {
+#ifdef HEIGHT_MAP
+    // Z compensation. The pieces of the line come back here.
+    if (height_map_line(target, pl_data))
+        return;
+#endif
     // If enabled, check for soft limit violations. Placed here all line motions are picked up
     // from everywhere in Grbl.
-    if (soft_limits->get()) {
+    if (hot_settings->soft_limits && !mc_soft_limits_clear) {
         // NOTE: Block jog state. Jogging is a special case and soft limits are handled independently.
         if (sys.state != STATE_JOG)  limits_soft_check(target);
     }
     // If in check gcode mode, prevent motion by blocking planner. Soft limits still work.
-    if (sys.state == STATE_CHECK_MODE)  return;
+    if (sys.state == STATE_CHECK_MODE) {
+#ifdef SD_COMPILE
+        sd_compile_motion(target, pl_data); // Kept for the compiled file, if compiling
+#endif
+#ifdef SD_BENCHMARK
+        sd_bench_motion(target, pl_data);
+#endif
+        return;
+    }
     // NOTE: Backlash compensation may be installed here. It will need direction info to track when
     // to insert a backlash line motion(s) before the intended line motion and will require its own
     // plan_check_full_buffer() and check for system abort loop. Also for position reporting
@@ -77,8 +118,16 @@ void mc_line(float* target, plan_line_data_t* pl_data) {
     do {
         protocol_execute_realtime(); // Check for any run-time commands
         if (sys.abort)  return;   // Bail, if system abort.
+#ifdef LASER_RASTER
+        // A raster motion also waits for room in the raster line queue.
+        if (plan_check_full_buffer() || (pl_data->raster && raster_queue_full()))  protocol_auto_cycle_start();
+#else
         if (plan_check_full_buffer())  protocol_auto_cycle_start();     // Auto-cycle start when buffer is full.
+#endif
         else  break;
+#ifdef PROTOCOL_READ_AHEAD
+        protocol_read_ahead();
+#endif
     } while (1);
     // Plan and queue motion into planner buffer
     // uint8_t plan_status; // Not used in normal operation.
@@ -86,6 +135,148 @@ void mc_line(float* target, plan_line_data_t* pl_data) {
 }
 
 
+#ifdef ARC_BATCHED_PLANNING
+// Execute count linear motions like mc_line(), planned together with one replan. Soft limits are
+// checked for the whole batch before any of it is planned, and the batch is split if the planner
+// buffer does not have room for all of it.
+void mc_line_batch(float (*targets)[N_AXIS], uint8_t count, plan_line_data_t* pl_data) {
+    uint8_t i;
+#ifdef HEIGHT_MAP
+    if (height_map_active()) {
+        for (i = 0; i < count; i++)
+            mc_line(targets[i], pl_data); // Compensated one by one
+        return;
+    }
+#endif
+    if (hot_settings->soft_limits && !mc_soft_limits_clear) {
+        if (sys.state != STATE_JOG) {
+            for (i = 0; i < count; i++)
+                limits_soft_check(targets[i]);
+        }
+    }
+    if (sys.state == STATE_CHECK_MODE) {
+#ifdef SD_COMPILE
+        for (i = 0; i < count; i++)
+            sd_compile_motion(targets[i], pl_data);
+#endif
+#ifdef SD_BENCHMARK
+        for (i = 0; i < count; i++)
+            sd_bench_motion(targets[i], pl_data);
+#endif
+        return;
+    }
+    while (count) {
+        do {
+            protocol_execute_realtime(); // Check for any run-time commands
+            if (sys.abort)  return;   // Bail, if system abort.
+            if (plan_check_full_buffer())  protocol_auto_cycle_start();     // Auto-cycle start when buffer is full.
+            else  break;
+#ifdef PROTOCOL_READ_AHEAD
+            protocol_read_ahead();
+#endif
+        } while (1);
+        uint8_t n = MIN(count, plan_get_block_buffer_available());
+        plan_buffer_lines(targets, n, pl_data);
+        targets += n;
+        count -= n;
+    }
+}
+#endif
+
+#ifdef USE_KINEMATICS
+// Returns the point at fraction t of the way from position to target, converted to joint space.
+static void mc_kins_point(const float* position, const float* target, float t,
+                          void (*transform)(const float* cartesian, float* joints), float* joints) {
+    float point[N_AXIS];
+    for (uint8_t idx = 0; idx < N_AXIS; idx++)
+        point[idx] = position[idx] + t * (target[idx] - position[idx]);
+    transform(point, joints);
+}
+
+static float mc_kins_distance(const float* a, const float* b) {
+    float sum = 0.0f;
+    for (uint8_t idx = 0; idx < N_AXIS; idx++)
+        sum += (a[idx] - b[idx]) * (a[idx] - b[idx]);
+    return sqrtf(sum);
+}
+
+// A straight joint-space segment misses the middle of its cartesian line by the distance, in
+// joint space, between the transformed middle and the middle of the transformed ends. Divided by
+// the joint travel per mm along the line there, a finite difference of the local Jacobian, this is
+// the chordal error in mm. It shrinks with the square of the segment length, so n segments of a
+// piece with error e each have e / n^2. The move is cut into pieces of max_length first, each
+// with its own estimate, and the worst piece sets the count for all of them.
+uint32_t mc_kins_segment_count(const float* position, const float* target, float max_length, float tolerance,
+                               void (*transform)(const float* cartesian, float* joints)) {
+    float length = mc_kins_distance(position, target);
+    if (length == 0.0f)
+        return 1;
+    float pieces_f = ceilf(length / MAX(max_length, 1e-3f));
+    uint32_t pieces = MIN(pieces_f, KINEMATICS_SEGMENTS_MAX);
+    float piece_length = length / pieces;
+    float worst = 0.0f; // Largest chordal error of a piece as one segment, in mm
+    float start[N_AXIS], end[N_AXIS], middle[N_AXIS], before[N_AXIS], after[N_AXIS];
+    mc_kins_point(position, target, 0.0f, transform, start);
+    for (uint32_t piece = 0; piece < pieces; piece++) {
+        float t0 = (float)piece / pieces;
+        float dt = 1.0f / pieces;
+        mc_kins_point(position, target, t0 + dt, transform, end);
+        mc_kins_point(position, target, t0 + 0.5f * dt, transform, middle);
+        mc_kins_point(position, target, t0 + 0.25f * dt, transform, before);
+        mc_kins_point(position, target, t0 + 0.75f * dt, transform, after);
+        float chord_middle[N_AXIS];
+        for (uint8_t idx = 0; idx < N_AXIS; idx++)
+            chord_middle[idx] = 0.5f * (start[idx] + end[idx]);
+        float joints_per_mm = mc_kins_distance(after, before) / (0.5f * piece_length);
+        if (joints_per_mm > 0.0f)
+            worst = MAX(worst, mc_kins_distance(middle, chord_middle) / joints_per_mm);
+        memcpy(start, end, sizeof(start));
+    }
+    float per_piece = ceilf(sqrtf(worst / MAX(tolerance, 1e-6f)));
+    return MIN(MAX(per_piece, 1.0f) * pieces, KINEMATICS_SEGMENTS_MAX);
+}
+#endif
+
+#ifdef USE_KINEMATICS_BATCH
+// The kinematics convert the targets in place, in order, and set the feed rate for the batch in a
+// copy of pl_data, so one call pays for the setup of the transform and the batch is planned with a
+// single replan.
+void mc_line_kins_batch(float (*targets)[N_AXIS], uint8_t count, plan_line_data_t* pl_data, float* position) {
+    if (count == 0)
+        return;
+    float last[N_AXIS];
+    memcpy(last, targets[count - 1], sizeof(last));
+    plan_line_data_t batch_data = *pl_data;
+    inverse_kinematics_batch(targets, count, &batch_data, position);
+    mc_line_batch(targets, count, &batch_data);
+    memcpy(position, last, sizeof(last));
+}
+#endif
+
+// Returns the chordal tolerance for an arc of the given radius and feed rate (mm/min). Normally this is
+// the arc_tolerance setting. With the arc_adaptive setting, fast arcs get longer segments when the
+// planner is running low. To accelerate to the feed rate and stop again, the planner needs blocks
+// covering the stopping distance feed^2/(2*acceleration). The segments are made long enough for the
+// planner buffer to hold that distance, scaled by the fraction of the buffer that is empty, so the
+// tolerance only grows while the planner is starving. It never exceeds ARC_ADAPTIVE_TOLERANCE_MAX times
+// the setting, and slow arcs keep the set tolerance.
+static float mc_arc_tolerance(float radius, float feed_rate, uint8_t axis_0, uint8_t axis_1) {
+    float tolerance = hot_settings->arc_tolerance;
+    if (!hot_settings->arc_adaptive)
+        return tolerance;
+    float acceleration = MIN(axis_settings[axis_0]->acceleration->get(), axis_settings[axis_1]->acceleration->get()) * SEC_PER_MIN_SQ;
+    uint8_t available = plan_get_block_buffer_available();
+    uint8_t blocks = available + plan_get_block_buffer_count();
+    if (acceleration <= 0.0f || blocks == 0)
+        return tolerance;
+    float segment_length = (feed_rate * feed_rate) / (2.0f * acceleration * blocks) * available / blocks;
+    float half_length = 0.5f * segment_length;
+    if (half_length >= radius)
+        return MIN(tolerance * ARC_ADAPTIVE_TOLERANCE_MAX, radius);
+    float sagitta = radius - sqrtf(radius * radius - half_length * half_length); // Tolerance of a segment this long
+    return MIN(MAX(tolerance, sagitta), MIN(tolerance * ARC_ADAPTIVE_TOLERANCE_MAX, radius));
+}
+
 // Execute an arc in offset mode format. position == current xyz, target == target xyz,
 // offset == offset from current xyz, axis_X defines circle plane in tool space, axis_linear is
 // the direction of helical travel, radius == circle radius, isclockwise boolean. Used
@@ -93,8 +284,8 @@ void mc_line(float* target, plan_line_data_t* pl_data) {
 // The arc is approximated by generating a huge number of tiny, linear segments. The chordal tolerance
 // of each segment is configured in the arc_tolerance setting, which is defined to be the maximum normal
 // distance from segment to the circle when the end points both lie on the circle.
-void mc_arc(float* target, plan_line_data_t* pl_data, float* position, float* offset, float radius,
-            uint8_t axis_0, uint8_t axis_1, uint8_t axis_linear, uint8_t is_clockwise_arc) {
+static void mc_arc_lines(float* target, plan_line_data_t* pl_data, float* position, float* offset, float radius,
+                         uint8_t axis_0, uint8_t axis_1, uint8_t axis_linear, uint8_t is_clockwise_arc) {
     float center_axis0 = position[axis_0] + offset[axis_0];
     float center_axis1 = position[axis_1] + offset[axis_1];
     float r_axis0 = -offset[axis_0];  // Radius vector from center to current location
@@ -108,7 +299,7 @@ void mc_arc(float* target, plan_line_data_t* pl_data, float* position, float* of
         previous_position[n] = position[n];
 #endif
     // CCW angle between position and target from circle center. Only one atan2() trig computation required.
-    float angular_travel = atan2(r_axis0 * rt_axis1 - r_axis1 * rt_axis0, r_axis0 * rt_axis0 + r_axis1 * rt_axis1);
+    float angular_travel = atan2f(r_axis0 * rt_axis1 - r_axis1 * rt_axis0, r_axis0 * rt_axis0 + r_axis1 * rt_axis1);
     if (is_clockwise_arc) { // Correct atan2 output per direction
         if (angular_travel >= -ARC_ANGULAR_TRAVEL_EPSILON)  angular_travel -= 2 * M_PI;
     } else {
@@ -118,8 +309,12 @@ void mc_arc(float* target, plan_line_data_t* pl_data, float* position, float* of
     // (2x) arc_tolerance. For 99% of users, this is just fine. If a different arc segment fit
     // is desired, i.e. least-squares, midpoint on arc, just change the mm_per_arc_segment calculation.
     // For the intended uses of Grbl, this value shouldn't exceed 2000 for the strictest of cases.
-    uint16_t segments = floor(fabs(0.5 * angular_travel * radius) /
-                              sqrt(arc_tolerance->get() * (2 * radius - arc_tolerance->get())));
+    float feed_rate = pl_data->feed_rate;
+    if (pl_data->condition & PL_COND_FLAG_INVERSE_TIME)
+        feed_rate *= fabsf(angular_travel * radius); // Inverse time is per motion. Approximate the arc length.
+    float tolerance = mc_arc_tolerance(radius, feed_rate, axis_0, axis_1);
+    uint16_t segments = floorf(fabsf(0.5f * angular_travel * radius) /
+                               sqrtf(tolerance * (2.0f * radius - tolerance)));
     if (segments) {
         // Multiply inverse feed_rate to compensate for the fact that this movement is approximated
         // by a number of discrete segments. The inverse feed_rate should be correct for the sum of
@@ -156,14 +351,19 @@ void mc_arc(float* target, plan_line_data_t* pl_data, float* position, float* of
            This is important when there are successive arc motions.
         */
         // Computes: cos_T = 1 - theta_per_segment^2/2, sin_T = theta_per_segment - theta_per_segment^3/6) in ~52usec
-        float cos_T = 2.0 - theta_per_segment * theta_per_segment;
-        float sin_T = theta_per_segment * 0.16666667 * (cos_T + 4.0);
-        cos_T *= 0.5;
+        // NOTE: The arc math is kept in single precision, which the ESP32 FPU computes in hardware.
+        float cos_T = 2.0f - theta_per_segment * theta_per_segment;
+        float sin_T = theta_per_segment * 0.16666667f * (cos_T + 4.0f);
+        cos_T *= 0.5f;
         float sin_Ti;
         float cos_Ti;
         float r_axisi;
         uint16_t i;
         uint8_t count = 0;
+#ifdef ARC_BATCHED_PLANNING
+        float batch[ARC_BATCH_SIZE][N_AXIS];
+        uint8_t batch_count = 0;
+#endif
         for (i = 1; i < segments; i++) { // Increment (segments-1).
             if (count < N_ARC_CORRECTION) {
                 // Apply vector rotation matrix. ~40 usec
@@ -174,8 +374,8 @@ void mc_arc(float* target, plan_line_data_t* pl_data, float* position, float* of
             } else {
                 // Arc correction to radius vector. Computed only every N_ARC_CORRECTION increments. ~375 usec
                 // Compute exact location by applying transformation matrix from initial radius vector(=-offset).
-                cos_Ti = cos(i * theta_per_segment);
-                sin_Ti = sin(i * theta_per_segment);
+                cos_Ti = cosf(i * theta_per_segment);
+                sin_Ti = sinf(i * theta_per_segment);
                 r_axis0 = -offset[axis_0] * cos_Ti + offset[axis_1] * sin_Ti;
                 r_axis1 = -offset[axis_0] * sin_Ti - offset[axis_1] * cos_Ti;
                 count = 0;
@@ -184,17 +384,36 @@ void mc_arc(float* target, plan_line_data_t* pl_data, float* position, float* of
             position[axis_0] = center_axis0 + r_axis0;
             position[axis_1] = center_axis1 + r_axis1;
             position[axis_linear] += linear_per_segment;
-#ifdef USE_KINEMATICS
+#ifdef USE_KINEMATICS_BATCH
+            memcpy(batch[batch_count++], position, sizeof(batch[0]));
+            if (batch_count == ARC_BATCH_SIZE) {
+                mc_line_kins_batch(batch, batch_count, pl_data, previous_position);
+                batch_count = 0;
+            }
+#elif defined(USE_KINEMATICS)
             mc_line_kins(position, pl_data, previous_position);
             previous_position[axis_0] = position[axis_0];
             previous_position[axis_1] = position[axis_1];
             previous_position[axis_linear] = position[axis_linear];
+#elif defined(ARC_BATCHED_PLANNING)
+            memcpy(batch[batch_count++], position, sizeof(batch[0]));
+            if (batch_count == ARC_BATCH_SIZE) {
+                mc_line_batch(batch, batch_count, pl_data);
+                batch_count = 0;
+            }
 #else
             mc_line(position, pl_data);
 #endif
             // Bail mid-circle on system abort. Runtime command check already performed by mc_line.
             if (sys.abort)  return;
         }
+#ifdef USE_KINEMATICS_BATCH
+        mc_line_kins_batch(batch, batch_count, pl_data, previous_position); // Remaining segments
+        if (sys.abort)  return;
+#elif defined(ARC_BATCHED_PLANNING)
+        mc_line_batch(batch, batch_count, pl_data); // Remaining segments
+        if (sys.abort)  return;
+#endif
     }
     // Ensure last segment arrives at target location.
 #ifdef USE_KINEMATICS
@@ -204,6 +423,172 @@ void mc_arc(float* target, plan_line_data_t* pl_data, float* position, float* of
 #endif
 }
 
+void mc_arc(float* target, plan_line_data_t* pl_data, float* position, float* offset, float radius,
+            uint8_t axis_0, uint8_t axis_1, uint8_t axis_linear, uint8_t is_clockwise_arc) {
+    // The segment end points lie on the circle, so the box of the circle bounds them in its plane.
+    float lo[N_AXIS], hi[N_AXIS];
+    mc_motion_box(position, target, lo, hi);
+    float center_axis0 = position[axis_0] + offset[axis_0];
+    float center_axis1 = position[axis_1] + offset[axis_1];
+    float r = MAX(hypot_f(offset[axis_0], offset[axis_1]), hypot_f(target[axis_0] - center_axis0, target[axis_1] - center_axis1));
+    lo[axis_0] = MIN(lo[axis_0], center_axis0 - r);
+    hi[axis_0] = MAX(hi[axis_0], center_axis0 + r);
+    lo[axis_1] = MIN(lo[axis_1], center_axis1 - r);
+    hi[axis_1] = MAX(hi[axis_1], center_axis1 + r);
+    mc_soft_limits_clear = mc_box_within_soft_limits(lo, hi);
+    mc_arc_lines(target, pl_data, position, offset, radius, axis_0, axis_1, axis_linear, is_clockwise_arc);
+    mc_soft_limits_clear = false;
+}
+
+
+// Execute a cubic Bezier spline from position to target, flattened into line segments that are
+// uniformly spaced in the curve parameter t. A chord over a parameter step h deviates from the curve
+// by at most h^2/8 times the largest second derivative, which is bounded by 6 times the largest second
+// difference of the control points. So n segments stay within the arc_tolerance setting when
+// n^2 >= 0.75 * max|second difference| / arc_tolerance. This makes the count follow the curvature.
+// Straight splines get a single segment and tight ones more.
+static void mc_spline_lines(float* target, plan_line_data_t* pl_data, float* position, float* control_1, float* control_2) {
+    float start_x = position[X_AXIS];
+    float start_y = position[Y_AXIS];
+    float second_diff = MAX(hypot_f(start_x - 2.0f * control_1[0] + control_2[0], start_y - 2.0f * control_1[1] + control_2[1]),
+                            hypot_f(control_1[0] - 2.0f * control_2[0] + target[X_AXIS], control_1[1] - 2.0f * control_2[1] + target[Y_AXIS]));
+    float segments_f = ceilf(sqrtf(0.75f * second_diff / MAX(hot_settings->arc_tolerance, 1e-6f)));
+    uint16_t segments = MIN(segments_f, SPLINE_SEGMENTS_MAX);
+    uint8_t idx;
+#ifdef USE_KINEMATICS
+    float previous_position[N_AXIS];
+    memcpy(previous_position, position, sizeof(previous_position));
+#endif
+    if (segments > 1) {
+        // Multiply inverse feed_rate to compensate for the number of segments, as in mc_arc().
+        if (pl_data->condition & PL_COND_FLAG_INVERSE_TIME) {
+            pl_data->feed_rate *= segments;
+            bit_false(pl_data->condition, PL_COND_FLAG_INVERSE_TIME); // Force as feed absolute mode over spline segments.
+        }
+        float linear_per_segment[N_AXIS];
+        for (idx = 0; idx < N_AXIS; idx++)
+            linear_per_segment[idx] = (target[idx] - position[idx]) / segments;
+#ifdef ARC_BATCHED_PLANNING
+        float batch[ARC_BATCH_SIZE][N_AXIS];
+        uint8_t batch_count = 0;
+#endif
+        uint16_t i;
+        for (i = 1; i < segments; i++) { // Increment (segments-1).
+            // Bernstein form of the cubic at t = i/segments.
+            float t = (float)i / segments;
+            float u = 1.0f - t;
+            float b0 = u * u * u;
+            float b1 = 3.0f * u * u * t;
+            float b2 = 3.0f * u * t * t;
+            float b3 = t * t * t;
+            for (idx = 0; idx < N_AXIS; idx++)
+                position[idx] += linear_per_segment[idx];
+            position[X_AXIS] = b0 * start_x + b1 * control_1[0] + b2 * control_2[0] + b3 * target[X_AXIS];
+            position[Y_AXIS] = b0 * start_y + b1 * control_1[1] + b2 * control_2[1] + b3 * target[Y_AXIS];
+#ifdef USE_KINEMATICS_BATCH
+            memcpy(batch[batch_count++], position, sizeof(batch[0]));
+            if (batch_count == ARC_BATCH_SIZE) {
+                mc_line_kins_batch(batch, batch_count, pl_data, previous_position);
+                batch_count = 0;
+            }
+#elif defined(USE_KINEMATICS)
+            mc_line_kins(position, pl_data, previous_position);
+            memcpy(previous_position, position, sizeof(previous_position));
+#elif defined(ARC_BATCHED_PLANNING)
+            memcpy(batch[batch_count++], position, sizeof(batch[0]));
+            if (batch_count == ARC_BATCH_SIZE) {
+                mc_line_batch(batch, batch_count, pl_data);
+                batch_count = 0;
+            }
+#else
+            mc_line(position, pl_data);
+#endif
+            // Bail mid-spline on system abort. Runtime command check already performed by mc_line.
+            if (sys.abort)  return;
+        }
+#ifdef USE_KINEMATICS_BATCH
+        mc_line_kins_batch(batch, batch_count, pl_data, previous_position); // Remaining segments
+        if (sys.abort)  return;
+#elif defined(ARC_BATCHED_PLANNING)
+        mc_line_batch(batch, batch_count, pl_data); // Remaining segments
+        if (sys.abort)  return;
+#endif
+    }
+    // Ensure last segment arrives at target location.
+#ifdef USE_KINEMATICS
+    mc_line_kins(target, pl_data, previous_position);
+#else
+    mc_line(target, pl_data);
+#endif
+}
+
+void mc_spline(float* target, plan_line_data_t* pl_data, float* position, float* control_1, float* control_2) {
+    // The curve stays inside the convex hull of its control points.
+    float lo[N_AXIS], hi[N_AXIS];
+    mc_motion_box(position, target, lo, hi);
+    lo[X_AXIS] = MIN(lo[X_AXIS], MIN(control_1[0], control_2[0]));
+    hi[X_AXIS] = MAX(hi[X_AXIS], MAX(control_1[0], control_2[0]));
+    lo[Y_AXIS] = MIN(lo[Y_AXIS], MIN(control_1[1], control_2[1]));
+    hi[Y_AXIS] = MAX(hi[Y_AXIS], MAX(control_1[1], control_2[1]));
+    mc_soft_limits_clear = mc_box_within_soft_limits(lo, hi);
+    mc_spline_lines(target, pl_data, position, control_1, control_2);
+    mc_soft_limits_clear = false;
+}
+
+// Moves the drilling axis of a canned cycle to level, at the feed rate or as a rapid
+static void mc_cycle_axis_move(float* position, uint8_t axis, float level, plan_line_data_t* pl_data, bool rapid) {
+    if (position[axis] == level)
+        return;
+    float target[N_AXIS];
+    memcpy(target, position, sizeof(target));
+    target[axis] = level;
+    plan_line_data_t move_data = *pl_data;
+    if (rapid)
+        move_data.condition |= PL_COND_FLAG_RAPID_MOTION;
+    mc_line_kins(target, &move_data, position);
+    memcpy(position, target, sizeof(target));
+}
+
+void mc_canned_cycle(const canned_cycle_t* cycle, plan_line_data_t* pl_data, float* position) {
+    uint8_t axis = cycle->axis;
+    if (position[axis] < cycle->r)
+        mc_cycle_axis_move(position, axis, cycle->r, pl_data, true);
+    for (uint8_t hole = 0; hole < cycle->repeats; hole++) {
+        // Rapid to the hole at the clearance level, or at R from below it
+        float target[N_AXIS];
+        memcpy(target, position, sizeof(target));
+        target[cycle->axis_0] = cycle->hole[0] + hole * cycle->step[0];
+        target[cycle->axis_1] = cycle->hole[1] + hole * cycle->step[1];
+        plan_line_data_t move_data = *pl_data;
+        move_data.condition |= PL_COND_FLAG_RAPID_MOTION;
+        mc_line_kins(target, &move_data, position);
+        memcpy(position, target, sizeof(target));
+        mc_cycle_axis_move(position, axis, cycle->r, pl_data, true);
+        if (cycle->motion == MOTION_MODE_DRILL_PECK || cycle->motion == MOTION_MODE_DRILL_CHIP_BREAK) {
+            float level = cycle->r;
+            while (level > cycle->depth) {
+                if (sys.abort)
+                    return;
+                level = MAX(level - cycle->peck, cycle->depth);
+                mc_cycle_axis_move(position, axis, level, pl_data, false);
+                if (level == cycle->depth)
+                    break;
+                // G83 clears the chips out of the hole and comes back down to just above the
+                // bottom. G73 only backs off that much to break the chip.
+                if (cycle->motion == MOTION_MODE_DRILL_PECK)
+                    mc_cycle_axis_move(position, axis, cycle->r, pl_data, true);
+                mc_cycle_axis_move(position, axis, MIN(level + CANNED_CYCLE_PECK_CLEARANCE, cycle->r), pl_data, true);
+            }
+        } else
+            mc_cycle_axis_move(position, axis, cycle->depth, pl_data, false);
+        if (cycle->motion == MOTION_MODE_DRILL_DWELL)
+            mc_dwell(cycle->dwell);
+        mc_cycle_axis_move(position, axis, cycle->clear, pl_data, true);
+        if (sys.abort)
+            return;
+    }
+}
+
 
 // Execute dwell in seconds.
 void mc_dwell(float seconds) {
@@ -263,6 +648,42 @@ void mc_homing_cycle(uint8_t cycle_mask) {
     } // Perform homing cycle based on mask.
     else
 #endif
+#ifdef HOMING_PARALLEL
+    {
+        uint8_t parallel_mask = 0;
+#ifdef HOMING_CYCLE_0
+        parallel_mask |= HOMING_CYCLE_0;
+#endif
+#ifdef HOMING_CYCLE_1
+        parallel_mask |= HOMING_CYCLE_1;
+#endif
+#ifdef HOMING_CYCLE_2
+        parallel_mask |= HOMING_CYCLE_2;
+#endif
+#ifdef HOMING_CYCLE_3
+        parallel_mask |= HOMING_CYCLE_3;
+#endif
+#ifdef HOMING_CYCLE_4
+        parallel_mask |= HOMING_CYCLE_4;
+#endif
+#ifdef HOMING_CYCLE_5
+        parallel_mask |= HOMING_CYCLE_5;
+#endif
+        // Every axis finds its switch in one pass, ganged axes with both motors.
+        limits_go_home(parallel_mask);
+        // Then each squared axis squares alone, the same as in its own cycle but with the
+        // dual motor pass already done.
+        for (uint8_t idx = 0; idx < N_AXIS; idx++) {
+            if ((parallel_mask & bit(idx)) && axis_is_squared(bit(idx))) {
+                ganged_mode = SQUARING_MODE_A;
+                limits_go_home(bit(idx));
+                ganged_mode = SQUARING_MODE_B;
+                limits_go_home(bit(idx));
+                ganged_mode = SQUARING_MODE_DUAL; // always return to dual
+            }
+        }
+    }
+#else
     {
         // Search to engage all axes limit switches at faster homing seek rate.
         if (! axis_is_squared(HOMING_CYCLE_0))
@@ -318,6 +739,7 @@ void mc_homing_cycle(uint8_t cycle_mask) {
         limits_go_home(HOMING_CYCLE_5);  // Homing cycle 5
 #endif
     }
+#endif
     protocol_execute_realtime(); // Check for reset and set system abort.
     if (sys.abort)  {
         return;   // Did not complete. Alarm state set by mc_alarm.
@@ -370,7 +792,12 @@ uint8_t mc_probe_cycle(float* target, plan_line_data_t* pl_data, uint8_t parser_
     // Probing cycle complete!
     // Set state variables and error out, if the probe failed and cycle with error is enabled.
     if (sys_probe_state == PROBE_ACTIVE) {
-        if (is_no_error)  memcpy(sys_probe_position, sys_position, sizeof(sys_position));
+        if (is_no_error) {
+            memcpy(sys_probe_position, sys_position, sizeof(sys_position));
+#ifdef PROBE_EDGE_CAPTURE
+            memset(probe_edge_offset, 0, sizeof(probe_edge_offset));
+#endif
+        }
         else  system_set_exec_alarm(EXEC_ALARM_PROBE_FAIL_CONTACT);
     } else {
         sys.probe_succeeded = true; // Indicate to system the probing cycle completed successfully.
@@ -390,6 +817,92 @@ uint8_t mc_probe_cycle(float* target, plan_line_data_t* pl_data, uint8_t parser_
     else  return (GC_PROBE_FAIL_END);  // Failed to trigger probe within travel. With or without error.
 }
 
+#ifdef PROBE_SEQUENCE
+// Unlike mc_probe_cycle(), there is no wait for the host between points. Once a point is hit,
+// the retract, the travel to the next point and the approach are queued together, so they run
+// as one motion. The probe stays off through the retract, while it is still triggered, and the
+// stepper ISR turns it on where the approach block starts.
+bool mc_probe_sequence(const float* xy, uint16_t n_points, float z_floor, float clearance, float feed_rate,
+                       void (*on_hit)(uint16_t point, const float* position)) {
+    if (sys.state == STATE_CHECK_MODE)  return (false);
+    protocol_buffer_synchronize();
+    if (sys.abort)  return (false);
+    probe_configure_invert_mask(false);
+    if (probe_get_state()) {
+        system_set_exec_alarm(EXEC_ALARM_PROBE_FAIL_INITIAL);
+        protocol_execute_realtime();
+        return (false);
+    }
+    plan_line_data_t plan_data;
+    plan_line_data_t* pl_data = &plan_data;
+    memset(pl_data, 0, sizeof(plan_line_data_t));
+    pl_data->spindle_speed = gc_state.spindle_speed;
+    uint8_t accessory = gc_state.modal.spindle | gc_state.modal.coolant;
+    float target[N_AXIS];
+    float position[N_AXIS];
+    system_convert_array_steps_to_mpos(target, sys_position);
+    bool probed = true;
+    for (uint16_t point = 0; point < n_points; point++) {
+        // The first point is reached at the present height, the others at the retract height.
+        pl_data->condition = PL_COND_FLAG_RAPID_MOTION | accessory;
+        pl_data->probe = false;
+        if (point > 0) {
+            target[Z_AXIS] = position[Z_AXIS] + clearance;
+            mc_line(target, pl_data);
+        }
+        target[X_AXIS] = xy[2 * point];
+        target[Y_AXIS] = xy[2 * point + 1];
+        mc_line(target, pl_data);
+        pl_data->condition = PL_COND_FLAG_NO_FEED_OVERRIDE | accessory;
+        pl_data->feed_rate = feed_rate;
+        pl_data->probe = true;
+        target[Z_AXIS] = z_floor;
+        mc_line(target, pl_data);
+        sys.probe_succeeded = false;
+        sys_probe_state = PROBE_ARMED;
+        system_set_exec_state_flag(EXEC_CYCLE_START);
+        do {
+            protocol_execute_realtime();
+            if (sys.abort) {
+                sys_probe_state = PROBE_OFF;
+                return (false);
+            }
+        } while (sys.state != STATE_IDLE);
+        if (sys_probe_state != PROBE_OFF) {
+            // The approach reached z_floor without a contact
+            sys_probe_state = PROBE_OFF;
+            system_set_exec_alarm(EXEC_ALARM_PROBE_FAIL_CONTACT);
+            probed = false;
+            break;
+        }
+        sys.probe_succeeded = true;
+        probe_get_position(position);
+        on_hit(point, position);
+        protocol_execute_realtime();
+        // Remove the rest of the approach. The next motions start from where it stopped.
+        st_reset();
+        plan_reset();
+        plan_sync_position();
+        system_convert_array_steps_to_mpos(target, sys_position);
+    }
+    if (probed) {
+        // Clear the last point
+        pl_data->condition = PL_COND_FLAG_RAPID_MOTION | accessory;
+        pl_data->probe = false;
+        target[Z_AXIS] = position[Z_AXIS] + clearance;
+        mc_line(target, pl_data);
+        protocol_buffer_synchronize();
+    } else {
+        protocol_execute_realtime();
+        st_reset();
+        plan_reset();
+        plan_sync_position();
+    }
+    gc_sync_position();
+    return (probed && !sys.abort);
+}
+#endif
+
 
 // Plans and executes the single special motion case for parking. Independent of main planner buffer.
 // NOTE: Uses the always free planner ring buffer head to store motion parameters for execution.
@@ -428,40 +941,75 @@ void mc_override_ctrl_update(uint8_t override_state) {
 // is in a motion state. If so, kills the steppers and sets the system alarm to flag position
 // lost, since there was an abrupt uncontrolled deceleration. Called at an interrupt level by
 // realtime abort command and hard limits. So, keep to a minimum.
+// Set by mc_reset_isr() until mc_reset_complete() has run
+static volatile bool mc_reset_pending = false;
+
+static void mc_reset_outputs() {
+    // Kill spindle and coolant.
+    spindle_stop_all();
+    coolant_stop();
+    // turn off all digital I/O
+    sys_io_control(0xFF, false);
+#ifdef ENABLE_SD_CARD
+    // do we need to stop a running SD job?
+    if (get_sd_state(false) == SDCARD_BUSY_PRINTING) {
+        //Report print stopped
+        report_feedback_message(MESSAGE_SD_FILE_QUIT);
+        closeFile();
+    }
+#ifdef SD_JOB_QUEUE
+    sd_queue_clear(); // A reset stops the run, including the jobs queued after it
+#endif
+#endif
+}
+
+static void IRAM_ATTR mc_reset_steppers() {
+    // Kill steppers only if in any motion state, i.e. cycle, actively holding, or homing.
+    // NOTE: If steppers are kept enabled via the step idle delay setting, this also keeps
+    // the steppers enabled by avoiding the go_idle call altogether, unless the motion state is
+    // violated, by which, all bets are off.
+    if ((sys.state & (STATE_CYCLE | STATE_HOMING | STATE_JOG)) ||
+            (sys.step_control & (STEP_CONTROL_EXECUTE_HOLD | STEP_CONTROL_EXECUTE_SYS_MOTION))) {
+        if (sys.state == STATE_HOMING) {
+            if (!sys_rt_exec_alarm) system_set_exec_alarm(EXEC_ALARM_HOMING_FAIL_RESET);
+        } else  system_set_exec_alarm(EXEC_ALARM_ABORT_CYCLE);
+        st_go_idle(); // Force kill steppers. Position has likely been lost.
+    }
+    ganged_mode = SQUARING_MODE_DUAL; // in case an error occurred during squaring
+}
+
 void mc_reset() {
     // Only this function can set the system reset. Helps prevent multiple kill calls.
     if (bit_isfalse(sys_rt_exec_state, EXEC_RESET)) {
         system_set_exec_state_flag(EXEC_RESET);
-        // Kill spindle and coolant.
-        spindle->stop();
-        coolant_stop();
-        // turn off all digital I/O
-        sys_io_control(0xFF, false);
-#ifdef ENABLE_SD_CARD
-        // do we need to stop a running SD job?
-        if (get_sd_state(false) == SDCARD_BUSY_PRINTING) {
-            //Report print stopped
-            report_feedback_message(MESSAGE_SD_FILE_QUIT);
-            closeFile();
-        }
-#endif
-        // Kill steppers only if in any motion state, i.e. cycle, actively holding, or homing.
-        // NOTE: If steppers are kept enabled via the step idle delay setting, this also keeps
-        // the steppers enabled by avoiding the go_idle call altogether, unless the motion state is
-        // violated, by which, all bets are off.
-        if ((sys.state & (STATE_CYCLE | STATE_HOMING | STATE_JOG)) ||
-                (sys.step_control & (STEP_CONTROL_EXECUTE_HOLD | STEP_CONTROL_EXECUTE_SYS_MOTION))) {
-            if (sys.state == STATE_HOMING) {
-                if (!sys_rt_exec_alarm) system_set_exec_alarm(EXEC_ALARM_HOMING_FAIL_RESET);
-            } else  system_set_exec_alarm(EXEC_ALARM_ABORT_CYCLE);
-            st_go_idle(); // Force kill steppers. Position has likely been lost.
-        }
-        ganged_mode = SQUARING_MODE_DUAL; // in case an error occurred during squaring
-
+        mc_reset_outputs();
+        mc_reset_steppers();
 #ifdef USE_I2S_OUT_STREAM
         i2s_out_reset();
 #endif
     }
 }
 
+// The spindle stop can be a VFD command over RS485, and the SD job stop reports and closes the
+// file, so none of mc_reset_outputs() runs here.
+void IRAM_ATTR mc_reset_isr() {
+    if (bit_isfalse(sys_rt_exec_state, EXEC_RESET)) {
+        system_set_exec_state_flag(EXEC_RESET);
+        mc_reset_steppers();
+        mc_reset_pending = true;
+    }
+}
+
+// Called from protocol_exec_rt_system() only. The SD job stop reports and closes the file the main
+// loop reads the job from, so it must not run beside it in another task.
+void mc_reset_complete() {
+    if (!mc_reset_pending)
+        return;
+    mc_reset_pending = false;
+    mc_reset_outputs();
+#ifdef USE_I2S_OUT_STREAM
+    i2s_out_reset();
+#endif
+}
+
 
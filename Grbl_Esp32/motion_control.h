@@ -42,6 +42,47 @@
 #define HOMING_CYCLE_B    bit(B_AXIS)
 #define HOMING_CYCLE_C    bit(C_AXIS)
 
+// Maximum number of arc segments planned together with ARC_BATCHED_PLANNING, and of points
+// converted together with USE_KINEMATICS_BATCH.
+#ifndef ARC_BATCH_SIZE
+    #define ARC_BATCH_SIZE 8
+#endif
+
+// Upper limit of the arc tolerance used by the GCode/ArcAdaptive setting, as a multiple of the
+// GCode/ArcTolerance setting.
+#ifndef ARC_ADAPTIVE_TOLERANCE_MAX
+    #define ARC_ADAPTIVE_TOLERANCE_MAX 10.0f
+#endif
+
+// Upper limit of the number of line segments of a G5/G5.1 spline.
+#ifndef SPLINE_SEGMENTS_MAX
+    #define SPLINE_SEGMENTS_MAX 1000
+#endif
+
+// How far a G83 peck rapids back down to above the bottom of the last one, and a G73 peck
+// backs off to break the chip. LinuxCNC uses the same 0.010 inch.
+#ifndef CANNED_CYCLE_PECK_CLEARANCE
+    #define CANNED_CYCLE_PECK_CLEARANCE 0.254f // mm
+#endif
+
+// Upper limit of the number of segments mc_kins_segment_count() cuts a move into.
+#ifndef KINEMATICS_SEGMENTS_MAX
+    #define KINEMATICS_SEGMENTS_MAX 1000
+#endif
+
+// Kinematics turn each arc segment into its own motions, so arc segments are not batched, unless
+// the kinematics convert whole batches with inverse_kinematics_batch().
+#ifdef USE_KINEMATICS_BATCH
+    #ifndef USE_KINEMATICS
+        #error "USE_KINEMATICS_BATCH requires USE_KINEMATICS"
+    #endif
+    #ifndef ARC_BATCHED_PLANNING
+        #define ARC_BATCHED_PLANNING
+    #endif
+#elif defined(USE_KINEMATICS)
+    #undef ARC_BATCHED_PLANNING
+#endif
+
 
 // Execute linear motion in absolute millimeter coordinates. Feed rate given in millimeters/second
 // unless invert_feed_rate is true. Then the feed_rate means that the motion should be completed in
@@ -49,6 +90,25 @@
 void mc_line_kins(float* target, plan_line_data_t* pl_data, float* position);
 void mc_line(float* target, plan_line_data_t* pl_data);
 
+#ifdef ARC_BATCHED_PLANNING
+// Execute count linear motions like mc_line(), planned together with one replan.
+void mc_line_batch(float (*targets)[N_AXIS], uint8_t count, plan_line_data_t* pl_data);
+#endif
+
+#ifdef USE_KINEMATICS
+// Returns the number of equal segments to cut a move into, so that each segment, a straight line
+// in joint space, stays within tolerance mm of the cartesian line. Segments are at most max_length
+// mm. transform converts a cartesian point to joint space.
+uint32_t mc_kins_segment_count(const float* position, const float* target, float max_length, float tolerance,
+                               void (*transform)(const float* cartesian, float* joints));
+#endif
+
+#ifdef USE_KINEMATICS_BATCH
+// Convert count cartesian targets to joint space in one call and plan them together. position is
+// the cartesian start of the first target and is moved to the last one.
+void mc_line_kins_batch(float (*targets)[N_AXIS], uint8_t count, plan_line_data_t* pl_data, float* position);
+#endif
+
 // Execute an arc in offset mode format. position == current xyz, target == target xyz,
 // offset == offset from current xyz, axis_XXX defines circle plane in tool space, axis_linear is
 // the direction of helical travel, radius == circle radius, is_clockwise_arc boolean. Used
@@ -56,6 +116,34 @@ void mc_line(float* target, plan_line_data_t* pl_data);
 void mc_arc(float* target, plan_line_data_t* pl_data, float* position, float* offset, float radius,
             uint8_t axis_0, uint8_t axis_1, uint8_t axis_linear, uint8_t is_clockwise_arc);
 
+// Execute a cubic Bezier spline in the XY plane from position to target. control_1 and control_2 are
+// the absolute XY positions of the control points. The other axes move linearly.
+void mc_spline(float* target, plan_line_data_t* pl_data, float* position, float* control_1, float* control_2);
+
+// A canned drilling cycle of the parser, with every level of the drilling axis in machine
+// coordinates. The axis is the one normal to the plane, and r is above depth along it.
+typedef struct {
+    uint8_t motion;     // MOTION_MODE_DRILL, _DWELL, _PECK or _CHIP_BREAK
+    uint8_t axis;       // The drilling axis
+    uint8_t axis_0;     // The axes of the plane, which move to the holes
+    uint8_t axis_1;
+    float hole[2];      // The first hole, on axis_0 and axis_1
+    float step[2];      // From one hole to the next, G91 only
+    uint8_t repeats;    // L, the number of holes
+    float r;            // The level the holes start from
+    float depth;        // The bottom of the holes
+    float clear;        // The level between the holes. The start with G98 if above R, else R.
+    float peck;         // Q of G73 and G83
+    float dwell;        // P of G82, in seconds
+} canned_cycle_t;
+
+// Drill the holes of a canned cycle from position, which is moved to above the last hole at the
+// clearance level. At each hole, the axes of the plane rapid to it at the clearance level, the
+// drilling axis rapids to R, feeds down to the depth, pecking for G73 and G83, dwells there for
+// G82, and rapids back to the clearance level. The drilling axis first rapids up to R if it
+// starts below it.
+void mc_canned_cycle(const canned_cycle_t* cycle, plan_line_data_t* pl_data, float* position);
+
 // Dwell for a specific number of seconds
 void mc_dwell(float seconds);
 
@@ -65,6 +153,13 @@ void mc_homing_cycle(uint8_t cycle_mask);
 // Perform tool length probe cycle. Requires probe switch.
 uint8_t mc_probe_cycle(float* target, plan_line_data_t* pl_data, uint8_t parser_flags);
 
+#ifdef PROBE_SEQUENCE
+// Probes down to z_floor at each of the n_points XY pairs in xy, in machine coordinates, and
+// passes each probe position to on_hit. Returns true when every point was probed.
+bool mc_probe_sequence(const float* xy, uint16_t n_points, float z_floor, float clearance, float feed_rate,
+                       void (*on_hit)(uint16_t point, const float* position));
+#endif
+
 // Handles updating the override control state.
 void mc_override_ctrl_update(uint8_t override_state);
 
@@ -74,4 +169,9 @@ void mc_parking_motion(float* parking_target, plan_line_data_t* pl_data);
 // Performs system reset. If in motion state, kills all motion and sets system alarm.
 void mc_reset();
 
+// The part of mc_reset() that is safe in an interrupt: sets the reset and kills the steppers.
+// mc_reset_complete() stops the spindle, coolant, I/O and SD job after it, from the main loop.
+void mc_reset_isr();
+void mc_reset_complete();
+
 #endif
@@ -0,0 +1,125 @@
+/*
+	mpg.cpp
+	Part of Grbl_ESP32
+
+	Grbl is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Grbl is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+	See mpg.h for usage.
+*/
+
+#include "grbl.h"
+
+#ifdef USE_MPG
+
+#include <driver/pcnt.h>
+
+static bool mpg_present = false;
+static int16_t mpg_last_count = 0; // Wraps like the 16 bit counter, so differences stay right
+static int32_t mpg_counts = 0;     // Counted and not yet moved, less than a detent when idle
+static bool mpg_sync = false;      // The parser position waits for the jog to stop
+
+// Counts both edges of both channels, 4 counts per line like encoder.cpp. The counter is never
+// cleared, it wraps at its 16 bit range.
+void mpg_init() {
+    if (MPG_A_PIN == UNDEFINED_PIN || MPG_B_PIN == UNDEFINED_PIN) {
+        grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "No MPG defined");
+        return;
+    }
+    pcnt_config_t config = {};
+    config.unit = MPG_PCNT_UNIT;
+    config.counter_h_lim = INT16_MAX;
+    config.counter_l_lim = INT16_MIN;
+    config.lctrl_mode = PCNT_MODE_REVERSE;
+    config.hctrl_mode = PCNT_MODE_KEEP;
+
+    config.channel = PCNT_CHANNEL_0;
+    config.pulse_gpio_num = MPG_A_PIN;
+    config.ctrl_gpio_num = MPG_B_PIN;
+    config.pos_mode = PCNT_COUNT_DEC;
+    config.neg_mode = PCNT_COUNT_INC;
+    pcnt_unit_config(&config);
+
+    config.channel = PCNT_CHANNEL_1;
+    config.pulse_gpio_num = MPG_B_PIN;
+    config.ctrl_gpio_num = MPG_A_PIN;
+    config.pos_mode = PCNT_COUNT_INC;
+    config.neg_mode = PCNT_COUNT_DEC;
+    pcnt_unit_config(&config);
+
+    pcnt_set_filter_value(MPG_PCNT_UNIT, MPG_PCNT_FILTER);
+    pcnt_filter_enable(MPG_PCNT_UNIT);
+    pcnt_counter_pause(MPG_PCNT_UNIT);
+    pcnt_counter_clear(MPG_PCNT_UNIT);
+    pcnt_counter_resume(MPG_PCNT_UNIT);
+    mpg_present = true;
+    grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "MPG A:%s B:%s", pinName(MPG_A_PIN).c_str(), pinName(MPG_B_PIN).c_str());
+}
+
+void mpg_update() {
+    if (!mpg_present)
+        return;
+    int16_t count;
+    pcnt_get_counter_value(MPG_PCNT_UNIT, &count);
+    int16_t delta = count - mpg_last_count;
+    mpg_last_count = count;
+    int8_t axis = mpg_axis->get();
+    if (axis == MPG_AXIS_OFF || (sys.state != STATE_IDLE && sys.state != STATE_JOG) || (sys.suspend & SUSPEND_JOG_CANCEL)) {
+        mpg_counts = 0; // Turns of the wheel while it can not jog are not kept
+        if (mpg_sync && sys.state == STATE_IDLE) {
+            gc_sync_position();
+            mpg_sync = false;
+        }
+        return;
+    }
+    mpg_counts += delta;
+    int32_t detents = mpg_counts / MPG_COUNTS_PER_DETENT;
+    if (detents == 0) {
+        if (mpg_sync && sys.state == STATE_IDLE) {
+            gc_sync_position();
+            mpg_sync = false;
+        }
+        return;
+    }
+    if (plan_get_block_buffer_size() - plan_get_block_buffer_available() >= MPG_MAX_BLOCKS)
+        return; // Counts wait for the planned blocks to run
+    float step = mpg_step->get();
+    float rate = mpg_rate->get();
+    // Drop what the axis could not catch up with soon after the wheel stops
+    int32_t max_detents = MAX(1, (int32_t)(rate * MPG_MAX_LAG_MS / 60000.0 / step));
+    detents = MIN(MAX(detents, -max_detents), max_detents);
+    mpg_counts = mpg_counts % MPG_COUNTS_PER_DETENT;
+    float target[N_AXIS];
+    plan_get_position(target);
+    target[axis] += detents * step;
+    if (soft_limits->get() && system_check_travel_limits(target))
+        return;
+    plan_line_data_t plan_data;
+    plan_line_data_t* pl_data = &plan_data;
+    memset(pl_data, 0, sizeof(plan_line_data_t));
+    pl_data->feed_rate = rate;
+    pl_data->spindle_speed = gc_state.spindle_speed;
+    pl_data->condition = PL_COND_FLAG_NO_FEED_OVERRIDE | gc_state.modal.spindle | gc_state.modal.coolant;
+#ifdef USE_LINE_NUMBERS
+    pl_data->line_number = JOG_LINE_NUMBER;
+#endif
+    plan_buffer_line(target, pl_data);
+    mpg_sync = true;
+    if (sys.state == STATE_IDLE && plan_get_current_block() != NULL) {
+        sys.state = STATE_JOG;
+        st_prep_buffer();
+        st_wake_up();
+    }
+}
+
+#endif
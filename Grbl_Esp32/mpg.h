@@ -0,0 +1,65 @@
+/*
+	mpg.h
+	Part of Grbl_ESP32
+
+	Grbl is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	Grbl is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+
+	Handwheel (MPG)
+
+	Counts a quadrature manual pulse generator with a PCNT unit and jogs the axis chosen by
+	MPG/Axis by MPG/Step mm per detent, at up to MPG/Rate mm/min. The jog is planned straight
+	from the counts, without G-code, so the latency is that of the main loop and not of the
+	host or the network. Only MPG_MAX_BLOCKS blocks are planned ahead, and counts that would
+	be more than MPG_MAX_LAG_MS of travel behind are dropped, so the axis stops soon after
+	the wheel.
+
+	Usage
+
+	1. In config.h un-comment #define USE_MPG
+
+	2. In the machine definition file in Machines/, define the handwheel pins like this ....
+				#define MPG_A_PIN				GPIO_NUM_32
+				#define MPG_B_PIN				GPIO_NUM_33
+
+	3. $MPG/Axis=X selects the axis, $MPG/Axis=OFF ignores the wheel.
+*/
+
+#ifndef mpg_h
+#define mpg_h
+
+// Encoders use the PCNT units from 0 up, one per axis, and the spindle tachometer unit 7.
+#define MPG_PCNT_UNIT PCNT_UNIT_6
+
+#ifndef MPG_COUNTS_PER_DETENT
+    #define MPG_COUNTS_PER_DETENT 4
+#endif
+// Glitches shorter than this many APB clocks (12.5ns) are ignored. Max 1023.
+#ifndef MPG_PCNT_FILTER
+    #define MPG_PCNT_FILTER 1000
+#endif
+#ifndef MPG_MAX_BLOCKS
+    #define MPG_MAX_BLOCKS 2
+#endif
+#ifndef MPG_MAX_LAG_MS
+    #define MPG_MAX_LAG_MS 200
+#endif
+
+#define MPG_AXIS_OFF -1 // MPG/Axis value with the wheel ignored
+
+void mpg_init();
+
+// Plans the jog for the detents counted since the last call. Called by protocol_exec_rt_system().
+void mpg_update();
+
+#endif
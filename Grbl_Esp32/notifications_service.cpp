@@ -79,6 +79,11 @@ NotificationsService::NotificationsService() {
     _token1 = "";
     _token1 = "";
     _settings = "";
+    _queue = NULL;
+    _task = NULL;
+    _mutex = NULL;
+    _client = NULL;
+    _logged_in = false;
 }
 NotificationsService::~NotificationsService() {
     end();
@@ -102,23 +107,119 @@ const char* NotificationsService::getTypeString() {
     return "None";
 }
 
+// Adds next to the message of notification as a line of its own. False when it does not fit.
+bool NotificationsService::batch(notification_t* notification, const notification_t* next) {
+    size_t len = strlen(notification->message);
+    size_t room = sizeof(notification->message) - len;
+    int added = snprintf(notification->message + len, room, "\n%s: %s", next->title, next->message);
+    if (added < 0 || (size_t)added >= room) {
+        notification->message[len] = '\0';
+        return false;
+    }
+    return true;
+}
+
+// The sends block for seconds in the TLS handshake and in Wait4Answer(), so they are done by
+// this task and never by the caller of grbl_notify(), which may be the main loop.
+void NotificationsService::notificationsTask(void* pvParameters) {
+    NotificationsService* service = (NotificationsService*)pvParameters;
+    notification_t notification;
+    notification_t next;
+    bool pending = false; // next is waiting for the message after this one
+    while (true) {
+        if (pending) {
+            notification = next;
+            pending = false;
+        } else if (xQueueReceive(service->_queue, &notification, pdMS_TO_TICKS(NOTIFICATIONS_IDLE_MS)) != pdTRUE) {
+            // Nothing for a while. The provider would drop the connection soon anyway.
+            xSemaphoreTake(service->_mutex, portMAX_DELAY);
+            service->closeClient();
+            xSemaphoreGive(service->_mutex);
+            continue;
+        }
+        // Events often come in bursts, like an error and then the end of the job
+        while (xQueueReceive(service->_queue, &next, pdMS_TO_TICKS(NOTIFICATIONS_BATCH_MS)) == pdTRUE) {
+            if (!batch(&notification, &next)) {
+                pending = true;
+                break;
+            }
+        }
+        xSemaphoreTake(service->_mutex, portMAX_DELAY);
+        if (service->_started && !service->deliver(&notification))
+            log_d("Notification %s not sent", notification.title);
+        xSemaphoreGive(service->_mutex);
+    }
+}
+
 bool NotificationsService::sendMSG(const char* title, const char* message) {
-    if (!_started) return false;
-    if (!((strlen(title) == 0) && (strlen(message) == 0))) {
-        switch (_notificationType) {
-        case ESP_PUSHOVER_NOTIFICATION:
-            return sendPushoverMSG(title, message);
-            break;
-        case ESP_EMAIL_NOTIFICATION:
-            return sendEmailMSG(title, message);
-            break;
-        case ESP_LINE_NOTIFICATION :
-            return sendLineMSG(title, message);
-            break;
-        default:
-            break;
+    if (!_started || _queue == NULL) return false;
+    if ((strlen(title) == 0) && (strlen(message) == 0))
+        return false;
+    notification_t notification;
+    strncpy(notification.title, title, sizeof(notification.title) - 1);
+    notification.title[sizeof(notification.title) - 1] = '\0';
+    strncpy(notification.message, message, sizeof(notification.message) - 1);
+    notification.message[sizeof(notification.message) - 1] = '\0';
+    return xQueueSend(_queue, &notification, 0) == pdTRUE;
+}
+
+// A connection kept from an earlier message may have been closed by the server without us
+// seeing it yet, so a failed send on one is tried once more on a new connection.
+bool NotificationsService::deliver(const notification_t* notification) {
+    HEAP_TAG_SCOPE(HEAP_TAG_NOTIFICATIONS);
+    bool reused = _client != NULL && _client->connected();
+    bool res = send(notification);
+    if (!res) {
+        closeClient();
+        if (reused) {
+            res = send(notification);
+            if (!res)
+                closeClient();
         }
     }
+    return res;
+}
+
+// Connects _client to the provider unless it still is, which saves the TLS handshake, its
+// seconds of CPU time and its heap. The WiFiClientSecure of the core has no session
+// resumption, so the connection itself is what is kept.
+bool NotificationsService::connectClient() {
+    if (_client == NULL)
+        _client = new WiFiClientSecure();
+    if (_client->connected()) {
+        while (_client->available()) // What is left of the last answer
+            _client->read();
+        return true;
+    }
+    _client->stop();
+    _logged_in = false;
+    if (!_client->connect(_serveraddress.c_str(), _port)) {
+        log_d("Error connecting  server %s:%d", _serveraddress.c_str(), _port);
+        return false;
+    }
+    return true;
+}
+
+void NotificationsService::closeClient() {
+    if (_client == NULL)
+        return;
+    if (_logged_in && _client->connected())
+        _client->print("QUIT\r\n");
+    _client->stop();
+    _logged_in = false;
+}
+
+bool NotificationsService::send(const notification_t* notification) {
+    switch (_notificationType) {
+    case ESP_PUSHOVER_NOTIFICATION:
+        return sendPushoverMSG(notification->title, notification->message);
+    case ESP_EMAIL_NOTIFICATION:
+        return sendEmailMSG(notification->title, notification->message);
+    case ESP_LINE_NOTIFICATION :
+        return sendLineMSG(notification->title, notification->message);
+    default:
+        break;
+    }
     return false;
 }
 //Messages are currently limited to 1024 4-byte UTF-8 characters
@@ -126,12 +227,9 @@ bool NotificationsService::sendMSG(const char* title, const char* message) {
 bool NotificationsService::sendPushoverMSG(const char* title, const char* message) {
     String data;
     String postcmd;
-    bool res;
-    WiFiClientSecure Notificationclient;
-    if (!Notificationclient.connect(_serveraddress.c_str(), _port)) {
-        log_d("Error connecting  server %s:%d", _serveraddress.c_str(), _port);
+    if (!connectClient())
         return false;
-    }
+    WiFiClientSecure& Notificationclient = *_client;
     //build data for post
     data = "user=";
     data += _token1;
@@ -144,56 +242,55 @@ bool NotificationsService::sendPushoverMSG(const char* title, const char* messag
     data += "&device=";
     data += wifi_config.Hostname();
     //build post query
-    postcmd  = "POST /1/messages.json HTTP/1.1\r\nHost: api.pushover.net\r\nConnection: close\r\nCache-Control: no-cache\r\nUser-Agent: ESP3D\r\nAccept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\nContent-Length: ";
+    postcmd  = "POST /1/messages.json HTTP/1.1\r\nHost: api.pushover.net\r\nConnection: keep-alive\r\nCache-Control: no-cache\r\nUser-Agent: ESP3D\r\nAccept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\nContent-Length: ";
     postcmd  += data.length();
     postcmd  += "\r\n\r\n";
     postcmd  += data;
     log_d("Query: %s", postcmd.c_str());
     //send query
     Notificationclient.print(postcmd);
-    res = Wait4Answer(Notificationclient, "{", "\"status\":1",  PUSHOVERTIMEOUT);
-    Notificationclient.stop();
-    return res;
+    return Wait4Answer(Notificationclient, "{", "\"status\":1",  PUSHOVERTIMEOUT);
 }
 bool NotificationsService::sendEmailMSG(const char* title, const char* message) {
-    WiFiClientSecure Notificationclient;
     log_d("Connect to server");
-    if (!Notificationclient.connect(_serveraddress.c_str(), _port)) {
-        log_d("Error connecting  server %s:%d", _serveraddress.c_str(), _port);
-        return false;
-    }
-    //Check answer of connection
-    if (!Wait4Answer(Notificationclient, "220", "220", EMAILTIMEOUT)) {
-        log_d("Connection failed!");
-        return false;
-    }
-    //Do HELO
-    log_d("HELO");
-    Notificationclient.print("HELO friend\r\n");
-    if (!Wait4Answer(Notificationclient, "250", "250", EMAILTIMEOUT)) {
-        log_d("HELO failed!");
-        return false;
-    }
-    log_d("AUTH LOGIN");
-    //Request AUthentication
-    Notificationclient.print("AUTH LOGIN\r\n");
-    if (!Wait4Answer(Notificationclient, "334", "334", EMAILTIMEOUT)) {
-        log_d("AUTH LOGIN failed!");
-        return false;
-    }
-    log_d("Send LOGIN");
-    //sent Login
-    Notificationclient.printf("%s\r\n", _token1.c_str());
-    if (!Wait4Answer(Notificationclient, "334", "334", EMAILTIMEOUT)) {
-        log_d("Sent login failed!");
-        return false;
-    }
-    log_d("Send PASSWORD");
-    //Send password
-    Notificationclient.printf("%s\r\n", _token2.c_str());
-    if (!Wait4Answer(Notificationclient, "235", "235", EMAILTIMEOUT)) {
-        log_d("Sent password failed!");
+    if (!connectClient())
         return false;
+    WiFiClientSecure& Notificationclient = *_client;
+    if (!_logged_in) {
+        //Check answer of connection
+        if (!Wait4Answer(Notificationclient, "220", "220", EMAILTIMEOUT)) {
+            log_d("Connection failed!");
+            return false;
+        }
+        //Do HELO
+        log_d("HELO");
+        Notificationclient.print("HELO friend\r\n");
+        if (!Wait4Answer(Notificationclient, "250", "250", EMAILTIMEOUT)) {
+            log_d("HELO failed!");
+            return false;
+        }
+        log_d("AUTH LOGIN");
+        //Request AUthentication
+        Notificationclient.print("AUTH LOGIN\r\n");
+        if (!Wait4Answer(Notificationclient, "334", "334", EMAILTIMEOUT)) {
+            log_d("AUTH LOGIN failed!");
+            return false;
+        }
+        log_d("Send LOGIN");
+        //sent Login
+        Notificationclient.printf("%s\r\n", _token1.c_str());
+        if (!Wait4Answer(Notificationclient, "334", "334", EMAILTIMEOUT)) {
+            log_d("Sent login failed!");
+            return false;
+        }
+        log_d("Send PASSWORD");
+        //Send password
+        Notificationclient.printf("%s\r\n", _token2.c_str());
+        if (!Wait4Answer(Notificationclient, "235", "235", EMAILTIMEOUT)) {
+            log_d("Sent password failed!");
+            return false;
+        }
+        _logged_in = true;
     }
     log_d("MAIL FROM");
     //Send From
@@ -229,31 +326,21 @@ bool NotificationsService::sendEmailMSG(const char* title, const char* message)
         log_d("Sending final dot failed!");
         return false;
     }
-    log_d("QUIT");
-    //Quit
-    Notificationclient.print("QUIT\r\n");
-    if (!Wait4Answer(Notificationclient, "221", "221", EMAILTIMEOUT)) {
-        log_d("QUIT failed!");
-        return false;
-    }
-    Notificationclient.stop();
+    //The session stays open for the next message, closeClient() sends the QUIT
     return true;
 }
 bool NotificationsService::sendLineMSG(const char* title, const char* message) {
     String data;
     String postcmd;
-    bool res;
-    WiFiClientSecure Notificationclient;
     (void)title;
-    if (!Notificationclient.connect(_serveraddress.c_str(), _port)) {
-        log_d("Error connecting  server %s:%d", _serveraddress.c_str(), _port);
+    if (!connectClient())
         return false;
-    }
+    WiFiClientSecure& Notificationclient = *_client;
     //build data for post
     data = "message=";
     data += message;
     //build post query
-    postcmd  = "POST /api/notify HTTP/1.1\r\nHost: notify-api.line.me\r\nConnection: close\r\nCache-Control: no-cache\r\nUser-Agent: ESP3D\r\nAccept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\nContent-Type: application/x-www-form-urlencoded\r\n";
+    postcmd  = "POST /api/notify HTTP/1.1\r\nHost: notify-api.line.me\r\nConnection: keep-alive\r\nCache-Control: no-cache\r\nUser-Agent: ESP3D\r\nAccept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\nContent-Type: application/x-www-form-urlencoded\r\n";
     postcmd  += "Authorization: Bearer ";
     postcmd  += _token1 + "\r\n";
     postcmd  += "Content-Length: ";
@@ -263,9 +350,7 @@ bool NotificationsService::sendLineMSG(const char* title, const char* message) {
     log_d("Query: %s", postcmd.c_str());
     //send query
     Notificationclient.print(postcmd);
-    res = Wait4Answer(Notificationclient, "{", "\"status\":200",  LINETIMEOUT);
-    Notificationclient.stop();
-    return res;
+    return Wait4Answer(Notificationclient, "{", "\"status\":200",  LINETIMEOUT);
 }
 //Email#serveraddress:port
 bool NotificationsService::getPortFromSettings() {
@@ -303,6 +388,7 @@ bool NotificationsService::getEmailFromSettings() {
 
 
 bool NotificationsService::begin() {
+    HEAP_TAG_SCOPE(HEAP_TAG_NOTIFICATIONS);
     end();
     _notificationType = notification_type->get();
     switch (_notificationType) {
@@ -333,6 +419,21 @@ bool NotificationsService::begin() {
     bool res = true;
     if (WiFi.getMode() != WIFI_STA)
         res = false;
+#ifdef ENABLE_ETHERNET
+    if (eth_config.connected())
+        res = true;
+#endif
+    if (res && _task == NULL) {
+        // The queue and the task are made once and kept, as begin() and end() follow the WiFi mode
+        _queue = xQueueCreate(NOTIFICATIONS_QUEUE, sizeof(notification_t));
+        _mutex = xSemaphoreCreateMutex();
+        if (_queue == NULL || _mutex == NULL)
+            res = false;
+        else
+            task_create(TASK_NOTIFICATIONS, notificationsTask, NOTIFICATIONS_TASK_STACK, this, &_task);
+        if (_task == NULL)
+            res = false;
+    }
     if (!res)
         end();
     _started = res;
@@ -342,12 +443,17 @@ void NotificationsService::end() {
     if (!_started)
         return;
     _started = false;
+    // Drops what is queued, and waits for a message being sent to finish with the settings
+    xQueueReset(_queue);
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    closeClient();
     _notificationType = 0;
     _token1 = "";
     _token1 = "";
     _settings = "";
     _serveraddress = "";
     _port = 0;
+    xSemaphoreGive(_mutex);
 }
 
 void NotificationsService::handle() {
@@ -23,6 +23,35 @@
 #ifndef _NOTIFICATIONS_SERVICE_H
 #define _NOTIFICATIONS_SERVICE_H
 
+// Messages waiting for the notifications task. Each takes the title and the message sizes.
+#ifndef NOTIFICATIONS_QUEUE
+    #define NOTIFICATIONS_QUEUE 4
+#endif
+#ifndef NOTIFICATIONS_TITLE_MAX
+    #define NOTIFICATIONS_TITLE_MAX 64
+#endif
+#ifndef NOTIFICATIONS_MESSAGE_MAX
+    #define NOTIFICATIONS_MESSAGE_MAX 256
+#endif
+// Messages that come within this time of each other are sent as one
+#ifndef NOTIFICATIONS_BATCH_MS
+    #define NOTIFICATIONS_BATCH_MS 2000
+#endif
+// The connection to the provider is kept open this long after the last message
+#ifndef NOTIFICATIONS_IDLE_MS
+    #define NOTIFICATIONS_IDLE_MS 60000
+#endif
+// The TLS handshake of mbedTLS needs a large stack
+#ifndef NOTIFICATIONS_TASK_STACK
+    #define NOTIFICATIONS_TASK_STACK 8192
+#endif
+
+class WiFiClientSecure;
+
+typedef struct {
+    char title[NOTIFICATIONS_TITLE_MAX];
+    char message[NOTIFICATIONS_MESSAGE_MAX];
+} notification_t;
 
 class NotificationsService {
   public:
@@ -31,6 +60,8 @@ class NotificationsService {
     bool begin();
     void end();
     void handle();
+    // Queues the message for the notifications task and returns at once. False when the
+    // service is not started or the queue is full, in which case the message is dropped.
     bool sendMSG(const char* title, const char* message);
     const char* getTypeString();
     bool started();
@@ -42,6 +73,17 @@ class NotificationsService {
     String _settings;
     String _serveraddress;
     uint16_t _port;
+    QueueHandle_t _queue;
+    TaskHandle_t _task;
+    SemaphoreHandle_t _mutex; // Held while a message is sent, so end() waits for it
+    WiFiClientSecure* _client; // Kept connected between messages, see connectClient()
+    bool _logged_in;           // The SMTP session on _client is past AUTH
+    static void notificationsTask(void* pvParameters);
+    static bool batch(notification_t* notification, const notification_t* next);
+    bool deliver(const notification_t* notification);
+    bool send(const notification_t* notification);
+    bool connectClient();
+    void closeClient();
     bool sendPushoverMSG(const char* title, const char* message);
     bool sendEmailMSG(const char* title, const char* message);
     bool sendLineMSG(const char* title, const char* message);
@@ -27,7 +27,6 @@
 
 
 
-#define MAX_INT_DIGITS 8 // Maximum number of digits in int32 (and float)
 
 // Extracts a floating point value from a string. The following code is based loosely on
 // the avr-libc strtod() function by Michael Stumpf and Dmitry Xmelkov and many freely
@@ -71,24 +70,7 @@ uint8_t read_float(const char* line, uint8_t* char_counter, float* float_ptr) {
     }
     // Return if no digits have been read.
     if (!ndigit)  return (false);  ;
-    // Convert integer into floating point.
-    float fval;
-    fval = (float)intval;
-    // Apply decimal. Should perform no more than two floating point multiplications for the
-    // expected range of E0 to E-4.
-    if (fval != 0) {
-        while (exp <= -2) {
-            fval *= 0.01;
-            exp += 2;
-        }
-        if (exp < 0)
-            fval *= 0.1;
-        else if (exp > 0) {
-            do {
-                fval *= 10.0;
-            } while (--exp > 0);
-        }
-    }
+    float fval = decimal_to_float(intval, exp);
     // Assign floating point value with correct sign.
     if (isnegative)
         *float_ptr = -fval;
@@ -98,6 +80,97 @@ uint8_t read_float(const char* line, uint8_t* char_counter, float* float_ptr) {
     return (true);
 }
 
+// Powers of ten up to the float range. Up to 1e10 they are exact in a float.
+static const float pow10_table[] = {
+    1e0f,  1e1f,  1e2f,  1e3f,  1e4f,  1e5f,  1e6f,  1e7f,  1e8f,  1e9f,
+    1e10f, 1e11f, 1e12f, 1e13f, 1e14f, 1e15f, 1e16f, 1e17f, 1e18f, 1e19f,
+    1e20f, 1e21f, 1e22f, 1e23f, 1e24f, 1e25f, 1e26f, 1e27f, 1e28f, 1e29f,
+    1e30f, 1e31f, 1e32f, 1e33f, 1e34f, 1e35f, 1e36f, 1e37f, 1e38f
+};
+#define POW10_TABLE_MAX ((int8_t)(sizeof(pow10_table) / sizeof(pow10_table[0]) - 1))
+
+// Converts the digits read by read_float() to floating point, correctly rounded for the
+// fractional values of g-code.
+// NOTE: The former repeated multiplications by 0.1 and 0.01 were done in double precision, which
+// is software emulated on the ESP32, and rounded at each step.
+float decimal_to_float(uint32_t intval, int8_t exp) {
+    float fval = (float)intval;
+    if (fval == 0 || exp == 0)
+        return fval;
+    if (exp < 0) {
+        // read_float() keeps exp >= -MAX_INT_DIGITS, so the power of ten is exact
+        if (intval <= (1UL << 24))
+            return fval / pow10_table[-exp]; // intval is exact too, so this rounds once
+        // Longer digit strings are divided in integers, with a sticky bit for the remainder,
+        // so the conversion to float is the only rounding.
+        uint32_t den = (uint32_t)pow10_table[-exp];
+        uint64_t num = (uint64_t)intval << 33; // intval < 2^30
+        uint64_t q = num / den;
+        if (q * den != num)
+            q |= 1;
+        return (float)q * (1.0f / 8589934592.0f); // 2^-33
+    }
+    // Digits past MAX_INT_DIGITS before the point. Up to 1e10 the product is exact in 64 bits.
+    if (exp <= 10)
+        return (float)((uint64_t)intval * (uint64_t)pow10_table[exp]);
+    if (exp > POW10_TABLE_MAX)
+        return __builtin_inff();
+    return fval * pow10_table[exp]; // Past 1e19, where both factors may be rounded
+}
+
+uint16_t crc16_ccitt(const uint8_t* data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    while (len--) {
+        crc ^= (uint16_t)(*data++) << 8;
+        for (uint8_t bit_index = 0; bit_index < 8; bit_index++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+    return crc;
+}
+
+// CRC-16/MODBUS of each byte value, so a frame costs one lookup per byte
+static const uint16_t crc16_modbus_table[256] = {
+    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
+    0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
+    0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
+    0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
+    0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
+    0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
+    0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
+    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
+    0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
+    0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
+    0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
+    0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
+    0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
+    0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
+    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
+    0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
+    0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
+    0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
+    0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
+    0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
+    0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
+    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
+    0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
+    0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
+    0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
+    0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
+    0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
+    0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
+    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
+    0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
+    0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
+    0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040,
+};
+
+uint16_t crc16_modbus(const uint8_t* data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    while (len--)
+        crc = (crc >> 8) ^ crc16_modbus_table[(crc ^ *data++) & 0xFF];
+    return crc;
+}
+
 void delay_ms(uint16_t ms) {
     delay(ms);
 }
@@ -135,35 +208,53 @@ float convert_delta_vector_to_unit_vector(float* vector) {
     return (magnitude);
 }
 
+// Reciprocals of the per-axis acceleration (min^2/mm) and max rate (min/mm) settings, so the limit
+// functions below multiply instead of dividing and reading the settings for every block.
+static float inv_axis_acceleration[N_AXIS];
+static float inv_axis_max_rate[N_AXIS];
+
+// Rebuilds the reciprocal axis limits. Must be called whenever the axis settings change.
+// NOTE: The acceleration setting is stored and displayed in units of mm/sec^2, but used in units of
+// mm/min^2, so the conversion is folded in here. A zero setting gives an infinite reciprocal, which
+// limits any motion along that axis to zero, as before.
+void update_axis_limits() {
+    uint8_t idx;
+    for (idx = 0; idx < N_AXIS; idx++) {
+        inv_axis_acceleration[idx] = 1.0 / (axis_settings[idx]->acceleration->get() * SEC_PER_MIN_SQ);
+        inv_axis_max_rate[idx] = 1.0 / axis_settings[idx]->max_rate->get();
+    }
+}
+
+// The smallest of limit/|unit_vec| over the axes is 1 over the largest of |unit_vec|/limit.
 float limit_acceleration_by_axis_maximum(float* unit_vec) {
     uint8_t idx;
-    float limit_value = SOME_LARGE_VALUE;
+    float max_ratio = 0.0;
     for (idx = 0; idx < N_AXIS; idx++) {
-        if (unit_vec[idx] != 0)    // Avoid divide by zero.
-            limit_value = MIN(limit_value, fabs(axis_settings[idx]->acceleration->get() / unit_vec[idx]));
+        if (unit_vec[idx] != 0)    // Skip axes that do not move.
+            max_ratio = MAX(max_ratio, fabs(unit_vec[idx]) * inv_axis_acceleration[idx]);
     }
-    // The acceleration setting is stored and displayed in units of mm/sec^2,
-    // but used in units of mm/min^2.  It suffices to perform the conversion once on
-    // exit, since the limit computation above is independent of units - it simply
-    // finds the smallest value.
-    return (limit_value * SEC_PER_MIN_SQ);
+    if (max_ratio == 0.0)
+        return (SOME_LARGE_VALUE * SEC_PER_MIN_SQ);
+    return (1.0 / max_ratio);
 }
 
 float limit_rate_by_axis_maximum(float* unit_vec) {
     uint8_t idx;
-    float limit_value = SOME_LARGE_VALUE;
+    float max_ratio = 0.0;
     for (idx = 0; idx < N_AXIS; idx++) {
-        if (unit_vec[idx] != 0)    // Avoid divide by zero.
-            limit_value = MIN(limit_value, fabs(axis_settings[idx]->max_rate->get() / unit_vec[idx]));
+        if (unit_vec[idx] != 0)    // Skip axes that do not move.
+            max_ratio = MAX(max_ratio, fabs(unit_vec[idx]) * inv_axis_max_rate[idx]);
     }
-    return (limit_value);
+    if (max_ratio == 0.0)
+        return (SOME_LARGE_VALUE);
+    return (1.0 / max_ratio);
 }
 
 float map_float(float x, float in_min, float in_max, float out_min, float out_max) { // DrawBot_Badge
     return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
 }
 
-uint32_t map_uint32_t(uint32_t x, uint32_t in_min, uint32_t in_max, uint32_t out_min, uint32_t out_max) {
+uint32_t IRAM_ATTR map_uint32_t(uint32_t x, uint32_t in_min, uint32_t in_max, uint32_t out_min, uint32_t out_max) {
     return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
 }
 
@@ -184,4 +275,22 @@ bool char_is_numeric(char value) {
     return (value >= '0' && value <='9');
 }
 
-
+char *trim(char *str)
+{
+    char *end;
+    // Trim leading space
+    while(isspace((unsigned char)*str)) {
+        str++;
+    }
+    if(*str == 0)  {  // All spaces?
+        return str;
+    }
+    // Trim trailing space
+    end = str + strlen(str) - 1;
+    while(end > str && isspace((unsigned char)*end)) {
+        end--;
+    }
+    // Write new null terminator character
+    end[1] = '\0';
+    return str;
+}
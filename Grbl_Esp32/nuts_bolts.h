@@ -113,6 +113,18 @@
 // a pointer to the result variable. Returns true when it succeeds
 uint8_t read_float(const char* line, uint8_t* char_counter, float* float_ptr);
 
+// Converts an integer of decimal digits and a power of ten exponent to floating point. The
+// digits past MAX_INT_DIGITS are dropped by read_float() and counted in the exponent instead.
+#define MAX_INT_DIGITS 9 // Maximum number of digits in uint32
+float decimal_to_float(uint32_t intval, int8_t exp);
+
+// CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF) of a block of bytes.
+uint16_t crc16_ccitt(const uint8_t* data, size_t len);
+
+// CRC-16/MODBUS (reflected polynomial 0xA001, initial value 0xFFFF), as sent low byte first
+// at the end of a Modbus RTU frame.
+uint16_t crc16_modbus(const uint8_t* data, size_t len);
+
 // Non-blocking delay function used for general operation and suspend features.
 void delay_sec(float seconds, uint8_t mode);
 
@@ -123,6 +135,7 @@ void delay_ms(uint16_t ms);
 float hypot_f(float x, float y);
 
 float convert_delta_vector_to_unit_vector(float* vector);
+void update_axis_limits();
 float limit_acceleration_by_axis_maximum(float* unit_vec);
 float limit_rate_by_axis_maximum(float* unit_vec);
 
@@ -0,0 +1,287 @@
+/*
+  ota_writer.cpp - writes firmware updates to flash from a background task, while the machine is idle
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef OTA_WRITER
+
+#include <Update.h>
+#ifdef OTA_GZIP
+    #include "rom/miniz.h"
+#endif
+
+// The upload fills the chunks in the context of the web server and queues the full ones. The
+// writer task writes them to flash and gives them back. Erasing a sector takes tens of
+// milliseconds, which the upload no longer waits for at every HTTP chunk. If the machine leaves
+// idle while the update runs, the writer stops writing and the update fails, so a job started
+// from another client never runs beside the flash writes.
+
+#define OTA_WRITER_STOP 0xff // Queued after the last chunk
+
+static uint8_t* ota_chunks[OTA_WRITER_CHUNKS];
+static size_t ota_chunk_len[OTA_WRITER_CHUNKS];
+static QueueHandle_t ota_full = NULL;
+static QueueHandle_t ota_free = NULL;
+static TaskHandle_t otaWriterTaskHandle = NULL;
+static int16_t ota_current; // The chunk being filled, -1 when none
+static size_t ota_size;
+static volatile uint32_t ota_written;
+static volatile bool ota_failed;
+
+#ifdef OTA_GZIP
+// An image that starts with the gzip magic is inflated by the writer task, with the inflater in
+// the ESP32 ROM like SD_GZIP jobs, into a ring of TINFL_LZ_DICT_SIZE bytes that the deflate data
+// refers back into. Each piece it inflates goes to Update.write(), which gathers whole sectors.
+// The buffers are only taken for a compressed update. The progress is that of the upload.
+static tinfl_decompressor* ota_gz_inflater = NULL;
+static uint8_t* ota_gz_ring = NULL;
+static size_t ota_gz_ring_pos;
+static int8_t ota_gz;     // -1 until the first chunk is seen, then 1 when compressed
+static bool ota_gz_done;  // The end of the deflate data was reached
+
+// The length of the gzip header at the start of data, 0 when it is not one. See RFC 1952. The
+// header must be within the first chunk, which it always is but for a FEXTRA of kilobytes.
+static size_t ota_gz_header(const uint8_t* data, size_t len) {
+    if (len < 10 || data[0] != 0x1f || data[1] != 0x8b || data[2] != 8) // 8 is deflate
+        return 0;
+    uint8_t flags = data[3];
+    size_t pos = 10;
+    if (flags & bit(2)) { // FEXTRA
+        if (pos + 2 > len)
+            return 0;
+        pos += 2 + (data[pos] | (data[pos + 1] << 8));
+    }
+    for (uint8_t name_bit = 3; name_bit <= 4; name_bit++) { // FNAME and FCOMMENT
+        if (!(flags & bit(name_bit)))
+            continue;
+        while (pos < len && data[pos] != 0)
+            pos++;
+        pos++;
+    }
+    if (flags & bit(1)) // FHCRC
+        pos += 2;
+    return pos < len ? pos : 0;
+}
+
+static bool ota_gz_begin() {
+    ota_gz_inflater = (tinfl_decompressor*)malloc(sizeof(tinfl_decompressor));
+    ota_gz_ring = (uint8_t*)malloc(TINFL_LZ_DICT_SIZE);
+    if (ota_gz_inflater == NULL || ota_gz_ring == NULL)
+        return false;
+    tinfl_init(ota_gz_inflater);
+    ota_gz_ring_pos = 0;
+    ota_gz_done = false;
+    return true;
+}
+
+static void ota_gz_free() {
+    free(ota_gz_inflater);
+    free(ota_gz_ring);
+    ota_gz_inflater = NULL;
+    ota_gz_ring = NULL;
+}
+
+static bool ota_gz_write(const uint8_t* data, size_t len) {
+    while (!ota_gz_done) {
+        size_t in_bytes = len;
+        size_t out_bytes = TINFL_LZ_DICT_SIZE - ota_gz_ring_pos;
+        tinfl_status status = tinfl_decompress(ota_gz_inflater, data, &in_bytes, ota_gz_ring,
+                                               ota_gz_ring + ota_gz_ring_pos, &out_bytes, TINFL_FLAG_HAS_MORE_INPUT);
+        data += in_bytes;
+        len -= in_bytes;
+        if (out_bytes && Update.write(ota_gz_ring + ota_gz_ring_pos, out_bytes) != out_bytes)
+            return false;
+        ota_gz_ring_pos = (ota_gz_ring_pos + out_bytes) & (TINFL_LZ_DICT_SIZE - 1);
+        if (status == TINFL_STATUS_DONE)
+            ota_gz_done = true; // What follows is the gzip trailer
+        else if (status < TINFL_STATUS_DONE)
+            return false; // Bad data
+        else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && len == 0)
+            break;
+    }
+    return true;
+}
+#endif
+
+// Writes one chunk of the upload to the update
+static bool ota_write(uint8_t* data, size_t len) {
+#ifdef OTA_GZIP
+    if (ota_gz < 0) {
+        size_t header = ota_gz_header(data, len);
+        ota_gz = header != 0;
+        if (ota_gz) {
+            if (!ota_gz_begin())
+                return false;
+            grbl_send(CLIENT_ALL, "[MSG:Update image is compressed]\r\n");
+            data += header;
+            len -= header;
+        }
+    }
+    if (ota_gz)
+        return ota_gz_write(data, len);
+#endif
+    return Update.write(data, len) == len;
+}
+
+bool ota_writer_allowed() {
+    if (sys.state != STATE_IDLE && sys.state != STATE_ALARM)
+        return false;
+#ifdef ENABLE_SD_CARD
+    if (get_sd_state(false) == SDCARD_BUSY_PRINTING)
+        return false;
+#endif
+    return true;
+}
+
+static void otaWriterTask(void* pvParameters) {
+    uint32_t reported = 0;
+    uint8_t chunk;
+    while (xQueueReceive(ota_full, &chunk, portMAX_DELAY) == pdTRUE && chunk != OTA_WRITER_STOP) {
+        if (!ota_failed) {
+            size_t len = ota_chunk_len[chunk];
+            if (!ota_writer_allowed()) {
+                grbl_send(CLIENT_ALL, "[MSG:Update stopped, the machine is not idle]\r\n");
+                ota_failed = true;
+            } else if (!ota_write(ota_chunks[chunk], len)) {
+                grbl_send(CLIENT_ALL, "[MSG:Update write failed]\r\n");
+                ota_failed = true;
+            } else {
+                ota_written += len;
+                if (ota_size > 0) {
+                    uint32_t percent = (100ULL * ota_written / ota_size) / OTA_WRITER_PROGRESS_PERCENT * OTA_WRITER_PROGRESS_PERCENT;
+                    if (percent > reported && percent < 100) {
+                        reported = percent;
+                        grbl_sendf(CLIENT_ALL, "[MSG:Update %d%%]\r\n", percent);
+                    }
+                }
+            }
+        }
+        xQueueSend(ota_free, &chunk, portMAX_DELAY);
+    }
+    otaWriterTaskHandle = NULL;
+    vTaskDelete(NULL);
+}
+
+static void ota_writer_free() {
+    for (uint8_t i = 0; i < OTA_WRITER_CHUNKS; i++) {
+        free(ota_chunks[i]);
+        ota_chunks[i] = NULL;
+    }
+    if (ota_full != NULL)
+        vQueueDelete(ota_full);
+    if (ota_free != NULL)
+        vQueueDelete(ota_free);
+    ota_full = ota_free = NULL;
+#ifdef OTA_GZIP
+    ota_gz_free();
+#endif
+}
+
+// Queues the stop marker and waits for the writer task to leave
+static void ota_writer_stop() {
+    if (otaWriterTaskHandle == NULL)
+        return;
+    uint8_t stop = OTA_WRITER_STOP;
+    xQueueSend(ota_full, &stop, portMAX_DELAY);
+    while (otaWriterTaskHandle != NULL)
+        vTaskDelay(1);
+}
+
+bool ota_writer_begin(size_t size) {
+    ota_writer_abort();
+    ota_size = size;
+    ota_written = 0;
+    ota_failed = false;
+    ota_current = -1;
+#ifdef OTA_GZIP
+    ota_gz = -1;
+#endif
+    ota_full = xQueueCreate(OTA_WRITER_CHUNKS + 1, sizeof(uint8_t));
+    ota_free = xQueueCreate(OTA_WRITER_CHUNKS, sizeof(uint8_t));
+    bool ok = ota_full != NULL && ota_free != NULL;
+    for (uint8_t i = 0; ok && i < OTA_WRITER_CHUNKS; i++) {
+        ota_chunks[i] = (uint8_t*)malloc(OTA_WRITER_CHUNK);
+        ok = ota_chunks[i] != NULL;
+        if (ok)
+            xQueueSend(ota_free, &i, 0);
+    }
+    if (ok)
+        task_create(TASK_OTA_WRITER, otaWriterTask, 4096, NULL, &otaWriterTaskHandle);
+    if (!ok || otaWriterTaskHandle == NULL) {
+        ota_writer_free();
+        return false;
+    }
+    return true;
+}
+
+bool ota_writer_write(const uint8_t* data, size_t len) {
+    while (len) {
+        if (ota_failed)
+            return false;
+        if (ota_current < 0) {
+            uint8_t chunk;
+            if (xQueueReceive(ota_free, &chunk, pdMS_TO_TICKS(OTA_WRITER_TIMEOUT_MS)) != pdTRUE) {
+                ota_failed = true;
+                return false;
+            }
+            ota_current = chunk;
+            ota_chunk_len[chunk] = 0;
+        }
+        size_t* used = &ota_chunk_len[ota_current];
+        size_t count = MIN(len, OTA_WRITER_CHUNK - *used);
+        memcpy(ota_chunks[ota_current] + *used, data, count);
+        *used += count;
+        data += count;
+        len -= count;
+        if (*used == OTA_WRITER_CHUNK) {
+            uint8_t chunk = ota_current;
+            xQueueSend(ota_full, &chunk, portMAX_DELAY); // Never full: it has room for all chunks
+            ota_current = -1;
+        }
+    }
+    return true;
+}
+
+bool ota_writer_end() {
+    if (otaWriterTaskHandle == NULL)
+        return false;
+    if (ota_current >= 0) {
+        uint8_t chunk = ota_current;
+        xQueueSend(ota_full, &chunk, portMAX_DELAY);
+        ota_current = -1;
+    }
+    ota_writer_stop();
+#ifdef OTA_GZIP
+    if (ota_gz > 0 && !ota_gz_done && !ota_failed) {
+        grbl_send(CLIENT_ALL, "[MSG:Update image is cut short]\r\n");
+        ota_failed = true;
+    }
+#endif
+    bool ok = !ota_failed && Update.end(true);
+    ota_writer_free();
+    return ok;
+}
+
+void ota_writer_abort() {
+    ota_failed = true;
+    ota_writer_stop();
+    ota_current = -1;
+    ota_writer_free();
+}
+
+#endif
@@ -0,0 +1,62 @@
+/*
+  ota_writer.h - writes firmware updates to flash from a background task, while the machine is idle
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ota_writer_h
+#define ota_writer_h
+
+#if defined(OTA_GZIP) && !defined(OTA_WRITER)
+    #error "OTA_GZIP needs OTA_WRITER"
+#endif
+
+#ifdef OTA_WRITER
+
+// The size of the chunks handed to Update.write(). A multiple of the 4KB flash sector, so each
+// write erases and programs whole sectors.
+#ifndef OTA_WRITER_CHUNK
+    #define OTA_WRITER_CHUNK 4096
+#endif
+// Chunks the upload can fill while the writer task is still writing earlier ones
+#ifndef OTA_WRITER_CHUNKS
+    #define OTA_WRITER_CHUNKS 4
+#endif
+// How long the upload waits for a free chunk before the update fails
+#ifndef OTA_WRITER_TIMEOUT_MS
+    #define OTA_WRITER_TIMEOUT_MS 5000
+#endif
+// A [MSG:Update n%] line is sent each time this much more is written
+#ifndef OTA_WRITER_PROGRESS_PERCENT
+    #define OTA_WRITER_PROGRESS_PERCENT 10
+#endif
+
+// True when an update may start: the machine is idle or in alarm and no SD job is running
+bool ota_writer_allowed();
+
+// Starts the writer task for an update of size bytes, 0 when not known. Update.begin() must
+// have been called.
+bool ota_writer_begin(size_t size);
+// Queues the data to be written. False when the update failed, also when the machine was
+// started while it ran.
+bool ota_writer_write(const uint8_t* data, size_t len);
+// Writes what is left, waits for the writer task and ends the update with Update.end(true)
+bool ota_writer_end();
+// Stops the writer task and drops what is queued. The caller ends or aborts the update.
+void ota_writer_abort();
+
+#endif
+
+#endif
@@ -0,0 +1,484 @@
+/*
+  oword.cpp - O-word subroutines and loops, run from lines kept in RAM
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef OWORD_SUBROUTINES
+
+#include <SPIFFS.h>
+
+// The O-word lines of LinuxCNC, with N a number or <name> a name:
+//   oN sub ... oN endsub       defines the sub oN, oN return leaves it early
+//   oN call                    runs the sub oN
+//   oN repeat [n] ... oN endrepeat
+//   oN while [n] ... oN endwhile
+//   oN break, oN continue      leave or restart the innermost loop
+// A while loop runs while its [expr] is not 0. With GCODE_EXPRESSIONS, the [expr] arguments of
+// a call are #1, #2, ... within the sub, and #1-#30 are restored after it. Without, repeat and
+// while take a number in brackets, and a while loop with one other than 0 runs until a break.
+//   The lines from a sub or loop to its end are kept as records in one store, g-code lines as
+// the words of the tokenizer or as their compiled expressions, and O-word lines as their keyword,
+// number, name and arguments. They run from there through gc_execute_words(), without being
+// parsed again. A loop is run once its end has come, and dropped after. A sub is only defined
+// at its end. The subs and the files loaded for a call stay at the bottom of the store until
+// the program ends.
+//   A run goes through a range of records once. A sub record defines the sub up to its end
+// record and skips over it. Loops and calls run the records of their body, found by the end
+// record with the same number, as a nested run.
+
+#define OWORD_GCODE 0 // A g-code line, or no sub or loop being kept
+#define OWORD_SUB 1
+#define OWORD_ENDSUB 2
+#define OWORD_CALL 3
+#define OWORD_RETURN 4
+#define OWORD_REPEAT 5
+#define OWORD_ENDREPEAT 6
+#define OWORD_WHILE 7
+#define OWORD_ENDWHILE 8
+#define OWORD_BREAK 9
+#define OWORD_CONTINUE 10
+#define OWORD_EXPRESSION 11 // A g-code line with parameters or expressions, compiled
+
+// The end of a sub or loop is the keyword after its start
+static const char* const oword_keywords[] = {
+    "", "SUB", "ENDSUB", "CALL", "RETURN", "REPEAT", "ENDREPEAT", "WHILE", "ENDWHILE", "BREAK", "CONTINUE",
+};
+#define OWORD_KEYWORDS (sizeof(oword_keywords) / sizeof(oword_keywords[0]))
+
+// The number of o<name> is the FNV-1a hash of the name with this bit set, so it differs from any oN
+#define OWORD_NAMED 0x80000000
+
+typedef struct {
+    uint16_t size;   // Of the record with what follows it, a multiple of 4
+    uint8_t kind;    // OWORD_GCODE, or the keyword of an O-word line
+    uint8_t count;   // Words that follow a g-code line, or arguments of an O-word line
+    uint32_t number; // Of an O-word line, or the length of the code of a compiled line
+} oword_record_t;
+// An O-word record is followed by the name of o<name>, empty for oN, and the arguments after
+// the keyword. With GCODE_EXPRESSIONS the arguments are the codes of their expressions, one
+// after the other, and otherwise the text after the keyword. The name and text end with a NUL.
+
+typedef struct {
+    uint32_t number;
+    uint32_t start; // First record of the body
+    uint32_t end;   // The endsub record
+} oword_sub_t;
+
+static uint8_t store[OWORD_STORE_SIZE] __attribute__((aligned(4)));
+static uint32_t store_used;
+static oword_sub_t subs[OWORD_MAX_SUBS];
+static uint8_t sub_count;
+static uint8_t keeping = OWORD_GCODE; // Keyword of the sub or loop whose lines are being kept
+static uint32_t keeping_number;
+static uint32_t keeping_start;
+static uint8_t running;               // Depth of nested runs
+static uint8_t unwinding;             // OWORD_RETURN, OWORD_BREAK or OWORD_CONTINUE, leaving the runs it ends
+
+static inline oword_record_t* oword_at(uint32_t pos) {
+    return (oword_record_t*)(store + pos);
+}
+
+static inline const char* oword_name(const oword_record_t* record) {
+    return (const char*)(record + 1);
+}
+
+static inline const uint8_t* oword_args(const oword_record_t* record) {
+    const char* name = oword_name(record);
+    return (const uint8_t*)(name + strlen(name) + 1);
+}
+
+// Adds a record with room for size bytes after it at the top of the store
+static oword_record_t* oword_append(uint8_t kind, uint32_t number, uint32_t size) {
+    size = (sizeof(oword_record_t) + size + 3) & ~3;
+    if (store_used + size > OWORD_STORE_SIZE)
+        return NULL;
+    oword_record_t* record = oword_at(store_used);
+    record->size = size;
+    record->kind = kind;
+    record->count = 0;
+    record->number = number;
+    store_used += size;
+    return record;
+}
+
+// Drops the records from pos up, and the subs among them
+static void oword_drop(uint32_t pos) {
+    store_used = pos;
+    uint8_t kept = 0;
+    for (uint8_t i = 0; i < sub_count; i++) {
+        if (subs[i].start < pos)
+            subs[kept++] = subs[i];
+    }
+    sub_count = kept;
+}
+
+static oword_sub_t* oword_find(uint32_t number) {
+    for (uint8_t i = 0; i < sub_count; i++) {
+        if (subs[i].number == number)
+            return &subs[i];
+    }
+    return NULL;
+}
+
+// Keeps an O-word line, collapsed, as a record
+static uint8_t oword_keep_oword(char* line) {
+    collapseGCode(line);
+    char* c = line + 1; // After the O
+    const char* name = "";
+    uint32_t number = 0;
+    if (*c == '<') {
+        name = ++c;
+        while (*c != '\0' && *c != '>')
+            c++;
+        if (*c != '>' || c == name)
+            return STATUS_OWORD_SYNTAX;
+        *c++ = '\0';
+        number = 2166136261u;
+        for (const char* n = name; *n != '\0'; n++)
+            number = (number ^ (uint8_t)*n) * 16777619u;
+        number |= OWORD_NAMED;
+    } else {
+        if (*c < '0' || *c > '9')
+            return STATUS_OWORD_SYNTAX;
+        for (; *c >= '0' && *c <= '9'; c++) {
+            number = number * 10 + (*c - '0');
+            if (number >= OWORD_NAMED)
+                return STATUS_OWORD_SYNTAX;
+        }
+    }
+    uint8_t kind = OWORD_KEYWORDS;
+    size_t length = 0;
+    for (uint8_t k = OWORD_SUB; k < OWORD_KEYWORDS; k++) {
+        length = strlen(oword_keywords[k]);
+        if (strncmp(c, oword_keywords[k], length) == 0 && (c[length] == '\0' || c[length] == '[')) {
+            kind = k;
+            break;
+        }
+    }
+    if (kind == OWORD_KEYWORDS)
+        return STATUS_OWORD_SYNTAX;
+    c += length;
+    uint8_t arg_count = 0;
+#ifdef GCODE_EXPRESSIONS
+    uint8_t args[EXPR_LINE_CODE_SIZE];
+    uint16_t args_size = 0;
+    uint8_t char_counter = c - line;
+    for (; line[char_counter] != '\0'; arg_count++) {
+        uint8_t status = expr_compile(line, &char_counter, args, &args_size, sizeof(args));
+        if (status != STATUS_OK)
+            return status;
+    }
+#else
+    const char* args = c;
+    size_t args_size = strlen(args) + 1;
+#endif
+    size_t name_size = strlen(name) + 1;
+    oword_record_t* record = oword_append(kind, number, name_size + args_size);
+    if (!record)
+        return STATUS_OWORD_OVERFLOW;
+    record->count = arg_count;
+    char* text = (char*)(record + 1);
+    memcpy(text, name, name_size);
+    memcpy(text + name_size, args, args_size);
+    return STATUS_OK;
+}
+
+// Keeps a line as a record at the top of the store. Lines without words are not kept.
+static uint8_t oword_keep(char* line) {
+    char* c = line;
+    while (*c == ' ' || *c == '\t')
+        c++;
+    if (*c == 'O' || *c == 'o')
+        return oword_keep_oword(c);
+    if (*c == '%')
+        return STATUS_OK; // The program start and end marks of a file
+#ifdef GCODE_EXPRESSIONS
+    if (expr_line_has_expressions(line)) {
+        uint8_t code[EXPR_LINE_CODE_SIZE];
+        uint16_t length;
+        uint8_t status = expr_compile_line(line, code, sizeof(code), &length);
+        if (status != STATUS_OK || length == 0)
+            return status;
+        oword_record_t* record = oword_append(OWORD_EXPRESSION, length, length);
+        if (!record)
+            return STATUS_OWORD_OVERFLOW;
+        memcpy(record + 1, code, length);
+        return STATUS_OK;
+    }
+#endif
+    gc_word_t words[GC_MAX_WORDS];
+    uint8_t word_count;
+    uint8_t status = gc_tokenize_line(line, words, &word_count);
+    if (status != STATUS_OK || word_count == 0)
+        return status;
+    oword_record_t* record = oword_append(OWORD_GCODE, 0, word_count * sizeof(gc_word_t));
+    if (!record)
+        return STATUS_OWORD_OVERFLOW;
+    record->count = word_count;
+    memcpy(record + 1, words, word_count * sizeof(gc_word_t));
+    return STATUS_OK;
+}
+
+// Finds the record of kind with the number of the O-word, from pos up to end
+static bool oword_match(uint32_t pos, uint32_t end, uint8_t kind, uint32_t number, uint32_t* found) {
+    for (; pos < end; pos += oword_at(pos)->size) {
+        const oword_record_t* record = oword_at(pos);
+        if (record->kind == kind && record->number == number) {
+            *found = pos;
+            return true;
+        }
+    }
+    return false;
+}
+
+// The value in brackets of a repeat or while line
+static uint8_t oword_value(const oword_record_t* record, float* value) {
+#ifdef GCODE_EXPRESSIONS
+    const uint8_t* code = oword_args(record);
+    if (record->count != 1)
+        return STATUS_OWORD_SYNTAX;
+    return expr_eval(&code, value);
+#else
+    const char* args = (const char*)oword_args(record);
+    uint8_t char_counter = 1;
+    if (args[0] != '[' || !read_float(args, &char_counter, value) || args[char_counter] != ']' ||
+        args[char_counter + 1] != '\0')
+        return STATUS_OWORD_SYNTAX;
+    return STATUS_OK;
+#endif
+}
+
+static uint8_t oword_run(uint32_t pos, uint32_t end, uint8_t client);
+
+static uint8_t oword_define(const oword_record_t* record, uint32_t body, uint32_t end, uint32_t* next) {
+    uint32_t finish;
+    if (!oword_match(body, end, OWORD_ENDSUB, record->number, &finish))
+        return STATUS_OWORD_SYNTAX;
+    *next = finish + oword_at(finish)->size;
+    oword_sub_t* sub = oword_find(record->number);
+    if (!sub) {
+        if (sub_count == OWORD_MAX_SUBS)
+            return STATUS_OWORD_OVERFLOW;
+        sub = &subs[sub_count++];
+    }
+    sub->number = record->number;
+    sub->start = body;
+    sub->end = finish;
+    return STATUS_OK;
+}
+
+static uint8_t oword_loop(const oword_record_t* record, uint32_t body, uint32_t end, uint32_t* next, uint8_t client) {
+    uint32_t finish;
+    if (!oword_match(body, end, record->kind + 1, record->number, &finish))
+        return STATUS_OWORD_SYNTAX;
+    *next = finish + oword_at(finish)->size;
+    float value;
+    uint8_t status = oword_value(record, &value);
+    for (uint32_t pass = 0; status == STATUS_OK; pass++) {
+        if (record->kind == OWORD_REPEAT ? pass >= value : value == 0.0f)
+            break;
+        // A loop of O-word lines alone never waits for the planner
+        protocol_execute_realtime();
+        if (sys.abort)
+            break;
+        status = oword_run(body, finish, client);
+        if (unwinding == OWORD_RETURN)
+            break;
+        bool leave = (unwinding == OWORD_BREAK);
+        unwinding = OWORD_GCODE;
+        if (leave)
+            break;
+        if (record->kind == OWORD_WHILE && status == STATUS_OK)
+            status = oword_value(record, &value);
+    }
+    return status;
+}
+
+// Keeps the lines of the file for o<name> and runs them, so that its subs get defined. The SD
+// card is tried first, then SPIFFS.
+static uint8_t oword_load(const char* name, uint8_t client) {
+    char path[sizeof(OWORD_FILE_PREFIX) + LINE_BUFFER_SIZE + sizeof(OWORD_FILE_SUFFIX)];
+    strcpy(path, OWORD_FILE_PREFIX);
+    char* c = path + strlen(path);
+    for (; *name != '\0'; name++)
+        *c++ = tolower(*name);
+    strcpy(c, OWORD_FILE_SUFFIX);
+    File file;
+#ifdef ENABLE_SD_CARD
+    uint8_t sd_state = get_sd_state(true);
+    if (sd_state == SDCARD_IDLE || sd_state == SDCARD_BUSY_PRINTING)
+        file = SD.open(path, FILE_READ);
+#endif
+    if (!file && SPIFFS.exists(path))
+        file = SPIFFS.open(path, FILE_READ);
+    if (!file)
+        return STATUS_OWORD_UNDEFINED;
+    uint32_t at = store_used;
+    char line[LINE_BUFFER_SIZE];
+    uint8_t length = 0;
+    uint8_t status = STATUS_OK;
+    while (status == STATUS_OK) {
+        int ch = file.read();
+        if (ch < 0 || ch == '\n' || ch == '\r') {
+            line[length] = '\0';
+            if (length)
+                status = oword_keep(line);
+            length = 0;
+            if (ch < 0)
+                break;
+        } else if (length < LINE_BUFFER_SIZE - 1)
+            line[length++] = ch;
+        else
+            status = STATUS_LINE_LENGTH_EXCEEDED;
+    }
+    file.close();
+    if (status == STATUS_OK)
+        status = oword_run(at, store_used, client);
+    if (status != STATUS_OK)
+        oword_drop(at);
+    return status;
+}
+
+static uint8_t oword_call(const oword_record_t* record, uint8_t client) {
+    oword_sub_t* sub = oword_find(record->number);
+    if (!sub && (record->number & OWORD_NAMED)) {
+        uint8_t status = oword_load(oword_name(record), client);
+        if (status != STATUS_OK)
+            return status;
+        sub = oword_find(record->number);
+    }
+    if (!sub)
+        return STATUS_OWORD_UNDEFINED;
+#ifdef GCODE_EXPRESSIONS
+    // The arguments are all evaluated before #1-#30 take them
+    float args[EXPR_LOCALS] = { 0.0f };
+    if (record->count > EXPR_LOCALS)
+        return STATUS_OWORD_SYNTAX;
+    const uint8_t* code = oword_args(record);
+    for (uint8_t i = 0; i < record->count; i++) {
+        uint8_t status = expr_eval(&code, &args[i]);
+        if (status != STATUS_OK)
+            return status;
+    }
+    float saved[EXPR_LOCALS];
+    expr_save_locals(saved);
+    for (uint8_t i = 0; i < EXPR_LOCALS; i++)
+        expr_set_parameter(i + 1, args[i]);
+#endif
+    uint8_t status = oword_run(sub->start, sub->end, client);
+    unwinding = OWORD_GCODE; // A return, or a break or continue outside a loop of the sub
+#ifdef GCODE_EXPRESSIONS
+    expr_restore_locals(saved);
+#endif
+    return status;
+}
+
+static uint8_t oword_run(uint32_t pos, uint32_t end, uint8_t client) {
+    if (running == OWORD_MAX_DEPTH)
+        return STATUS_OWORD_OVERFLOW;
+    running++;
+    uint8_t status = STATUS_OK;
+    while (pos < end && status == STATUS_OK && unwinding == OWORD_GCODE && !sys.abort) {
+        const oword_record_t* record = oword_at(pos);
+        uint32_t next = pos + record->size;
+        switch (record->kind) {
+            case OWORD_GCODE: status = gc_execute_words((const gc_word_t*)(record + 1), record->count, false, client); break;
+#ifdef GCODE_EXPRESSIONS
+            case OWORD_EXPRESSION: {
+                gc_word_t words[GC_MAX_WORDS];
+                uint8_t word_count;
+                status = expr_run_line((const uint8_t*)(record + 1), record->number, words, &word_count);
+                if (status == STATUS_OK)
+                    status = gc_execute_words(words, word_count, false, client);
+                break;
+            }
+#endif
+            case OWORD_SUB: status = oword_define(record, next, end, &next); break;
+            case OWORD_CALL: status = oword_call(record, client); break;
+            case OWORD_REPEAT:
+            case OWORD_WHILE: status = oword_loop(record, next, end, &next, client); break;
+            case OWORD_RETURN:
+            case OWORD_BREAK:
+            case OWORD_CONTINUE: unwinding = record->kind; break;
+            default: status = STATUS_OWORD_SYNTAX; break; // An end without its start
+        }
+        pos = next;
+    }
+    running--;
+    return status;
+}
+
+static uint8_t oword_take(char* line, uint8_t client) {
+    uint32_t at = store_used;
+    uint8_t status = oword_keep(line);
+    if (status == STATUS_OWORD_OVERFLOW && keeping != OWORD_GCODE) {
+        oword_drop(keeping_start); // The sub or loop cannot be kept whole
+        keeping = OWORD_GCODE;
+    }
+    if (status != STATUS_OK || at == store_used)
+        return status;
+    const oword_record_t* record = oword_at(at);
+    if (keeping == OWORD_GCODE) {
+        if (record->kind == OWORD_SUB || record->kind == OWORD_REPEAT || record->kind == OWORD_WHILE) {
+            keeping = record->kind;
+            keeping_number = record->number;
+            keeping_start = at;
+            return STATUS_OK;
+        }
+        // A single O-word line, like a call
+        uint32_t after = at + record->size;
+        status = oword_run(at, after, client);
+        if (unwinding != OWORD_GCODE) {
+            unwinding = OWORD_GCODE;
+            status = STATUS_OWORD_SYNTAX; // A return, break or continue outside of a sub or loop
+        }
+        if (store_used == after)
+            store_used = at; // Unless a file was loaded above it
+        return status;
+    }
+    if (record->kind != keeping + 1 || record->number != keeping_number)
+        return STATUS_OK;
+    uint8_t kept = keeping;
+    keeping = OWORD_GCODE;
+    status = oword_run(keeping_start, store_used, client);
+    unwinding = OWORD_GCODE;
+    if (kept != OWORD_SUB)
+        oword_drop(keeping_start);
+    return status;
+}
+
+bool oword_take_line(char* line, uint8_t client, uint8_t* status) {
+    const char* c = line;
+    while (*c == ' ' || *c == '\t')
+        c++;
+    if (keeping == OWORD_GCODE && *c != 'O' && *c != 'o')
+        return false;
+    *status = oword_take(line, client);
+    return true;
+}
+
+void oword_reset() {
+    if (running)
+        return;
+    store_used = 0;
+    sub_count = 0;
+    keeping = OWORD_GCODE;
+    unwinding = OWORD_GCODE;
+}
+
+#endif
@@ -0,0 +1,52 @@
+/*
+  oword.h - O-word subroutines and loops, run from lines kept in RAM
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef oword_h
+#define oword_h
+
+#ifdef OWORD_SUBROUTINES
+
+// Bytes of kept lines. A g-code line takes 8 bytes, plus 8 per word.
+#ifndef OWORD_STORE_SIZE
+    #define OWORD_STORE_SIZE 16384
+#endif
+
+#ifndef OWORD_MAX_SUBS
+    #define OWORD_MAX_SUBS 32
+#endif
+
+// Calls and loops nested within each other
+#ifndef OWORD_MAX_DEPTH
+    #define OWORD_MAX_DEPTH 8
+#endif
+
+// A call of an undefined o<name> loads OWORD_FILE_PREFIX name OWORD_FILE_SUFFIX, in lower case
+#define OWORD_FILE_PREFIX "/"
+#define OWORD_FILE_SUFFIX ".nc"
+
+// Takes an O-word line, or any line while the lines of a sub or loop are being kept, and sets
+// status to its result. Returns false for the other lines, which the parser runs as usual.
+bool oword_take_line(char* line, uint8_t client, uint8_t* status);
+
+// Forgets the subs and the kept lines, at a reset or the end of the program. Does nothing at
+// a program end within kept lines, which are dropped once they are done.
+void oword_reset();
+
+#endif
+
+#endif
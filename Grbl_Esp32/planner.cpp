@@ -26,7 +26,8 @@
 #include "grbl.h"
 #include <stdlib.h> // PSoc Required for labs
 
-static plan_block_t block_buffer[BLOCK_BUFFER_SIZE]; // A ring buffer for motion instructions
+static plan_block_t *block_buffer;                   // A ring buffer for motion instructions. Allocated by plan_init().
+static uint8_t block_buffer_size;                    // Number of blocks in block_buffer
 static uint8_t block_buffer_tail;                    // Index of the block to process now
 static uint8_t block_buffer_head;                    // Index of the next block to be pushed
 static uint8_t next_buffer_head;                     // Index of the next buffer head
@@ -40,14 +41,29 @@ typedef struct
     // i.e. arcs, canned cycles, and backlash compensation.
     float previous_unit_vec[N_AXIS]; // Unit vector of previous path line segment
     float previous_nominal_speed;    // Nominal speed of previous path line segment
+    float previous_target[N_AXIS];   // Target of previous path line segment (mm)
+
+    // Planner state from before the last block was added, so the block can be replaced by a merged one.
+    // See plan_merge_last_block().
+    bool merge_ready;                // The fields below describe the last block in the buffer
+    int32_t merge_position[N_AXIS];
+    float merge_unit_vec[N_AXIS];
+    float merge_nominal_speed;
+    float merge_start[N_AXIS];       // Start of the last block (mm)
+    float merge_points[PLANNER_MERGE_MAX][N_AXIS]; // Ends of the motions merged into the last block (mm)
+    uint8_t merge_count;
 } planner_t;
 static planner_t pl;
 
+// G95. The measured over the programmed spindle speed, applied to the feed of every feed per
+// revolution block. Stays 1 without a tachometer. See plan_spindle_feed_update().
+static float spindle_feed_ratio = 1.0f;
+
 // Returns the index of the next block in the ring buffer. Also called by stepper segment buffer.
 uint8_t plan_next_block_index(uint8_t block_index)
 {
     block_index++;
-    if (block_index == BLOCK_BUFFER_SIZE)
+    if (block_index == block_buffer_size)
         block_index = 0;
     return (block_index);
 }
@@ -56,7 +72,7 @@ uint8_t plan_next_block_index(uint8_t block_index)
 static uint8_t plan_prev_block_index(uint8_t block_index)
 {
     if (block_index == 0)
-        block_index = BLOCK_BUFFER_SIZE;
+        block_index = block_buffer_size;
     block_index--;
     return (block_index);
 }
@@ -126,13 +142,29 @@ static uint8_t plan_prev_block_index(uint8_t block_index)
   ARM versions should have enough memory and speed for look-ahead blocks numbering up to a hundred or more.
 
 */
+#ifdef PLANNER_PROFILE
+// CPU cycles spent in planner_recalculate(), as measured with the Xtensa CCOUNT register.
+static uint32_t recalculate_cycles_last;
+static uint32_t recalculate_cycles_max;
+static uint64_t recalculate_cycles_total;
+static uint32_t recalculate_count;
+static uint32_t recalculate_blocks_total; // Blocks visited by the reverse pass
+#endif
+
 static void planner_recalculate()
 {
+#ifdef PLANNER_PROFILE
+    uint32_t cycles_start = xthal_get_ccount();
+#endif
     // Initialize block index to the last block in the planner buffer.
     uint8_t block_index = plan_prev_block_index(block_buffer_head);
     // Bail. Can't do anything with one only one plan-able block.
     if (block_index == block_buffer_planned)
         return;
+#ifdef PLANNER_INCREMENTAL_RECALCULATE
+    // Forward pass start. Moved back from the planned pointer only as far as the reverse pass went.
+    uint8_t forward_index = block_buffer_planned;
+#endif
     // Reverse Pass: Coarsely maximize all possible deceleration curves back-planning from the last
     // block in buffer. Cease planning when the last optimal planned or tail pointer is reached.
     // NOTE: Forward pass will later refine and correct the reverse pass to create an optimal plan.
@@ -154,6 +186,29 @@ static void planner_recalculate()
         {
             next = current;
             current = &block_buffer[block_index];
+#ifdef PLANNER_PROFILE
+            recalculate_blocks_total++;
+#endif
+#ifdef PLANNER_INCREMENTAL_RECALCULATE
+            // If the entry speed of this block does not change, neither can the entry speeds before it,
+            // since each one is computed from the block after it. The earlier blocks already hold the
+            // result of the last plan, so the reverse pass stops and the forward pass restarts here.
+            if (current->entry_speed_sqr != current->max_entry_speed_sqr)
+            {
+                entry_speed_sqr = next->entry_speed_sqr + 2 * current->acceleration * current->millimeters;
+                if (entry_speed_sqr > current->max_entry_speed_sqr)
+                    entry_speed_sqr = current->max_entry_speed_sqr;
+                if (entry_speed_sqr == current->entry_speed_sqr)
+                {
+                    forward_index = block_index;
+                    break;
+                }
+                current->entry_speed_sqr = entry_speed_sqr;
+            }
+            block_index = plan_prev_block_index(block_index);
+            if (block_index == block_buffer_tail)
+                st_update_plan_block_parameters();
+#else
             block_index = plan_prev_block_index(block_index);
             // Check if next block is the tail block(=planned block). If so, update current stepper parameters.
             if (block_index == block_buffer_tail)
@@ -167,12 +222,18 @@ static void planner_recalculate()
                 else
                     current->entry_speed_sqr = current->max_entry_speed_sqr;
             }
+#endif
         }
     }
     // Forward Pass: Forward plan the acceleration curve from the planned pointer onward.
     // Also scans for optimal plan breakpoints and appropriately updates the planned pointer.
+#ifdef PLANNER_INCREMENTAL_RECALCULATE
+    next = &block_buffer[forward_index]; // Begin where the reverse pass stopped
+    block_index = plan_next_block_index(forward_index);
+#else
     next = &block_buffer[block_buffer_planned]; // Begin at buffer planned pointer
     block_index = plan_next_block_index(block_buffer_planned);
+#endif
     while (block_index != block_buffer_head)
     {
         current = next;
@@ -198,20 +259,183 @@ static void planner_recalculate()
             block_buffer_planned = block_index;
         block_index = plan_next_block_index(block_index);
     }
+#ifdef PLANNER_PROFILE
+    uint32_t cycles = xthal_get_ccount() - cycles_start;
+    recalculate_cycles_last = cycles;
+    if (cycles > recalculate_cycles_max)
+        recalculate_cycles_max = cycles;
+    recalculate_cycles_total += cycles;
+    recalculate_count++;
+#endif
+}
+
+#ifdef PLANNER_PROFILE
+// Reports the planner_recalculate() statistics gathered since the last report, then restarts the
+// measurement. Blocks is the average number of blocks visited by the reverse pass per call.
+// NOTE: Calls that bail out with a single plannable block are not counted.
+void plan_report_recalculate_cycles(uint8_t client)
+{
+    uint32_t count = recalculate_count;
+    uint32_t average = count ? (uint32_t)(recalculate_cycles_total / count) : 0;
+    float blocks = count ? (float)recalculate_blocks_total / count : 0.0;
+    grbl_sendf(client, "[MSG:Planner cycles last:%u avg:%u max:%u calls:%u blocks:%.1f]\r\n",
+               recalculate_cycles_last, average, recalculate_cycles_max, count, blocks);
+    recalculate_cycles_max = 0;
+    recalculate_cycles_total = 0;
+    recalculate_count = 0;
+    recalculate_blocks_total = 0;
+}
+#endif
+
+#ifdef PLANNER_BLOCK_REPORT
+// One block, as copied under the prep lock
+typedef struct {
+    float entry_speed_sqr;
+    float max_entry_speed_sqr;
+    float nominal_speed;
+    float acceleration;
+    float millimeters;
+    uint8_t condition;
+    bool planned;
+} plan_block_sample_t;
+
+static uint8_t block_report_client;
+static uint32_t block_report_interval_ms; // 0 if not subscribed
+static uint32_t block_report_next_ms;
+
+// Sends [PLN:<blocks>] and then a line for each block, the executing one first:
+//   [PLB:<entry>,<max entry>,<nominal>,<acceleration>,<mm>,<flags>]
+// The speeds are in mm/min, the acceleration in mm/sec^2 and mm is the distance left. The flags
+// are X for the executing block, P for a block the planner has optimally planned, L for an entry
+// speed below its maximum, which is where the stops ahead limit the speed, and R for a rapid.
+void plan_report_blocks(uint8_t client)
+{
+    plan_block_sample_t* samples = (plan_block_sample_t*)malloc(block_buffer_size * sizeof(plan_block_sample_t));
+    if (samples == NULL)
+        return;
+    uint8_t count = 0;
+    bool planned = true; // Blocks before block_buffer_planned
+    st_prep_lock();
+    for (uint8_t index = block_buffer_tail; index != block_buffer_head; index = plan_next_block_index(index)) {
+        if (index == block_buffer_planned)
+            planned = false;
+        plan_block_t* block = &block_buffer[index];
+        plan_block_sample_t* sample = &samples[count++];
+        sample->entry_speed_sqr = block->entry_speed_sqr;
+        sample->max_entry_speed_sqr = block->max_entry_speed_sqr;
+        sample->nominal_speed = plan_compute_profile_nominal_speed(block);
+        sample->acceleration = block->acceleration;
+        sample->millimeters = block->millimeters;
+        sample->condition = block->condition;
+        sample->planned = planned;
+    }
+    st_prep_unlock();
+    grbl_sendf(client, "[PLN:%d]\r\n", count);
+    for (uint8_t i = 0; i < count; i++) {
+        const plan_block_sample_t* sample = &samples[i];
+        char flags[5];
+        char* flag = flags;
+        if (i == 0)
+            *flag++ = 'X';
+        if (sample->planned)
+            *flag++ = 'P';
+        if (sample->entry_speed_sqr < sample->max_entry_speed_sqr)
+            *flag++ = 'L';
+        if (sample->condition & PL_COND_FLAG_RAPID_MOTION)
+            *flag++ = 'R';
+        *flag = '\0';
+        grbl_sendf(client, "[PLB:%.1f,%.1f,%.1f,%.1f,%.3f,%s]\r\n", sqrtf(sample->entry_speed_sqr),
+                   sqrtf(sample->max_entry_speed_sqr), sample->nominal_speed, sample->acceleration / (60.0f * 60.0f),
+                   sample->millimeters, flags);
+    }
+    free(samples);
+}
+
+err_t plan_subscribe_block_report(uint8_t client, uint32_t interval_ms)
+{
+    if (client >= CLIENT_COUNT)
+        return STATUS_INVALID_STATEMENT;
+    if (interval_ms != 0 && interval_ms < PLANNER_BLOCK_REPORT_MIN_MS)
+        return STATUS_NUMBER_RANGE;
+    block_report_interval_ms = 0; // Stopped while it is changed. The serial task sends the reports.
+    if (interval_ms == 0)
+        return STATUS_OK;
+    block_report_client = client;
+    block_report_next_ms = millis() + interval_ms;
+    block_report_interval_ms = interval_ms;
+    return STATUS_OK;
+}
+
+uint32_t plan_block_report_wait_ms()
+{
+    if (block_report_interval_ms == 0)
+        return UINT32_MAX;
+    int32_t left = block_report_next_ms - millis();
+    return left > 0 ? left : 0;
+}
+
+void plan_push_block_report()
+{
+    uint32_t interval_ms = block_report_interval_ms;
+    if (interval_ms == 0 || (int32_t)(millis() - block_report_next_ms) < 0)
+        return;
+    block_report_next_ms += interval_ms;
+    if ((int32_t)(millis() - block_report_next_ms) >= 0)
+        block_report_next_ms = millis() + interval_ms; // Fell behind. Skip the missed reports.
+    plan_report_blocks(block_report_client);
+}
+#endif
+
+#ifdef STATIC_MOTION_BUFFERS
+#if PLANNER_STATIC_BLOCKS < BLOCK_BUFFER_SIZE || PLANNER_STATIC_BLOCKS > BLOCK_BUFFER_SIZE_MAX
+    #error "PLANNER_STATIC_BLOCKS must be between BLOCK_BUFFER_SIZE and BLOCK_BUFFER_SIZE_MAX"
+#endif
+static plan_block_t block_buffer_static[PLANNER_STATIC_BLOCKS];
+#endif
+
+// Allocates the planner block buffer with the depth from the Planner/Blocks setting. The depth
+// is reduced if the buffer would take more than a quarter of the free heap.
+// NOTE: Called once at boot, after the settings are loaded. Changes take effect at the next boot.
+void plan_init()
+{
+    uint32_t size = planner_blocks->get();
+#ifdef STATIC_MOTION_BUFFERS
+    size = constrain(size, BLOCK_BUFFER_SIZE, PLANNER_STATIC_BLOCKS);
+    block_buffer = block_buffer_static;
+#else
+    while ((size > BLOCK_BUFFER_SIZE) && ((size * sizeof(plan_block_t)) > (ESP.getFreeHeap() / 4)))
+        size >>= 1;
+    if (size < BLOCK_BUFFER_SIZE)
+        size = BLOCK_BUFFER_SIZE;
+    block_buffer = (plan_block_t *)calloc(size, sizeof(plan_block_t));
+    if (block_buffer == NULL)
+    {
+        size = BLOCK_BUFFER_SIZE;
+        block_buffer = (plan_block_t *)calloc(size, sizeof(plan_block_t));
+    }
+#endif
+    block_buffer_size = size;
+    grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Planner blocks %d", block_buffer_size);
 }
 
 void plan_reset()
 {
     memset(&pl, 0, sizeof(planner_t)); // Clear planner struct
+    spindle_feed_ratio = 1.0f;
     plan_reset_buffer();
 }
 
 void plan_reset_buffer()
 {
+    st_prep_lock();
     block_buffer_tail = 0;
     block_buffer_head = 0;    // Empty = tail
     next_buffer_head = 1;     // plan_next_block_index(block_buffer_head)
     block_buffer_planned = 0; // = block_buffer_tail;
+#ifdef LASER_RASTER
+    raster_reset(); // The queued raster lines belong to the removed blocks.
+#endif
+    st_prep_unlock();
 }
 
 void plan_discard_current_block()
@@ -233,7 +457,7 @@ plan_block_t *plan_get_system_motion_block()
 }
 
 // Returns address of first planner block, if available. Called by various main program functions.
-plan_block_t *plan_get_current_block()
+plan_block_t * IRAM_ATTR plan_get_current_block()
 {
     if (block_buffer_head == block_buffer_tail)
         return (NULL); // Buffer empty
@@ -261,12 +485,14 @@ uint8_t plan_check_full_buffer()
 float plan_compute_profile_nominal_speed(plan_block_t *block)
 {
     float nominal_speed = block->programmed_rate;
+    if (block->feed_per_rev != 0.0f) // G95. The spindle speed of the block, with its override.
+        nominal_speed = block->feed_per_rev * block->spindle_speed * (0.01f * sys.spindle_speed_ovr) * spindle_feed_ratio;
     if (block->condition & PL_COND_FLAG_RAPID_MOTION)
-        nominal_speed *= (0.01 * sys.r_override);
+        nominal_speed *= (0.01f * sys.r_override);
     else
     {
         if (!(block->condition & PL_COND_FLAG_NO_FEED_OVERRIDE))
-            nominal_speed *= (0.01 * sys.f_override);
+            nominal_speed *= (0.01f * sys.f_override);
         if (nominal_speed > block->rapid_rate)
             nominal_speed = block->rapid_rate;
     }
@@ -291,6 +517,7 @@ static void plan_compute_profile_parameters(plan_block_t *block, float nominal_s
 // Re-calculates buffered motions profile parameters upon a motion-based override change.
 void plan_update_velocity_profile_parameters()
 {
+    st_prep_lock();
     uint8_t block_index = block_buffer_tail;
     plan_block_t *block;
     float nominal_speed;
@@ -304,10 +531,117 @@ void plan_update_velocity_profile_parameters()
         block_index = plan_next_block_index(block_index);
     }
     pl.previous_nominal_speed = prev_nominal_speed; // Update prev nominal speed for next incoming block.
+    st_prep_unlock();
 }
 
+static uint8_t plan_buffer_line_unlocked(float *target, plan_line_data_t *pl_data, bool recalculate);
+
+// NOTE: With USE_SEGMENT_PREP_TASK, the segment prep task reads the planner buffer from another task,
+// so a block is only added and replanned while holding the prep lock.
 uint8_t plan_buffer_line(float *target, plan_line_data_t *pl_data)
 {
+    TRACE_SCOPE(TRACE_PLAN, 1);
+    HEAP_TAG_SCOPE(HEAP_TAG_MOTION);
+    st_prep_lock();
+    uint8_t plan_status = plan_buffer_line_unlocked(target, pl_data, true);
+    st_prep_unlock();
+    return (plan_status);
+}
+
+// NOTE: The blocks are not replanned until all of them are added. The prep lock is held throughout,
+// so the segment prep task never sees the blocks before they are planned.
+uint8_t plan_buffer_lines(float (*targets)[N_AXIS], uint8_t count, plan_line_data_t *pl_data)
+{
+    TRACE_SCOPE(TRACE_PLAN, count);
+    HEAP_TAG_SCOPE(HEAP_TAG_MOTION);
+    st_prep_lock();
+    for (uint8_t i = 0; i < count; i++)
+        plan_buffer_line_unlocked(targets[i], pl_data, false);
+    planner_recalculate();
+    st_prep_unlock();
+    return (PLAN_OK);
+}
+
+// Returns the distance of point from the line from start to end, or -1 if point does not project onto
+// the line strictly between start and end.
+static float plan_distance_from_line(float *start, float *end, float *point)
+{
+    float direction[N_AXIS], offset[N_AXIS];
+    float length_sqr = 0.0, along = 0.0, offset_sqr = 0.0;
+    uint8_t idx;
+    for (idx = 0; idx < N_AXIS; idx++)
+    {
+        direction[idx] = end[idx] - start[idx];
+        offset[idx] = point[idx] - start[idx];
+        length_sqr += direction[idx] * direction[idx];
+        along += direction[idx] * offset[idx];
+        offset_sqr += offset[idx] * offset[idx];
+    }
+    if ((along <= 0.0) || (along >= length_sqr))
+        return (-1.0);
+    return (sqrt(MAX(offset_sqr - along * along / length_sqr, 0.0)));
+}
+
+// Merges a motion to target into the last block of the buffer, if it continues that block in a nearly
+// straight line. Each motion merged so far, and the end of the last block, must lie within the
+// Planner/MergeTolerance setting of the straight line from the start of the last block to target, and
+// the motion must have the same feed rate, spindle speed and conditions. If so, the last block is
+// removed and the planner state is rolled back to before it, so the caller re-plans from the start of
+// the last block to target. Returns true if the block was removed.
+// NOTE: The block at the buffer tail may be executing, so it is never merged into. Inverse time motions
+// are not merged, since their feed rate applies to each motion.
+static bool plan_merge_last_block(float *target, plan_line_data_t *pl_data)
+{
+    float tolerance = hot_settings->planner_merge_tolerance;
+    if ((tolerance <= 0.0) || !pl.merge_ready || (pl.merge_count >= PLANNER_MERGE_MAX))
+        return (false);
+    if (block_buffer_head == block_buffer_tail)
+        return (false);
+    uint8_t last_index = plan_prev_block_index(block_buffer_head);
+    if (last_index == block_buffer_tail)
+        return (false);
+    plan_block_t *last = &block_buffer[last_index];
+    if ((last->condition != pl_data->condition) || (last->spindle_speed != pl_data->spindle_speed))
+        return (false);
+    if ((pl_data->condition & (PL_COND_FLAG_SYSTEM_MOTION | PL_COND_FLAG_INVERSE_TIME)) || pl_data->feed_per_rev)
+        return (false);
+#ifdef LASER_RASTER
+    if (pl_data->raster || (last->raster != NULL))
+        return (false); // A raster block keeps its own length, which sets the pixel pitch.
+#endif
+#ifdef PROBE_SEQUENCE
+    if (pl_data->probe || last->probe)
+        return (false);
+#endif
+    if (!(pl_data->condition & PL_COND_FLAG_RAPID_MOTION) && (last->programmed_rate != pl_data->feed_rate))
+        return (false);
+    float distance = plan_distance_from_line(pl.merge_start, target, pl.previous_target);
+    if ((distance < 0.0) || (distance > tolerance))
+        return (false);
+    for (uint8_t i = 0; i < pl.merge_count; i++)
+    {
+        distance = plan_distance_from_line(pl.merge_start, target, pl.merge_points[i]);
+        if ((distance < 0.0) || (distance > tolerance))
+            return (false);
+    }
+    // Remove the last block and roll back to the planner state from before it.
+    memcpy(pl.merge_points[pl.merge_count++], pl.previous_target, sizeof(pl.previous_target));
+    memcpy(pl.position, pl.merge_position, sizeof(pl.position));
+    memcpy(pl.previous_unit_vec, pl.merge_unit_vec, sizeof(pl.previous_unit_vec));
+    memcpy(pl.previous_target, pl.merge_start, sizeof(pl.previous_target));
+    pl.previous_nominal_speed = pl.merge_nominal_speed;
+    block_buffer_head = last_index;
+    next_buffer_head = plan_next_block_index(block_buffer_head);
+    // The new block can have another entry speed than the one it replaces, which changes the exit
+    // speed of the blocks before it. Replan from the tail, as plan_cycle_reinitialize() does, so
+    // that none of them keeps a deceleration planned for the old exit speed.
+    block_buffer_planned = block_buffer_tail;
+    return (true);
+}
+
+static uint8_t plan_buffer_line_unlocked(float *target, plan_line_data_t *pl_data, bool recalculate)
+{
+    bool merged = plan_merge_last_block(target, pl_data);
     // Prepare and initialize new block. Copy relevant pl_data for block execution.
     plan_block_t *block = &block_buffer[block_buffer_head];
     memset(block, 0, sizeof(plan_block_t)); // Zero all block values.
@@ -323,85 +657,26 @@ uint8_t plan_buffer_line(float *target, plan_line_data_t *pl_data)
     uint8_t idx;
     // Copy position data based on type of motion being planned.
     if (block->condition & PL_COND_FLAG_SYSTEM_MOTION)
-    {
-        // #ifdef COREXY
-        //         position_steps[X_AXIS] = system_convert_corexy_to_x_axis_steps(sys_position);
-        //         position_steps[Y_AXIS] = system_convert_corexy_to_y_axis_steps(sys_position);
-        //         position_steps[Z_AXIS] = sys_position[Z_AXIS];
-        // #else
-        //         memcpy(position_steps, sys_position, sizeof(sys_position));
-        // #endif
-        if (machineType->get() == MACHINE_COREXY)
-        {
-            position_steps[X_AXIS] = system_convert_corexy_to_x_axis_steps(sys_position);
-            position_steps[Y_AXIS] = system_convert_corexy_to_y_axis_steps(sys_position);
-            position_steps[Z_AXIS] = sys_position[Z_AXIS];
-        }
-        else
-        {
-            memcpy(position_steps, sys_position, sizeof(sys_position));
-        }
-    }
+        kinematics_axis_steps(sys_position, position_steps);
     else
         memcpy(position_steps, pl.position, sizeof(pl.position));
-    // #ifdef COREXY
-    //     target_steps[A_MOTOR] = lround(target[A_MOTOR] * axis_settings[A_MOTOR]->steps_per_mm->get());
-    //     target_steps[B_MOTOR] = lround(target[B_MOTOR] * axis_settings[B_MOTOR]->steps_per_mm->get());
-    //     block->steps[A_MOTOR] = labs((target_steps[X_AXIS] - position_steps[X_AXIS]) + (target_steps[Y_AXIS] - position_steps[Y_AXIS]));
-    //     block->steps[B_MOTOR] = labs((target_steps[X_AXIS] - position_steps[X_AXIS]) - (target_steps[Y_AXIS] - position_steps[Y_AXIS]));
-    // #endif
-    if (machineType->get() == MACHINE_COREXY)
+    // Calculate target position in absolute steps and the steps of the move for each axis. Linear
+    // kinematics, like CoreXY, then turn the axis steps into motor steps.
+    int32_t delta_steps[N_AXIS];
+    for (idx = 0; idx < N_AXIS; idx++)
     {
-        target_steps[A_MOTOR] = lround(target[A_MOTOR] * axis_settings[A_MOTOR]->steps_per_mm->get());
-        target_steps[B_MOTOR] = lround(target[B_MOTOR] * axis_settings[B_MOTOR]->steps_per_mm->get());
-        block->steps[A_MOTOR] = labs((target_steps[X_AXIS] - position_steps[X_AXIS]) + (target_steps[Y_AXIS] - position_steps[Y_AXIS]));
-        block->steps[B_MOTOR] = labs((target_steps[X_AXIS] - position_steps[X_AXIS]) - (target_steps[Y_AXIS] - position_steps[Y_AXIS]));
+        target_steps[idx] = lround(target[idx] * axis_settings[idx]->steps_per_mm->get());
+        delta_steps[idx] = target_steps[idx] - position_steps[idx];
     }
+    kinematics_motor_steps(delta_steps, delta_steps);
     for (idx = 0; idx < N_AXIS; idx++)
     {
-        // Calculate target position in absolute steps, number of steps for each axis, and determine max step events.
-        // Also, compute individual axes distance for move and prep unit vector calculations.
+        // Number of steps for each motor, and determine max step events. Also, compute individual
+        // motor distance for move and prep unit vector calculations.
         // NOTE: Computes true distance from converted step values.
-        // #ifdef COREXY
-        //         if (!(idx == A_MOTOR) && !(idx == B_MOTOR)) {
-        //             target_steps[idx] = lround(target[idx] * axis_settings[idx]->steps_per_mm->get());
-        //             block->steps[idx] = labs(target_steps[idx] - position_steps[idx]);
-        //         }
-        //         block->step_event_count = MAX(block->step_event_count, block->steps[idx]);
-        //         if (idx == A_MOTOR)
-        //             delta_mm = (target_steps[X_AXIS] - position_steps[X_AXIS] + target_steps[Y_AXIS] - position_steps[Y_AXIS]) / axis_settings[idx]->steps_per_mm->get();
-        //         else if (idx == B_MOTOR)
-        //             delta_mm = (target_steps[X_AXIS] - position_steps[X_AXIS] - target_steps[Y_AXIS] + position_steps[Y_AXIS]) / axis_settings[idx]->steps_per_mm->get();
-        //         else
-        //             delta_mm = (target_steps[idx] - position_steps[idx]) / axis_settings[idx]->steps_per_mm->get();
-        // #else
-        //         target_steps[idx] = lround(target[idx] * axis_settings[idx]->steps_per_mm->get());
-        //         block->steps[idx] = labs(target_steps[idx] - position_steps[idx]);
-        //         block->step_event_count = MAX(block->step_event_count, block->steps[idx]);
-        //         delta_mm = (target_steps[idx] - position_steps[idx]) / axis_settings[idx]->steps_per_mm->get();
-        // #endif
-        if (machineType->get() == MACHINE_COREXY)
-        {
-            if (!(idx == A_MOTOR) && !(idx == B_MOTOR))
-            {
-                target_steps[idx] = lround(target[idx] * axis_settings[idx]->steps_per_mm->get());
-                block->steps[idx] = labs(target_steps[idx] - position_steps[idx]);
-            }
-            block->step_event_count = MAX(block->step_event_count, block->steps[idx]);
-            if (idx == A_MOTOR)
-                delta_mm = (target_steps[X_AXIS] - position_steps[X_AXIS] + target_steps[Y_AXIS] - position_steps[Y_AXIS]) / axis_settings[idx]->steps_per_mm->get();
-            else if (idx == B_MOTOR)
-                delta_mm = (target_steps[X_AXIS] - position_steps[X_AXIS] - target_steps[Y_AXIS] + position_steps[Y_AXIS]) / axis_settings[idx]->steps_per_mm->get();
-            else
-                delta_mm = (target_steps[idx] - position_steps[idx]) / axis_settings[idx]->steps_per_mm->get();
-        }
-        else
-        {
-            target_steps[idx] = lround(target[idx] * axis_settings[idx]->steps_per_mm->get());
-            block->steps[idx] = labs(target_steps[idx] - position_steps[idx]);
-            block->step_event_count = MAX(block->step_event_count, block->steps[idx]);
-            delta_mm = (target_steps[idx] - position_steps[idx]) / axis_settings[idx]->steps_per_mm->get();
-        }
+        block->steps[idx] = labs(delta_steps[idx]);
+        block->step_event_count = MAX(block->step_event_count, block->steps[idx]);
+        delta_mm = delta_steps[idx] / axis_settings[idx]->steps_per_mm->get();
         unit_vec[idx] = delta_mm; // Store unit vector numerator
         // Set direction bits. Bit enabled always means direction is negative.
         if (delta_mm < 0.0)
@@ -409,13 +684,29 @@ uint8_t plan_buffer_line(float *target, plan_line_data_t *pl_data)
     }
     // Bail if this is a zero-length block. Highly unlikely to occur.
     if (block->step_event_count == 0)
+    {
+        if (merged)
+            pl.merge_ready = false; // The merge state described the removed block.
         return (PLAN_EMPTY_BLOCK);
+    }
+#ifdef LASER_RASTER
+    if (pl_data->raster)
+        block->raster = raster_queue_staged();
+#endif
+#ifdef PROBE_SEQUENCE
+    block->probe = pl_data->probe;
+#endif
     // Calculate the unit vector of the line move and the block maximum feed rate and acceleration scaled
     // down such that no individual axes maximum values are exceeded with respect to the line direction.
     // NOTE: This calculation assumes all axes are orthogonal (Cartesian) and works with ABC-axes,
     // if they are also orthogonal/independent. Operates on the absolute value of the unit vector.
     block->millimeters = convert_delta_vector_to_unit_vector(unit_vec);
     block->acceleration = limit_acceleration_by_axis_maximum(unit_vec);
+    // The smoothstep ramps peak at 1.5 times the average acceleration of the ramp, so the block
+    // is planned at 2/3 of it and the peak stays within the axis acceleration settings.
+    block->smoothstep = (hot_settings->accel_profile == ACCEL_PROFILE_SMOOTHSTEP);
+    if (block->smoothstep)
+        block->acceleration *= (2.0f / 3.0f);
     block->rapid_rate = limit_rate_by_axis_maximum(unit_vec);
     // Store programmed rate.
     if (block->condition & PL_COND_FLAG_RAPID_MOTION)
@@ -425,6 +716,11 @@ uint8_t plan_buffer_line(float *target, plan_line_data_t *pl_data)
         block->programmed_rate = pl_data->feed_rate;
         if (block->condition & PL_COND_FLAG_INVERSE_TIME)
             block->programmed_rate *= block->millimeters;
+        else if (pl_data->feed_per_rev)
+        {
+            block->feed_per_rev = pl_data->feed_rate;
+            block->programmed_rate = pl_data->feed_rate * pl_data->spindle_speed;
+        }
     }
     // TODO: Need to check this method handling zero junction speeds when starting from rest.
     if ((block_buffer_head == block_buffer_tail) || (block->condition & PL_COND_FLAG_SYSTEM_MOTION))
@@ -483,7 +779,7 @@ uint8_t plan_buffer_line(float *target, plan_line_data_t *pl_data)
                 float junction_acceleration = limit_acceleration_by_axis_maximum(junction_unit_vec);
                 float sin_theta_d2 = sqrt(0.5 * (1.0 - junction_cos_theta)); // Trig half angle identity. Always positive.
                 block->max_junction_speed_sqr = MAX(MINIMUM_JUNCTION_SPEED * MINIMUM_JUNCTION_SPEED,
-                                                    (junction_acceleration * junction_deviation->get() * sin_theta_d2) / (1.0 - sin_theta_d2));
+                                                    (junction_acceleration * hot_settings->junction_deviation * sin_theta_d2) / (1.0 - sin_theta_d2));
             }
         }
     }
@@ -492,6 +788,15 @@ uint8_t plan_buffer_line(float *target, plan_line_data_t *pl_data)
     {
         float nominal_speed = plan_compute_profile_nominal_speed(block);
         plan_compute_profile_parameters(block, nominal_speed, pl.previous_nominal_speed);
+        // Keep the state from before this block for merging into it later.
+        memcpy(pl.merge_position, pl.position, sizeof(pl.position));
+        memcpy(pl.merge_unit_vec, pl.previous_unit_vec, sizeof(pl.previous_unit_vec));
+        memcpy(pl.merge_start, pl.previous_target, sizeof(pl.previous_target));
+        pl.merge_nominal_speed = pl.previous_nominal_speed;
+        if (!merged)
+            pl.merge_count = 0;
+        pl.merge_ready = true;
+        memcpy(pl.previous_target, target, sizeof(pl.previous_target));
         pl.previous_nominal_speed = nominal_speed;
         // Update previous path unit_vector and planner position.
         memcpy(pl.previous_unit_vec, unit_vec, sizeof(unit_vec)); // pl.previous_unit_vec[] = unit_vec[]
@@ -500,50 +805,39 @@ uint8_t plan_buffer_line(float *target, plan_line_data_t *pl_data)
         block_buffer_head = next_buffer_head;
         next_buffer_head = plan_next_block_index(block_buffer_head);
         // Finish up by recalculating the plan with the new block.
-        planner_recalculate();
+        if (recalculate)
+            planner_recalculate();
     }
+#ifdef LINE_TRACE
+    line_trace_planned();
+#endif
     return (PLAN_OK);
 }
 
 // Reset the planner position vectors. Called by the system abort/initialization routine.
 void plan_sync_position()
 {
-    // TODO: For motor configurations not in the same coordinate frame as the machine position,
-    // this function needs to be updated to accomodate the difference.
-    uint8_t idx;
-    for (idx = 0; idx < N_AXIS; idx++)
-    {
-        // #ifdef COREXY
-        //         if (idx == X_AXIS)
-        //             pl.position[X_AXIS] = system_convert_corexy_to_x_axis_steps(sys_position);
-        //         else if (idx == Y_AXIS)
-        //             pl.position[Y_AXIS] = system_convert_corexy_to_y_axis_steps(sys_position);
-        //         else
-        //             pl.position[idx] = sys_position[idx];
-        // #else
-        //         pl.position[idx] = sys_position[idx];
-        // #endif
-        if (machineType->get() == MACHINE_COREXY)
-        {
-            if (idx == X_AXIS)
-                pl.position[X_AXIS] = system_convert_corexy_to_x_axis_steps(sys_position);
-            else if (idx == Y_AXIS)
-                pl.position[Y_AXIS] = system_convert_corexy_to_y_axis_steps(sys_position);
-            else
-                pl.position[idx] = sys_position[idx];
-        }
-        else
-        {
-            pl.position[idx] = sys_position[idx];
-        }
-    }
+    pl.merge_ready = false; // The last block no longer ends at the planner position.
+    // The planner position is in axis steps. sys_position is in motor steps.
+    kinematics_axis_steps(sys_position, pl.position);
+}
+
+void plan_get_position(float* position)
+{
+    for (uint8_t idx = 0; idx < N_AXIS; idx++)
+        position[idx] = pl.position[idx] / axis_settings[idx]->steps_per_mm->get();
 }
 
 // Returns the number of available blocks are in the planner buffer.
+uint8_t plan_get_block_buffer_size()
+{
+    return block_buffer_size - 1; // One block is always left empty
+}
+
 uint8_t plan_get_block_buffer_available()
 {
     if (block_buffer_head >= block_buffer_tail)
-        return ((BLOCK_BUFFER_SIZE - 1) - (block_buffer_head - block_buffer_tail));
+        return ((block_buffer_size - 1) - (block_buffer_head - block_buffer_tail));
     return ((block_buffer_tail - block_buffer_head - 1));
 }
 
@@ -553,7 +847,7 @@ uint8_t plan_get_block_buffer_count()
 {
     if (block_buffer_head >= block_buffer_tail)
         return (block_buffer_head - block_buffer_tail);
-    return (BLOCK_BUFFER_SIZE - (block_buffer_tail - block_buffer_head));
+    return (block_buffer_size - (block_buffer_tail - block_buffer_head));
 }
 
 // Re-initialize buffer plan with a partially completed block, assumed to exist at the buffer tail.
@@ -561,7 +855,37 @@ uint8_t plan_get_block_buffer_count()
 void plan_cycle_reinitialize()
 {
     // Re-plan from a complete stop. Reset planner entry speeds and buffer planned pointer.
+    st_prep_lock();
     st_update_plan_block_parameters();
     block_buffer_planned = block_buffer_tail;
     planner_recalculate();
+    st_prep_unlock();
 }
+
+#ifdef SPINDLE_TACH_PIN
+// While a G95 block runs, reads the tachometer every SPINDLE_FEED_SAMPLE_MS. When the measured
+// over the programmed speed moved by more than SPINDLE_FEED_TOLERANCE percent, the buffer is
+// replanned as for a feed override, so the feed per revolution holds when the spindle slows
+// under load.
+void plan_spindle_feed_update()
+{
+    static uint32_t sample_ms;
+    plan_block_t *block = plan_get_current_block();
+    if (block == NULL || block->feed_per_rev == 0.0f || sys.spindle_speed == 0)
+        return;
+    uint32_t now = millis();
+    uint32_t elapsed = now - sample_ms;
+    if (elapsed < SPINDLE_FEED_SAMPLE_MS)
+        return;
+    sample_ms = now;
+    uint32_t rpm;
+    if (!spindle->get_actual_rpm(&rpm) || elapsed > 2 * SPINDLE_FEED_SAMPLE_MS)
+        return; // The first reading in a while averages over the time before the block
+    float ratio = (float)rpm / sys.spindle_speed;
+    if (fabsf(ratio - spindle_feed_ratio) * 100.0f <= SPINDLE_FEED_TOLERANCE * spindle_feed_ratio)
+        return;
+    spindle_feed_ratio = ratio;
+    plan_update_velocity_profile_parameters();
+    plan_cycle_reinitialize();
+}
+#endif
@@ -34,6 +34,23 @@
     #endif
 #endif
 
+// The planner buffer depth is set at boot by the Planner/Blocks setting. BLOCK_BUFFER_SIZE is
+// the default and the minimum. The block indices are uint8_t, which limits the maximum.
+#ifndef BLOCK_BUFFER_SIZE_MAX
+    #define BLOCK_BUFFER_SIZE_MAX 255
+#endif
+
+// Depth of the planner buffer of STATIC_MOTION_BUFFERS builds, which the Planner/Blocks setting
+// is limited to. See config.h.
+#ifndef PLANNER_STATIC_BLOCKS
+    #define PLANNER_STATIC_BLOCKS BLOCK_BUFFER_SIZE
+#endif
+
+// Maximum number of motions merged into one block by the Planner/MergeTolerance setting.
+#ifndef PLANNER_MERGE_MAX
+    #define PLANNER_MERGE_MAX 8
+#endif
+
 // Returned status message from planner.
 #define PLAN_OK true
 #define PLAN_EMPTY_BLOCK false
@@ -73,6 +90,7 @@ typedef struct {
     float max_entry_speed_sqr; // Maximum allowable entry speed based on the minimum of junction limit and
     //   neighboring nominal speeds with overrides in (mm/min)^2
     float acceleration;        // Axis-limit adjusted line acceleration in (mm/min^2). Does not change.
+    bool smoothstep;           // Planned for the smoothstep ramps of Stepper/AccelProfile, see plan_buffer_line()
     float millimeters;         // The remaining distance for this block to be executed in (mm).
     // NOTE: This value may be altered by stepper algorithm during execution.
 
@@ -80,11 +98,18 @@ typedef struct {
     float max_junction_speed_sqr; // Junction entry speed limit based on direction vectors in (mm/min)^2
     float rapid_rate;             // Axis-limit adjusted maximum rate for this block direction in (mm/min)
     float programmed_rate;        // Programmed rate of this block (mm/min).
+    float feed_per_rev;           // G95 feed in mm per spindle revolution, or 0. See plan_compute_profile_nominal_speed().
 
 
     // Stored spindle speed data used by spindle overrides and resuming methods.
     float spindle_speed;    // Block spindle speed. Copied from pl_line_data.
     //#endif
+#ifdef LASER_RASTER
+    raster_line_t* raster;  // Pixel powers spread over the block, or NULL. See raster.h.
+#endif
+#ifdef PROBE_SEQUENCE
+    bool probe;             // The probe turns on where the block starts. Copied from pl_line_data.
+#endif
 } plan_block_t;
 
 // Planner data prototype. Must be used when passing new motions to the planner.
@@ -92,14 +117,22 @@ typedef struct {
     float feed_rate;          // Desired feed rate for line motion. Value is ignored, if rapid motion.
     uint32_t spindle_speed;      // Desired spindle speed through line motion.
     uint8_t condition;        // Bitflag variable to indicate planner conditions. See defines above.
+    bool feed_per_rev;        // G95. feed_rate is in mm per spindle revolution.
 #ifdef USE_LINE_NUMBERS
     int32_t line_number;    // Desired line number to report when executing.
 #endif
+#ifdef LASER_RASTER
+    bool raster;            // The staged raster pixels go with this motion.
+#endif
+#ifdef PROBE_SEQUENCE
+    bool probe;             // The approach of a probe sequence. See mc_probe_sequence().
+#endif
 } plan_line_data_t;
 
 
 
 // Initialize and reset the motion plan subsystem
+void plan_init(); // Allocate the block buffer. Called once at boot.
 void plan_reset(); // Reset all
 void plan_reset_buffer(); // Reset buffer only.
 
@@ -108,6 +141,11 @@ void plan_reset_buffer(); // Reset buffer only.
 // rate is taken to mean "frequency" and would complete the operation in 1/feed_rate minutes.
 uint8_t plan_buffer_line(float* target, plan_line_data_t* pl_data);
 
+// Adds count linear movements to the buffer and replans once for all of them. The targets are
+// absolute positions like those of plan_buffer_line() and all use the same pl_data.
+// NOTE: The caller must make sure the buffer has room for count blocks.
+uint8_t plan_buffer_lines(float (*targets)[N_AXIS], uint8_t count, plan_line_data_t* pl_data);
+
 // Called when the current block is no longer needed. Discards the block and makes the memory
 // availible for new blocks.
 void plan_discard_current_block();
@@ -133,12 +171,29 @@ void plan_update_velocity_profile_parameters();
 // Reset the planner position vector (in steps)
 void plan_sync_position();
 
+// Writes the planner position, where the last planned line ends, in mm
+void plan_get_position(float* position);
+
 // Reinitialize plan with a partially completed block
 void plan_cycle_reinitialize();
 
+#ifdef SPINDLE_TACH_PIN
+// Makes G95 blocks follow the speed the tachometer measures. Called by the realtime protocol.
+#ifndef SPINDLE_FEED_SAMPLE_MS
+    #define SPINDLE_FEED_SAMPLE_MS 100
+#endif
+#ifndef SPINDLE_FEED_TOLERANCE
+    #define SPINDLE_FEED_TOLERANCE 2 // percent
+#endif
+void plan_spindle_feed_update();
+#endif
+
 // Returns the number of available blocks are in the planner buffer.
 uint8_t plan_get_block_buffer_available();
 
+// Returns the number of blocks the planner buffer can hold.
+uint8_t plan_get_block_buffer_size();
+
 // Returns the number of active blocks are in the planner buffer.
 // NOTE: Deprecated. Not used unless classic status reports are enabled in config.h
 uint8_t plan_get_block_buffer_count();
@@ -148,5 +203,26 @@ uint8_t plan_check_full_buffer();
 
 void plan_get_planner_mpos(float* target);
 
+#ifdef PLANNER_PROFILE
+// Reports and resets the planner_recalculate() cycle count statistics.
+void plan_report_recalculate_cycles(uint8_t client);
+#endif
+
+#ifdef PLANNER_BLOCK_REPORT
+#ifndef PLANNER_BLOCK_REPORT_MIN_MS
+    #define PLANNER_BLOCK_REPORT_MIN_MS 50
+#endif
+
+// Sends the planner blocks to client. See $PB.
+void plan_report_blocks(uint8_t client);
+
+// Sends the planner blocks to client every interval_ms, or stops if 0. plan_push_block_report()
+// sends them when due. Called by the serial task.
+err_t plan_subscribe_block_report(uint8_t client, uint32_t interval_ms);
+void plan_push_block_report();
+// Milliseconds until plan_push_block_report() is due, or UINT32_MAX with no report subscribed.
+uint32_t plan_block_report_wait_ms();
+#endif
+
 
 #endif
\ No newline at end of file
@@ -27,6 +27,24 @@
 // Inverts the probe pin state depending on user settings and probing cycle mode.
 uint8_t probe_invert_mask;
 
+#ifdef PROBE_EDGE_CAPTURE
+#ifdef USE_I2S_OUT_STREAM
+    #error "PROBE_EDGE_CAPTURE can not be used with USE_I2S_OUT_STREAM"
+#endif
+int16_t probe_edge_offset[N_AXIS];
+
+// Records the probe position at the probe edge. The stepper ISR also checks the pin every tick, in
+// case it gets there first. Both interrupts are attached on the same core at the same level, so
+// they do not interrupt each other.
+static void IRAM_ATTR isr_probe_edge() {
+    if (sys_probe_state == PROBE_ACTIVE && probe_get_state()) {
+        st_probe_edge_position(sys_probe_position, probe_edge_offset);
+        sys_probe_state = PROBE_OFF;
+        system_set_exec_state_flag(EXEC_MOTION_CANCEL);
+    }
+}
+#endif
+
 
 // Probe pin initialization routine.
 void probe_init() {
@@ -37,6 +55,9 @@ void probe_init() {
     pinMode(PROBE_PIN, INPUT_PULLUP);    // Enable internal pull-up resistors. Normal high operation.
 #endif
     probe_configure_invert_mask(false); // Initialize invert mask.
+#ifdef PROBE_EDGE_CAPTURE
+    attachInterrupt(digitalPinToInterrupt(PROBE_PIN), isr_probe_edge, CHANGE);
+#endif
 #endif
 }
 
@@ -51,7 +72,7 @@ void probe_configure_invert_mask(uint8_t is_probe_away) {
 }
 
 // Returns the probe pin state. Triggered = true. Called by gcode parser and probe state monitor.
-uint8_t probe_get_state() {
+uint8_t IRAM_ATTR probe_get_state() {
 #ifdef PROBE_PIN
     return ((digitalRead(PROBE_PIN)) ^ probe_invert_mask);
 #else
@@ -60,13 +81,29 @@ uint8_t probe_get_state() {
 }
 
 
+// Writes the last probe position, sys_probe_position, in machine coordinates and mm.
+void probe_get_position(float* position) {
+    system_convert_array_steps_to_mpos(position, sys_probe_position);
+#ifdef PROBE_EDGE_CAPTURE
+    // Parts of a step from the probe edge. CoreXY and bipolar machines, whose motors are not axes,
+    // keep whole steps.
+    if (!kinematics_mixed() && hot_settings->machine_type != MACHINE_BIPOLAR) {
+        for (uint8_t idx = 0; idx < N_AXIS; idx++)
+            position[idx] += probe_edge_offset[idx] / (PROBE_EDGE_STEP_SCALE * axis_settings[idx]->steps_per_mm->get());
+    }
+#endif
+}
+
 // Monitors probe pin state and records the system position when detected. Called by the
 // stepper ISR per ISR tick.
 // NOTE: This function must be extremely efficient as to not bog down the stepper ISR.
-void probe_state_monitor() {
+void IRAM_ATTR probe_state_monitor() {
     if (probe_get_state()) {
         sys_probe_state = PROBE_OFF;
         memcpy(sys_probe_position, sys_position, sizeof(sys_position));
-        bit_true(sys_rt_exec_state, EXEC_MOTION_CANCEL);
+#ifdef PROBE_EDGE_CAPTURE
+        memset(probe_edge_offset, 0, sizeof(probe_edge_offset));
+#endif
+        system_set_exec_state_flag(EXEC_MOTION_CANCEL);
     }
 }
@@ -27,6 +27,18 @@
 // Values that define the probing state machine.
 #define PROBE_OFF     0 // Probing disabled or not in use. (Must be zero.)
 #define PROBE_ACTIVE  1 // Actively watching the input pin.
+#ifdef PROBE_SEQUENCE
+#define PROBE_ARMED   2 // Waiting for the approach block of a probe sequence. See mc_probe_sequence().
+#endif
+
+#ifdef PROBE_EDGE_CAPTURE
+// Resolution of probe_edge_offset, in parts of a step. Whole steps times this must fit an int16_t.
+#define PROBE_EDGE_STEP_SCALE 256
+
+// Part of a step to add to each axis of sys_probe_position, in 1/PROBE_EDGE_STEP_SCALE steps.
+// Zero when the probe position was taken at whole step resolution.
+extern int16_t probe_edge_offset[N_AXIS];
+#endif
 
 // Probe pin initialization routine.
 void probe_init();
@@ -39,6 +51,9 @@ void probe_configure_invert_mask(uint8_t is_probe_away);
 // Returns probe pin state. Triggered = true. Called by gcode parser and probe state monitor.
 uint8_t probe_get_state();
 
+// Writes the last probe position, sys_probe_position, in machine coordinates and mm.
+void probe_get_position(float* position);
+
 // Monitors probe pin state and records the system position when detected. Called by the
 // stepper ISR per ISR tick.
 void probe_state_monitor();
@@ -36,6 +36,10 @@ typedef struct {
     char buffer[LINE_BUFFER_SIZE];
     int  len;
     int  line_number;
+#ifdef LINE_TRACE
+    uint32_t received_us; // See line_trace.h
+    uint32_t eol_us;
+#endif
 } client_line_t;
 client_line_t client_lines[CLIENT_COUNT];
 
@@ -45,9 +49,8 @@ void empty_line(uint8_t client)
     cl->len = 0;
     cl->buffer[0] = '\0';
 }
-err_t add_char_to_line(char c, uint8_t client)
+static err_t add_char_to_client_line(char c, uint8_t client, client_line_t* cl)
 {
-    client_line_t* cl = &client_lines[client];
     // Simple editing for interactive input
     if (c == '\b') {
         // Backspace erases
@@ -58,17 +61,32 @@ err_t add_char_to_line(char c, uint8_t client)
         return STATUS_OK;
     }
     if (cl->len == (LINE_BUFFER_SIZE - 1)) {
+#ifdef LINE_TRACE
+        if (c == '\r' || c == '\n')
+            line_trace_eol(client); // Still counted, to number the lines as the serial task does
+#endif
         return STATUS_OVERFLOW;
     }
     if (c == '\r' || c == '\n') {
         cl->len = 0;
         cl->line_number++;
+#ifdef LINE_TRACE
+        cl->eol_us = line_trace_eol(client);
+#endif
         return STATUS_EOL;
     }
+#ifdef LINE_TRACE
+    if (cl->len == 0)
+        cl->received_us = line_trace_start(client);
+#endif
     cl->buffer[cl->len++] = c;
     cl->buffer[cl->len] = '\0';
     return STATUS_OK;
 }
+err_t add_char_to_line(char c, uint8_t client)
+{
+    return add_char_to_client_line(c, client, &client_lines[client]);
+}
 
 err_t execute_line(char* line, uint8_t client, auth_t auth_level)
 {
@@ -91,6 +109,362 @@ err_t execute_line(char* line, uint8_t client, auth_t auth_level)
 /*
   GRBL PRIMARY LOOP:
 */
+// Input starvation counter, reported and cleared by $ST. See protocol_main_loop().
+static uint32_t input_starvations = 0;
+static bool input_starved = false;
+
+uint32_t protocol_take_input_starvations() {
+    uint32_t count = input_starvations;
+    input_starvations = 0;
+    return count;
+}
+
+// Lines executed since boot, from all clients. SD lines are not counted.
+static uint32_t lines_executed = 0;
+
+uint32_t protocol_get_lines_executed() {
+    return lines_executed;
+}
+
+#ifdef LOOP_PROFILE
+// Time histograms of the passes of protocol_main_loop(), of each phase and of the whole pass.
+// Bin n counts durations from 2^n to 2^(n+1) microseconds, bin 0 those under 2us, and the last
+// bin the rest. A long pass delays the realtime commands and the next line by as much.
+enum loop_phase_t : uint8_t {
+    LOOP_SD,           // SD lines
+    LOOP_CLIENTS,      // Reading and running client lines
+    LOOP_CYCLE_START,  // protocol_auto_cycle_start()
+    LOOP_REALTIME,     // protocol_execute_realtime()
+    LOOP_HOUSEKEEPING, // Stepper disable, deferred settings writes and job statistics
+    LOOP_PASS,         // The whole pass
+    LOOP_PHASES,
+};
+#define LOOP_BINS 17
+
+typedef struct {
+    uint32_t bins[LOOP_BINS];
+    uint32_t max_us;
+    uint64_t total_us;
+} loop_times_t;
+static loop_times_t loop_times[LOOP_PHASES];
+static uint32_t loop_passes;
+
+// Counts the time of phase since start, and returns the time now, the start of the next phase
+static int64_t loop_mark(uint8_t phase, int64_t start) {
+    int64_t now = esp_timer_get_time();
+    uint32_t us = now - start;
+    loop_times_t* times = &loop_times[phase];
+    times->bins[MIN(us < 2 ? 0 : 31 - __builtin_clz(us), LOOP_BINS - 1)]++;
+    times->total_us += us;
+    if (us > times->max_us)
+        times->max_us = us;
+    return now;
+}
+
+void protocol_report_loop_times(uint8_t client) {
+    static const char* const names[LOOP_PHASES] = { "SD", "Clients", "CycleStart", "Realtime", "Housekeeping", "Pass" };
+    grbl_sendf(client, "[MSG:Loop passes:%u]\r\n", loop_passes);
+    for (uint8_t phase = 0; phase < LOOP_PHASES; phase++) {
+        loop_times_t* times = &loop_times[phase];
+        char bins[LOOP_BINS * 16] = "";
+        for (uint8_t bin = 0; bin < LOOP_BINS; bin++) {
+            if (times->bins[bin] == 0)
+                continue;
+            if (bin == LOOP_BINS - 1)
+                sprintf(bins + strlen(bins), " >=%u:%u", 1u << bin, times->bins[bin]);
+            else
+                sprintf(bins + strlen(bins), " <%u:%u", 2u << bin, times->bins[bin]);
+        }
+        grbl_sendf(client, "[MSG:Loop %s avg:%.1f max:%u us%s]\r\n", names[phase],
+                   loop_passes ? (float)times->total_us / loop_passes : 0.0f, times->max_us, bins);
+    }
+    memset(loop_times, 0, sizeof(loop_times));
+    loop_passes = 0;
+}
+#endif
+
+// Client scheduling. The client that last sent g-code is the streaming client. Its lines are
+// always read first and in full. While a job is running, the other clients are limited to the
+// Serial/ClientRate setting in lines per second, so a dashboard polling with $ commands cannot
+// starve the planner. Bytes read past a line that had to wait are kept in client_pending.
+typedef struct {
+    uint8_t data[RX_BUFFER_SIZE];
+    size_t pos;
+    size_t len;
+} client_pending_t;
+static client_pending_t client_pending[CLIENT_COUNT];
+static uint8_t stream_client = CLIENT_SERIAL;
+static uint32_t client_next_line_ms[CLIENT_COUNT];
+
+#ifdef BINARY_GCODE_FRAMES
+// A binary frame being received. len is 0 when the client is not in a frame.
+typedef struct {
+    uint8_t data[GC_FRAME_MAX];
+    uint16_t len;
+} client_frame_t;
+static client_frame_t client_frames[CLIENT_COUNT];
+#endif
+
+#ifdef PROTOCOL_READ_AHEAD
+// Lines of the streaming client read while the planner was full. See protocol_read_ahead().
+typedef struct {
+    client_line_t line;
+    uint8_t client;
+    err_t status; // STATUS_EOL, or STATUS_OVERFLOW if the line was too long
+    bool tokenized; // The words are split into tokens, by gc_tokenize_ahead()
+    gc_tokens_t tokens;
+} read_ahead_line_t;
+static read_ahead_line_t read_ahead_lines[PROTOCOL_READ_AHEAD_LINES + 1];
+static uint8_t read_ahead_head = 0;
+static uint8_t read_ahead_tail = 0;
+#endif
+
+// Returns true if a client other than the streaming client may run a line now.
+static bool protocol_client_may_run_line(uint8_t client) {
+    uint32_t rate = client_line_rate->get();
+    if (client == stream_client || rate == 0 || !(sys.state & (STATE_CYCLE | STATE_HOLD)))
+        return true;
+    return (int32_t)(millis() - client_next_line_ms[client]) >= 0;
+}
+
+// Drops the bytes and lines read ahead. Called on a system abort, like the client buffers.
+static void protocol_drop_pending() {
+    for (uint8_t c = 0; c < CLIENT_COUNT; c++) {
+        client_pending[c].pos = client_pending[c].len = 0;
+#ifdef BINARY_GCODE_FRAMES
+        client_frames[c].len = 0;
+#endif
+    }
+#ifdef PROTOCOL_READ_AHEAD
+    read_ahead_head = read_ahead_tail = 0;
+#endif
+}
+
+// Runs one received line and reports its status. Returns false on a system abort.
+// tokens, if not NULL, are the words of a g-code line split ahead of time.
+static bool protocol_run_line(client_line_t* cl, uint8_t client, const gc_tokens_t* tokens) {
+    char* line = cl->buffer;
+    protocol_execute_realtime(); // Runtime command check point.
+    if (sys.abort) {
+        protocol_drop_pending();
+        return false;   // Bail to calling function upon system abort
+    }
+#ifdef REPORT_ECHO_RAW_LINE_RECEIVED
+    report_echo_line_received(line, client);
+#endif
+    if (line[0] != 0 && line[0] != '$' && line[0] != '[')
+        stream_client = client; // g-code makes this the streaming client
+    else if (client != stream_client && client_line_rate->get() != 0)
+        client_next_line_ms[client] = millis() + 1000 / client_line_rate->get();
+#ifdef LINE_TRACE
+    line_trace_begin(client, cl->received_us, cl->eol_us);
+#endif
+    // auth_level can be upgraded by supplying a password on the command line
+    TRACE_BEGIN(TRACE_LINE, client);
+#ifdef BENCHMARK
+    size_t line_len = strlen(line); // The parser may change the line
+#endif
+#ifdef PROTOCOL_READ_AHEAD
+    if (tokens != NULL) {
+        // Block if in alarm or jog mode, as execute_line() does for g-code
+        report_status_message((sys.state & (STATE_ALARM | STATE_JOG)) ? STATUS_SYSTEM_GC_LOCK : gc_execute_tokens(line, tokens, client), client);
+    } else
+#endif
+        report_status_message(execute_line(line, client, LEVEL_GUEST), client);
+    lines_executed++;
+#ifdef BENCHMARK
+    bench_stream_line(client, line_len);
+#endif
+    TRACE_END(TRACE_LINE);
+#ifdef LINE_TRACE
+    line_trace_end();
+#endif
+    return true;
+}
+
+#ifdef BINARY_GCODE_FRAMES
+// Adds a received byte to a binary frame. Returns false if the byte is not part of a frame.
+// Sets complete when the byte finishes the frame.
+static bool protocol_frame_byte(uint8_t client, uint8_t data, bool& complete) {
+    client_frame_t* frame = &client_frames[client];
+    complete = false;
+    if (frame->len == 0 && data != GC_FRAME_START)
+        return false;
+    frame->data[frame->len++] = data;
+    complete = (frame->len >= 2) && (frame->len == frame->data[1] + 4);
+    return true;
+}
+
+// Checks, unpacks and runs a complete binary frame. Returns false on a system abort.
+static bool protocol_run_frame(uint8_t client) {
+    client_frame_t* frame = &client_frames[client];
+    uint8_t length = frame->data[1];
+    const uint8_t* payload = &frame->data[2];
+    uint16_t crc = (frame->data[2 + length] << 8) | frame->data[3 + length];
+    frame->len = 0;
+    protocol_execute_realtime(); // Runtime command check point.
+    if (sys.abort) {
+        protocol_drop_pending();
+        return false;   // Bail to calling function upon system abort
+    }
+    uint8_t word_count = (length - 1) / GC_FRAME_WORD_SIZE;
+    uint8_t opcode = payload[0];
+    if (length == 0 || crc != crc16_ccitt(&frame->data[1], length + 1) ||
+            ((length - 1) % GC_FRAME_WORD_SIZE) != 0 || word_count > GC_MAX_WORDS ||
+            (opcode != GC_FRAME_BLOCK && opcode != GC_FRAME_JOG)) {
+        report_status_message(STATUS_BAD_FRAME, client);
+        return true;
+    }
+    gc_word_t words[GC_MAX_WORDS];
+    for (uint8_t i = 0; i < word_count; i++) {
+        const uint8_t* word = &payload[1 + i * GC_FRAME_WORD_SIZE];
+        uint32_t bits = word[1] | (word[2] << 8) | (word[3] << 16) | ((uint32_t)word[4] << 24);
+        words[i].letter = word[0];
+        memcpy(&words[i].value, &bits, sizeof(float));
+        if (words[i].letter < 'A' || words[i].letter > 'Z' || isnan(words[i].value) || isinf(words[i].value)) {
+            report_status_message(words[i].letter < 'A' || words[i].letter > 'Z' ? STATUS_EXPECTED_COMMAND_LETTER : STATUS_BAD_NUMBER_FORMAT, client);
+            return true;
+        }
+    }
+    err_t status;
+    if (opcode == GC_FRAME_JOG) {
+        // Execute only if in IDLE or JOG states, as for $J=
+        status = (sys.state != STATE_IDLE && sys.state != STATE_JOG) ? STATUS_IDLE_ERROR : gc_execute_words(words, word_count, true, client);
+    } else {
+        stream_client = client; // g-code makes this the streaming client
+        // Block if in alarm or jog mode, as for g-code lines
+        status = (sys.state & (STATE_ALARM | STATE_JOG)) ? STATUS_SYSTEM_GC_LOCK : gc_execute_words(words, word_count, false, client);
+    }
+    report_status_message(status, client);
+    return true;
+}
+#endif
+
+#ifdef PROTOCOL_READ_AHEAD
+// Runs the lines read ahead, in order. Returns false on a system abort.
+static bool protocol_run_read_ahead() {
+    while (read_ahead_tail != read_ahead_head) {
+        read_ahead_line_t* ahead = &read_ahead_lines[read_ahead_tail];
+        if (ahead->status == STATUS_OVERFLOW)
+            report_status_message(STATUS_OVERFLOW, ahead->client);
+        else if (!protocol_run_line(&ahead->line, ahead->client, ahead->tokenized ? &ahead->tokens : NULL))
+            return false;
+        // The slot is released after the line has run, so protocol_read_ahead() cannot reuse it
+        read_ahead_tail = (read_ahead_tail + 1) % (PROTOCOL_READ_AHEAD_LINES + 1);
+    }
+    return true;
+}
+
+// Called while a motion waits for planner space. Moves whole lines of the streaming client from
+// its receive buffer to the read-ahead queue, so the client can keep sending in the meantime, and
+// splits their g-code into words, so that only gc_execute_words() is left for the main loop.
+// NOTE: Lines are only taken when the client has no partial line, and the line is run later by
+// protocol_run_read_ahead(), so the order of the lines is unchanged.
+void protocol_read_ahead() {
+    uint8_t client = stream_client;
+    client_pending_t* pending = &client_pending[client];
+    if (client_lines[client].len != 0)
+        return;
+#ifdef BINARY_GCODE_FRAMES
+    if (client_frames[client].len != 0)
+        return; // Frames are only run from protocol_read_client()
+#endif
+    if (read_ahead_tail != read_ahead_head && read_ahead_lines[read_ahead_tail].client != client)
+        return;
+    for (;;) {
+        uint8_t next = (read_ahead_head + 1) % (PROTOCOL_READ_AHEAD_LINES + 1);
+        if (next == read_ahead_tail)
+            return; // Queue full
+        // Find the end of the next line, reading more of the client if needed
+        size_t eol = pending->pos;
+        while (eol < pending->len && pending->data[eol] != '\n' && pending->data[eol] != '\r')
+            eol++;
+#ifdef BINARY_GCODE_FRAMES
+        if (memchr(&pending->data[pending->pos], GC_FRAME_START, eol - pending->pos) != NULL)
+            return; // A frame comes first
+#endif
+        if (eol == pending->len) {
+            size_t kept = pending->len - pending->pos;
+            memmove(pending->data, &pending->data[pending->pos], kept);
+            pending->pos = 0;
+            pending->len = kept + serial_read_bytes(client, &pending->data[kept], sizeof(pending->data) - kept);
+            eol = kept;
+            while (eol < pending->len && pending->data[eol] != '\n' && pending->data[eol] != '\r')
+                eol++;
+            if (eol == pending->len)
+                return; // No whole line yet. It is put together in protocol_read_client().
+#ifdef BINARY_GCODE_FRAMES
+            if (memchr(pending->data, GC_FRAME_START, eol) != NULL)
+                return; // A frame comes first
+#endif
+        }
+        read_ahead_line_t* ahead = &read_ahead_lines[read_ahead_head];
+        ahead->client = client;
+        ahead->line.len = 0;
+        ahead->line.buffer[0] = '\0';
+        err_t res = STATUS_OK;
+        while (pending->pos <= eol && res == STATUS_OK)
+            res = add_char_to_client_line(pending->data[pending->pos++], client, &ahead->line);
+        ahead->status = res;
+        char first = ahead->line.buffer[0];
+        ahead->tokenized = (res == STATUS_EOL) && first != 0 && first != '$' && first != '[' &&
+                           gc_tokenize_ahead(ahead->line.buffer, &ahead->tokens);
+        read_ahead_head = next;
+    }
+}
+#endif
+
+// Reads a client and runs its lines until it has no more data or has to wait for its rate.
+// Sets received if any data was read. Returns false on a system abort.
+static bool protocol_read_client(uint8_t client, bool& received) {
+    client_pending_t* pending = &client_pending[client];
+    for (;;) {
+#ifdef PROTOCOL_READ_AHEAD
+        if (!protocol_run_read_ahead())
+            return false;
+#endif
+        if (pending->pos == pending->len) {
+            pending->pos = 0;
+            pending->len = serial_read_bytes(client, pending->data, sizeof(pending->data));
+            if (pending->len == 0)
+                return true;
+            received = true;
+        }
+        while (pending->pos < pending->len) {
+            // A line is only started once the client may run it
+            if (client_lines[client].len == 0 && !protocol_client_may_run_line(client))
+                return true;
+#ifdef BINARY_GCODE_FRAMES
+            bool complete;
+            if (protocol_frame_byte(client, pending->data[pending->pos], complete)) {
+                pending->pos++;
+                if (complete && !protocol_run_frame(client))
+                    return false;
+                continue;
+            }
+#endif
+            err_t res = add_char_to_line(pending->data[pending->pos++], client);
+            switch (res) {
+                case STATUS_OK:
+                    break;
+                case STATUS_EOL:
+                    if (!protocol_run_line(&client_lines[client], client, NULL))
+                        return false;
+                    empty_line(client);
+#ifdef PROTOCOL_READ_AHEAD
+                    if (!protocol_run_read_ahead())
+                        return false;
+#endif
+                    break;
+                case STATUS_OVERFLOW:
+                    report_status_message(STATUS_OVERFLOW, client);
+                    empty_line(client);
+                    break;
+            }
+        }
+    }
+}
+
 void protocol_main_loop() {
     //uint8_t client = CLIENT_SERIAL; // default client
     // Perform some machine checks to make sure everything is good to go.
@@ -112,7 +486,7 @@ void protocol_main_loop() {
         // Check if the safety door is open.
         sys.state = STATE_IDLE;
         if (system_check_safety_door_ajar()) {
-            bit_true(sys_rt_exec_state, EXEC_SAFETY_DOOR);
+            system_set_exec_state_flag(EXEC_SAFETY_DOOR);
             protocol_execute_realtime(); // Enter safety door mode. Should return as IDLE state.
         }
         // All systems go!
@@ -122,67 +496,103 @@ void protocol_main_loop() {
     // Primary loop! Upon a system abort, this exits back to main() to reset the system.
     // This is also where Grbl idles while waiting for something to do.
     // ---------------------------------------------------------------------------------
-    uint8_t c;
     for (;;) {
+#ifdef LOOP_PROFILE
+        int64_t loop_start = esp_timer_get_time();
+        int64_t phase_start = loop_start;
+#endif
 #ifdef ENABLE_SD_CARD
-        if (SD_ready_next) {
-            char fileLine[255];
-            if (readFileLine(fileLine, 255)) {
+        // SD lines run back to back while the planner has room, up to SD_LINES_PER_PASS before the
+        // clients are read again. The realtime commands are checked between lines as for clients.
+        for (uint8_t sd_lines = 0; SD_ready_next && sd_lines < SD_LINES_PER_PASS; sd_lines++) {
+            if (sd_lines != 0) {
+                if (plan_check_full_buffer())
+                    break;
+                protocol_execute_realtime();
+                if (sys.abort)
+                    return;
+            }
+            uint8_t status;
+            if (sd_run_next(&status)) {
                 SD_ready_next = false;
-                report_status_message(gc_execute_line(fileLine, SD_client), SD_client);
+                report_status_message(status, SD_client);
             } else {
                 char temp[50];
                 sd_get_current_filename(temp);
                 grbl_notifyf("SD print done", "%s print is successful", temp);
                 closeFile(); // close file and clear SD ready/running flags
+#ifdef SD_JOB_QUEUE
+                // The next job of the queue is planned behind the last blocks of this one
+                if (sd_queue_next())
+                    continue;
+#endif
+#ifdef JOB_STATS
+                job_stats_sd_done();
+#endif
             }
         }
+#endif
+#ifdef LOOP_PROFILE
+        phase_start = loop_mark(LOOP_SD, phase_start);
 #endif
         // Receive one line of incoming serial data, as the data becomes available.
         // Filtering, if necessary, is done later in gc_execute_line(), so the
         // filtering is the same with serial and file input.
-        uint8_t client = CLIENT_SERIAL;
-        char* line;
-        for (client = 0; client < CLIENT_COUNT; client++) {
-            while ((c = serial_read(client)) != SERIAL_NO_DATA) {
-                err_t res = add_char_to_line(c, client);
-                switch (res) {
-                    case STATUS_OK:
-                        break;
-                    case STATUS_EOL:
-                        protocol_execute_realtime(); // Runtime command check point.
-                        if (sys.abort) {
-                            return;   // Bail to calling function upon system abort
-                        }
-                        line = client_lines[client].buffer;
-#ifdef REPORT_ECHO_RAW_LINE_RECEIVED
-                        report_echo_line_received(line, client);
-#endif
-                        // auth_level can be upgraded by supplying a password on the command line
-                        report_status_message(execute_line(line, client, LEVEL_GUEST), client);
-                        empty_line(client);
-                        break;
-                    case STATUS_OVERFLOW:
-                        report_status_message(STATUS_OVERFLOW, client);
-                        empty_line(client);
-                        break;
-                }
-            } // while serial read
+        bool received = false;
+#ifdef ENABLE_SD_CARD
+        received = get_sd_state(false) == SDCARD_BUSY_PRINTING;
+#endif
+        // The streaming client goes first, then the rest in order.
+        if (!protocol_read_client(stream_client, received))
+            return;
+        for (uint8_t client = 0; client < CLIENT_COUNT; client++) {
+            if (client != stream_client && !protocol_read_client(client, received))
+                return;
         } // for clients
+        // Count each time the input runs dry during a cycle while the planner still has room.
+        if (received)
+            input_starved = false;
+        else if (sys.state == STATE_CYCLE && !input_starved && !plan_check_full_buffer()) {
+            input_starved = true;
+            input_starvations++;
+        }
+#ifdef LOOP_PROFILE
+        phase_start = loop_mark(LOOP_CLIENTS, phase_start);
+#endif
         // If there are no more characters in the serial read buffer to be processed and executed,
         // this indicates that g-code streaming has either filled the planner buffer or has
         // completed. In either case, auto-cycle start, if enabled, any queued moves.
         protocol_auto_cycle_start();
+#ifdef LOOP_PROFILE
+        phase_start = loop_mark(LOOP_CYCLE_START, phase_start);
+#endif
         protocol_execute_realtime();  // Runtime command check point.
         if (sys.abort) {
             return;   // Bail to main() program loop to reset system.
         }
+#ifdef LOOP_PROFILE
+        phase_start = loop_mark(LOOP_REALTIME, phase_start);
+#endif
         // check to see if we should disable the stepper drivers ... esp32 work around for disable in main loop.
         if (stepper_idle) {
             if (esp_timer_get_time() > stepper_idle_counter) {
                 motors_set_disable(true);
             }
         }
+#ifdef FLASH_WRITE_DEFER
+        settings_flush_deferred();
+#endif
+#ifdef TOOL_TABLE
+        tool_table_flush();
+#endif
+#ifdef JOB_STATS
+        job_stats_poll();
+#endif
+#ifdef LOOP_PROFILE
+        loop_mark(LOOP_HOUSEKEEPING, phase_start);
+        loop_mark(LOOP_PASS, loop_start);
+        loop_passes++;
+#endif
     }
     return; /* Never reached */
 }
@@ -260,6 +670,7 @@ void protocol_exec_rt_system() {
     if (rt_exec) {
         // Execute system abort.
         if (rt_exec & EXEC_RESET) {
+            mc_reset_complete(); // Of a reset from the control pin ISR
             sys.abort = true;  // Only place this is set true.
             return; // Nothing else to do but exit.
         }
@@ -402,6 +813,11 @@ void protocol_exec_rt_system() {
                 } else {
                     sys.suspend = SUSPEND_DISABLE;
                     sys.state = STATE_IDLE;
+                    // A laser that M5 left enabled, at zero power, is turned off now its motion is done.
+                    if (gc_state.modal.spindle == SPINDLE_DISABLE && spindle->pin_state != SPINDLE_DISABLE)
+                        spindle->set_state(SPINDLE_DISABLE, 0);
+                    // So is a coolant change that no block came after, see coolant_sync().
+                    coolant_write(gc_state.modal.coolant);
                 }
             }
             system_clear_exec_state_flag(EXEC_CYCLE_STOP);
@@ -447,6 +863,9 @@ void protocol_exec_rt_system() {
             bit_true(sys.step_control, STEP_CONTROL_UPDATE_SPINDLE_RPM);
             sys.spindle_speed_ovr = last_s_override;
             sys.report_ovr_counter = 0; // Set to report change immediately
+            // The feed of G95 blocks follows the spindle speed
+            plan_update_velocity_profile_parameters();
+            plan_cycle_reinitialize();
         }
         if (rt_exec & EXEC_SPINDLE_OVR_STOP) {
             // Spindle stop override allowed only while in HOLD state.
@@ -487,6 +906,16 @@ void protocol_exec_rt_system() {
         report_realtime_debug();
         sys_rt_exec_debug = 0;
     }
+#endif
+#ifdef SPINDLE_TACH_PIN
+    if (sys.state == STATE_CYCLE)
+        plan_spindle_feed_update();
+#endif
+#ifdef JOG_VELOCITY
+    jog_velocity_update();
+#endif
+#ifdef USE_MPG
+    mpg_update();
 #endif
     // Reload step segment buffer
     if (sys.state & (STATE_CYCLE | STATE_HOLD | STATE_SAFETY_DOOR | STATE_HOMING | STATE_SLEEP | STATE_JOG))
@@ -505,13 +934,6 @@ static void protocol_exec_rt_suspend() {
     float restore_target[N_AXIS];
     float parking_target[N_AXIS];
     float retract_waypoint = PARKING_PULLOUT_INCREMENT;
-    plan_line_data_t plan_data;
-    plan_line_data_t* pl_data = &plan_data;
-    memset(pl_data, 0, sizeof(plan_line_data_t));
-    pl_data->condition = (PL_COND_FLAG_SYSTEM_MOTION | PL_COND_FLAG_NO_FEED_OVERRIDE);
-#ifdef USE_LINE_NUMBERS
-    pl_data->line_number = PARKING_MOTION_LINE_NUMBER;
-#endif
 #endif
     plan_block_t* block = plan_get_current_block();
     uint8_t restore_condition;
@@ -523,6 +945,26 @@ static void protocol_exec_rt_suspend() {
         restore_condition = block->condition;
         restore_spindle_speed = block->spindle_speed;
     }
+#ifdef PARKING_ENABLE
+    // The parking is planned here, while the hold decelerates, so the pull-out is buffered as soon
+    // as the machine has stopped. Only the position is read then. The pull-out and plunge keep the
+    // spindle and coolant of the interrupted motion, and the fast moves run with them off.
+    bool parking_allowed = homing_enable->get() && !laser_mode->get();
+#ifdef ENABLE_PARKING_OVERRIDE_CONTROL
+    parking_allowed = parking_allowed && (sys.override_ctrl == OVERRIDE_PARKING_MOTION);
+#endif
+    plan_line_data_t park_data;
+    memset(&park_data, 0, sizeof(plan_line_data_t));
+    park_data.condition = (PL_COND_FLAG_SYSTEM_MOTION | PL_COND_FLAG_NO_FEED_OVERRIDE);
+#ifdef USE_LINE_NUMBERS
+    park_data.line_number = PARKING_MOTION_LINE_NUMBER;
+#endif
+    plan_line_data_t pullout_data = park_data;
+    park_data.feed_rate = PARKING_RATE;
+    pullout_data.feed_rate = PARKING_PULLOUT_RATE;
+    pullout_data.condition |= (restore_condition & PL_COND_ACCESSORY_MASK);
+    pullout_data.spindle_speed = restore_spindle_speed;
+#endif
 #ifdef DISABLE_LASER_DURING_HOLD
     if (laser_mode->get())
         system_set_exec_accessory_override_flag(EXEC_SPINDLE_OVR_STOP);
@@ -553,42 +995,27 @@ static void protocol_exec_rt_suspend() {
                     // Execute slow pull-out parking retract motion. Parking requires homing enabled, the
                     // current location not exceeding the parking target location, and laser mode disabled.
                     // NOTE: State is will remain DOOR, until the de-energizing and retract is complete.
-#ifdef ENABLE_PARKING_OVERRIDE_CONTROL
-                    if (homing_enable->get() &&
-                        (parking_target[PARKING_AXIS] < PARKING_TARGET) &&
-                        laser_mode->get() &&
-                        (sys.override_ctrl == OVERRIDE_PARKING_MOTION)) {
-#else
-                        if (homing_enable->get() &&
-                            (parking_target[PARKING_AXIS] < PARKING_TARGET) &&
-                            laser_mode->get()) {
-#endif
+                    if (parking_allowed && (parking_target[PARKING_AXIS] < PARKING_TARGET)) {
                         // Retract spindle by pullout distance. Ensure retraction motion moves away from
                         // the workpiece and waypoint motion doesn't exceed the parking target location.
                         if (parking_target[PARKING_AXIS] < retract_waypoint) {
                             parking_target[PARKING_AXIS] = retract_waypoint;
-                            pl_data->feed_rate = PARKING_PULLOUT_RATE;
-                            pl_data->condition |= (restore_condition & PL_COND_ACCESSORY_MASK); // Retain accessory state
-                            pl_data->spindle_speed = restore_spindle_speed;
-                            mc_parking_motion(parking_target, pl_data);
+                            mc_parking_motion(parking_target, &pullout_data);
                         }
                         // NOTE: Clear accessory state after retract and after an aborted restore motion.
-                        pl_data->condition = (PL_COND_FLAG_SYSTEM_MOTION | PL_COND_FLAG_NO_FEED_OVERRIDE);
-                        pl_data->spindle_speed = 0.0;
-                        spindle->set_state((SPINDLE_DISABLE, 0); // De-energize
-                                              coolant_set_state(COOLANT_DISABLE); // De-energize
-                                              // Execute fast parking retract motion to parking target location.
+                        spindle->set_state(SPINDLE_DISABLE, 0); // De-energize
+                        coolant_set_state(COOLANT_DISABLE); // De-energize
+                        // Execute fast parking retract motion to parking target location.
                         if (parking_target[PARKING_AXIS] < PARKING_TARGET) {
-                        parking_target[PARKING_AXIS] = PARKING_TARGET;
-                            pl_data->feed_rate = PARKING_RATE;
-                            mc_parking_motion(parking_target, pl_data);
+                            parking_target[PARKING_AXIS] = PARKING_TARGET;
+                            mc_parking_motion(parking_target, &park_data);
                         }
                     } else {
                         // Parking motion not possible. Just disable the spindle and coolant.
                         // NOTE: Laser mode does not start a parking motion to ensure the laser stops immediately.
-                        ->set_state((SPINDLE_DISABLE, 0.0); // De-energize
-                            coolant_set_state(COOLANT_DISABLE);     // De-energize
-                        }
+                        spindle->set_state(SPINDLE_DISABLE, 0); // De-energize
+                        coolant_set_state(COOLANT_DISABLE);     // De-energize
+                    }
 #endif
                     sys.suspend &= ~(SUSPEND_RESTART_RETRACT);
                     sys.suspend |= SUSPEND_RETRACT_COMPLETE;
@@ -610,21 +1037,26 @@ static void protocol_exec_rt_suspend() {
                     }
                     // Handles parking restore and safety door resume.
                     if (sys.suspend & SUSPEND_INITIATE_RESTORE) {
+                        bool spindle_restore = gc_state.modal.spindle != SPINDLE_DISABLE && !laser_mode->get();
+                        float spindle_delay = SAFETY_DOOR_SPINDLE_DELAY;
 #ifdef PARKING_ENABLE
                         // Execute fast restore motion to the pull-out position. Parking requires homing enabled.
                         // NOTE: State is will remain DOOR, until the de-energizing and retract is complete.
-#ifdef ENABLE_PARKING_OVERRIDE_CONTROL
-                        if (homing_enable->get() && !laser_mode->get()) &&
-                                (sys.override_ctrl == OVERRIDE_PARKING_MOTION)) {
-#else
-                        if (homing_enable->get() && !laser_mode->get()) {
-#endif
-                            // Check to ensure the motion doesn't move below pull-out position.
-                            if (parking_target[PARKING_AXIS] <= PARKING_TARGET) {
-                                parking_target[PARKING_AXIS] = retract_waypoint;
-                                pl_data->feed_rate = PARKING_RATE;
-                                mc_parking_motion(parking_target, pl_data);
+                        // Check to ensure the motion doesn't move below pull-out position.
+                        if (parking_allowed && parking_target[PARKING_AXIS] <= PARKING_TARGET) {
+#ifdef PARKING_RESTORE_SPINUP
+                            // The spindle comes up to speed while the tool moves down to the pull-out position
+                            uint32_t spinup_ms = millis();
+                            if (spindle_restore) {
+                                spindle->set_state((restore_condition & (PL_COND_FLAG_SPINDLE_CW | PL_COND_FLAG_SPINDLE_CCW)), (uint32_t)restore_spindle_speed);
+                                spindle_restore = false;
                             }
+#endif
+                            parking_target[PARKING_AXIS] = retract_waypoint;
+                            mc_parking_motion(parking_target, &park_data);
+#ifdef PARKING_RESTORE_SPINUP
+                            spindle_delay -= (millis() - spinup_ms) / 1000.0f;
+#endif
                         }
 #endif
                         // Delayed Tasks: Restart spindle and coolant, delay to power-up, then resume cycle.
@@ -635,8 +1067,10 @@ static void protocol_exec_rt_suspend() {
                                     // When in laser mode, ignore spindle spin-up delay. Set to turn on laser when cycle starts.
                                     bit_true(sys.step_control, STEP_CONTROL_UPDATE_SPINDLE_RPM);
                                 } else {
-                                    spindle->set_state((restore_condition & (PL_COND_FLAG_SPINDLE_CW | PL_COND_FLAG_SPINDLE_CCW)), (uint32_t)restore_spindle_speed);
-                                    delay_sec(SAFETY_DOOR_SPINDLE_DELAY, DELAY_MODE_SYS_SUSPEND);
+                                    if (spindle_restore)
+                                        spindle->set_state((restore_condition & (PL_COND_FLAG_SPINDLE_CW | PL_COND_FLAG_SPINDLE_CCW)), (uint32_t)restore_spindle_speed);
+                                    if (!spindle->wait_at_speed(DELAY_MODE_SYS_SUSPEND) && spindle_delay > 0.0f)
+                                        delay_sec(spindle_delay, DELAY_MODE_SYS_SUSPEND);
                                 }
                             }
                         }
@@ -644,28 +1078,18 @@ static void protocol_exec_rt_suspend() {
                             // Block if safety door re-opened during prior restore actions.
                             if (bit_isfalse(sys.suspend, SUSPEND_RESTART_RETRACT)) {
                                 // NOTE: Laser mode will honor this delay. An exhaust system is often controlled by this pin.
-                                coolant_set_state((restore_condition & (PL_COND_FLAG_COOLANT_FLOOD | PL_COND_FLAG_COOLANT_FLOOD)));
+                                coolant_set_state((restore_condition & (PL_COND_FLAG_COOLANT_FLOOD | PL_COND_FLAG_COOLANT_MIST)));
                                 delay_sec(SAFETY_DOOR_COOLANT_DELAY, DELAY_MODE_SYS_SUSPEND);
                             }
                         }
 #ifdef PARKING_ENABLE
                         // Execute slow plunge motion from pull-out position to resume position.
-#ifdef ENABLE_PARKING_OVERRIDE_CONTROL
-                        if (homing_enable->get() && !laser_mode->get()) &&
-                                (sys.override_ctrl == OVERRIDE_PARKING_MOTION)) {
-#else
-                        if (homing_enable->get() && !laser_mode->get()) {
-#endif
-                            // Block if safety door re-opened during prior restore actions.
-                            if (bit_isfalse(sys.suspend, SUSPEND_RESTART_RETRACT)) {
-                                // Regardless if the retract parking motion was a valid/safe motion or not, the
-                                // restore parking motion should logically be valid, either by returning to the
-                                // original position through valid machine space or by not moving at all.
-                                pl_data->feed_rate = PARKING_PULLOUT_RATE;
-                                pl_data->condition |= (restore_condition & PL_COND_ACCESSORY_MASK); // Restore accessory state
-                                pl_data->spindle_speed = restore_spindle_speed;
-                                mc_parking_motion(restore_target, pl_data);
-                            }
+                        // Block if safety door re-opened during prior restore actions.
+                        if (parking_allowed && bit_isfalse(sys.suspend, SUSPEND_RESTART_RETRACT)) {
+                            // Regardless if the retract parking motion was a valid/safe motion or not, the
+                            // restore parking motion should logically be valid, either by returning to the
+                            // original position through valid machine space or by not moving at all.
+                            mc_parking_motion(restore_target, &pullout_data);
                         }
 #endif
                         if (bit_isfalse(sys.suspend, SUSPEND_RESTART_RETRACT)) {
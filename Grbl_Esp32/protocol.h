@@ -25,20 +25,58 @@
 #ifndef protocol_h
 #define protocol_h
 
-// Line buffer size from the serial input stream to be executed.
-// NOTE: Not a problem except for extreme cases, but the line buffer size can be too small
-// and g-code blocks can get truncated. Officially, the g-code standards support up to 256
-// characters. In future versions, this will be increased, when we know how much extra
-// memory space we can invest into here or we re-write the g-code parser not to have this
-// buffer.
-#ifndef LINE_BUFFER_SIZE
-    #define LINE_BUFFER_SIZE 80
+// Lines of the streaming client that can be read ahead while the planner is full.
+#ifndef PROTOCOL_READ_AHEAD_LINES
+    #define PROTOCOL_READ_AHEAD_LINES 8
+#endif
+
+#ifdef BINARY_GCODE_FRAMES
+// Binary g-code frames. A frame can be sent on any client in place of a line:
+//   GC_FRAME_START, length, payload (length bytes), CRC-16 high byte, CRC-16 low byte
+// The CRC is crc16_ccitt() of the length byte and the payload. The payload is an opcode followed
+// by words of GC_FRAME_WORD_SIZE bytes: the letter ('A'-'Z') and its float32 value, little endian.
+// Each frame is answered with ok or error like a line. Realtime commands are not recognized
+// inside a frame, only between frames.
+// The receiving task holds a frame until it is complete, and gives it up if its CRC does not match
+// or if no byte of it comes for GC_FRAME_TIMEOUT_CHARS character times on the serial port (plus the
+// SERIAL_UART_RX_THRESHOLD bytes the UART hands over at once and a tick or two), or for
+// GC_FRAME_TIMEOUT_PACKET_MS on the other clients. A frame given up is answered with error:120,
+// and the bytes after its GC_FRAME_START are read again as ordinary data, realtime commands and
+// all, up to the next GC_FRAME_START. So a sender resynchronizes by waiting out the timeout, and a
+// truncated or corrupt frame cannot hide a reset, feed hold or cycle start for longer than that.
+    #define GC_FRAME_START     0x02 // ASCII STX, which never appears in g-code text
+    #define GC_FRAME_BLOCK     0x01 // Opcode of a g-code block
+    #define GC_FRAME_JOG       0x02 // Opcode of a jog block, as sent with $J=
+    #define GC_FRAME_WORD_SIZE 5
+    #define GC_FRAME_MAX       (2 + 255 + 2)
+    #ifndef GC_FRAME_TIMEOUT_CHARS
+        #define GC_FRAME_TIMEOUT_CHARS 4
+    #endif
+    #ifndef GC_FRAME_TIMEOUT_PACKET_MS
+        #define GC_FRAME_TIMEOUT_PACKET_MS 50
+    #endif
 #endif
 
 // Starts Grbl main loop. It handles all incoming characters from the serial port and executes
 // them as they complete. It is also responsible for finishing the initialization procedures.
 void protocol_main_loop();
 
+// Returns and clears the number of times the input ran dry during a cycle. See $ST.
+uint32_t protocol_take_input_starvations();
+
+// Returns the number of client lines executed since boot
+uint32_t protocol_get_lines_executed();
+
+#ifdef LOOP_PROFILE
+// Reports and resets the main loop iteration time histograms. See $LP.
+void protocol_report_loop_times(uint8_t client);
+#endif
+
+#ifdef PROTOCOL_READ_AHEAD
+// Reads whole lines of the streaming client ahead while a motion waits for the planner.
+void protocol_read_ahead();
+#endif
+
 // Checks and executes a realtime command at various stop points in main program
 void protocol_execute_realtime();
 void protocol_exec_rt_system();
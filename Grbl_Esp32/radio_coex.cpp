@@ -0,0 +1,108 @@
+/*
+  radio_coex.cpp - favors the transport that streams the job over the other radio
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef RADIO_COEX_POLICY
+
+#include <esp_coexist.h>
+
+// During a cycle, the serial task calls the handle() of the transport the job comes from on
+// every loop, and that of the other one every RADIO_COEX_POLL_MS. The reads of the streamed
+// lines are not in handle(), so they are never held. With USB or SD jobs both are held. When
+// both radios are on, the shared antenna is also given to the streaming one first.
+
+static volatile radio_coex_t coex_stream = RADIO_COEX_NONE; // The last client with job lines
+static radio_coex_t coex_favored = RADIO_COEX_NONE;
+static bool coex_cycle = false;
+static uint32_t coex_polled_ms[3];
+static uint32_t coex_deferred[3]; // Polls held, for the report
+
+static const char* const coex_names[] = { "None", "WiFi", "BT" };
+
+void radio_coex_received(uint8_t client) {
+    switch (client) {
+    case CLIENT_WEBUI:
+    case CLIENT_TELNET:
+    case CLIENT_TCP:
+        coex_stream = RADIO_COEX_WIFI;
+        break;
+    case CLIENT_BT:
+        coex_stream = RADIO_COEX_BT;
+        break;
+    default:
+        coex_stream = RADIO_COEX_NONE;
+        break;
+    }
+}
+
+static void coex_prefer(radio_coex_t transport) {
+    if (WiFi.getMode() == WIFI_MODE_NULL || !bt_config.Is_BT_on())
+        return; // One radio has the antenna to itself
+    esp_coex_prefer_t prefer = ESP_COEX_PREFER_BALANCE;
+    if (transport == RADIO_COEX_WIFI)
+        prefer = ESP_COEX_PREFER_WIFI;
+    else if (transport == RADIO_COEX_BT)
+        prefer = ESP_COEX_PREFER_BT;
+    esp_coex_preference_set(prefer);
+}
+
+void radio_coex_update() {
+    bool cycle = sys.state & (STATE_CYCLE | STATE_HOLD);
+#ifdef ENABLE_SD_CARD
+    if (get_sd_state(false) == SDCARD_BUSY_PRINTING)
+        coex_stream = RADIO_COEX_NONE; // Commands from a pendant do not make it the job transport
+#endif
+    if (!cycle) {
+        if (coex_cycle)
+            coex_stream = RADIO_COEX_NONE; // The next job may come from elsewhere
+        coex_cycle = false;
+        if (coex_favored != RADIO_COEX_NONE) {
+            coex_favored = RADIO_COEX_NONE;
+            coex_prefer(RADIO_COEX_NONE);
+        }
+        return;
+    }
+    coex_cycle = true;
+    if (coex_favored != coex_stream) {
+        coex_favored = coex_stream;
+        coex_prefer(coex_favored);
+    }
+}
+
+bool radio_coex_poll(radio_coex_t transport) {
+    if (!coex_cycle || transport == coex_favored)
+        return true;
+    uint32_t now = millis();
+    if (now - coex_polled_ms[transport] < RADIO_COEX_POLL_MS) {
+        coex_deferred[transport]++;
+        return false;
+    }
+    coex_polled_ms[transport] = now;
+    return true;
+}
+
+const char* radio_coex_info() {
+    static char line[96];
+    snprintf(line, sizeof(line), "[MSG:Coex=%s:Stream=%s:Favored=%s:Deferred WiFi=%u:Deferred BT=%u]\r\n",
+             coex_cycle ? "Cycle" : "Idle", coex_names[coex_stream], coex_names[coex_favored],
+             coex_deferred[RADIO_COEX_WIFI], coex_deferred[RADIO_COEX_BT]);
+    return line;
+}
+
+#endif
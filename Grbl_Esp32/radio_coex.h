@@ -0,0 +1,53 @@
+/*
+  radio_coex.h - favors the transport that streams the job over the other radio
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef radio_coex_h
+#define radio_coex_h
+
+#if defined(RADIO_COEX_POLICY) && !(defined(ENABLE_WIFI) && defined(ENABLE_BLUETOOTH))
+    #error "RADIO_COEX_POLICY needs ENABLE_WIFI and ENABLE_BLUETOOTH"
+#endif
+
+#ifdef RADIO_COEX_POLICY
+
+// How often the handle() of a transport that does not stream the job is called during a cycle
+#ifndef RADIO_COEX_POLL_MS
+    #define RADIO_COEX_POLL_MS 50
+#endif
+
+typedef enum : uint8_t {
+    RADIO_COEX_NONE = 0, // Not in a cycle, or the job comes over USB or from the SD card
+    RADIO_COEX_WIFI,     // WebUI, telnet and the TCP stream, also over Ethernet
+    RADIO_COEX_BT,
+} radio_coex_t;
+
+// Notes the client that sent job lines. Called by serial_commit().
+void radio_coex_received(uint8_t client);
+
+// Follows the machine state, once per loop of the serial task
+void radio_coex_update();
+
+// True when the handle() of transport is due
+bool radio_coex_poll(radio_coex_t transport);
+
+// The state, as a [MSG:] line for $I
+const char* radio_coex_info();
+
+#endif
+
+#endif
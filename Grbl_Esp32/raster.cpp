@@ -0,0 +1,120 @@
+/*
+  raster.cpp - laser raster lines with a power value per pixel
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef LASER_RASTER
+
+#include "spsc_ring.h"
+
+// A raster job streams a $R= line (or several, each adding pixels) before each G1 raster motion:
+//   $R=<base64 of (count, power) pairs>
+//   G1 X50 F6000
+// The staged pixels are spread over that motion, which becomes a single planner block, and the
+// stepper ISR sets the laser power as it crosses from one pixel to the next. The power scales
+// the spindle speed of the block, so S, M4 and the spindle override still apply.
+
+// Queued lines. The planner is the producer and the stepper ISR the consumer.
+static raster_line_t raster_lines[RASTER_LINE_COUNT];
+static SPSCRing<raster_line_t> raster_ring;
+
+static raster_line_t raster_staged; // Collected by $R= commands for the next motion
+
+void raster_reset() {
+    raster_ring.init(raster_lines, RASTER_LINE_COUNT);
+    raster_staged.pixels = 0;
+}
+
+// Returns the 6-bit value of a base64 character, or -1 if it is not one.
+static int8_t raster_base64_value(char c) {
+    if (c >= 'A' && c <= 'Z')
+        return c - 'A';
+    if (c >= 'a' && c <= 'z')
+        return c - 'a' + 26;
+    if (c >= '0' && c <= '9')
+        return c - '0' + 52;
+    if (c == '+')
+        return 62;
+    if (c == '/')
+        return 63;
+    return -1;
+}
+
+uint8_t raster_stage(const char* data) {
+    if (data == NULL)
+        return STATUS_INVALID_STATEMENT;
+    uint16_t pixels = raster_staged.pixels;
+    uint32_t bits = 0;
+    uint8_t bit_count = 0;
+    uint8_t run = 0; // Pixel count of the pair being decoded, 0 when a count comes next
+    for (; *data != '\0' && *data != '='; data++) {
+        int8_t value = raster_base64_value(*data);
+        if (value < 0)
+            return STATUS_BAD_RASTER;
+        bits = (bits << 6) | value;
+        bit_count += 6;
+        if (bit_count < 8)
+            continue;
+        bit_count -= 8;
+        uint8_t byte = (bits >> bit_count) & 0xFF;
+        if (run == 0) {
+            if (byte == 0)
+                return STATUS_BAD_RASTER;
+            run = byte;
+            continue;
+        }
+        if (pixels + run > RASTER_MAX_PIXELS)
+            return STATUS_BAD_RASTER;
+        memset(&raster_staged.power[pixels], byte, run);
+        pixels += run;
+        run = 0;
+    }
+    if (run != 0)
+        return STATUS_BAD_RASTER; // A count without its power
+    raster_staged.pixels = pixels; // Nothing is added unless the whole value is good
+    return STATUS_OK;
+}
+
+uint16_t raster_staged_pixels() {
+    return raster_staged.pixels;
+}
+
+void raster_clear_staged() {
+    raster_staged.pixels = 0;
+}
+
+bool raster_queue_full() {
+    return raster_staged.pixels != 0 && raster_ring.full();
+}
+
+raster_line_t* raster_queue_staged() {
+    if (raster_staged.pixels == 0)
+        return NULL;
+    raster_line_t* line = raster_ring.producer_slot();
+    line->pixels = raster_staged.pixels;
+    memcpy(line->power, raster_staged.power, raster_staged.pixels);
+    raster_ring.push();
+    raster_staged.pixels = 0;
+    return line;
+}
+
+void IRAM_ATTR raster_release() {
+    raster_ring.pop();
+}
+
+#endif
@@ -0,0 +1,62 @@
+/*
+  raster.h - laser raster lines with a power value per pixel
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef raster_h
+#define raster_h
+
+// The most pixels of one raster line.
+#ifndef RASTER_MAX_PIXELS
+    #define RASTER_MAX_PIXELS 1024
+#endif
+
+// The number of raster lines that can be queued with their planner blocks. The stepper holds on
+// to the line it ran last until the next raster line starts, so at least 3 are needed.
+#ifndef RASTER_LINE_COUNT
+    #define RASTER_LINE_COUNT 4
+#endif
+
+// The pixel powers of a raster line, 0-255, spread evenly over the length of its planner block.
+typedef struct {
+    uint16_t pixels;
+    uint8_t power[RASTER_MAX_PIXELS];
+} raster_line_t;
+
+// Empties the raster line queue and drops the staged pixels. Called with the planner reset.
+void raster_reset();
+
+// Decodes the value of a $R= command and adds its pixels to the staged line. The value is base64
+// of (count, power) byte pairs, each a run of count pixels (1-255) at power (0-255).
+uint8_t raster_stage(const char* data);
+
+// Returns the number of pixels staged for the next G1 motion.
+uint16_t raster_staged_pixels();
+
+// Drops the staged pixels.
+void raster_clear_staged();
+
+// Returns true if there are staged pixels and the queue has no room for them yet.
+bool raster_queue_full();
+
+// Moves the staged pixels into the queue and returns the queued line, or NULL if none are staged.
+// Called by the planner for the block of the motion. Must not be called if raster_queue_full().
+raster_line_t* raster_queue_staged();
+
+// Releases the oldest queued line. Called by the stepper ISR when a later raster line starts.
+void raster_release();
+
+#endif
@@ -47,6 +47,10 @@
 */
 
 #include "grbl.h"
+#include <esp_heap_caps.h>
+#if defined (ENABLE_WIFI) && defined(ENABLE_HTTP)
+    #include "web_server.h"
+#endif
 #ifdef REPORT_HEAP
 EspClass esp;
 #endif
@@ -55,10 +59,18 @@ EspClass esp;
 // this is a generic send function that everything should use, so interfaces could be added (Bluetooth, etc)
 void grbl_send(uint8_t client, const char* text) {
     if (client == CLIENT_INPUT) return;
+#ifdef CLIENT_TX_QUEUES
+    if (serial_tx_queue(client, (const uint8_t*)text, strlen(text), false))
+        return;
+#endif
 #ifdef ENABLE_BLUETOOTH
     if (SerialBT.hasClient() && (client == CLIENT_BT || client == CLIENT_ALL)) {
+#ifdef BT_STREAM
+        bt_config.write((const uint8_t*)text, strlen(text));
+#else
         SerialBT.print(text);
         //delay(10); // possible fix for dropped characters
+#endif
     }
 #endif
 #if defined (ENABLE_WIFI) && defined(ENABLE_HTTP) && defined(ENABLE_SERIAL2SOCKET_OUT)
@@ -68,9 +80,58 @@ void grbl_send(uint8_t client, const char* text) {
 #if defined (ENABLE_WIFI) && defined(ENABLE_TELNET)
     if (client == CLIENT_TELNET || client == CLIENT_ALL)
         telnet_server.write((const uint8_t*)text, strlen(text));
+#endif
+#if defined (ENABLE_WIFI) && defined(TCP_STREAM_SERVER)
+    if (client == CLIENT_TCP || client == CLIENT_ALL)
+        tcp_stream_server.write((const uint8_t*)text, strlen(text));
 #endif
     if (client == CLIENT_SERIAL || client == CLIENT_ALL)
-        Serial.print(text);
+        serial_uart_write((const uint8_t*)text, strlen(text));
+}
+
+void grbl_write(uint8_t client, const uint8_t* data, size_t len) {
+    if (client == CLIENT_INPUT) return;
+#ifdef CLIENT_TX_QUEUES
+    if (serial_tx_queue(client, data, len, false))
+        return;
+#endif
+    grbl_write_direct(client, data, len);
+}
+
+void grbl_write_droppable(uint8_t client, const uint8_t* data, size_t len) {
+    if (client == CLIENT_INPUT) return;
+#ifdef CLIENT_TX_QUEUES
+    if (serial_tx_queue(client, data, len, true))
+        return;
+#endif
+    grbl_write_direct(client, data, len);
+}
+
+void grbl_write_direct(uint8_t client, const uint8_t* data, size_t len) {
+    if (client == CLIENT_INPUT) return;
+#ifdef ENABLE_BLUETOOTH
+    if (SerialBT.hasClient() && (client == CLIENT_BT || client == CLIENT_ALL)) {
+#ifdef BT_STREAM
+        bt_config.write(data, len);
+#else
+        SerialBT.write(data, len);
+#endif
+    }
+#endif
+#if defined (ENABLE_WIFI) && defined(ENABLE_HTTP) && defined(ENABLE_SERIAL2SOCKET_OUT)
+    if (client == CLIENT_WEBUI || client == CLIENT_ALL)
+        Serial2Socket.write(data, len);
+#endif
+#if defined (ENABLE_WIFI) && defined(ENABLE_TELNET)
+    if (client == CLIENT_TELNET || client == CLIENT_ALL)
+        telnet_server.write(data, len);
+#endif
+#if defined (ENABLE_WIFI) && defined(TCP_STREAM_SERVER)
+    if (client == CLIENT_TCP || client == CLIENT_ALL)
+        tcp_stream_server.write(data, len);
+#endif
+    if (client == CLIENT_SERIAL || client == CLIENT_ALL)
+        serial_uart_write(data, len);
 }
 
 // This is a formating version of the grbl_send(CLIENT_ALL,...) function that work like printf
@@ -82,7 +143,7 @@ void grbl_sendf(uint8_t client, const char* format, ...) {
     va_list copy;
     va_start(arg, format);
     va_copy(copy, arg);
-    size_t len = vsnprintf(NULL, 0, format, arg);
+    size_t len = vsnprintf(NULL, 0, format, copy);
     va_end(copy);
     if (len >= sizeof(loc_buf)) {
         temp = new char[len + 1];
@@ -105,7 +166,7 @@ void grbl_msg_sendf(uint8_t client, uint8_t level, const char* format, ...) {
     va_list copy;
     va_start(arg, format);
     va_copy(copy, arg);
-    size_t len = vsnprintf(NULL, 0, format, arg);
+    size_t len = vsnprintf(NULL, 0, format, copy);
     va_end(copy);
     if (len >= sizeof(loc_buf)) {
         temp = new char[len + 1];
@@ -133,7 +194,7 @@ void grbl_notifyf(const char* title, const char* format, ...) {
     va_list copy;
     va_start(arg, format);
     va_copy(copy, arg);
-    size_t len = vsnprintf(NULL, 0, format, arg);
+    size_t len = vsnprintf(NULL, 0, format, copy);
     va_end(copy);
     if (len >= sizeof(loc_buf)) {
         temp = new char[len + 1];
@@ -166,6 +227,121 @@ static void report_util_axis_values(float* axis_value, char* rpt) {
     }
 }
 
+// Builds a report line in a buffer, appending at a tracked end so nothing is scanned twice. Text
+// that does not fit is dropped, so the line is cut short rather than overflowing the buffer.
+typedef struct {
+    char* pos;
+    char* end; // Last byte of the buffer, kept for the terminating null
+} report_builder_t;
+
+static void report_builder_init(report_builder_t* rb, char* buffer, size_t size) {
+    rb->pos = buffer;
+    rb->end = buffer + size - 1;
+    *rb->pos = '\0';
+}
+
+static void report_builder_char(report_builder_t* rb, char c) {
+    if (rb->pos < rb->end) {
+        *rb->pos++ = c;
+        *rb->pos = '\0';
+    }
+}
+
+static void report_builder_str(report_builder_t* rb, const char* text) {
+    while (*text && rb->pos < rb->end)
+        *rb->pos++ = *text++;
+    *rb->pos = '\0';
+}
+
+static void report_builder_uint(report_builder_t* rb, uint32_t value) {
+    char digits[10];
+    uint8_t count = 0;
+    do {
+        digits[count++] = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+    while (count)
+        report_builder_char(rb, digits[--count]);
+}
+
+static void report_builder_int(report_builder_t* rb, int32_t value) {
+    if (value < 0) {
+        report_builder_char(rb, '-');
+        report_builder_uint(rb, -(uint32_t)value);
+    } else
+        report_builder_uint(rb, value);
+}
+
+// Appends value with decimals (0-4) fractional digits, exactly as printf("%.*f") does. The value
+// is m * 2^e, so m * 10^decimals is an exact integer and only the final shift needs rounding, half
+// to even like printf. Values that do not fit the integer math fall back to printf.
+static void report_builder_float(report_builder_t* rb, double value, uint8_t decimals) {
+    static const uint16_t pow10[] = { 1, 10, 100, 1000, 10000 };
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    int16_t exponent = (bits >> 52) & 0x7FF;
+    uint64_t scaled = bits & 0xFFFFFFFFFFFFFULL;
+    if (exponent) {
+        scaled |= 1ULL << 52;
+        exponent -= 1075; // value = scaled * 2^exponent
+    } else
+        exponent = -1074; // Zero or denormal
+    if (scaled) {
+        // Values that came from a float have at most 24 significant bits.
+        uint8_t zeros = __builtin_ctzll(scaled);
+        scaled >>= zeros;
+        exponent += zeros;
+    }
+    bool fits = (exponent < 32) && (scaled < (1ULL << 60) / pow10[decimals]);
+    if (fits) {
+        scaled *= pow10[decimals]; // Under 2^60
+        if (exponent >= 0) {
+            fits = (scaled >> (32 - exponent)) == 0;
+            scaled <<= exponent;
+        } else if (exponent < -60)
+            scaled = 0; // Under one half
+        else {
+            uint8_t shift = -exponent;
+            uint64_t half = 1ULL << (shift - 1);
+            uint64_t rest = scaled & ((half << 1) - 1);
+            scaled >>= shift;
+            if (rest > half || (rest == half && (scaled & 1)))
+                scaled++;
+            fits = (scaled <= 0xFFFFFFFF);
+        }
+    }
+    if (!fits) {
+        char text[48];
+        snprintf(text, sizeof(text), "%.*f", decimals, value);
+        report_builder_str(rb, text);
+        return;
+    }
+    if (bits >> 63)
+        report_builder_char(rb, '-'); // printf keeps the sign of negative values rounded to zero
+    uint32_t whole = scaled;
+    report_builder_uint(rb, whole / pow10[decimals]);
+    if (decimals) {
+        report_builder_char(rb, '.');
+        uint32_t fraction = whole % pow10[decimals];
+        for (uint8_t digit = decimals; digit--;)
+            report_builder_char(rb, '0' + (fraction / pow10[digit]) % 10);
+    }
+}
+
+// Appends the axis values like report_util_axis_values().
+static void report_builder_axis_values(report_builder_t* rb, float* axis_value) {
+    bool inches = report_inches->get();
+    float unit_conv = 1.0 / MM_PER_INCH;
+    for (uint8_t idx = 0; idx < N_AXIS; idx++) {
+        if (inches)
+            report_builder_float(rb, axis_value[idx] * unit_conv, 4); // Report inches to 4 decimals
+        else
+            report_builder_float(rb, axis_value[idx], 3); // Report mm to 3 decimals
+        if (idx < (N_AXIS - 1))
+            report_builder_char(rb, ',');
+    }
+}
+
 void get_state(char* foo) {
     // pad them to same length
     switch (sys.state) {
@@ -191,10 +367,17 @@ void get_state(char* foo) {
 void report_status_message(uint8_t status_code, uint8_t client) {
     switch (status_code) {
     case STATUS_OK: // STATUS_OK
+#if defined(TCP_STREAM_SERVER) && defined(TCP_STREAM_QUIET_OK)
+        if (client == CLIENT_TCP)
+            break; // The TCP window paces the sender
+#endif
 #ifdef ENABLE_SD_CARD
-        if (get_sd_state(false) == SDCARD_BUSY_PRINTING)
+        if (get_sd_state(false) == SDCARD_BUSY_PRINTING) {
             SD_ready_next = true; // flag so system_execute_line() will send the next line
-        else
+#ifdef REPORT_SD_LINE_OK
+            grbl_send(client, "ok\r\n");
+#endif
+        } else
             grbl_send(client, "ok\r\n");
 #else
         grbl_send(client, "ok\r\n");
@@ -212,6 +395,9 @@ void report_status_message(uint8_t status_code, uint8_t client) {
                 grbl_notifyf("SD print error", "Error:%d during SD file at line: %d", status_code, sd_get_current_line_number());
                 grbl_sendf(CLIENT_ALL, "error:%d in SD file at line %d\r\n", status_code, sd_get_current_line_number());
                 closeFile();
+#ifdef SD_JOB_QUEUE
+                sd_queue_clear();
+#endif
             }
             return;
         }
@@ -289,7 +475,7 @@ void report_probe_parameters(uint8_t client) {
     char temp[60];
     strcpy(probe_rpt, "[PRB:"); // initialize the string with the first characters
     // get the machine position and put them into a string and append to the probe report
-    system_convert_array_steps_to_mpos(print_position, sys_probe_position);
+    probe_get_position(print_position);
     report_util_axis_values(print_position, temp);
     strcat(probe_rpt, temp);
     // add the success indicator and add closing characters
@@ -346,10 +532,12 @@ void report_ngc_parameters(uint8_t client) {
 // Print current gcode parser mode state
 void report_gcode_modes(uint8_t client) {
     char temp[20];
-    char modes_rpt[75];
+    char modes_rpt[80];
     strcpy(modes_rpt, "[GC:G");
     if (gc_state.modal.motion >= MOTION_MODE_PROBE_TOWARD)
         sprintf(temp, "38.%d", gc_state.modal.motion - (MOTION_MODE_PROBE_TOWARD - 2));
+    else if (gc_state.modal.motion == MOTION_MODE_QUADRATIC_SPLINE)
+        strcpy(temp, "5.1");
     else
         sprintf(temp, "%d", gc_state.modal.motion);
     strcat(modes_rpt, temp);
@@ -361,7 +549,9 @@ void report_gcode_modes(uint8_t client) {
     strcat(modes_rpt, temp);
     sprintf(temp, " G%d", gc_state.modal.distance + 90);
     strcat(modes_rpt, temp);
-    sprintf(temp, " G%d", 94 - gc_state.modal.feed_rate);
+    sprintf(temp, " G%d", (gc_state.modal.feed_rate == FEED_RATE_MODE_UNITS_PER_REV) ? 95 : 94 - gc_state.modal.feed_rate);
+    strcat(modes_rpt, temp);
+    sprintf(temp, " G%d", gc_state.modal.retract + 98);
     strcat(modes_rpt, temp);
     if (gc_state.modal.program_flow) {
         //report_util_gcode_modes_M();
@@ -416,7 +606,7 @@ void report_execute_startup_message(const char* line, uint8_t status_code, uint8
 
 // Prints build info line
 void report_build_info(char* line, uint8_t client) {
-    char build_info[50];
+    char build_info[80];
     strcpy(build_info, "[VER:" GRBL_VERSION "." GRBL_VERSION_BUILD ":");
     strcat(build_info, line);
     strcat(build_info, "]\r\n[OPT:");
@@ -428,7 +618,7 @@ void report_build_info(char* line, uint8_t client) {
 // #ifdef COREXY
 //     strcat(build_info, "C");
 // #endif
-if(machineType->get() == MACHINE_COREXY)
+if (kinematics_mixed())
 {
     strcat(build_info, "C");
 }
@@ -477,6 +667,10 @@ if(machineType->get() == MACHINE_COREXY)
 #ifndef FORCE_BUFFER_SYNC_DURING_WCO_CHANGE // NOTE: Shown when disabled.
     strcat(build_info, "W");
 #endif
+    // Planner blocks and receive buffer size, as in Grbl 1.1, so senders can size their pipelines.
+    char sizes[16];
+    sprintf(sizes, ",%d,%d", plan_get_block_buffer_size(), serial_get_rx_buffer_size(client < CLIENT_COUNT ? client : CLIENT_SERIAL));
+    strcat(build_info, sizes);
     // NOTE: Compiled values, like override increments/max/min values, may be added at some point later.
     // These will likely have a comma delimiter to separate them.
     strcat(build_info, "]\r\n");
@@ -485,9 +679,15 @@ if(machineType->get() == MACHINE_COREXY)
 #if defined (ENABLE_WIFI)
     grbl_send(client, (char*)wifi_config.info());
 #endif
+#if defined (ENABLE_ETHERNET)
+    grbl_send(client, (char*)eth_config.info());
+#endif
 #if defined (ENABLE_BLUETOOTH)
     grbl_send(client, (char*)bt_config.info());
 #endif
+#ifdef RADIO_COEX_POLICY
+    grbl_send(client, (char*)radio_coex_info());
+#endif
 }
 
 // Prints the character string line Grbl has received from the user, which has been pre-parsed,
@@ -496,52 +696,92 @@ void report_echo_line_received(char* line, uint8_t client) {
     grbl_sendf(client, "[echo: %s]\r\n", line);
 }
 
+#ifdef USE_FWD_KINEMATIC
+// forward_kinematics() costs trig calls on every status report, and an idle machine reports the
+// same position over and over. So the last result is kept with the step snapshot and the work
+// position it came from, and served again while neither changes.
+// NOTE: Reports are built by the serial and web tasks too. The lock covers the copies only, and
+// the transform runs outside it.
+static portMUX_TYPE fwd_kinematics_cache_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool fwd_kinematics_cached = false;
+static int32_t fwd_kinematics_steps[N_AXIS];
+static float fwd_kinematics_position[N_AXIS];
+static float fwd_kinematics_result[N_AXIS];
+
+static void report_forward_kinematics(float* position, const int32_t* steps) {
+    float work_position[N_AXIS];
+    memcpy(work_position, position, sizeof(work_position));
+    bool hit;
+    portENTER_CRITICAL(&fwd_kinematics_cache_lock);
+    hit = fwd_kinematics_cached && memcmp(steps, fwd_kinematics_steps, sizeof(fwd_kinematics_steps)) == 0 &&
+          memcmp(position, fwd_kinematics_position, sizeof(fwd_kinematics_position)) == 0;
+    if (hit)
+        memcpy(position, fwd_kinematics_result, sizeof(fwd_kinematics_result));
+    portEXIT_CRITICAL(&fwd_kinematics_cache_lock);
+    if (hit)
+        return;
+    forward_kinematics(position);
+    portENTER_CRITICAL(&fwd_kinematics_cache_lock);
+    memcpy(fwd_kinematics_steps, steps, sizeof(fwd_kinematics_steps));
+    memcpy(fwd_kinematics_position, work_position, sizeof(fwd_kinematics_position));
+    memcpy(fwd_kinematics_result, position, sizeof(fwd_kinematics_result));
+    fwd_kinematics_cached = true;
+    portEXIT_CRITICAL(&fwd_kinematics_cache_lock);
+}
+#endif
+
 // Prints real-time data. This function grabs a real-time snapshot of the stepper subprogram
 // and the actual location of the CNC machine. Users may change the following function to their
 // specific needs, but the desired real-time data report must be as short as possible. This is
 // requires as it minimizes the computational overhead and allows grbl to keep running smoothly,
 // especially during g-code programs with fast, short line segments and high frequency reports (5-20Hz).
-void report_realtime_status(uint8_t client) {
+// Builds a status report with the given fields (RT_FIELD_*). The Bf: field is different for each
+// client, so it is left out and *buffer_at is set to where it goes, or REPORT_NO_BUFFER_STATE.
+static void report_build_status(char* status, size_t size, uint8_t fields, size_t* buffer_at) {
+    TRACE_SCOPE(TRACE_STATUS, 0);
     uint8_t idx;
     int32_t current_position[N_AXIS]; // Copy current state of the system position variable
     memcpy(current_position, sys_position, sizeof(sys_position));
     float print_position[N_AXIS];
-    char status[200];
+#if defined(ENABLE_SD_CARD) || defined(STEPPER_ISR_PROFILE)
     char temp[80];
+#endif
+    report_builder_t rb;
+    report_builder_init(&rb, status, size - 3); // Room to close the line
     system_convert_array_steps_to_mpos(print_position, current_position);
     // Report current machine state and sub-states
-    strcpy(status, "<");
+    report_builder_char(&rb, '<');
     switch (sys.state) {
-    case STATE_IDLE: strcat(status, "Idle"); break;
-    case STATE_CYCLE: strcat(status, "Run"); break;
+    case STATE_IDLE: report_builder_str(&rb, "Idle"); break;
+    case STATE_CYCLE: report_builder_str(&rb, "Run"); break;
     case STATE_HOLD:
         if (!(sys.suspend & SUSPEND_JOG_CANCEL)) {
-            strcat(status, "Hold:");
-            if (sys.suspend & SUSPEND_HOLD_COMPLETE)  strcat(status, "0");   // Ready to resume
-            else  strcat(status, "1");   // Actively holding
+            report_builder_str(&rb, "Hold:");
+            if (sys.suspend & SUSPEND_HOLD_COMPLETE)  report_builder_str(&rb, "0");   // Ready to resume
+            else  report_builder_str(&rb, "1");   // Actively holding
             break;
         } // Continues to print jog state during jog cancel.
-    case STATE_JOG: strcat(status, "Jog"); break;
-    case STATE_HOMING: strcat(status, "Home"); break;
-    case STATE_ALARM: strcat(status, "Alarm"); break;
-    case STATE_CHECK_MODE: strcat(status, "Check"); break;
+    case STATE_JOG: report_builder_str(&rb, "Jog"); break;
+    case STATE_HOMING: report_builder_str(&rb, "Home"); break;
+    case STATE_ALARM: report_builder_str(&rb, "Alarm"); break;
+    case STATE_CHECK_MODE: report_builder_str(&rb, "Check"); break;
     case STATE_SAFETY_DOOR:
-        strcat(status, "Door:");
+        report_builder_str(&rb, "Door:");
         if (sys.suspend & SUSPEND_INITIATE_RESTORE) {
-            strcat(status, "3"); // Restoring
+            report_builder_str(&rb, "3"); // Restoring
         } else {
             if (sys.suspend & SUSPEND_RETRACT_COMPLETE) {
                 if (sys.suspend & SUSPEND_SAFETY_DOOR_AJAR) {
-                    strcat(status, "1"); // Door ajar
+                    report_builder_str(&rb, "1"); // Door ajar
                 } else
-                    strcat(status, "0");
+                    report_builder_str(&rb, "0");
                 // Door closed and ready to resume
             } else {
-                strcat(status, "2"); // Retracting
+                report_builder_str(&rb, "2"); // Retracting
             }
         }
         break;
-    case STATE_SLEEP: strcat(status, "Sleep"); break;
+    case STATE_SLEEP: report_builder_str(&rb, "Sleep"); break;
     }
     float wco[N_AXIS];
     if (bit_isfalse(status_mask->get(), BITFLAG_RT_STATUS_POSITION_TYPE) ||
@@ -556,136 +796,501 @@ void report_realtime_status(uint8_t client) {
     }
     // Report machine position
     if (bit_istrue(status_mask->get(), BITFLAG_RT_STATUS_POSITION_TYPE))
-        strcat(status, "|MPos:");
+        report_builder_str(&rb, "|MPos:");
     else {
 #ifdef USE_FWD_KINEMATIC
-        forward_kinematics(print_position);
+        report_forward_kinematics(print_position, current_position);
 #endif
-        strcat(status, "|WPos:");
-    }
-    report_util_axis_values(print_position, temp);
-    strcat(status, temp);
-    // Returns planner and serial read buffer states.
-#ifdef REPORT_FIELD_BUFFER_STATE
-    if (bit_istrue(status_mask->get(), BITFLAG_RT_STATUS_BUFFER_STATE)) {
-        int bufsize = DEFAULTBUFFERSIZE;
-#if defined (ENABLE_WIFI) && defined(ENABLE_TELNET)
-        if (client == CLIENT_TELNET)
-            bufsize = telnet_server.get_rx_buffer_available();
-#endif //ENABLE_WIFI && ENABLE_TELNET
-#if defined(ENABLE_BLUETOOTH)
-        if (client == CLIENT_BT) {
-            //TODO FIXME
-            bufsize = 512 - SerialBT.available();
-        }
-#endif //ENABLE_BLUETOOTH
-        if (client == CLIENT_SERIAL)
-            bufsize = serial_get_rx_buffer_available(CLIENT_SERIAL);
-        sprintf(temp, "|Bf:%d,%d", plan_get_block_buffer_available(), bufsize);
-        strcat(status, temp);
+        report_builder_str(&rb, "|WPos:");
     }
-#endif
+    report_builder_axis_values(&rb, print_position);
+    // The planner and serial read buffer states go here. See report_send_status().
+    *buffer_at = (fields & RT_FIELD_BUFFER_STATE) ? rb.pos - status : REPORT_NO_BUFFER_STATE;
 #ifdef USE_LINE_NUMBERS
 #ifdef REPORT_FIELD_LINE_NUMBERS
     // Report current line number
-    plan_block_t* cur_block = plan_get_current_block();
+    plan_block_t* cur_block = (fields & RT_FIELD_LINE_NUMBER) ? plan_get_current_block() : NULL;
     if (cur_block != NULL) {
         uint32_t ln = cur_block->line_number;
         if (ln > 0) {
-            sprintf(temp, "|Ln:%d", ln);
-            strcat(status, temp);
+            report_builder_str(&rb, "|Ln:");
+            report_builder_int(&rb, ln);
         }
     }
 #endif
 #endif
     // Report realtime feed speed
 #ifdef REPORT_FIELD_CURRENT_FEED_SPEED
-    if (report_inches->get())
-        sprintf(temp, "|FS:%.1f,%d", st_get_realtime_rate()/ MM_PER_INCH, sys.spindle_speed);
-    else
-        sprintf(temp, "|FS:%.0f,%d", st_get_realtime_rate(), sys.spindle_speed);
-    strcat(status, temp);
+    if (fields & RT_FIELD_FEED_SPEED) {
+        report_builder_str(&rb, "|FS:");
+        if (report_inches->get())
+            report_builder_float(&rb, st_get_realtime_rate() / MM_PER_INCH, 1);
+        else
+            report_builder_float(&rb, st_get_realtime_rate(), 0);
+        report_builder_char(&rb, ',');
+        report_builder_int(&rb, sys.spindle_speed);
+    }
 #endif
 #ifdef REPORT_FIELD_PIN_STATE
     uint8_t lim_pin_state = limits_get_state();
     uint8_t ctrl_pin_state = system_control_get_state();
     uint8_t prb_pin_state = probe_get_state();
-    if (lim_pin_state | ctrl_pin_state | prb_pin_state) {
-        strcat(status, "|Pn:");
-        if (prb_pin_state)  strcat(status, "P");
+    if ((fields & RT_FIELD_PIN_STATE) && (lim_pin_state | ctrl_pin_state | prb_pin_state)) {
+        report_builder_str(&rb, "|Pn:");
+        if (prb_pin_state)  report_builder_str(&rb, "P");
         if (lim_pin_state) {
-            if (bit_istrue(lim_pin_state, bit(X_AXIS)))  strcat(status, "X");
-            if (bit_istrue(lim_pin_state, bit(Y_AXIS)))  strcat(status, "Y");
-            if (bit_istrue(lim_pin_state, bit(Z_AXIS)))  strcat(status, "Z");
+            if (bit_istrue(lim_pin_state, bit(X_AXIS)))  report_builder_str(&rb, "X");
+            if (bit_istrue(lim_pin_state, bit(Y_AXIS)))  report_builder_str(&rb, "Y");
+            if (bit_istrue(lim_pin_state, bit(Z_AXIS)))  report_builder_str(&rb, "Z");
 #if (N_AXIS > A_AXIS)
-            if (bit_istrue(lim_pin_state, bit(A_AXIS)))  strcat(status, "A");
+            if (bit_istrue(lim_pin_state, bit(A_AXIS)))  report_builder_str(&rb, "A");
 #endif
 #if (N_AXIS > B_AXIS)
-            if (bit_istrue(lim_pin_state, bit(B_AXIS)))  strcat(status, "B");
+            if (bit_istrue(lim_pin_state, bit(B_AXIS)))  report_builder_str(&rb, "B");
 #endif
 #if (N_AXIS > C_AXIS)
-            if (bit_istrue(lim_pin_state, bit(C_AXIS)))  strcat(status, "C");
+            if (bit_istrue(lim_pin_state, bit(C_AXIS)))  report_builder_str(&rb, "C");
 #endif
         }
         if (ctrl_pin_state) {
 #ifdef ENABLE_SAFETY_DOOR_INPUT_PIN
-            if (bit_istrue(ctrl_pin_state, CONTROL_PIN_INDEX_SAFETY_DOOR))  strcat(status, "D");
+            if (bit_istrue(ctrl_pin_state, CONTROL_PIN_INDEX_SAFETY_DOOR))  report_builder_str(&rb, "D");
 #endif
-            if (bit_istrue(ctrl_pin_state, CONTROL_PIN_INDEX_RESET))  strcat(status, "R");
-            if (bit_istrue(ctrl_pin_state, CONTROL_PIN_INDEX_FEED_HOLD))  strcat(status, "H");
-            if (bit_istrue(ctrl_pin_state, CONTROL_PIN_INDEX_CYCLE_START))  strcat(status, "S");
+            if (bit_istrue(ctrl_pin_state, CONTROL_PIN_INDEX_RESET))  report_builder_str(&rb, "R");
+            if (bit_istrue(ctrl_pin_state, CONTROL_PIN_INDEX_FEED_HOLD))  report_builder_str(&rb, "H");
+            if (bit_istrue(ctrl_pin_state, CONTROL_PIN_INDEX_CYCLE_START))  report_builder_str(&rb, "S");
         }
     }
 #endif
 #ifdef REPORT_FIELD_WORK_COORD_OFFSET
-    if (sys.report_wco_counter > 0)  sys.report_wco_counter--;
-    else {
-        if (sys.state & (STATE_HOMING | STATE_CYCLE | STATE_HOLD | STATE_JOG | STATE_SAFETY_DOOR)) {
-            sys.report_wco_counter = (REPORT_WCO_REFRESH_BUSY_COUNT - 1); // Reset counter for slow refresh
-        } else  sys.report_wco_counter = (REPORT_WCO_REFRESH_IDLE_COUNT - 1);
-        if (sys.report_ovr_counter == 0)  sys.report_ovr_counter = 1;   // Set override on next report.
-        strcat(status, "|WCO:");
-        report_util_axis_values(wco, temp);
-        strcat(status, temp);
+    if (fields & RT_FIELD_WORK_COORD_OFFSET) {
+        if (sys.report_wco_counter > 0)  sys.report_wco_counter--;
+        else {
+            if (sys.state & (STATE_HOMING | STATE_CYCLE | STATE_HOLD | STATE_JOG | STATE_SAFETY_DOOR)) {
+                sys.report_wco_counter = (REPORT_WCO_REFRESH_BUSY_COUNT - 1); // Reset counter for slow refresh
+            } else  sys.report_wco_counter = (REPORT_WCO_REFRESH_IDLE_COUNT - 1);
+            if (sys.report_ovr_counter == 0)  sys.report_ovr_counter = 1;   // Set override on next report.
+            report_builder_str(&rb, "|WCO:");
+            report_builder_axis_values(&rb, wco);
+        }
     }
 #endif
 #ifdef REPORT_FIELD_OVERRIDES
-    if (sys.report_ovr_counter > 0)  sys.report_ovr_counter--;
-    else {
-        if (sys.state & (STATE_HOMING | STATE_CYCLE | STATE_HOLD | STATE_JOG | STATE_SAFETY_DOOR)) {
-            sys.report_ovr_counter = (REPORT_OVR_REFRESH_BUSY_COUNT - 1); // Reset counter for slow refresh
-        } else  sys.report_ovr_counter = (REPORT_OVR_REFRESH_IDLE_COUNT - 1);
-        sprintf(temp, "|Ov:%d,%d,%d", sys.f_override, sys.r_override, sys.spindle_speed_ovr);
-        strcat(status, temp);
-        uint8_t sp_state =  spindle->get_state();
-        uint8_t cl_state = coolant_get_state();
-        if (sp_state || cl_state) {
-            strcat(status, "|A:");
-            if (sp_state) { // != SPINDLE_STATE_DISABLE
-                if (sp_state == SPINDLE_STATE_CW)  strcat(status, "S");   // CW
-                else  strcat(status, "C");   // CCW
-            }
-            if (cl_state & COOLANT_STATE_FLOOD)  strcat(status, "F");
+    if (fields & RT_FIELD_OVERRIDES) {
+        if (sys.report_ovr_counter > 0)  sys.report_ovr_counter--;
+        else {
+            if (sys.state & (STATE_HOMING | STATE_CYCLE | STATE_HOLD | STATE_JOG | STATE_SAFETY_DOOR)) {
+                sys.report_ovr_counter = (REPORT_OVR_REFRESH_BUSY_COUNT - 1); // Reset counter for slow refresh
+            } else  sys.report_ovr_counter = (REPORT_OVR_REFRESH_IDLE_COUNT - 1);
+            report_builder_str(&rb, "|Ov:");
+            report_builder_uint(&rb, sys.f_override);
+            report_builder_char(&rb, ',');
+            report_builder_uint(&rb, sys.r_override);
+            report_builder_char(&rb, ',');
+            report_builder_uint(&rb, sys.spindle_speed_ovr);
+            uint8_t sp_state =  spindle->get_state();
+            uint8_t cl_state = coolant_get_state();
+            if (sp_state || cl_state) {
+                report_builder_str(&rb, "|A:");
+                if (sp_state) { // != SPINDLE_STATE_DISABLE
+                    if (sp_state == SPINDLE_STATE_CW)  report_builder_str(&rb, "S");   // CW
+                    else  report_builder_str(&rb, "C");   // CCW
+                }
+                if (cl_state & COOLANT_STATE_FLOOD)  report_builder_str(&rb, "F");
 #ifdef COOLANT_MIST_PIN // TODO Deal with M8 - Flood
-            if (cl_state & COOLANT_STATE_MIST)  strcat(status, "M");
+                if (cl_state & COOLANT_STATE_MIST)  report_builder_str(&rb, "M");
 #endif
+            }
         }
     }
 #endif
 #ifdef ENABLE_SD_CARD
-    if (get_sd_state(false) == SDCARD_BUSY_PRINTING) {
-        sprintf(temp, "|SD:%4.2f,", sd_report_perc_complete());
-        strcat(status, temp);
+    if ((fields & RT_FIELD_DIAGNOSTICS) && get_sd_state(false) == SDCARD_BUSY_PRINTING) {
+        report_builder_str(&rb, "|SD:");
+        report_builder_float(&rb, sd_report_perc_complete(), 2);
+        report_builder_char(&rb, ',');
         sd_get_current_filename(temp);
-        strcat(status, temp);
+        report_builder_str(&rb, temp);
+#ifdef SD_ESTIMATE
+        float percent;
+        uint32_t remaining_s;
+        if (sd_estimate_progress(sd_get_current_line_number(), &percent, &remaining_s)) {
+            report_builder_str(&rb, "|ETA:");
+            report_builder_int(&rb, (int32_t)remaining_s);
+        }
+#endif
+    }
+#endif
+#ifdef STEPPER_ISR_PROFILE
+    if (fields & RT_FIELD_DIAGNOSTICS) {
+        st_isr_profile_field(temp);
+        report_builder_str(&rb, temp);
     }
 #endif
 #ifdef REPORT_HEAP
-    sprintf(temp, "|Heap:%d", esp.getHeapSize());
-    strcat(status, temp);
+    if (fields & RT_FIELD_DIAGNOSTICS) {
+        report_builder_str(&rb, "|Heap:");
+        report_builder_int(&rb, esp.getHeapSize());
+    }
+#endif
+    strcpy(rb.pos, ">\r\n");
+}
+
+// Returns the free space in the receive buffer of client, as reported in the Bf: field.
+static int report_rx_buffer_available(uint8_t client) {
+    int bufsize = DEFAULTBUFFERSIZE;
+#if defined (ENABLE_WIFI) && defined(ENABLE_TELNET)
+    if (client == CLIENT_TELNET)
+        bufsize = telnet_server.get_rx_buffer_available();
+#endif //ENABLE_WIFI && ENABLE_TELNET
+#if defined(ENABLE_BLUETOOTH)
+    if (client == CLIENT_BT) {
+#ifdef BT_STREAM
+        bufsize = serial_get_rx_buffer_available(CLIENT_BT) - SerialBT.available();
+#else
+        //TODO FIXME
+        bufsize = 512 - SerialBT.available();
+#endif
+    }
+#endif //ENABLE_BLUETOOTH
+    if (client == CLIENT_SERIAL)
+        bufsize = serial_get_rx_buffer_available(CLIENT_SERIAL);
+    else if (client < CLIENT_COUNT && client != CLIENT_TELNET && client != CLIENT_BT)
+        bufsize = serial_get_rx_buffer_available(client);
+    return bufsize;
+}
+
+// Sends a report from report_build_status() to client, with the client's Bf: field put in.
+static void report_send_status(uint8_t client, const char* status, size_t buffer_at) {
+#ifdef REPORT_FIELD_BUFFER_STATE
+    if (buffer_at != REPORT_NO_BUFFER_STATE && bit_istrue(status_mask->get(), BITFLAG_RT_STATUS_BUFFER_STATE)) {
+        char line[REPORT_STATUS_LINE_SIZE + 16];
+        report_builder_t rb;
+        report_builder_init(&rb, line, sizeof(line));
+        memcpy(line, status, buffer_at);
+        rb.pos += buffer_at;
+        report_builder_str(&rb, "|Bf:");
+        report_builder_uint(&rb, plan_get_block_buffer_available());
+        report_builder_char(&rb, ',');
+        report_builder_int(&rb, report_rx_buffer_available(client));
+        report_builder_str(&rb, status + buffer_at);
+        grbl_write_droppable(client, (const uint8_t*)line, rb.pos - line);
+        return;
+    }
+#endif
+    grbl_write_droppable(client, (const uint8_t*)status, strlen(status));
+}
+
+void report_realtime_status(uint8_t client) {
+    char status[REPORT_STATUS_LINE_SIZE];
+    size_t buffer_at;
+    report_build_status(status, sizeof(status), RT_FIELD_ALL, &buffer_at);
+    report_send_status(client, status, buffer_at);
+}
+
+#if defined(BENCHMARK) || defined(GRBL_NATIVE)
+// Builds the status report of report_realtime_status() without sending it. See bench.cpp.
+void report_format_realtime_status(char* status, size_t size) {
+    size_t buffer_at;
+    report_build_status(status, size, RT_FIELD_ALL, &buffer_at);
+}
+
+// For the comparison with snprintf() in tests/native/test_report.cpp
+void report_format_float(char* text, size_t size, double value, uint8_t decimals) {
+    report_builder_t rb;
+    report_builder_init(&rb, text, size);
+    report_builder_float(&rb, value, decimals);
+}
+#endif
+
+#ifdef REPORT_STATUS_FRAMES
+#define STATUS_FRAME_RX_AT (2 + 17 + 8 * N_AXIS) // Offset of the receive buffer field
+
+static uint16_t status_frame_sequence;
+
+static uint8_t* status_frame_put(uint8_t* pos, uint32_t value, uint8_t size) {
+    while (size--) {
+        *pos++ = value & 0xFF;
+        value >>= 8;
+    }
+    return pos;
+}
+
+// Builds a binary status frame, as described in report.h. The receive buffer field and the CRC
+// are set for each client by status_frame_send().
+static void status_frame_build(uint8_t* frame) {
+    int32_t position[N_AXIS];
+    memcpy(position, sys_position, sizeof(sys_position));
+    uint8_t* pos = frame;
+    *pos++ = STATUS_FRAME_START;
+    *pos++ = STATUS_FRAME_PAYLOAD_SIZE;
+    *pos++ = STATUS_FRAME_TYPE;
+    pos = status_frame_put(pos, status_frame_sequence++, 2);
+    *pos++ = sys.state;
+    *pos++ = sys.suspend;
+    for (uint8_t idx = 0; idx < N_AXIS; idx++)
+        pos = status_frame_put(pos, position[idx], 4);
+    for (uint8_t idx = 0; idx < N_AXIS; idx++) {
+        float wco = gc_state.coord_system[idx] + gc_state.coord_offset[idx];
+        if (idx == TOOL_LENGTH_OFFSET_AXIS)  wco += gc_state.tool_length_offset;
+        pos = status_frame_put(pos, lroundf(wco * axis_settings[idx]->steps_per_mm->get()), 4);
+    }
+    float rate = st_get_realtime_rate();
+    uint32_t rate_bits;
+    memcpy(&rate_bits, &rate, sizeof(rate_bits));
+    pos = status_frame_put(pos, rate_bits, 4);
+    pos = status_frame_put(pos, sys.spindle_speed, 4);
+    *pos++ = sys.f_override;
+    *pos++ = sys.r_override;
+    *pos++ = sys.spindle_speed_ovr;
+    *pos++ = plan_get_block_buffer_available();
+    pos += 2; // Receive buffer, per client
+    int32_t line_number = 0;
+#ifdef USE_LINE_NUMBERS
+    plan_block_t* cur_block = plan_get_current_block();
+    if (cur_block != NULL)
+        line_number = cur_block->line_number;
+#endif
+    pos = status_frame_put(pos, line_number, 4);
+    *pos++ = limits_get_state();
+    *pos++ = system_control_get_state();
+    *pos++ = probe_get_state();
+}
+
+// Sets the receive buffer field and the CRC of a frame from status_frame_build()
+static void status_frame_finish(uint8_t* frame, int rx) {
+    status_frame_put(&frame[STATUS_FRAME_RX_AT], rx < 0 ? 0 : rx, 2);
+    uint16_t crc = crc16_ccitt(&frame[1], STATUS_FRAME_PAYLOAD_SIZE + 1);
+    frame[2 + STATUS_FRAME_PAYLOAD_SIZE] = crc >> 8;
+    frame[3 + STATUS_FRAME_PAYLOAD_SIZE] = crc & 0xFF;
+}
+
+// Sends a frame from status_frame_build() to client.
+static void status_frame_send(uint8_t client, uint8_t* frame) {
+    status_frame_finish(frame, report_rx_buffer_available(client));
+    grbl_write_droppable(client, frame, STATUS_FRAME_SIZE);
+}
+
+void report_status_frame(uint8_t client) {
+    uint8_t frame[STATUS_FRAME_SIZE];
+    status_frame_build(frame);
+    status_frame_send(client, frame);
+}
+
+void report_build_status_frame(uint8_t* frame, int rx_available) {
+    status_frame_build(frame);
+    status_frame_finish(frame, rx_available);
+}
+#endif
+
+#ifdef REPORT_STATUS_PUSH
+// Clients that asked for status reports every interval_ms with $RI=.
+typedef struct {
+    uint32_t interval_ms; // 0 if not subscribed
+    uint32_t next_ms;     // When the next report is due
+    uint8_t fields;
+} report_subscription_t;
+static report_subscription_t report_subscriptions[CLIENT_COUNT];
+
+err_t report_subscribe(uint8_t client, uint32_t interval_ms, uint8_t fields) {
+    if (client >= CLIENT_COUNT)
+        return STATUS_INVALID_STATEMENT;
+#ifdef REPORT_STATUS_FRAMES
+    uint32_t min_interval = (fields & RT_FIELD_FRAME) ? REPORT_PUSH_MIN_FRAME_INTERVAL : REPORT_PUSH_MIN_INTERVAL;
+#else
+    if (fields & RT_FIELD_FRAME)
+        return STATUS_INVALID_STATEMENT;
+    uint32_t min_interval = REPORT_PUSH_MIN_INTERVAL;
+#endif
+    if (interval_ms != 0 && (interval_ms < min_interval || interval_ms > REPORT_PUSH_MAX_INTERVAL))
+        return STATUS_NUMBER_RANGE;
+    report_subscription_t* subscription = &report_subscriptions[client];
+    subscription->interval_ms = 0; // Stopped while it is changed. report_push_status() runs in another task.
+    if (interval_ms == 0)
+        return STATUS_OK;
+    subscription->fields = fields;
+    // Reports are due on multiples of the interval, so clients with the same interval get the
+    // same report.
+    subscription->next_ms = (millis() / interval_ms + 1) * interval_ms;
+    subscription->interval_ms = interval_ms;
+    return STATUS_OK;
+}
+
+uint32_t report_push_status_wait_ms() {
+    uint32_t now = millis();
+    uint32_t wait_ms = UINT32_MAX;
+    for (uint8_t client = 0; client < CLIENT_COUNT; client++) {
+        report_subscription_t* subscription = &report_subscriptions[client];
+        if (subscription->interval_ms == 0)
+            continue;
+        int32_t left = subscription->next_ms - now;
+        wait_ms = MIN(wait_ms, left > 0 ? (uint32_t)left : 0);
+    }
+    return wait_ms;
+}
+
+void report_push_status() {
+    uint32_t now = millis();
+    uint8_t due = 0;
+    for (uint8_t client = 0; client < CLIENT_COUNT; client++) {
+        report_subscription_t* subscription = &report_subscriptions[client];
+        if (subscription->interval_ms == 0 || (int32_t)(now - subscription->next_ms) < 0)
+            continue;
+        due |= bit(client);
+        subscription->next_ms = (now / subscription->interval_ms + 1) * subscription->interval_ms;
+    }
+    // Each set of fields is formatted once and the same line goes to all clients that asked for it.
+    while (due) {
+        uint8_t fields = 0;
+        bool first = true;
+        char status[REPORT_STATUS_LINE_SIZE];
+        size_t buffer_at = REPORT_NO_BUFFER_STATE;
+        for (uint8_t client = 0; client < CLIENT_COUNT; client++) {
+            if (!(due & bit(client)))
+                continue;
+            if (first) {
+                fields = report_subscriptions[client].fields;
+#ifdef REPORT_STATUS_FRAMES
+                if (fields & RT_FIELD_FRAME)
+                    status_frame_build((uint8_t*)status);
+                else
+#endif
+                    report_build_status(status, sizeof(status), fields, &buffer_at);
+                first = false;
+            } else if (report_subscriptions[client].fields != fields)
+                continue;
+#ifdef REPORT_STATUS_FRAMES
+            if (fields & RT_FIELD_FRAME)
+                status_frame_send(client, (uint8_t*)status);
+            else
+#endif
+                report_send_status(client, status, buffer_at);
+            due &= ~bit(client);
+        }
+    }
+}
+#endif
+
+// Reports and clears the starvation counters, to tell where streaming stalls come from: the
+// segment prep (segment underruns), the g-code parsing and planning (planner starvations) or
+// the sender (input starvations).
+void report_starvation_counters(uint8_t client) {
+    uint32_t underruns, starvations;
+    st_take_starvation_counts(&underruns, &starvations);
+    grbl_sendf(client, "[MSG:Starvation segment:%u planner:%u input:%u]\r\n",
+               underruns, starvations, protocol_take_input_starvations());
+}
+
+#ifdef STATIC_MOTION_BUFFERS
+    #define MOTION_BUFFERS_IN "static"
+#else
+    #define MOTION_BUFFERS_IN "heap"
+#endif
+
+static void report_memory_line(uint8_t client, const char* name, size_t bytes, const char* where) {
+    grbl_sendf(client, "[MSG:Memory %s:%u %s]\r\n", name, (uint32_t)bytes, where);
+}
+
+void report_memory_map(uint8_t client) {
+    size_t total = 0;
+    size_t bytes = plan_get_block_buffer_size() * sizeof(plan_block_t);
+    report_memory_line(client, "Planner", bytes, MOTION_BUFFERS_IN);
+    total += bytes;
+    bytes = st_get_buffer_bytes();
+    report_memory_line(client, "Segments", bytes, MOTION_BUFFERS_IN);
+    total += bytes;
+    bytes = 0;
+    for (uint8_t client_num = 0; client_num < CLIENT_COUNT; client_num++)
+        bytes += serial_get_rx_buffer_size(client_num);
+    report_memory_line(client, "ClientRX", bytes, MOTION_BUFFERS_IN);
+    total += bytes;
+#if defined (ENABLE_WIFI) && defined(ENABLE_HTTP)
+    report_memory_line(client, "Serial2Socket", sizeof(Serial2Socket), "static");
+    total += sizeof(Serial2Socket);
+#endif
+#if defined (ENABLE_WIFI) && defined(ENABLE_TELNET)
+    report_memory_line(client, "Telnet", sizeof(telnet_server), "static");
+    total += sizeof(telnet_server);
+#endif
+#if defined (ENABLE_WIFI) && defined(ENABLE_NOTIFICATIONS)
+    report_memory_line(client, "Notifications", sizeof(notificationsservice), "static");
+    total += sizeof(notificationsservice);
+#endif
+#if defined (ENABLE_WIFI) && defined(ENABLE_HTTP) && defined(WEB_REQUEST_ARENA)
+    report_memory_line(client, "WebArena", web_arena.size(), "heap");
+    total += web_arena.size();
+#endif
+    report_memory_line(client, "Total", total, "");
+    grbl_sendf(client, "[MSG:Memory heap free:%u internal:%u largest:%u lowest:%u]\r\n",
+               ESP.getFreeHeap(), heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+               heap_caps_get_largest_free_block(MALLOC_CAP_8BIT), ESP.getMinFreeHeap());
+}
+
+#if (configUSE_TRACE_FACILITY == 1)
+// The run time counters of the last task report, for the CPU shares since then
+#define REPORT_TASKS_MAX 32
+static TaskHandle_t report_task_handles[REPORT_TASKS_MAX];
+static uint32_t report_task_run_times[REPORT_TASKS_MAX];
+static uint8_t report_task_count;
+static uint32_t report_task_total_time;
+
+static int report_task_order(const void* a, const void* b) {
+    return (int)((const TaskStatus_t*)a)->xTaskNumber - (int)((const TaskStatus_t*)b)->xTaskNumber;
+}
+#endif
+
+// Lists the FreeRTOS tasks with their priority, core and the least stack they had free. The CPU
+// share is of one core, since the last report or since the task started, so the tasks of both
+// cores add up to 200%. It needs run time stats in the FreeRTOS config of the core.
+void report_tasks(uint8_t client) {
+#if (configUSE_TRACE_FACILITY == 1)
+    UBaseType_t size = uxTaskGetNumberOfTasks() + 4; // Room for tasks started meanwhile
+    TaskStatus_t* tasks = (TaskStatus_t*)malloc(size * sizeof(TaskStatus_t));
+    if (tasks == NULL) {
+        grbl_sendf(client, "[MSG:Tasks out of memory]\r\n");
+        return;
+    }
+    uint32_t total_time = 0;
+    UBaseType_t count = uxTaskGetSystemState(tasks, size, &total_time);
+    qsort(tasks, count, sizeof(TaskStatus_t), report_task_order); // In the order they started
+    uint32_t elapsed = total_time - report_task_total_time;
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t* task = &tasks[i];
+        char cpu[12] = "-";
+#if (configGENERATE_RUN_TIME_STATS == 1)
+        uint32_t run_time = task->ulRunTimeCounter;
+        for (uint8_t j = 0; j < report_task_count; j++) {
+            if (report_task_handles[j] == task->xHandle) {
+                run_time -= report_task_run_times[j];
+                break;
+            }
+        }
+        if (elapsed)
+            sprintf(cpu, "%.1f%%", run_time * 100.0f / elapsed);
+#endif
+        char core[4] = "-";
+#if (configTASKLIST_INCLUDE_COREID == 1)
+        if (task->xCoreID == tskNO_AFFINITY)
+            strcpy(core, "any");
+        else
+            sprintf(core, "%d", task->xCoreID);
+#endif
+        // On the ESP32 a stack word is a byte
+        grbl_sendf(client, "[MSG:Task %s cpu:%s prio:%u core:%s stack free:%u]\r\n", task->pcTaskName, cpu,
+                   task->uxCurrentPriority, core, task->usStackHighWaterMark * sizeof(StackType_t));
+    }
+#if (configGENERATE_RUN_TIME_STATS == 1)
+    report_task_count = MIN(count, REPORT_TASKS_MAX);
+    for (uint8_t j = 0; j < report_task_count; j++) {
+        report_task_handles[j] = tasks[j].xHandle;
+        report_task_run_times[j] = tasks[j].ulRunTimeCounter;
+    }
+    report_task_total_time = total_time;
+#endif
+    free(tasks);
+#else
+    grbl_sendf(client, "[MSG:Tasks need configUSE_TRACE_FACILITY]\r\n");
 #endif
-    strcat(status, ">\r\n");
-    grbl_send(client, status);
 }
 
 void report_realtime_steps() {
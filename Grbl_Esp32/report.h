@@ -86,6 +86,17 @@
 #define STATUS_AUTHENTICATION_FAILED 110
 #define STATUS_EOL 111
 
+#define STATUS_BAD_FRAME 120 // Binary g-code frame with a bad CRC, opcode or length
+#define STATUS_BAD_RASTER 121 // $R= data that is not base64 of whole (count, power) pairs, or too long
+#define STATUS_SD_COMPILED_MISMATCH 122 // Compiled SD file from another start position or offsets
+#define STATUS_OWORD_SYNTAX 123 // O-word line without a known keyword, or without its matching end
+#define STATUS_OWORD_UNDEFINED 124 // Call of a sub that is neither defined nor a file
+#define STATUS_OWORD_OVERFLOW 125 // O-word store full, or calls and loops nested too deep
+#define STATUS_EXPRESSION_SYNTAX 126 // Unknown operator or function, or unbalanced brackets
+#define STATUS_EXPRESSION_MATH 127 // Division by zero, or a function outside of its domain
+#define STATUS_PARAMETER_INVALID 128 // Parameter number that does not exist, or is read-only
+#define STATUS_SD_QUEUE_FULL 129 // SD job queue already holds SD_QUEUE_JOBS jobs
+
 typedef uint8_t err_t; // For status codes
 const char* errorString(err_t errorNumber);
 
@@ -119,8 +130,9 @@ const char* errorString(err_t errorNumber);
 #define CLIENT_WEBUI		2
 #define CLIENT_TELNET		3
 #define CLIENT_INPUT        4
+#define CLIENT_TCP          5 // see TCP_STREAM_SERVER
 #define CLIENT_ALL			0xFF
-#define CLIENT_COUNT    	5 // total number of client types regardless if they are used
+#define CLIENT_COUNT    	6 // total number of client types regardless if they are used
 
 #define MSG_LEVEL_NONE		0 // set GRBL_MSG_LEVEL in config.h to the level you want to see
 #define MSG_LEVEL_ERROR		1
@@ -131,6 +143,13 @@ const char* errorString(err_t errorNumber);
 
 // functions to send data to the user.
 void grbl_send(uint8_t client, const char* text);
+// Sends len bytes of data, which may be binary.
+void grbl_write(uint8_t client, const uint8_t* data, size_t len);
+// Like grbl_write(), but the data is dropped for a client that is not keeping up. For reports the
+// client asks for again, see serial_tx_queue().
+void grbl_write_droppable(uint8_t client, const uint8_t* data, size_t len);
+// Writes to the transports right away, bypassing the transmit queues.
+void grbl_write_direct(uint8_t client, const uint8_t* data, size_t len);
 void grbl_sendf(uint8_t client, const char* format, ...);
 void grbl_msg_sendf(uint8_t client, uint8_t level, const char* format, ...);
 
@@ -161,7 +180,79 @@ void report_grbl_settings(uint8_t client, uint8_t show_extended);
 void report_echo_line_received(char* line, uint8_t client);
 
 // Prints realtime status report
+// The longest status report line. Fields that do not fit are cut off rather than overflowing.
+#ifndef REPORT_STATUS_LINE_SIZE
+    #define REPORT_STATUS_LINE_SIZE 256
+#endif
 void report_realtime_status(uint8_t client);
+#if defined(BENCHMARK) || defined(GRBL_NATIVE)
+void report_format_realtime_status(char* status, size_t size);
+// Formats value to decimals (0-4) digits as the status report does, which is as snprintf("%.*f").
+void report_format_float(char* text, size_t size, double value, uint8_t decimals);
+#endif
+
+// The optional status report fields. A polled report has all of them, as far as they are enabled
+// in config.h and by the status mask setting. Pushed reports have those given to $RI=.
+#define RT_FIELD_BUFFER_STATE       bit(0) // Bf:
+#define RT_FIELD_LINE_NUMBER        bit(1) // Ln:
+#define RT_FIELD_FEED_SPEED         bit(2) // FS:
+#define RT_FIELD_PIN_STATE          bit(3) // Pn:
+#define RT_FIELD_WORK_COORD_OFFSET  bit(4) // WCO:
+#define RT_FIELD_OVERRIDES          bit(5) // Ov: and A:
+#define RT_FIELD_DIAGNOSTICS        bit(6) // SD:, ISR: and Heap:
+#define RT_FIELD_ALL                0x7F
+#define RT_FIELD_FRAME              bit(7) // Push binary status frames instead of text reports
+
+#define REPORT_NO_BUFFER_STATE ((size_t)-1)
+
+#ifdef REPORT_STATUS_FRAMES
+// A binary status frame is framed like a binary g-code frame (see protocol.h):
+//   STATUS_FRAME_START, length, payload (length bytes), CRC-16 high byte, CRC-16 low byte
+// where the CRC is crc16_ccitt() of the length byte and the payload. The payload, little endian:
+//   uint8  STATUS_FRAME_TYPE
+//   uint16 sequence number, counting the frames built
+//   uint8  sys.state (STATE_* bits), uint8 sys.suspend (SUSPEND_* bits)
+//   int32  machine position in steps, for each axis (sys_position, motor steps on CoreXY)
+//   int32  work coordinate offset in steps, for each axis. WPos = MPos - WCO.
+//   float  realtime feed rate (mm/min)
+//   uint32 spindle speed
+//   uint8  feed, rapid and spindle overrides (percent)
+//   uint8  free planner blocks, uint16 free bytes in the client's receive buffer
+//   int32  line number of the executing block, 0 if none
+//   uint8  limit pins (axis bits), uint8 control pins (CONTROL_PIN_INDEX_* bits), uint8 probe pin
+#define STATUS_FRAME_START 0x02
+#define STATUS_FRAME_TYPE  0x81
+#define STATUS_FRAME_PAYLOAD_SIZE (26 + 8 * N_AXIS)
+
+#define STATUS_FRAME_SIZE (2 + STATUS_FRAME_PAYLOAD_SIZE + 2)
+
+// Sends client a binary status frame.
+void report_status_frame(uint8_t client);
+// Builds a whole binary status frame of STATUS_FRAME_SIZE bytes, for a channel that is not a
+// client, like UDP_REALTIME. rx_available is put in its receive buffer field.
+void report_build_status_frame(uint8_t* frame, int rx_available);
+#endif
+
+#ifdef REPORT_STATUS_PUSH
+// Limits of the push interval, in milliseconds. Binary status frames can go at the faster rate.
+#ifndef REPORT_PUSH_MIN_INTERVAL
+    #define REPORT_PUSH_MIN_INTERVAL 20
+#endif
+#ifndef REPORT_PUSH_MIN_FRAME_INTERVAL
+    #define REPORT_PUSH_MIN_FRAME_INTERVAL 10
+#endif
+#ifndef REPORT_PUSH_MAX_INTERVAL
+    #define REPORT_PUSH_MAX_INTERVAL 60000
+#endif
+
+// Sends client a status report with fields (RT_FIELD_*) every interval_ms. 0 stops the reports.
+err_t report_subscribe(uint8_t client, uint32_t interval_ms, uint8_t fields);
+
+// Sends the pushed status reports that are due. Called by the serial task.
+void report_push_status();
+// Milliseconds until a pushed status report is due, or UINT32_MAX with none subscribed.
+uint32_t report_push_status_wait_ms();
+#endif
 
 // Prints recorded probe position
 void report_probe_parameters(uint8_t client);
@@ -191,4 +282,13 @@ void report_hex_msg(char* buf, const char *prefix, int len);
 
 char report_get_axis_letter(uint8_t axis);
 
+// Reports and clears the segment, planner and input starvation counters
+void report_starvation_counters(uint8_t client);
+
+// Reports the bytes taken by each subsystem buffer, where they are, and the state of the heap
+void report_memory_map(uint8_t client);
+
+// Reports the CPU share, priority, core and stack high water mark of each task
+void report_tasks(uint8_t client);
+
 #endif
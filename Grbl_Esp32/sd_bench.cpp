@@ -0,0 +1,308 @@
+/*
+  sd_bench.cpp - throughput of the parser, planner and segment prep on an SD job
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef SD_BENCHMARK
+
+// The job is parsed in check mode, as $SD/Compile does, with only the parser calls timed, so the
+// card reads are left out. mc_line() hands the motions to sd_bench_motion(), which keeps them.
+// The kept motions are then planned from the current position. Whenever the planner is full, the
+// segment prep runs and its segments are dropped in place of the stepper ISR, until a block is
+// free. Each stage is timed on its own, so the rates are of the code and not of the machine.
+// Afterwards the planner and steppers are reset and the parser goes back to where it was.
+//
+// $SD/Simulate runs the same passes, but st_sim_prep() replays the steps of each segment on a
+// virtual timer, as the stepper ISR would put them out. The steps of each window of
+// 1/ACCELERATION_TICKS_PER_SECOND give the feed and the step rate of the fastest motor in the
+// window, and the change of feed between windows the acceleration. The feed is the length of the
+// motor step vector, which on CoreXY machines is not the tool feed.
+//
+// The native build runs both on the host, from files, see tests/native/native_main.cpp.
+
+typedef struct {
+    float target[N_AXIS];
+    plan_line_data_t pl_data;
+} sd_bench_motion_t;
+
+static sd_bench_motion_t* sd_bench_motions = NULL;
+static uint32_t sd_bench_count;
+static uint32_t sd_bench_dropped; // Motions past SD_BENCH_MAX_MOTIONS
+
+void sd_bench_motion(float* target, plan_line_data_t* pl_data) {
+    if (sd_bench_motions == NULL)
+        return;
+    if (sd_bench_count == SD_BENCH_MAX_MOTIONS) {
+        sd_bench_dropped++;
+        return;
+    }
+    sd_bench_motion_t* motion = &sd_bench_motions[sd_bench_count++];
+    memcpy(motion->target, target, sizeof(motion->target));
+    motion->pl_data = *pl_data;
+}
+
+#define SD_SIM_WINDOW_TICKS (F_STEPPER_TIMER / ACCELERATION_TICKS_PER_SECOND)
+#define SD_SIM_RATE_BINS 18 // Step rate histogram bins, 2^k to 2^(k+1)-1 steps/s
+
+typedef struct {
+    st_sim_t st;
+    sd_bench_edge_t edge;
+    int32_t steps[N_AXIS];         // Net steps of each motor
+    uint32_t window_steps[N_AXIS];
+    uint64_t window_end;           // Timer ticks
+    float feed;                    // mm/min in the last window
+    float peak_feed;
+    float peak_accel;              // mm/sec^2
+    uint32_t rate_bins[SD_SIM_RATE_BINS];
+} sd_sim_t;
+
+static sd_sim_t* sd_sim = NULL;
+
+static void sd_sim_window() {
+    const float window_sec = 1.0f / ACCELERATION_TICKS_PER_SECOND;
+    float sum = 0.0f;
+    uint32_t fastest = 0;
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        float mm = sd_sim->window_steps[axis] / axis_settings[axis]->steps_per_mm->get();
+        sum += mm * mm;
+        fastest = MAX(fastest, sd_sim->window_steps[axis]);
+        sd_sim->window_steps[axis] = 0;
+    }
+    float feed = sqrtf(sum) / window_sec * 60.0f;
+    sd_sim->peak_feed = MAX(sd_sim->peak_feed, feed);
+    sd_sim->peak_accel = MAX(sd_sim->peak_accel, fabsf(feed - sd_sim->feed) / 60.0f / window_sec);
+    sd_sim->feed = feed;
+    uint32_t rate = fastest * ACCELERATION_TICKS_PER_SECOND;
+    if (rate)
+        sd_sim->rate_bins[MIN(31 - __builtin_clz(rate), SD_SIM_RATE_BINS - 1)]++;
+    sd_sim->window_end += SD_SIM_WINDOW_TICKS;
+}
+
+static void sd_sim_tick(uint8_t step_bits, uint8_t dir_bits, uint64_t time) {
+    while (time >= sd_sim->window_end)
+        sd_sim_window();
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        if (step_bits & bit(axis)) {
+            sd_sim->window_steps[axis]++;
+            sd_sim->steps[axis] += (dir_bits & bit(axis)) ? -1 : 1;
+        }
+    }
+    if (sd_sim->edge)
+        sd_sim->edge(step_bits, dir_bits, time);
+}
+
+// Reports the simulation. start is the motor position the job started from. Returns true if the
+// steps ended where the planner put the last motion.
+static bool sd_sim_report(uint8_t client, const char* path, const int32_t* start) {
+    sd_sim_window(); // The last, partial window
+    grbl_msg_sendf(client, MSG_LEVEL_INFO, "Sim %s: %.3f sec, peak feed %.0f mm/min, peak accel %.0f mm/sec^2",
+                   path, (double)sd_sim->st.time / F_STEPPER_TIMER, sd_sim->peak_feed, sd_sim->peak_accel);
+    for (uint8_t bin = 0; bin < SD_SIM_RATE_BINS; bin++) {
+        if (sd_sim->rate_bins[bin])
+            grbl_msg_sendf(client, MSG_LEVEL_INFO, "Sim rate %d-%d steps/sec: %d windows", 1 << bin, (2 << bin) - 1, sd_sim->rate_bins[bin]);
+    }
+    if (sd_bench_count == 0 || sd_bench_dropped)
+        return false;
+    // The steps must end where the planner put the last motion.
+    int32_t end[N_AXIS];
+    for (uint8_t axis = 0; axis < N_AXIS; axis++)
+        end[axis] = lround(sd_bench_motions[sd_bench_count - 1].target[axis] * axis_settings[axis]->steps_per_mm->get());
+    kinematics_motor_steps(end, end);
+    char off[12 * N_AXIS] = "";
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        int32_t error = start[axis] + sd_sim->steps[axis] - end[axis];
+        if (error)
+            sprintf(off + strlen(off), " %c:%d", "XYZABC"[axis], error);
+    }
+    if (off[0]) {
+        grbl_msg_sendf(client, MSG_LEVEL_INFO, "Sim end is off by steps%s", off);
+        return false;
+    }
+    grbl_msg_sendf(client, MSG_LEVEL_INFO, "Sim end matches the planner");
+    return true;
+}
+
+// Parses the job. A line with an error is reported and the parse goes on, so that a job with a
+// few bad lines still gives rates, as tests/parsetest.nc does. Returns the status that stopped
+// the parse, if one did, and sets *lines, *errors and *us.
+static err_t sd_bench_parse(sd_bench_read_t read, void* source, uint8_t client, uint32_t* lines, uint32_t* errors, int64_t* us) {
+    char line[256];
+    int len = 0;
+    *lines = 0;
+    *errors = 0;
+    *us = 0;
+    while (true) {
+        int c = read(source);
+        if (c >= 0 && c != '\n') {
+            if (len == sizeof(line) - 1)
+                return STATUS_OVERFLOW;
+            line[len++] = c;
+            continue;
+        }
+        if (c < 0 && len == 0)
+            break;
+        line[len] = '\0';
+        len = 0;
+        (*lines)++;
+        protocol_execute_realtime();
+        if (sys.abort)
+            return STATUS_SD_FAILED_READ;
+        int64_t start = esp_timer_get_time();
+        err_t status = gc_execute_line(line, client);
+        *us += esp_timer_get_time() - start;
+        // STATUS_GCODE_UNSUPPORTED_COMMAND is tolerated when the job runs, see report_status_message()
+        if (status != STATUS_OK && status != STATUS_GCODE_UNSUPPORTED_COMMAND) {
+            grbl_sendf(client, "error:%d in SD file at line %d\r\n", status, *lines);
+            (*errors)++;
+        }
+        if (c < 0)
+            break;
+    }
+    return STATUS_OK;
+}
+
+// Runs the segment prep until the planner has a free block, or has no blocks left if drain.
+// Returns false if the prep stopped making segments.
+static bool sd_bench_prep(bool drain, uint32_t* segments, int64_t* us) {
+    while (drain ? plan_get_current_block() != NULL : plan_check_full_buffer()) {
+        int64_t start = esp_timer_get_time();
+        uint32_t count = sd_sim ? st_sim_prep(&sd_sim->st, sd_sim_tick) : st_bench_prep();
+        *us += esp_timer_get_time() - start;
+        if (count == 0)
+            return false;
+        *segments += count;
+    }
+    return true;
+}
+
+// Plans the kept motions. Sets *blocks, *plan_us, *segments and *prep_us.
+static void sd_bench_plan(uint32_t* blocks, int64_t* plan_us, uint32_t* segments, int64_t* prep_us) {
+    *blocks = 0;
+    *plan_us = 0;
+    *segments = 0;
+    *prep_us = 0;
+    for (uint32_t i = 0; i < sd_bench_count; i++) {
+        if (!sd_bench_prep(false, segments, prep_us))
+            return;
+        uint8_t plan_count = plan_get_block_buffer_count();
+        int64_t start = esp_timer_get_time();
+        plan_buffer_line(sd_bench_motions[i].target, &sd_bench_motions[i].pl_data);
+        *plan_us += esp_timer_get_time() - start;
+        if (plan_get_block_buffer_count() != plan_count)
+            (*blocks)++; // Not merged into the block before it, nor too short to plan
+    }
+    sd_bench_prep(true, segments, prep_us);
+}
+
+static uint32_t sd_bench_rate(uint32_t count, int64_t us) {
+    return us ? (uint32_t)(count * 1000000LL / us) : 0;
+}
+
+err_t sd_bench_run(const char* path, sd_bench_read_t read, void* source, uint8_t client, bool simulate,
+                   sd_bench_edge_t edge, sd_bench_result_t* result) {
+    sd_bench_motions = (sd_bench_motion_t*)malloc(SD_BENCH_MAX_MOTIONS * sizeof(sd_bench_motion_t));
+    if (simulate)
+        sd_sim = (sd_sim_t*)calloc(1, sizeof(sd_sim_t));
+    if (sd_bench_motions == NULL || (simulate && sd_sim == NULL)) {
+        free(sd_bench_motions);
+        sd_bench_motions = NULL;
+        free(sd_sim);
+        sd_sim = NULL;
+        return STATUS_OVERFLOW;
+    }
+    int32_t start_position[N_AXIS];
+    memcpy(start_position, sys_position, sizeof(start_position));
+    if (sd_sim) {
+        sd_sim->st.block_index = 0xff;
+        sd_sim->window_end = SD_SIM_WINDOW_TICKS;
+        sd_sim->edge = edge;
+    }
+    sd_bench_count = 0;
+    sd_bench_dropped = 0;
+    parser_state_t start_state = gc_state;
+    uint8_t state = sys.state;
+    sys.state = STATE_CHECK_MODE;
+    uint32_t lines, errors;
+    int64_t parse_us;
+    err_t status = sd_bench_parse(read, source, client, &lines, &errors, &parse_us);
+    gc_state = start_state;
+    sys.state = state;
+    uint32_t blocks = 0, segments = 0;
+    int64_t plan_us = 0, prep_us = 0;
+    if (status == STATUS_OK) {
+        // sys_position is where the parser started, so the motions follow on from it.
+        plan_sync_position();
+        sd_bench_plan(&blocks, &plan_us, &segments, &prep_us);
+        st_reset();
+        plan_reset();
+        plan_sync_position();
+    }
+    bool end_matches = false;
+    if (status == STATUS_OK && sd_sim)
+        end_matches = sd_sim_report(client, path, start_position);
+    if (result) {
+        memset(result, 0, sizeof(sd_bench_result_t));
+        result->lines = lines;
+        result->errors = errors;
+        result->motions = sd_bench_count;
+        result->dropped = sd_bench_dropped;
+        result->blocks = blocks;
+        result->segments = segments;
+        if (sd_bench_count)
+            memcpy(result->end, sd_bench_motions[sd_bench_count - 1].target, sizeof(result->end));
+        if (sd_sim) {
+            result->sim_ticks = sd_sim->st.time;
+            result->peak_feed = sd_sim->peak_feed;
+            result->peak_accel = sd_sim->peak_accel;
+            result->end_matches = end_matches;
+        }
+    }
+    free(sd_bench_motions);
+    sd_bench_motions = NULL;
+    free(sd_sim);
+    sd_sim = NULL;
+    if (status != STATUS_OK) {
+        grbl_sendf(client, "error:%d in SD file at line %d\r\n", status, lines);
+        return status;
+    }
+    grbl_msg_sendf(client, MSG_LEVEL_INFO, "Bench %s: %d lines %d lines/s, %d blocks %d blocks/s, %d segments %d segments/s",
+                   path, lines, sd_bench_rate(lines, parse_us), blocks, sd_bench_rate(blocks, plan_us),
+                   segments, sd_bench_rate(segments, prep_us));
+    if (sd_bench_dropped)
+        grbl_msg_sendf(client, MSG_LEVEL_INFO, "Bench planned the first %d motions of %d", sd_bench_count, sd_bench_count + sd_bench_dropped);
+    return STATUS_OK;
+}
+
+#ifdef ENABLE_SD_CARD
+static int sd_bench_read_file(void* source) {
+    return ((File*)source)->read();
+}
+
+err_t sd_bench_file(fs::FS& fs, const char* path, uint8_t client, bool simulate) {
+    File source = fs.open(path);
+    if (!source)
+        return STATUS_SD_FAILED_OPEN_FILE;
+    set_sd_state(SDCARD_BUSY_PARSING);
+    err_t status = sd_bench_run(path, sd_bench_read_file, &source, client, simulate, NULL, NULL);
+    set_sd_state(SDCARD_IDLE);
+    source.close();
+    return status;
+}
+#endif
+
+#endif
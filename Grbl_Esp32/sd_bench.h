@@ -0,0 +1,74 @@
+/*
+  sd_bench.h - throughput of the parser, planner and segment prep on an SD job
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef sd_bench_h
+#define sd_bench_h
+
+#ifdef SD_BENCHMARK
+
+#if !defined(ENABLE_SD_CARD) && !defined(GRBL_NATIVE)
+    #error "SD_BENCHMARK requires ENABLE_SD_CARD"
+#endif
+
+// The most motions kept from the parse for the planner and segment prep pass.
+#ifndef SD_BENCH_MAX_MOTIONS
+    #define SD_BENCH_MAX_MOTIONS 1000
+#endif
+
+// Returns the next character of a job, or -1 at its end.
+typedef int (*sd_bench_read_t)(void* source);
+
+// Gets the step bits and direction bits of each simulated tick that steps a motor, and the time
+// of its pulse in stepper timer ticks from the start of the job. See st_sim_prep().
+typedef void (*sd_bench_edge_t)(uint8_t step_bits, uint8_t dir_bits, uint64_t time);
+
+// What a run found, for the checks of the native build. See tests/native/native_sim.cpp.
+typedef struct {
+    uint32_t lines;
+    uint32_t errors;   // Lines that had an error
+    uint32_t motions;  // Motions kept from the parse
+    uint32_t dropped;  // Motions past SD_BENCH_MAX_MOTIONS, which were not planned
+    uint32_t blocks;
+    uint32_t segments;
+    float end[N_AXIS]; // Target of the last motion, mm
+    // With simulate
+    uint64_t sim_ticks; // Stepper timer ticks the steps took, from the start of the job
+    float peak_feed;    // mm/min
+    float peak_accel;   // mm/sec^2
+    bool end_matches;   // The steps ended at the target of the last motion
+} sd_bench_result_t;
+
+// Runs the job read from source through the parser, the planner and the segment prep, without
+// motion, and reports the rate of each to client under path. With simulate, the steps of the
+// segments are replayed and the feed, acceleration and step rates they make are reported too.
+// edge, if not NULL, gets each simulated tick, and result, if not NULL, what was found.
+// Must be called in the idle state.
+err_t sd_bench_run(const char* path, sd_bench_read_t read, void* source, uint8_t client, bool simulate,
+                   sd_bench_edge_t edge, sd_bench_result_t* result);
+
+#ifdef ENABLE_SD_CARD
+// sd_bench_run() on the job at path.
+err_t sd_bench_file(fs::FS& fs, const char* path, uint8_t client, bool simulate);
+#endif
+
+// Keeps a motion of the parse. Called by mc_line() in check mode.
+void sd_bench_motion(float* target, plan_line_data_t* pl_data);
+
+#endif
+
+#endif
@@ -0,0 +1,333 @@
+/*
+  sd_dir_cache.cpp - RAM index of SD card directories, built in the background
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef SD_DIR_CACHE
+
+// Walking a FAT directory opens every entry, which takes a long time on a card with hundreds of
+// jobs. The listings are kept in RAM instead, in SD_DIR_CACHE_DIRS slots. A directory that is not
+// listed is queued for sdDirCacheTask, which walks it at low priority and swaps the result into
+// its slot. Uploads and deletes through the firmware edit the listings in place, so a listing is
+// only walked again when the card is mounted again or its slot was reused.
+//
+// The slots are guarded by a recursive mutex, held by readers from sd_dir_cache_get() to
+// sd_dir_cache_release(). The walk itself runs without it, under the card mutex, which keeps
+// get_sd_state() from remounting the card under the task.
+enum : uint8_t {
+    SD_DIR_EMPTY = SD_DIR_FAILED + 1,
+};
+
+typedef struct {
+    char path[SD_DIR_CACHE_PATH_MAX];
+    sd_dir_entry_t* entries;
+    uint32_t count;
+    uint32_t capacity;
+    uint8_t state;
+    uint32_t generation; // Changes whenever the slot is emptied, so a walk in progress is dropped
+    uint32_t used;       // When last read, for replacing the oldest
+    uint8_t readers;     // Gets not released yet. Nested gets of one task must not replace it.
+} sd_dir_t;
+
+static sd_dir_t sd_dirs[SD_DIR_CACHE_DIRS];
+static SemaphoreHandle_t sd_dir_mutex = NULL;
+static SemaphoreHandle_t sd_card_mutex = NULL;
+static QueueHandle_t sd_dir_requests = NULL;
+static TaskHandle_t sdDirCacheTaskHandle = NULL;
+static uint32_t sd_dir_tick = 0;
+static bool sd_space_known = false;
+static uint64_t sd_space_total, sd_space_used;
+
+#define SD_DIR_LOCK() xSemaphoreTakeRecursive(sd_dir_mutex, portMAX_DELAY)
+#define SD_DIR_UNLOCK() xSemaphoreGiveRecursive(sd_dir_mutex)
+
+static void sd_dir_free(sd_dir_entry_t* entries, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++)
+        free(entries[i].name);
+    free(entries);
+}
+
+static void sd_dir_empty(sd_dir_t* dir) {
+    sd_dir_free(dir->entries, dir->count);
+    dir->entries = NULL;
+    dir->count = dir->capacity = 0;
+    dir->state = SD_DIR_EMPTY;
+    dir->generation++;
+}
+
+// Appends an entry. Returns false if out of memory.
+static bool sd_dir_append(sd_dir_entry_t** entries, uint32_t* count, uint32_t* capacity, const char* name, uint32_t size, bool is_dir) {
+    if (*count == *capacity) {
+        uint32_t grown = *capacity ? *capacity * 2 : 16;
+        sd_dir_entry_t* larger = (sd_dir_entry_t*)realloc(*entries, grown * sizeof(sd_dir_entry_t));
+        if (larger == NULL)
+            return false;
+        *entries = larger;
+        *capacity = grown;
+    }
+    char* copy = strdup(name);
+    if (copy == NULL)
+        return false;
+    sd_dir_entry_t* entry = &(*entries)[(*count)++];
+    entry->name = copy;
+    entry->size = size;
+    entry->is_dir = is_dir;
+    return true;
+}
+
+static const char* sd_dir_basename(const char* path) {
+    const char* slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+// Gets the directory holding path into parent.
+static void sd_dir_parent(const char* path, char* parent) {
+    const char* slash = strrchr(path, '/');
+    size_t len = (slash == NULL || slash == path) ? 1 : slash - path;
+    len = MIN(len, SD_DIR_CACHE_PATH_MAX - 1);
+    memcpy(parent, slash == NULL ? "/" : path, len);
+    parent[len] = '\0';
+}
+
+// Returns the slot listing path, or NULL.
+static sd_dir_t* sd_dir_find(const char* path) {
+    for (uint8_t i = 0; i < SD_DIR_CACHE_DIRS; i++) {
+        if (sd_dirs[i].state != SD_DIR_EMPTY && strcmp(sd_dirs[i].path, path) == 0)
+            return &sd_dirs[i];
+    }
+    return NULL;
+}
+
+static void sdDirCacheTask(void* pvParameters) {
+    uint8_t slot;
+    char path[SD_DIR_CACHE_PATH_MAX];
+    while (true) {
+        if (xQueueReceive(sd_dir_requests, &slot, portMAX_DELAY) != pdTRUE)
+            continue;
+        SD_DIR_LOCK();
+        bool wanted = sd_dirs[slot].state == SD_DIR_BUILDING;
+        uint32_t generation = sd_dirs[slot].generation;
+        strcpy(path, sd_dirs[slot].path);
+        SD_DIR_UNLOCK();
+        if (!wanted)
+            continue;
+        sd_dir_entry_t* entries = NULL;
+        uint32_t count = 0, capacity = 0;
+        bool ok = false;
+        sd_dir_cache_lock_card(portMAX_DELAY);
+        File dir = SD.open(path);
+        if (dir && dir.isDirectory()) {
+            ok = true;
+            File entry = dir.openNextFile();
+            while (entry && ok) {
+                ok = sd_dir_append(&entries, &count, &capacity, sd_dir_basename(entry.name()), entry.size(), entry.isDirectory());
+                entry.close();
+                if ((count % 16) == 0)
+                    vTaskDelay(1); // Let the card go to a running job now and then
+                entry = dir.openNextFile();
+            }
+        }
+        if (dir)
+            dir.close();
+        bool space = !sd_space_known;
+        uint64_t total = 0, used = 0;
+        if (space) {
+            total = SD.totalBytes();
+            used = SD.usedBytes(); // Reads the whole FAT
+        }
+        sd_dir_cache_unlock_card();
+        SD_DIR_LOCK();
+        if (space && !sd_space_known) {
+            sd_space_total = total;
+            sd_space_used = used;
+            sd_space_known = true;
+        }
+        sd_dir_t* dir_slot = &sd_dirs[slot];
+        if (dir_slot->generation == generation && dir_slot->state == SD_DIR_BUILDING) {
+            dir_slot->entries = entries;
+            dir_slot->count = count;
+            dir_slot->capacity = capacity;
+            dir_slot->state = ok ? SD_DIR_READY : SD_DIR_FAILED;
+            entries = NULL;
+            count = 0;
+        }
+        SD_DIR_UNLOCK();
+        sd_dir_free(entries, count);
+    }
+}
+
+static bool sd_dir_cache_init() {
+    if (sdDirCacheTaskHandle != NULL)
+        return true;
+    for (uint8_t i = 0; i < SD_DIR_CACHE_DIRS; i++)
+        sd_dirs[i].state = SD_DIR_EMPTY;
+    sd_dir_mutex = xSemaphoreCreateRecursiveMutex();
+    sd_card_mutex = xSemaphoreCreateMutex();
+    sd_dir_requests = xQueueCreate(SD_DIR_CACHE_DIRS, sizeof(uint8_t));
+    task_create(TASK_SD_DIR_CACHE, sdDirCacheTask, 4096, NULL, &sdDirCacheTaskHandle);
+    return sdDirCacheTaskHandle != NULL;
+}
+
+uint8_t sd_dir_cache_get(const char* path, const sd_dir_entry_t** entries, uint32_t* count) {
+    if (!sd_dir_cache_init() || strlen(path) >= SD_DIR_CACHE_PATH_MAX)
+        return SD_DIR_FAILED;
+    SD_DIR_LOCK();
+    sd_dir_t* dir = sd_dir_find(path);
+    if (dir == NULL) {
+        // Take an empty slot, or else the one read longest ago that is not being walked
+        for (uint8_t i = 0; i < SD_DIR_CACHE_DIRS; i++) {
+            sd_dir_t* slot = &sd_dirs[i];
+            if (slot->state == SD_DIR_BUILDING || slot->readers)
+                continue;
+            if (dir == NULL || slot->state == SD_DIR_EMPTY || (dir->state != SD_DIR_EMPTY && slot->used < dir->used))
+                dir = slot;
+        }
+        if (dir == NULL) {
+            SD_DIR_UNLOCK();
+            return SD_DIR_BUILDING; // Every slot is being walked. Try again later.
+        }
+        sd_dir_empty(dir);
+        strcpy(dir->path, path);
+        dir->state = SD_DIR_BUILDING;
+        uint8_t slot = dir - sd_dirs;
+        xQueueSend(sd_dir_requests, &slot, 0); // Never full: at most one request per slot
+    }
+    dir->used = ++sd_dir_tick;
+    uint8_t state = dir->state;
+    if (state == SD_DIR_READY) {
+        dir->readers++;
+        *entries = dir->entries;
+        *count = dir->count;
+        return state; // Locked until sd_dir_cache_release()
+    }
+    if (state == SD_DIR_FAILED)
+        sd_dir_empty(dir); // Walked again next time, in case it was made since
+    SD_DIR_UNLOCK();
+    return state;
+}
+
+void sd_dir_cache_release(const sd_dir_entry_t* entries) {
+    for (uint8_t i = 0; i < SD_DIR_CACHE_DIRS; i++) {
+        if (sd_dirs[i].readers && sd_dirs[i].entries == entries) {
+            sd_dirs[i].readers--;
+            break;
+        }
+    }
+    SD_DIR_UNLOCK();
+}
+
+bool sd_dir_cache_space(uint64_t* total, uint64_t* used) {
+    if (!sd_dir_cache_init())
+        return false;
+    SD_DIR_LOCK();
+    bool known = sd_space_known;
+    *total = sd_space_total;
+    *used = sd_space_used;
+    SD_DIR_UNLOCK();
+    return known;
+}
+
+void sd_dir_cache_added(const char* path, uint32_t size, bool is_dir) {
+    if (!sd_dir_cache_init())
+        return;
+    char parent[SD_DIR_CACHE_PATH_MAX];
+    sd_dir_parent(path, parent);
+    const char* name = sd_dir_basename(path);
+    SD_DIR_LOCK();
+    sd_dir_t* dir = sd_dir_find(parent);
+    if (dir != NULL && dir->state == SD_DIR_READY) {
+        uint32_t i;
+        for (i = 0; i < dir->count && strcmp(dir->entries[i].name, name) != 0; i++) {}
+        if (i < dir->count) {
+            sd_space_used -= dir->entries[i].size;
+            dir->entries[i].size = size;
+            dir->entries[i].is_dir = is_dir;
+        } else if (!sd_dir_append(&dir->entries, &dir->count, &dir->capacity, name, size, is_dir))
+            sd_dir_empty(dir);
+    } else if (dir != NULL)
+        sd_dir_empty(dir); // A walk in progress may have missed it
+    sd_space_used += size;
+    SD_DIR_UNLOCK();
+}
+
+void sd_dir_cache_removed(const char* path) {
+    if (!sd_dir_cache_init())
+        return;
+    char parent[SD_DIR_CACHE_PATH_MAX];
+    sd_dir_parent(path, parent);
+    const char* name = sd_dir_basename(path);
+    size_t len = strlen(path);
+    SD_DIR_LOCK();
+    sd_dir_t* dir = sd_dir_find(parent);
+    if (dir != NULL && dir->state == SD_DIR_READY) {
+        for (uint32_t i = 0; i < dir->count; i++) {
+            if (strcmp(dir->entries[i].name, name) == 0) {
+                sd_space_used -= MIN(sd_space_used, (uint64_t)dir->entries[i].size);
+                free(dir->entries[i].name);
+                memmove(&dir->entries[i], &dir->entries[i + 1], (dir->count - i - 1) * sizeof(sd_dir_entry_t));
+                dir->count--;
+                break;
+            }
+        }
+    } else if (dir != NULL)
+        sd_dir_empty(dir);
+    // The listings of a removed directory and the directories in it
+    for (uint8_t i = 0; i < SD_DIR_CACHE_DIRS; i++) {
+        if (sd_dirs[i].state != SD_DIR_EMPTY && strncmp(sd_dirs[i].path, path, len) == 0 &&
+                (sd_dirs[i].path[len] == '\0' || sd_dirs[i].path[len] == '/'))
+            sd_dir_empty(&sd_dirs[i]);
+    }
+    SD_DIR_UNLOCK();
+}
+
+void sd_dir_cache_invalidate(const char* path) {
+    if (!sd_dir_cache_init())
+        return;
+    char parent[SD_DIR_CACHE_PATH_MAX];
+    sd_dir_parent(path, parent);
+    SD_DIR_LOCK();
+    sd_dir_t* dir = sd_dir_find(parent);
+    if (dir != NULL)
+        sd_dir_empty(dir);
+    SD_DIR_UNLOCK();
+}
+
+void sd_dir_cache_clear() {
+    if (!sd_dir_cache_init())
+        return;
+    SD_DIR_LOCK();
+    for (uint8_t i = 0; i < SD_DIR_CACHE_DIRS; i++) {
+        if (sd_dirs[i].state != SD_DIR_EMPTY)
+            sd_dir_empty(&sd_dirs[i]);
+    }
+    sd_space_known = false;
+    SD_DIR_UNLOCK();
+}
+
+bool sd_dir_cache_lock_card(TickType_t wait) {
+    if (!sd_dir_cache_init())
+        return true;
+    return xSemaphoreTake(sd_card_mutex, wait) == pdTRUE;
+}
+
+void sd_dir_cache_unlock_card() {
+    if (sd_card_mutex != NULL)
+        xSemaphoreGive(sd_card_mutex);
+}
+
+#endif
@@ -0,0 +1,74 @@
+/*
+  sd_dir_cache.h - RAM index of SD card directories, built in the background
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef sd_dir_cache_h
+#define sd_dir_cache_h
+
+#ifdef SD_DIR_CACHE
+
+// The number of directories listed in RAM at once. The least recently used one is replaced.
+#ifndef SD_DIR_CACHE_DIRS
+    #define SD_DIR_CACHE_DIRS 4
+#endif
+
+// Longest directory path that is cached.
+#ifndef SD_DIR_CACHE_PATH_MAX
+    #define SD_DIR_CACHE_PATH_MAX 128
+#endif
+
+// How long a WebUI listing waits for a directory that is not listed yet, in ms.
+#ifndef SD_DIR_CACHE_WAIT_MS
+    #define SD_DIR_CACHE_WAIT_MS 2000
+#endif
+
+enum : uint8_t {
+    SD_DIR_BUILDING = 0, // Being listed by the background task
+    SD_DIR_READY,
+    SD_DIR_FAILED,       // Not a directory
+};
+
+typedef struct {
+    char* name;      // Without the path
+    uint32_t size;
+    bool is_dir;
+} sd_dir_entry_t;
+
+// Gets the entries of the directory at path, which is "/" or has no trailing '/'. If it is not
+// listed yet, it is queued for the background task and SD_DIR_BUILDING is returned. On
+// SD_DIR_READY the entries stay valid until they are passed to sd_dir_cache_release(), and the
+// listings can't change meanwhile. Gets may be nested, as when listing subdirectories.
+uint8_t sd_dir_cache_get(const char* path, const sd_dir_entry_t** entries, uint32_t* count);
+void sd_dir_cache_release(const sd_dir_entry_t* entries);
+
+// Gets the card space, known once the first directory is listed after the card is mounted.
+bool sd_dir_cache_space(uint64_t* total, uint64_t* used);
+
+// Keep the listings up to date with changes made through the firmware. path is the full path of
+// the file or directory.
+void sd_dir_cache_added(const char* path, uint32_t size, bool is_dir);
+void sd_dir_cache_removed(const char* path);
+void sd_dir_cache_invalidate(const char* path); // The directory holding path is listed again
+void sd_dir_cache_clear(); // A card was mounted
+
+// Held by the background task while it reads the card. The card must not be remounted without it.
+bool sd_dir_cache_lock_card(TickType_t wait);
+void sd_dir_cache_unlock_card();
+
+#endif
+
+#endif
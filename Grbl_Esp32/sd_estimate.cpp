@@ -0,0 +1,364 @@
+/*
+  sd_estimate.cpp - run time estimate of SD jobs for time based progress
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef SD_ESTIMATE
+
+// The job is read a second time by a task below the main loop priority. Its own small g-code
+// reader follows the motion modes, units, distance mode and feed, which is all the time depends
+// on, without touching the parser state of the running job. Each motion is timed with the
+// planner's model: a trapezoid at the axis limited acceleration, from the junction speed with the
+// motion before to the junction speed with the motion after. The backward pass of the planner
+// over more than one motion is left out, so runs of short motions come out a little fast.
+// Lines that make the planner stop, like dwell or spindle changes, end at zero speed.
+
+static TaskHandle_t sdEstimateTaskHandle = NULL;
+static volatile bool sd_estimate_cancel = false;
+static volatile bool sd_estimate_done = false;
+static char sd_estimate_path[128];
+static fs::FS* sd_estimate_fs;
+
+static float* sd_estimate_times = NULL; // Seconds to the start of every stride-th line
+static uint32_t sd_estimate_count = 0;
+static uint32_t sd_estimate_capacity = 0;
+static float sd_estimate_total;          // Seconds of the whole job
+
+// A motion waiting for the one after it, which gives its exit speed.
+typedef struct {
+    bool valid;
+    float millimeters;
+    float nominal_speed;  // mm/min
+    float acceleration;   // mm/min^2
+    float unit_vec[N_AXIS];
+    float entry_speed;    // mm/min
+} sd_estimate_motion_t;
+
+typedef struct {
+    float position[N_AXIS];
+    uint8_t motion;       // 0-3 for G0-G3
+    bool absolute;
+    bool inches;
+    bool inverse_time;
+    uint8_t plane;        // 17, 18 or 19
+    float feed_rate;      // mm/min, or 1/min with inverse time
+    double time;          // Seconds so far
+    sd_estimate_motion_t last;
+} sd_estimate_state_t;
+
+// Returns the minutes of a motion over millimeters that starts at entry, ends at exit and does
+// not go faster than nominal, all in mm/min.
+static float sd_estimate_trapezoid(float millimeters, float entry, float exit, float nominal, float acceleration) {
+    float accelerate = (nominal * nominal - entry * entry) / (2 * acceleration);
+    float decelerate = (nominal * nominal - exit * exit) / (2 * acceleration);
+    if (accelerate + decelerate <= millimeters)
+        return (nominal - entry) / acceleration + (nominal - exit) / acceleration + (millimeters - accelerate - decelerate) / nominal;
+    float peak = sqrt((2 * acceleration * millimeters + entry * entry + exit * exit) / 2);
+    if (peak <= MAX(entry, exit))
+        return 2 * millimeters / (entry + exit + 1e-6);
+    return (peak - entry) / acceleration + (peak - exit) / acceleration;
+}
+
+// Times the waiting motion now that the speed it ends at is known.
+static void sd_estimate_finish(sd_estimate_state_t* st, float exit_speed) {
+    sd_estimate_motion_t* m = &st->last;
+    if (!m->valid)
+        return;
+    float reachable = sqrt(m->entry_speed * m->entry_speed + 2 * m->acceleration * m->millimeters);
+    exit_speed = MIN(exit_speed, reachable);
+    st->time += sd_estimate_trapezoid(m->millimeters, m->entry_speed, exit_speed, m->nominal_speed, m->acceleration) * 60.0;
+    m->valid = false;
+    m->entry_speed = exit_speed;
+}
+
+// Adds a motion along unit_vec, with the junction to the motion before as in the planner.
+static void sd_estimate_motion(sd_estimate_state_t* st, float* unit_vec, float millimeters, float nominal_speed) {
+    if (millimeters <= 0)
+        return;
+    sd_estimate_motion_t* m = &st->last;
+    float acceleration = limit_acceleration_by_axis_maximum(unit_vec);
+    nominal_speed = MIN(nominal_speed, limit_rate_by_axis_maximum(unit_vec));
+    float entry_speed = 0.0;
+    if (m->valid) {
+        float junction_cos_theta = 0.0;
+        float junction_vec[N_AXIS];
+        for (uint8_t idx = 0; idx < N_AXIS; idx++) {
+            junction_cos_theta -= m->unit_vec[idx] * unit_vec[idx];
+            junction_vec[idx] = unit_vec[idx] - m->unit_vec[idx];
+        }
+        float junction_speed_sqr;
+        if (junction_cos_theta > 0.999999)
+            junction_speed_sqr = MINIMUM_JUNCTION_SPEED * MINIMUM_JUNCTION_SPEED;
+        else if (junction_cos_theta < -0.999999)
+            junction_speed_sqr = SOME_LARGE_VALUE;
+        else {
+            convert_delta_vector_to_unit_vector(junction_vec);
+            float junction_acceleration = limit_acceleration_by_axis_maximum(junction_vec);
+            float sin_theta_d2 = sqrt(0.5 * (1.0 - junction_cos_theta));
+            junction_speed_sqr = MAX(MINIMUM_JUNCTION_SPEED * MINIMUM_JUNCTION_SPEED,
+                                     (junction_acceleration * hot_settings->junction_deviation * sin_theta_d2) / (1.0 - sin_theta_d2));
+        }
+        float junction_speed = MIN(sqrt(junction_speed_sqr), MIN(m->nominal_speed, nominal_speed));
+        sd_estimate_finish(st, junction_speed);
+        entry_speed = m->entry_speed;
+    }
+    m->valid = true;
+    m->millimeters = millimeters;
+    m->nominal_speed = nominal_speed;
+    m->acceleration = acceleration;
+    m->entry_speed = entry_speed;
+    memcpy(m->unit_vec, unit_vec, sizeof(m->unit_vec));
+}
+
+// Returns the index of an axis letter, or -1.
+static int8_t sd_estimate_axis(char letter) {
+    const char* axes = "XYZABC";
+    const char* p = strchr(axes, letter);
+    return (p && (p - axes) < N_AXIS) ? p - axes : -1;
+}
+
+// Reads one line. Only the words the time depends on are looked at.
+static void sd_estimate_line(sd_estimate_state_t* st, char* line) {
+    float target[N_AXIS];
+    float offset[3] = { 0.0, 0.0, 0.0 }; // I, J, K
+    float radius = 0.0;
+    bool axis_words = false, has_radius = false, stop = false;
+    float dwell = 0.0;
+    float feed = -1.0;
+    memcpy(target, st->position, sizeof(target));
+    char* p = line;
+    while (*p) {
+        char c = toupper(*p);
+        if (c == '(') {
+            while (*p && *p != ')')
+                p++;
+            if (*p)
+                p++;
+            continue;
+        }
+        if (c == ';')
+            break;
+        if (c < 'A' || c > 'Z') {
+            p++;
+            continue;
+        }
+        char* end;
+        float value = strtof(p + 1, &end);
+        if (end == p + 1) {
+            p++;
+            continue;
+        }
+        p = end;
+        int8_t axis;
+        switch (c) {
+        case 'G':
+            if (value == 0 || value == 1 || value == 2 || value == 3)
+                st->motion = (uint8_t)value;
+            else if (value == 4)
+                stop = true;
+            else if (value == 17 || value == 18 || value == 19)
+                st->plane = (uint8_t)value;
+            else if (value == 20 || value == 21)
+                st->inches = (value == 20);
+            else if (value == 90 || value == 91)
+                st->absolute = (value == 90);
+            else if (value == 93 || value == 94)
+                st->inverse_time = (value == 93);
+            else if (value >= 28 && value < 39)
+                stop = true; // Homing and probing moves are not estimated
+            break;
+        case 'M':
+            stop = true; // Spindle, coolant, pauses and tool changes all wait for the planner
+            break;
+        case 'F':
+            feed = value;
+            break;
+        case 'P':
+            dwell = value;
+            break;
+        case 'I': case 'J': case 'K':
+            offset[c - 'I'] = value * (st->inches ? MM_PER_INCH : 1.0);
+            break;
+        case 'R':
+            radius = value * (st->inches ? MM_PER_INCH : 1.0);
+            has_radius = true;
+            break;
+        default:
+            axis = sd_estimate_axis(c);
+            if (axis >= 0) {
+                float mm = value * (st->inches ? MM_PER_INCH : 1.0);
+                target[axis] = st->absolute ? mm : st->position[axis] + mm;
+                axis_words = true;
+            }
+        }
+    }
+    if (feed >= 0)
+        st->feed_rate = st->inverse_time ? feed : feed * (st->inches ? MM_PER_INCH : 1.0);
+    if (stop) {
+        sd_estimate_finish(st, 0.0);
+        st->last.entry_speed = 0.0;
+        if (dwell > 0)
+            st->time += dwell;
+    }
+    if (!axis_words)
+        return;
+    float delta[N_AXIS];
+    for (uint8_t idx = 0; idx < N_AXIS; idx++)
+        delta[idx] = target[idx] - st->position[idx];
+    float unit_vec[N_AXIS];
+    memcpy(unit_vec, delta, sizeof(unit_vec));
+    float millimeters = convert_delta_vector_to_unit_vector(unit_vec);
+    if (st->motion == 2 || st->motion == 3) {
+        // The arc length in its plane, with any motion across it as a helix
+        uint8_t a0 = st->plane == 18 ? Z_AXIS : (st->plane == 19 ? Y_AXIS : X_AXIS);
+        uint8_t a1 = st->plane == 18 ? X_AXIS : (st->plane == 19 ? Z_AXIS : Y_AXIS);
+        uint8_t o0 = st->plane == 18 ? 2 : (st->plane == 19 ? 1 : 0);
+        uint8_t o1 = st->plane == 18 ? 0 : (st->plane == 19 ? 2 : 1);
+        float chord = hypot_f(delta[a0], delta[a1]);
+        float r, angle;
+        if (has_radius) {
+            r = fabs(radius);
+            float half = MIN(1.0, chord / (2 * r + 1e-6));
+            angle = 2 * asin(half);
+            if (radius < 0)
+                angle = 2 * M_PI - angle;
+        } else {
+            r = hypot_f(offset[o0], offset[o1]);
+            float start0 = -offset[o0], start1 = -offset[o1];
+            float end0 = delta[a0] - offset[o0], end1 = delta[a1] - offset[o1];
+            angle = atan2(start0 * end1 - start1 * end0, start0 * end0 + start1 * end1);
+            if (st->motion == 2 && angle >= 0)
+                angle -= 2 * M_PI;
+            else if (st->motion == 3 && angle <= 0)
+                angle += 2 * M_PI;
+            angle = fabs(angle);
+        }
+        float across = 0.0;
+        for (uint8_t idx = 0; idx < N_AXIS; idx++) {
+            if (idx != a0 && idx != a1)
+                across += delta[idx] * delta[idx];
+        }
+        millimeters = sqrt(r * angle * r * angle + across);
+    }
+    float nominal_speed;
+    if (st->motion == 0)
+        nominal_speed = SOME_LARGE_VALUE; // Limited to the axis rates
+    else if (st->inverse_time)
+        nominal_speed = millimeters * st->feed_rate;
+    else
+        nominal_speed = st->feed_rate;
+    if (nominal_speed > 0)
+        sd_estimate_motion(st, unit_vec, millimeters, nominal_speed);
+    memcpy(st->position, target, sizeof(st->position));
+}
+
+// Keeps the time at the start of a stride-th line.
+static bool sd_estimate_keep(float seconds) {
+    if (sd_estimate_count == sd_estimate_capacity) {
+        uint32_t capacity = sd_estimate_capacity ? sd_estimate_capacity * 2 : 256;
+        float* times = (float*)realloc(sd_estimate_times, capacity * sizeof(float));
+        if (times == NULL)
+            return false;
+        sd_estimate_times = times;
+        sd_estimate_capacity = capacity;
+    }
+    sd_estimate_times[sd_estimate_count++] = seconds;
+    return true;
+}
+
+static void sdEstimateTask(void* pvParameters) {
+    File file = sd_estimate_fs->open(sd_estimate_path);
+    sd_estimate_state_t st;
+    memset(&st, 0, sizeof(st));
+    system_convert_array_steps_to_mpos(st.position, sys_position);
+    st.motion = 0;
+    st.absolute = true;
+    st.plane = 17;
+    sd_estimate_count = 0;
+    bool ok = file && sd_estimate_keep(0.0);
+    uint8_t buffer[512];
+    char line[256];
+    size_t len = 0;
+    uint32_t lines = 0;
+    while (ok && !sd_estimate_cancel) {
+        int count = file.read(buffer, sizeof(buffer));
+        if (count <= 0)
+            break;
+        for (int i = 0; i < count && ok; i++) {
+            if (buffer[i] != '\n') {
+                if (len < sizeof(line) - 1)
+                    line[len++] = buffer[i];
+                continue;
+            }
+            line[len] = '\0';
+            len = 0;
+            sd_estimate_line(&st, line);
+            if ((++lines % SD_ESTIMATE_STRIDE) == 0)
+                ok = sd_estimate_keep(st.time);
+        }
+    }
+    if (ok && !sd_estimate_cancel) {
+        line[len] = '\0';
+        sd_estimate_line(&st, line);
+        sd_estimate_finish(&st, 0.0);
+        sd_estimate_total = st.time;
+        __atomic_store_n(&sd_estimate_done, true, __ATOMIC_RELEASE);
+    }
+    if (file)
+        file.close();
+    sdEstimateTaskHandle = NULL;
+    vTaskDelete(NULL);
+}
+
+void sd_estimate_start(fs::FS& fs, const char* path) {
+    sd_estimate_stop();
+    while (sdEstimateTaskHandle != NULL)
+        vTaskDelay(1); // The last estimate is still stopping
+    sd_estimate_cancel = false;
+    sd_estimate_done = false;
+    strncpy(sd_estimate_path, path, sizeof(sd_estimate_path) - 1);
+    sd_estimate_path[sizeof(sd_estimate_path) - 1] = '\0';
+    sd_estimate_fs = &fs;
+    task_create(TASK_SD_ESTIMATE, sdEstimateTask, 4096, NULL, &sdEstimateTaskHandle);
+}
+
+void sd_estimate_stop() {
+    sd_estimate_cancel = true;
+    sd_estimate_done = false;
+}
+
+bool sd_estimate_progress(uint32_t line, float* percent, uint32_t* remaining_s) {
+    if (!__atomic_load_n(&sd_estimate_done, __ATOMIC_ACQUIRE) || sd_estimate_total <= 0)
+        return false;
+    uint32_t index = line / SD_ESTIMATE_STRIDE;
+    float done;
+    if (index + 1 < sd_estimate_count) {
+        float from = sd_estimate_times[index];
+        float to = sd_estimate_times[index + 1];
+        done = from + (to - from) * (line % SD_ESTIMATE_STRIDE) / SD_ESTIMATE_STRIDE;
+    } else if (index < sd_estimate_count) {
+        done = sd_estimate_times[index];
+    } else
+        done = sd_estimate_total;
+    done = MIN(done, sd_estimate_total);
+    *percent = done / sd_estimate_total * 100.0;
+    *remaining_s = (uint32_t)(sd_estimate_total - done);
+    return true;
+}
+
+#endif
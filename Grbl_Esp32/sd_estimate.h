@@ -0,0 +1,42 @@
+/*
+  sd_estimate.h - run time estimate of SD jobs for time based progress
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef sd_estimate_h
+#define sd_estimate_h
+
+#ifdef SD_ESTIMATE
+
+// The estimated time to the start of every SD_ESTIMATE_STRIDE-th line is kept. The progress of
+// the lines in between is interpolated.
+#ifndef SD_ESTIMATE_STRIDE
+    #define SD_ESTIMATE_STRIDE 64
+#endif
+
+// Starts estimating the job at path in a low priority task. Called when a job is opened.
+void sd_estimate_start(fs::FS& fs, const char* path);
+
+// Stops the estimate of the job. Safe from any context.
+void sd_estimate_stop();
+
+// Gets the estimated percentage of the job run time before line, and the seconds after it.
+// Returns false while the estimate is not finished.
+bool sd_estimate_progress(uint32_t line, float* percent, uint32_t* remaining_s);
+
+#endif
+
+#endif
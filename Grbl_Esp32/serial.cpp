@@ -56,98 +56,603 @@
 */
 
 #include "grbl.h"
+#include "driver/uart.h"
+#if defined (ENABLE_WIFI) && (defined(ENABLE_TELNET) || defined(TCP_STREAM_SERVER))
+    #define SERIAL_NET_WAIT
+    #include <lwip/sockets.h>
+#endif
 
 portMUX_TYPE myMutex = portMUX_INITIALIZER_UNLOCKED;
 
 static TaskHandle_t serialCheckTaskHandle = 0;
+static QueueHandle_t uart_events;
+static TaskHandle_t serialUartTaskHandle = 0;
+#ifdef SERIAL_NET_WAIT
+static TaskHandle_t serialNetTaskHandle = 0;
+static void serialNetTask(void* pvParameters);
+#endif
+
+#ifdef CLIENT_TX_QUEUES
+static TaskHandle_t clientTxTaskHandles[CLIENT_COUNT]; // One transmit task per client
+static QueueHandle_t tx_queues[CLIENT_COUNT]; // tx_message_t pointers waiting to be sent
+static uint32_t tx_queued_bytes[CLIENT_COUNT]; // Bytes of the messages in each queue
+static uint32_t tx_dropped[CLIENT_COUNT]; // Messages dropped for each client
+static uint32_t tx_dropped_critical[CLIENT_COUNT]; // Of those, the ones not marked droppable
+static bool tx_client_present(uint8_t client);
+static void clientTxTask(void* pvParameters);
+#endif
 
 InputBuffer client_buffer[CLIENT_COUNT];  // create a buffer for each client
+static uint32_t rx_overflows[CLIENT_COUNT]; // Writes to a client buffer that did not fit
 
 // Returns the number of bytes available in a client buffer.
-uint8_t serial_get_rx_buffer_available(uint8_t client) {
+int serial_get_rx_buffer_available(uint8_t client) {
     return client_buffer[client].availableforwrite();
 }
 
+int serial_get_rx_buffer_size(uint8_t client) {
+    return client_buffer[client].capacity();
+}
+
+uint32_t serial_get_rx_overflows(uint8_t client) {
+    return rx_overflows[client];
+}
+
+#ifdef STATIC_MOTION_BUFFERS
+#if SERIAL_STATIC_RX_SIZE < RX_BUFFER_SIZE
+    #error "SERIAL_STATIC_RX_SIZE must be at least RX_BUFFER_SIZE"
+#endif
+static uint8_t client_rx_static[CLIENT_COUNT][SERIAL_STATIC_RX_SIZE];
+#endif
+
+// Sizes the client buffers from the Serial/RxBuffer setting. The size is reduced if all of the
+// buffers would take more than a quarter of the free heap.
+// NOTE: Called once at boot, after the settings are loaded. Changes take effect at the next boot.
+void serial_alloc_buffers() {
+    size_t size = serial_rx_buffer->get();
+#ifdef STATIC_MOTION_BUFFERS
+    // Every client gets the same static buffer, without the larger TCP and BT stream sizes
+    size = constrain(size, RX_BUFFER_SIZE, SERIAL_STATIC_RX_SIZE);
+    for (uint8_t client = 0; client < CLIENT_COUNT; client++) {
+        vTaskEnterCritical(&myMutex);
+        client_buffer[client].replace(client_rx_static[client], size, false);
+        vTaskExitCritical(&myMutex);
+    }
+#else
+    while ((size > RX_BUFFER_SIZE) && ((size * CLIENT_COUNT) > (ESP.getFreeHeap() / 4)))
+        size >>= 1;
+    if (size < RX_BUFFER_SIZE)
+        size = RX_BUFFER_SIZE;
+    for (uint8_t client = 0; client < CLIENT_COUNT; client++) {
+        size_t client_size = size;
+#if defined (ENABLE_WIFI) && defined(TCP_STREAM_SERVER)
+        if (client == CLIENT_TCP)
+            client_size = MAX(size, TCP_STREAM_RX_BUFFER_SIZE); // Lines to run while the window reopens
+#endif
+#if defined (ENABLE_BLUETOOTH) && defined(BT_STREAM)
+        if (client == CLIENT_BT)
+            client_size = MAX(size, BT_STREAM_RX_BUFFER_SIZE);
+#endif
+        // The heap is not used with the lock held, only the pointers are swapped under it
+        uint8_t* storage = NULL;
+        if (client_size > RXBUFFERSIZE) {
+            storage = (uint8_t*)malloc(client_size);
+            if (storage == NULL)
+                continue; // Keep the current buffer
+        }
+        vTaskEnterCritical(&myMutex);
+        uint8_t* old = client_buffer[client].replace(storage, client_size, storage != NULL);
+        vTaskExitCritical(&myMutex);
+        free(old);
+    }
+#endif
+    grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Client RX buffers %d", client_buffer[CLIENT_SERIAL].capacity());
+}
+
+// Wakes serialCheckTask when the UART driver has received data.
+static void serialUartTask(void* pvParameters) {
+    uart_event_t event;
+    while (true) {
+        if (xQueueReceive(uart_events, &event, portMAX_DELAY) != pdTRUE)
+            continue;
+        if (event.type == UART_FIFO_OVF)
+            rx_overflows[CLIENT_SERIAL]++; // The driver has dropped the FIFO
+        serial_notify_data();
+    }
+}
+
+static void serial_uart_init() {
+    uart_config_t uart_config = {
+        .baud_rate = BAUD_RATE,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .rx_flow_ctrl_thresh = 0,
+    };
+    uart_param_config(SERIAL_UART, &uart_config);
+    uart_driver_install(SERIAL_UART, SERIAL_UART_RX_BUFFER, SERIAL_UART_TX_BUFFER, 16, &uart_events, 0);
+    uart_intr_config_t uart_intr = {
+        .intr_enable_mask = UART_RXFIFO_FULL_INT_ENA_M | UART_RXFIFO_TOUT_INT_ENA_M | UART_FRM_ERR_INT_ENA_M |
+                            UART_RXFIFO_OVF_INT_ENA_M | UART_BRK_DET_INT_ENA_M | UART_PARITY_ERR_INT_ENA_M,
+        .rx_timeout_thresh = 2,
+        .txfifo_empty_intr_thresh = 10,
+        .rxfifo_full_thresh = SERIAL_UART_RX_THRESHOLD,
+    };
+    uart_intr_config(SERIAL_UART, &uart_intr);
+    task_create(TASK_SERIAL_UART, serialUartTask, 2048, NULL, &serialUartTaskHandle);
+}
+
+void serial_uart_write(const uint8_t* data, size_t len) {
+    uart_write_bytes(SERIAL_UART, (const char*)data, len);
+}
+
+uint32_t serial_uart_baud_rate() {
+    uint32_t baud_rate = 0;
+    uart_get_baudrate(SERIAL_UART, &baud_rate);
+    return baud_rate;
+}
+
+static size_t serial_uart_available() {
+    size_t len = 0;
+    uart_get_buffered_data_len(SERIAL_UART, &len);
+    return len;
+}
+
+// Reads up to size bytes that the UART driver holds now.
+static size_t serial_uart_take(uint8_t* data, size_t size) {
+    size_t len = MIN(serial_uart_available(), size);
+    if (len == 0)
+        return 0;
+    int read = uart_read_bytes(SERIAL_UART, data, len, 0);
+    return read > 0 ? read : 0;
+}
+
 void serial_init() {
-    Serial.begin(BAUD_RATE);
+    serial_uart_init();
     // reset all buffers
     serial_reset_read_buffer(CLIENT_ALL);
     grbl_send(CLIENT_SERIAL, "\r\n"); // create some white space after ESP32 boot info
+#ifdef CLIENT_TX_QUEUES
+    // A task per client sends its queued messages, so a stalled client only holds up its own
+    // task. Until the tasks run, messages are written directly.
+    for (uint8_t client = 0; client < CLIENT_COUNT; client++) {
+        if (!tx_client_present(client))
+            continue;
+        tx_queues[client] = xQueueCreate(TX_QUEUE_DEPTH, sizeof(tx_message_t*));
+        task_create(TASK_CLIENT_TX, clientTxTask, 3072, (void*)(uintptr_t)client, &clientTxTaskHandles[client]);
+    }
+#endif
     serialCheckTaskHandle = 0;
     // create a task to check for incoming data
-    xTaskCreatePinnedToCore(serialCheckTask,     // task
-                            "serialCheckTask", // name for task
-                            8192,   // size of task stack
-                            NULL,   // parameters
-                            1, // priority
-                            &serialCheckTaskHandle,
-                            1 // core
-                           );
+    task_create(TASK_SERIAL_CHECK, serialCheckTask, 8192, NULL, &serialCheckTaskHandle);
+#ifdef SERIAL_NET_WAIT
+    task_create(TASK_SERIAL_NET, serialNetTask, 2048, NULL, &serialNetTaskHandle);
+#endif
+}
+
+
+#ifdef CLIENT_TX_QUEUES
+static void tx_message_release(tx_message_t* message) {
+    if (__atomic_sub_fetch(&message->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        free(message);
+}
+
+// Returns true for the clients that are compiled in.
+static bool tx_client_present(uint8_t client) {
+    switch (client) {
+    case CLIENT_SERIAL:
+        return true;
+#ifdef ENABLE_BLUETOOTH
+    case CLIENT_BT:
+        return true;
+#endif
+#if defined (ENABLE_WIFI) && defined(ENABLE_HTTP) && defined(ENABLE_SERIAL2SOCKET_OUT)
+    case CLIENT_WEBUI:
+        return true;
+#endif
+#if defined (ENABLE_WIFI) && defined(ENABLE_TELNET)
+    case CLIENT_TELNET:
+        return true;
+#endif
+#if defined (ENABLE_WIFI) && defined(TCP_STREAM_SERVER)
+    case CLIENT_TCP:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+// Returns true if messages for client can be queued now. Clients that are not compiled in or not
+// connected get nothing, as with grbl_send().
+static bool tx_client_active(uint8_t client) {
+    if (!tx_client_present(client) || clientTxTaskHandles[client] == 0)
+        return false;
+#ifdef ENABLE_BLUETOOTH
+    if (client == CLIENT_BT)
+        return SerialBT.hasClient();
+#endif
+    return true;
+}
+
+// Queues message for client, within TX_QUEUE_DEPTH messages and TX_QUEUE_BYTES bytes. A message
+// larger than TX_QUEUE_BYTES still goes into an empty queue.
+static bool tx_queue_push(uint8_t client, tx_message_t* message) {
+    uint32_t queued = __atomic_load_n(&tx_queued_bytes[client], __ATOMIC_ACQUIRE);
+    if (queued != 0 && queued + message->len > TX_QUEUE_BYTES)
+        return false;
+    __atomic_add_fetch(&message->refs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&tx_queued_bytes[client], message->len, __ATOMIC_RELEASE);
+    if (xQueueSend(tx_queues[client], &message, 0) == pdTRUE)
+        return true;
+    __atomic_sub_fetch(&tx_queued_bytes[client], message->len, __ATOMIC_RELEASE);
+    __atomic_sub_fetch(&message->refs, 1, __ATOMIC_RELAXED);
+    return false;
 }
 
+bool serial_tx_queue(uint8_t client, const uint8_t* data, size_t len, bool droppable) {
+    // The transmit tasks write directly, so messages they send while writing cannot wait on
+    // their own queue.
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    for (uint8_t c = 0; c < CLIENT_COUNT; c++) {
+        if (clientTxTaskHandles[c] == task)
+            return false;
+    }
+    if (clientTxTaskHandles[CLIENT_SERIAL] == 0)
+        return false;
+    tx_message_t* message = (tx_message_t*)malloc(sizeof(tx_message_t) + len);
+    if (message == NULL)
+        return false;
+    message->data = (uint8_t*)(message + 1);
+    message->len = len;
+    memcpy(message->data, data, len);
+    message->refs = 1; // The reference of this function, dropped below
+    TickType_t start = xTaskGetTickCount();
+    for (uint8_t c = 0; c < CLIENT_COUNT; c++) {
+        if ((client != CLIENT_ALL && client != c) || !tx_client_active(c))
+            continue;
+        // A droppable message is dropped as soon as the client's queue is full. Any other message
+        // waits up to TX_QUEUE_WAIT_MS for the client to catch up, so a client that stops reading
+        // cannot stall the protocol loop, and with it the planner, for longer than that.
+        while (!tx_queue_push(c, message)) {
+            if (droppable || (xTaskGetTickCount() - start) >= pdMS_TO_TICKS(TX_QUEUE_WAIT_MS)) {
+                __atomic_add_fetch(&tx_dropped[c], 1, __ATOMIC_RELAXED);
+                if (!droppable)
+                    __atomic_add_fetch(&tx_dropped_critical[c], 1, __ATOMIC_RELAXED);
+                break;
+            }
+            vTaskDelay(1);
+        }
+    }
+    tx_message_release(message);
+    return true;
+}
+
+uint32_t serial_tx_dropped(uint8_t client) {
+    return client < CLIENT_COUNT ? __atomic_load_n(&tx_dropped[client], __ATOMIC_RELAXED) : 0;
+}
+
+// Sends the queued messages of one client. The message data is shared with the other clients it
+// was queued for.
+static void clientTxTask(void* pvParameters) {
+    uint8_t client = (uint8_t)(uintptr_t)pvParameters;
+    uint32_t dropped_critical = 0;
+    tx_message_t* message;
+    while (true) {
+        if (xQueueReceive(tx_queues[client], &message, portMAX_DELAY) != pdTRUE)
+            continue;
+        TRACE_BEGIN(TRACE_TX, client);
+        grbl_write_direct(client, message->data, message->len);
+        TRACE_END(TRACE_TX);
+        __atomic_sub_fetch(&tx_queued_bytes[client], message->len, __ATOMIC_RELEASE);
+        tx_message_release(message);
+        // Tell the client when responses it may be waiting for were lost.
+        uint32_t dropped = __atomic_load_n(&tx_dropped_critical[client], __ATOMIC_RELAXED);
+        if (dropped != dropped_critical && uxQueueMessagesWaiting(tx_queues[client]) == 0) {
+            char msg[48];
+            snprintf(msg, sizeof(msg), "[MSG:TX dropped %u messages]\r\n", dropped - dropped_critical);
+            grbl_write_direct(client, (const uint8_t*)msg, strlen(msg));
+            dropped_critical = dropped;
+        }
+    }
+}
+#endif
+
+void serial_notify_data() {
+    if (serialCheckTaskHandle != 0)
+        xTaskNotifyGive(serialCheckTaskHandle);
+}
+
+// Reads up to size bytes that are available now from a client stream.
+template <typename S>
+static size_t serial_take(S& stream, uint8_t* data, size_t size) {
+    size_t len = 0;
+    int avail = stream.available();
+    while (avail-- > 0 && len < size)
+        data[len++] = stream.read();
+    return len;
+}
+
+// Adds received data to the client buffer with one lock.
+static void serial_store(uint8_t client, const uint8_t* data, size_t len) {
+    if (len == 0)
+        return;
+#ifdef RADIO_COEX_POLICY
+    radio_coex_received(client);
+#endif
+    TRACE_MARK(TRACE_RX, len);
+#ifdef LINE_TRACE
+    line_trace_received(client, data, len);
+#endif
+    vTaskEnterCritical(&myMutex);
+    size_t written = client_buffer[client].write(data, len); // Data beyond the free space is dropped, as before
+    vTaskExitCritical(&myMutex);
+    if (written < len)
+        rx_overflows[client]++;
+}
+
+// Acts on a realtime command, or keeps the byte at data[kept]. Returns the new count of kept bytes.
+static size_t serial_filter(uint8_t client, uint8_t* data, size_t kept, uint8_t c) {
+    // Pick off realtime command characters directly from the serial stream. These characters are
+    // not passed into the main buffer, but these set system state flag bits for realtime execution.
+    if (is_realtime_command(c))
+        execute_realtime_command(c, client);
+    else
+        data[kept++] = c;
+    return kept;
+}
+
+#ifdef BINARY_GCODE_FRAMES
+// Binary frames are held until they are complete and checked, because their bytes can look like
+// realtime commands. See protocol.h for how a bad or truncated frame is resynchronized.
+typedef struct {
+    uint8_t data[GC_FRAME_MAX];
+    uint16_t len;     // 0 when the client is not in a frame
+    uint32_t last_us; // When the last byte of the frame was taken
+} serial_frame_t;
+static serial_frame_t serial_frames[CLIENT_COUNT];
+static const uint8_t serial_bad_frame[] = { GC_FRAME_START, 0, 0, 0 }; // An empty frame, answered with error:120
+
+// Longest gap allowed between the bytes of a frame. The UART hands over SERIAL_UART_RX_THRESHOLD
+// bytes at a time and the serial task takes them a tick or two later, so those are added to the
+// character times. Network data comes in packets.
+static uint32_t serial_frame_timeout_us(uint8_t client) {
+    if (client == CLIENT_SERIAL)
+        return (GC_FRAME_TIMEOUT_CHARS + SERIAL_UART_RX_THRESHOLD) * 10 * 1000000UL / BAUD_RATE + 2 * portTICK_PERIOD_MS * 1000;
+    return GC_FRAME_TIMEOUT_PACKET_MS * 1000;
+}
+
+// Gives up a bad frame. The protocol is sent an empty frame in its place, so the sender is
+// answered, and the bytes after its GC_FRAME_START are taken again as ordinary data up to the next
+// GC_FRAME_START, which starts a new frame with the bytes that follow it.
+static void serial_frame_resync(uint8_t client) {
+    serial_frame_t* frame = &serial_frames[client];
+    uint16_t held = frame->len;
+    uint16_t i;
+    size_t kept = 0;
+    serial_store(client, serial_bad_frame, sizeof(serial_bad_frame));
+    for (i = 1; i < held && frame->data[i] != GC_FRAME_START; i++)
+        kept = serial_filter(client, frame->data, kept, frame->data[i]);
+    serial_store(client, frame->data, kept);
+    frame->len = held - i;
+    memmove(frame->data, &frame->data[i], frame->len);
+}
+
+// Passes on the held frame once it is complete. A frame with a bad CRC is given up, as its length
+// byte cannot be trusted either.
+static void serial_frame_check(uint8_t client) {
+    serial_frame_t* frame = &serial_frames[client];
+    while (frame->len >= 2 && frame->len == frame->data[1] + 4) {
+        uint8_t length = frame->data[1];
+        uint16_t crc = (frame->data[2 + length] << 8) | frame->data[3 + length];
+        if (crc == crc16_ccitt(&frame->data[1], length + 1)) {
+            serial_store(client, frame->data, frame->len);
+            frame->len = 0;
+        } else
+            serial_frame_resync(client);
+    }
+}
+
+// Gives up the held frame if its sender stopped partway through it.
+static void serial_frame_expire(uint8_t client, uint32_t now_us) {
+    serial_frame_t* frame = &serial_frames[client];
+    while (frame->len != 0 && now_us - frame->last_us > serial_frame_timeout_us(client)) {
+        serial_frame_resync(client);
+        serial_frame_check(client);
+    }
+}
+
+// Returns the microseconds until the first held frame times out, or UINT32_MAX with none held.
+static uint32_t serial_frame_wait_us(uint32_t now_us) {
+    uint32_t wait_us = UINT32_MAX;
+    for (uint8_t client = 0; client < CLIENT_COUNT; client++) {
+        if (serial_frames[client].len == 0)
+            continue;
+        uint32_t held_us = now_us - serial_frames[client].last_us;
+        uint32_t timeout_us = serial_frame_timeout_us(client);
+        wait_us = MIN(wait_us, held_us < timeout_us ? timeout_us - held_us : 0);
+    }
+    return wait_us;
+}
+#endif
+
+#ifdef SERIAL_NET_WAIT
+// The sockets of the telnet and TCP stream clients, or -1. serialCheckTask, which owns the
+// clients, sets them after it has handled the clients, and serialNetTask waits on them.
+#ifdef ENABLE_TELNET
+    #define SERIAL_NET_TELNET_FDS MAX_TLNT_CLIENTS
+#else
+    #define SERIAL_NET_TELNET_FDS 0
+#endif
+#define SERIAL_NET_FDS (SERIAL_NET_TELNET_FDS + 1)
+static volatile int net_fds[SERIAL_NET_FDS];
+
+static void serial_net_fds_update() {
+    uint8_t n = 0;
+#ifdef ENABLE_TELNET
+    for (uint8_t i = 0; i < MAX_TLNT_CLIENTS; i++)
+        net_fds[n++] = telnet_server.client_fd(i);
+#endif
+#ifdef TCP_STREAM_SERVER
+    net_fds[n++] = tcp_stream_server.client_fd();
+#endif
+    while (n < SERIAL_NET_FDS)
+        net_fds[n++] = -1;
+}
+
+// Wakes serialCheckTask when a telnet or TCP stream socket has data, as lwIP cannot notify it,
+// then waits for serialCheckTask to have read the sockets. Data it had no room for is looked at
+// again a tick later, so a full client buffer is polled as before rather than spun on. New
+// connections are seen by serialCheckTask when it runs, at the latest after SERIAL_IDLE_TICKS.
+static void serialNetTask(void* pvParameters) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY); // Until serialCheckTask has set the sockets
+    while (true) {
+        fd_set readable;
+        int max_fd = -1;
+        FD_ZERO(&readable);
+        for (uint8_t i = 0; i < SERIAL_NET_FDS; i++) {
+            int fd = net_fds[i];
+            if (fd >= 0) {
+                FD_SET(fd, &readable);
+                max_fd = MAX(max_fd, fd);
+            }
+        }
+        if (max_fd < 0) {
+            vTaskDelay(SERIAL_IDLE_TICKS);
+            continue;
+        }
+        struct timeval timeout = { 0, SERIAL_IDLE_TICKS * portTICK_PERIOD_MS * 1000 }; // For a new client
+        int ready = select(max_fd + 1, &readable, NULL, NULL, &timeout);
+        if (ready < 0)
+            vTaskDelay(1); // A socket closed under it. Take the sockets again.
+        if (ready <= 0)
+            continue;
+        ulTaskNotifyTake(pdTRUE, 0); // Drop a notification from before the data came
+        serial_notify_data();
+        ulTaskNotifyTake(pdTRUE, SERIAL_IDLE_TICKS);
+        vTaskDelay(1);
+    }
+}
+#endif
+
+// How long serialCheckTask can sleep when no client wakes it.
+static TickType_t serial_wait_ticks() {
+    uint32_t wait_ms = SERIAL_IDLE_TICKS * portTICK_PERIOD_MS;
+#ifdef BINARY_GCODE_FRAMES
+    wait_ms = MIN(wait_ms, serial_frame_wait_us(esp_timer_get_time()) / 1000 + 1);
+#endif
+#ifdef REPORT_STATUS_PUSH
+    wait_ms = MIN(wait_ms, report_push_status_wait_ms());
+#endif
+#ifdef PLANNER_BLOCK_REPORT
+    wait_ms = MIN(wait_ms, plan_block_report_wait_ms());
+#endif
+#if defined(ENABLE_BLUETOOTH) && defined(BT_STREAM)
+    wait_ms = MIN(wait_ms, bt_config.tx_wait_ms());
+#endif
+    return (wait_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+}
+
+// Acts on the realtime commands in a block of received data, then adds the rest to the client
+// buffer with one lock. Realtime commands are still acted upon before the lines around them.
+static void serial_commit(uint8_t client, uint8_t* data, size_t len) {
+    size_t kept = 0;
+#ifdef BINARY_GCODE_FRAMES
+    serial_frame_t* frame = &serial_frames[client];
+    uint32_t now_us = esp_timer_get_time();
+    serial_frame_expire(client, now_us);
+#endif
+    for (size_t i = 0; i < len; i++) {
+#ifdef BINARY_GCODE_FRAMES
+        if (frame->len != 0 || data[i] == GC_FRAME_START) {
+            if (frame->len == 0) {
+                serial_store(client, data, kept); // The bytes before the frame come first
+                kept = 0;
+            }
+            frame->data[frame->len++] = data[i];
+            frame->last_us = now_us;
+            serial_frame_check(client);
+            continue;
+        }
+#endif
+        kept = serial_filter(client, data, kept, data[i]);
+    }
+    serial_store(client, data, kept);
+}
 
 // this task runs and checks for data on all interfaces
 // REaltime stuff is acted upon, then characters are added to the appropriate buffer
 void serialCheckTask(void* pvParameters) {
-    uint8_t data = 0;
-    uint8_t client = CLIENT_ALL; // who sent the data
+    uint8_t data[RXBUFFERSIZE];
+    size_t len;
     while (true) { // run continuously
         while (any_client_has_data()) {
-            if (Serial.available()) {
-                client = CLIENT_SERIAL;
-                data = Serial.read();
-            } else if (inputBuffer.available()) {
-                client = CLIENT_INPUT;
-                data = inputBuffer.read();
-            } else {
-                //currently is wifi or BT but better to prepare both can be live
+            if ((len = serial_uart_take(data, sizeof(data))) > 0)
+                serial_commit(CLIENT_SERIAL, data, len);
+            if ((len = inputBuffer.read(data, sizeof(data))) > 0)
+                serial_commit(CLIENT_INPUT, data, len);
 #ifdef ENABLE_BLUETOOTH
-                if (SerialBT.hasClient() && SerialBT.available()) {
-                    client = CLIENT_BT;
-                    data = SerialBT.read();
-                    //Serial.write(data);  // echo all data to serial
-                } else {
+            if (SerialBT.hasClient() && (len = serial_take(SerialBT, data, sizeof(data))) > 0) {
+#ifdef BT_STREAM
+                bt_config.count_rx(len);
+#endif
+                serial_commit(CLIENT_BT, data, len);
+            }
 #endif
 #if defined (ENABLE_WIFI) && defined(ENABLE_HTTP)  && defined(ENABLE_SERIAL2SOCKET_IN)
-                    if (Serial2Socket.available()) {
-                        client = CLIENT_WEBUI;
-                        data = Serial2Socket.read();
-                    } else {
+            if ((len = serial_take(Serial2Socket, data, sizeof(data))) > 0)
+                serial_commit(CLIENT_WEBUI, data, len);
 #endif
-#if defined (ENABLE_WIFI) && defined(ENABLE_TELNET)
-                        if (telnet_server.available()) {
-                            client = CLIENT_TELNET;
-                            data = telnet_server.read();
-                        }
+#if defined (ENABLE_WIFI) && defined(ENABLE_HTTP) && defined(WEBSOCKET_STREAM)
+            if ((len = ws_stream_take(data, sizeof(data))) > 0)
+                serial_commit(CLIENT_WEBUI, data, len);
 #endif
-#if defined (ENABLE_WIFI) && defined(ENABLE_HTTP)  && defined(ENABLE_SERIAL2SOCKET_IN)
-                    }
+#if defined (ENABLE_WIFI) && defined(ENABLE_TELNET)
+            if ((len = telnet_server.read(data, sizeof(data))) > 0)
+                serial_commit(CLIENT_TELNET, data, len);
 #endif
-#ifdef ENABLE_BLUETOOTH
-                }
+#if defined (ENABLE_WIFI) && defined(TCP_STREAM_SERVER)
+            if ((len = tcp_stream_server.read(data, sizeof(data))) > 0)
+                serial_commit(CLIENT_TCP, data, len);
 #endif
-            }
-            // Pick off realtime command characters directly from the serial stream. These characters are
-            // not passed into the main buffer, but these set system state flag bits for realtime execution.
-            if (is_realtime_command(data))
-                execute_realtime_command(data, client);
-            else {
-                vTaskEnterCritical(&myMutex);
-                client_buffer[client].write(data);
-                vTaskExitCritical(&myMutex);
-            }
         }  // if something available
         COMMANDS::handle();
+        if (boot_network_ready()) {
+#ifdef RADIO_COEX_POLICY
+            radio_coex_update();
+            if (radio_coex_poll(RADIO_COEX_WIFI))
+#endif
 #ifdef ENABLE_WIFI
-        wifi_config.handle();
+                wifi_config.handle();
+#endif
+#ifdef RADIO_COEX_POLICY
+            if (radio_coex_poll(RADIO_COEX_BT))
 #endif
 #ifdef ENABLE_BLUETOOTH
-        bt_config.handle();
+                bt_config.handle();
 #endif
+        }
 #if defined (ENABLE_WIFI) && defined(ENABLE_HTTP) && defined(ENABLE_SERIAL2SOCKET_IN)
         Serial2Socket.handle_flush();
 #endif
-        vTaskDelay(1 / portTICK_RATE_MS);  // Yield to other tasks
+#ifdef BINARY_GCODE_FRAMES
+        for (uint8_t client = 0; client < CLIENT_COUNT; client++)
+            serial_frame_expire(client, esp_timer_get_time()); // Frames whose sender stopped sending
+#endif
+#ifdef REPORT_STATUS_PUSH
+        report_push_status();
+#endif
+#ifdef PLANNER_BLOCK_REPORT
+        plan_push_block_report();
+#endif
+#ifdef SERIAL_NET_WAIT
+        serial_net_fds_update();
+        if (serialNetTaskHandle != 0)
+            xTaskNotifyGive(serialNetTaskHandle); // The sockets have been read
+#endif
+        // Sleep until a client has data, or something is due. Telnet may have just read some.
+        ulTaskNotifyTake(pdTRUE, any_client_has_data() ? 0 : serial_wait_ticks());
     }  // while(true)
 }
 
@@ -156,11 +661,15 @@ void serial_reset_read_buffer(uint8_t client) {
         if (client == client_num || client == CLIENT_ALL)
             client_buffer[client].begin();
     }
+#if defined (ENABLE_WIFI) && defined(ENABLE_HTTP) && defined(WEBSOCKET_STREAM)
+    if (client == CLIENT_WEBUI || client == CLIENT_ALL)
+        ws_stream_reset();
+#endif
 }
 
 // Writes one byte to the TX serial buffer. Called by main program.
 void serial_write(uint8_t data) {
-    Serial.write((char)data);
+    serial_uart_write(&data, 1);
 }
 
 // Fetches the first byte in the serial read buffer. Called by protocol loop.
@@ -178,16 +687,29 @@ uint8_t serial_read(uint8_t client) {
     }
 }
 
+size_t serial_read_bytes(uint8_t client, uint8_t* data, size_t size) {
+    vTaskEnterCritical(&myMutex);
+    size_t len = client_buffer[client].read(data, size);
+    vTaskExitCritical(&myMutex);
+    return len;
+}
+
 bool any_client_has_data() {
-    return (Serial.available() || inputBuffer.available()
+    return (serial_uart_available() || inputBuffer.available()
 #ifdef ENABLE_BLUETOOTH
             || (SerialBT.hasClient() && SerialBT.available())
 #endif
 #if defined (ENABLE_WIFI) && defined(ENABLE_HTTP) && defined(ENABLE_SERIAL2SOCKET_IN)
             || Serial2Socket.available()
 #endif
+#if defined (ENABLE_WIFI) && defined(ENABLE_HTTP) && defined(WEBSOCKET_STREAM)
+            || ws_stream_ready()
+#endif
 #if defined (ENABLE_WIFI) && defined(ENABLE_TELNET)
             || telnet_server.available()
+#endif
+#if defined (ENABLE_WIFI) && defined(TCP_STREAM_SERVER)
+            || tcp_stream_server.available()
 #endif
            );
 }
@@ -219,6 +741,11 @@ void execute_realtime_command(uint8_t command, uint8_t client) {
         if (sys.state & STATE_JOG)   // Block all other states from invoking motion cancel.
             system_set_exec_state_flag(EXEC_MOTION_CANCEL);
         break;
+#ifdef REPORT_STATUS_FRAMES
+    case CMD_STATUS_FRAME:
+        report_status_frame(client);
+        break;
+#endif
 #ifdef DEBUG
     case CMD_DEBUG_REPORT: {uint8_t sreg = SREG; cli(); bit_true(sys_rt_exec_debug, EXEC_DEBUG_REPORT); SREG = sreg;} break;
 #endif
@@ -26,6 +26,16 @@
 #ifndef RX_BUFFER_SIZE
     #define RX_BUFFER_SIZE 128
 #endif
+// The client receive buffers are sized at boot by the Serial/RxBuffer setting. RX_BUFFER_SIZE is
+// the default and the minimum.
+#ifndef RX_BUFFER_SIZE_MAX
+    #define RX_BUFFER_SIZE_MAX 16384
+#endif
+// Size of each client receive buffer of STATIC_MOTION_BUFFERS builds, which the Serial/RxBuffer
+// setting is limited to. See config.h.
+#ifndef SERIAL_STATIC_RX_SIZE
+    #define SERIAL_STATIC_RX_SIZE 1024
+#endif
 #ifndef TX_BUFFER_SIZE
     #ifdef USE_LINE_NUMBERS
         #define TX_BUFFER_SIZE 112
@@ -36,21 +46,88 @@
 
 #define SERIAL_NO_DATA 0xff
 
+// serialCheckTask sleeps until a client calls serial_notify_data(), until a pushed report or a
+// held binary frame is due, or for at most this many ticks for the web server and WiFi upkeep.
+// Every client notifies it: the UART through the event queue of its driver, and the telnet and
+// TCP stream sockets through serialNetTask.
+#ifndef SERIAL_IDLE_TICKS
+    #define SERIAL_IDLE_TICKS pdMS_TO_TICKS(20)
+#endif
+
+// The UART of CLIENT_SERIAL, run by the ESP-IDF driver rather than HardwareSerial so that its
+// receive events can wake serialCheckTask.
+#define SERIAL_UART UART_NUM_0
+#ifndef SERIAL_UART_RX_BUFFER
+    #define SERIAL_UART_RX_BUFFER 1024
+#endif
+#ifndef SERIAL_UART_TX_BUFFER
+    #define SERIAL_UART_TX_BUFFER 512
+#endif
+// Received bytes the UART FIFO collects before it interrupts. A pause of two characters also
+// interrupts, so this only bounds the latency of a continuous stream.
+#ifndef SERIAL_UART_RX_THRESHOLD
+    #define SERIAL_UART_RX_THRESHOLD 16
+#endif
+
 // a task to read for incoming data from serial port
 void serialCheckTask(void* pvParameters);
+// Wakes serialCheckTask to read new client data. Not for use in an ISR.
+void serial_notify_data();
 
 void serial_write(uint8_t data);
+// Writes to the UART of CLIENT_SERIAL. Waits while its transmit buffer is full.
+void serial_uart_write(const uint8_t* data, size_t len);
+// The baud rate the UART of CLIENT_SERIAL runs at.
+uint32_t serial_uart_baud_rate();
 // Fetches the first byte in the serial read buffer. Called by main program.
 uint8_t serial_read(uint8_t client);
+// Fetches up to size bytes from a client read buffer with one lock. Returns the number of bytes.
+size_t serial_read_bytes(uint8_t client, uint8_t* data, size_t size);
 
 // See if the character is an action command like feedhold or jogging. If so, do the action and return true
 uint8_t check_action_command(uint8_t data);
 
+#ifdef CLIENT_TX_QUEUES
+// Messages and bytes that can wait in the transmit queue of each client.
+#ifndef TX_QUEUE_DEPTH
+    #define TX_QUEUE_DEPTH 32
+#endif
+#ifndef TX_QUEUE_BYTES
+    #define TX_QUEUE_BYTES 2048
+#endif
+// How long a message that is not droppable waits for room in a full queue before it is dropped.
+#ifndef TX_QUEUE_WAIT_MS
+    #define TX_QUEUE_WAIT_MS 50
+#endif
+
+// An outgoing message. It is copied once and queued by reference for every client it goes to.
+// The client that sends it last frees it.
+typedef struct {
+    uint32_t refs;
+    size_t len;
+    uint8_t* data; // Follows the struct in the same allocation
+} tx_message_t;
+
+// Queues len bytes of data for client, or for every connected client with CLIENT_ALL. A droppable
+// message, such as a status report the client asks for again, is dropped for a client whose queue
+// is full. Other messages wait up to TX_QUEUE_WAIT_MS. Returns false if the data was not queued,
+// before the transmit tasks have started or without memory, in which case the caller writes it
+// directly.
+bool serial_tx_queue(uint8_t client, const uint8_t* data, size_t len, bool droppable);
+// Returns the number of messages dropped for client.
+uint32_t serial_tx_dropped(uint8_t client);
+#endif
+
 void serial_init();
+void serial_alloc_buffers(); // Size the client buffers from settings. Called once at boot.
 void serial_reset_read_buffer(uint8_t client);
 
 // Returns the number of bytes available in the RX serial buffer.
-uint8_t serial_get_rx_buffer_available(uint8_t client);
+int serial_get_rx_buffer_available(uint8_t client);
+// Returns the size of the RX serial buffer. Senders counting characters can keep this many in flight.
+int serial_get_rx_buffer_size(uint8_t client);
+// Returns the number of times data for client was dropped because its buffer was full
+uint32_t serial_get_rx_overflows(uint8_t client);
 
 void execute_realtime_command(uint8_t command, uint8_t client);
 bool any_client_has_data();
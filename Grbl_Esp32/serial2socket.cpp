@@ -36,6 +36,10 @@ Serial_2_Socket Serial2Socket;
 Serial_2_Socket::Serial_2_Socket() {
     _web_socket = NULL;
     _TXbufferSize = 0;
+#ifdef SERIAL2SOCKET_ADAPTIVE_FLUSH
+    _TXlineStart = 0;
+    _TXurgent = false;
+#endif
     _RXbufferSize = 0;
     _RXbufferpos = 0;
 }
@@ -47,12 +51,20 @@ Serial_2_Socket::~Serial_2_Socket() {
 }
 void Serial_2_Socket::begin(long speed) {
     _TXbufferSize = 0;
+#ifdef SERIAL2SOCKET_ADAPTIVE_FLUSH
+    _TXlineStart = 0;
+    _TXurgent = false;
+#endif
     _RXbufferSize = 0;
     _RXbufferpos = 0;
 }
 
 void Serial_2_Socket::end() {
     _TXbufferSize = 0;
+#ifdef SERIAL2SOCKET_ADAPTIVE_FLUSH
+    _TXlineStart = 0;
+    _TXurgent = false;
+#endif
     _RXbufferSize = 0;
     _RXbufferpos = 0;
 }
@@ -62,9 +74,15 @@ long Serial_2_Socket::baudRate() {
 }
 
 bool Serial_2_Socket::attachWS(void* web_socket) {
+    if (_socket_mutex == NULL)
+        _socket_mutex = xSemaphoreCreateRecursiveMutex();
     if (web_socket) {
         _web_socket = web_socket;
         _TXbufferSize = 0;
+#ifdef SERIAL2SOCKET_ADAPTIVE_FLUSH
+        _TXlineStart = 0;
+        _TXurgent = false;
+#endif
         return true;
     }
     return false;
@@ -75,6 +93,16 @@ bool Serial_2_Socket::detachWS() {
     return true;
 }
 
+void Serial_2_Socket::lock() {
+    if (_socket_mutex)
+        xSemaphoreTakeRecursive(_socket_mutex, portMAX_DELAY);
+}
+
+void Serial_2_Socket::unlock() {
+    if (_socket_mutex)
+        xSemaphoreGiveRecursive(_socket_mutex);
+}
+
 Serial_2_Socket::operator bool() const {
     return true;
 }
@@ -98,6 +126,7 @@ size_t Serial_2_Socket::write(const uint8_t* buffer, size_t size) {
         return 0;
     }
 #if defined(ENABLE_SERIAL2SOCKET_OUT)
+    lock();
     if (_TXbufferSize == 0)_lastflush = millis();
     //send full line
     if (_TXbufferSize + size > TXBUFFERSIZE) flush();
@@ -105,9 +134,17 @@ size_t Serial_2_Socket::write(const uint8_t* buffer, size_t size) {
     for (int i = 0; i < size; i++) {
         _TXbuffer[_TXbufferSize] = buffer[i];
         _TXbufferSize++;
+#ifdef SERIAL2SOCKET_ADAPTIVE_FLUSH
+        if (buffer[i] == '\n') {
+            if (isUrgentLine(_TXbuffer + _TXlineStart, _TXbufferSize - _TXlineStart))
+                _TXurgent = true;
+            _TXlineStart = _TXbufferSize;
+        }
+#endif
     }
     log_i("[SOCKET]buffer size %d", _TXbufferSize);
     handle_flush();
+    unlock();
 #endif
     return size;
 }
@@ -120,6 +157,7 @@ int Serial_2_Socket::peek(void) {
 bool Serial_2_Socket::push(const char* data) {
 #if defined(ENABLE_SERIAL2SOCKET_IN)
     int data_size = strlen(data);
+    lock();
     if ((data_size + _RXbufferSize) <= RXBUFFERSIZE) {
         int current = _RXbufferpos + _RXbufferSize;
         if (current > RXBUFFERSIZE) current = current - RXBUFFERSIZE;
@@ -129,8 +167,11 @@ bool Serial_2_Socket::push(const char* data) {
             current ++;
         }
         _RXbufferSize += strlen(data);
+        unlock();
+        serial_notify_data();
         return true;
     }
+    unlock();
     return false;
 #else
     return true;
@@ -138,24 +179,46 @@ bool Serial_2_Socket::push(const char* data) {
 }
 
 int Serial_2_Socket::read(void) {
+    int v = -1;
+    lock();
     if (_RXbufferSize > 0) {
-        int v = _RXbuffer[_RXbufferpos];
+        v = _RXbuffer[_RXbufferpos];
         _RXbufferpos++;
         if (_RXbufferpos > (RXBUFFERSIZE - 1))_RXbufferpos = 0;
         _RXbufferSize--;
-        return v;
-    } else return -1;
+    }
+    unlock();
+    return v;
 }
 
+#ifdef SERIAL2SOCKET_ADAPTIVE_FLUSH
+// The responses and the reports are what the WebUI waits for to send the next line or to
+// update its position, so a line of them is sent at once with what came before it.
+bool Serial_2_Socket::isUrgentLine(const uint8_t* line, size_t len) {
+    if (len >= 2 && line[0] == 'o' && line[1] == 'k')
+        return true;
+    if (len >= 1 && line[0] == '<')
+        return true; // Status report
+    return (len >= 6 && memcmp(line, "error:", 6) == 0) || (len >= 6 && memcmp(line, "ALARM:", 6) == 0);
+}
+#endif
+
 void Serial_2_Socket::handle_flush() {
+    lock();
     if (_TXbufferSize > 0) {
+#ifdef SERIAL2SOCKET_ADAPTIVE_FLUSH
+        if (_TXurgent || (_TXbufferSize >= TXBUFFERSIZE) || ((millis() - _lastflush) > SERIAL2SOCKET_COALESCE_MS)) {
+#else
         if ((_TXbufferSize >= TXBUFFERSIZE) || ((millis() - _lastflush) > FLUSHTIMEOUT)) {
+#endif
             log_i("[SOCKET]need flush, buffer size %d", _TXbufferSize);
             flush();
         }
     }
+    unlock();
 }
 void Serial_2_Socket::flush(void) {
+    lock();
     if (_TXbufferSize > 0) {
         //if ((((AsyncWebSocket *)_web_socket)->count() > 0) && (((AsyncWebSocket *)_web_socket)->availableForWriteAll())) {
         log_i("[SOCKET]flush data, buffer size %d", _TXbufferSize);
@@ -167,7 +230,12 @@ void Serial_2_Socket::flush(void) {
         _lastflush = millis();
         //reset buffer
         _TXbufferSize = 0;
+#ifdef SERIAL2SOCKET_ADAPTIVE_FLUSH
+        _TXlineStart = 0;
+        _TXurgent = false;
+#endif
     }
+    unlock();
 }
 
 #endif // ENABLE_WIFI
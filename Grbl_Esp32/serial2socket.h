@@ -26,6 +26,12 @@
 #define TXBUFFERSIZE 1200
 #define RXBUFFERSIZE 128
 #define FLUSHTIMEOUT 500
+#ifdef SERIAL2SOCKET_ADAPTIVE_FLUSH
+// Other output than responses and reports is gathered this long into one frame
+    #ifndef SERIAL2SOCKET_COALESCE_MS
+        #define SERIAL2SOCKET_COALESCE_MS 50
+    #endif
+#endif
 class Serial_2_Socket: public Print {
   public:
     Serial_2_Socket();
@@ -60,11 +66,20 @@ class Serial_2_Socket: public Print {
     operator bool() const;
     bool attachWS(void* web_socket);
     bool detachWS();
+    // Held while the web socket server is used. It may be run by another task than the writers.
+    void lock();
+    void unlock();
   private:
+    SemaphoreHandle_t _socket_mutex = NULL;
     uint32_t _lastflush;
     void* _web_socket;
     uint8_t _TXbuffer[TXBUFFERSIZE];
     uint16_t _TXbufferSize;
+#ifdef SERIAL2SOCKET_ADAPTIVE_FLUSH
+    uint16_t _TXlineStart; // Where the line being written starts in _TXbuffer
+    bool _TXurgent;        // A line that the WebUI waits for is in _TXbuffer
+    static bool isUrgentLine(const uint8_t* line, size_t len);
+#endif
     uint8_t _RXbuffer[RXBUFFERSIZE];
     uint16_t _RXbufferSize;
     uint16_t _RXbufferpos;
@@ -27,6 +27,9 @@
 #ifdef USE_SERVO_AXES
 
 static TaskHandle_t servosSyncTaskHandle = 0;
+#ifdef SERVO_SEGMENT_UPDATE
+static portMUX_TYPE servo_axes_spinlock = portMUX_INITIALIZER_UNLOCKED;
+#endif
 
 #ifdef SERVO_X_PIN
     ServoAxis X_Servo_Axis(X_AXIS, SERVO_X_PIN);
@@ -176,14 +179,7 @@ void init_servos() {
 #endif
 #endif
     // setup a task that will calculate the determine and set the servo positions
-    xTaskCreatePinnedToCore(servosSyncTask,      // task
-                            "servosSyncTask", // name for task
-                            4096,   // size of task stack
-                            NULL,   // parameters
-                            1, // priority
-                            &servosSyncTaskHandle,
-                            0 // core
-                           );
+    task_create(TASK_SERVOS_SYNC, servosSyncTask, 4096, NULL, &servosSyncTaskHandle);
 }
 
 
@@ -230,6 +226,9 @@ void ServoAxis::init() {
     ledcSetup(_channel_num, _pwm_freq, _pwm_resolution_bits);
     ledcAttachPin(_pin_num, _channel_num);
     disable();
+#ifdef SERVO_SEGMENT_UPDATE
+    servo_axis_mask |= bit(_axis); // The ISR holds off until set_location() makes the map
+#endif
 }
 
 void ServoAxis::set_location() {
@@ -241,24 +240,23 @@ void ServoAxis::set_location() {
     float servo_pos, mpos, offset;
     // skip location if we are in alarm mode
     if (_disable_on_alarm && (sys.state == STATE_ALARM)) {
+        _set_segment_hold(true);
         disable();
         return;
     }
     // track the disable status of the steppers if desired.
     if (_disable_with_steppers && get_stepper_disable()) {
+        _set_segment_hold(true);
         disable();
         return;
     }
-    if ((_homing_type == SERVO_HOMING_TARGET) && (sys.state == STATE_HOMING)) {
+    bool homing_target = (_homing_type == SERVO_HOMING_TARGET) && (sys.state == STATE_HOMING);
+    offset = _use_mpos ? 0.0 : gc_state.coord_system[_axis] + gc_state.coord_offset[_axis]; // get the current axis work offset
+    if (homing_target) {
         servo_pos = _homing_position; // go to servos home position
     } else {
         mpos = system_convert_axis_steps_to_mpos(sys_position, _axis);  // get the axis machine position in mm
-        if (_use_mpos)
-            servo_pos = mpos;
-        else {
-            offset = gc_state.coord_system[_axis] + gc_state.coord_offset[_axis]; // get the current axis work offset
-            servo_pos = mpos - offset; // determine the current work position
-        }
+        servo_pos = mpos - offset; // determine the current work position
     }
     // 1. Get the pulse ranges of the servos
     // 2. Invert if selected in the settings
@@ -287,14 +285,95 @@ void ServoAxis::set_location() {
     // apply the calibrations
     servo_pulse_min *= min_pulse_cal;
     servo_pulse_max *= max_pulse_cal;
+#ifdef SERVO_SEGMENT_UPDATE
+    // During motion, the stepper ISR writes the duty as each segment is loaded, so here only the
+    // map is updated for offset and calibration changes. Otherwise the output is written here.
+    if (!homing_target) {
+        float duty_per_mm = (servo_pulse_max - servo_pulse_min) / (_position_max - _position_min);
+        int64_t duty_base_q16 = llroundf((servo_pulse_min - (offset + _position_min) * duty_per_mm) * 65536.0f);
+        int32_t duty_per_step_q16 = lroundf(duty_per_mm / axis_settings[_axis]->steps_per_mm->get() * 65536.0f);
+        portENTER_CRITICAL(&servo_axes_spinlock);
+        _duty_base_q16 = duty_base_q16;
+        _duty_per_step_q16 = duty_per_step_q16;
+        _duty_low = (uint32_t)min(servo_pulse_min, servo_pulse_max);
+        _duty_high = (uint32_t)max(servo_pulse_min, servo_pulse_max);
+        _segment_hold = false;
+        if (!(sys.state & (STATE_CYCLE | STATE_HOLD | STATE_JOG | STATE_SAFETY_DOOR)))
+            segment_write(sys_position[_axis]);
+        portEXIT_CRITICAL(&servo_axes_spinlock);
+        return;
+    }
+    _set_segment_hold(true);
+#endif
     // determine the pulse length
     servo_pulse_len = (uint32_t)mapConstrain(servo_pos, _position_min, _position_max, servo_pulse_min, servo_pulse_max);
     _write_pwm(servo_pulse_len);
 }
 
+#ifdef SERVO_SEGMENT_UPDATE
+// Writes the duty for a position in steps with the map made by set_location().
+// NOTE: Called with servo_axes_spinlock held, from the stepper ISR or servosSyncTask.
+void IRAM_ATTR ServoAxis::segment_write(int32_t steps) {
+    if (_segment_hold)
+        return;
+    int64_t duty = (_duty_base_q16 + (int64_t)_duty_per_step_q16 * steps) >> 16;
+    if (duty < _duty_low)
+        duty = _duty_low;
+    else if (duty > _duty_high)
+        duty = _duty_high;
+    if (duty == _current_duty)
+        return;
+    _current_duty = duty;
+    sys_ledc_write_isr(_channel_num, duty);
+}
+
+// Stops the stepper ISR writing the output, before set_location() writes it itself
+void ServoAxis::_set_segment_hold(bool hold) {
+    portENTER_CRITICAL(&servo_axes_spinlock);
+    _segment_hold = hold;
+    portEXIT_CRITICAL(&servo_axes_spinlock);
+}
+
+// Sends all servo axes the position they will be at when the segment just loaded is done. The
+// duties are written together, and the LEDC takes each new duty at the end of its PWM period,
+// so a segment shorter than the period only moves the servo on to the later target.
+void IRAM_ATTR servo_axes_segment_update(const int32_t* target) {
+    portENTER_CRITICAL_ISR(&servo_axes_spinlock);
+#ifdef SERVO_X_PIN
+    X_Servo_Axis.segment_write(target[X_AXIS]);
+#endif
+#ifdef SERVO_Y_PIN
+    Y_Servo_Axis.segment_write(target[Y_AXIS]);
+#endif
+#ifdef SERVO_Z_PIN
+    Z_Servo_Axis.segment_write(target[Z_AXIS]);
+#endif
+#ifdef SERVO_A_PIN
+    A_Servo_Axis.segment_write(target[A_AXIS]);
+#endif
+#ifdef SERVO_B_PIN
+    B_Servo_Axis.segment_write(target[B_AXIS]);
+#endif
+#ifdef SERVO_C_PIN
+    C_Servo_Axis.segment_write(target[C_AXIS]);
+#endif
+    portEXIT_CRITICAL_ISR(&servo_axes_spinlock);
+}
+#else
+void ServoAxis::_set_segment_hold(bool hold) {}
+#endif
+
 void ServoAxis::_write_pwm(uint32_t duty) {
+#ifdef SERVO_SEGMENT_UPDATE
+    // The stepper ISR may have written the register, so the duty it wrote is the one to compare
+    if (_current_duty == duty)
+        return;
+    _current_duty = duty;
+    ledcWrite(_channel_num, duty);
+#else
     if (ledcRead(_channel_num) != duty)   // only write if it is changing
         ledcWrite(_channel_num, duty);
+#endif
 }
 
 // sets the PWM to zero. This allows most servos to be manually moved
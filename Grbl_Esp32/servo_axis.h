@@ -63,6 +63,9 @@ extern float my_location;
 
 void init_servos();
 void servosSyncTask(void* pvParameters);
+#ifdef SERVO_SEGMENT_UPDATE
+void servo_axes_segment_update(const int32_t* target);
+#endif
 
 
 class ServoAxis {
@@ -77,6 +80,9 @@ class ServoAxis {
     void set_disable_on_alarm(bool disable_on_alarm);
     void set_disable_with_steppers(bool disable_with_steppers);
     void set_use_mpos(bool use_mpos);
+#ifdef SERVO_SEGMENT_UPDATE
+    void segment_write(int32_t steps);
+#endif
 
   private:
     int _axis; // these should be assign in constructor using Grbl X_AXIS type values
@@ -97,9 +103,20 @@ class ServoAxis {
     bool _disable_on_alarm = true;
     bool _disable_with_steppers = false;
     bool _use_mpos = true;
+    uint32_t _current_duty = 0;
+#ifdef SERVO_SEGMENT_UPDATE
+    // The position to duty map of set_location(), as duty = base + steps * per_step, so the
+    // stepper ISR can apply it without floats. Both are 16.16 fixed point.
+    int64_t _duty_base_q16 = 0;
+    int32_t _duty_per_step_q16 = 0;
+    uint32_t _duty_low = 0;
+    uint32_t _duty_high = 0;
+    bool _segment_hold = true; // Leave the output to set_location()
+#endif
 
     bool _validate_cal_settings();
     void _write_pwm(uint32_t duty);
+    void _set_segment_hold(bool hold);
     bool _cal_is_valid(); // checks to see if calibration values are in acceptable range
 
 };
@@ -24,26 +24,82 @@
 
 #include "grbl.h"
 
+// The coordinate data, G54-G59, G28 and G30, is kept in RAM and stored in NVS, a blob per
+// coordinate system. Reads come from RAM. A write is one small NVS entry instead of an EEPROM
+// commit, which rewrites the whole emulated sector. The data is copied from EEPROM at the first
+// boot that finds none in NVS.
+static const char* coord_keys[SETTING_INDEX_NCOORD + 1] = { "G54", "G55", "G56", "G57", "G58", "G59", "G28", "G30" };
+static float coord_data_cache[SETTING_INDEX_NCOORD + 1][N_AXIS];
+static nvs_handle coord_handle = 0;
 
-// Read selected coordinate data from EEPROM. Updates pointed coord_data value.
-uint8_t settings_read_coord_data(uint8_t coord_select, float* coord_data) {
-    uint32_t addr = coord_select * (sizeof(float) * N_AXIS + 1) + EEPROM_ADDR_PARAMETERS;
-    if (!(memcpy_from_eeprom_with_checksum((char*)coord_data, addr, sizeof(float)*N_AXIS))) {
-        // Reset with default zero vector
-        clear_vector_float(coord_data);
-        settings_write_coord_data(coord_select, coord_data);
-        return (false);
+#ifdef FLASH_WRITE_DEFER
+// Coordinate systems written while motion runs, waiting to be stored. A flash write turns off the
+// flash cache, which holds off the stepper ISR and stalls the steps.
+static uint16_t coord_pending_mask = 0;
+#endif
+
+bool settings_motion_active() {
+    return (sys.state & (STATE_CYCLE | STATE_HOLD | STATE_HOMING | STATE_SAFETY_DOOR | STATE_JOG)) ||
+           plan_get_current_block() != NULL;
+}
+
+static void settings_store_coord_data(uint8_t coord_select) {
+    if (nvs_set_blob(coord_handle, coord_keys[coord_select], coord_data_cache[coord_select], sizeof(float) * N_AXIS) != ESP_OK ||
+        nvs_commit(coord_handle) != ESP_OK)
+        grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Cannot store %s", coord_keys[coord_select]);
+}
+
+// Loads the coordinate data into RAM. Called once at boot, after EEPROM.begin().
+void settings_init_coord_data() {
+    if (esp_err_t err = nvs_open("Grbl_ESP32", NVS_READWRITE, &coord_handle)) {
+        grbl_sendf(CLIENT_SERIAL, "nvs_open failed with error %d\r\n", err);
+        return;
+    }
+    for (uint8_t coord_select = 0; coord_select <= SETTING_INDEX_NCOORD; coord_select++) {
+        float* coord_data = coord_data_cache[coord_select];
+        size_t len = sizeof(float) * N_AXIS;
+        if (nvs_get_blob(coord_handle, coord_keys[coord_select], coord_data, &len) == ESP_OK && len == sizeof(float) * N_AXIS)
+            continue;
+        uint32_t addr = coord_select * (sizeof(float) * N_AXIS + 1) + EEPROM_ADDR_PARAMETERS;
+        if (!(memcpy_from_eeprom_with_checksum((char*)coord_data, addr, sizeof(float)*N_AXIS)))
+            clear_vector_float(coord_data);
+        settings_store_coord_data(coord_select);
     }
+}
+
+#ifdef FLASH_WRITE_DEFER
+// Stores the coordinate data written during motion. Called from the main loop.
+void settings_flush_deferred() {
+    if (coord_pending_mask == 0 || settings_motion_active())
+        return;
+    for (uint8_t coord_select = 0; coord_select <= SETTING_INDEX_NCOORD; coord_select++) {
+        if (coord_pending_mask & bit(coord_select)) {
+            coord_pending_mask &= ~bit(coord_select);
+            settings_store_coord_data(coord_select);
+        }
+    }
+}
+#endif
+
+// Read selected coordinate data. Updates pointed coord_data value.
+uint8_t settings_read_coord_data(uint8_t coord_select, float* coord_data) {
+    memcpy(coord_data, coord_data_cache[coord_select], sizeof(float) * N_AXIS);
     return (true);
 }
 
-// Method to store coord data parameters into EEPROM
+// Method to store coord data parameters
 void settings_write_coord_data(uint8_t coord_select, float* coord_data) {
-#ifdef FORCE_BUFFER_SYNC_DURING_EEPROM_WRITE
+    memcpy(coord_data_cache[coord_select], coord_data, sizeof(float) * N_AXIS);
+#ifdef FLASH_WRITE_DEFER
+    if (settings_motion_active()) {
+        coord_pending_mask |= bit(coord_select);
+        return;
+    }
+    coord_pending_mask &= ~bit(coord_select);
+#elif defined(FORCE_BUFFER_SYNC_DURING_EEPROM_WRITE)
     protocol_buffer_synchronize();
 #endif
-    uint32_t addr = coord_select * (sizeof(float) * N_AXIS + 1) + EEPROM_ADDR_PARAMETERS;
-    memcpy_to_eeprom_with_checksum(addr, (char*)coord_data, sizeof(float)*N_AXIS);
+    settings_store_coord_data(coord_select);
 }
 
 // Method to store build info into EEPROM
@@ -42,6 +42,11 @@
     #define SETTINGS_RESTORE_ALL 0xFF // All bitflags
 #endif
 
+// SPIFFS file of $Settings/Export and $Settings/Import without a path
+#ifndef SETTINGS_BUNDLE_PATH
+    #define SETTINGS_BUNDLE_PATH "/settings.txt"
+#endif
+
 // Define EEPROM memory address location values for Grbl settings and parameters
 // NOTE: The Atmega328p has 1KB EEPROM. The upper half is reserved for parameters and
 // the startup script. The lower half contains the global settings and space for future
@@ -63,17 +68,33 @@
 // Initialize the configuration subsystem (load settings from EEPROM)
 void settings_init();
 void settings_restore(uint8_t restore_flag);
+
+// Batch setting changes into one commit. See ProcessSettings.cpp.
+void settings_begin();
+uint8_t settings_commit();
+void settings_abort();
 void write_global_settings();
 
 uint8_t settings_read_build_info(char* line);
 void settings_store_build_info(const char* line);
 
-// Writes selected coordinate data to EEPROM
+// Loads the coordinate data from NVS into RAM, moving it from EEPROM the first time
+void settings_init_coord_data();
+
+// Writes selected coordinate data to RAM and NVS
 void settings_write_coord_data(uint8_t coord_select, float* coord_data);
 
-// Reads selected coordinate data from EEPROM
+// Reads selected coordinate data from RAM
 uint8_t settings_read_coord_data(uint8_t coord_select, float* coord_data);
 
+#ifdef FLASH_WRITE_DEFER
+// Stores the coordinate data that was written during motion, once motion has stopped
+void settings_flush_deferred();
+#endif
+
+// Returns true while the steppers may be running, when a flash write would stall them
+bool settings_motion_active();
+
 // Returns the step pin mask according to Grbl's internal axis numbering
 uint8_t get_step_pin_mask(uint8_t i);
 
@@ -42,14 +42,7 @@ void solenoid_init() {
     ledcAttachPin(SOLENOID_PEN_PIN, solenoid_pwm_chan_num);
     solenoid_disable(); // start it it off
     // setup a task that will calculate the determine and set the servo position
-    xTaskCreatePinnedToCore(solenoidSyncTask,     // task
-                            "solenoidSyncTask", // name for task
-                            4096,   // size of task stack
-                            NULL,   // parameters
-                            1, // priority
-                            &solenoidSyncTaskHandle,
-                            0 // core
-                           );
+    task_create(TASK_SOLENOID_SYNC, solenoidSyncTask, 4096, NULL, &solenoidSyncTaskHandle);
 }
 
 // turn off the PWM (0 duty)
@@ -58,26 +51,27 @@ void solenoid_disable() {
 }
 
 // this is the task
+// It sleeps until the stepper ISR sees Z cross zero, see pen_z_crossed_isr(). Only while the
+// pull-in power is on does it wake every SOLENOID_TIMER_INT_FREQ to count it down.
 void solenoidSyncTask(void* pvParameters) {
     int32_t current_position[N_AXIS]; // copy of current location
     float m_pos[N_AXIS];   // machine position in mm
-    TickType_t xLastWakeTime;
-    const TickType_t xSolenoidFrequency = SOLENOID_TIMER_INT_FREQ;  // in ticks (typically ms)
-    uint16_t solenoid_delay_counter = 0;
-    xLastWakeTime = xTaskGetTickCount(); // Initialise the xLastWakeTime variable with the current time.
+    vTaskDelay((SOLENOID_TURNON_DELAY + 1) * SOLENOID_TIMER_INT_FREQ); // startup delay
+    solenoid_pen_enable = true;
     while (true) { // don't ever return from this or the task dies
-        if (!solenoid_pen_enable) {
-            solenoid_delay_counter++;
-            solenoid_pen_enable = (solenoid_delay_counter > SOLENOID_TURNON_DELAY);
-        } else {
-            memcpy(current_position, sys_position, sizeof(sys_position)); // get current position in step
-            system_convert_array_steps_to_mpos(m_pos, current_position); // convert to millimeters
-            calc_solenoid(m_pos[Z_AXIS]); // calculate kinematics and move the servos
-        }
-        vTaskDelayUntil(&xLastWakeTime, xSolenoidFrequency);
+        memcpy(current_position, sys_position, sizeof(sys_position)); // get current position in step
+        system_convert_array_steps_to_mpos(m_pos, current_position); // convert to millimeters
+        calc_solenoid(m_pos[Z_AXIS]); // calculate kinematics and move the servos
+        bool pulling = (ledcRead(solenoid_pwm_chan_num) == SOLENOID_PULSE_LEN_UP);
+        ulTaskNotifyTake(pdTRUE, pulling ? SOLENOID_TIMER_INT_FREQ : SOLENOID_STATE_CHECK_TICKS);
     }
 }
 
+void IRAM_ATTR pen_z_crossed_isr() {
+    if (solenoidSyncTaskHandle)
+        vTaskNotifyGiveFromISR(solenoidSyncTaskHandle, NULL);
+}
+
 // calculate and set the PWM value for the servo
 void calc_solenoid(float penZ) {
     uint32_t solenoid_pen_pulse_len;
@@ -60,6 +60,16 @@
     #define SOLENOID_TIMER_INT_FREQ 50
 #endif
 
+// The pen task sleeps until the stepper sees Z cross zero. It also looks every this many
+// ticks, for alarms and for positions set without steps, like homing.
+#ifndef SOLENOID_STATE_CHECK_TICKS
+    #define SOLENOID_STATE_CHECK_TICKS 500
+#endif
+
+#ifdef USE_PEN_SOLENOID
+    #define PEN_Z_EVENTS // Also defined by machines with their own pen code, like atari_1020.h
+#endif
+
 #ifndef solenoid_h
     #define solenoid_h
 
@@ -68,4 +78,7 @@
     void solenoidSyncTask(void* pvParameters);
     void calc_solenoid(float penZ);
 
+    // Called by the stepper ISR when Z crosses zero, with PEN_Z_EVENTS
+    void pen_z_crossed_isr();
+
 #endif
@@ -0,0 +1,102 @@
+/*
+  spindle_capture.cpp - per segment record of the spindle output, for checking laser power
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef SPINDLE_CAPTURE
+
+// One segment. time is esp_timer_get_time() microseconds, truncated to 32 bits. Only differences
+// are reported, which are right across the wrap.
+typedef struct {
+    uint32_t time;
+    uint32_t duty;    // The duty written, 0 for spindles without a segment duty
+    uint16_t rpm;     // The speed after rate adjust, the override and the limits
+    float feed_rate;  // The mean speed of the segment, mm/min
+} capture_record_t;
+static capture_record_t capture_records[SPINDLE_CAPTURE_SIZE];
+static volatile uint16_t capture_next = 0;
+static volatile uint16_t capture_count = 0;
+static volatile bool capture_on = false;
+static bool capture_held_on = false; // capture_on when spindle_capture_hold() paused it
+
+const char* const spindle_capture_header = "time_us,rpm,duty,feed_mm_min";
+
+void spindle_capture_start() {
+    capture_on = false;
+    capture_next = 0;
+    capture_count = 0;
+    capture_on = true;
+}
+
+void spindle_capture_stop() {
+    capture_on = false;
+}
+
+bool spindle_capture_running() {
+    return capture_on;
+}
+
+void IRAM_ATTR spindle_capture_segment(uint32_t rpm, uint32_t duty, float feed_rate) {
+    if (!capture_on)
+        return;
+    capture_record_t* record = &capture_records[capture_next];
+    record->time = (uint32_t)esp_timer_get_time();
+    record->duty = duty;
+    record->rpm = rpm;
+    record->feed_rate = feed_rate;
+    capture_next = (capture_next + 1) % SPINDLE_CAPTURE_SIZE;
+    if (capture_count < SPINDLE_CAPTURE_SIZE)
+        capture_count++;
+}
+
+uint16_t spindle_capture_hold() {
+    capture_held_on = capture_on;
+    capture_on = false;
+    // The ISR runs on the other core and may be inside spindle_capture_segment(). It is done
+    // within microseconds, so one tick is enough for the records to be still.
+    vTaskDelay(1);
+    return capture_count;
+}
+
+bool spindle_capture_csv(uint16_t index, char* line, size_t size) {
+    if (index >= capture_count)
+        return false;
+    uint16_t first = (capture_next + SPINDLE_CAPTURE_SIZE - capture_count) % SPINDLE_CAPTURE_SIZE;
+    const capture_record_t* record = &capture_records[(first + index) % SPINDLE_CAPTURE_SIZE];
+    snprintf(line, size, "%u,%u,%u,%.1f\r\n",
+             record->time - capture_records[first].time,
+             record->rpm,
+             record->duty,
+             record->feed_rate);
+    return true;
+}
+
+void spindle_capture_release() {
+    capture_on = capture_held_on;
+}
+
+void spindle_capture_report(uint8_t client) {
+    char line[48];
+    uint16_t count = spindle_capture_hold();
+    grbl_sendf(client, "%s\r\n", spindle_capture_header);
+    for (uint16_t i = 0; i < count && spindle_capture_csv(i, line, sizeof(line)); i++)
+        grbl_send(client, line);
+    spindle_capture_release();
+}
+
+#endif
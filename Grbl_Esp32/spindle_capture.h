@@ -0,0 +1,52 @@
+/*
+  spindle_capture.h - per segment record of the spindle output, for checking laser power
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef spindle_capture_h
+#define spindle_capture_h
+
+#ifdef SPINDLE_CAPTURE
+
+// The number of segment records kept. The oldest are overwritten.
+#ifndef SPINDLE_CAPTURE_SIZE
+    #define SPINDLE_CAPTURE_SIZE 512
+#endif
+
+void spindle_capture_start(); // Clears the records and starts recording
+void spindle_capture_stop();
+bool spindle_capture_running();
+
+// Stepper ISR side. Records the output of a segment as it is loaded.
+void spindle_capture_segment(uint32_t rpm, uint32_t duty, float feed_rate);
+
+// Reading side. spindle_capture_hold() pauses the recording, so the records stay still while
+// they are read, and returns their number. spindle_capture_csv() formats record index, 0 being
+// the oldest, as a CSV line and returns false past the last one. spindle_capture_release()
+// resumes the recording if it was running.
+uint16_t spindle_capture_hold();
+bool spindle_capture_csv(uint16_t index, char* line, size_t size);
+void spindle_capture_release();
+
+// The first line of the CSV, naming the columns
+extern const char* const spindle_capture_header;
+
+// Sends the records as CSV lines to client. See $Spindle/Capture.
+void spindle_capture_report(uint8_t client);
+
+#endif
+
+#endif
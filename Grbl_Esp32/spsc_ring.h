@@ -0,0 +1,91 @@
+/*
+  spsc_ring.h - single-producer/single-consumer ring buffer indexing
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef spsc_ring_h
+#define spsc_ring_h
+
+// A lock-free ring of slots shared by exactly one producer and one consumer, such as the
+// segment prep code and the stepper ISR. The producer fills the slot returned by
+// producer_slot() and then calls push(). The consumer reads the slot returned by
+// consumer_slot() and then calls pop(). The ring holds at most size - 1 entries.
+//
+// push() publishes the head index with release semantics and consumer_slot() reads it with
+// acquire semantics, so everything the producer wrote before push() is visible to the
+// consumer, even when they run on different cores. The same holds for pop() and the tail.
+//
+// NOTE: The GCC __atomic builtins are used rather than std::atomic, because they always compile
+// to inline instructions (memw on the Xtensa). With the accessors forced inline, this keeps the
+// ring usable from code running in IRAM.
+#define SPSC_INLINE inline __attribute__((always_inline))
+
+template <typename T, typename Index = uint8_t>
+class SPSCRing {
+  public:
+    // Attaches the slot storage. Must be called before use and while nothing is running.
+    void init(T* slots, Index size) {
+        _slots = slots;
+        _size = size;
+        reset();
+    }
+
+    // Empties the ring. Only safe when neither side is running.
+    void reset() {
+        __atomic_store_n(&_head, 0, __ATOMIC_RELEASE);
+        __atomic_store_n(&_tail, 0, __ATOMIC_RELEASE);
+    }
+
+    SPSC_INLINE Index size() const { return _size; }
+
+    // Producer side.
+    SPSC_INLINE bool full() const { return next(_head) == __atomic_load_n(&_tail, __ATOMIC_ACQUIRE); }
+    SPSC_INLINE T* producer_slot() const { return &_slots[_head]; }
+    SPSC_INLINE void push() { __atomic_store_n(&_head, next(_head), __ATOMIC_RELEASE); }
+    // The slot pushed back pushes ago, with 1 for the last one. The consumer may be reading the
+    // oldest entry, so only an entry newer than that can be changed.
+    SPSC_INLINE T* pushed_slot(Index back) const { return &_slots[_head >= back ? _head - back : _head + _size - back]; }
+
+    // Consumer side. Returns NULL if the ring is empty.
+    SPSC_INLINE T* consumer_slot() const {
+        if (__atomic_load_n(&_head, __ATOMIC_ACQUIRE) == _tail)
+            return NULL;
+        return &_slots[_tail];
+    }
+    SPSC_INLINE void pop() { __atomic_store_n(&_tail, next(_tail), __ATOMIC_RELEASE); }
+
+    // Consumer side. The number of entries the consumer can read now.
+    SPSC_INLINE Index count() const {
+        Index head = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+        return head >= _tail ? head - _tail : head + _size - _tail;
+    }
+
+    // Returns the index following index, wrapping at the ring size.
+    SPSC_INLINE Index next(Index index) const {
+        index++;
+        if (index == _size)
+            index = 0;
+        return index;
+    }
+
+  private:
+    T* _slots = NULL;
+    Index _size = 0;
+    Index _head = 0; // Written only by the producer
+    Index _tail = 0; // Written only by the consumer
+};
+
+#endif
@@ -24,10 +24,15 @@
 */
 
 #include "grbl.h"
+#include "spsc_ring.h"
+
+#if defined(INPUT_SHAPING) || defined(BACKLASH_COMPENSATION)
+    #define SEGMENT_BLOCKS
+#endif
 
 // Stores the planner block Bresenham algorithm execution data for the segments in the segment
 // buffer. Normally, this buffer is partially in-use, but, for the worst case scenario, it will
-// never exceed the number of accessible stepper buffer segments (SEGMENT_BUFFER_SIZE-1).
+// never exceed the number of accessible stepper buffer segments (segment_ring.size()-1).
 // NOTE: This data is copied from the prepped planner blocks so that the planner blocks may be
 // discarded when entirely consumed and completed by the segment buffer. Also, AMASS alters this
 // data for its own use.
@@ -36,8 +41,40 @@ typedef struct {
     uint32_t step_event_count;
     uint8_t direction_bits;
     uint8_t is_pwm_rate_adjusted; // Tracks motions that require constant laser power/rate
+    uint8_t coolant; // Coolant flags the pins switch to as the block starts, or COOLANT_NO_CHANGE
+#ifdef USE_RMT_STEP_TRAINS
+    uint8_t train_axis; // The only axis with steps, or RMT_TRAIN_NONE
+#endif
+#ifdef LASER_RASTER
+    const raster_line_t* raster; // Pixel powers of a raster block, or NULL
+    uint64_t raster_width;       // Step events per pixel, as 48.16 fixed point
+#endif
+#ifdef PROBE_SEQUENCE
+    bool probe; // Arms the probe monitor as the block starts
+#endif
+#ifdef BACKLASH_COMPENSATION
+    uint16_t uncounted[N_AXIS]; // Backlash steps of the axes, which take up the slack and leave sys_position alone
+#endif
 } st_block_t;
-static st_block_t st_block_buffer[SEGMENT_BUFFER_SIZE - 1];
+#define COOLANT_NO_CHANGE 0xff
+static st_block_t* st_block_buffer;
+
+#ifdef SEGMENT_BLOCKS
+// While shaping or taking up backlash, each segment has block data of its own, with the steps of
+// the axes over the segment. Their indices are marked with ST_SEGMENT_BLOCK. See
+// st_segment_own_block().
+#define ST_SEGMENT_BLOCK 0x80
+static st_block_t* st_segment_blocks; // One per segment of the segment buffer
+#endif
+
+// The block data of a segment
+static inline IRAM_ATTR st_block_t* st_segment_block(uint8_t st_block_index) {
+#ifdef SEGMENT_BLOCKS
+    if (st_block_index & ST_SEGMENT_BLOCK)
+        return &st_segment_blocks[st_block_index & ~ST_SEGMENT_BLOCK];
+#endif
+    return &st_block_buffer[st_block_index];
+}
 
 // Primary stepper segment ring buffer. Contains small, short line segments for the stepper
 // algorithm to execute, which are "checked-out" incrementally from the first block in the
@@ -53,25 +90,24 @@ typedef struct {
     uint8_t prescaler;      // Without AMASS, a prescaler is required to adjust for slow timing.
 #endif
     uint16_t spindle_rpm;  // TODO get rid of this.
+    uint16_t spindle_speed; // spindle_rpm after the override and limits, when the spindle has segment_duty
+    uint32_t spindle_duty;  // The PWM duty of spindle_speed, written by the ISR as the segment starts
+#ifdef SPINDLE_CAPTURE
+    float feed_rate;        // Mean speed of the segment, mm/min
+#endif
 } segment_t;
-static segment_t segment_buffer[SEGMENT_BUFFER_SIZE];
+static segment_t* segment_buffer; // Sized at boot from the Stepper/Segments setting. See st_alloc_buffers().
 
 // Stepper ISR data struct. Contains the running data for the main stepper ISR.
 typedef struct {
     // Used by the bresenham line algorithm
-    uint32_t counter_x,        // Counter variables for the bresenham line tracer
-             counter_y,
-             counter_z
-#if (N_AXIS > A_AXIS)
-             , counter_a
-#endif
-#if (N_AXIS > B_AXIS)
-             , counter_b
+    uint32_t counter[N_AXIS];  // Counter variables for the bresenham line tracer
+#ifdef BACKLASH_COMPENSATION
+    uint16_t uncounted[N_AXIS]; // Backlash steps left in the executing segment
 #endif
-#if (N_AXIS > C_AXIS)
-             , counter_c
+#ifdef DEFER_POSITION_UPDATES
+    int32_t position_delta[N_AXIS]; // Steps taken in the executing segment, not yet added to sys_position
 #endif
-             ;
 #ifdef STEP_PULSE_DELAY
     uint8_t step_bits;  // Stores out_bits output to complete the step pulse delay
 #endif
@@ -85,29 +121,77 @@ typedef struct {
 #endif
 
     uint16_t step_count;       // Steps remaining in line segment motion
+#ifdef USE_RMT_STEP_TRAINS
+    uint8_t train_len;             // Pulses of the train to output with step_outbits. 0 for single steps.
+    uint16_t train_cycles;         // Step period of that train in timer ticks
+    uint32_t train_output_cycles;  // Duration of the train output this tick, 0 if none
+    bool period_stretched;         // The timer period is set to the duration of a train
+#endif
+    bool dir_setup_hold;      // The steps of this tick wait for the direction setup time
+#ifdef LASER_RASTER
+    const raster_line_t* raster_line; // The raster line last started. Released when the next one starts.
+    bool raster_on;                   // The executing block is a raster block
+    uint16_t raster_pixel;            // The pixel being burnt
+    uint64_t raster_position;         // Step events into the block, as 48.16 fixed point
+    uint64_t raster_next;             // Where the next pixel starts
+    uint64_t raster_increment;        // Step events per ISR tick of the executing segment
+#endif
     uint8_t exec_block_index; // Tracks the current st_block index. Change indicates new block.
     st_block_t* exec_block;   // Pointer to the block data for the segment being executed
     segment_t* exec_segment;  // Pointer to the segment being executed
 } stepper_t;
 static stepper_t st;
 
-// Step segment ring buffer indices
-static volatile uint8_t segment_buffer_tail;
-static uint8_t segment_buffer_head;
-static uint8_t segment_next_head;
+// Step segment ring buffer indices. Segment prep is the producer and the stepper ISR the consumer.
+// NOTE: The st_block_buffer data of a segment is written before the segment is pushed, so it is
+// published to the ISR by the same release.
+static SPSCRing<segment_t> segment_ring;
 
 // Step and direction port invert masks.
 static uint8_t step_port_invert_mask;
 static uint8_t dir_port_invert_mask;
 
+static uint8_t dir_applied_bits = 0xff; // Last direction bits set on the pins. Kept across st_reset().
+
 // Used to avoid ISR nesting of the "Stepper Driver Interrupt". Should never occur though.
 static volatile uint8_t busy;
 
+#ifdef USE_I2S_OUT_STREAM
+// Steps pushed into each I2S DMA buffer while probing. The I2S task fills the buffers ahead of the
+// motors, so these tell the steps still queued from those already sent. Indexed by DMA buffer.
+static int32_t i2s_buffer_steps[I2S_OUT_DMABUF_COUNT_MAX][N_AXIS];
+static uint32_t i2s_fill_buffer; // The DMA buffer the stepper ISR is pushing into
+#endif
+
 // Pointers for the step segment being prepped from the planner buffer. Accessed only by the
 // main program. Pointers may be planning segments or planner blocks ahead of what being executed.
 static plan_block_t* pl_block;     // Pointer to the planner block being prepped
 static st_block_t* st_prep_block;  // Pointer to the stepper block data being prepped
 
+#ifdef USE_SEGMENT_PREP_TASK
+// The segment prep task refills the segment buffer whenever the stepper ISR frees a segment. The
+// prep lock keeps the planner from changing the buffered blocks while a segment is being prepped.
+static TaskHandle_t segmentPrepTaskHandle = 0;
+static SemaphoreHandle_t prep_mutex = NULL;
+#endif
+
+#ifdef SEGMENT_BLOCKS
+static bool segment_blocks;          // The segments being prepped have block data of their own
+static uint8_t segment_block_index;  // Index of the last of those
+static uint8_t segment_source_index; // The st_block_buffer block the last of those was prepped from
+#endif
+#ifdef INPUT_SHAPING
+static bool shaping;                // The segments being prepped are shaped. Only changes with the shaper idle.
+static segment_t shaped_last;       // The last segment prepped. The delayed motion after it keeps its spindle.
+#endif
+#ifdef BACKLASH_COMPENSATION
+// The slack of each axis is taken up by extra steps in the segments after the axis reverses,
+// spread over BACKLASH_SEGMENTS of them. The directions are kept across st_reset().
+static bool backlash;                     // Some axis has backlash. Only changes at a new block.
+static uint32_t backlash_pending[N_AXIS]; // Of the slack still to take up
+static int8_t backlash_dir[N_AXIS];       // The way the axis last moved, 0 before its first motion
+#endif
+
 // esp32 work around for diable in main loop
 uint64_t stepper_idle_counter; // used to count down until time to disable stepper drivers
 bool stepper_idle;
@@ -143,10 +227,56 @@ typedef struct {
     float inv_rate;    // Used by PWM laser mode to speed up segment calculations.
     //uint16_t current_spindle_pwm;  // todo remove
     float current_spindle_rpm;
-
+    uint8_t coolant;   // Coolant flags of the last block prepared, for st_block_t.coolant
+
+    // Smoothstep ramp state. See st_scurve_ramp_begin().
+    bool scurve;            // Ramps of the current profile follow a smoothstep
+    float ramp_start_mm;    // Ramp start measured from end of block (mm)
+    float ramp_v0;          // Speed at ramp start (mm/min)
+    float ramp_dv;          // Speed change over the ramp (mm/min)
+    float ramp_time;        // Ramp duration (min)
+    float ramp_elapsed;     // Time into the ramp (min)
+#ifdef RETIME_QUEUED_SEGMENTS
+    uint8_t cruise_segments; // Segments at the end of the buffer that cruise at current_speed
+#endif
 } st_prep_t;
 static st_prep_t prep;
 
+// Starts a smoothstep acceleration or deceleration ramp from start_mm to end_mm, measured from the
+// end of the block, going from speed v0 to v1. The speed follows v0 + (v1 - v0) * (3u^2 - 2u^3),
+// where u is the fraction of the ramp time, so acceleration rises from zero and falls back to it
+// instead of stepping. This is not jerk limited: there is no jerk setting, and the jerk is that of
+// the ramp length. The average speed is (v0 + v1) / 2, as for the trapezoidal ramp, so the ramp
+// takes the same time over the same distance and the planned junction speeds are unchanged.
+// NOTE: The peak acceleration, at mid-ramp, is 1.5 times that of the trapezoidal ramp. The
+// planner plans these blocks at 2/3 of the axis acceleration, so the peak stays within $12x.
+// The acceleration is zero at the end of each ramp, so also at each block junction.
+static void st_scurve_ramp_begin(float start_mm, float end_mm, float v0, float v1) {
+    prep.ramp_start_mm = start_mm;
+    prep.ramp_v0 = v0;
+    prep.ramp_dv = v1 - v0;
+    prep.ramp_time = (v0 + v1 > 0.0f) ? 2.0f * (start_mm - end_mm) / (v0 + v1) : 0.0f;
+    prep.ramp_elapsed = 0.0f;
+}
+
+// Advances the smoothstep ramp by *time_var and updates the current speed and *mm_remaining. Returns
+// true if the ramp ends within *time_var, which is then trimmed to the time left in the ramp. The
+// caller sets the exact ramp end position and speed.
+static bool st_scurve_ramp_advance(float* time_var, float* mm_remaining) {
+    float t = prep.ramp_elapsed + *time_var;
+    if (t >= prep.ramp_time) {
+        *time_var = prep.ramp_time - prep.ramp_elapsed;
+        prep.ramp_elapsed = prep.ramp_time;
+        return true;
+    }
+    prep.ramp_elapsed = t;
+    float u = t / prep.ramp_time;
+    float u2 = u * u;
+    prep.current_speed = prep.ramp_v0 + prep.ramp_dv * u2 * (3.0f - 2.0f * u);
+    *mm_remaining = prep.ramp_start_mm - prep.ramp_time * u * (prep.ramp_v0 + prep.ramp_dv * u2 * (1.0f - 0.5f * u));
+    return false;
+}
+
 
 
 /* "The Stepper Driver Interrupt" - This timer interrupt is the workhorse of Grbl. Grbl employs
@@ -206,27 +336,312 @@ static st_prep_t prep;
 */
 #ifdef USE_RMT_STEPS
     inline IRAM_ATTR static void stepperRMT_Outputs();
+    static void st_rmt_build_channel_masks();
+#ifdef USE_RMT_STEP_TRAINS
+    static inline IRAM_ATTR bool st_rmt_train_steps(uint8_t direction_bits);
+#endif
+
+// The RMT channels to start for each stepping axis, per squaring mode (ganged_mode). One bit per channel.
+static uint8_t rmt_step_channels[SQUARING_MODE_B + 1][N_AXIS];
+
+#ifdef USE_RMT_STEP_TRAINS
+// What each channel's memory holds. The single pulse item is the one StandardStepper wrote at init.
+static uint32_t rmt_single_item[RMT_CHANNEL_MAX]; // First item of the single step pulse
+static uint8_t rmt_train_len[RMT_CHANNEL_MAX];     // Pulses of the train in memory. 0 for the single pulse.
+static uint16_t rmt_train_period[RMT_CHANNEL_MAX]; // Pulse period of that train in RMT ticks
+
+// The RMT counts at 80 MHz / 20 (see StandardStepper::init_step_dir_pins()).
+#define RMT_TICKS_PER_MICROSECOND 4
+#define STEP_TIMER_TICKS_PER_RMT_TICK (F_STEPPER_TIMER / (RMT_TICKS_PER_MICROSECOND * 1000000))
+#endif
+
+// Axes with an RMT step output and those with a ganged second motor, as configured in the machine file.
+#ifdef MACHINE_CONFIG
+// Taken from the motors by st_build_step_outputs(), as the file can change them
+static uint8_t rmt_step_axes = 0;
+static uint8_t rmt_ganged_axes = 0;
+#else
+static const uint8_t rmt_step_axes = 0
+#ifdef X_STEP_PIN
+    | bit(X_AXIS)
+#endif
+#ifdef Y_STEP_PIN
+    | bit(Y_AXIS)
+#endif
+#ifdef Z_STEP_PIN
+    | bit(Z_AXIS)
+#endif
+#ifdef A_STEP_PIN
+    | bit(A_AXIS)
+#endif
+#ifdef B_STEP_PIN
+    | bit(B_AXIS)
+#endif
+#ifdef C_STEP_PIN
+    | bit(C_AXIS)
+#endif
+    ;
+static const uint8_t rmt_ganged_axes = 0
+#ifdef X2_STEP_PIN
+    | bit(X_AXIS)
+#endif
+#ifdef Y2_STEP_PIN
+    | bit(Y_AXIS)
 #endif
+#ifdef Z2_STEP_PIN
+    | bit(Z_AXIS)
+#endif
+#ifdef A2_STEP_PIN
+    | bit(A_AXIS)
+#endif
+#ifdef B2_STEP_PIN
+    | bit(B_AXIS)
+#endif
+#ifdef C2_STEP_PIN
+    | bit(C_AXIS)
+#endif
+    ;
+#endif
+#endif
+
+#ifdef MACHINE_CONFIG
+// The step pins of the motors, as a list of the pins to write per squaring mode (ganged_mode), so
+// set_stepper_pins_on() does not test for motors or ganged axes
+typedef struct {
+    uint8_t pin;
+    uint8_t axis_bit;
+} step_output_t;
+static step_output_t step_outputs[SQUARING_MODE_B + 1][MAX_AXES * MAX_GANGED];
+static uint8_t step_output_count[SQUARING_MODE_B + 1];
+static void st_build_step_outputs();
+#endif
+
+static void IRAM_ATTR stepper_pulse_func();
+
+// Starvation counters, reported and cleared by $ST. A segment underrun is the ISR running out of
+// segments while the planner still had a block, so the segment prep did not keep up. A planner
+// starvation is the prep running out of planner blocks during a cycle. It is counted once per
+// occurrence, which includes the normal end of each motion sequence.
+static volatile uint32_t segment_underruns;
+static volatile uint32_t segment_underruns_total;
+#ifdef BENCHMARK
+static volatile bool st_bench_muted;
+static st_bench_run_t* volatile st_bench_run; // Timed ticks of $Bench/Step
+#endif
+static uint32_t planner_starvations;
+static uint32_t planner_starvations_total;
+static bool planner_starved;
+
+#ifdef STEPPER_ISR_PROFILE
+// CPU cycles spent in stepper_pulse_func(), as measured with the Xtensa CCOUNT register.
+static volatile uint32_t isr_cycles_last;
+static volatile uint32_t isr_cycles_min = UINT32_MAX;
+static volatile uint32_t isr_cycles_max;
+static volatile uint64_t isr_cycles_total;
+static volatile uint32_t isr_cycles_count;
+// Ticks that took longer than the step period, and timer interrupts dropped by the busy flag.
+static volatile uint32_t isr_overruns;
+static volatile uint32_t isr_reentries;
+static uint32_t cpu_cycles_per_timer_tick;
+// Segments left in the buffer when the ISR loads one. How far ahead the prep runs.
+static volatile uint32_t segment_fill_min = UINT32_MAX;
+static volatile uint32_t segment_fill_total;
+static volatile uint32_t segment_fill_count;
+#ifdef USE_RMT_STEPS
+// CPU cycles between the first and the last RMT channel start of a tick. The skew between the motors.
+static volatile uint32_t rmt_start_skew_max;
+#endif
+// CPU cycles spent in st_prep_buffer() per prepared segment, including planner block loads.
+static uint64_t prep_cycles_total;
+static uint32_t prep_segment_count;
+#endif
+
+#ifdef USE_I2S_OUT_STREAM
+// Called by the I2S task when it starts to fill a DMA buffer with stepping data.
+static void IRAM_ATTR st_i2s_buffer_start(uint32_t buf_idx) {
+    i2s_fill_buffer = buf_idx;
+    memset(i2s_buffer_steps[buf_idx], 0, sizeof(i2s_buffer_steps[buf_idx]));
+}
 
-static void stepper_pulse_func();
+// Takes the steps of the DMA buffers in buf_mask back out of position.
+static void IRAM_ATTR st_i2s_subtract_buffer_steps(int32_t* position, uint32_t buf_mask) {
+    for (uint32_t buf_idx = 0; buf_mask != 0; buf_idx++, buf_mask >>= 1) {
+        if (buf_mask & 1) {
+            for (uint8_t axis = 0; axis < N_AXIS; axis++)
+                position[axis] -= i2s_buffer_steps[buf_idx][axis];
+        }
+    }
+}
+
+// Called by the stepper ISR when the probe has just triggered. probe_state_monitor() recorded the
+// position of the steps generated so far, which run ahead of the motors by the queued DMA buffers.
+static void IRAM_ATTR st_i2s_probe_triggered() {
+    st_i2s_subtract_buffer_steps(sys_probe_position, i2s_out_get_pending_mask());
+#ifdef I2S_OUT_PROBE_FAST_STOP
+    // Discard the queued steps. Only the steps that are actually sent stay in sys_position.
+    st_i2s_subtract_buffer_steps(sys_position, i2s_out_abort());
+    st_go_idle();
+    system_set_exec_state_flag(EXEC_CYCLE_STOP); // Ends the probing motion like a completed cycle
+#endif
+}
+#endif
+
+#ifdef PROBE_EDGE_CAPTURE
+// sys_position already counts the steps that go out at the next tick, at the end of the timer
+// period. The motors of those axes are taken to move evenly from their last step to the next,
+// so they are moved back by the part of the period that is left. Integer math, for the ISR.
+void IRAM_ATTR st_probe_edge_position(int32_t* steps, int16_t* offset) {
+    TIMERG0.hw_timer[STEP_TIMER_INDEX].update = 1;
+    uint32_t count = TIMERG0.hw_timer[STEP_TIMER_INDEX].cnt_low;
+    uint32_t period = TIMERG0.hw_timer[STEP_TIMER_INDEX].alarm_low;
+    int16_t remaining = 0;
+    if (period > count)
+        remaining = ((period - count) * PROBE_EDGE_STEP_SCALE) / period;
+    uint8_t pending = (st.exec_block != NULL) ? (st.step_outbits ^ step_port_invert_mask) : 0;
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        steps[axis] = sys_position[axis];
+        offset[axis] = 0;
+        if (pending & bit(axis))
+            offset[axis] = (st.exec_block->direction_bits & bit(axis)) ? remaining : -remaining;
+    }
+}
+#endif
+
+#ifdef DEFER_POSITION_UPDATES
+// Adds the steps taken so far in the executing segment to sys_position. Called by the ISR when a
+// segment completes and by st_go_idle() once the step timer is stopped.
+static inline void IRAM_ATTR st_flush_position_delta() {
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        sys_position[axis] += st.position_delta[axis];
+        st.position_delta[axis] = 0;
+    }
+}
+#endif
+
+#ifdef PEN_Z_EVENTS
+// Tells the pen task when Z has crossed zero, the pen threshold, as a segment starts or the
+// motion ends. The pen then moves within a segment of the crossing, without polling Z.
+static inline void IRAM_ATTR st_pen_z_update() {
+    static int8_t last_side = 0;
+    int32_t z = sys_position[Z_AXIS];
+    int8_t side = (z > 0) - (z < 0);
+    if (side != last_side) {
+        last_side = side;
+        pen_z_crossed_isr();
+    }
+}
+#endif
+
+#ifdef SERVO_SEGMENT_UPDATE
+// Sends the servo axes the position they will reach by the end of the segment just loaded. The
+// Bresenham counter of an axis takes a step each time it passes step_event_count, so the steps
+// of the segment follow from the counter and its increment without stepping through it.
+static void IRAM_ATTR st_servo_segment_update() {
+    int32_t target[N_AXIS];
+    const uint32_t step_event_count = st.exec_block->step_event_count;
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        target[axis] = sys_position[axis];
+        if (!(servo_axis_mask & bit(axis)) || step_event_count == 0)
+            continue;
+#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+        uint64_t total = st.counter[axis] + (uint64_t)st.exec_segment->n_step * st.steps[axis];
+#else
+        uint64_t total = st.counter[axis] + (uint64_t)st.exec_segment->n_step * st.exec_block->steps[axis];
+#endif
+        int32_t steps = total ? (total - 1) / step_event_count : 0;
+        target[axis] += (st.exec_block->direction_bits & bit(axis)) ? -steps : steps;
+    }
+    motors_servo_segment_update(target);
+#ifdef USE_SERVO_AXES
+    servo_axes_segment_update(target);
+#endif
+}
+#endif
+
+#ifdef LASER_RASTER
+// Starts the raster line of a newly loaded block. A block that returns to its line after a parking
+// motion goes on from the pixel it stopped at.
+static inline IRAM_ATTR void st_raster_block_start() {
+    const raster_line_t* line = st.exec_block->raster;
+    st.raster_on = (line != NULL);
+    if (line == NULL || line == st.raster_line)
+        return;
+    if (st.raster_line != NULL)
+        raster_release();
+    st.raster_line = line;
+    st.raster_pixel = 0;
+    st.raster_position = 0;
+    st.raster_next = st.exec_block->raster_width;
+}
+
+// Returns the spindle speed of the executing segment, scaled by the power of the current pixel.
+static inline IRAM_ATTR uint32_t st_segment_rpm() {
+    uint32_t rpm = st.exec_segment->spindle_rpm;
+    if (st.raster_on)
+        rpm = rpm * st.raster_line->power[st.raster_pixel] / 255;
+    return rpm;
+}
+#endif
+
+// Sets the spindle output of the executing segment. A PWM duty was converted when the
+// segment was prepared, so only the LEDC channel is written here.
+static inline IRAM_ATTR void st_segment_spindle() {
+#ifdef SPINDLE_CAPTURE
+    // Raster pixels change the power within the segment, so only its first one is recorded
+    if (spindle->segment_duty)
+        spindle_capture_segment(st.exec_segment->spindle_speed, st.exec_segment->spindle_duty, st.exec_segment->feed_rate);
+    else
+        spindle_capture_segment(st.exec_segment->spindle_rpm, 0, st.exec_segment->feed_rate);
+#endif
+#ifdef LASER_RASTER
+    if (st.raster_on) {
+        spindle->set_rpm(st_segment_rpm());
+        return;
+    }
+#endif
+    if (spindle->segment_duty) {
+        sys.spindle_speed = st.exec_segment->spindle_speed;
+        static_cast<PWMSpindle*>(spindle)->write_duty(st.exec_segment->spindle_duty);
+    } else
+        spindle->set_rpm(st.exec_segment->spindle_rpm);
+}
 
-// TODO: Replace direct updating of the int32 position counters in the ISR somehow. Perhaps use smaller
-// int8 variables and update position counters only when a segment completes. This can get complicated
-// with probing and homing cycles that require true real-time positions.
+// NOTE: With DEFER_POSITION_UPDATES, the int32 position counters are only updated when a segment
+// completes. Probing and homing cycles require true real-time positions, so they keep updating
+// sys_position on every step.
 void IRAM_ATTR onStepperDriverTimer(void* para) { // ISR It is time to take a step =======================================================================================
     //const int timer_idx = (int)para;  // get the timer index
     TIMERG0.int_clr_timers.t0 = 1;
     if (busy) {
+#ifdef STEPPER_ISR_PROFILE
+        isr_reentries++;
+#endif
         return;    // The busy-flag is used to avoid reentering this interrupt
     }
     busy = true;
 
+#ifdef EVENT_TRACE_STEP_ISR
+    TRACE_BEGIN(TRACE_STEP_ISR, 0);
+#endif
     stepper_pulse_func();
+#ifdef EVENT_TRACE_STEP_ISR
+    TRACE_END(TRACE_STEP_ISR);
+#endif
 
     TIMERG0.hw_timer[STEP_TIMER_INDEX].config.alarm_en = TIMER_ALARM_EN;
     busy = false;
 }
 
+#ifdef USE_STEP_PULSE_OFF_TIMER
+// The Stepper Port Reset Interrupt. Fires once, pulse_microseconds after the step pins were set by
+// stepper_pulse_func(), and ends the step pulse.
+void IRAM_ATTR onStepperOffTimer(void* para) {
+    TIMERG0.int_clr_timers.t1 = 1;
+    timer_pause(STEP_TIMER_GROUP, STEP_OFF_TIMER_INDEX);
+    set_stepper_pins_on(0); // turn all off
+}
+#endif
+
 /**
  * This phase of the ISR should ONLY create the pulses for the steppers.
  * This prevents jitter caused by the interval between the start of the
@@ -234,13 +649,34 @@ void IRAM_ATTR onStepperDriverTimer(void* para) { // ISR It is time to take a st
  * call to this method that might cause variation in the timing. The aim
  * is to keep pulse timing as regular as possible.
  */
-static void stepper_pulse_func() {
+static void IRAM_ATTR stepper_pulse_func() {
+    // When an axis that steps now has just changed direction, only the direction pins are set on
+    // this tick. Its steps go out on an extra tick, Stepper/DirSetup later, which then puts the
+    // step period back. Ticks without a reversal are not delayed.
+    if (st.dir_setup_hold) {
+        st.dir_setup_hold = false;
+        if (st.exec_segment != NULL)
+            Stepper_Timer_WritePeriod(st.exec_segment->cycles_per_tick);
+    } else if (hot_settings->direction_setup_microseconds != 0 &&
+               ((st.dir_outbits ^ dir_applied_bits) & (st.step_outbits ^ step_port_invert_mask))) {
+        dir_applied_bits = st.dir_outbits;
+        motors_set_direction_pins(st.dir_outbits);
+        st.dir_setup_hold = true;
+        Stepper_Timer_WritePeriod(hot_settings->direction_setup_microseconds * TICKS_PER_MICROSECOND);
+        return;
+    }
+#if defined(STEPPER_ISR_PROFILE) || defined(BENCHMARK)
+    uint32_t isr_cycles_start = xthal_get_ccount();
+#endif
+    dir_applied_bits = st.dir_outbits;
     motors_set_direction_pins(st.dir_outbits);
 #ifdef USE_RMT_STEPS
     stepperRMT_Outputs();
 #else
     set_stepper_pins_on(st.step_outbits);
-#ifndef USE_I2S_OUT_STREAM
+#ifdef USE_STEP_PULSE_OFF_TIMER
+    Stepper_Off_Timer_Start(); // onStepperOffTimer() ends the pulse
+#elif !defined(USE_I2S_OUT_STREAM)
     uint64_t step_pulse_start_time = esp_timer_get_time();
 #endif
 #endif
@@ -251,42 +687,77 @@ static void stepper_pulse_func() {
     // If there is no step segment, attempt to pop one from the stepper buffer
     if (st.exec_segment == NULL) {
         // Anything in the buffer? If so, load and initialize next step segment.
-        if (segment_buffer_head != segment_buffer_tail) {
+        st.exec_segment = segment_ring.consumer_slot();
+        if (st.exec_segment != NULL) {
+#ifdef STEPPER_ISR_PROFILE
+            uint32_t fill = segment_ring.count();
+            if (fill < segment_fill_min)
+                segment_fill_min = fill;
+            segment_fill_total += fill;
+            segment_fill_count++;
+#endif
             // Initialize new step segment and load number of steps to execute
-            st.exec_segment = &segment_buffer[segment_buffer_tail];
             // Initialize step segment timing per step and load number of steps to execute.
             Stepper_Timer_WritePeriod(st.exec_segment->cycles_per_tick);
             st.step_count = st.exec_segment->n_step; // NOTE: Can sometimes be zero when moving slow.
+            TRACE_MARK(TRACE_SEGMENT_LOAD, st.step_count);
             // If the new segment starts a new planner block, initialize stepper variables and counters.
             // NOTE: When the segment data index changes, this indicates a new planner block.
             if (st.exec_block_index != st.exec_segment->st_block_index) {
                 st.exec_block_index = st.exec_segment->st_block_index;
-                st.exec_block = &st_block_buffer[st.exec_block_index];
+                st.exec_block = st_segment_block(st.exec_block_index);
                 // Initialize Bresenham line and distance counters
-                st.counter_x = st.counter_y = st.counter_z = (st.exec_block->step_event_count >> 1);
-                // TODO ABC
+                for (uint8_t axis = 0; axis < N_AXIS; axis++)
+                    st.counter[axis] = (st.exec_block->step_event_count >> 1);
+#ifdef BACKLASH_COMPENSATION
+                memcpy(st.uncounted, st.exec_block->uncounted, sizeof(st.uncounted));
+#endif
+                // M7/M8/M9 switch here, where the motion after them starts, instead of with a sync
+                if (st.exec_block->coolant != COOLANT_NO_CHANGE)
+                    coolant_write(st.exec_block->coolant);
+#ifdef LASER_RASTER
+                st_raster_block_start();
+#endif
+#ifdef PROBE_SEQUENCE
+                // The approach of a probe sequence, after the retract and travel before it
+                if (st.exec_block->probe && sys_probe_state == PROBE_ARMED)
+                    sys_probe_state = PROBE_ACTIVE;
+#endif
             }
-            st.dir_outbits = st.exec_block->direction_bits ^ dir_invert_mask->get();
+            st.dir_outbits = st.exec_block->direction_bits ^ hot_settings->dir_invert_mask;
 #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
             // With AMASS enabled, adjust Bresenham axis increment counters according to AMASS level.
-            st.steps[X_AXIS] = st.exec_block->steps[X_AXIS] >> st.exec_segment->amass_level;
-            st.steps[Y_AXIS] = st.exec_block->steps[Y_AXIS] >> st.exec_segment->amass_level;
-            st.steps[Z_AXIS] = st.exec_block->steps[Z_AXIS] >> st.exec_segment->amass_level;
-#if (N_AXIS > A_AXIS)
-            st.steps[A_AXIS] = st.exec_block->steps[A_AXIS] >> st.exec_segment->amass_level;
+            for (uint8_t axis = 0; axis < N_AXIS; axis++)
+                st.steps[axis] = st.exec_block->steps[axis] >> st.exec_segment->amass_level;
 #endif
-#if (N_AXIS > B_AXIS)
-            st.steps[B_AXIS] = st.exec_block->steps[B_AXIS] >> st.exec_segment->amass_level;
+            // Set real-time spindle output as segment is loaded, just prior to the first step.
+#ifdef LASER_RASTER
+#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+            // An AMASS tick is a fraction of a step event of the block.
+            st.raster_increment = (uint64_t)1 << (16 + MAX_AMASS_LEVEL - st.exec_segment->amass_level);
+#else
+            st.raster_increment = (uint64_t)1 << 16;
 #endif
-#if (N_AXIS > C_AXIS)
-            st.steps[C_AXIS] = st.exec_block->steps[C_AXIS] >> st.exec_segment->amass_level;
 #endif
+            st_segment_spindle();
+#ifdef SERVO_SEGMENT_UPDATE
+            if (servo_axis_mask)
+                st_servo_segment_update();
+#endif
+#ifdef PEN_Z_EVENTS
+            st_pen_z_update();
 #endif
-            // Set real-time spindle output as segment is loaded, just prior to the first step.
-            spindle->set_rpm(st.exec_segment->spindle_rpm);
         } else {
             // Segment buffer empty. Shutdown.
+            if (plan_get_current_block() != NULL) {
+                segment_underruns++;
+                segment_underruns_total++;
+                TRACE_MARK(TRACE_SEGMENT_UNDERRUN, 0);
+            }
             st_go_idle();
+#ifdef PEN_Z_EVENTS
+            st_pen_z_update();
+#endif
             if (!(sys.state & STATE_JOG)) {  // added to prevent ... jog after probing crash
                 // Ensure pwm is set properly upon completion of rate-controlled motion.
                 if (st.exec_block != NULL && st.exec_block->is_pwm_rate_adjusted)
@@ -297,130 +768,316 @@ static void stepper_pulse_func() {
             return; // Nothing to do but exit.
         }
     }
+#ifdef USE_RMT_STEP_TRAINS
+    // Hold off the next tick until the train started above is done, then go back to the step period.
+    if (st.train_output_cycles) {
+        Stepper_Timer_WritePeriod(st.train_output_cycles);
+        st.period_stretched = true;
+    } else if (st.period_stretched) {
+        Stepper_Timer_WritePeriod(st.exec_segment->cycles_per_tick);
+        st.period_stretched = false;
+    }
+#endif
     // Check probing state.
-    if (sys_probe_state == PROBE_ACTIVE)
+    if (sys_probe_state == PROBE_ACTIVE) {
         probe_state_monitor();
+#ifdef USE_I2S_OUT_STREAM
+        if (sys_probe_state != PROBE_ACTIVE) {
+            st_i2s_probe_triggered();
+#ifdef I2S_OUT_PROBE_FAST_STOP
+            return; // Stepping has stopped
+#endif
+        }
+#endif
+    }
     // Reset step out bits.
     st.step_outbits = 0;
     // Execute step displacement profile by Bresenham line algorithm
-#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
-    st.counter_x += st.steps[X_AXIS];
-#else
-    st.counter_x += st.exec_block->steps[X_AXIS];
-#endif
-    if (st.counter_x > st.exec_block->step_event_count) {
-        st.step_outbits |= bit(X_AXIS);
-        st.counter_x -= st.exec_block->step_event_count;
-        if (st.exec_block->direction_bits & bit(X_AXIS))
-            sys_position[X_AXIS]--;
-        else
-            sys_position[X_AXIS]++;
-    }
-#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
-    st.counter_y += st.steps[Y_AXIS];
-#else
-    st.counter_y += st.exec_block->steps[Y_AXIS];
-#endif
-    if (st.counter_y > st.exec_block->step_event_count) {
-        st.step_outbits |= bit(Y_AXIS);
-        st.counter_y -= st.exec_block->step_event_count;
-        if (st.exec_block->direction_bits & bit(Y_AXIS))
-            sys_position[Y_AXIS]--;
-        else
-            sys_position[Y_AXIS]++;
-    }
-#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
-    st.counter_z += st.steps[Z_AXIS];
-#else
-    st.counter_z += st.exec_block->steps[Z_AXIS];
-#endif
-    if (st.counter_z > st.exec_block->step_event_count) {
-        st.step_outbits |= bit(Z_AXIS);
-        st.counter_z -= st.exec_block->step_event_count;
-        if (st.exec_block->direction_bits & bit(Z_AXIS))
-            sys_position[Z_AXIS]--;
-        else
-            sys_position[Z_AXIS]++;
-    }
-#if (N_AXIS > A_AXIS)
-#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
-    st.counter_a += st.steps[A_AXIS];
-#else
-    st.counter_a += st.exec_block->steps[A_AXIS];
+    // NOTE: The block fields are read once into locals. Otherwise the writes to sys_position[] force
+    // the compiler to reload them for every axis. N_AXIS is a compile-time constant loop bound.
+    const st_block_t* exec_block = st.exec_block;
+    const uint32_t step_event_count = exec_block->step_event_count;
+    const uint8_t direction_bits = exec_block->direction_bits;
+#ifdef DEFER_POSITION_UPDATES
+    const bool defer_position = (sys_probe_state != PROBE_ACTIVE) && (sys.state != STATE_HOMING);
 #endif
-    if (st.counter_a > st.exec_block->step_event_count) {
-        st.step_outbits |= bit(A_AXIS);
-        st.counter_a -= st.exec_block->step_event_count;
-        if (st.exec_block->direction_bits & bit(A_AXIS))  sys_position[A_AXIS]--;
-        else  sys_position[A_AXIS]++;
-    }
+#ifdef USE_I2S_OUT_STREAM
+    int32_t* buffer_steps = (sys_probe_state == PROBE_ACTIVE) ? i2s_buffer_steps[i2s_fill_buffer] : NULL;
+#endif
+#ifdef USE_RMT_STEP_TRAINS
+    // A single-axis segment skips the Bresenham pass. Its counter would come out unchanged anyway.
+    if (!st_rmt_train_steps(direction_bits))
 #endif
-#if (N_AXIS > B_AXIS)
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
 #ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
-    st.counter_b += st.steps[B_AXIS];
+        st.counter[axis] += st.steps[axis];
 #else
-    st.counter_b += st.exec_block->steps[B_AXIS];
+        st.counter[axis] += exec_block->steps[axis];
+#endif
+        if (st.counter[axis] > step_event_count) {
+            st.step_outbits |= bit(axis);
+            st.counter[axis] -= step_event_count;
+#ifdef BACKLASH_COMPENSATION
+            if (st.uncounted[axis]) {
+                st.uncounted[axis]--;
+                continue;
+            }
 #endif
-    if (st.counter_b > st.exec_block->step_event_count) {
-        st.step_outbits |= bit(B_AXIS);
-        st.counter_b -= st.exec_block->step_event_count;
-        if (st.exec_block->direction_bits & bit(B_AXIS))  sys_position[B_AXIS]--;
-        else  sys_position[B_AXIS]++;
-    }
+#ifdef DEFER_POSITION_UPDATES
+            if (defer_position) {
+                if (direction_bits & bit(axis))
+                    st.position_delta[axis]--;
+                else
+                    st.position_delta[axis]++;
+                continue;
+            }
 #endif
-#if (N_AXIS > C_AXIS)
-#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
-    st.counter_c += st.steps[C_AXIS];
-#else
-    st.counter_c += st.exec_block->steps[C_AXIS];
+            if (direction_bits & bit(axis))
+                sys_position[axis]--;
+            else
+                sys_position[axis]++;
+#ifdef USE_I2S_OUT_STREAM
+            if (buffer_steps != NULL)
+                buffer_steps[axis] += (direction_bits & bit(axis)) ? -1 : 1;
 #endif
-    if (st.counter_c > st.exec_block->step_event_count) {
-        st.step_outbits |= bit(C_AXIS);
-        st.counter_c -= st.exec_block->step_event_count;
-        if (st.exec_block->direction_bits & bit(C_AXIS))  sys_position[C_AXIS]--;
-        else  sys_position[C_AXIS]++;
+        }
+    }
+#ifdef LASER_RASTER
+    // Set the power of the next pixel when the block crosses into it.
+    if (st.raster_on) {
+        st.raster_position += st.raster_increment;
+        if (st.raster_position >= st.raster_next && st.raster_pixel + 1 < st.raster_line->pixels) {
+            st.raster_pixel++;
+            st.raster_next += exec_block->raster_width;
+            spindle->set_rpm(st_segment_rpm());
+        }
     }
 #endif
     // During a homing cycle, lock out and prevent desired axes from moving.
     if (sys.state == STATE_HOMING)
         st.step_outbits &= sys.homing_axis_lock;
+#ifdef BENCHMARK
+    if (st_bench_muted)
+        st.step_outbits = 0; // $Bench/Step runs the ISR without stepping
+#endif
     st.step_count--; // Decrement step events count
     if (st.step_count == 0) {
         // Segment is complete. Discard current segment and advance segment indexing.
+#ifdef DEFER_POSITION_UPDATES
+        st_flush_position_delta();
+#endif
         st.exec_segment = NULL;
-        if (++segment_buffer_tail == SEGMENT_BUFFER_SIZE)
-            segment_buffer_tail = 0;
+        segment_ring.pop();
+#ifdef USE_SEGMENT_PREP_TASK
+        // Wake the prep task to refill the freed segment. With I2S this runs in the I2S task.
+        if (xPortInIsrContext()) {
+            BaseType_t higher_priority_task_woken = pdFALSE;
+            vTaskNotifyGiveFromISR(segmentPrepTaskHandle, &higher_priority_task_woken);
+            if (higher_priority_task_woken)
+                portYIELD_FROM_ISR();
+        } else
+            xTaskNotifyGive(segmentPrepTaskHandle);
+#endif
     }
 
 #ifndef USE_RMT_STEPS
 #ifdef USE_I2S_OUT_STREAM
     //
     // Generate pulse (at least one pulse)
-    // The pulse resolution is limited by I2S_OUT_USEC_PER_PULSE
+    // The pulse resolution is limited by i2s_out_get_pulse_usec()
     //
     st.step_outbits ^= step_port_invert_mask;  // Apply step port invert mask
-    i2s_out_push_sample(pulse_microseconds->get() / I2S_OUT_USEC_PER_PULSE);
+    i2s_out_push_sample(hot_settings->pulse_microseconds / i2s_out_get_pulse_usec());
     set_stepper_pins_on(0); // turn all off
+#elif defined(USE_STEP_PULSE_OFF_TIMER)
+    st.step_outbits ^= step_port_invert_mask;  // Apply step port invert mask
 #else
     st.step_outbits ^= step_port_invert_mask;  // Apply step port invert mask
     // wait for step pulse time to complete...some of it should have expired during code above
-    while (esp_timer_get_time() - step_pulse_start_time < pulse_microseconds->get()) {
+    while (esp_timer_get_time() - step_pulse_start_time < hot_settings->pulse_microseconds) {
         NOP(); // spin here until time to turn off step
     }
     set_stepper_pins_on(0); // turn all off
 #endif
+#endif
+#ifdef STEPPER_ISR_PROFILE
+    uint32_t isr_cycles = xthal_get_ccount() - isr_cycles_start;
+    isr_cycles_last = isr_cycles;
+    if (isr_cycles < isr_cycles_min)
+        isr_cycles_min = isr_cycles;
+    if (isr_cycles > isr_cycles_max)
+        isr_cycles_max = isr_cycles;
+    isr_cycles_total += isr_cycles;
+    isr_cycles_count++;
+    if (st.exec_segment != NULL && isr_cycles > st.exec_segment->cycles_per_tick * cpu_cycles_per_timer_tick)
+        isr_overruns++;
+#endif
+#ifdef BENCHMARK
+    if (st_bench_run != NULL) {
+        uint32_t bench_cycles = xthal_get_ccount() - isr_cycles_start;
+        st_bench_run->isr_cycles += bench_cycles;
+        if (bench_cycles > st_bench_run->isr_cycles_max)
+            st_bench_run->isr_cycles_max = bench_cycles;
+        st_bench_run->isr_ticks++;
+    }
 #endif
     return;
 }
 
+// Returns and clears the starvation counters. See $ST.
+void st_take_starvation_counts(uint32_t* underruns, uint32_t* starvations) {
+    *underruns = segment_underruns;
+    segment_underruns = 0;
+    *starvations = planner_starvations;
+    planner_starvations = 0;
+}
+
+void st_get_starvation_totals(uint32_t* underruns, uint32_t* starvations) {
+    *underruns = segment_underruns_total;
+    *starvations = planner_starvations_total;
+}
+
+#ifdef STEPPER_ISR_PROFILE
+// Reports the stepper ISR cycle counts gathered since the last report, then restarts the
+// measurement. The average is the figure to compare between builds. The maximum includes
+// new segment and new block loads.
+void st_report_isr_cycles(uint8_t client) {
+    uint32_t count = isr_cycles_count;
+    uint32_t average = count ? (uint32_t)(isr_cycles_total / count) : 0;
+    grbl_sendf(client, "[MSG:ISR cycles last:%u min:%u avg:%u max:%u ticks:%u (%u MHz)]\r\n",
+               isr_cycles_last, count ? isr_cycles_min : 0, average, isr_cycles_max, count, ESP.getCpuFreqMHz());
+    grbl_sendf(client, "[MSG:ISR overruns:%u reentries:%u]\r\n", isr_overruns, isr_reentries);
+    isr_cycles_min = UINT32_MAX;
+    isr_cycles_max = 0;
+    isr_cycles_total = 0;
+    isr_cycles_count = 0;
+    isr_overruns = 0;
+    isr_reentries = 0;
+    uint32_t fill_count = segment_fill_count;
+    grbl_sendf(client, "[MSG:Segment fill min:%u avg:%.1f of %u]\r\n",
+               fill_count ? segment_fill_min : 0, fill_count ? (float)segment_fill_total / fill_count : 0.0f,
+               segment_ring.size() - 1);
+    segment_fill_min = UINT32_MAX;
+    segment_fill_total = 0;
+    segment_fill_count = 0;
+#ifdef USE_RMT_STEPS
+    grbl_sendf(client, "[MSG:RMT start skew max:%u cycles]\r\n", rmt_start_skew_max);
+    rmt_start_skew_max = 0;
+#endif
+    // Segment prep throughput, as if st_prep_buffer() ran back to back.
+    uint32_t prep_average = prep_segment_count ? (uint32_t)(prep_cycles_total / prep_segment_count) : 0;
+    float segments_per_ms = prep_average ? (ESP.getCpuFreqMHz() * 1000.0f) / prep_average : 0.0f;
+    grbl_sendf(client, "[MSG:Prep cycles avg:%u segments:%u segments/ms:%.1f]\r\n",
+               prep_average, prep_segment_count, segments_per_ms);
+    prep_cycles_total = 0;
+    prep_segment_count = 0;
+}
+
+uint32_t st_get_isr_cycles_max() {
+    return isr_cycles_max;
+}
+
+// Status report field with the ISR average and maximum cycles and overruns since the last $SC,
+// and the segment underruns since the last $ST.
+void st_isr_profile_field(char* field) {
+    uint32_t count = isr_cycles_count;
+    sprintf(field, "|ISR:%u,%u,%u,%u", count ? (uint32_t)(isr_cycles_total / count) : 0,
+            isr_cycles_max, isr_overruns, segment_underruns);
+}
+#endif
+
+#ifdef STATIC_MOTION_BUFFERS
+#if STEPPER_STATIC_SEGMENTS < SEGMENT_BUFFER_SIZE || STEPPER_STATIC_SEGMENTS > SEGMENT_BUFFER_SIZE_MAX
+    #error "STEPPER_STATIC_SEGMENTS must be between SEGMENT_BUFFER_SIZE and SEGMENT_BUFFER_SIZE_MAX"
+#endif
+static segment_t segment_buffer_static[STEPPER_STATIC_SEGMENTS];
+static st_block_t st_block_buffer_static[STEPPER_STATIC_SEGMENTS - 1];
+#ifdef SEGMENT_BLOCKS
+static st_block_t st_segment_blocks_static[STEPPER_STATIC_SEGMENTS];
+#endif
+#endif
+
+// Allocates the step segment buffers with the depth from the Stepper/Segments setting. As with
+// the planner buffer, the depth is reduced if it would take more than a quarter of the free heap.
+static void st_alloc_buffers() {
+    uint32_t size = stepper_segments->get();
+#ifdef STATIC_MOTION_BUFFERS
+    size = constrain(size, SEGMENT_BUFFER_SIZE, STEPPER_STATIC_SEGMENTS);
+    segment_buffer = segment_buffer_static;
+    st_block_buffer = st_block_buffer_static;
+#ifdef SEGMENT_BLOCKS
+    st_segment_blocks = st_segment_blocks_static;
+#endif
+#else
+#ifdef SEGMENT_BLOCKS
+    const uint32_t segment_bytes = sizeof(segment_t) + 2 * sizeof(st_block_t);
+#else
+    const uint32_t segment_bytes = sizeof(segment_t) + sizeof(st_block_t);
+#endif
+    while ((size > SEGMENT_BUFFER_SIZE) && ((size * segment_bytes) > (ESP.getFreeHeap() / 4)))
+        size >>= 1;
+    if (size < SEGMENT_BUFFER_SIZE)
+        size = SEGMENT_BUFFER_SIZE;
+    segment_buffer = (segment_t*)calloc(size, sizeof(segment_t));
+    st_block_buffer = (st_block_t*)calloc(size - 1, sizeof(st_block_t));
+    if (segment_buffer == NULL || st_block_buffer == NULL) {
+        free(segment_buffer);
+        free(st_block_buffer);
+        size = SEGMENT_BUFFER_SIZE;
+        segment_buffer = (segment_t*)calloc(size, sizeof(segment_t));
+        st_block_buffer = (st_block_t*)calloc(size - 1, sizeof(st_block_t));
+    }
+#ifdef SEGMENT_BLOCKS
+    st_segment_blocks = (st_block_t*)calloc(size, sizeof(st_block_t));
+#endif
+#endif
+    segment_ring.init(segment_buffer, size);
+    grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Step segments %d", segment_ring.size());
+}
+
+uint8_t st_get_segment_buffer_size() {
+    return segment_ring.size();
+}
+
+size_t st_get_buffer_bytes() {
+#ifdef SEGMENT_BLOCKS
+    return segment_ring.size() * (sizeof(segment_t) + sizeof(st_block_t)) + (segment_ring.size() - 1) * sizeof(st_block_t);
+#else
+    return segment_ring.size() * sizeof(segment_t) + (segment_ring.size() - 1) * sizeof(st_block_t);
+#endif
+}
+
+#ifdef USE_SEGMENT_PREP_TASK
+// Refills the segment buffer when woken by the stepper ISR, or at least every
+// SEGMENT_PREP_TASK_PERIOD_MS while in motion, in case a wake up was missed.
+static void segmentPrepTask(void* pvParameters) {
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, SEGMENT_PREP_TASK_PERIOD_MS / portTICK_PERIOD_MS);
+        if (sys.state & (STATE_CYCLE | STATE_HOLD | STATE_SAFETY_DOOR | STATE_HOMING | STATE_SLEEP | STATE_JOG))
+            st_prep_buffer();
+    }
+}
+#endif
+
 void stepper_init() {
 
     grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Axis count %d", N_AXIS);
+    st_alloc_buffers();
+#ifdef STEPPER_ISR_PROFILE
+    cpu_cycles_per_timer_tick = (ESP.getCpuFreqMHz() * 1000000) / F_STEPPER_TIMER;
+#endif
+#ifdef USE_SEGMENT_PREP_TASK
+    prep_mutex = xSemaphoreCreateMutex();
+    task_create(TASK_SEGMENT_PREP, segmentPrepTask, 4096, NULL, &segmentPrepTaskHandle);
+    grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Segment prep task");
+#endif
     // make the step pins outputs
 #ifdef USE_RMT_STEPS
     grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "RMT Steps");
 #elif defined(USE_I2S_OUT_STREAM)
     grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "I2S Steps");
+#elif defined(USE_STEP_PULSE_OFF_TIMER)
+    grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Timed Steps, Pulse Off Timer");
 #else
     grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Timed Steps");
 #endif
@@ -428,6 +1085,7 @@ void stepper_init() {
 #ifdef USE_I2S_OUT_STREAM
     // I2S stepper do not use timer interrupt but callback
     i2s_out_set_pulse_callback(stepper_pulse_func);
+    i2s_out_set_buffer_callback(st_i2s_buffer_start);
 #else
     timer_config_t config;
     config.divider     = F_TIMERS / F_STEPPER_TIMER;
@@ -440,6 +1098,15 @@ void stepper_init() {
     timer_set_counter_value(STEP_TIMER_GROUP, STEP_TIMER_INDEX, 0x00000000ULL);
     timer_enable_intr(STEP_TIMER_GROUP, STEP_TIMER_INDEX);
     timer_isr_register(STEP_TIMER_GROUP, STEP_TIMER_INDEX, onStepperDriverTimer, NULL, 0, NULL);
+#ifdef USE_STEP_PULSE_OFF_TIMER
+    // One-shot timer that ends each step pulse
+    config.divider     = STEPPER_OFF_TIMER_PRESCALE;
+    config.auto_reload = false;
+    timer_init(STEP_TIMER_GROUP, STEP_OFF_TIMER_INDEX, &config);
+    timer_set_counter_value(STEP_TIMER_GROUP, STEP_OFF_TIMER_INDEX, 0x00000000ULL);
+    timer_enable_intr(STEP_TIMER_GROUP, STEP_OFF_TIMER_INDEX);
+    timer_isr_register(STEP_TIMER_GROUP, STEP_OFF_TIMER_INDEX, onStepperOffTimer, NULL, 0, NULL);
+#endif
 #endif
 #ifdef USE_TRINAMIC
     Trinamic_Init();
@@ -472,6 +1139,7 @@ void st_reset() {
 #ifdef ESP_DEBUG
     //Serial.println("st_reset()");
 #endif
+    st_prep_lock();
     // Initialize stepper driver idle state.
 #ifdef USE_I2S_OUT_STREAM
     i2s_out_reset();
@@ -482,18 +1150,83 @@ void st_reset() {
     memset(&st, 0, sizeof(stepper_t));
     st.exec_segment = NULL;
     pl_block = NULL;  // Planner block pointer used by segment buffer
-    segment_buffer_tail = 0;
-    segment_buffer_head = 0; // empty = tail
-    segment_next_head = 1;
+    segment_ring.reset();
+#ifdef SEGMENT_BLOCKS
+    segment_blocks = false;
+    segment_source_index = 0xff;
+#endif
+#ifdef INPUT_SHAPING
+    // The delayed motion is dropped with the segments. sys_position has the steps that were taken.
+    shaping = false;
+    shaper_reset();
+#endif
+#ifdef BACKLASH_COMPENSATION
+    // The slack not yet taken up is dropped too. The axes stay on the side they last moved to.
+    backlash = false;
+    memset(backlash_pending, 0, sizeof(backlash_pending));
+#endif
     busy = false;
     st_generate_step_dir_invert_masks();
     st.dir_outbits = dir_port_invert_mask; // Initialize direction bits to default.
+#ifdef MACHINE_CONFIG
+    st_build_step_outputs();
+#endif
+#ifdef USE_RMT_STEPS
+    st_rmt_build_channel_masks();
+#endif
     // TODO do we need to turn step pins off?
+    st_prep_unlock();
 }
 
 
-void set_stepper_pins_on(uint8_t onMask) {
-    onMask ^= step_invert_mask->get(); // invert pins as required by invert mask
+#ifdef MACHINE_CONFIG
+// Builds the step pin lists used by set_stepper_pins_on() from the motors, whether they came from
+// the machine config or the machine definition. Called by st_reset(), which runs after
+// init_motors().
+static void st_build_step_outputs() {
+    memset(step_output_count, 0, sizeof(step_output_count));
+#ifdef USE_RMT_STEPS
+    rmt_step_axes = 0;
+    rmt_ganged_axes = 0;
+#endif
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        uint8_t pins[MAX_GANGED];
+        for (uint8_t gang_index = PRIMARY_MOTOR; gang_index <= GANGED_MOTOR; gang_index++) {
+            Motor* motor = myMotor[axis][gang_index];
+            pins[gang_index] = UNDEFINED_PIN;
+            if (motor->type_id == STANDARD_MOTOR || motor->type_id == TRINAMIC_SPI_MOTOR)
+                pins[gang_index] = static_cast<StandardStepper*>(motor)->step_pin;
+        }
+        bool axis_ganged = pins[GANGED_MOTOR] != UNDEFINED_PIN;
+#ifdef USE_RMT_STEPS
+        if (pins[PRIMARY_MOTOR] != UNDEFINED_PIN)
+            rmt_step_axes |= bit(axis);
+        if (axis_ganged)
+            rmt_ganged_axes |= bit(axis);
+#endif
+        for (uint8_t mode = SQUARING_MODE_DUAL; mode <= SQUARING_MODE_B; mode++) {
+            for (uint8_t gang_index = PRIMARY_MOTOR; gang_index <= GANGED_MOTOR; gang_index++) {
+                if (pins[gang_index] == UNDEFINED_PIN)
+                    continue;
+                // A non-ganged axis steps its primary motor in every squaring mode
+                if (axis_ganged && mode == (gang_index == PRIMARY_MOTOR ? SQUARING_MODE_B : SQUARING_MODE_A))
+                    continue;
+                step_output_t* out = &step_outputs[mode][step_output_count[mode]++];
+                out->pin = pins[gang_index];
+                out->axis_bit = bit(axis);
+            }
+        }
+    }
+}
+#endif
+
+void IRAM_ATTR set_stepper_pins_on(uint8_t onMask) {
+    onMask ^= hot_settings->step_invert_mask; // invert pins as required by invert mask
+#ifdef MACHINE_CONFIG
+    const step_output_t* out = step_outputs[ganged_mode];
+    for (uint8_t i = step_output_count[ganged_mode]; i; i--, out++)
+        digitalWrite(out->pin, onMask & out->axis_bit);
+#else
 #ifdef X_STEP_PIN
 #ifndef X2_STEP_PIN // if not a ganged axis
     digitalWrite(X_STEP_PIN, (onMask & bit(X_AXIS)));
@@ -558,129 +1291,155 @@ void set_stepper_pins_on(uint8_t onMask) {
         digitalWrite(C2_STEP_PIN, (onMask & bit(C_AXIS)));
 #endif
 #endif
+#endif
 }
 //#endif
 
 #ifdef USE_RMT_STEPS
-inline IRAM_ATTR static void stepperRMT_Outputs() {
-#ifdef  X_STEP_PIN
-    if (st.step_outbits & bit(X_AXIS)) {
-#ifndef X2_STEP_PIN // if not a ganged axis
-        RMT.conf_ch[rmt_chan_num[X_AXIS][PRIMARY_MOTOR]].conf1.mem_rd_rst = 1;
-        RMT.conf_ch[rmt_chan_num[X_AXIS][PRIMARY_MOTOR]].conf1.tx_start = 1;
-#else // it is a ganged axis
-        if ((ganged_mode == SQUARING_MODE_DUAL) || (ganged_mode == SQUARING_MODE_A)) {
-            RMT.conf_ch[rmt_chan_num[X_AXIS][PRIMARY_MOTOR]].conf1.mem_rd_rst = 1;
-            RMT.conf_ch[rmt_chan_num[X_AXIS][PRIMARY_MOTOR]].conf1.tx_start = 1;
-        }
-        if ((ganged_mode == SQUARING_MODE_DUAL) || (ganged_mode == SQUARING_MODE_B)) {
-            RMT.conf_ch[rmt_chan_num[X_AXIS][GANGED_MOTOR]].conf1.mem_rd_rst = 1;
-            RMT.conf_ch[rmt_chan_num[X_AXIS][GANGED_MOTOR]].conf1.tx_start = 1;
+// Builds the RMT channel masks used by stepperRMT_Outputs(). Called by st_reset(), which runs after
+// init_motors() has assigned the channels.
+static void st_rmt_build_channel_masks() {
+    memset(rmt_step_channels, 0, sizeof(rmt_step_channels));
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        if (!bit_istrue(rmt_step_axes, bit(axis)))
+            continue;
+        bool axis_ganged = bit_istrue(rmt_ganged_axes, bit(axis));
+        for (uint8_t mode = SQUARING_MODE_DUAL; mode <= SQUARING_MODE_B; mode++) {
+            // A non-ganged axis steps its primary motor in every squaring mode.
+            if (!axis_ganged || mode != SQUARING_MODE_B)
+                rmt_step_channels[mode][axis] |= bit(rmt_chan_num[axis][PRIMARY_MOTOR]);
+            if (axis_ganged && mode != SQUARING_MODE_A)
+                rmt_step_channels[mode][axis] |= bit(rmt_chan_num[axis][GANGED_MOTOR]);
         }
-#endif
     }
-#endif
-#ifdef  Y_STEP_PIN
-    if (st.step_outbits & bit(Y_AXIS)) {
-#ifndef Y2_STEP_PIN // if not a ganged axis
-        RMT.conf_ch[rmt_chan_num[Y_AXIS][PRIMARY_MOTOR]].conf1.mem_rd_rst = 1;
-        RMT.conf_ch[rmt_chan_num[Y_AXIS][PRIMARY_MOTOR]].conf1.tx_start = 1;
-#else // it is a ganged axis
-        if ((ganged_mode == SQUARING_MODE_DUAL) || (ganged_mode == SQUARING_MODE_A)) {
-            RMT.conf_ch[rmt_chan_num[Y_AXIS][PRIMARY_MOTOR]].conf1.mem_rd_rst = 1;
-            RMT.conf_ch[rmt_chan_num[Y_AXIS][PRIMARY_MOTOR]].conf1.tx_start = 1;
+#ifdef USE_RMT_STEP_TRAINS
+    // Put the single pulse back into channels left holding a train, and remember it.
+    uint32_t chan_mask = 0;
+    for (uint8_t axis = 0; axis < N_AXIS; axis++)
+        chan_mask |= rmt_step_channels[SQUARING_MODE_DUAL][axis];
+    for (uint32_t m = chan_mask; m; m &= m - 1) {
+        uint32_t chan = __builtin_ctz(m);
+        if (rmt_train_len[chan]) {
+            RMTMEM.chan[chan].data32[0].val = rmt_single_item[chan];
+            RMTMEM.chan[chan].data32[1].val = 0;
+            rmt_train_len[chan] = 0;
         }
-        if ((ganged_mode == SQUARING_MODE_DUAL) || (ganged_mode == SQUARING_MODE_B)) {
-            RMT.conf_ch[rmt_chan_num[Y_AXIS][GANGED_MOTOR]].conf1.mem_rd_rst = 1;
-            RMT.conf_ch[rmt_chan_num[Y_AXIS][GANGED_MOTOR]].conf1.tx_start = 1;
-        }
-#endif
+        rmt_single_item[chan] = RMTMEM.chan[chan].data32[0].val;
     }
 #endif
+}
 
-#ifdef  Z_STEP_PIN
-    if (st.step_outbits & bit(Z_AXIS)) {
-#ifndef Z2_STEP_PIN // if not a ganged axis
-        RMT.conf_ch[rmt_chan_num[Z_AXIS][PRIMARY_MOTOR]].conf1.mem_rd_rst = 1;
-        RMT.conf_ch[rmt_chan_num[Z_AXIS][PRIMARY_MOTOR]].conf1.tx_start = 1;
-#else // it is a ganged axis
-        if ((ganged_mode == SQUARING_MODE_DUAL) || (ganged_mode == SQUARING_MODE_A)) {
-            RMT.conf_ch[rmt_chan_num[Z_AXIS][PRIMARY_MOTOR]].conf1.mem_rd_rst = 1;
-            RMT.conf_ch[rmt_chan_num[Z_AXIS][PRIMARY_MOTOR]].conf1.tx_start = 1;
-        }
-        if ((ganged_mode == SQUARING_MODE_DUAL) || (ganged_mode == SQUARING_MODE_B)) {
-            RMT.conf_ch[rmt_chan_num[Z_AXIS][GANGED_MOTOR]].conf1.mem_rd_rst = 1;
-            RMT.conf_ch[rmt_chan_num[Z_AXIS][GANGED_MOTOR]].conf1.tx_start = 1;
-        }
-#endif
+#ifdef USE_RMT_STEP_TRAINS
+// Makes the channel memory hold a train of len pulses at the given period in RMT ticks, or the
+// single pulse for len 0. Only rewrites what changed since the last call.
+static inline IRAM_ATTR void st_rmt_load_train(uint32_t chan, uint8_t len, uint16_t period) {
+    if (len == rmt_train_len[chan] && (len == 0 || period == rmt_train_period[chan]))
+        return;
+    volatile rmt_item32_t* items = RMTMEM.chan[chan].data32;
+    if (len == 0) {
+        items[0].val = rmt_single_item[chan];
+        items[1].val = 0;
+    } else {
+        // The single pulse item is an idle tick followed by the pulse. Each train item is the pulse
+        // followed by the rest of the period at the idle level.
+        uint32_t idle_level = (rmt_single_item[chan] >> 15) & 1;
+        uint32_t pulse = (rmt_single_item[chan] >> 16) & 0x7fff;
+        uint32_t item = pulse | ((idle_level ^ 1) << 15) | ((uint32_t)(period - pulse) << 16) | (idle_level << 31);
+        uint8_t from = (rmt_train_len[chan] != 0 && period == rmt_train_period[chan]) ? rmt_train_len[chan] : 0;
+        for (uint8_t i = from; i < len; i++)
+            items[i].val = item;
+        items[len].val = 0; // End marker
     }
-#endif
+    rmt_train_len[chan] = len;
+    rmt_train_period[chan] = period;
+}
 
-#ifdef  A_STEP_PIN
-    if (st.step_outbits & bit(A_AXIS)) {
-#ifndef A2_STEP_PIN // if not a ganged axis
-        RMT.conf_ch[rmt_chan_num[A_AXIS][PRIMARY_MOTOR]].conf1.mem_rd_rst = 1;
-        RMT.conf_ch[rmt_chan_num[A_AXIS][PRIMARY_MOTOR]].conf1.tx_start = 1;
-#else // it is a ganged axis
-        if ((ganged_mode == SQUARING_MODE_DUAL) || (ganged_mode == SQUARING_MODE_A)) {
-            RMT.conf_ch[rmt_chan_num[A_AXIS][PRIMARY_MOTOR]].conf1.mem_rd_rst = 1;
-            RMT.conf_ch[rmt_chan_num[A_AXIS][PRIMARY_MOTOR]].conf1.tx_start = 1;
-        }
-        if ((ganged_mode == SQUARING_MODE_DUAL) || (ganged_mode == SQUARING_MODE_B)) {
-            RMT.conf_ch[rmt_chan_num[A_AXIS][GANGED_MOTOR]].conf1.mem_rd_rst = 1;
-            RMT.conf_ch[rmt_chan_num[A_AXIS][GANGED_MOTOR]].conf1.tx_start = 1;
-        }
+// Sends the steps of the executing segment as a train when it only moves one axis at full
+// resolution. Updates the position and the step count like that many Bresenham ticks would.
+// Returns false if the segment has to be stepped one tick at a time.
+static inline IRAM_ATTR bool st_rmt_train_steps(uint8_t direction_bits) {
+    uint8_t axis = st.exec_block->train_axis;
+    if (axis == RMT_TRAIN_NONE || st.step_count < 2 || sys_probe_state == PROBE_ACTIVE || sys.state == STATE_HOMING)
+        return false;
+#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+    if (st.exec_segment->amass_level != 0)
+        return false;
+#else
+    if (st.exec_segment->prescaler != 1)
+        return false;
+#endif
+    // Leave at least a microsecond at the idle level between the pulses.
+    uint32_t period = st.exec_segment->cycles_per_tick / STEP_TIMER_TICKS_PER_RMT_TICK;
+    if (period <= (hot_settings->pulse_microseconds + 1) * RMT_TICKS_PER_MICROSECOND)
+        return false;
+    uint8_t len = (st.step_count < RMT_STEP_TRAIN_MAX) ? st.step_count : RMT_STEP_TRAIN_MAX;
+    st.train_len = len;
+    st.train_cycles = st.exec_segment->cycles_per_tick;
+    st.step_outbits |= bit(axis);
+    int32_t steps = (direction_bits & bit(axis)) ? -(int32_t)len : (int32_t)len;
+#ifdef DEFER_POSITION_UPDATES
+    st.position_delta[axis] += steps;
+#else
+    sys_position[axis] += steps;
 #endif
-    }
+    st.step_count -= len - 1; // The last one is counted by the caller
+    return true;
+}
 #endif
 
-#ifdef  B_STEP_PIN
-    if (st.step_outbits & bit(B_AXIS)) {
-#ifndef Z2_STEP_PIN // if not a ganged axis
-        RMT.conf_ch[rmt_chan_num[B_AXIS][PRIMARY_MOTOR]].conf1.mem_rd_rst = 1;
-        RMT.conf_ch[rmt_chan_num[B_AXIS][PRIMARY_MOTOR]].conf1.tx_start = 1;
-#else // it is a ganged axis
-        if ((ganged_mode == SQUARING_MODE_DUAL) || (ganged_mode == SQUARING_MODE_A)) {
-            RMT.conf_ch[rmt_chan_num[B_AXIS][PRIMARY_MOTOR]].conf1.mem_rd_rst = 1;
-            RMT.conf_ch[rmt_chan_num[B_AXIS][PRIMARY_MOTOR]].conf1.tx_start = 1;
-        }
-        if ((ganged_mode == SQUARING_MODE_DUAL) || (ganged_mode == SQUARING_MODE_B)) {
-            RMT.conf_ch[rmt_chan_num[B_AXIS][GANGED_MOTOR]].conf1.mem_rd_rst = 1;
-            RMT.conf_ch[rmt_chan_num[B_AXIS][GANGED_MOTOR]].conf1.tx_start = 1;
-        }
-#endif
+// Starts the RMT pulse of every motor that steps this tick. The channel mask is collected first,
+// then each channel's conf1 register is read, and finally all channels are started back to back
+// with a single store each, so the skew between the motors is only a few store cycles.
+// NOTE: The ESP32 RMT has no register to start several channels at once.
+inline IRAM_ATTR static void stepperRMT_Outputs() {
+    const uint8_t* axis_channels = rmt_step_channels[ganged_mode];
+    uint32_t chan_mask = 0;
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        if (st.step_outbits & bit(axis))
+            chan_mask |= axis_channels[axis];
     }
+#ifdef USE_RMT_STEP_TRAINS
+    uint8_t train_len = st.train_len;
+    uint16_t train_period = st.train_cycles / STEP_TIMER_TICKS_PER_RMT_TICK;
+    st.train_output_cycles = (chan_mask != 0 && train_len != 0) ? (uint32_t)st.train_cycles * train_len : 0;
+    st.train_len = 0;
 #endif
-
-#ifdef  C_STEP_PIN
-    if (st.step_outbits & bit(C_AXIS)) {
-#ifndef Z2_STEP_PIN // if not a ganged axis
-        RMT.conf_ch[rmt_chan_num[C_AXIS][PRIMARY_MOTOR]].conf1.mem_rd_rst = 1;
-        RMT.conf_ch[rmt_chan_num[C_AXIS][PRIMARY_MOTOR]].conf1.tx_start = 1;
-#else // it is a ganged axis
-        if ((ganged_mode == SQUARING_MODE_DUAL) || (ganged_mode == SQUARING_MODE_A)) {
-            RMT.conf_ch[rmt_chan_num[C_AXIS][PRIMARY_MOTOR]].conf1.mem_rd_rst = 1;
-            RMT.conf_ch[rmt_chan_num[C_AXIS][PRIMARY_MOTOR]].conf1.tx_start = 1;
-        }
-        if ((ganged_mode == SQUARING_MODE_DUAL) || (ganged_mode == SQUARING_MODE_B)) {
-            RMT.conf_ch[rmt_chan_num[C_AXIS][GANGED_MOTOR]].conf1.mem_rd_rst = 1;
-            RMT.conf_ch[rmt_chan_num[C_AXIS][GANGED_MOTOR]].conf1.tx_start = 1;
-        }
+    if (chan_mask == 0)
+        return;
+    uint32_t conf1[RMT_CHANNEL_MAX];
+    for (uint32_t m = chan_mask; m; m &= m - 1) {
+        uint32_t chan = __builtin_ctz(m);
+#ifdef USE_RMT_STEP_TRAINS
+        st_rmt_load_train(chan, train_len, train_period);
 #endif
+        conf1[chan] = RMT.conf_ch[chan].conf1.val | RMT_MEM_RD_RST_CH0 | RMT_TX_START_CH0;
     }
+#ifdef STEPPER_ISR_PROFILE
+    uint32_t skew_start = xthal_get_ccount();
+#endif
+    for (uint32_t m = chan_mask; m; m &= m - 1) {
+        uint32_t chan = __builtin_ctz(m);
+        RMT.conf_ch[chan].conf1.val = conf1[chan];
+    }
+#ifdef STEPPER_ISR_PROFILE
+    uint32_t skew = xthal_get_ccount() - skew_start;
+    if (skew > rmt_start_skew_max)
+        rmt_start_skew_max = skew;
 #endif
-
-
 }
 #endif
 
 // Stepper shutdown
-void st_go_idle() {
+void IRAM_ATTR st_go_idle() {
     // Disable Stepper Driver Interrupt. Allow Stepper Port Reset Interrupt to finish, if active.
     Stepper_Timer_Stop();
     busy = false;
+#ifdef DEFER_POSITION_UPDATES
+    // Account for the steps of a segment interrupted by a reset, abort or jog cancel.
+    st_flush_position_delta();
+#endif
     // Set stepper driver idle state, disabled or enabled, depending on settings and circumstances.
-    if (((stepper_idle_lock_time->get() != 0xff) || sys_rt_exec_alarm || sys.state == STATE_SLEEP) && sys.state != STATE_HOMING) {
+    if (((hot_settings->idle_lock_time != 0xff) || sys_rt_exec_alarm || sys.state == STATE_SLEEP) && sys.state != STATE_HOMING) {
         // Force stepper dwell to lock axes for a defined amount of time to ensure the axes come to a complete
         // stop and not drift from residual inertial forces at the end of the last movement.
 
@@ -688,7 +1447,7 @@ void st_go_idle() {
             motors_set_disable(true);
         } else {
             stepper_idle = true; // esp32 work around for disable in main loop
-            stepper_idle_counter = esp_timer_get_time() + (stepper_idle_lock_time->get() * 1000); // * 1000 because the time is in uSecs
+            stepper_idle_counter = esp_timer_get_time() + (hot_settings->idle_lock_time * 1000); // * 1000 because the time is in uSecs
             // after idle countdown will be disabled in protocol loop
         }
     } else
@@ -697,9 +1456,106 @@ void st_go_idle() {
     set_stepper_pins_on(0);
 }
 
+#ifdef RETIME_QUEUED_SEGMENTS
+static void st_segment_timing(segment_t* segment, const st_block_t* block, uint32_t cycles);
+
+// The timer ticks per step of a segment, as given to st_segment_timing(), which shifted them for
+// the AMASS level or the prescaler. Shifts segment->n_step back to the step count too.
+static uint32_t st_segment_cycles(segment_t* segment) {
+#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+    segment->n_step >>= segment->amass_level;
+    return (uint32_t)segment->cycles_per_tick << segment->amass_level;
+#else
+    const uint8_t prescaler_shift[4] = { 0, 0, 3, 6 };
+    return (uint32_t)segment->cycles_per_tick << prescaler_shift[segment->prescaler];
+#endif
+}
+
+// Both segments have the same AMASS level or prescaler
+static inline bool st_segment_same_scale(const segment_t* a, const segment_t* b) {
+#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+    return a->amass_level == b->amass_level;
+#else
+    return a->prescaler == b->prescaler;
+#endif
+}
+
+// Re-times the segments at the end of the buffer for a new nominal speed of the block being
+// prepped, as after a feed override, so the change does not wait for the prepared segments to run
+// out. Only the segments cruising at prep.current_speed are changed. The speed of each is at most
+// the block acceleration over a segment time from that of the one before, and no more than the
+// block can still slow to its exit speed from. prep.current_speed ends at the speed the last one
+// reaches, for the replan. Called with the prep locked.
+// The new timing goes through st_segment_timing(), so a large change picks another AMASS level or
+// prescaler as a newly prepared segment would.
+// NOTE: The ISR may start the oldest of them while it is changed. The 16-bit store of
+// cycles_per_tick is atomic, so that segment runs at either timing. Its other fields are not, so
+// if it needs another AMASS level or prescaler it is left as it is, and the ramp starts after it.
+static void st_retime_queued_segments() {
+    if (prep.ramp_type != RAMP_CRUISE || prep.cruise_segments == 0 || prep.current_speed <= 0.0f)
+        return;
+    if ((sys.step_control & STEP_CONTROL_EXECUTE_HOLD) || st_prep_block->is_pwm_rate_adjusted)
+        return;
+#ifdef SEGMENT_BLOCKS
+    if (segment_blocks)
+        return; // The steps of each segment are timed one by one
+#endif
+    uint8_t queued = segment_ring.count();
+    if (queued < 2)
+        return; // Only the executing segment
+    float speed = prep.current_speed;
+    float target = plan_compute_profile_nominal_speed(pl_block);
+    float limit_sqr = prep.exit_speed * prep.exit_speed + 2.0f * pl_block->acceleration * (pl_block->millimeters - prep.mm_complete);
+    if (target * target > limit_sqr)
+        target = sqrtf(limit_sqr);
+    if (fabsf(target - speed) < 0.01f * speed)
+        return; // Within the rounding of a per cent override
+    float speed_step = pl_block->acceleration * DT_SEGMENT;
+    uint8_t count = MIN(prep.cruise_segments, queued - 1);
+    float ratio = 1.0f;
+    uint8_t first = 1; // The first segment that is re-timed
+    for (uint8_t i = 1; i <= count; i++) {
+        uint8_t n = i + 1 - first; // Segment times from the last one at speed
+        float segment_speed = constrain(target, speed - n * speed_step, speed + n * speed_step);
+        float segment_ratio = segment_speed / speed;
+        segment_t* segment = segment_ring.pushed_slot(count + 1 - i); // Oldest first
+        segment_t timed = *segment;
+        uint32_t cycles = st_segment_cycles(&timed) / segment_ratio;
+        st_segment_timing(&timed, st_segment_block(timed.st_block_index), cycles);
+        if (i == 1) {
+            if (!st_segment_same_scale(&timed, segment)) {
+                first = 2; // The ISR may load it while it is changed
+                continue;
+            }
+            segment->cycles_per_tick = timed.cycles_per_tick;
+        } else {
+            segment->n_step = timed.n_step;
+#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+            segment->amass_level = timed.amass_level;
+#else
+            segment->prescaler = timed.prescaler;
+#endif
+            segment->cycles_per_tick = timed.cycles_per_tick;
+        }
+        ratio = segment_ratio;
+#ifdef SPINDLE_CAPTURE
+        segment->feed_rate = segment_speed;
+#endif
+    }
+    if (first > count)
+        return; // Nothing re-timed
+    prep.current_speed = speed * ratio;
+    prep.dt_remainder /= ratio;
+    prep.cruise_segments = 0;
+}
+#endif
+
 // Called by planner_recalculate() when the executing block is updated by the new plan.
 void st_update_plan_block_parameters() {
     if (pl_block != NULL) { // Ignore if at start of a new block.
+#ifdef RETIME_QUEUED_SEGMENTS
+        st_retime_queued_segments();
+#endif
         prep.recalculate_flag |= PREP_FLAG_RECALCULATE;
         pl_block->entry_speed_sqr = prep.current_speed * prep.current_speed; // Update entry speed.
         pl_block = NULL; // Flag st_prep_segment() to load and check active velocity profile.
@@ -759,7 +1615,7 @@ void st_generate_step_dir_invert_masks() {
 // Increments the step segment buffer block data ring buffer.
 static uint8_t st_next_block_index(uint8_t block_index) {
     block_index++;
-    if (block_index == (SEGMENT_BUFFER_SIZE - 1))
+    if (block_index == (segment_ring.size() - 1))
         return (0);
     return (block_index);
 }
@@ -777,11 +1633,261 @@ static uint8_t st_next_block_index(uint8_t block_index) {
    Currently, the segment buffer conservatively holds roughly up to 40-50 msec of steps.
    NOTE: Computation units are in steps, millimeters, and minutes.
 */
+#ifdef USE_SEGMENT_PREP_TASK
+void st_prep_lock() {
+    if (prep_mutex)
+        xSemaphoreTake(prep_mutex, portMAX_DELAY);
+}
+
+void st_prep_unlock() {
+    if (prep_mutex)
+        xSemaphoreGive(prep_mutex);
+}
+#endif
+
+#if defined(ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING) && defined(AMASS_MULTI_AXIS_ONLY)
+// The block steps at most one axis, so smoothing gains nothing
+static bool st_block_single_axis(const st_block_t* block) {
+    uint8_t axes = 0;
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        if (block->steps[axis] != 0)
+            axes++;
+    }
+    return axes <= 1;
+}
+#endif
+
+// Sets the step timing of a segment of block from the timer ticks per step, with the AMASS level
+// or the prescaler it needs.
+static void st_segment_timing(segment_t* segment, const st_block_t* block, uint32_t cycles) {
+#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+    // Compute step timing and multi-axis smoothing level.
+    // NOTE: AMASS overdrives the timer with each level, so only one prescalar is required.
+    segment->amass_level = 0;
+#ifdef AMASS_MULTI_AXIS_ONLY
+    if (st_block_single_axis(block)) {
+        while (segment->amass_level < MAX_AMASS_LEVEL && (cycles >> segment->amass_level) >= (1UL << 16))
+            segment->amass_level++;
+    } else
+#endif
+        while (segment->amass_level < MAX_AMASS_LEVEL && cycles >= AMASS_LEVEL_CYCLES(segment->amass_level + 1))
+            segment->amass_level++;
+    cycles >>= segment->amass_level;
+    segment->n_step <<= segment->amass_level;
+    if (cycles < (1UL << 16)) {
+        segment->cycles_per_tick = cycles;    // < 65536 (4.1ms @ 16MHz)
+    } else {
+        segment->cycles_per_tick = 0xffff;    // Just set the slowest speed possible.
+    }
+#else
+    // Compute step timing and timer prescalar for normal step generation.
+    if (cycles < (1UL << 16)) { // < 65536  (4.1ms @ 16MHz)
+        segment->prescaler = 1; // prescaler: 0
+        segment->cycles_per_tick = cycles;
+    } else if (cycles < (1UL << 19)) { // < 524288 (32.8ms@16MHz)
+        segment->prescaler = 2; // prescaler: 8
+        segment->cycles_per_tick = cycles >> 3;
+    } else {
+        segment->prescaler = 3; // prescaler: 64
+        if (cycles < (1UL << 22))   // < 4194304 (262ms@16MHz)
+            segment->cycles_per_tick =  cycles >> 6;
+        else   // Just set the slowest speed possible. (Around 4 step/sec.)
+            segment->cycles_per_tick = 0xffff;
+    }
+#endif
+}
+
+#ifdef SEGMENT_BLOCKS
+// The signed axis steps of a block from step event events_from to events_to, on the Bresenham
+// line of the block
+static void st_block_steps(const plan_block_t* block, uint32_t events_from, uint32_t events_to, int32_t* steps) {
+    uint64_t half = block->step_event_count >> 1;
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        int32_t from = ((uint64_t)events_from * block->steps[axis] + half) / block->step_event_count;
+        int32_t to = ((uint64_t)events_to * block->steps[axis] + half) / block->step_event_count;
+        steps[axis] = (block->direction_bits & bit(axis)) ? from - to : to - from;
+    }
+}
+
+#ifdef BACKLASH_COMPENSATION
+// Adds the backlash steps to the signed motor steps of a segment of dt (min), and gives them in
+// uncounted. An axis that turns the other way owes its whole slack, less what it still owed
+// from the way before, as that part was never taken up.
+static void st_backlash_steps(int32_t* steps, float dt, uint16_t* uncounted) {
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        uint32_t slack = hot_settings->backlash_steps[axis];
+        uncounted[axis] = 0;
+        if (steps[axis] != 0) {
+            int8_t dir = (steps[axis] < 0) ? -1 : 1;
+            if (backlash_dir[axis] != 0 && dir != backlash_dir[axis])
+                backlash_pending[axis] = slack - MIN(backlash_pending[axis], slack);
+            backlash_dir[axis] = dir;
+        }
+        if (backlash_pending[axis] == 0)
+            continue;
+        uint32_t share = (slack + BACKLASH_SEGMENTS - 1) / BACKLASH_SEGMENTS;
+        share = MAX(1, MIN(share, (uint32_t)(hot_settings->backlash_rate[axis] * dt)));
+        uint32_t take = MIN(MIN(backlash_pending[axis], share), 0xffff);
+        backlash_pending[axis] -= take;
+        steps[axis] += backlash_dir[axis] * (int32_t)take;
+        uncounted[axis] = take;
+    }
+}
+#endif
+
+// Gives the prepped segment block data of its own, with the signed axis steps of steps over
+// the time dt (min). The steps of the axes are a line of their own, as they no longer follow
+// the Bresenham line of the block. With from_block false, the segment is not prepped from a
+// block, like the delayed motion of the shapers after the input motion has stopped.
+static void st_segment_own_block(segment_t* segment, float dt, int32_t* steps, bool from_block) {
+    segment_block_index = (segment_block_index + 1) % segment_ring.size();
+    st_block_t* st_block = &st_segment_blocks[segment_block_index];
+#ifdef BACKLASH_COMPENSATION
+    st_backlash_steps(steps, dt, st_block->uncounted);
+#endif
+    uint32_t n_step = 0;
+    st_block->direction_bits = 0;
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        if (steps[axis] < 0) {
+            st_block->direction_bits |= bit(axis);
+            steps[axis] = -steps[axis];
+        }
+        st_block->steps[axis] = steps[axis];
+        n_step = MAX(n_step, st_block->steps[axis]);
+    }
+    // A segment with no steps still takes its time, as one tick that steps no axis
+    n_step = MAX(n_step, 1);
+    st_block->step_event_count = n_step;
+#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+    for (uint8_t axis = 0; axis < N_AXIS; axis++)
+        st_block->steps[axis] <<= MAX_AMASS_LEVEL;
+    st_block->step_event_count <<= MAX_AMASS_LEVEL;
+#endif
+#ifdef USE_RMT_STEP_TRAINS
+    st_block->train_axis = RMT_TRAIN_NONE;
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        if (steps[axis] == 0)
+            continue;
+        if (st_block->train_axis != RMT_TRAIN_NONE || !bit_istrue(rmt_step_axes, bit(axis))) {
+            st_block->train_axis = RMT_TRAIN_NONE;
+            break;
+        }
+        st_block->train_axis = axis;
+    }
+#ifdef BACKLASH_COMPENSATION
+    // A train counts all of its steps in the position
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        if (st_block->uncounted[axis])
+            st_block->train_axis = RMT_TRAIN_NONE;
+    }
+#endif
+#endif
+    // The events of the block start with the first segment prepped from it
+    st_block->is_pwm_rate_adjusted = st_prep_block->is_pwm_rate_adjusted;
+    st_block->coolant = COOLANT_NO_CHANGE;
+#ifdef PROBE_SEQUENCE
+    st_block->probe = false;
+#endif
+    if (from_block && segment_source_index != prep.st_block_index) {
+        segment_source_index = prep.st_block_index;
+        st_block->coolant = st_prep_block->coolant;
+#ifdef PROBE_SEQUENCE
+        st_block->probe = st_prep_block->probe;
+#endif
+    }
+    segment->st_block_index = ST_SEGMENT_BLOCK | segment_block_index;
+    segment->n_step = n_step;
+    st_segment_timing(segment, st_block, ceilf((TICKS_PER_MICROSECOND * 1000000 * 60) * dt / n_step));
+}
+
+// Makes the prepped segment one with block data of its own, over the same time dt (min). Its
+// steps are the motion of the block from step event events_from to events_to. While shaping,
+// the shapers of the axes delay and spread these.
+static void st_segment_steps(segment_t* segment, float dt, const plan_block_t* block, uint32_t events_from, uint32_t events_to) {
+    int32_t steps[N_AXIS];
+    st_block_steps(block, events_from, events_to, steps);
+#ifdef INPUT_SHAPING
+    if (shaping) {
+        int32_t shaped[N_AXIS];
+        shaper_segment(steps, dt * 60000.0f, shaped);
+        memcpy(steps, shaped, sizeof(steps));
+    }
+#endif
+    st_segment_own_block(segment, dt, steps, true);
+}
+
+// The segments have block data of their own while shaping or taking up backlash
+static inline bool st_segment_own_blocks() {
+#ifdef INPUT_SHAPING
+    if (shaping)
+        return true;
+#endif
+#ifdef BACKLASH_COMPENSATION
+    if (backlash)
+        return true;
+#endif
+    return false;
+}
+#endif
+
+#ifdef BACKLASH_COMPENSATION
+// Whether the block takes up backlash. Homing is not taken up, and neither is a build that has
+// no room for the block data of the segments.
+static bool st_backlash_begin(const plan_block_t* block) {
+    bool any = false;
+    for (uint8_t axis = 0; axis < N_AXIS; axis++)
+        any |= hot_settings->backlash_steps[axis] != 0;
+    if (any && st_segment_blocks != NULL && sys.state != STATE_HOMING)
+        return true;
+    // The axes still move to a side of their slack
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        if (block->steps[axis] != 0) {
+            backlash_dir[axis] = (block->direction_bits & bit(axis)) ? -1 : 1;
+            backlash_pending[axis] = 0;
+        }
+    }
+    return false;
+}
+#endif
+
+#ifdef INPUT_SHAPING
+// Plays out the motion still delayed by the shapers once the input motion has stopped
+static void st_shape_tail() {
+    while (shaping && !shaper_idle() && !segment_ring.full()) {
+        segment_t* segment = segment_ring.producer_slot();
+        *segment = shaped_last;
+        int32_t none[N_AXIS] = { 0 };
+        int32_t shaped[N_AXIS];
+        shaper_segment(none, DT_SHAPED_SEGMENT * 60000.0f, shaped);
+        st_segment_own_block(segment, DT_SHAPED_SEGMENT, shaped, false);
+        segment_ring.push();
+    }
+}
+#endif
+
+static void st_prep_segments();
+
+// With the segment prep task, called by both the prep task and the main program, so the prep
+// itself is done under the lock.
 void st_prep_buffer() {
+    st_prep_lock();
+    st_prep_segments();
+#ifdef INPUT_SHAPING
+    st_shape_tail();
+#endif
+    st_prep_unlock();
+}
+
+static void st_prep_segments() {
     // Block step prep buffer, while in a suspend state and there is no suspend motion to execute.
     if (bit_istrue(sys.step_control, STEP_CONTROL_END_MOTION))
         return;
-    while (segment_buffer_tail != segment_next_head) { // Check if we need to fill the buffer.
+    TRACE_SCOPE(TRACE_PREP, 0);
+    HEAP_TAG_SCOPE(HEAP_TAG_MOTION);
+    while (!segment_ring.full()) { // Check if we need to fill the buffer.
+#ifdef STEPPER_ISR_PROFILE
+        uint32_t prep_cycles_start = xthal_get_ccount();
+#endif
         // Determine if we need to load a new planner block or if the block needs to be recomputed.
         if (pl_block == NULL) {
             // Query planner for a queued block
@@ -790,8 +1896,17 @@ void st_prep_buffer() {
             else
                 pl_block = plan_get_current_block();
             if (pl_block == NULL) {
+                if (sys.state == STATE_CYCLE && !planner_starved) {
+                    planner_starved = true;
+                    planner_starvations++;
+                    planner_starvations_total++;
+#ifdef JOB_STATS
+                    job_stats_starved();
+#endif
+                }
                 return;    // No planner blocks. Exit.
             }
+            planner_starved = false;
             // Check if we need to only recompute the velocity profile or load a new block.
             if (prep.recalculate_flag & PREP_FLAG_RECALCULATE) {
 #ifdef PARKING_ENABLE
@@ -810,6 +1925,24 @@ void st_prep_buffer() {
                 // segment buffer finishes the prepped block, but the stepper ISR is still executing it.
                 st_prep_block = &st_block_buffer[prep.st_block_index];
                 st_prep_block->direction_bits = pl_block->direction_bits;
+#ifdef PROBE_SEQUENCE
+                st_prep_block->probe = pl_block->probe;
+#endif
+#ifdef BACKLASH_COMPENSATION
+                // Only decided as a block is loaded, so the steps of a block follow one line
+                // from its start
+                backlash = st_backlash_begin(pl_block);
+                segment_blocks = st_segment_own_blocks();
+#endif
+                // Only a change of the coolant condition is an event. Homing and parking motions
+                // have no coolant in theirs, and these leave the pins alone.
+                st_prep_block->coolant = COOLANT_NO_CHANGE;
+                if (!(pl_block->condition & PL_COND_FLAG_SYSTEM_MOTION)) {
+                    uint8_t coolant = pl_block->condition & (PL_COND_FLAG_COOLANT_FLOOD | PL_COND_FLAG_COOLANT_MIST);
+                    if (coolant != prep.coolant)
+                        st_prep_block->coolant = coolant;
+                    prep.coolant = coolant;
+                }
                 uint8_t idx;
 #ifndef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
                 for (idx = 0; idx < N_AXIS; idx++)
@@ -822,25 +1955,47 @@ void st_prep_buffer() {
                 for (idx = 0; idx < N_AXIS; idx++)
                     st_prep_block->steps[idx] = pl_block->steps[idx] << MAX_AMASS_LEVEL;
                 st_prep_block->step_event_count = pl_block->step_event_count << MAX_AMASS_LEVEL;
+#endif
+#ifdef USE_RMT_STEP_TRAINS
+                // Single-axis blocks of RMT driven axes can be sent as step trains.
+                st_prep_block->train_axis = RMT_TRAIN_NONE;
+                for (idx = 0; idx < N_AXIS; idx++) {
+                    if (pl_block->steps[idx] == 0)
+                        continue;
+                    if (st_prep_block->train_axis != RMT_TRAIN_NONE || !bit_istrue(rmt_step_axes, bit(idx))) {
+                        st_prep_block->train_axis = RMT_TRAIN_NONE;
+                        break;
+                    }
+                    st_prep_block->train_axis = idx;
+                }
+#ifdef LASER_RASTER
+                if (pl_block->raster != NULL)
+                    st_prep_block->train_axis = RMT_TRAIN_NONE; // The ISR tracks the pixels step by step.
+#endif
+#endif
+#ifdef LASER_RASTER
+                st_prep_block->raster = pl_block->raster;
+                if (pl_block->raster != NULL)
+                    st_prep_block->raster_width = ((uint64_t)st_prep_block->step_event_count << 16) / pl_block->raster->pixels;
 #endif
                 // Initialize segment buffer data for generating the segments.
                 prep.steps_remaining = (float)pl_block->step_event_count;
                 prep.step_per_mm = prep.steps_remaining / pl_block->millimeters;
                 prep.req_mm_increment = REQ_MM_INCREMENT_SCALAR / prep.step_per_mm;
-                prep.dt_remainder = 0.0; // Reset for new segment block
+                prep.dt_remainder = 0.0f; // Reset for new segment block
                 if ((sys.step_control & STEP_CONTROL_EXECUTE_HOLD) || (prep.recalculate_flag & PREP_FLAG_DECEL_OVERRIDE)) {
                     // New block loaded mid-hold. Override planner block entry speed to enforce deceleration.
                     prep.current_speed = prep.exit_speed;
                     pl_block->entry_speed_sqr = prep.exit_speed * prep.exit_speed;
                     prep.recalculate_flag &= ~(PREP_FLAG_DECEL_OVERRIDE);
                 } else
-                    prep.current_speed = sqrt(pl_block->entry_speed_sqr);
+                    prep.current_speed = sqrtf(pl_block->entry_speed_sqr);
 
 
                 if (spindle->isRateAdjusted() ){ //   laser_mode->get() {
                     if (pl_block->condition & PL_COND_FLAG_SPINDLE_CCW) {
                         // Pre-compute inverse programmed rate to speed up PWM updating per step segment.
-                        prep.inv_rate = 1.0 / pl_block->programmed_rate;
+                        prep.inv_rate = 1.0f / pl_block->programmed_rate;
                         st_prep_block->is_pwm_rate_adjusted = true;
                     }
                 }
@@ -852,20 +2007,20 @@ void st_prep_buffer() {
              planner has updated it. For a commanded forced-deceleration, such as from a feed
              hold, override the planner velocities and decelerate to the target exit speed.
             */
-            prep.mm_complete = 0.0; // Default velocity profile complete at 0.0mm from end of block.
-            float inv_2_accel = 0.5 / pl_block->acceleration;
+            prep.mm_complete = 0.0f; // Default velocity profile complete at 0.0mm from end of block.
+            float inv_2_accel = 0.5f / pl_block->acceleration;
             if (sys.step_control & STEP_CONTROL_EXECUTE_HOLD) { // [Forced Deceleration to Zero Velocity]
                 // Compute velocity profile parameters for a feed hold in-progress. This profile overrides
                 // the planner block profile, enforcing a deceleration to zero speed.
                 prep.ramp_type = RAMP_DECEL;
                 // Compute decelerate distance relative to end of block.
                 float decel_dist = pl_block->millimeters - inv_2_accel * pl_block->entry_speed_sqr;
-                if (decel_dist < 0.0) {
+                if (decel_dist < 0.0f) {
                     // Deceleration through entire planner block. End of feed hold is not in this block.
-                    prep.exit_speed = sqrt(pl_block->entry_speed_sqr - 2 * pl_block->acceleration * pl_block->millimeters);
+                    prep.exit_speed = sqrtf(pl_block->entry_speed_sqr - 2 * pl_block->acceleration * pl_block->millimeters);
                 } else {
                     prep.mm_complete = decel_dist; // End of feed hold.
-                    prep.exit_speed = 0.0;
+                    prep.exit_speed = 0.0f;
                 }
             } else { // [Normal Operation]
                 // Compute or recompute velocity profile parameters of the prepped planner block.
@@ -874,23 +2029,23 @@ void st_prep_buffer() {
                 float exit_speed_sqr;
                 float nominal_speed;
                 if (sys.step_control & STEP_CONTROL_EXECUTE_SYS_MOTION) {
-                    prep.exit_speed = exit_speed_sqr = 0.0; // Enforce stop at end of system motion.
+                    prep.exit_speed = exit_speed_sqr = 0.0f; // Enforce stop at end of system motion.
                 } else {
                     exit_speed_sqr = plan_get_exec_block_exit_speed_sqr();
-                    prep.exit_speed = sqrt(exit_speed_sqr);
+                    prep.exit_speed = sqrtf(exit_speed_sqr);
                 }
                 nominal_speed = plan_compute_profile_nominal_speed(pl_block);
                 float nominal_speed_sqr = nominal_speed * nominal_speed;
                 float intersect_distance =
-                    0.5 * (pl_block->millimeters + inv_2_accel * (pl_block->entry_speed_sqr - exit_speed_sqr));
+                    0.5f * (pl_block->millimeters + inv_2_accel * (pl_block->entry_speed_sqr - exit_speed_sqr));
                 if (pl_block->entry_speed_sqr > nominal_speed_sqr) { // Only occurs during override reductions.
                     prep.accelerate_until = pl_block->millimeters - inv_2_accel * (pl_block->entry_speed_sqr - nominal_speed_sqr);
-                    if (prep.accelerate_until <= 0.0) { // Deceleration-only.
+                    if (prep.accelerate_until <= 0.0f) { // Deceleration-only.
                         prep.ramp_type = RAMP_DECEL;
                         // prep.decelerate_after = pl_block->millimeters;
                         // prep.maximum_speed = prep.current_speed;
                         // Compute override block exit speed since it doesn't match the planner exit speed.
-                        prep.exit_speed = sqrt(pl_block->entry_speed_sqr - 2 * pl_block->acceleration * pl_block->millimeters);
+                        prep.exit_speed = sqrtf(pl_block->entry_speed_sqr - 2 * pl_block->acceleration * pl_block->millimeters);
                         prep.recalculate_flag |= PREP_FLAG_DECEL_OVERRIDE; // Flag to load next block as deceleration override.
                         // TODO: Determine correct handling of parameters in deceleration-only.
                         // Can be tricky since entry speed will be current speed, as in feed holds.
@@ -901,7 +2056,7 @@ void st_prep_buffer() {
                         prep.maximum_speed = nominal_speed;
                         prep.ramp_type = RAMP_DECEL_OVERRIDE;
                     }
-                } else if (intersect_distance > 0.0) {
+                } else if (intersect_distance > 0.0f) {
                     if (intersect_distance < pl_block->millimeters) { // Either trapezoid or triangle types
                         // NOTE: For acceleration-cruise and cruise-only types, following calculation will be 0.0.
                         prep.decelerate_after = inv_2_accel * (nominal_speed_sqr - exit_speed_sqr);
@@ -917,7 +2072,7 @@ void st_prep_buffer() {
                         } else { // Triangle type
                             prep.accelerate_until = intersect_distance;
                             prep.decelerate_after = intersect_distance;
-                            prep.maximum_speed = sqrt(2.0 * pl_block->acceleration * intersect_distance + exit_speed_sqr);
+                            prep.maximum_speed = sqrtf(2.0f * pl_block->acceleration * intersect_distance + exit_speed_sqr);
                         }
                     } else { // Deceleration-only type
                         prep.ramp_type = RAMP_DECEL;
@@ -925,17 +2080,34 @@ void st_prep_buffer() {
                         // prep.maximum_speed = prep.current_speed;
                     }
                 } else { // Acceleration-only type
-                    prep.accelerate_until = 0.0;
+                    prep.accelerate_until = 0.0f;
                     // prep.decelerate_after = 0.0;
                     prep.maximum_speed = prep.exit_speed;
                 }
             }
 
+            // Smoothstep ramps replace the constant acceleration ramps of the profile computed above,
+            // for blocks planned for them. Feed holds and override decelerations keep the trapezoidal
+            // ramps.
+            prep.scurve = pl_block->smoothstep &&
+                          !(sys.step_control & STEP_CONTROL_EXECUTE_HOLD) &&
+                          !(prep.recalculate_flag & PREP_FLAG_DECEL_OVERRIDE) &&
+                          (prep.ramp_type != RAMP_DECEL_OVERRIDE);
+            if (prep.scurve) {
+                if (prep.ramp_type == RAMP_ACCEL)
+                    st_scurve_ramp_begin(pl_block->millimeters, prep.accelerate_until, prep.current_speed, prep.maximum_speed);
+                else if (prep.ramp_type == RAMP_DECEL)
+                    st_scurve_ramp_begin(pl_block->millimeters, prep.mm_complete, prep.current_speed, prep.exit_speed);
+            }
+
             bit_true(sys.step_control, STEP_CONTROL_UPDATE_SPINDLE_RPM); // Force update whenever updating block.
+#ifdef RETIME_QUEUED_SEGMENTS
+            prep.cruise_segments = 0;
+#endif
 
         }
         // Initialize new segment
-        segment_t* prep_segment = &segment_buffer[segment_buffer_head];
+        segment_t* prep_segment = segment_ring.producer_slot();
         // Set new segment to point to the current segment data block.
         prep_segment->st_block_index = prep.st_block_index;
         /*------------------------------------------------------------------------------------
@@ -952,25 +2124,45 @@ void st_prep_buffer() {
           the end of planner block (typical) or mid-block at the end of a forced deceleration,
           such as from a feed hold.
         */
-        float dt_max = DT_SEGMENT; // Maximum segment time
-        float dt = 0.0; // Initialize segment time
+#ifdef INPUT_SHAPING
+        // The shapers and their delays only change between motions
+        if (shaper_idle()) {
+            shaping = st_segment_blocks != NULL && sys.state != STATE_HOMING && shaper_begin();
+            segment_blocks = st_segment_own_blocks();
+        }
+        float dt_segment = shaping ? DT_SHAPED_SEGMENT : DT_SEGMENT;
+#else
+        float dt_segment = DT_SEGMENT;
+#endif
+        float dt_max = dt_segment; // Maximum segment time
+        float dt = 0.0f; // Initialize segment time
         float time_var = dt_max; // Time worker variable
         float mm_var; // mm-Distance worker variable
         float speed_var; // Speed worker variable
         float mm_remaining = pl_block->millimeters; // New segment distance from end of block.
+        float segment_start_mm = mm_remaining;
         float minimum_mm = mm_remaining - prep.req_mm_increment; // Guarantee at least one step.
-        if (minimum_mm < 0.0)
-            minimum_mm = 0.0;
+        if (minimum_mm < 0.0f)
+            minimum_mm = 0.0f;
+#ifdef RETIME_QUEUED_SEGMENTS
+        uint8_t segment_start_ramp = prep.ramp_type;
+#endif
+#ifdef JOB_STATS
+        float ramp_dt[3] = { 0.0f, 0.0f, 0.0f }; // RAMP_ACCEL, RAMP_CRUISE, RAMP_DECEL
+#endif
         do {
+#ifdef JOB_STATS
+            uint8_t ramp = (prep.ramp_type == RAMP_DECEL_OVERRIDE) ? RAMP_DECEL : prep.ramp_type;
+#endif
             switch (prep.ramp_type) {
             case RAMP_DECEL_OVERRIDE:
                 speed_var = pl_block->acceleration * time_var;
-                mm_var = time_var * (prep.current_speed - 0.5 * speed_var);
+                mm_var = time_var * (prep.current_speed - 0.5f * speed_var);
                 mm_remaining -= mm_var;
                 if ((mm_remaining < prep.accelerate_until) || (mm_var <= 0)) {
                     // Cruise or cruise-deceleration types only for deceleration override.
                     mm_remaining = prep.accelerate_until; // NOTE: 0.0 at EOB
-                    time_var = 2.0 * (pl_block->millimeters - mm_remaining) / (prep.current_speed + prep.maximum_speed);
+                    time_var = 2.0f * (pl_block->millimeters - mm_remaining) / (prep.current_speed + prep.maximum_speed);
                     prep.ramp_type = RAMP_CRUISE;
                     prep.current_speed = prep.maximum_speed;
                 } else   // Mid-deceleration override ramp.
@@ -978,12 +2170,24 @@ void st_prep_buffer() {
                 break;
             case RAMP_ACCEL:
                 // NOTE: Acceleration ramp only computes during first do-while loop.
+                if (prep.scurve) {
+                    if (st_scurve_ramp_advance(&time_var, &mm_remaining)) { // End of acceleration ramp.
+                        mm_remaining = prep.accelerate_until; // NOTE: 0.0 at EOB
+                        prep.current_speed = prep.maximum_speed;
+                        if (mm_remaining == prep.decelerate_after) {
+                            prep.ramp_type = RAMP_DECEL;
+                            st_scurve_ramp_begin(mm_remaining, prep.mm_complete, prep.current_speed, prep.exit_speed);
+                        } else
+                            prep.ramp_type = RAMP_CRUISE;
+                    }
+                    break;
+                }
                 speed_var = pl_block->acceleration * time_var;
-                mm_remaining -= time_var * (prep.current_speed + 0.5 * speed_var);
+                mm_remaining -= time_var * (prep.current_speed + 0.5f * speed_var);
                 if (mm_remaining < prep.accelerate_until) { // End of acceleration ramp.
                     // Acceleration-cruise, acceleration-deceleration ramp junction, or end of block.
                     mm_remaining = prep.accelerate_until; // NOTE: 0.0 at EOB
-                    time_var = 2.0 * (pl_block->millimeters - mm_remaining) / (prep.current_speed + prep.maximum_speed);
+                    time_var = 2.0f * (pl_block->millimeters - mm_remaining) / (prep.current_speed + prep.maximum_speed);
                     if (mm_remaining == prep.decelerate_after)
                         prep.ramp_type = RAMP_DECEL;
                     else
@@ -1002,15 +2206,24 @@ void st_prep_buffer() {
                     time_var = (mm_remaining - prep.decelerate_after) / prep.maximum_speed;
                     mm_remaining = prep.decelerate_after; // NOTE: 0.0 at EOB
                     prep.ramp_type = RAMP_DECEL;
+                    if (prep.scurve)
+                        st_scurve_ramp_begin(mm_remaining, prep.mm_complete, prep.current_speed, prep.exit_speed);
                 } else   // Cruising only.
                     mm_remaining = mm_var;
                 break;
             default: // case RAMP_DECEL:
+                if (prep.scurve) {
+                    if (st_scurve_ramp_advance(&time_var, &mm_remaining)) { // End of block.
+                        mm_remaining = prep.mm_complete;
+                        prep.current_speed = prep.exit_speed;
+                    }
+                    break;
+                }
                 // NOTE: mm_var used as a misc worker variable to prevent errors when near zero speed.
                 speed_var = pl_block->acceleration * time_var; // Used as delta speed (mm/min)
                 if (prep.current_speed > speed_var) { // Check if at or below zero speed.
                     // Compute distance from end of segment to end of block.
-                    mm_var = mm_remaining - time_var * (prep.current_speed - 0.5 * speed_var); // (mm)
+                    mm_var = mm_remaining - time_var * (prep.current_speed - 0.5f * speed_var); // (mm)
                     if (mm_var > prep.mm_complete) { // Typical case. In deceleration ramp.
                         mm_remaining = mm_var;
                         prep.current_speed -= speed_var;
@@ -1018,24 +2231,30 @@ void st_prep_buffer() {
                     }
                 }
                 // Otherwise, at end of block or end of forced-deceleration.
-                time_var = 2.0 * (mm_remaining - prep.mm_complete) / (prep.current_speed + prep.exit_speed);
+                time_var = 2.0f * (mm_remaining - prep.mm_complete) / (prep.current_speed + prep.exit_speed);
                 mm_remaining = prep.mm_complete;
                 prep.current_speed = prep.exit_speed;
             }
             dt += time_var; // Add computed ramp time to total segment time.
+#ifdef JOB_STATS
+            ramp_dt[ramp] += time_var;
+#endif
             if (dt < dt_max) {
                 time_var = dt_max - dt;    // **Incomplete** At ramp junction.
             } else {
                 if (mm_remaining > minimum_mm) { // Check for very slow segments with zero steps.
                     // Increase segment time to ensure at least one step in segment. Override and loop
                     // through distance calculations until minimum_mm or mm_complete.
-                    dt_max += DT_SEGMENT;
+                    dt_max += dt_segment;
                     time_var = dt_max - dt;
                 } else {
                     break; // **Complete** Exit loop. Segment execution time maxed.
                 }
             }
         } while (mm_remaining > prep.mm_complete); // **Complete** Exit loop. Profile complete.
+#ifdef JOB_STATS
+        job_stats_segment(dt, segment_start_mm - mm_remaining, pl_block->programmed_rate, ramp_dt);
+#endif
 
         /* -----------------------------------------------------------------------------------
           Compute spindle speed PWM output for step segment
@@ -1045,7 +2264,11 @@ void st_prep_buffer() {
                 float rpm = pl_block->spindle_speed;
                 // NOTE: Feed and rapid overrides are independent of PWM value and do not alter laser power/rate.
                 if (st_prep_block->is_pwm_rate_adjusted) {
-                    rpm *= (prep.current_speed * prep.inv_rate);
+                    // Scale by the mean speed of the segment, the distance it covers over its time.
+                    // prep.current_speed is the speed at its end, so it leads the power while
+                    // accelerating and lags it while decelerating, which burns corners.
+                    float segment_speed = (dt > 0.0f) ? (segment_start_mm - mm_remaining) / dt : prep.current_speed;
+                    rpm *= (segment_speed * prep.inv_rate);
                     //grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "RPM %.2f", rpm);
                     //grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Rates CV %.2f IV %.2f RPM %.2f", prep.current_speed, prep.inv_rate, rpm);
                 }
@@ -1054,13 +2277,21 @@ void st_prep_buffer() {
 
                 prep.current_spindle_rpm = rpm;
             } else {
-                sys.spindle_speed = 0.0;
-                prep.current_spindle_rpm = 0.0;
+                sys.spindle_speed = 0.0f;
+                prep.current_spindle_rpm = 0.0f;
 
             }
             bit_false(sys.step_control, STEP_CONTROL_UPDATE_SPINDLE_RPM);
         }
         prep_segment->spindle_rpm = prep.current_spindle_rpm; // Reload segment PWM value
+        if (spindle->segment_duty) {
+            uint32_t rpm = prep_segment->spindle_rpm;
+            prep_segment->spindle_duty  = static_cast<PWMSpindle*>(spindle)->rpm_to_duty(&rpm);
+            prep_segment->spindle_speed = rpm;
+        }
+#ifdef SPINDLE_CAPTURE
+        prep_segment->feed_rate = (dt > 0.0f) ? (segment_start_mm - mm_remaining) / dt : prep.current_speed;
+#endif
 
         /* -----------------------------------------------------------------------------------
            Compute segment step rate, steps to execute, and apply necessary rate corrections.
@@ -1073,8 +2304,8 @@ void st_prep_buffer() {
            supported by Grbl (i.e. exceeding 10 meters axis travel at 200 step/mm).
         */
         float step_dist_remaining = prep.step_per_mm * mm_remaining; // Convert mm_remaining to steps
-        float n_steps_remaining = ceil(step_dist_remaining); // Round-up current steps remaining
-        float last_n_steps_remaining = ceil(prep.steps_remaining); // Round-up last steps remaining
+        float n_steps_remaining = ceilf(step_dist_remaining); // Round-up current steps remaining
+        float last_n_steps_remaining = ceilf(prep.steps_remaining); // Round-up last steps remaining
         prep_segment->n_step = last_n_steps_remaining - n_steps_remaining; // Compute number of steps to execute.
         // Bail if we are at the end of a feed hold and don't have a step to execute.
         if (prep_segment->n_step == 0) {
@@ -1100,47 +2331,34 @@ void st_prep_buffer() {
         dt += prep.dt_remainder; // Apply previous segment partial step execute time
         float inv_rate = dt / (last_n_steps_remaining - step_dist_remaining); // Compute adjusted step rate inverse
         // Compute CPU cycles per step for the prepped segment.
-        uint32_t cycles = ceil((TICKS_PER_MICROSECOND * 1000000 * 60) * inv_rate); // (cycles/step)
-#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
-        // Compute step timing and multi-axis smoothing level.
-        // NOTE: AMASS overdrives the timer with each level, so only one prescalar is required.
-        if (cycles < AMASS_LEVEL1)
-            prep_segment->amass_level = 0;
-        else {
-            if (cycles < AMASS_LEVEL2)
-                prep_segment->amass_level = 1;
-            else if (cycles < AMASS_LEVEL3)
-                prep_segment->amass_level = 2;
-            else
-                prep_segment->amass_level = 3;
-            cycles >>= prep_segment->amass_level;
-            prep_segment->n_step <<= prep_segment->amass_level;
-        }
-        if (cycles < (1UL << 16)) {
-            prep_segment->cycles_per_tick = cycles;    // < 65536 (4.1ms @ 16MHz)
-        } else {
-            prep_segment->cycles_per_tick = 0xffff;    // Just set the slowest speed possible.
-        }
-#else
-        // Compute step timing and timer prescalar for normal step generation.
-        if (cycles < (1UL << 16)) { // < 65536  (4.1ms @ 16MHz)
-            prep_segment->prescaler = 1; // prescaler: 0
-            prep_segment->cycles_per_tick = cycles;
-        } else if (cycles < (1UL << 19)) { // < 524288 (32.8ms@16MHz)
-            prep_segment->prescaler = 2; // prescaler: 8
-            prep_segment->cycles_per_tick = cycles >> 3;
-        } else {
-            prep_segment->prescaler = 3; // prescaler: 64
-            if (cycles < (1UL << 22))   // < 4194304 (262ms@16MHz)
-                prep_segment->cycles_per_tick =  cycles >> 6;
-            else   // Just set the slowest speed possible. (Around 4 step/sec.)
-                prep_segment->cycles_per_tick = 0xffff;
-        }
-#endif
+        uint32_t cycles = ceilf((TICKS_PER_MICROSECOND * 1000000 * 60) * inv_rate); // (cycles/step)
+#ifdef SEGMENT_BLOCKS
+        if (segment_blocks) {
+            // The whole steps of the segment take their time at the adjusted rate. The partial
+            // step left over is in the time of the next segment.
+            uint32_t events_to = pl_block->step_event_count - (uint32_t)n_steps_remaining;
+            float step_time = prep_segment->n_step ? prep_segment->n_step * inv_rate : dt;
+            st_segment_steps(prep_segment, step_time, pl_block, events_to - prep_segment->n_step, events_to);
+#ifdef INPUT_SHAPING
+            shaped_last = *prep_segment;
+#endif
+        } else
+#endif
+            st_segment_timing(prep_segment, st_prep_block, cycles);
         // Segment complete! Increment segment buffer indices, so stepper ISR can immediately execute it.
-        segment_buffer_head = segment_next_head;
-        if (++segment_next_head == SEGMENT_BUFFER_SIZE)
-            segment_next_head = 0;
+        TRACE_MARK(TRACE_SEGMENT_PREP, prep_segment->n_step);
+        segment_ring.push();
+#ifdef RETIME_QUEUED_SEGMENTS
+        if (segment_start_ramp == RAMP_CRUISE && prep.ramp_type == RAMP_CRUISE) {
+            if (prep.cruise_segments < 0xff)
+                prep.cruise_segments++;
+        } else
+            prep.cruise_segments = 0;
+#endif
+#ifdef STEPPER_ISR_PROFILE
+        prep_cycles_total += xthal_get_ccount() - prep_cycles_start;
+        prep_segment_count++;
+#endif
         // Update the appropriate planner and segment data.
         pl_block->millimeters = mm_remaining;
         prep.steps_remaining = n_steps_remaining;
@@ -1148,7 +2366,7 @@ void st_prep_buffer() {
         // Check for exit conditions and flag to load next planner block.
         if (mm_remaining == prep.mm_complete) {
             // End of planner block or forced-termination. No more distance to be executed.
-            if (mm_remaining > 0.0) { // At end of forced-termination.
+            if (mm_remaining > 0.0f) { // At end of forced-termination.
                 // Reset prep parameters for resuming and then bail. Allow the stepper ISR to complete
                 // the segment queue, where realtime protocol will set new state upon receiving the
                 // cycle stop flag from the ISR. Prep_segment is blocked until then.
@@ -1172,6 +2390,143 @@ void st_prep_buffer() {
 }
 
 
+#if defined(SD_BENCHMARK) || defined(BENCHMARK)
+// Prepares segments from the planner like st_prep_buffer() and drops them, as if the stepper ISR
+// had run them. Returns the number of segments. Only for the benchmark, with the ISR stopped.
+uint32_t st_bench_prep() {
+    uint32_t count = 0;
+    st_prep_buffer();
+    while (segment_ring.consumer_slot() != NULL) {
+        segment_ring.pop();
+        count++;
+    }
+    return count;
+}
+#endif
+
+#ifdef SD_BENCHMARK
+
+// Replays the step output of stepper_pulse_func() on a virtual timer for the segments that
+// st_prep_buffer() makes, and drops them. on_tick gets the step bits and direction bits of each
+// tick that steps an axis, and the time of its pulse in timer ticks from the start. The pulse of a
+// tick goes out at the next tick, as in the ISR, and a reversal waits Stepper/DirSetup.
+// Returns the number of segments.
+uint32_t st_sim_prep(st_sim_t* sim, void (*on_tick)(uint8_t step_bits, uint8_t dir_bits, uint64_t time)) {
+    uint32_t count = 0;
+    st_prep_buffer();
+    segment_t* segment;
+    while ((segment = segment_ring.consumer_slot()) != NULL) {
+        const st_block_t* block = st_segment_block(segment->st_block_index);
+        if (sim->block_index != segment->st_block_index) {
+            sim->block_index = segment->st_block_index;
+            for (uint8_t axis = 0; axis < N_AXIS; axis++)
+                sim->counter[axis] = block->step_event_count >> 1;
+        }
+        uint32_t steps[N_AXIS];
+        for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+            steps[axis] = block->steps[axis] >> segment->amass_level;
+#else
+            steps[axis] = block->steps[axis];
+#endif
+        }
+        for (uint16_t n = 0; n < segment->n_step; n++) {
+            uint8_t step_bits = 0;
+            for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+                sim->counter[axis] += steps[axis];
+                if (sim->counter[axis] > block->step_event_count) {
+                    step_bits |= bit(axis);
+                    sim->counter[axis] -= block->step_event_count;
+                }
+            }
+            sim->time += segment->cycles_per_tick;
+            if (step_bits) {
+                if (hot_settings->direction_setup_microseconds != 0 && ((block->direction_bits ^ sim->dir_bits) & step_bits))
+                    sim->time += hot_settings->direction_setup_microseconds * TICKS_PER_MICROSECOND;
+                sim->dir_bits = block->direction_bits;
+                on_tick(step_bits, block->direction_bits, sim->time);
+            }
+        }
+        segment_ring.pop();
+        count++;
+    }
+    return count;
+}
+#endif
+
+#ifdef BENCHMARK
+// Runs the stepper ISR for ticks ticks of an X motion at rate steps/sec, fed by segments made
+// here instead of by the prep, and fills *run with how long it took and the cycles of the ISR.
+// Unless step, the steps are muted. The direction pins and sys_position do change, so the caller
+// puts sys_position back. Returns false if the ISR fell more than 5% behind the rate. Only for
+// the benchmark, with the planner empty.
+bool st_bench_isr_rate(uint32_t rate, uint32_t ticks, bool step, void (*running)(), st_bench_run_t* run) {
+    uint32_t cycles_per_tick = F_STEPPER_TIMER / rate;
+    if (cycles_per_tick == 0 || cycles_per_tick > 0xffff)
+        return false;
+    int64_t expected_us = (int64_t)ticks * cycles_per_tick / TICKS_PER_MICROSECOND;
+    st_reset();
+    // Not block 0, which st_reset() leaves as the executing block index
+    uint8_t block_index = st_next_block_index(0);
+    st_block_t* block = &st_block_buffer[block_index];
+    memset(block, 0, sizeof(st_block_t));
+    block->steps[X_AXIS] = ticks;
+    block->step_event_count = ticks;
+#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
+    block->steps[X_AXIS] <<= MAX_AMASS_LEVEL;
+    block->step_event_count <<= MAX_AMASS_LEVEL;
+#endif
+    block->coolant = COOLANT_NO_CHANGE;
+#ifdef USE_RMT_STEP_TRAINS
+    block->train_axis = RMT_TRAIN_NONE; // A train would bypass the muting
+#endif
+    // Segments of one acceleration tick each, like those of the prep
+    uint32_t segment_steps = MAX(1, MIN(rate / ACCELERATION_TICKS_PER_SECOND, 0xffff));
+    uint32_t remaining = ticks;
+    int64_t start = 0;
+    memset(run, 0, sizeof(st_bench_run_t));
+    st_bench_muted = !step;
+    while (remaining > 0 || segment_ring.consumer_slot() != NULL || st.exec_segment != NULL) {
+        if (remaining > 0 && !segment_ring.full()) {
+            segment_t* segment = segment_ring.producer_slot();
+            memset(segment, 0, sizeof(segment_t));
+            segment->n_step = MIN(remaining, segment_steps);
+            segment->cycles_per_tick = cycles_per_tick;
+            segment->st_block_index = block_index;
+            segment->spindle_rpm = sys.spindle_speed;
+            if (spindle->segment_duty) {
+                uint32_t rpm = segment->spindle_rpm;
+                segment->spindle_duty = static_cast<PWMSpindle*>(spindle)->rpm_to_duty(&rpm);
+                segment->spindle_speed = rpm;
+            }
+            segment_ring.push();
+            remaining -= segment->n_step;
+            if (start == 0 && (remaining == 0 || segment_ring.full())) {
+                start = esp_timer_get_time();
+                st_bench_run = run;
+                st_wake_up();
+                if (step)
+                    motors_set_disable(true); // Pulses for the loopback pin only
+            }
+            continue;
+        }
+        if (running != NULL && start != 0) {
+            running();
+            running = NULL;
+        }
+        if (esp_timer_get_time() - start > 2 * expected_us + 100000)
+            break; // Stuck
+        vTaskDelay(1);
+    }
+    run->us = esp_timer_get_time() - start;
+    bool done = remaining == 0 && segment_ring.consumer_slot() == NULL;
+    st_reset();
+    st_bench_run = NULL;
+    st_bench_muted = false;
+    return done && run->us <= expected_us + expected_us / 20 + 2000;
+}
+#endif
+
 
 // Called by realtime status reporting to fetch the current speed being executed. This value
 // however is not exactly the current speed, but the speed computed in the last step segment
@@ -1217,6 +2572,16 @@ void IRAM_ATTR Stepper_Timer_Stop() {
 #endif
 }
 
+#ifdef USE_STEP_PULSE_OFF_TIMER
+// Arms the one-shot pulse off timer for the current pulse_microseconds setting.
+void IRAM_ATTR Stepper_Off_Timer_Start() {
+    timer_set_counter_value(STEP_TIMER_GROUP, STEP_OFF_TIMER_INDEX, 0x00000000ULL);
+    timer_set_alarm_value(STEP_TIMER_GROUP, STEP_OFF_TIMER_INDEX, hot_settings->pulse_microseconds * STEPPER_OFF_TICKS_PER_MICROSECOND);
+    TIMERG0.hw_timer[STEP_OFF_TIMER_INDEX].config.alarm_en = TIMER_ALARM_EN;
+    timer_start(STEP_TIMER_GROUP, STEP_OFF_TIMER_INDEX);
+}
+#endif
+
 bool get_stepper_disable() { // returns true if steppers are disabled
     bool disabled = false;
 #ifdef STEPPERS_DISABLE_PIN
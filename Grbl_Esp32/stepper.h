@@ -29,19 +29,70 @@
     #define SEGMENT_BUFFER_SIZE 6
 #endif
 
+// The segment buffer depth is set at boot by the Stepper/Segments setting. SEGMENT_BUFFER_SIZE
+// is the default and the minimum.
+#ifndef SEGMENT_BUFFER_SIZE_MAX
+    #define SEGMENT_BUFFER_SIZE_MAX 128
+#endif
 
+// Depth of the segment buffer of STATIC_MOTION_BUFFERS builds, which the Stepper/Segments setting
+// is limited to. See config.h.
+#ifndef STEPPER_STATIC_SEGMENTS
+    #define STEPPER_STATIC_SEGMENTS SEGMENT_BUFFER_SIZE
+#endif
 
 #include "grbl.h"
 #include "config.h"
 
+#ifndef SEGMENT_PREP_TASK_PRIORITY
+    #define SEGMENT_PREP_TASK_PRIORITY 3 // Above the Arduino loop and the serial task
+#endif
+#ifndef SEGMENT_PREP_TASK_PERIOD_MS
+    #define SEGMENT_PREP_TASK_PERIOD_MS 5
+#endif
+
+// The pulse off timer is only needed when the ISR drives the step pins directly.
+#if defined(USE_RMT_STEPS) || defined(USE_I2S_OUT_STREAM)
+    #undef USE_STEP_PULSE_OFF_TIMER
+#endif
+
+// Step trains are written into the RMT channel memory, so they need RMT steps with plain pulses.
+#if !defined(USE_RMT_STEPS) || defined(STEP_PULSE_DELAY)
+    #undef USE_RMT_STEP_TRAINS
+#endif
+
+// Maximum number of pulses in one RMT step train. With the end marker, a train must fit in the
+// 64 items of one RMT memory block.
+#ifndef RMT_STEP_TRAIN_MAX
+    #define RMT_STEP_TRAIN_MAX 32
+#endif
+#define RMT_TRAIN_NONE 0xff // st_block_t train_axis of a block that is not single-axis
+
+#if defined(BACKLASH_COMPENSATION) && defined(LASER_RASTER)
+    #error "BACKLASH_COMPENSATION cannot be used with LASER_RASTER, the pixels follow the planned steps"
+#endif
+
+// Segments the slack of a reversing axis is taken up over, at most. The steps in one segment are
+// also kept to the <axis>/MaxRate of the axis over the segment time.
+#ifndef BACKLASH_SEGMENTS
+    #define BACKLASH_SEGMENTS 4
+#endif
+#define BACKLASH_MAX 5.0f // mm, the range of <axis>/Backlash
+
 // Some useful constants.
-#define DT_SEGMENT (1.0/(ACCELERATION_TICKS_PER_SECOND*60.0)) // min/segment
-#define REQ_MM_INCREMENT_SCALAR 1.25
+// NOTE: Single precision literals. The ESP32 FPU only handles floats, so a double literal here
+// pulls software double math into st_prep_buffer().
+#define DT_SEGMENT (1.0f/(ACCELERATION_TICKS_PER_SECOND*60.0f)) // min/segment
+#define REQ_MM_INCREMENT_SCALAR 1.25f
 #define RAMP_ACCEL 0
 #define RAMP_CRUISE 1
 #define RAMP_DECEL 2
 #define RAMP_DECEL_OVERRIDE 3
 
+// Acceleration profiles of the segment generator. Selected by the Stepper/AccelProfile setting.
+#define ACCEL_PROFILE_TRAPEZOID 0
+#define ACCEL_PROFILE_SMOOTHSTEP 1
+
 #define PREP_FLAG_RECALCULATE bit(0)
 #define PREP_FLAG_HOLD_PARTIAL_BLOCK bit(1)
 #define PREP_FLAG_PARKING bit(2)
@@ -54,23 +105,33 @@
 // timer, and the CPU overhead. Level 0 (no AMASS, normal operation) frequency bin starts at the
 // Level 1 cutoff frequency and up to as fast as the CPU allows (over 30kHz in limited testing).
 // NOTE: AMASS cutoff frequency multiplied by ISR overdrive factor must not exceed maximum step frequency.
-// NOTE: Current settings are set to overdrive the ISR to no more than 16kHz, balancing CPU overhead
-// and timer accuracy.  Do not alter these settings unless you know what you are doing.
-///#ifdef ADAPTIVE_MULTI_AXIS_STEP_SMOOTHING
-#define MAX_AMASS_LEVEL 3
+// NOTE: The cutoffs are computed from F_STEPPER_TIMER and AMASS_ISR_FREQUENCY, the highest rate the
+// ISR is over-driven to. Level n starts below AMASS_ISR_FREQUENCY / 2^n steps/sec, so the ISR runs
+// at up to AMASS_ISR_FREQUENCY at every level. The defaults are the original cutoffs, which balance
+// CPU overhead and timer accuracy. Do not alter these settings unless you know what you are doing.
+#ifndef MAX_AMASS_LEVEL
+    #define MAX_AMASS_LEVEL 3
+#endif
+#ifndef AMASS_ISR_FREQUENCY
+    #define AMASS_ISR_FREQUENCY 16000 // Hz
+#endif
 // AMASS_LEVEL0: Normal operation. No AMASS. No upper cutoff frequency. Starts at LEVEL1 cutoff frequency.
 // Note ESP32 use F_STEPPER_TIMER rather than the AVR F_CPU
-#define AMASS_LEVEL1 (F_STEPPER_TIMER/8000) // Over-drives ISR (x2). Defined as F_CPU/(Cutoff frequency in Hz)
-#define AMASS_LEVEL2 (F_STEPPER_TIMER/4000) // Over-drives ISR (x4)
-#define AMASS_LEVEL3 (F_STEPPER_TIMER/2000) // Over-drives ISR (x8)
+// Level n over-drives the ISR (x2^n). Defined as F_STEPPER_TIMER/(Cutoff frequency in Hz).
+#define AMASS_LEVEL_CYCLES(n) ((uint32_t)(F_STEPPER_TIMER / AMASS_ISR_FREQUENCY) << (n))
 
 #if MAX_AMASS_LEVEL <= 0
-    error "AMASS must have 1 or more levels to operate correctly."
+    #error "AMASS must have 1 or more levels to operate correctly."
+#endif
+// The Bresenham counts of a block are shifted up by MAX_AMASS_LEVEL, and must stay within 32 bits
+#if MAX_AMASS_LEVEL > 6
+    #error "MAX_AMASS_LEVEL can be at most 6"
 #endif
-//#endif
 
 #define STEP_TIMER_GROUP TIMER_GROUP_0
 #define STEP_TIMER_INDEX TIMER_0
+#define STEP_OFF_TIMER_INDEX TIMER_1 // Used by USE_STEP_PULSE_OFF_TIMER
+#define STEPPER_OFF_TICKS_PER_MICROSECOND (F_TIMERS / STEPPER_OFF_TIMER_PRESCALE / 1000000)
 
 // esp32 work around for diable in main loop
 extern uint64_t stepper_idle_counter;
@@ -80,7 +141,7 @@ extern uint8_t ganged_mode;
 
 // -- Task handles for use in the notifications
 void IRAM_ATTR onSteppertimer();
-void IRAM_ATTR onStepperOffTimer();
+void IRAM_ATTR onStepperOffTimer(void* para);
 
 void stepper_init();
 
@@ -105,12 +166,82 @@ void st_parking_restore_buffer();
 // Reloads step segment buffer. Called continuously by realtime execution system.
 void st_prep_buffer();
 
+// Serializes planner buffer changes against segment prep. Only needed, and only more than a no-op,
+// when segment prep runs in its own task.
+#ifdef USE_SEGMENT_PREP_TASK
+void st_prep_lock();
+void st_prep_unlock();
+#else
+inline void st_prep_lock() {}
+inline void st_prep_unlock() {}
+#endif
+
 // Called by planner_recalculate() when the executing block is updated by the new plan.
 void st_update_plan_block_parameters();
 
 // Called by realtime status reporting if realtime rate reporting is enabled in config.h.
 float st_get_realtime_rate();
 
+// Returns and clears the segment underrun and planner starvation counts.
+void st_take_starvation_counts(uint32_t* underruns, uint32_t* starvations);
+// Returns the same counts since boot, without clearing them. See /metrics.
+void st_get_starvation_totals(uint32_t* underruns, uint32_t* starvations);
+
+// Returns the number of step segments and the bytes taken by the segment and block buffers.
+uint8_t st_get_segment_buffer_size();
+size_t st_get_buffer_bytes();
+
+#ifdef STEPPER_ISR_PROFILE
+// Reports and resets the stepper ISR cycle count statistics.
+void st_report_isr_cycles(uint8_t client);
+// Writes the |ISR: status report field. See report_realtime_status().
+void st_isr_profile_field(char* field);
+
+// Returns the most CPU cycles of a stepper ISR tick since the last $SC
+uint32_t st_get_isr_cycles_max();
+#endif
+
+#if defined(SD_BENCHMARK) || defined(BENCHMARK)
+// Prepares and drops step segments. See sd_bench.cpp and bench.cpp.
+uint32_t st_bench_prep();
+#endif
+
+#ifdef SD_BENCHMARK
+
+// The state of the simulated stepper ISR of st_sim_prep(). Zero it, with block_index 0xff, to start.
+typedef struct {
+    uint64_t time;             // Timer ticks since the start
+    uint32_t counter[N_AXIS];  // Bresenham counters
+    uint8_t block_index;       // st_block of the last segment
+    uint8_t dir_bits;          // Direction of the last steps
+} st_sim_t;
+
+// Prepares step segments, replays their steps and drops them. See stepper.cpp.
+uint32_t st_sim_prep(st_sim_t* sim, void (*on_tick)(uint8_t step_bits, uint8_t dir_bits, uint64_t time));
+#endif
+
+#ifdef BENCHMARK
+// What st_bench_isr_rate() measured
+typedef struct {
+    int64_t us;              // From the first tick to the end of the steps
+    uint64_t isr_cycles;     // CPU cycles in stepper_pulse_func(), over all its ticks
+    uint32_t isr_cycles_max; // The longest tick
+    uint32_t isr_ticks;
+} st_bench_run_t;
+
+// Runs the stepper ISR at a step rate on the X axis. With step false the step outputs are muted.
+// With step true the X step pin pulses, but the drivers stay disabled. running, if not NULL, is
+// called once, when the ISR has started the steps. See bench.cpp.
+bool st_bench_isr_rate(uint32_t rate, uint32_t ticks, bool step, void (*running)(), st_bench_run_t* run);
+#endif
+
+#ifdef PROBE_EDGE_CAPTURE
+// Writes the position of the motors at this moment to steps, and the part of a step each axis
+// has moved since its last step to offset, in 1/PROBE_EDGE_STEP_SCALE steps. Called by the probe
+// pin ISR.
+void st_probe_edge_position(int32_t* steps, int16_t* offset);
+#endif
+
 // disable (or enable) steppers via STEPPERS_DISABLE_PIN
 bool get_stepper_disable(); // returns the state of the pin
 
@@ -120,5 +251,6 @@ void set_direction_pins_on(uint8_t onMask);
 void Stepper_Timer_WritePeriod(uint64_t alarm_val);
 void Stepper_Timer_Start();
 void Stepper_Timer_Stop();
+void Stepper_Off_Timer_Start();
 
 #endif
\ No newline at end of file
@@ -20,9 +20,18 @@
 
 #include "grbl.h"
 #include "config.h"
+#include "soc/ledc_struct.h"
+#include "soc/rtc_io_reg.h"
+#include <driver/dac.h>
 
-xQueueHandle control_sw_queue;  // used by control switch debouncing
-bool debouncing = false;  // debouncing in process
+#ifdef ENABLE_CONTROL_SW_DEBOUNCE
+// The pins that act on their first edge, without waiting for the debounce
+#define CONTROL_PIN_SAFETY_MASK (CONTROL_PIN_INDEX_RESET | CONTROL_PIN_INDEX_FEED_HOLD | CONTROL_PIN_INDEX_SAFETY_DOOR)
+static esp_timer_handle_t control_debounce_timer;
+static volatile bool debouncing = false;        // The timer is running
+static volatile uint8_t control_safety_latched = 0; // Safety pins acted on and not yet released
+static void control_debounce_expired(void* arg);
+#endif
 
 void system_ini() { // Renamed from system_init() due to conflict with esp32 files
     // setup control inputs
@@ -64,14 +73,10 @@ void system_ini() { // Renamed from system_init() due to conflict with esp32 fil
     attachInterrupt(digitalPinToInterrupt(MACRO_BUTTON_3_PIN), isr_control_inputs, CHANGE);
 #endif
 #ifdef ENABLE_CONTROL_SW_DEBOUNCE
-    // setup task used for debouncing
-    control_sw_queue = xQueueCreate(10, sizeof(int));
-    xTaskCreate(controlCheckTask,
-                "controlCheckTask",
-                2048,
-                NULL,
-                5, // priority
-                NULL);
+    esp_timer_create_args_t args = {};
+    args.callback = control_debounce_expired;
+    args.name = "control_debounce";
+    esp_timer_create(&args, &control_debounce_timer);
 #endif
 
     //customize pin definition if needed
@@ -98,27 +103,36 @@ void system_ini() { // Renamed from system_init() due to conflict with esp32 fil
 }
 
 #ifdef ENABLE_CONTROL_SW_DEBOUNCE
-// this is the debounce task
-void controlCheckTask(void* pvParameters) {
-    while (true) {
-        int evt;
-        xQueueReceive(control_sw_queue, &evt, portMAX_DELAY); // block until receive queue
-        vTaskDelay(CONTROL_SW_DEBOUNCE_PERIOD); // delay a while
-        uint8_t pin = system_control_get_state();
-        if (pin)
-            system_exec_control_pin(pin);
-        debouncing = false;
-    }
+// Runs the other pins once the bouncing is over, and lets the safety pins that were released act
+// again on their next edge.
+static void control_debounce_expired(void* arg) {
+    debouncing = false;
+    uint8_t pin = system_control_get_state();
+    control_safety_latched &= pin;
+    pin &= ~control_safety_latched;
+    if (pin)
+        system_exec_control_pin(pin);
 }
 #endif
 
 void IRAM_ATTR isr_control_inputs() {
 #ifdef ENABLE_CONTROL_SW_DEBOUNCE
-    // we will start a task that will recheck the switches after a small delay
-    int evt;
-    if (!debouncing) { // prevent resending until debounce is done
+    // A safety pin acts on its first edge. The bounces after it find it latched, until the
+    // debounce timer sees it released.
+    uint8_t pin = system_control_get_state();
+    uint8_t pressed = pin & CONTROL_PIN_SAFETY_MASK & ~control_safety_latched;
+    if (pressed) {
+        control_safety_latched |= pressed;
+        if (pressed & CONTROL_PIN_INDEX_RESET)
+            mc_reset_isr(); // The rest of mc_reset() runs in mc_reset_complete(), from the main loop
+        if (pressed & CONTROL_PIN_INDEX_FEED_HOLD)
+            system_set_exec_state_flag(EXEC_FEED_HOLD);
+        if (pressed & CONTROL_PIN_INDEX_SAFETY_DOOR)
+            system_set_exec_state_flag(EXEC_SAFETY_DOOR);
+    }
+    if (!debouncing) {
         debouncing = true;
-        xQueueSendFromISR(control_sw_queue, &evt, NULL);
+        esp_timer_start_once(control_debounce_timer, CONTROL_SW_DEBOUNCE_PERIOD * 1000);
     }
 #else
     uint8_t pin = system_control_get_state();
@@ -136,13 +150,21 @@ uint8_t system_check_safety_door_ajar() {
 }
 
 // Special handlers for setting and clearing Grbl's real-time execution flags.
-void system_set_exec_state_flag(uint8_t mask) {
+static volatile uint32_t hold_requests = 0;
+
+void IRAM_ATTR system_set_exec_state_flag(uint8_t mask) {
     // TODO uint8_t sreg = SREG;
     // TODO cli();
     sys_rt_exec_state |= (mask);
+    if (mask & EXEC_HOLD_MASK)
+        hold_requests++;
     // TODO SREG = sreg;
 }
 
+uint32_t IRAM_ATTR system_hold_requests() {
+    return hold_requests;
+}
+
 void system_clear_exec_state_flag(uint8_t mask) {
     //uint8_t sreg = SREG;
     //cli();
@@ -150,7 +172,7 @@ void system_clear_exec_state_flag(uint8_t mask) {
     //SREG = sreg;
 }
 
-void system_set_exec_alarm(uint8_t code) {
+void IRAM_ATTR system_set_exec_alarm(uint8_t code) {
     //uint8_t sreg = SREG;
     //cli();
     sys_rt_exec_alarm = code;
@@ -202,64 +224,28 @@ void system_flag_wco_change() {
 
 
 // Returns machine position of axis 'idx'. Must be sent a 'step' array.
-// NOTE: If motor steps and machine position are not in the same coordinate frame, this function
-//   serves as a central place to compute the transformation.
+// NOTE: Motor steps and machine position are not in the same coordinate frame on CoreXY machines.
+//   kinematics_axis_steps() computes the transformation.
 float system_convert_axis_steps_to_mpos(int32_t* steps, uint8_t idx) {
-    float pos;
-    float steps_per_mm = axis_settings[idx]->steps_per_mm->get();
-// #ifdef COREXY
-//     if (idx == X_AXIS)
-//         pos = (float)system_convert_corexy_to_x_axis_steps(steps) / steps_per_mm;
-//     else if (idx == Y_AXIS)
-//         pos = (float)system_convert_corexy_to_y_axis_steps(steps) / steps_per_mm;
-//     else
-//         pos = steps[idx] / steps_per_mm;
-// #else
-//     pos = steps[idx] / steps_per_mm;
-// #endif
-    if(machineType->get() == MACHINE_COREXY)
-    {
-        if (idx == X_AXIS)
-            pos = (float)system_convert_corexy_to_x_axis_steps(steps) / steps_per_mm;
-        else if (idx == Y_AXIS)
-            pos = (float)system_convert_corexy_to_y_axis_steps(steps) / steps_per_mm;
-        else
-            pos = steps[idx] / steps_per_mm;
-    }else
-    {
-        pos = steps[idx] / steps_per_mm;
-    }
-    
-    return (pos);
+    int32_t axis_steps[N_AXIS];
+    kinematics_axis_steps(steps, axis_steps);
+    return axis_steps[idx] / axis_settings[idx]->steps_per_mm->get();
 }
 
 void system_convert_array_steps_to_mpos(float* position, int32_t* steps) {
     uint8_t idx;
+    int32_t axis_steps[N_AXIS];
+    kinematics_axis_steps(steps, axis_steps);
     for (idx = 0; idx < N_AXIS; idx++)
-        position[idx] = system_convert_axis_steps_to_mpos(steps, idx);
-    return;
+        position[idx] = axis_steps[idx] / axis_settings[idx]->steps_per_mm->get();
 }
 
 // Checks and reports if target array exceeds machine travel limits.
 uint8_t system_check_travel_limits(float* target) {
-    uint8_t idx;
-    for (idx = 0; idx < N_AXIS; idx++) {
-        float travel = axis_settings[idx]->max_travel->get();
-#ifdef HOMING_FORCE_SET_ORIGIN
-        uint8_t mask = homing_dir_mask->get();
-        // When homing forced set origin is enabled, soft limits checks need to account for directionality.
-        if (bit_istrue(mask, bit(idx))) {
-            if (target[idx] < 0 || target[idx] > travel)  return (true);
-        } else {
-            if (target[idx] > 0 || target[idx] < -travel)  return (true);
-        }
-#else
-#ifdef HOMING_FORCE_POSITIVE_SPACE
-        if (target[idx] < 0 || target[idx] > travel)  return (true);
-#else
-        if (target[idx] > 0 || target[idx] < -travel)  return (true);
-#endif
-#endif
+    const hot_settings_t* hot = hot_settings;
+    for (uint8_t idx = 0; idx < N_AXIS; idx++) {
+        if (target[idx] < hot->travel_min[idx] || target[idx] > hot->travel_max[idx])
+            return (true);
     }
     return (false);
 }
@@ -267,7 +253,7 @@ uint8_t system_check_travel_limits(float* target) {
 // Returns control pin state as a uint8 bitfield. Each bit indicates the input pin state, where
 // triggered is 1 and not triggered is 0. Invert mask is applied. Bitfield organization is
 // defined by the CONTROL_PIN_INDEX in the header file.
-uint8_t system_control_get_state() {
+uint8_t IRAM_ATTR system_control_get_state() {
     uint8_t defined_pin_mask = 0; // a mask of defined pins
     uint8_t control_state = 0;
     
@@ -317,9 +303,9 @@ void system_exec_control_pin(uint8_t pin) {
     } else if (bit_istrue(pin, CONTROL_PIN_INDEX_CYCLE_START))
         bit_true(sys_rt_exec_state, EXEC_CYCLE_START);
     else if (bit_istrue(pin, CONTROL_PIN_INDEX_FEED_HOLD))
-        bit_true(sys_rt_exec_state, EXEC_FEED_HOLD);
+        system_set_exec_state_flag(EXEC_FEED_HOLD);
     else if (bit_istrue(pin, CONTROL_PIN_INDEX_SAFETY_DOOR))
-        bit_true(sys_rt_exec_state, EXEC_SAFETY_DOOR);
+        system_set_exec_state_flag(EXEC_SAFETY_DOOR);
 #ifdef MACRO_BUTTON_0_PIN
     else if (bit_istrue(pin, CONTROL_PIN_INDEX_MACRO_0)) {
         user_defined_macro(CONTROL_PIN_INDEX_MACRO_0); // function must be implemented by user
@@ -406,17 +392,48 @@ int8_t sys_get_next_RMT_chan_num() {
     This returns an unused pwm channel.
     The 8 channels share 4 timers, so pairs 0,1 & 2,3 , etc
     have to be the same frequency. The spindle always uses channel 0
-    so we start counting from 2.
+    so we start counting from 2. Channels 8-15 are the low speed
+    channels, which are paired the same way.
 
     There are still possible issues if requested channels use different frequencies
     TODO: Make this more robust.
 */
 int8_t sys_get_next_PWM_chan_num() {
     static uint8_t next_PWM_chan_num = 2; // start at 2 to avoid spindle
-    if (next_PWM_chan_num < 8)  // 7 is the max PWM channel number
+    if (next_PWM_chan_num < 16)  // 15 is the max PWM channel number
         return next_PWM_chan_num++;
     else {
         grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_ERROR, "Error: out of PWM channels");
         return -1;
     }
 }
+
+/*
+    Sets the duty of a PWM channel set up with ledcSetup(). ledcWrite() takes a mutex,
+    so it cannot be used from an ISR. This does the same register writes.
+*/
+void IRAM_ATTR sys_ledc_write_isr(uint8_t chan, uint32_t duty) {
+    uint8_t group = chan / 8;
+    uint8_t channel = chan % 8;
+    LEDC.channel_group[group].channel[channel].duty.duty = duty << 4; // 4 fractional bits
+    // A single step, which also ends a fade started with ledc_set_fade_with_time()
+    LEDC.channel_group[group].channel[channel].conf1.duty_inc = 1;
+    LEDC.channel_group[group].channel[channel].conf1.duty_num = 1;
+    LEDC.channel_group[group].channel[channel].conf1.duty_cycle = 1;
+    LEDC.channel_group[group].channel[channel].conf1.duty_scale = 0;
+    LEDC.channel_group[group].channel[channel].conf0.sig_out_en = 1;
+    LEDC.channel_group[group].channel[channel].conf1.duty_start = 1;
+    if (group)
+        LEDC.channel_group[group].channel[channel].conf0.low_speed_update = 1;
+}
+
+/*
+    Sets the output of a DAC channel enabled with dac_output_enable(). dac_output_voltage()
+    is not in IRAM and takes a spinlock. This is its register write.
+*/
+void IRAM_ATTR sys_dac_write_isr(uint8_t channel, uint8_t value) {
+    if (channel == DAC_CHANNEL_1)
+        SET_PERI_REG_BITS(RTC_IO_PAD_DAC1_REG, RTC_IO_PDAC1_DAC, value, RTC_IO_PDAC1_DAC_S);
+    else
+        SET_PERI_REG_BITS(RTC_IO_PAD_DAC2_REG, RTC_IO_PDAC2_DAC, value, RTC_IO_PDAC2_DAC_S);
+}
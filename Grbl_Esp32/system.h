@@ -64,6 +64,8 @@ extern system_t sys;
 #define EXEC_SAFETY_DOOR    bit(5) // bitmask 00100000
 #define EXEC_MOTION_CANCEL  bit(6) // bitmask 01000000
 #define EXEC_SLEEP          bit(7) // bitmask 10000000
+// The flags that stop the motion until a cycle start or a reset
+#define EXEC_HOLD_MASK      (EXEC_FEED_HOLD | EXEC_SAFETY_DOOR | EXEC_MOTION_CANCEL | EXEC_SLEEP)
 
 // Alarm executor codes. Valid values (1-255). Zero is reserved.
 #define EXEC_ALARM_HARD_LIMIT           1
@@ -76,6 +78,7 @@ extern system_t sys;
 #define EXEC_ALARM_HOMING_FAIL_PULLOFF  8
 #define EXEC_ALARM_HOMING_FAIL_APPROACH 9
 #define EXEC_ALARM_SPINDLE_CONTROL      10
+#define EXEC_ALARM_ENCODER_FOLLOWING_ERROR 11
 
 // Override bit maps. Realtime bitflags to control feed, rapid, spindle, and coolant overrides.
 // Spindle/coolant and feed/rapids are separated into two controlling flag variables.
@@ -182,6 +185,9 @@ void isr_control_inputs();
 
 // Special handlers for setting and clearing Grbl's real-time execution flags.
 void system_set_exec_state_flag(uint8_t mask);
+// The number of times system_set_exec_state_flag() was given an EXEC_HOLD_MASK flag, so that the
+// source of a hold can tell if another one asked for a hold after it.
+uint32_t system_hold_requests();
 void system_clear_exec_state_flag(uint8_t mask);
 void system_set_exec_alarm(uint8_t code);
 void system_clear_exec_alarm();
@@ -222,8 +228,6 @@ int32_t system_convert_corexy_to_y_axis_steps(int32_t* steps);
 int32_t system_convert_bipolar_to_x_axis_steps(int32_t* steps); // [XBoard]
 int32_t system_convert_bipolar_to_y_axis_steps(int32_t* steps); // [XBoard]
 
-// A task that runs after a control switch interrupt for debouncing.
-void controlCheckTask(void* pvParameters);
 void system_exec_control_pin(uint8_t pin);
 
 void sys_io_control(uint8_t io_num_mask, bool turnOn);
@@ -231,5 +235,7 @@ void sys_io_control(uint8_t io_num_mask, bool turnOn);
 //
 int8_t sys_get_next_RMT_chan_num();
 int8_t sys_get_next_PWM_chan_num();
+void sys_ledc_write_isr(uint8_t chan, uint32_t duty);
+void sys_dac_write_isr(uint8_t channel, uint8_t value);
 
 #endif
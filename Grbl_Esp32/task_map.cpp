@@ -0,0 +1,124 @@
+/*
+  task_map.cpp - the cores and priorities of the tasks of Grbl
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+// Tasks started before the settings, that task_map_init() sets the priority of
+#define TASK_MAP_EARLY_MAX 10
+
+typedef struct {
+    const char* name;
+    uint8_t task_class;
+    uint8_t core;
+    uint8_t priority;
+    bool fixed_core;    // The core cannot be set
+} task_map_entry_t;
+
+static const task_map_entry_t task_map[TASK_COUNT] = {
+    { "segmentPrepTask", TASK_CLASS_MOTION, 1, SEGMENT_PREP_TASK_PRIORITY, false },
+    { "I2SOutTask", TASK_CLASS_MOTION, CONFIG_ARDUINO_RUNNING_CORE, 1, true }, // With the I2S interrupt
+    { "serialCheckTask", TASK_CLASS_REALTIME, 1, 1, false },
+    { "serialUartTask", TASK_CLASS_REALTIME, 1, 2, false }, // Above the main loop, as it only waits on the UART
+    { "serialNetTask", TASK_CLASS_REALTIME, 1, 1, false },
+    { "clientTxTask", TASK_CLASS_REALTIME, 1, 1, false },
+    { "udpRealtimeTask", TASK_CLASS_REALTIME, 1, 2, false }, // Above the main loop, as it mostly waits on the socket
+    { "servoUpdateTask", TASK_CLASS_DEVICE, 0, 1, false },
+    { "servosSyncTask", TASK_CLASS_DEVICE, 0, 1, false },
+    { "solenoidSyncTask", TASK_CLASS_DEVICE, 0, 1, false },
+    { "readSgTask", TASK_CLASS_DEVICE, 0, 1, false },
+    { "encoderCheckTask", TASK_CLASS_DEVICE, 0, 1, false },
+    { "vfd_cmdTaskHandle", TASK_CLASS_DEVICE, 0, 1, false },
+    { "Electromagnet_Hold_TaskHandle", TASK_CLASS_DEVICE, 0, 1, false },
+    { "sdReadTask", TASK_CLASS_STORAGE, 1, 1, false }, // Feeds the main loop, so on its core
+    { "sdEstimateTask", TASK_CLASS_STORAGE, 1, 0, false }, // Below the main loop
+    { "sdDirCacheTask", TASK_CLASS_STORAGE, 1, 0, false },
+    { "otaWriterTask", TASK_CLASS_STORAGE, 0, 1, false }, // With the WiFi stack it is fed from
+    { "bootNetworkTask", TASK_CLASS_NETWORK, 0, 1, false },
+    { "webServerTask", TASK_CLASS_NETWORK, 0, 1, false },
+    { "captivePortalTask", TASK_CLASS_NETWORK, 0, 1, false },
+    { "notificationsTask", TASK_CLASS_NETWORK, 0, 0, false }, // Below everything else
+};
+
+static const char* const class_names[TASK_CLASS_COUNT] = { "Motion", "Realtime", "Device", "Storage", "Network" };
+
+static bool settings_ready = false;
+static uint8_t started[TASK_COUNT];
+static bool started_early[TASK_COUNT]; // On the default core, as a running task cannot move
+static task_id_t early_ids[TASK_MAP_EARLY_MAX];
+static TaskHandle_t early_handles[TASK_MAP_EARLY_MAX];
+static uint8_t early_count = 0;
+
+const char* task_class_name(uint8_t task_class) {
+    return class_names[task_class];
+}
+
+static uint8_t task_core(task_id_t id) {
+    const task_map_entry_t* entry = &task_map[id];
+    if (!settings_ready || entry->fixed_core || started_early[id] || task_class_core[entry->task_class]->get() < 0)
+        return entry->core;
+    return task_class_core[entry->task_class]->get();
+}
+
+static uint8_t task_priority(task_id_t id) {
+    const task_map_entry_t* entry = &task_map[id];
+    uint8_t priority = entry->priority;
+    if (settings_ready && task_class_priority[entry->task_class]->get() >= 0)
+        priority = task_class_priority[entry->task_class]->get();
+    switch (entry->task_class) {
+    case TASK_CLASS_MOTION:
+    case TASK_CLASS_REALTIME:
+        return MAX(priority, TASK_PRIORITY_LOOP);
+    case TASK_CLASS_STORAGE:
+    case TASK_CLASS_NETWORK:
+        return MIN(priority, TASK_PRIORITY_LOOP);
+    default:
+        return priority;
+    }
+}
+
+BaseType_t task_create(task_id_t id, TaskFunction_t function, uint32_t stack_size, void* parameters, TaskHandle_t* handle) {
+    TaskHandle_t local_handle = NULL;
+    if (handle == NULL)
+        handle = &local_handle;
+    BaseType_t result = xTaskCreatePinnedToCore(function, task_map[id].name, stack_size, parameters, task_priority(id), handle, task_core(id));
+    if (result != pdPASS)
+        return result;
+    started[id]++;
+    if (!settings_ready && early_count < TASK_MAP_EARLY_MAX) {
+        started_early[id] = true;
+        early_ids[early_count] = id;
+        early_handles[early_count++] = *handle;
+    }
+    return result;
+}
+
+void task_map_init() {
+    settings_ready = true;
+    for (uint8_t i = 0; i < early_count; i++)
+        vTaskPrioritySet(early_handles[i], task_priority(early_ids[i]));
+    early_count = 0;
+}
+
+void task_map_report(uint8_t client, bool all) {
+    for (uint8_t id = 0; id < TASK_COUNT; id++) {
+        if (!all && !started[id])
+            continue;
+        grbl_sendf(client, "[MSG:Task map %s %s core:%d prio:%d%s]\r\n", task_map[id].name, class_names[task_map[id].task_class],
+                   task_core((task_id_t)id), task_priority((task_id_t)id), started[id] ? "" : " not started");
+    }
+}
@@ -0,0 +1,88 @@
+/*
+  task_map.h - the cores and priorities of the tasks of Grbl
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef task_map_h
+#define task_map_h
+
+/*
+    Every task is started by task_create() at the core and priority of its entry in task_map.cpp.
+    The tasks are in classes, and $Tasks/<Class>/Core and $Tasks/<Class>/Priority move a whole
+    class. -1 leaves each task of the class at its default.
+
+        Motion    core 1  segment prep 3, I2S out 1
+        Realtime  core 1  serial check 1, serial UART 2, serial net 1, client TX 1, UDP realtime 2
+        Device    core 0  1
+        Storage   core 1  SD read 1, SD estimate 0, SD directory cache 0; OTA writer on core 0
+        Network   core 0  1, notifications 0
+
+    The main loop runs at TASK_PRIORITY_LOOP on core 1. Storage and network tasks are kept at or
+    below it, and motion and realtime tasks at or above it, so that whatever the settings a web
+    request or an SD read never preempts the segment prep or the realtime commands.
+*/
+
+// The priority of the Arduino loop task, that runs the protocol
+#define TASK_PRIORITY_LOOP 1
+
+typedef enum {
+    TASK_CLASS_MOTION = 0,
+    TASK_CLASS_REALTIME,
+    TASK_CLASS_DEVICE,
+    TASK_CLASS_STORAGE,
+    TASK_CLASS_NETWORK,
+    TASK_CLASS_COUNT
+} task_class_t;
+
+typedef enum {
+    TASK_SEGMENT_PREP = 0,
+    TASK_I2S_OUT,
+    TASK_SERIAL_CHECK,
+    TASK_SERIAL_UART,
+    TASK_SERIAL_NET,
+    TASK_CLIENT_TX,
+    TASK_UDP_REALTIME,
+    TASK_SERVO_UPDATE,
+    TASK_SERVOS_SYNC,
+    TASK_SOLENOID_SYNC,
+    TASK_STALLGUARD,
+    TASK_ENCODER,
+    TASK_VFD,
+    TASK_ELECTROMAGNET,
+    TASK_SD_READ,
+    TASK_SD_ESTIMATE,
+    TASK_SD_DIR_CACHE,
+    TASK_OTA_WRITER,
+    TASK_BOOT_NETWORK,
+    TASK_WEB_SERVER,
+    TASK_CAPTIVE_PORTAL,
+    TASK_NOTIFICATIONS,
+    TASK_COUNT
+} task_id_t;
+
+const char* task_class_name(uint8_t task_class);
+
+// xTaskCreatePinnedToCore() with the name, core and priority of the map
+BaseType_t task_create(task_id_t id, TaskFunction_t function, uint32_t stack_size, void* parameters, TaskHandle_t* handle);
+
+// After settings_init(). Gives the tasks started before the settings their priority settings.
+// Their core cannot change once they run.
+void task_map_init();
+
+// The tasks started so far, or all of them, with their core and priority
+void task_map_report(uint8_t client, bool all);
+
+#endif
@@ -0,0 +1,100 @@
+/*
+  tcp_stream.cpp - raw TCP port for streaming G-code jobs
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef ARDUINO_ARCH_ESP32
+
+#include "grbl.h"
+
+#if defined (ENABLE_WIFI) && defined (TCP_STREAM_SERVER)
+
+#include "tcp_stream.h"
+#include <WiFi.h>
+#include <lwip/sockets.h>
+
+// One client streams a job over a plain TCP connection, as CLIENT_TCP. Unlike telnet, there is
+// no ring between the socket and Grbl: serialCheckTask reads the socket only as far as the
+// CLIENT_TCP buffer has room, and the bytes left in lwIP close the TCP window. The window is the
+// flow control, so the sender writes as fast as the socket takes it and does not need to count
+// ok lines. With TCP_STREAM_QUIET_OK it gets only the errors.
+TCP_Stream_Server tcp_stream_server;
+static WiFiClient tcp_stream_client;
+
+bool TCP_Stream_Server::begin() {
+    end();
+    _server = new WiFiServer(TCP_STREAM_PORT, 1);
+    _server->setNoDelay(true);
+    _server->begin();
+    grbl_sendf(CLIENT_ALL, "[MSG:TCP stream Started %d]\r\n", TCP_STREAM_PORT);
+    _setupdone = true;
+    return true;
+}
+
+void TCP_Stream_Server::end() {
+    _setupdone = false;
+    if (tcp_stream_client)
+        tcp_stream_client.stop();
+    if (_server) {
+        delete _server;
+        _server = NULL;
+    }
+}
+
+void TCP_Stream_Server::handle() {
+    if (!_setupdone || _server == NULL || !_server->hasClient())
+        return;
+    if (tcp_stream_client && tcp_stream_client.connected()) {
+        _server->available().stop(); // One sender at a time
+        return;
+    }
+    if (tcp_stream_client)
+        tcp_stream_client.stop();
+    tcp_stream_client = _server->available();
+    tcp_stream_client.setNoDelay(true);
+    int size = TCP_STREAM_SOCKET_BUFFER;
+    setsockopt(tcp_stream_client.fd(), SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)); // Kept if lwIP allows it
+    serial_reset_read_buffer(CLIENT_TCP);
+}
+
+size_t TCP_Stream_Server::write(const uint8_t* buffer, size_t size) {
+    if (!_setupdone || !tcp_stream_client || !tcp_stream_client.connected())
+        return 0;
+    return tcp_stream_client.write(buffer, size);
+}
+
+bool TCP_Stream_Server::available() {
+    return _setupdone && tcp_stream_client && tcp_stream_client.available() > 0 &&
+           serial_get_rx_buffer_available(CLIENT_TCP) > 0;
+}
+
+int TCP_Stream_Server::client_fd() {
+    return (_setupdone && tcp_stream_client && tcp_stream_client.connected()) ? tcp_stream_client.fd() : -1;
+}
+
+size_t TCP_Stream_Server::read(uint8_t* buffer, size_t size) {
+    if (!available())
+        return 0;
+    int room = serial_get_rx_buffer_available(CLIENT_TCP);
+    if ((int)size > room)
+        size = room;
+    int len = tcp_stream_client.read(buffer, size);
+    return len > 0 ? len : 0;
+}
+
+#endif // ENABLE_WIFI && TCP_STREAM_SERVER
+
+#endif // ARDUINO_ARCH_ESP32
@@ -0,0 +1,58 @@
+/*
+  tcp_stream.h - raw TCP port for streaming G-code jobs
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TCP_STREAM_H
+#define _TCP_STREAM_H
+
+#include "config.h"
+class WiFiServer;
+class WiFiClient;
+
+#ifndef TCP_STREAM_PORT
+    #define TCP_STREAM_PORT 8023
+#endif
+
+// Size of the CLIENT_TCP receive buffer, when larger than the Serial/RxBuffer setting.
+#ifndef TCP_STREAM_RX_BUFFER_SIZE
+    #define TCP_STREAM_RX_BUFFER_SIZE 8192
+#endif
+
+// Socket receive buffer asked of lwIP. The TCP window itself is set in the lwIP configuration.
+#ifndef TCP_STREAM_SOCKET_BUFFER
+    #define TCP_STREAM_SOCKET_BUFFER 16384
+#endif
+
+class TCP_Stream_Server {
+  public:
+    bool begin();
+    void end();
+    void handle();
+    size_t write(const uint8_t* buffer, size_t size);
+    // Reads up to size bytes straight from the socket. Returns the number read.
+    size_t read(uint8_t* buffer, size_t size);
+    bool available();
+    // The socket of the connected client, or -1.
+    int client_fd();
+  private:
+    bool _setupdone = false;
+    WiFiServer* _server = NULL;
+};
+
+extern TCP_Stream_Server tcp_stream_server;
+
+#endif
@@ -90,6 +90,8 @@ void Telnet_Server::clearClients() {
 #endif
                 if (_telnetClients[i]) _telnetClients[i].stop();
                 _telnetClients[i] = _telnetserver->available();
+                //responses go out at once instead of waiting on Nagle for the next ok
+                _telnetClients[i].setNoDelay(true);
                 break;
             }
         }
@@ -138,12 +140,15 @@ void Telnet_Server::handle() {
             if (_telnetClients[i].available()) {
                 uint8_t buf[1024];
                 COMMANDS::wait(0);
-                int readlen = _telnetClients[i].available();
-                int writelen = TELNETRXBUFFERSIZE - available();
-                if (readlen > 1024) readlen = 1024;
-                if (readlen > writelen) readlen = writelen;
-                if (readlen > 0) {
-                    _telnetClients[i].read(buf, readlen);
+                //take all that lwIP holds, as long as it fits, one block at a time
+                int readlen;
+                while ((readlen = _telnetClients[i].available()) > 0) {
+                    int writelen = TELNETRXBUFFERSIZE - available();
+                    if (readlen > 1024) readlen = 1024;
+                    if (readlen > writelen) readlen = writelen;
+                    if (readlen <= 0) break;
+                    readlen = _telnetClients[i].read(buf, readlen);
+                    if (readlen <= 0) break;
                     push(buf, readlen);
                 }
                 return;
@@ -160,6 +165,12 @@ void Telnet_Server::handle() {
     }
 }
 
+int Telnet_Server::client_fd(uint8_t i) {
+    if (!_setupdone || !_telnetClients[i] || !_telnetClients[i].connected())
+        return -1;
+    return _telnetClients[i].fd();
+}
+
 int Telnet_Server::peek(void) {
     if (_RXbufferSize > 0)return _RXbuffer[_RXbufferpos];
     else return -1;
@@ -199,8 +210,6 @@ bool Telnet_Server::push(const uint8_t* data, int data_size) {
                 current ++;
                 data_processed++;
             }
-            COMMANDS::wait(0);
-            //vTaskDelay(1 / portTICK_RATE_MS);  // Yield to other tasks
         }
         _RXbufferSize += data_processed;
         return true;
@@ -219,6 +228,19 @@ int Telnet_Server::read(void) {
     } else return -1;
 }
 
+//reads up to size bytes in at most two copies. Returns the number of bytes read
+size_t Telnet_Server::read(uint8_t* buffer, size_t size) {
+    if (size > _RXbufferSize) size = _RXbufferSize;
+    size_t first = TELNETRXBUFFERSIZE - _RXbufferpos;
+    if (first > size) first = size;
+    memcpy(buffer, &_RXbuffer[_RXbufferpos], first);
+    memcpy(buffer + first, _RXbuffer, size - first);
+    _RXbufferpos += size;
+    if (_RXbufferpos > (TELNETRXBUFFERSIZE - 1)) _RXbufferpos -= TELNETRXBUFFERSIZE;
+    _RXbufferSize -= size;
+    return size;
+}
+
 #endif // Enable TELNET && ENABLE_WIFI
 
 #endif // ARDUINO_ARCH_ESP32
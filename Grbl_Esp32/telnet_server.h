@@ -41,12 +41,15 @@ class Telnet_Server {
     void handle();
     size_t write(const uint8_t* buffer, size_t size);
     int read(void);
+    size_t read(uint8_t* buffer, size_t size);
     int peek(void);
     int available();
     int get_rx_buffer_available();
     bool push(uint8_t data);
     bool push(const uint8_t* data, int datasize);
     static uint16_t port() {return _port;}
+    // The socket of client i, or -1 if it is not connected.
+    int client_fd(uint8_t i);
   private:
     static bool _setupdone;
     static WiFiServer* _telnetserver;
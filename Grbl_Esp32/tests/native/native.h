@@ -0,0 +1,46 @@
+/*
+  native.h - the programs of the native build
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../../grbl.h"
+
+// Each command of the native program takes the arguments after its name and returns the exit
+// status. The tests return the number of failed checks. See native_main.cpp.
+typedef int (*native_command_t)(int argc, char** argv);
+
+// Reports a failed check of a test and counts it in *failures.
+#define NATIVE_CHECK(failures, cond, ...)          \
+    do {                                           \
+        if (!(cond)) {                             \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__);                   \
+            printf("\n");                          \
+            (*(failures))++;                       \
+        }                                          \
+    } while (0)
+
+// Resets the parser, planner and steppers, as a reset of the device does.
+void native_reset();
+
+int native_bench(int argc, char** argv);
+int native_sim(int argc, char** argv);
+int native_test_float(int argc, char** argv);
+int native_test_report(int argc, char** argv);
+int native_test_stress(int argc, char** argv);
+int native_test_tokens(int argc, char** argv);
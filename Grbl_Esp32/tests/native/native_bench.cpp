@@ -0,0 +1,51 @@
+/*
+  native_bench.cpp - the SD job benchmark of the native build, on files of the host
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Build and run, from the repository root:
+//   pio run -e native && .pio/build/native/program bench Grbl_Esp32/tests/*.nc
+//
+// Runs each file through sd_bench_run(), as $SD/Bench does on the device, and prints its
+//   [MSG:Bench <file>: <n> lines <n> lines/s, <n> blocks <n> blocks/s, <n> segments <n> segments/s]
+// The rates are of the host, so they compare changes, not boards.
+
+#include "native.h"
+
+static int native_read_file(void* source) {
+    return fgetc((FILE*)source);
+}
+
+int native_bench(int argc, char** argv) {
+    if (argc == 0) {
+        printf("bench needs a file\n");
+        return 2;
+    }
+    int failed = 0;
+    for (int i = 0; i < argc; i++) {
+        FILE* source = fopen(argv[i], "r");
+        if (source == NULL) {
+            printf("cannot open %s\n", argv[i]);
+            failed++;
+            continue;
+        }
+        native_reset();
+        if (sd_bench_run(argv[i], native_read_file, source, CLIENT_SERIAL, false, NULL, NULL) != STATUS_OK)
+            failed++;
+        fclose(source);
+    }
+    return failed;
+}
@@ -0,0 +1,110 @@
+/*
+  native_main.cpp - the program of the native build
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Build and run, from the repository root:
+//   pio run -e native && .pio/build/native/program bench Grbl_Esp32/tests/*.nc
+//
+// The parser, planner and segment prep run on the host with the default settings of the machine
+// file given by MACHINE_FILENAME in [env:native]. Settings can be changed for a run with
+// -s <name>=<value> before the command, e.g. -s Planner/Blocks=32, as $<name>=<value> does.
+
+#include "native.h"
+
+typedef struct {
+    const char* name;
+    native_command_t run;
+    const char* usage;
+} native_command_entry_t;
+
+static const native_command_entry_t native_commands[] = {
+    { "bench", native_bench, "<file.nc>...  parse lines/s, planner blocks/s and segments/s of each file" },
+    { "sim", native_sim, "[--edges <file.csv>] <file.nc>...  simulated step output of each file, as $SD/Simulate" },
+    { "test-float", native_test_float, "[<count> [<seed>]]  read_float() and decimal_to_float() against strtof()" },
+    { "test-report", native_test_report, "[<count> [<seed>]]  the status report builder against snprintf() and the former report, and their reports/s" },
+    { "test-stress", native_test_stress, "<folder>  the jobs of tests/stress/generate.py against their .expected files" },
+    { "test-tokens", native_test_tokens, "[<file.nc>...]  gc_tokenize_line() against the former collapseGCode() scan, and their lines/s" },
+};
+
+extern void make_settings();
+
+// The defaults, as there is no NVS. See load_settings().
+static void native_load_settings() {
+    EEPROM.begin(EEPROM_SIZE);
+    settings_init_coord_data();
+    make_settings();
+    for (Setting* s = Setting::List; s; s = s->next())
+        s->load();
+}
+
+void native_reset() {
+    memset(&sys, 0, sizeof(system_t));
+    sys.state = STATE_IDLE;
+    sys.f_override = DEFAULT_FEED_OVERRIDE;
+    sys.r_override = DEFAULT_RAPID_OVERRIDE;
+    sys.spindle_speed_ovr = DEFAULT_SPINDLE_SPEED_OVERRIDE;
+    gc_init();
+    plan_reset();
+    st_reset();
+    plan_sync_position();
+    gc_sync_position();
+}
+
+// Sets the setting of name=value. Returns false if there is no such setting or the value is bad.
+static bool native_set(char* assignment) {
+    char* value = strchr(assignment, '=');
+    if (value == NULL)
+        return false;
+    *value++ = '\0';
+    for (Setting* s = Setting::List; s; s = s->next()) {
+        if (strcasecmp(s->getName(), assignment) == 0 || (s->getGrblName() && strcmp(s->getGrblName(), assignment) == 0))
+            return s->setStringValue(value) == STATUS_OK;
+    }
+    return false;
+}
+
+static int native_usage() {
+    printf("usage: program [-s <setting>=<value>]... <command> [<args>]\n");
+    for (const native_command_entry_t& command : native_commands)
+        printf("  %s %s\n", command.name, command.usage);
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    native_load_settings();
+    int arg = 1;
+    while (arg + 1 < argc && strcmp(argv[arg], "-s") == 0) {
+        if (!native_set(argv[arg + 1])) {
+            printf("bad setting %s\n", argv[arg + 1]);
+            return 2;
+        }
+        arg += 2;
+    }
+    if (arg == argc)
+        return native_usage();
+    update_hot_settings();
+    plan_init();
+    stepper_init(); // The timers only exist in the stubs, but it sizes the segment buffer
+    spindle_select();
+    native_reset();
+    for (const native_command_entry_t& command : native_commands) {
+        if (strcmp(command.name, argv[arg]) == 0)
+            return command.run(argc - arg - 1, argv + arg + 1);
+    }
+    return native_usage();
+}
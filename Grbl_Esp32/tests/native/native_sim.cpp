@@ -0,0 +1,190 @@
+/*
+  native_sim.cpp - the step output simulator of the native build, and the check of tests/stress
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Build and run, from the repository root:
+//   pio run -e native && .pio/build/native/program sim [--edges <file.csv>] <file.nc>...
+//   python Grbl_Esp32/tests/stress/generate.py --out /tmp/stress && .pio/build/native/program test-stress /tmp/stress
+//
+// sim runs each file through sd_bench_run() with the simulation of $SD/Simulate: st_sim_prep()
+// replays the step output of stepper_pulse_func() on a virtual timer, and the achieved feed,
+// acceleration peaks and step rate histogram are printed as on the device. With --edges, every
+// step and direction edge goes to a CSV file, one per line:
+//   <time us>,<axis>,<step|dir>,<level>
+// A step pulse is a 1 edge at the time of the pulse and a 0 edge Stepper/Pulse later. A direction
+// pin is recorded when a pulse needs its new level, Stepper/DirSetup before that pulse, as the
+// ISR sets it. The times only depend on the file and the settings, so runs can be diffed.
+//
+// test-stress checks the files of tests/stress/generate.py against their .expected files: the
+// job has the expected lines and no errors, the steps end where the planner put the last motion,
+// which is the expected end, and the simulated time is not shorter than min_time. It prints each
+// time against min_time, so a slower planner or stepper shows as a larger ratio.
+
+#include "native.h"
+
+#include <dirent.h>
+
+static FILE* native_sim_edges = NULL;
+static uint8_t native_sim_dir_bits;
+
+static int native_sim_read_file(void* source) {
+    return fgetc((FILE*)source);
+}
+
+static void native_sim_edge(uint8_t step_bits, uint8_t dir_bits, uint64_t time) {
+    double us = (double)time / TICKS_PER_MICROSECOND;
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        if ((step_bits & bit(axis)) && ((dir_bits ^ native_sim_dir_bits) & bit(axis)))
+            fprintf(native_sim_edges, "%.3f,%c,dir,%d\n", us - hot_settings->direction_setup_microseconds, "XYZABC"[axis], (dir_bits >> axis) & 1);
+    }
+    native_sim_dir_bits = (native_sim_dir_bits & ~step_bits) | (dir_bits & step_bits);
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        if (step_bits & bit(axis))
+            fprintf(native_sim_edges, "%.3f,%c,step,1\n", us, "XYZABC"[axis]);
+    }
+    for (uint8_t axis = 0; axis < N_AXIS; axis++) {
+        if (step_bits & bit(axis))
+            fprintf(native_sim_edges, "%.3f,%c,step,0\n", us + hot_settings->pulse_microseconds, "XYZABC"[axis]);
+    }
+}
+
+// Simulates the job at path from the reset state. Returns the status of sd_bench_run().
+static err_t native_sim_file(const char* path, sd_bench_result_t* result) {
+    FILE* source = fopen(path, "r");
+    if (source == NULL) {
+        printf("cannot open %s\n", path);
+        return STATUS_SD_FAILED_OPEN_FILE;
+    }
+    native_reset();
+    native_sim_dir_bits = 0;
+    err_t status = sd_bench_run(path, native_sim_read_file, source, CLIENT_SERIAL, true, native_sim_edges ? native_sim_edge : NULL, result);
+    fclose(source);
+    return status;
+}
+
+int native_sim(int argc, char** argv) {
+    int arg = 0;
+    if (arg + 1 < argc && strcmp(argv[arg], "--edges") == 0) {
+        native_sim_edges = fopen(argv[arg + 1], "w");
+        if (native_sim_edges == NULL) {
+            printf("cannot write %s\n", argv[arg + 1]);
+            return 2;
+        }
+        fprintf(native_sim_edges, "time_us,axis,signal,level\n");
+        arg += 2;
+    }
+    if (arg == argc) {
+        printf("sim needs a file\n");
+        return 2;
+    }
+    int failed = 0;
+    for (; arg < argc; arg++) {
+        sd_bench_result_t result;
+        if (native_sim_file(argv[arg], &result) != STATUS_OK)
+            failed++;
+    }
+    if (native_sim_edges)
+        fclose(native_sim_edges);
+    native_sim_edges = NULL;
+    return failed;
+}
+
+// The .expected file of tests/stress/generate.py
+typedef struct {
+    uint32_t lines;
+    float end[3]; // X, Y and Z
+    float min_time;
+} native_expected_t;
+
+static bool native_read_expected(const char* path, native_expected_t* expected) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+        return false;
+    char text[80];
+    uint8_t found = 0;
+    while (fgets(text, sizeof(text), file)) {
+        if (sscanf(text, "lines %u", &expected->lines) == 1)
+            found |= bit(0);
+        else if (sscanf(text, "end X%f Y%f Z%f", &expected->end[0], &expected->end[1], &expected->end[2]) == 3)
+            found |= bit(1);
+        else if (sscanf(text, "min_time %f", &expected->min_time) == 1)
+            found |= bit(2);
+    }
+    fclose(file);
+    return found == 0x7;
+}
+
+// Checks the job of one .expected file. Returns the number of failed checks.
+static int native_check_stress(const char* dir, const char* name) {
+    int failures = 0;
+    char path[512];
+    native_expected_t expected;
+    snprintf(path, sizeof(path), "%s/%s.expected", dir, name);
+    if (!native_read_expected(path, &expected)) {
+        NATIVE_CHECK(&failures, false, "%s: cannot read lines, end and min_time", path);
+        return failures;
+    }
+    snprintf(path, sizeof(path), "%s/%s.nc", dir, name);
+    sd_bench_result_t result;
+    err_t status = native_sim_file(path, &result);
+    NATIVE_CHECK(&failures, status == STATUS_OK, "%s: error:%d", path, status);
+    if (status != STATUS_OK)
+        return failures;
+    NATIVE_CHECK(&failures, result.lines == expected.lines, "%s: %d lines, expected %d", path, result.lines, expected.lines);
+    NATIVE_CHECK(&failures, result.errors == 0, "%s: %d lines with errors", path, result.errors);
+    NATIVE_CHECK(&failures, result.dropped == 0, "%s: %d motions past SD_BENCH_MAX_MOTIONS", path, result.dropped);
+    NATIVE_CHECK(&failures, result.end_matches, "%s: the steps did not end where the planner put the last motion", path);
+    for (uint8_t axis = 0; axis < 3; axis++) {
+        float step = 1.0f / axis_settings[axis]->steps_per_mm->get();
+        NATIVE_CHECK(&failures, fabsf(result.end[axis] - expected.end[axis]) <= step / 2, "%s: ends at %c%.4f, expected %c%.4f", path,
+                     "XYZ"[axis], result.end[axis], "XYZ"[axis], expected.end[axis]);
+    }
+    float sim_sec = (double)result.sim_ticks / F_STEPPER_TIMER;
+    // min_time is at the programmed feeds, without acceleration. 0.1% is left for the step timing.
+    NATIVE_CHECK(&failures, sim_sec >= expected.min_time * 0.999f, "%s: %.3f sec, shorter than min_time %.3f", path, sim_sec,
+                 expected.min_time);
+    printf("test-stress %s: %.3f sec, %.2fx min_time, peak feed %.0f mm/min, peak accel %.0f mm/sec^2, %d segments\n", name, sim_sec,
+           expected.min_time > 0 ? sim_sec / expected.min_time : 0.0f, result.peak_feed, result.peak_accel, result.segments);
+    return failures;
+}
+
+int native_test_stress(int argc, char** argv) {
+    if (argc != 1) {
+        printf("test-stress needs the folder of generate.py\n");
+        return 2;
+    }
+    struct dirent** entries;
+    int count = scandir(argv[0], &entries, NULL, alphasort); // In order, so that runs can be diffed
+    if (count < 0) {
+        printf("cannot open %s\n", argv[0]);
+        return 2;
+    }
+    int failures = 0, jobs = 0;
+    for (int i = 0; i < count; i++) {
+        char* suffix = strrchr(entries[i]->d_name, '.');
+        if (suffix != NULL && strcmp(suffix, ".expected") == 0) {
+            *suffix = '\0';
+            failures += native_check_stress(argv[0], entries[i]->d_name);
+            jobs++;
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    NATIVE_CHECK(&failures, jobs > 0, "%s has no .expected files", argv[0]);
+    printf("test-stress: %d jobs, %d failures\n", jobs, failures);
+    return failures;
+}
@@ -0,0 +1,110 @@
+/*
+  native_stubs.cpp - what the native build has in place of the device
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The native build links the parser, planner, segment prep and the modules they call, see
+// [env:native] in platformio.ini. This file defines what the modules it leaves out would have:
+// the globals of Grbl_Esp32.ino, the serial port, the motor drivers and the registers the
+// linked modules write. Everything sent to a client goes to stdout.
+
+#include "../../grbl.h"
+#include "soc/ledc_struct.h"
+#include "soc/gpio_struct.h"
+
+#include <chrono>
+
+// From Grbl_Esp32.ino
+system_t sys;
+int32_t sys_position[N_AXIS];
+int32_t sys_probe_position[N_AXIS];
+volatile uint8_t sys_probe_state;
+volatile uint8_t sys_rt_exec_state;
+volatile uint8_t sys_rt_exec_alarm;
+volatile uint8_t sys_rt_exec_motion_override;
+volatile uint8_t sys_rt_exec_accessory_override;
+#ifdef DEBUG
+volatile uint8_t sys_rt_exec_debug;
+#endif
+Spindle* spindle = &null_spindle;
+
+// The SDK and the core
+EspClass ESP;
+EEPROMClass EEPROM;
+timg_dev_t TIMERG0;
+ledc_dev_t LEDC;
+gpio_dev_t GPIO;
+
+static bool native_time_frozen = false;
+static int64_t native_time_us = 0; // The frozen time, or the offset from the host clock
+
+static int64_t native_host_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t esp_timer_get_time() {
+    static const int64_t start = native_host_us();
+    return native_time_frozen ? native_time_us : native_host_us() - start + native_time_us;
+}
+
+void native_set_time_us(int64_t us) {
+    native_time_frozen = true;
+    native_time_us = us;
+}
+
+void native_advance_time_us(int64_t us) {
+    native_time_us += us;
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)(esp_timer_get_time() / 1000 / portTICK_PERIOD_MS);
+}
+
+// Nothing watches the tasks, as there are none.
+extern "C" esp_err_t esp_task_wdt_init(uint32_t timeout, bool panic) {
+    return ESP_OK;
+}
+extern "C" esp_err_t esp_task_wdt_add(TaskHandle_t handle) {
+    return ESP_OK;
+}
+extern "C" esp_err_t esp_task_wdt_delete(TaskHandle_t handle) {
+    return ESP_OK;
+}
+extern "C" esp_err_t esp_task_wdt_reset() {
+    return ESP_OK;
+}
+
+extern "C" int __digitalRead(uint8_t pin) {
+    return 0;
+}
+extern "C" void __pinMode(uint8_t pin, uint8_t mode) {}
+extern "C" void __digitalWrite(uint8_t pin, uint8_t val) {}
+
+// The serial port is stdout, and has nothing to read.
+void serial_write(uint8_t data) {
+    putchar(data);
+}
+
+void serial_uart_write(const uint8_t* data, size_t len) {
+    fwrite(data, 1, len, stdout);
+}
+
+int serial_get_rx_buffer_available(uint8_t client) {
+    return RX_BUFFER_SIZE;
+}
+
+// There are no motor drivers. The simulator takes the steps from the segments instead.
+void motors_set_disable(bool disable) {}
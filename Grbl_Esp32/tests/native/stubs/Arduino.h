@@ -0,0 +1,156 @@
+/*
+  Arduino.h - host stand-in for the Arduino core, for the native build
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+// Only what the headers of grbl.h and the modules of the native build use. Pins do nothing and
+// time comes from the host clock, or from native_set_time_us() when a test drives it.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+#include <string>
+#include <stdexcept>
+
+#include "binary.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define ICACHE_RAM_ATTR
+#define NOP() ((void)0)
+
+#define HIGH 0x1
+#define LOW  0x0
+#define INPUT          0x01
+#define OUTPUT         0x02
+#define PULLUP         0x04
+#define INPUT_PULLUP   0x05
+#define PULLDOWN       0x08
+#define INPUT_PULLDOWN 0x09
+#define OPEN_DRAIN     0x10
+#define RISING  0x01
+#define FALLING 0x02
+#define CHANGE  0x03
+
+#define CONFIG_ARDUINO_RUNNING_CORE 1
+#define F_CPU 240000000L
+
+#define log_d(...) ((void)0)
+#define log_i(...) ((void)0)
+#define log_w(...) ((void)0)
+#define log_e(...) ((void)0)
+#define log_v(...) ((void)0)
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define bit(b) (1UL << (b))
+#define bitRead(value, b) (((value) >> (b)) & 0x01)
+#define bitSet(value, b) ((value) |= (1UL << (b)))
+#define bitClear(value, b) ((value) &= ~(1UL << (b)))
+#define digitalPinToInterrupt(p) (p)
+
+// Pins.cpp puts these over the __ functions of the core, which the native build does nothing in.
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+static inline uint16_t analogRead(uint8_t) { return 0; }
+static inline void attachInterrupt(uint8_t, void (*)(void), int) {}
+static inline void detachInterrupt(uint8_t) {}
+static inline double ledcSetup(uint8_t, double freq, uint8_t) { return freq; }
+static inline void ledcAttachPin(uint8_t, uint8_t) {}
+static inline void ledcDetachPin(uint8_t) {}
+static inline void ledcWrite(uint8_t, uint32_t) {}
+static inline void dacWrite(uint8_t, uint8_t) {}
+
+static inline unsigned long micros() { return (unsigned long)esp_timer_get_time(); }
+static inline unsigned long millis() { return (unsigned long)(esp_timer_get_time() / 1000); }
+static inline void delay(uint32_t ms) { native_advance_time_us((int64_t)ms * 1000); }
+static inline void delayMicroseconds(uint32_t us) { native_advance_time_us(us); }
+static inline void yield() {}
+
+// The chip, as the native programs report it.
+class EspClass {
+  public:
+    uint32_t getCpuFreqMHz() { return 240; }
+    uint32_t getFreeHeap() { return 200000; } // About that of a device after boot, which sizes
+    uint32_t getMinFreeHeap() { return 200000; } // the buffers as the device would
+    uint32_t getFlashChipSize() { return 0; }
+    uint64_t getEfuseMac() { return 0; }
+    const char* getSdkVersion() { return "native"; }
+    void restart() { exit(0); }
+};
+extern EspClass ESP;
+
+// The few members of the Arduino String that the headers and the native modules use.
+class String : public std::string {
+  public:
+    String() {}
+    String(const char* s) : std::string(s ? s : "") {}
+    String(const std::string& s) : std::string(s) {}
+    String(char c) : std::string(1, c) {}
+    String(int n) : std::string(std::to_string(n)) {}
+    String(unsigned int n) : std::string(std::to_string(n)) {}
+    String(long n) : std::string(std::to_string(n)) {}
+    String(unsigned long n) : std::string(std::to_string(n)) {}
+    String(float f, unsigned int decimals = 2) : String((double)f, decimals) {}
+    String(double f, unsigned int decimals = 2) {
+        char buf[48];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, f);
+        assign(buf);
+    }
+    long toInt() const { return atol(c_str()); }
+    float toFloat() const { return atof(c_str()); }
+    bool equals(const String& s) const { return *this == s; }
+    bool equalsIgnoreCase(const String& s) const { return strcasecmp(c_str(), s.c_str()) == 0; }
+    bool startsWith(const String& s) const { return compare(0, s.size(), s) == 0; }
+    bool endsWith(const String& s) const { return size() >= s.size() && compare(size() - s.size(), s.size(), s) == 0; }
+    int indexOf(char c, unsigned int from = 0) const { size_t i = find(c, from); return i == npos ? -1 : (int)i; }
+    int indexOf(const String& s, unsigned int from = 0) const { size_t i = find(s, from); return i == npos ? -1 : (int)i; }
+    int lastIndexOf(char c) const { size_t i = rfind(c); return i == npos ? -1 : (int)i; }
+    String substring(unsigned int from) const { return from < size() ? String(substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const { return from < to && from < size() ? String(substr(from, to - from)) : String(); }
+    char charAt(unsigned int i) const { return i < size() ? (*this)[i] : 0; }
+    void toUpperCase() { for (auto& c : *this) c = toupper(c); }
+    void toLowerCase() { for (auto& c : *this) c = tolower(c); }
+    void trim() {
+        size_t start = find_first_not_of(" \t\r\n");
+        size_t end = find_last_not_of(" \t\r\n");
+        *this = start == npos ? String() : String(substr(start, end - start + 1));
+    }
+    bool concat(const String& s) { append(s); return true; }
+    String& operator+=(const String& s) { append(s); return *this; }
+    String& operator+=(const char* s) { append(s); return *this; }
+    String& operator+=(char c) { push_back(c); return *this; }
+};
+
+static inline String operator+(const String& a, const String& b) { String s = a; s += b; return s; }
+static inline String operator+(const String& a, const char* b) { String s = a; s += b; return s; }
+static inline String operator+(const char* a, const String& b) { String s = a; s += b; return s; }
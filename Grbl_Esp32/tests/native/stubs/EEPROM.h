@@ -0,0 +1,36 @@
+/*
+  EEPROM.h - host stand-in for the Arduino core, for the native build
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// The EEPROM emulation of the core, in RAM. It starts erased on each run of the native build.
+class EEPROMClass {
+  public:
+    EEPROMClass() { memset(_data, 0xff, sizeof(_data)); }
+    bool begin(size_t) { return true; }
+    uint8_t read(int address) { return _data[address % sizeof(_data)]; }
+    void write(int address, uint8_t value) { _data[address % sizeof(_data)] = value; }
+    bool commit() { return true; }
+
+  private:
+    uint8_t _data[4096];
+};
+extern EEPROMClass EEPROM;
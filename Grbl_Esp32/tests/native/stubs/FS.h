@@ -0,0 +1,59 @@
+/*
+  FS.h - host stand-in for the Arduino core, for the native build
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Print.h"
+
+#include "Arduino.h"
+
+// There are no files on the device's file systems in the native build. The native programs
+// read their jobs with stdio.
+namespace fs {
+    class File : public Stream {
+      public:
+        size_t write(uint8_t) override { return 0; }
+        int available() override { return 0; }
+        int read() override { return -1; }
+        int peek() override { return -1; }
+        size_t read(uint8_t*, size_t) { return 0; }
+        bool seek(uint32_t) { return false; }
+        size_t position() const { return 0; }
+        size_t size() const { return 0; }
+        void close() {}
+        const char* name() const { return ""; }
+        bool isDirectory() { return false; }
+        File openNextFile() { return File(); }
+        operator bool() const { return false; }
+    };
+
+    class FS {
+      public:
+        File open(const char*, const char* = "r") { return File(); }
+        File open(const String& path, const char* mode = "r") { return open(path.c_str(), mode); }
+        bool exists(const char*) { return false; }
+        bool exists(const String&) { return false; }
+        bool remove(const char*) { return false; }
+        bool rename(const char*, const char*) { return false; }
+        bool mkdir(const char*) { return false; }
+        bool rmdir(const char*) { return false; }
+    };
+}
+
+using fs::File;
+using fs::FS;
@@ -0,0 +1,45 @@
+/*
+  WiFi.h - host stand-in for the Arduino core, for the native build
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Arduino.h"
+
+// Only the address of the IP settings. The native build has no network.
+class IPAddress {
+  public:
+    IPAddress(uint32_t address = 0) : _address(address) {}
+    bool fromString(const char* s) {
+        unsigned int b[4];
+        char end;
+        if (sscanf(s, "%u.%u.%u.%u%c", &b[0], &b[1], &b[2], &b[3], &end) != 4 || b[0] > 255 || b[1] > 255 || b[2] > 255 || b[3] > 255)
+            return false;
+        _address = b[0] | (b[1] << 8) | (b[2] << 16) | (b[3] << 24);
+        return true;
+    }
+    bool fromString(const String& s) { return fromString(s.c_str()); }
+    String toString() const {
+        char s[16];
+        snprintf(s, sizeof(s), "%u.%u.%u.%u", _address & 0xff, (_address >> 8) & 0xff, (_address >> 16) & 0xff, _address >> 24);
+        return String(s);
+    }
+    operator uint32_t() const { return _address; }
+
+  private:
+    uint32_t _address;
+};
@@ -0,0 +1,26 @@
+/*
+  driver/dac.h - host stand-in for the ESP32 SDK, for the native build
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "esp_timer.h"
+
+typedef enum { DAC_CHANNEL_1 = 1, DAC_CHANNEL_2 } dac_channel_t;
+
+static inline esp_err_t dac_output_enable(dac_channel_t) { return ESP_OK; }
+static inline esp_err_t dac_output_voltage(dac_channel_t, uint8_t) { return ESP_OK; }
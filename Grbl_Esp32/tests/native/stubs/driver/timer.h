@@ -0,0 +1,69 @@
+/*
+  driver/timer.h - host stand-in for the ESP32 SDK, for the native build
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_timer.h"
+
+// The hardware timers of the stepper. Nothing counts them in the native build: the simulator
+// runs the segment prep and replays the segments on its own virtual timer, see st_sim_prep().
+typedef int timer_group_t;
+typedef int timer_idx_t;
+#define TIMER_GROUP_0 0
+#define TIMER_GROUP_1 1
+#define TIMER_0 0
+#define TIMER_1 1
+typedef enum { TIMER_COUNT_DOWN, TIMER_COUNT_UP } timer_count_dir_t;
+typedef enum { TIMER_PAUSE, TIMER_START } timer_start_t;
+typedef enum { TIMER_ALARM_DIS, TIMER_ALARM_EN } timer_alarm_t;
+typedef enum { TIMER_INTR_LEVEL, TIMER_INTR_EDGE } timer_intr_mode_t;
+typedef enum { TIMER_AUTORELOAD_DIS, TIMER_AUTORELOAD_EN } timer_autoreload_t;
+typedef struct {
+    timer_alarm_t alarm_en;
+    timer_start_t counter_en;
+    timer_intr_mode_t intr_type;
+    timer_count_dir_t counter_dir;
+    bool auto_reload;
+    uint32_t divider;
+} timer_config_t;
+typedef void* timer_isr_handle_t;
+
+static inline esp_err_t timer_init(timer_group_t, timer_idx_t, const timer_config_t*) { return ESP_OK; }
+static inline esp_err_t timer_set_counter_value(timer_group_t, timer_idx_t, uint64_t) { return ESP_OK; }
+static inline esp_err_t timer_set_alarm_value(timer_group_t, timer_idx_t, uint64_t) { return ESP_OK; }
+static inline esp_err_t timer_enable_intr(timer_group_t, timer_idx_t) { return ESP_OK; }
+static inline esp_err_t timer_isr_register(timer_group_t, timer_idx_t, void (*)(void*), void*, int, timer_isr_handle_t*) { return ESP_OK; }
+static inline esp_err_t timer_start(timer_group_t, timer_idx_t) { return ESP_OK; }
+static inline esp_err_t timer_pause(timer_group_t, timer_idx_t) { return ESP_OK; }
+
+typedef struct {
+    struct {
+        struct {
+            uint32_t alarm_en;
+        } config;
+        uint32_t cnt_low;
+        uint32_t alarm_low;
+        uint32_t update;
+    } hw_timer[2];
+    struct {
+        uint32_t t0;
+        uint32_t t1;
+    } int_clr_timers;
+} timg_dev_t;
+extern timg_dev_t TIMERG0;
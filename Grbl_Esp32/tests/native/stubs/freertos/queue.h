@@ -0,0 +1,28 @@
+/*
+  freertos/queue.h - host stand-in for the ESP32 SDK, for the native build
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "FreeRTOS.h"
+
+static inline QueueHandle_t xQueueCreate(UBaseType_t, UBaseType_t) { return NULL; }
+static inline BaseType_t xQueueSend(QueueHandle_t, const void*, TickType_t) { return pdFAIL; }
+static inline BaseType_t xQueueSendFromISR(QueueHandle_t, const void*, BaseType_t*) { return pdFAIL; }
+static inline BaseType_t xQueueReceive(QueueHandle_t, void*, TickType_t) { return pdFALSE; }
+static inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t) { return 0; }
+static inline BaseType_t xQueueReset(QueueHandle_t) { return pdPASS; }
@@ -0,0 +1,48 @@
+/*
+  freertos/task.h - host stand-in for the ESP32 SDK, for the native build
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "FreeRTOS.h"
+
+// Tasks are not started in the native build. The modules it links only create them from their
+// init functions, which the native programs do not call.
+static inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t, TaskHandle_t* handle, BaseType_t) {
+    if (handle)
+        *handle = NULL;
+    return pdFAIL;
+}
+static inline BaseType_t xTaskCreate(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t, TaskHandle_t* handle) {
+    if (handle)
+        *handle = NULL;
+    return pdFAIL;
+}
+TickType_t xTaskGetTickCount();
+static inline TickType_t xTaskGetTickCountFromISR() { return xTaskGetTickCount(); }
+static inline void vTaskDelay(TickType_t) {}
+static inline void vTaskDelayUntil(TickType_t* last, TickType_t period) { *last += period; }
+static inline void vTaskDelete(TaskHandle_t) {}
+static inline void vTaskSuspend(TaskHandle_t) {}
+static inline void vTaskResume(TaskHandle_t) {}
+static inline void vTaskPrioritySet(TaskHandle_t, UBaseType_t) {}
+static inline UBaseType_t uxTaskPriorityGet(TaskHandle_t) { return 1; }
+static inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 0; }
+static inline TaskHandle_t xTaskGetCurrentTaskHandle() { return NULL; }
+static inline BaseType_t xTaskNotifyGive(TaskHandle_t) { return pdPASS; }
+static inline void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t*) {}
+static inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) { return 0; }
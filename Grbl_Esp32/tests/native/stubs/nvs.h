@@ -0,0 +1,64 @@
+/*
+  nvs.h - host stand-in for the ESP32 SDK, for the native build
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include "esp_timer.h"
+
+// There is no NVS on the host. The settings of the native build keep their defaults.
+typedef uint32_t nvs_handle;
+typedef void* nvs_iterator_t;
+typedef enum { NVS_TYPE_ANY = 0xff } nvs_type_t;
+typedef struct {
+    size_t used_entries;
+    size_t free_entries;
+    size_t total_entries;
+    size_t namespace_count;
+} nvs_stats_t;
+typedef struct {
+    char namespace_name[16];
+    char key[16];
+    nvs_type_t type;
+} nvs_entry_info_t;
+
+static inline esp_err_t nvs_get_stats(const char*, nvs_stats_t* stats) {
+    *stats = {};
+    return ESP_OK;
+}
+static inline nvs_iterator_t nvs_entry_find(const char*, const char*, nvs_type_t) { return NULL; }
+static inline nvs_iterator_t nvs_entry_next(nvs_iterator_t) { return NULL; }
+static inline void nvs_entry_info(nvs_iterator_t, nvs_entry_info_t* info) { *info = {}; }
+static inline esp_err_t nvs_erase_all(nvs_handle) { return ESP_OK; }
+
+#define ESP_ERR_NVS_NOT_FOUND 0x1102
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode;
+static inline esp_err_t nvs_open(const char*, nvs_open_mode, nvs_handle* handle) {
+    *handle = 0;
+    return ESP_OK;
+}
+static inline esp_err_t nvs_commit(nvs_handle) { return ESP_OK; }
+static inline esp_err_t nvs_erase_key(nvs_handle, const char*) { return ESP_OK; }
+static inline esp_err_t nvs_get_blob(nvs_handle, const char*, void*, size_t*) { return ESP_ERR_NVS_NOT_FOUND; }
+static inline esp_err_t nvs_get_i32(nvs_handle, const char*, int32_t*) { return ESP_ERR_NVS_NOT_FOUND; }
+static inline esp_err_t nvs_get_i8(nvs_handle, const char*, int8_t*) { return ESP_ERR_NVS_NOT_FOUND; }
+static inline esp_err_t nvs_get_str(nvs_handle, const char*, char*, size_t*) { return ESP_ERR_NVS_NOT_FOUND; }
+static inline esp_err_t nvs_set_blob(nvs_handle, const char*, const void*, size_t) { return ESP_OK; }
+static inline esp_err_t nvs_set_i32(nvs_handle, const char*, int32_t) { return ESP_OK; }
+static inline esp_err_t nvs_set_i8(nvs_handle, const char*, int8_t) { return ESP_OK; }
+static inline esp_err_t nvs_set_str(nvs_handle, const char*, const char*) { return ESP_OK; }
@@ -0,0 +1,44 @@
+/*
+  soc/ledc_struct.h - host stand-in for the ESP32 SDK, for the native build
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// The registers system.cpp writes the PWM duty to from the ISR. They drive nothing here.
+typedef struct {
+    struct {
+        struct {
+            struct {
+                uint32_t sig_out_en;
+                uint32_t low_speed_update;
+            } conf0;
+            struct {
+                uint32_t duty;
+            } duty;
+            struct {
+                uint32_t duty_scale;
+                uint32_t duty_cycle;
+                uint32_t duty_num;
+                uint32_t duty_inc;
+                uint32_t duty_start;
+            } conf1;
+        } channel[8];
+    } channel_group[2];
+} ledc_dev_t;
+extern ledc_dev_t LEDC;
@@ -0,0 +1,30 @@
+/*
+  soc/rtc_io_reg.h - host stand-in for the ESP32 SDK, for the native build
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// The DAC pad registers of sys_dac_write_isr(). The writes go nowhere.
+#define RTC_IO_PAD_DAC1_REG 0
+#define RTC_IO_PAD_DAC2_REG 0
+#define RTC_IO_PDAC1_DAC 0xff
+#define RTC_IO_PDAC1_DAC_S 19
+#define RTC_IO_PDAC2_DAC 0xff
+#define RTC_IO_PDAC2_DAC_S 19
+#define SET_PERI_REG_BITS(reg, bits, value, shift) ((void)(reg), (void)(bits), (void)(value), (void)(shift))
@@ -0,0 +1,139 @@
+/*
+  test_float.cpp - read_float() and decimal_to_float() against strtof()
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Build and run, from the repository root:
+//   pio run -e native && .pio/build/native/program test-float [<count> [<seed>]]
+//
+// Random g-code numbers are read with read_float() and compared with strtof() of the same text,
+// which rounds correctly. With up to MAX_INT_DIGITS digits, leading zeros included, the results
+// must be equal, as must the characters read. Past that, read_float() drops the digits that do
+// not fit, which may take the result 1 ulp below. decimal_to_float() is compared on its own
+// over the whole of its exponent range: equal up to exp 10, and within 2 ulp past that, above
+// 1e19, where both factors of the float product may be rounded.
+
+#include "native.h"
+
+static uint64_t test_float_state;
+
+// xorshift64*, so that a seed gives the same numbers on every host
+static uint32_t test_float_random(uint32_t range) {
+    test_float_state ^= test_float_state >> 12;
+    test_float_state ^= test_float_state << 25;
+    test_float_state ^= test_float_state >> 27;
+    return (uint32_t)((test_float_state * 2685821657736338717ULL) >> 32) % range;
+}
+
+// The distance of a and b in units in the last place. Both are finite and of the same sign.
+static uint32_t test_float_ulps(float a, float b) {
+    int32_t ia, ib;
+    memcpy(&ia, &a, sizeof(ia));
+    memcpy(&ib, &b, sizeof(ib));
+    return ia > ib ? ia - ib : ib - ia;
+}
+
+// Writes a random number as g-code has them into s and returns its digit count.
+static uint8_t test_float_number(char* s) {
+    static const char* signs[] = { "", "", "-", "+" };
+    uint8_t int_digits = test_float_random(8);
+    uint8_t frac_digits = test_float_random(8);
+    uint8_t digits = 0;
+    s += sprintf(s, "%s", signs[test_float_random(4)]);
+    for (uint8_t i = 0; i < int_digits; i++, digits++)
+        *s++ = '0' + (i == 0 && int_digits > 1 ? 1 + test_float_random(9) : test_float_random(10));
+    if (frac_digits || int_digits == 0 || test_float_random(2)) {
+        *s++ = '.';
+        if (int_digits == 0 && frac_digits == 0)
+            frac_digits = 1;
+    }
+    for (uint8_t i = 0; i < frac_digits; i++, digits++)
+        *s++ = '0' + test_float_random(10);
+    // What follows the number on a line. Not X, as strtof() reads 0X1 as hexadecimal.
+    static const char* next[] = { "", "Y1", " ", "(", ";", "E5", "." };
+    strcpy(s, next[test_float_random(sizeof(next) / sizeof(next[0]))]);
+    return digits;
+}
+
+static void test_read_float(int* failures, uint32_t count, uint32_t* inexact) {
+    char line[48];
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t digits = test_float_number(line);
+        uint8_t counter = 0;
+        float value;
+        char* end;
+        float expected = strtof(line, &end);
+        // strtof() would take E5 as the exponent, but g-code has no exponents
+        char* e = strchr(line, 'E');
+        if (e) {
+            *e = '\0';
+            expected = strtof(line, &end);
+            *e = 'E';
+        }
+        if (!read_float(line, &counter, &value)) {
+            NATIVE_CHECK(failures, false, "read_float(\"%s\") read no number", line);
+            continue;
+        }
+        NATIVE_CHECK(failures, counter == end - line, "read_float(\"%s\") read %d characters, strtof() %d", line, counter, (int)(end - line));
+        uint32_t ulps = test_float_ulps(value, expected);
+        if (digits <= MAX_INT_DIGITS)
+            NATIVE_CHECK(failures, ulps == 0, "read_float(\"%s\") = %.9g, strtof() %.9g", line, value, expected);
+        else {
+            NATIVE_CHECK(failures, ulps <= 1 && fabsf(value) <= fabsf(expected), "read_float(\"%s\") = %.9g, strtof() %.9g", line, value, expected);
+            if (ulps)
+                (*inexact)++;
+        }
+    }
+}
+
+static void test_decimal_to_float(int* failures, uint32_t count, uint32_t* inexact) {
+    static const uint32_t edges[] = { 0, 1, 9, 10, (1UL << 24) - 1, 1UL << 24, (1UL << 24) + 1, 99999999, 100000000, 999999999 };
+    char text[32];
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t intval = i < sizeof(edges) / sizeof(edges[0]) ? edges[i] : test_float_random(1000000000);
+        for (int8_t exp = -MAX_INT_DIGITS; exp <= 38; exp++) {
+            sprintf(text, "%ue%d", intval, exp);
+            float expected = strtof(text, NULL);
+            float value = decimal_to_float(intval, exp);
+            if (isinf(expected)) {
+                NATIVE_CHECK(failures, isinf(value), "decimal_to_float(%s) = %.9g, strtof() inf", text, value);
+                continue;
+            }
+            uint32_t ulps = test_float_ulps(value, expected);
+            if (exp <= 10)
+                NATIVE_CHECK(failures, ulps == 0, "decimal_to_float(%s) = %.9g, strtof() %.9g", text, value, expected);
+            else {
+                NATIVE_CHECK(failures, ulps <= 2, "decimal_to_float(%s) = %.9g, strtof() %.9g", text, value, expected);
+                if (ulps)
+                    (*inexact)++;
+            }
+        }
+    }
+}
+
+int native_test_float(int argc, char** argv) {
+    uint32_t count = argc > 0 ? atol(argv[0]) : 1000000;
+    test_float_state = argc > 1 ? strtoull(argv[1], NULL, 0) : 0x9e3779b97f4a7c15ULL;
+    if (test_float_state == 0)
+        test_float_state = 1;
+    int failures = 0;
+    uint32_t read_inexact = 0, scale_inexact = 0;
+    test_read_float(&failures, count, &read_inexact);
+    test_decimal_to_float(&failures, count / 10, &scale_inexact);
+    printf("test-float: %d numbers read, %d of more than %d digits 1 ulp low, %d scaled past 1e19 off, %d failures\n",
+           count, read_inexact, MAX_INT_DIGITS, scale_inexact, failures);
+    return failures;
+}
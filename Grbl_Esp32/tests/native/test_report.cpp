@@ -0,0 +1,320 @@
+/*
+  test_report.cpp - the status report builder against the strcat() and sprintf() report it replaced
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Build and run, from the repository root:
+//   pio run -e native && .pio/build/native/program test-report [<count> [<seed>]]
+//
+// Formats random values with report_format_float() and snprintf("%.*f") at 0 to 4 decimals, and
+// the strings must be equal: random float bit patterns, doubles within the float range, and positions in steps over
+// the steps/mm of common machines, which land on and next to the halfway cases. Then builds the
+// status report of random machine states with report_format_realtime_status() and with the
+// former strcat() and sprintf() report, which must be equal too. The Bf: field is left out of
+// both, as report_send_status() puts it in for each client. Last, a Run report is built both
+// ways for a while, and the rates are printed as
+//   test-report: <n> bytes, old <n> reports/s, new <n> reports/s
+// The rates are of the host. $Bench/Report times the new builder on a board.
+
+#include "native.h"
+
+#define TEST_REPORT_BENCH_US 500000 // How long each builder is timed for
+
+static uint64_t test_report_state;
+
+// xorshift64*, so that a seed gives the same values on every host
+static uint64_t test_report_random64() {
+    test_report_state ^= test_report_state >> 12;
+    test_report_state ^= test_report_state << 25;
+    test_report_state ^= test_report_state >> 27;
+    return test_report_state * 2685821657736338717ULL;
+}
+
+static uint32_t test_report_random(uint32_t range) {
+    return (uint32_t)(test_report_random64() >> 32) % range;
+}
+
+// A position of up to 2^bits steps, either way
+static int32_t test_report_steps() {
+    uint8_t bits = test_report_random(26);
+    int32_t steps = test_report_random(1UL << bits);
+    return test_report_random(2) ? -steps : steps;
+}
+
+// Compares value at each number of decimals. Returns the number of values compared.
+static uint32_t test_report_value(int* failures, double value) {
+    char expected[400], text[400];
+    for (uint8_t decimals = 0; decimals <= 4; decimals++) {
+        snprintf(expected, sizeof(expected), "%.*f", decimals, value);
+        report_format_float(text, sizeof(text), value, decimals);
+        NATIVE_CHECK(failures, strcmp(text, expected) == 0, "%.17g to %d decimals is %s, snprintf() %s", value, decimals, text, expected);
+    }
+    return 1;
+}
+
+static uint32_t test_report_float(int* failures, uint32_t count) {
+    static const float steps_per_mm[] = { 80, 100, 200, 250, 400, 1600, 3200 / 25.4f, 1000 / 3.0f };
+    uint32_t done = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t float_bits = test_report_random64() >> 32;
+        float f;
+        memcpy(&f, &float_bits, sizeof(f));
+        done += test_report_value(failures, f);
+        // Doubles within the float range, as the values of the report are floats widened to double
+        uint64_t double_bits = test_report_random64();
+        double_bits = (double_bits & 0x800FFFFFFFFFFFFFULL) | ((uint64_t)(1023 - 126 + test_report_random(254)) << 52);
+        double d;
+        memcpy(&d, &double_bits, sizeof(d));
+        done += test_report_value(failures, d);
+        // As system_convert_array_steps_to_mpos() and the inch conversion compute them
+        float mm = test_report_steps() / steps_per_mm[test_report_random(sizeof(steps_per_mm) / sizeof(steps_per_mm[0]))];
+        done += test_report_value(failures, mm);
+        done += test_report_value(failures, mm * (float)(1.0 / MM_PER_INCH));
+    }
+    return done;
+}
+
+// report_util_axis_values() as it was, with sprintf().
+static void test_report_old_axis_values(float* axis_value, char* rpt) {
+    uint8_t idx;
+    char axisVal[20];
+    float unit_conv = 1.0; // unit conversion multiplier..default is mm
+    rpt[0] = '\0';
+    if (report_inches->get())
+        unit_conv = 1.0 / MM_PER_INCH;
+    for (idx = 0; idx < N_AXIS; idx++) {
+        if (report_inches->get())
+            sprintf(axisVal, "%4.4f", axis_value[idx] * unit_conv);  // Report inches to 4 decimals
+        else
+            sprintf(axisVal, "%4.3f", axis_value[idx] * unit_conv);  // Report mm to 3 decimals
+        strcat(rpt, axisVal);
+        if (idx < (N_AXIS - 1))
+            strcat(rpt, ",");
+    }
+}
+
+// report_realtime_status() before the builder, with the fields of the native build and without
+// the Bf: field, built into status instead of sent.
+static void test_report_old(char* status) {
+    uint8_t idx;
+    int32_t current_position[N_AXIS]; // Copy current state of the system position variable
+    memcpy(current_position, sys_position, sizeof(sys_position));
+    float print_position[N_AXIS];
+    char temp[80];
+    system_convert_array_steps_to_mpos(print_position, current_position);
+    // Report current machine state and sub-states
+    strcpy(status, "<");
+    switch (sys.state) {
+    case STATE_IDLE: strcat(status, "Idle"); break;
+    case STATE_CYCLE: strcat(status, "Run"); break;
+    case STATE_HOLD:
+        if (!(sys.suspend & SUSPEND_JOG_CANCEL)) {
+            strcat(status, "Hold:");
+            if (sys.suspend & SUSPEND_HOLD_COMPLETE)  strcat(status, "0");   // Ready to resume
+            else  strcat(status, "1");   // Actively holding
+            break;
+        } // Continues to print jog state during jog cancel.
+    case STATE_JOG: strcat(status, "Jog"); break;
+    case STATE_HOMING: strcat(status, "Home"); break;
+    case STATE_ALARM: strcat(status, "Alarm"); break;
+    case STATE_CHECK_MODE: strcat(status, "Check"); break;
+    case STATE_SAFETY_DOOR:
+        strcat(status, "Door:");
+        if (sys.suspend & SUSPEND_INITIATE_RESTORE) {
+            strcat(status, "3"); // Restoring
+        } else {
+            if (sys.suspend & SUSPEND_RETRACT_COMPLETE) {
+                if (sys.suspend & SUSPEND_SAFETY_DOOR_AJAR) {
+                    strcat(status, "1"); // Door ajar
+                } else
+                    strcat(status, "0");
+                // Door closed and ready to resume
+            } else {
+                strcat(status, "2"); // Retracting
+            }
+        }
+        break;
+    case STATE_SLEEP: strcat(status, "Sleep"); break;
+    }
+    float wco[N_AXIS];
+    if (bit_isfalse(status_mask->get(), BITFLAG_RT_STATUS_POSITION_TYPE) ||
+            (sys.report_wco_counter == 0)) {
+        for (idx = 0; idx < N_AXIS; idx++) {
+            // Apply work coordinate offsets and tool length offset to current position.
+            wco[idx] = gc_state.coord_system[idx] + gc_state.coord_offset[idx];
+            if (idx == TOOL_LENGTH_OFFSET_AXIS)  wco[idx] += gc_state.tool_length_offset;
+            if (bit_isfalse(status_mask->get(), BITFLAG_RT_STATUS_POSITION_TYPE))
+                print_position[idx] -= wco[idx];
+        }
+    }
+    // Report machine position
+    if (bit_istrue(status_mask->get(), BITFLAG_RT_STATUS_POSITION_TYPE))
+        strcat(status, "|MPos:");
+    else
+        strcat(status, "|WPos:");
+    test_report_old_axis_values(print_position, temp);
+    strcat(status, temp);
+    // Report realtime feed speed
+    if (report_inches->get())
+        sprintf(temp, "|FS:%.1f,%d", st_get_realtime_rate()/ MM_PER_INCH, sys.spindle_speed);
+    else
+        sprintf(temp, "|FS:%.0f,%d", st_get_realtime_rate(), sys.spindle_speed);
+    strcat(status, temp);
+    uint8_t lim_pin_state = limits_get_state();
+    uint8_t ctrl_pin_state = system_control_get_state();
+    uint8_t prb_pin_state = probe_get_state();
+    if (lim_pin_state | ctrl_pin_state | prb_pin_state) {
+        strcat(status, "|Pn:");
+        if (prb_pin_state)  strcat(status, "P");
+        if (lim_pin_state) {
+            if (bit_istrue(lim_pin_state, bit(X_AXIS)))  strcat(status, "X");
+            if (bit_istrue(lim_pin_state, bit(Y_AXIS)))  strcat(status, "Y");
+            if (bit_istrue(lim_pin_state, bit(Z_AXIS)))  strcat(status, "Z");
+#if (N_AXIS > A_AXIS)
+            if (bit_istrue(lim_pin_state, bit(A_AXIS)))  strcat(status, "A");
+#endif
+#if (N_AXIS > B_AXIS)
+            if (bit_istrue(lim_pin_state, bit(B_AXIS)))  strcat(status, "B");
+#endif
+#if (N_AXIS > C_AXIS)
+            if (bit_istrue(lim_pin_state, bit(C_AXIS)))  strcat(status, "C");
+#endif
+        }
+        if (ctrl_pin_state) {
+            if (bit_istrue(ctrl_pin_state, CONTROL_PIN_INDEX_RESET))  strcat(status, "R");
+            if (bit_istrue(ctrl_pin_state, CONTROL_PIN_INDEX_FEED_HOLD))  strcat(status, "H");
+            if (bit_istrue(ctrl_pin_state, CONTROL_PIN_INDEX_CYCLE_START))  strcat(status, "S");
+        }
+    }
+    if (sys.report_wco_counter > 0)  sys.report_wco_counter--;
+    else {
+        if (sys.state & (STATE_HOMING | STATE_CYCLE | STATE_HOLD | STATE_JOG | STATE_SAFETY_DOOR)) {
+            sys.report_wco_counter = (REPORT_WCO_REFRESH_BUSY_COUNT - 1); // Reset counter for slow refresh
+        } else  sys.report_wco_counter = (REPORT_WCO_REFRESH_IDLE_COUNT - 1);
+        if (sys.report_ovr_counter == 0)  sys.report_ovr_counter = 1;   // Set override on next report.
+        strcat(status, "|WCO:");
+        test_report_old_axis_values(wco, temp);
+        strcat(status, temp);
+    }
+    if (sys.report_ovr_counter > 0)  sys.report_ovr_counter--;
+    else {
+        if (sys.state & (STATE_HOMING | STATE_CYCLE | STATE_HOLD | STATE_JOG | STATE_SAFETY_DOOR)) {
+            sys.report_ovr_counter = (REPORT_OVR_REFRESH_BUSY_COUNT - 1); // Reset counter for slow refresh
+        } else  sys.report_ovr_counter = (REPORT_OVR_REFRESH_IDLE_COUNT - 1);
+        sprintf(temp, "|Ov:%d,%d,%d", sys.f_override, sys.r_override, sys.spindle_speed_ovr);
+        strcat(status, temp);
+        uint8_t sp_state =  spindle->get_state();
+        uint8_t cl_state = coolant_get_state();
+        if (sp_state || cl_state) {
+            strcat(status, "|A:");
+            if (sp_state) { // != SPINDLE_STATE_DISABLE
+                if (sp_state == SPINDLE_STATE_CW)  strcat(status, "S");   // CW
+                else  strcat(status, "C");   // CCW
+            }
+            if (cl_state & COOLANT_STATE_FLOOD)  strcat(status, "F");
+        }
+    }
+    strcat(status, ">\r\n");
+}
+
+// Sets the setting to 0 or 1, as $<name>= does
+static void test_report_set(Setting* setting, bool on) {
+    char value[2] = { on ? '1' : '0', '\0' };
+    setting->setStringValue(value);
+}
+
+// A random machine state for a report, all of whose fields fit in REPORT_STATUS_LINE_SIZE
+static void test_report_random_state() {
+    static const uint8_t states[] = { STATE_IDLE,  STATE_CYCLE,       STATE_HOLD,  STATE_JOG,  STATE_HOMING,
+                                      STATE_ALARM, STATE_CHECK_MODE, STATE_SAFETY_DOOR, STATE_SLEEP };
+    sys.state = states[test_report_random(sizeof(states) / sizeof(states[0]))];
+    sys.suspend = test_report_random(256);
+    for (uint8_t idx = 0; idx < N_AXIS; idx++) {
+        sys_position[idx] = test_report_steps();
+        gc_state.coord_system[idx] = test_report_steps() / 1000.0f;
+        gc_state.coord_offset[idx] = test_report_random(4) ? 0 : test_report_steps() / 1000.0f;
+    }
+    gc_state.tool_length_offset = test_report_random(4) ? 0 : test_report_steps() / 1000.0f;
+    sys.f_override = 10 + test_report_random(191);
+    sys.r_override = 25 * (1 + test_report_random(4));
+    sys.spindle_speed_ovr = 10 + test_report_random(191);
+    sys.spindle_speed = test_report_random(30001);
+    sys.report_wco_counter = test_report_random(REPORT_WCO_REFRESH_BUSY_COUNT);
+    sys.report_ovr_counter = test_report_random(REPORT_OVR_REFRESH_BUSY_COUNT);
+    test_report_set(status_mask, test_report_random(2));
+    test_report_set(report_inches, test_report_random(2));
+}
+
+static void test_report_status(int* failures, uint32_t count) {
+    char expected[REPORT_STATUS_LINE_SIZE], status[REPORT_STATUS_LINE_SIZE];
+    for (uint32_t i = 0; i < count; i++) {
+        test_report_random_state();
+        uint8_t wco_counter = sys.report_wco_counter, ovr_counter = sys.report_ovr_counter;
+        test_report_old(expected);
+        uint8_t old_wco_counter = sys.report_wco_counter, old_ovr_counter = sys.report_ovr_counter;
+        sys.report_wco_counter = wco_counter;
+        sys.report_ovr_counter = ovr_counter;
+        report_format_realtime_status(status, sizeof(status));
+        NATIVE_CHECK(failures, strcmp(status, expected) == 0, "status report %s, was %s", status, expected);
+        NATIVE_CHECK(failures, sys.report_wco_counter == old_wco_counter && sys.report_ovr_counter == old_ovr_counter,
+                     "status report counters %d,%d, was %d,%d", sys.report_wco_counter, sys.report_ovr_counter, old_wco_counter, old_ovr_counter);
+    }
+}
+
+// Builds the reports of a running job with build for TEST_REPORT_BENCH_US and returns the reports/s.
+static uint32_t test_report_rate(void (*build)(char*)) {
+    char status[REPORT_STATUS_LINE_SIZE];
+    uint64_t done = 0;
+    int64_t start = esp_timer_get_time();
+    int64_t elapsed;
+    do {
+        for (int i = 0; i < 100; i++) {
+            sys_position[i % N_AXIS] += 37; // So that the values change as in a job
+            build(status);
+        }
+        done += 100;
+    } while ((elapsed = esp_timer_get_time() - start) < TEST_REPORT_BENCH_US);
+    return done * 1000000 / elapsed;
+}
+
+static void test_report_new(char* status) {
+    report_format_realtime_status(status, REPORT_STATUS_LINE_SIZE);
+}
+
+int native_test_report(int argc, char** argv) {
+    uint32_t count = argc > 0 ? atol(argv[0]) : 1000000;
+    test_report_state = argc > 1 ? strtoull(argv[1], NULL, 0) : 0x9e3779b97f4a7c15ULL;
+    if (test_report_state == 0)
+        test_report_state = 1;
+    int failures = 0;
+    uint32_t values = test_report_float(&failures, count);
+    test_report_status(&failures, count / 10);
+    printf("test-report: %d values at 0-%d decimals and %d status reports, %d failures\n", values, 4, count / 10, failures);
+    // A report as a sender sees it during a job, in mm with the machine position
+    native_reset();
+    sys.state = STATE_CYCLE;
+    for (uint8_t idx = 0; idx < N_AXIS; idx++)
+        sys_position[idx] = 123456 * (idx + 1);
+    test_report_set(status_mask, true);
+    test_report_set(report_inches, false);
+    char status[REPORT_STATUS_LINE_SIZE];
+    test_report_new(status);
+    uint32_t old_rate = test_report_rate(test_report_old);
+    uint32_t new_rate = test_report_rate(test_report_new);
+    printf("test-report: %d bytes, old %d reports/s, new %d reports/s\n", (int)strlen(status), old_rate, new_rate);
+    native_reset();
+    return failures;
+}
@@ -0,0 +1,275 @@
+/*
+  test_tokens.cpp - gc_tokenize_line() against the collapseGCode() and read_float() scan it replaced
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Build and run, from the repository root:
+//   pio run -e native && .pio/build/native/program test-tokens Grbl_Esp32/tests/parsetest.nc Grbl_Esp32/tests/raster_tree.nc
+//
+// Splits each line of the files, of a list of edge cases and of random lines both ways: with the
+// former STEP 2 scan of gc_execute_line(), collapseGCode() and then read_float() word by word, and
+// with gc_tokenize_line(). The letters, the word count and the status must be equal. The values
+// may differ by the rounding of the former read_float(), which multiplied by 0.1 and 0.01 in
+// double precision and kept one digit less, so they are only counted when they do. Each file is then split both ways
+// over and over for a while, and printed as
+//   test-tokens <file>: <n> lines, <n> values rounded differently, old <n> lines/s, new <n> lines/s
+// The rates are of the host, so they compare the two paths, not boards.
+
+#include "native.h"
+
+#define TEST_TOKENS_BENCH_US 500000 // How long each path is timed for on each file
+#define TEST_TOKENS_OLD_INT_DIGITS 8 // MAX_INT_DIGITS of the former read_float()
+
+// read_float() as it was before gc_tokenize_line(), with the scaling that decimal_to_float() replaced.
+static uint8_t test_tokens_read_float(const char* line, uint8_t* char_counter, float* float_ptr) {
+    const char* ptr = line + *char_counter;
+    unsigned char c;
+    // Grab first character and increment pointer. No spaces assumed in line.
+    c = *ptr++;
+    // Capture initial positive/minus character
+    bool isnegative = false;
+    if (c == '-') {
+        isnegative = true;
+        c = *ptr++;
+    } else if (c == '+')
+        c = *ptr++;
+    // Extract number into fast integer. Track decimal in terms of exponent value.
+    uint32_t intval = 0;
+    int8_t exp = 0;
+    uint8_t ndigit = 0;
+    bool isdecimal = false;
+    while (1) {
+        c -= '0';
+        if (c <= 9) {
+            ndigit++;
+            if (ndigit <= TEST_TOKENS_OLD_INT_DIGITS) {
+                if (isdecimal)  exp--;
+                intval = (((intval << 2) + intval) << 1) + c; // intval*10 + c
+            } else {
+                if (!(isdecimal))  exp++;    // Drop overflow digits
+            }
+        } else if (c == (('.' - '0') & 0xff)  &&  !(isdecimal))
+            isdecimal = true;
+        else
+            break;
+        c = *ptr++;
+    }
+    // Return if no digits have been read.
+    if (!ndigit)  return (false);  ;
+    // Convert integer into floating point.
+    float fval;
+    fval = (float)intval;
+    // Apply decimal. Should perform no more than two floating point multiplications for the
+    // expected range of E0 to E-4.
+    if (fval != 0) {
+        while (exp <= -2) {
+            fval *= 0.01;
+            exp += 2;
+        }
+        if (exp < 0)
+            fval *= 0.1;
+        else if (exp > 0) {
+            do {
+                fval *= 10.0;
+            } while (--exp > 0);
+        }
+    }
+    // Assign floating point value with correct sign.
+    if (isnegative)
+        *float_ptr = -fval;
+    else
+        *float_ptr = fval;
+    *char_counter = ptr - line - 1; // Set char_counter to next statement
+    return (true);
+}
+
+// Step 0 and the word loop of STEP 2 of gc_execute_line() before gc_tokenize_line(), with the
+// words kept instead of parsed.
+static uint8_t test_tokens_old(char* line, gc_word_t* words, uint8_t* word_count) {
+    uint8_t status = STATUS_OK;
+    uint8_t count = 0;
+    collapseGCode(line);
+    uint8_t char_counter = 0;
+    while (line[char_counter] != 0) { // Loop until no more g-code words in line.
+        char letter = line[char_counter];
+        float value;
+        if ((letter < 'A') || (letter > 'Z')) {
+            status = STATUS_EXPECTED_COMMAND_LETTER;    // [Expected word letter]
+            break;
+        }
+        char_counter++;
+        if (!test_tokens_read_float(line, &char_counter, &value)) {
+            status = STATUS_BAD_NUMBER_FORMAT;    // [Expected word value]
+            break;
+        }
+        // A line shorter than LINE_BUFFER_SIZE cannot have more words
+        words[count].letter = letter;
+        words[count++].value = value;
+    }
+    *word_count = count;
+    return status;
+}
+
+// Splits line both ways and checks that the words agree. Returns the number of values that differ.
+static uint32_t test_tokens_line(int* failures, const char* line, const char* where) {
+    char old_line[LINE_BUFFER_SIZE], new_line[LINE_BUFFER_SIZE];
+    gc_word_t old_words[GC_MAX_WORDS], new_words[GC_MAX_WORDS];
+    uint8_t old_count, new_count;
+    strcpy(old_line, line);
+    strcpy(new_line, line);
+    uint8_t old_status = test_tokens_old(old_line, old_words, &old_count);
+    uint8_t new_status = gc_tokenize_line(new_line, new_words, &new_count);
+    NATIVE_CHECK(failures, old_status == new_status, "%s \"%s\": status %d, was %d", where, line, new_status, old_status);
+    NATIVE_CHECK(failures, old_count == new_count, "%s \"%s\": %d words, was %d", where, line, new_count, old_count);
+    uint32_t inexact = 0;
+    for (uint8_t i = 0; i < MIN(old_count, new_count); i++) {
+        NATIVE_CHECK(failures, old_words[i].letter == new_words[i].letter, "%s \"%s\": word %d is %c, was %c", where, line, i,
+                     new_words[i].letter, old_words[i].letter);
+        if (old_words[i].value != new_words[i].value)
+            inexact++;
+    }
+    return inexact;
+}
+
+// Comments, case, spaces and malformed words, where the two paths are most likely to part.
+static const char* test_tokens_edges[] = {
+    "",
+    "g1x1y2",
+    "G1 X1 (comment) Y2",
+    "G1 X1 (unterminated",
+    "G1X1;rest X2",
+    "G1X1) Y2",
+    "(a)(b)G0X0",
+    "((nested) X1) Y2",
+    "%G1X1\r",
+    "  \tG1\tX 1 . 5  ",
+    "X1.2.3",
+    "X",
+    "X-",
+    "X.",
+    "X-.5",
+    "X+3",
+    "1X2",
+    "G1X1#2",
+    "N10 G1 X1 Y-2.0000001 Z123456789012 F.0001",
+    "X0.00000001 Y100000000 Z999999999.9",
+    "G1X1 Y2 ; a comment (with parens)",
+    "G1 X1 (a comment ; with semicolon) Y2",
+};
+
+static uint64_t test_tokens_state = 0x9e3779b97f4a7c15ULL;
+
+// xorshift64*, so that every host gets the same lines
+static uint32_t test_tokens_random(uint32_t range) {
+    test_tokens_state ^= test_tokens_state >> 12;
+    test_tokens_state ^= test_tokens_state << 25;
+    test_tokens_state ^= test_tokens_state >> 27;
+    return (uint32_t)((test_tokens_state * 2685821657736338717ULL) >> 32) % range;
+}
+
+// Writes a random line of up to LINE_BUFFER_SIZE - 1 characters, mostly words, into line.
+static void test_tokens_random_line(char* line) {
+    static const char* pieces[] = { "G", "x", "Y", "Z", "F", "n", "1", "23", "0.5", "-", "+", ".", " ", "\t",
+                                    "(c)", "(", ")", ";c", "%", "#", "45.678", "123456789" };
+    size_t length = 0;
+    size_t target = test_tokens_random(LINE_BUFFER_SIZE);
+    line[0] = '\0';
+    while (length < target) {
+        const char* piece = pieces[test_tokens_random(sizeof(pieces) / sizeof(pieces[0]))];
+        if (length + strlen(piece) >= LINE_BUFFER_SIZE)
+            break;
+        strcpy(line + length, piece);
+        length += strlen(piece);
+    }
+}
+
+// Reads the lines of path that fit in the line buffer, as the protocol takes them, into a
+// malloc'ed array. Returns the number of lines, or -1 if the file cannot be read.
+static int test_tokens_read_file(const char* path, char (**lines)[LINE_BUFFER_SIZE]) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+        return -1;
+    int count = 0, size = 0;
+    *lines = NULL;
+    char* text = NULL;
+    size_t text_size = 0;
+    ssize_t length;
+    while ((length = getline(&text, &text_size, file)) >= 0) {
+        while (length && (text[length - 1] == '\n' || text[length - 1] == '\r'))
+            text[--length] = '\0';
+        if (length >= LINE_BUFFER_SIZE)
+            continue; // STATUS_OVERFLOW
+        if (count == size) {
+            size = size ? 2 * size : 1024;
+            *lines = (char(*)[LINE_BUFFER_SIZE])realloc(*lines, size * LINE_BUFFER_SIZE);
+        }
+        strcpy((*lines)[count++], text);
+    }
+    free(text);
+    fclose(file);
+    return count;
+}
+
+// Splits the lines with tokenize for TEST_TOKENS_BENCH_US and returns the lines/s.
+static uint32_t test_tokens_rate(char (*lines)[LINE_BUFFER_SIZE], int count, uint8_t (*tokenize)(char*, gc_word_t*, uint8_t*)) {
+    char line[LINE_BUFFER_SIZE];
+    gc_word_t words[GC_MAX_WORDS];
+    uint8_t word_count;
+    volatile uint32_t words_seen = 0; // So that the passes are not optimized away
+    uint64_t done = 0;
+    int64_t start = esp_timer_get_time();
+    int64_t elapsed;
+    do {
+        for (int i = 0; i < count; i++) {
+            strcpy(line, lines[i]); // Both paths write to the line
+            tokenize(line, words, &word_count);
+            words_seen += word_count;
+        }
+        done += count;
+    } while ((elapsed = esp_timer_get_time() - start) < TEST_TOKENS_BENCH_US);
+    return done * 1000000 / elapsed;
+}
+
+int native_test_tokens(int argc, char** argv) {
+    int failures = 0;
+    uint32_t inexact = 0;
+    for (const char* line : test_tokens_edges)
+        inexact += test_tokens_line(&failures, line, "edge");
+    char line[LINE_BUFFER_SIZE];
+    for (int i = 0; i < 100000; i++) {
+        test_tokens_random_line(line);
+        inexact += test_tokens_line(&failures, line, "random");
+    }
+    printf("test-tokens: %d edge and 100000 random lines, %d values rounded differently\n", (int)(sizeof(test_tokens_edges) / sizeof(test_tokens_edges[0])), inexact);
+    for (int i = 0; i < argc; i++) {
+        char(*lines)[LINE_BUFFER_SIZE];
+        int count = test_tokens_read_file(argv[i], &lines);
+        if (count < 0) {
+            printf("cannot open %s\n", argv[i]);
+            failures++;
+            continue;
+        }
+        inexact = 0;
+        for (int j = 0; j < count; j++)
+            inexact += test_tokens_line(&failures, lines[j], argv[i]);
+        uint32_t old_rate = count ? test_tokens_rate(lines, count, test_tokens_old) : 0;
+        uint32_t new_rate = count ? test_tokens_rate(lines, count, gc_tokenize_line) : 0;
+        printf("test-tokens %s: %d lines, %d values rounded differently, old %d lines/s, new %d lines/s\n", argv[i], count, inexact, old_rate, new_rate);
+        free(lines);
+    }
+    printf("test-tokens: %d failures\n", failures);
+    return failures;
+}
@@ -0,0 +1,205 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Writes the stress G-code files for planner and stepper work
+#
+#  Grbl_Esp32 is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 3 of the License, or
+#  (at your option) any later version.
+#
+#  Grbl_Esp32 is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with Grbl_Esp32.  If not, see <http://www.gnu.org/licenses/>.
+#
+# Each file comes with a .expected file: the number of lines, where the
+# job must end and the shortest time it can take at the programmed feeds.
+# The native build checks every job of a folder against its .expected file,
+# with the step output simulator, from the repository root:
+#   pio run -e native && .pio/build/native/program test-stress /tmp/stress
+#   - The job must have the expected lines and no errors.
+#   - The steps must end where the planner put the last motion, which must
+#     be the expected end.
+#   - The simulated time must not be shorter than min_time. A much longer
+#     time than an earlier firmware took is a planner or stepper regression,
+#     so compare the printed ratios to min_time between builds.
+# On a device, copy both files to the SD card and run $SD/Simulate=/spiral.nc,
+# which prints the same report, for the settings of that machine.
+# $SD/Bench=/spiral.nc gives the lines, blocks and segments per second.
+#
+# The output only depends on the arguments, so the same arguments give the
+# same files on every host:
+#   python generate.py --out /tmp/stress
+#   python generate.py --out /tmp/stress --tiny-moves 20000 --tiny-step 0.005
+
+from __future__ import print_function
+import os, argparse, math
+
+
+class Job:
+    def __init__(self):
+        self.lines = []
+        self.pos = [0.0, 0.0, 0.0]
+        self.feed = 0.0
+        self.length = 0.0
+        self.min_time = 0.0
+
+    def add(self, line):
+        self.lines.append(line)
+
+    def set_feed(self, feed):
+        self.feed = feed
+        self.add('F%g' % feed)
+
+    # Moves in a straight line. rapid moves count no time, their rate is a setting.
+    def move(self, x, y, z=None, rapid=False, extra=''):
+        z = self.pos[2] if z is None else z
+        words = 'G0' if rapid else 'G1'
+        for letter, old, new in zip('XYZ', self.pos, (x, y, z)):
+            if fmt(new) != fmt(old):
+                words += ' %s%s' % (letter, fmt(new))
+        self.add(words + extra)
+        distance = math.sqrt(sum((new - old) ** 2 for old, new in zip(self.pos, (x, y, z))))
+        self.length += distance
+        if not rapid:
+            self.min_time += distance / self.feed * 60.0
+        self.pos = [float(fmt(x)), float(fmt(y)), float(fmt(z))]
+
+    # Arcs in the XY plane around the center (cx, cy), counter clockwise for a positive angle
+    def arc(self, cx, cy, angle):
+        radius = math.hypot(self.pos[0] - cx, self.pos[1] - cy)
+        start = math.atan2(self.pos[1] - cy, self.pos[0] - cx)
+        x = cx + radius * math.cos(start + angle)
+        y = cy + radius * math.sin(start + angle)
+        self.add('%s X%s Y%s I%s J%s' % ('G3' if angle > 0 else 'G2', fmt(x), fmt(y),
+                                          fmt(cx - self.pos[0]), fmt(cy - self.pos[1])))
+        distance = radius * abs(angle)
+        self.length += distance
+        self.min_time += distance / self.feed * 60.0
+        self.pos = [float(fmt(x)), float(fmt(y)), self.pos[2]]
+
+    def write(self, out, name):
+        with open(os.path.join(out, name + '.nc'), 'w') as f:
+            f.write('\n'.join(self.lines) + '\n')
+        with open(os.path.join(out, name + '.expected'), 'w') as f:
+            f.write('lines %d\n' % len(self.lines))
+            f.write('end X%s Y%s Z%s\n' % tuple(fmt(v) for v in self.pos))
+            f.write('length %.3f mm\n' % self.length)
+            f.write('min_time %.3f sec\n' % self.min_time)
+        print('%s.nc: %d lines, %.1f mm, at least %.1f sec' % (name, len(self.lines), self.length, self.min_time))
+
+
+def fmt(value):
+    text = '%.4f' % value
+    text = text.rstrip('0').rstrip('.')
+    return '0' if text in ('-0', '') else text
+
+
+def start(job):
+    job.add('G21 G90 G17 G94')
+    job.add('G0 X0 Y0 Z0')
+
+
+def end(job):
+    job.add('M5')
+
+
+# Archimedean spiral out from the center, in segments of step mm
+def spiral(args):
+    job = Job()
+    start(job)
+    job.set_feed(args.spiral_feed)
+    pitch = args.spiral_radius / args.spiral_turns
+    theta = 0.0
+    while True:
+        radius = pitch * theta / (2 * math.pi)
+        if radius > args.spiral_radius:
+            break
+        job.move(radius * math.cos(theta), radius * math.sin(theta))
+        # The segment length is about radius * dtheta, away from the center
+        theta += args.spiral_step / max(radius, args.spiral_step)
+    end(job)
+    return job
+
+
+# Back and forth scan lines with a power for each pixel, like a laser image
+def raster(args):
+    job = Job()
+    start(job)
+    job.add('M4 S0')
+    job.set_feed(args.raster_feed)
+    pixels = int(round(args.raster_width / args.raster_pixel))
+    rows = int(round(args.raster_height / args.raster_pixel))
+    for row in range(rows):
+        y = row * args.raster_pixel
+        forward = row % 2 == 0
+        job.move(0 if forward else args.raster_width, y, rapid=True, extra=' S0')
+        for i in range(1, pixels + 1):
+            x = i * args.raster_pixel if forward else args.raster_width - i * args.raster_pixel
+            # Rings of power, so every row changes power often and unevenly
+            r = math.hypot(x - args.raster_width / 2, y - args.raster_height / 2)
+            power = int(500 + 500 * math.sin(r * 2.0))
+            job.move(x, y, extra=' S%d' % power)
+    end(job)
+    return job
+
+
+# Short arcs alternating direction and size, so the arc segmentation and junctions are busy
+def arcs(args):
+    job = Job()
+    start(job)
+    job.set_feed(args.arc_feed)
+    for i in range(args.arc_count):
+        radius = args.arc_radius * (1 + (i % 7)) / 7.0
+        direction = 1 if i % 2 == 0 else -1
+        # Center on the line ahead, so every arc ends farther along X
+        cx = job.pos[0] + radius
+        cy = job.pos[1]
+        job.arc(cx, cy, direction * math.pi)
+        if job.pos[0] > 200:
+            job.move(0, job.pos[1] + args.arc_radius * 2, rapid=True)
+    end(job)
+    return job
+
+
+# Thousands of very short zig-zag moves. At the feed, they come faster than the planner can plan them
+def tiny(args):
+    job = Job()
+    start(job)
+    job.set_feed(args.tiny_feed)
+    for i in range(args.tiny_moves):
+        x = (i + 1) * args.tiny_step
+        y = args.tiny_step if i % 2 == 0 else 0.0
+        job.move(x, y)
+    end(job)
+    moves_per_sec = args.tiny_feed / 60.0 / (args.tiny_step * math.sqrt(2))
+    print('tiny.nc asks for %.0f moves/sec' % moves_per_sec)
+    return job
+
+
+parser = argparse.ArgumentParser(description='Writes the stress G-code files and their expected results')
+parser.add_argument('--out', default='.', help='folder for the files')
+parser.add_argument('--spiral-radius', type=float, default=40.0, help='mm')
+parser.add_argument('--spiral-turns', type=int, default=40)
+parser.add_argument('--spiral-step', type=float, default=0.05, help='segment length, mm')
+parser.add_argument('--spiral-feed', type=float, default=3000.0, help='mm/min')
+parser.add_argument('--raster-width', type=float, default=50.0, help='mm')
+parser.add_argument('--raster-height', type=float, default=20.0, help='mm')
+parser.add_argument('--raster-pixel', type=float, default=0.1, help='mm')
+parser.add_argument('--raster-feed', type=float, default=6000.0, help='mm/min')
+parser.add_argument('--arc-count', type=int, default=2000)
+parser.add_argument('--arc-radius', type=float, default=1.0, help='largest radius, mm')
+parser.add_argument('--arc-feed', type=float, default=2000.0, help='mm/min')
+parser.add_argument('--tiny-moves', type=int, default=5000)
+parser.add_argument('--tiny-step', type=float, default=0.01, help='mm')
+parser.add_argument('--tiny-feed', type=float, default=1200.0, help='mm/min')
+args = parser.parse_args()
+
+if not os.path.isdir(args.out):
+    os.makedirs(args.out)
+for name, generate in (('spiral', spiral), ('raster', raster), ('arcs', arcs), ('tiny', tiny)):
+    generate(args).write(args.out, name)
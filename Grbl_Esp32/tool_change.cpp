@@ -0,0 +1,142 @@
+/*
+  tool_change.cpp - the M6 tool change sequence, run on the controller
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef TOOL_CHANGE_SEQUENCE
+
+// The sequence, with the positions in machine coordinates from the $ToolChange/ settings:
+//   1. Rapid up to ToolChange/Z, then stop the spindle and coolant.
+//   2. Rapid over to ToolChange/X,Y. With USE_TOOL_CHANGE, user_tool_change() actuates the
+//      changer, and otherwise the machine holds, as at M0, until a cycle start.
+//   3. With ToolChange/Probe, rapid to ToolChange/Probe/X,Y and down to ToolChange/Probe/Z, probe
+//      down by ToolChange/Probe/Depth, and take the tool length offset from the hit, relative to
+//      ToolChange/Probe/Reference. A reference of 0 is taken from the first hit, for an offset
+//      of 0. With TOOL_TABLE, a tool with a length in the table is not probed again, and the
+//      probed length is written to the table.
+//   4. Rapid up to ToolChange/Z, over to the start, restore the spindle and coolant, and rapid
+//      down to the start.
+// The moves are planned as rapids from the parser, like G28, so there is no wait for the host.
+// They are synced where the spindle, the changer or the probe need the machine stopped.
+
+static int16_t loaded_tool = -1; // Unknown until the first change
+
+// Rapids to target, and waits for the machine to get there. Returns false on a reset or an alarm.
+static bool tool_change_move(float* target) {
+    plan_line_data_t plan_data;
+    memset(&plan_data, 0, sizeof(plan_line_data_t));
+    plan_data.condition = PL_COND_FLAG_RAPID_MOTION;
+    mc_line(target, &plan_data);
+    protocol_buffer_synchronize();
+    return !sys.abort && sys.state != STATE_ALARM;
+}
+
+// Probes the new tool, and returns false if the probe missed
+static bool tool_change_probe(float* position, float* length) {
+    position[X_AXIS] = tool_change_probe_x->get();
+    position[Y_AXIS] = tool_change_probe_y->get();
+    if (!tool_change_move(position))
+        return false;
+    position[Z_AXIS] = tool_change_probe_z->get();
+    if (!tool_change_move(position))
+        return false;
+    position[Z_AXIS] -= tool_change_probe_depth->get();
+    plan_line_data_t plan_data;
+    memset(&plan_data, 0, sizeof(plan_line_data_t));
+    plan_data.feed_rate = tool_change_probe_feed->get();
+    if (mc_probe_cycle(position, &plan_data, 0) != GC_PROBE_FOUND)
+        return false;
+    float hit[N_AXIS];
+    probe_get_position(hit);
+    system_convert_array_steps_to_mpos(position, sys_position); // Where the probe cycle stopped
+    float reference = tool_change_probe_reference->get();
+    if (reference == 0.0f) {
+        char value[20];
+        snprintf(value, sizeof(value), "%.3f", hit[Z_AXIS]);
+        tool_change_probe_reference->setStringValue(value);
+        reference = tool_change_probe_reference->get();
+    }
+    *length = hit[Z_AXIS] - reference;
+    return true;
+}
+
+void tool_change_run(uint8_t tool) {
+    if (sys.state == STATE_CHECK_MODE || tool == loaded_tool)
+        return;
+    protocol_buffer_synchronize();
+    if (sys.abort)
+        return;
+    float start[N_AXIS];
+    memcpy(start, gc_state.position, sizeof(start));
+    float position[N_AXIS];
+    memcpy(position, start, sizeof(position));
+    position[Z_AXIS] = tool_change_z->get();
+    if (!tool_change_move(position))
+        return;
+    spindle->spindle_sync(SPINDLE_DISABLE, 0);
+    coolant_sync(COOLANT_DISABLE);
+    position[X_AXIS] = tool_change_x->get();
+    position[Y_AXIS] = tool_change_y->get();
+    if (!tool_change_move(position))
+        return;
+#ifdef USE_TOOL_CHANGE
+    user_tool_change(tool);
+#else
+    grbl_msg_sendf(CLIENT_ALL, MSG_LEVEL_INFO, "Load tool %d, then cycle start", tool);
+    system_set_exec_state_flag(EXEC_FEED_HOLD);
+    protocol_execute_realtime(); // Held until the cycle start
+    if (sys.abort)
+        return;
+#endif
+    loaded_tool = tool;
+    if (tool_change_probe_enable->get()) {
+        float length = 0.0f;
+        bool known = false;
+#ifdef TOOL_TABLE
+        tool_entry_t entry;
+        known = tool_table_get(tool, &entry) && entry.length != 0.0f;
+        length = entry.length;
+#endif
+        if (!known) {
+            if (!tool_change_probe(position, &length))
+                return;
+#ifdef TOOL_TABLE
+            if (tool < TOOL_TABLE_SIZE) {
+                entry.length = length;
+                tool_table_set(tool, &entry);
+            }
+#endif
+        }
+        gc_state.modal.tool_length = TOOL_LENGTH_OFFSET_ENABLE_DYNAMIC;
+        gc_state.tool_length_offset = length;
+        system_flag_wco_change();
+    }
+    position[Z_AXIS] = tool_change_z->get();
+    if (!tool_change_move(position))
+        return;
+    position[X_AXIS] = start[X_AXIS];
+    position[Y_AXIS] = start[Y_AXIS];
+    if (!tool_change_move(position))
+        return;
+    // The spindle is up to speed, as after M3, before the tool goes back down
+    spindle->spindle_sync(gc_state.modal.spindle, (uint32_t)gc_state.spindle_speed);
+    coolant_sync(gc_state.modal.coolant);
+    tool_change_move(start);
+}
+
+#endif
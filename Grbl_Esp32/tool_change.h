@@ -0,0 +1,35 @@
+/*
+  tool_change.h - the M6 tool change sequence, run on the controller
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef tool_change_h
+#define tool_change_h
+
+#if defined(TOOL_CHANGE_SEQUENCE) && (TOOL_LENGTH_OFFSET_AXIS != Z_AXIS)
+    #error "TOOL_CHANGE_SEQUENCE retracts and probes along Z, so TOOL_LENGTH_OFFSET_AXIS must be Z_AXIS"
+#endif
+
+#ifdef TOOL_CHANGE_SEQUENCE
+
+// Changes to tool, from the parser at M6. Returns once the machine is back where it was, with
+// the spindle and coolant as they were and, if probed, the new tool length offset. Failures,
+// like a missed probe, end it with an alarm or a reset.
+void tool_change_run(uint8_t tool);
+
+#endif
+
+#endif
@@ -0,0 +1,93 @@
+/*
+  tool_table.cpp - lengths and diameters of the tools, kept in RAM and stored in NVS
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#ifdef TOOL_TABLE
+
+// The table is read from RAM, by G43 Hn in the parser. G10 L1 writes an entry to RAM and marks
+// it, and the marked entries are stored from the main loop once motion stops, each as a blob
+// "T<n>" next to the coordinate data. A flash write turns off the flash cache, which holds off
+// the stepper ISR, so it is never done mid-motion. A reset or power loss before the machine is
+// idle loses the pending entries. Tools without a blob have a length and diameter of 0.
+
+static tool_entry_t tools[TOOL_TABLE_SIZE];
+static uint32_t pending[(TOOL_TABLE_SIZE + 31) / 32];
+static bool any_pending = false;
+static nvs_handle tool_handle = 0;
+
+static void tool_table_key(uint8_t tool, char* key) {
+    sprintf(key, "T%d", tool);
+}
+
+void tool_table_init() {
+    if (esp_err_t err = nvs_open("Grbl_ESP32", NVS_READWRITE, &tool_handle)) {
+        grbl_sendf(CLIENT_SERIAL, "nvs_open failed with error %d\r\n", err);
+        return;
+    }
+    for (uint8_t tool = 0; tool < TOOL_TABLE_SIZE; tool++) {
+        char key[8];
+        tool_table_key(tool, key);
+        size_t len = sizeof(tool_entry_t);
+        if (nvs_get_blob(tool_handle, key, &tools[tool], &len) != ESP_OK || len != sizeof(tool_entry_t))
+            memset(&tools[tool], 0, sizeof(tool_entry_t));
+    }
+}
+
+bool tool_table_get(uint8_t tool, tool_entry_t* entry) {
+    if (tool >= TOOL_TABLE_SIZE)
+        return false;
+    *entry = tools[tool];
+    return true;
+}
+
+void tool_table_set(uint8_t tool, const tool_entry_t* entry) {
+    if (tool >= TOOL_TABLE_SIZE)
+        return;
+    tools[tool] = *entry;
+    pending[tool / 32] |= bit(tool % 32);
+    any_pending = true;
+}
+
+void tool_table_flush() {
+    if (!any_pending || settings_motion_active())
+        return;
+    any_pending = false;
+    for (uint8_t tool = 0; tool < TOOL_TABLE_SIZE; tool++) {
+        if (!(pending[tool / 32] & bit(tool % 32)))
+            continue;
+        pending[tool / 32] &= ~bit(tool % 32);
+        char key[8];
+        tool_table_key(tool, key);
+        if (nvs_set_blob(tool_handle, key, &tools[tool], sizeof(tool_entry_t)) != ESP_OK)
+            grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Cannot store %s", key);
+    }
+    if (nvs_commit(tool_handle) != ESP_OK)
+        grbl_msg_sendf(CLIENT_SERIAL, MSG_LEVEL_INFO, "Cannot store the tool table");
+}
+
+void tool_table_report(uint8_t client) {
+    float scale = report_inches->get() ? INCH_PER_MM : 1.0f;
+    for (uint8_t tool = 0; tool < TOOL_TABLE_SIZE; tool++) {
+        if (tools[tool].length == 0.0f && tools[tool].diameter == 0.0f)
+            continue;
+        grbl_sendf(client, "[TT:%d:%4.3f,%4.3f]\r\n", tool, tools[tool].length * scale, tools[tool].diameter * scale);
+    }
+}
+
+#endif
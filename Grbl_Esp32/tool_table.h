@@ -0,0 +1,52 @@
+/*
+  tool_table.h - lengths and diameters of the tools, kept in RAM and stored in NVS
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef tool_table_h
+#define tool_table_h
+
+#ifdef TOOL_TABLE
+
+// Tools T0 to T(TOOL_TABLE_SIZE - 1) have an entry
+#ifndef TOOL_TABLE_SIZE
+    #define TOOL_TABLE_SIZE 32
+#endif
+
+typedef struct {
+    float length;   // mm, along TOOL_LENGTH_OFFSET_AXIS
+    float diameter; // mm
+} tool_entry_t;
+
+// Loads the table from NVS into RAM. Called once at boot.
+void tool_table_init();
+
+// Returns false for a tool outside the table
+bool tool_table_get(uint8_t tool, tool_entry_t* entry);
+
+// Writes the entry to RAM at once. It is stored in NVS by tool_table_flush(), once the
+// machine has stopped.
+void tool_table_set(uint8_t tool, const tool_entry_t* entry);
+
+// Stores the entries written since the last call, unless motion runs. Called from the main loop.
+void tool_table_flush();
+
+// Sends a [TT:tool:length,diameter] line for each tool with an entry, in the report units
+void tool_table_report(uint8_t client);
+
+#endif
+
+#endif
@@ -0,0 +1,195 @@
+/*
+  udp_realtime.cpp - an authenticated UDP port for the realtime commands
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#if defined(ENABLE_WIFI) && defined(UDP_REALTIME)
+
+#include <lwip/sockets.h>
+#include <mbedtls/md.h>
+
+// Feed hold, resume, reset and the overrides sent on telnet or the TCP stream wait behind the
+// job lines sent before them. This port takes them alone, in their own task, which runs them
+// with execute_realtime_command() as soon as the datagram arrives. Each request is answered
+// with a status frame, so a pendant sees the effect in the same round trip. The datagrams are
+// described in udp_realtime.h. The sessions and sequence numbers keep a captured request from
+// being run again, also after a reset. A request whose reply was lost may be sent again with
+// a new sequence number, but then its commands run twice, so only resend those that are safe
+// to repeat, like a feed hold.
+
+typedef struct {
+    uint32_t session; // 0 when the slot is free
+    uint32_t sequence; // Of the last request run
+    uint32_t used_ms;
+} udp_session_t;
+
+static volatile bool udp_open = false; // The socket is opened and closed by the task
+static TaskHandle_t udp_task = NULL;
+static char udp_key[MAX_UDP_REALTIME_KEY_LENGTH + 1];
+static size_t udp_key_length;
+static udp_session_t udp_sessions[UDP_REALTIME_SESSIONS];
+
+static uint32_t udp_get32(const uint8_t* pos) {
+    return pos[0] | (pos[1] << 8) | (pos[2] << 16) | ((uint32_t)pos[3] << 24);
+}
+
+static void udp_put32(uint8_t* pos, uint32_t value) {
+    for (uint8_t i = 0; i < 4; i++, value >>= 8)
+        pos[i] = value & 0xFF;
+}
+
+static void udp_tag(const uint8_t* data, size_t length, uint8_t* tag) {
+    uint8_t hmac[32];
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const uint8_t*)udp_key, udp_key_length, data, length, hmac);
+    memcpy(tag, hmac, UDP_REALTIME_TAG_SIZE);
+}
+
+// Compares in a time that does not depend on where the tags differ
+static bool udp_tag_matches(const uint8_t* a, const uint8_t* b) {
+    uint8_t diff = 0;
+    for (uint8_t i = 0; i < UDP_REALTIME_TAG_SIZE; i++)
+        diff |= a[i] ^ b[i];
+    return diff == 0;
+}
+
+// The open session, or a new one in the place of the least recently used
+static udp_session_t* udp_session(uint32_t session, bool* opened) {
+    udp_session_t* slot = NULL;
+    *opened = false;
+    for (uint8_t i = 0; i < UDP_REALTIME_SESSIONS; i++) {
+        udp_session_t* s = &udp_sessions[i];
+        if (session != 0 && s->session == session)
+            return s;
+        if (slot == NULL || (slot->session != 0 && (s->session == 0 || (int32_t)(s->used_ms - slot->used_ms) < 0)))
+            slot = s;
+    }
+    do
+        slot->session = esp_random();
+    while (slot->session == 0);
+    slot->sequence = 0;
+    *opened = true;
+    return slot;
+}
+
+static void udp_run(const uint8_t* commands, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint8_t command = commands[i];
+        // Every request is answered with a status frame, and other bytes are not realtime commands
+        if (command == CMD_STATUS_REPORT || command == CMD_STATUS_FRAME || !is_realtime_command(command))
+            continue;
+        execute_realtime_command(command, CLIENT_ALL);
+    }
+}
+
+static int udp_open_socket() {
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0)
+        return -1;
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(UDP_REALTIME_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    // The task wakes up now and then, so udp_realtime_end() is noticed
+    struct timeval timeout = { 0, 100000 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static void udpRealtimeTask(void* pvParameters) {
+    uint8_t request[UDP_REALTIME_HEADER_SIZE + UDP_REALTIME_MAX_COMMANDS + UDP_REALTIME_TAG_SIZE];
+    uint8_t reply[UDP_REALTIME_REPLY_SIZE];
+    uint8_t tag[UDP_REALTIME_TAG_SIZE];
+    int sock = -1;
+    while (true) {
+        if (!udp_open) {
+            if (sock >= 0) {
+                close(sock);
+                sock = -1;
+            }
+            vTaskDelay(pdMS_TO_TICKS(100));
+            continue;
+        }
+        if (sock < 0) {
+            sock = udp_open_socket();
+            if (sock < 0) {
+                grbl_send(CLIENT_ALL, "[MSG:UDP realtime failed to start]\r\n");
+                udp_open = false;
+                continue;
+            }
+            memset(udp_sessions, 0, sizeof(udp_sessions));
+            grbl_sendf(CLIENT_ALL, "[MSG:UDP realtime Started %d]\r\n", UDP_REALTIME_PORT);
+        }
+        struct sockaddr_in from;
+        socklen_t from_length = sizeof(from);
+        int length = recvfrom(sock, request, sizeof(request), 0, (struct sockaddr*)&from, &from_length);
+        if (length < UDP_REALTIME_HEADER_SIZE + UDP_REALTIME_TAG_SIZE || request[0] != 'G' || request[1] != 'R')
+            continue; // Timed out, or not ours
+        size_t signed_length = length - UDP_REALTIME_TAG_SIZE;
+        udp_tag(request, signed_length, tag);
+        if (!udp_tag_matches(tag, request + signed_length))
+            continue; // Not answered, so the port gives nothing away to a sender without the key
+        uint32_t sequence = udp_get32(request + 6);
+        bool opened;
+        udp_session_t* session = udp_session(udp_get32(request + 2), &opened);
+        if (!opened) {
+            if ((int32_t)(sequence - session->sequence) <= 0)
+                continue; // Already run
+            session->sequence = sequence;
+            udp_run(request + UDP_REALTIME_HEADER_SIZE, signed_length - UDP_REALTIME_HEADER_SIZE);
+        }
+        session->used_ms = millis();
+        reply[0] = 'G';
+        reply[1] = 'S';
+        udp_put32(reply + 2, session->session);
+        udp_put32(reply + 6, sequence);
+        report_build_status_frame(reply + UDP_REALTIME_HEADER_SIZE, 0);
+        udp_tag(reply, UDP_REALTIME_REPLY_SIZE - UDP_REALTIME_TAG_SIZE, reply + UDP_REALTIME_REPLY_SIZE - UDP_REALTIME_TAG_SIZE);
+        sendto(sock, reply, sizeof(reply), 0, (struct sockaddr*)&from, from_length);
+    }
+}
+
+bool udp_realtime_key_valid(char* key) {
+    if (strlen(key) > MAX_UDP_REALTIME_KEY_LENGTH)
+        return false;
+    return strchr(key, ' ') == NULL;
+}
+
+void udp_realtime_begin() {
+    udp_realtime_end();
+    strncpy(udp_key, udp_realtime_key->get(), MAX_UDP_REALTIME_KEY_LENGTH);
+    udp_key[MAX_UDP_REALTIME_KEY_LENGTH] = '\0';
+    udp_key_length = strlen(udp_key);
+    if (udp_key_length == 0)
+        return; // Without a key anybody on the network could stop the machine
+    if (udp_task == NULL) {
+        // Made once and kept, as begin() and end() follow the WiFi mode
+        task_create(TASK_UDP_REALTIME, udpRealtimeTask, UDP_REALTIME_TASK_STACK, NULL, &udp_task);
+    }
+    udp_open = udp_task != NULL;
+}
+
+void udp_realtime_end() {
+    udp_open = false;
+}
+
+#endif
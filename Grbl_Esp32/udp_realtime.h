@@ -0,0 +1,75 @@
+/*
+  udp_realtime.h - an authenticated UDP port for the realtime commands
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef udp_realtime_h
+#define udp_realtime_h
+
+#if defined(UDP_REALTIME) && !defined(REPORT_STATUS_FRAMES)
+    #error "UDP_REALTIME needs REPORT_STATUS_FRAMES"
+#endif
+#if defined(UDP_REALTIME) && !defined(ENABLE_WIFI)
+    #error "UDP_REALTIME needs ENABLE_WIFI"
+#endif
+
+#ifdef UDP_REALTIME
+
+#ifndef UDP_REALTIME_PORT
+    #define UDP_REALTIME_PORT 8025
+#endif
+
+// Senders that can hold a session at the same time. The least recently used one is dropped
+// for a new one.
+#ifndef UDP_REALTIME_SESSIONS
+    #define UDP_REALTIME_SESSIONS 4
+#endif
+
+// Most realtime commands in one datagram
+#ifndef UDP_REALTIME_MAX_COMMANDS
+    #define UDP_REALTIME_MAX_COMMANDS 32
+#endif
+
+#ifndef UDP_REALTIME_TASK_STACK
+    #define UDP_REALTIME_TASK_STACK 4096
+#endif
+
+// The datagrams, little endian. The tag is the first UDP_REALTIME_TAG_SIZE bytes of the
+// HMAC-SHA256 of the bytes before it, keyed with $UDP/Key.
+//   Request: 'G' 'R', uint32 session, uint32 sequence, realtime command bytes, tag
+//   Reply:   'G' 'S', uint32 session, uint32 sequence of the request, status frame, tag
+// The status frame is the binary frame of REPORT_STATUS_FRAMES, see report.h. A request with
+// a session that is not open, like 0 for the first one, runs no commands. Its reply carries a
+// new session to use. The sequence must grow within a session, so a request is run once.
+#define UDP_REALTIME_TAG_SIZE 8
+#define UDP_REALTIME_HEADER_SIZE 10
+#define UDP_REALTIME_REPLY_SIZE (UDP_REALTIME_HEADER_SIZE + STATUS_FRAME_SIZE + UDP_REALTIME_TAG_SIZE)
+
+#define DEFAULT_UDP_REALTIME_KEY ""
+#define MIN_UDP_REALTIME_KEY_LENGTH 0
+#define MAX_UDP_REALTIME_KEY_LENGTH 64
+
+// The checker of $UDP/Key. Its value is hidden like the passwords.
+bool udp_realtime_key_valid(char* key);
+
+// Opens the port if $UDP/Key is set. The key is read here, so a new key is used from the next
+// start of the network services.
+void udp_realtime_begin();
+void udp_realtime_end();
+
+#endif
+
+#endif
@@ -42,6 +42,10 @@
 #include <StreamString.h>
 #include <Update.h>
 #include <esp_wifi_types.h>
+#include <esp_heap_caps.h>
+#ifdef WEB_CACHE_STATIC
+#include <MD5Builder.h>
+#endif
 #ifdef ENABLE_MDNS
 #include <ESPmDNS.h>
 #endif
@@ -89,11 +93,165 @@ long Web_Server::_id_connection = 0;
 uint8_t Web_Server::_upload_status = UPLOAD_STATUS_NONE;
 WebServer * Web_Server::_webserver = NULL;
 WebSocketsServer * Web_Server::_socket_server = NULL;
+#ifdef WEB_SERVER_TASK
+TaskHandle_t Web_Server::_task = NULL;
+volatile bool Web_Server::_task_stop = false;
+#endif
+#ifdef ENABLE_CAPTIVE_PORTAL
+TaskHandle_t Web_Server::_dns_task = NULL;
+volatile bool Web_Server::_dns_task_stop = false;
+#endif
+#ifdef WEB_REQUEST_ARENA
+Arena web_arena(WEB_ARENA_SIZE);
+#endif
+#ifdef SPIFFS_LIST_CACHE
+bool Web_Server::_spiffs_list_valid = false;
+String Web_Server::_spiffs_list_path;
+#endif
 #ifdef ENABLE_AUTHENTICATION
-auth_ip * Web_Server::_head = NULL;
+auth_ip Web_Server::_sessions[AUTH_SESSION_SLOTS];
 uint8_t Web_Server::_nb_ip = 0;
 #define MAX_AUTH_IP 10
+#define AUTH_TIMEOUT_MS 360000
+#if (AUTH_SESSION_SLOTS & (AUTH_SESSION_SLOTS - 1)) || (AUTH_SESSION_SLOTS <= MAX_AUTH_IP)
+    #error "AUTH_SESSION_SLOTS must be a power of two above MAX_AUTH_IP"
+#endif
+#endif
+
+#ifdef WEB_CACHE_STATIC
+// The ETag of the embedded page changes with each build of the firmware
+#define NOFILES_ETAG "\"" GRBL_VERSION_BUILD "-" __DATE__ "-" __TIME__ "\""
+
+// ETags of SPIFFS files, the MD5 of their content. SPIFFS keeps no modification time, so the hash
+// is taken the first time a file is served and the slots are emptied whenever SPIFFS is written.
+typedef struct {
+    String path;
+    size_t size;
+    String etag;
+} etag_slot_t;
+static etag_slot_t etag_slots[WEB_CACHE_ETAG_SLOTS];
+static uint8_t etag_next_slot = 0;
+
+// Returns the ETag of an open SPIFFS file and rewinds it.
+static String spiffs_etag(const String& path, File& file) {
+    size_t size = file.size();
+    for (uint8_t i = 0; i < WEB_CACHE_ETAG_SLOTS; i++) {
+        if (etag_slots[i].path == path && etag_slots[i].size == size)
+            return etag_slots[i].etag;
+    }
+    MD5Builder md5;
+    md5.begin();
+    md5.addStream(file, size);
+    md5.calculate();
+    file.seek(0);
+    etag_slot_t* slot = &etag_slots[etag_next_slot];
+    etag_next_slot = (etag_next_slot + 1) % WEB_CACHE_ETAG_SLOTS;
+    slot->path = path;
+    slot->size = size;
+    slot->etag = "\"" + md5.toString() + "\"";
+    return slot->etag;
+}
+#endif
+
+// Forgets what is cached about SPIFFS files. Called when SPIFFS is written.
+void Web_Server::spiffs_changed() {
+#ifdef WEB_CACHE_STATIC
+    for (uint8_t i = 0; i < WEB_CACHE_ETAG_SLOTS; i++) {
+        etag_slots[i].path = "";
+        etag_slots[i].etag = "";
+    }
+#endif
+#ifdef SPIFFS_LIST_CACHE
+    _spiffs_list_valid = false;
+#endif
+#ifdef WEBUI_PARTITION
+    webui_partition_changed();
 #endif
+}
+
+// Sends the caching headers for etag. Returns true and replies 304 if the browser has this version.
+bool Web_Server::send_not_modified(const String& etag) {
+#ifdef WEB_CACHE_STATIC
+    _webserver->sendHeader("ETag", etag);
+    _webserver->sendHeader("Cache-Control", "max-age=" + String(WEB_CACHE_MAX_AGE));
+    if (_webserver->header("If-None-Match") == etag) {
+        _webserver->send(304);
+        return true;
+    }
+#endif
+    return false;
+}
+
+// Streams a SPIFFS file, or replies 304 if the browser already has it.
+void Web_Server::stream_spiffs_file(const String& path, const String& contentType) {
+    File file = SPIFFS.open(path, FILE_READ);
+#ifdef WEB_CACHE_STATIC
+    if (file && send_not_modified(spiffs_etag(path, file))) {
+        file.close();
+        return;
+    }
+#endif
+    _webserver->streamFile(file, contentType);
+    file.close();
+}
+#ifdef WEBUI_PARTITION
+// Sends the WebUI page from the mapped partition, the whole page or the byte range the browser
+// asked for. Returns false when the partition has no page, to fall back on SPIFFS.
+bool Web_Server::send_webui_partition() {
+    size_t size;
+    const char* etag;
+    const uint8_t* page = webui_partition_get(&size, &etag);
+    if (page == NULL || size == 0)
+        return false;
+    if (send_not_modified(etag))
+        return true;
+    size_t first = 0;
+    size_t last = size - 1;
+    bool partial = false;
+    String range = _webserver->header("Range");
+    if (range.startsWith("bytes=") && range.indexOf(',') < 0) {
+        // bytes=first-last, bytes=first- or bytes=-suffix
+        const char* spec = range.c_str() + 6;
+        char* end;
+        partial = true;
+        if (*spec == '-') {
+            size_t suffix = strtoul(spec + 1, &end, 10);
+            if (suffix == 0)
+                partial = false;
+            else
+                first = suffix < size ? size - suffix : 0;
+        } else {
+            first = strtoul(spec, &end, 10);
+            if (*end == '-' && isdigit(end[1]))
+                last = strtoul(end + 1, &end, 10);
+            if (last >= size)
+                last = size - 1;
+        }
+        if (partial && first > last) {
+            _webserver->sendHeader("Content-Range", "bytes */" + String(size));
+            _webserver->send(416);
+            return true;
+        }
+    }
+    _webserver->sendHeader("Content-Encoding", "gzip");
+    _webserver->sendHeader("Accept-Ranges", "bytes");
+    if (partial)
+        _webserver->sendHeader("Content-Range", "bytes " + String(first) + "-" + String(last) + "/" + String(size));
+    _webserver->setContentLength(last - first + 1);
+    _webserver->send(partial ? 206 : 200, "text/html", "");
+    WiFiClient client = _webserver->client();
+    for (size_t pos = first; pos <= last;) {
+        size_t len = last + 1 - pos;
+        if (len > WEBUI_PARTITION_CHUNK)
+            len = WEBUI_PARTITION_CHUNK;
+        if (client.write(page + pos, len) != len)
+            break; // The browser went away
+        pos += len;
+    }
+    return true;
+}
+#endif
+
 Web_Server::Web_Server(){
     
 }
@@ -114,11 +272,24 @@ bool Web_Server::begin(){
     }
     _port = http_port->get();
 
+#ifdef WEBUI_PARTITION
+    webui_partition_begin();
+#endif
     //create instance
     _webserver= new WebServer(_port);
-#ifdef ENABLE_AUTHENTICATION
+#if defined(ENABLE_AUTHENTICATION) || defined(WEB_CACHE_STATIC) || defined(WEBUI_PARTITION)
     //here the list of headers to be recorded
-    const char * headerkeys[] = {"Cookie"} ;
+    const char * headerkeys[] = {
+#ifdef ENABLE_AUTHENTICATION
+        "Cookie",
+#endif
+#ifdef WEB_CACHE_STATIC
+        "If-None-Match",
+#endif
+#ifdef WEBUI_PARTITION
+        "Range",
+#endif
+    };
     size_t headerkeyssize = sizeof (headerkeys) / sizeof (char*);
     //ask server to track these headers
     _webserver->collectHeaders (headerkeys, headerkeyssize );
@@ -160,6 +331,16 @@ bool Web_Server::begin(){
     
     //web update
     _webserver->on ("/updatefw", HTTP_ANY, handleUpdate, WebUpdateUpload);
+
+#ifdef SPINDLE_CAPTURE
+    _webserver->on ("/spindle_capture.csv", HTTP_GET, handle_spindle_capture);
+#endif
+#ifdef EVENT_TRACE
+    _webserver->on ("/trace.json", HTTP_GET, handle_trace);
+#endif
+#ifdef WEB_METRICS
+    _webserver->on ("/metrics", HTTP_GET, handle_metrics);
+#endif
         
 #ifdef ENABLE_SD_CARD    
     //Direct SD management
@@ -172,6 +353,8 @@ bool Web_Server::begin(){
         // if DNSServer is started with "*" for domain name, it will reply with
         // provided IP to all DNS request
         dnsServer.start(DNS_PORT, "*", WiFi.softAPIP());
+        _dns_task_stop = false;
+        task_create(TASK_CAPTIVE_PORTAL, captivePortalTask, CAPTIVE_PORTAL_TASK_STACK, NULL, &_dns_task);
         grbl_send(CLIENT_ALL,"[MSG:Captive Portal Started]\r\n");
         _webserver->on ("/generate_204", HTTP_ANY,  handle_root);
         _webserver->on ("/gconnectivitycheck.gstatic.com", HTTP_ANY, handle_root);
@@ -213,14 +396,67 @@ bool Web_Server::begin(){
     }
 #endif
     _setupdone = true;
+#ifdef WEB_SERVER_TASK
+    _task_stop = false;
+    task_create(TASK_WEB_SERVER, webServerTask, WEB_SERVER_TASK_STACK, NULL, &_task);
+#endif
    return no_error;
 }
 
+#ifdef WEB_SERVER_TASK
+//Serves the HTTP and websocket clients on core 0, so a long request like a file download or an
+//upload only holds up this task and not the reading of the G-code clients
+void Web_Server::webServerTask(void* pvParameters) {
+    while (!_task_stop) {
+        web_server.handle();
+        vTaskDelay(WEB_SERVER_TASK_PERIOD_MS / portTICK_PERIOD_MS);
+    }
+    _task = NULL;
+    vTaskDelete(NULL);
+}
+#endif
+
+#ifdef ENABLE_CAPTIVE_PORTAL
+//Answers the DNS queries of the AP clients, so the main loop does not poll for them. The task
+//only exists in AP mode, from begin() to end().
+void Web_Server::captivePortalTask(void* pvParameters) {
+    while (!_dns_task_stop) {
+    #ifdef WIFI_POWER_POLICY
+        //the portal is for setting up, the DNS queries wait while the machine is busy
+        if (!wifi_config.isMachineBusy())
+    #endif
+            dnsServer.processNextRequest();
+        vTaskDelay(CAPTIVE_PORTAL_PERIOD_MS / portTICK_PERIOD_MS);
+    }
+    _dns_task = NULL;
+    vTaskDelete(NULL);
+}
+#endif
+
 void Web_Server::end(){
     _setupdone = false;
+#ifdef ENABLE_CAPTIVE_PORTAL
+    if (_dns_task != NULL) {
+        _dns_task_stop = true;
+        while (_dns_task != NULL) {
+            vTaskDelay(1);
+        }
+    }
+    dnsServer.stop();
+#endif
+#ifdef WEB_SERVER_TASK
+    _task_stop = true;
+    //wait for the task to leave the server, unless it is the one ending it
+    while (_task != NULL && _task != xTaskGetCurrentTaskHandle()) {
+        vTaskDelay(1);
+    }
+#endif
 #ifdef ENABLE_SSDP
     SSDP.end();
 #endif //ENABLE_SSDP
+#ifdef WEBUI_PARTITION
+    webui_partition_end();
+#endif
 #ifdef ENABLE_MDNS
     //remove mDNS
     mdns_service_remove("_http", "_tcp");
@@ -234,11 +470,7 @@ void Web_Server::end(){
         _webserver = NULL;
     }
 #ifdef ENABLE_AUTHENTICATION
-    while (_head) {
-        auth_ip * current = _head;
-        _head = _head->_next;
-        delete current;
-    }
+    memset(_sessions, 0, sizeof(_sessions));
     _nb_ip = 0;
 #endif
 }
@@ -250,21 +482,155 @@ void Web_Server::handle_root()
     String path = "/index.html";
     String contentType =  getContentType(path);
     String pathWithGz = path + ".gz";
+#ifdef WEBUI_PARTITION
+    if (!_webserver->hasArg("forcefallback") && send_webui_partition())
+        return;
+#endif
     //if have a index.html or gzip version this is default root page
     if((SPIFFS.exists(pathWithGz) || SPIFFS.exists(path)) && !_webserver->hasArg("forcefallback") && _webserver->arg("forcefallback")!="yes") {
         if(SPIFFS.exists(pathWithGz)) {
             path = pathWithGz;
         }
-		File file = SPIFFS.open(path, FILE_READ);
-        _webserver->streamFile(file, contentType);
-        file.close();
+        stream_spiffs_file(path, contentType);
         return;
     }
-    //if no lets launch the default content
+    //if no lets launch the default content, straight from flash
+#ifdef WEB_CACHE_STATIC
+    if (send_not_modified(NOFILES_ETAG))
+        return;
+#endif
     _webserver->sendHeader("Content-Encoding", "gzip");
     _webserver->send_P(200,"text/html",PAGE_NOFILES,PAGE_NOFILES_SIZE);
 }
 
+#ifdef SPINDLE_CAPTURE
+//Spindle capture records as CSV, see $Spindle/Capture
+void Web_Server::handle_spindle_capture()
+{
+    if (is_authenticated() == LEVEL_GUEST) {
+        _webserver->send (401, "text/plain", "Authentication failed!\n");
+        return;
+    }
+    // The lines are gathered in a stack buffer and sent in chunks, so no String is made per line
+    char chunk[512];
+    size_t len = 0;
+    char line[48];
+    uint16_t count = spindle_capture_hold();
+    _webserver->setContentLength(CONTENT_LENGTH_UNKNOWN);
+    _webserver->sendHeader("Cache-Control", "no-cache");
+    _webserver->send(200, "text/csv", "");
+    _webserver->sendContent(spindle_capture_header);
+    _webserver->sendContent("\r\n");
+    for (uint16_t i = 0; i < count && spindle_capture_csv(i, line, sizeof(line)); i++) {
+        size_t line_len = strlen(line);
+        if (len + line_len > sizeof(chunk)) {
+            _webserver->sendContent_P(chunk, len);
+            len = 0;
+        }
+        memcpy(&chunk[len], line, line_len);
+        len += line_len;
+    }
+    if (len > 0)
+        _webserver->sendContent_P(chunk, len);
+    _webserver->sendContent("");
+    spindle_capture_release();
+}
+#endif
+
+#ifdef WEB_METRICS
+// Appends a metric without labels. Prometheus text format 0.0.4.
+static size_t metrics_add(char* text, size_t len, size_t size, const char* name, const char* type, double value)
+{
+    if (len < size)
+        len += snprintf(text + len, size - len, "# TYPE %s %s\n%s %.10g\n", name, type, name, value);
+    return len;
+}
+
+// Sends the state of the controller for Prometheus to scrape. The counters count from boot.
+void Web_Server::handle_metrics()
+{
+    if (is_authenticated() == LEVEL_GUEST) {
+        _webserver->send (401, "text/plain", "Authentication failed!\n");
+        return;
+    }
+    char text[2048];
+    size_t len = 0;
+    const size_t size = sizeof(text);
+    len = metrics_add(text, len, size, "grbl_planner_blocks", "gauge", plan_get_block_buffer_count());
+    len = metrics_add(text, len, size, "grbl_planner_blocks_max", "gauge", plan_get_block_buffer_size());
+    uint32_t underruns, starvations;
+    st_get_starvation_totals(&underruns, &starvations);
+    len = metrics_add(text, len, size, "grbl_segment_underruns_total", "counter", underruns);
+    len = metrics_add(text, len, size, "grbl_planner_starvations_total", "counter", starvations);
+#ifdef STEPPER_ISR_PROFILE
+    len = metrics_add(text, len, size, "grbl_stepper_isr_max_microseconds", "gauge",
+                      (double)st_get_isr_cycles_max() / ESP.getCpuFreqMHz());
+#endif
+    len = metrics_add(text, len, size, "grbl_lines_total", "counter", protocol_get_lines_executed());
+    if (len < size)
+        len += snprintf(text + len, size - len, "# TYPE grbl_rx_overflows_total counter\n");
+    for (uint8_t client = 0; client < CLIENT_COUNT && len < size; client++)
+        len += snprintf(text + len, size - len, "grbl_rx_overflows_total{client=\"%d\"} %u\n", client, serial_get_rx_overflows(client));
+    len = metrics_add(text, len, size, "grbl_heap_free_bytes", "gauge", ESP.getFreeHeap());
+    len = metrics_add(text, len, size, "grbl_heap_largest_block_bytes", "gauge", heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+    len = metrics_add(text, len, size, "grbl_heap_min_free_bytes", "gauge", ESP.getMinFreeHeap());
+    if (WiFi.getMode() == WIFI_STA && WiFi.isConnected())
+        len = metrics_add(text, len, size, "grbl_wifi_rssi_dbm", "gauge", WiFi.RSSI());
+    static const struct {
+        uint8_t state;
+        const char* name;
+    } states[] = {
+        { STATE_IDLE, "Idle" }, { STATE_ALARM, "Alarm" }, { STATE_CHECK_MODE, "Check" }, { STATE_HOMING, "Home" },
+        { STATE_CYCLE, "Run" }, { STATE_HOLD, "Hold" }, { STATE_JOG, "Jog" }, { STATE_SAFETY_DOOR, "Door" },
+        { STATE_SLEEP, "Sleep" },
+    };
+    if (len < size)
+        len += snprintf(text + len, size - len, "# TYPE grbl_state gauge\n");
+    for (uint8_t i = 0; i < sizeof(states) / sizeof(states[0]) && len < size; i++)
+        len += snprintf(text + len, size - len, "grbl_state{state=\"%s\"} %d\n", states[i].name, sys.state == states[i].state);
+#ifdef ENABLE_SD_CARD
+    len = metrics_add(text, len, size, "grbl_sd_job_running", "gauge", get_sd_state(false) == SDCARD_BUSY_PRINTING);
+#endif
+    len = metrics_add(text, len, size, "grbl_spindle_rpm", "gauge", sys.spindle_speed);
+    len = metrics_add(text, len, size, "grbl_uptime_seconds", "counter", esp_timer_get_time() / 1000000.0);
+    _webserver->sendHeader("Cache-Control", "no-cache");
+    _webserver->send(200, "text/plain; version=0.0.4", text);
+}
+#endif
+
+#ifdef EVENT_TRACE
+// Sends the event trace as a Chrome trace JSON file. See event_trace.cpp.
+void Web_Server::handle_trace()
+{
+    if (is_authenticated() == LEVEL_GUEST) {
+        _webserver->send (401, "text/plain", "Authentication failed!\n");
+        return;
+    }
+    char chunk[1024];
+    size_t len = 0;
+    char line[128];
+    uint32_t count = trace_hold();
+    _webserver->setContentLength(CONTENT_LENGTH_UNKNOWN);
+    _webserver->sendHeader("Cache-Control", "no-cache");
+    _webserver->send(200, "application/json", "");
+    _webserver->sendContent(trace_json_header);
+    for (uint32_t i = 0; i < count && trace_json(i, line, sizeof(line)); i++) {
+        size_t line_len = strlen(line);
+        if (len + line_len > sizeof(chunk)) {
+            _webserver->sendContent_P(chunk, len);
+            len = 0;
+        }
+        memcpy(&chunk[len], line, line_len);
+        len += line_len;
+    }
+    if (len > 0)
+        _webserver->sendContent_P(chunk, len);
+    _webserver->sendContent(trace_json_footer);
+    _webserver->sendContent("");
+    trace_release();
+}
+#endif
+
 //Handle not registred path on SPIFFS neither SD ///////////////////////
 void Web_Server:: handle_not_found()
 {
@@ -323,9 +689,7 @@ void Web_Server:: handle_not_found()
             if(SPIFFS.exists(pathWithGz)) {
                 path = pathWithGz;
             }
-            File file = SPIFFS.open(path, FILE_READ);
-            _webserver->streamFile(file, contentType);
-            file.close();
+            stream_spiffs_file(path, contentType);
             return;
         } else {
             page_not_found = true;
@@ -359,10 +723,7 @@ void Web_Server:: handle_not_found()
             if(SPIFFS.exists(pathWithGz)) {
                 path = pathWithGz;
             }
-            File file = SPIFFS.open(path, FILE_READ);
-            _webserver->streamFile(file, contentType);
-            file.close();
-           
+            stream_spiffs_file(path, contentType);
         } else {
             //if not template use default page
             contentType = PAGE_404;
@@ -387,9 +748,18 @@ void Web_Server:: handle_not_found()
 }
 
 #ifdef ENABLE_SSDP
+//The schema only changes with the IP and the hostname, so it is made once and kept
+static String ssdp_schema;
+static IPAddress ssdp_schema_ip;
+static String ssdp_schema_hostname;
+
 //http SSDP xml presentation
 void Web_Server::handle_SSDP ()
 {
+    if (ssdp_schema.length() && (ssdp_schema_ip == WiFi.localIP()) && (ssdp_schema_hostname == wifi_config.Hostname())) {
+        _webserver->send (200, "text/xml", ssdp_schema);
+        return;
+    }
     StreamString sschema ;
     if (sschema.reserve (1024) ) {
         String templ =  "<?xml version=\"1.0\"?>"
@@ -427,7 +797,10 @@ void Web_Server::handle_SSDP ()
                         wifi_config.Hostname().c_str(),
                         serialNumber.c_str(),
                         uuid);
-        _webserver->send (200, "text/xml", (String) sschema);
+        ssdp_schema = (String) sschema;
+        ssdp_schema_ip = WiFi.localIP();
+        ssdp_schema_hostname = wifi_config.Hostname();
+        _webserver->send (200, "text/xml", ssdp_schema);
     } else {
         _webserver->send (500);
     }
@@ -487,54 +860,70 @@ void Web_Server::_handle_web_command (bool silent)
     if (ESPpos > -1) {
         char line[256];
         strncpy(line, cmd.c_str(), 255);
-        ESPResponseStream* espresponse = silent ? NULL : new ESPResponseStream(_webserver);
+        line[255] = '\0';
+#ifdef WEB_REQUEST_ARENA
+        ESPResponseStream response(_webserver, &web_arena);
+#else
+        ESPResponseStream response(_webserver);
+#endif
+        ESPResponseStream* espresponse = silent ? NULL : &response;
         err_t err = system_execute_line(line, espresponse, auth_level);
-        String answer;
+        char answer[80];
         if (err == STATUS_OK) {
-            answer = "ok";
+            strcpy(answer, "ok");
         } else {
             const char* msg = errorString(err);
-            answer = "Error: ";
             if (msg) {
-                answer += msg;
+                snprintf(answer, sizeof(answer), "Error: %s", msg);
             } else {
-                answer += err;
+                snprintf(answer, sizeof(answer), "Error: %d", err);
             }
         }
         if (silent || !espresponse->anyOutput()) {
-            _webserver->send (err ? 401 : 200, "text/plain", answer.c_str());
+            _webserver->send (err ? 401 : 200, "text/plain", answer);
         } else {
             espresponse->flush();
         }
+#ifdef WEB_REQUEST_ARENA
+        web_arena.reset(); // The response is done with its chunk buffer
+#endif
     } else { //execute GCODE
         if (auth_level == LEVEL_GUEST) {
             _webserver->send (401, "text/plain", "Authentication failed!\n");
             return;
         }
         //Instead of send several commands one by one by web  / send full set and split here
-        String scmd;
+        //Each line is copied to a stack buffer, so splitting makes no Strings
+        char scmd[256];
         const char *res = "";
-        uint8_t sindex = 0;
-        // TODO Settings - this is very inefficient.  get_Splited_Value() is O(n^2)
-        // when it could easily be O(n).  Also, it would be just as easy to push
-        // the entire string into Serial2Socket and pull off lines from there.
-        for (uint8_t sindex = 0;
-             (scmd = get_Splited_Value(cmd,'\n', sindex)) != "";
-             sindex++) {
+        const char *next = cmd.c_str();
+        while (*next) {
+            const char *eol = strchr(next, '\n');
+            size_t len = eol ? eol - next : strlen(next);
+            if (len == 0) {
+                break; // An empty line ends the commands, as it always has
+            }
+            if (len > sizeof(scmd) - 2) {
+                len = sizeof(scmd) - 2;
+            }
+            memcpy(scmd, next, len);
+            scmd[len] = '\0';
+            next = eol ? eol + 1 : next + strlen(next);
             // 0xC2 is an HTML encoding prefix that, in UTF-8 mode,
             // precede 0x90 and 0xa0-0bf, which are GRBL realtime commands.
             // There are other encodings for 0x91-0x9f, so I am not sure
             // how - or whether - those commands work.
             // Ref: https://www.w3schools.com/tags/ref_urlencode.ASP
-            if (!silent && (scmd.length() == 2) && (scmd[0] == 0xC2)) {
-                scmd[0]=scmd[1];
-                scmd.remove(1,1);
+            if (!silent && (len == 2) && ((uint8_t)scmd[0] == 0xC2)) {
+                scmd[0] = scmd[1];
+                scmd[1] = '\0';
+                len = 1;
+            }
+            if (len > 1 || !is_realtime_cmd(scmd[0])) {
+                scmd[len++] = '\n';
+                scmd[len] = '\0';
             }
-            if (scmd.length() > 1)
-                scmd += "\n";
-            else if (!is_realtime_cmd(scmd[0]) )
-                scmd += "\n";
-            if (!Serial2Socket.push(scmd.c_str()))
+            if (!Serial2Socket.push(scmd))
                 res = "Error";
         }
         _webserver->send (200, "text/plain", res);
@@ -635,18 +1024,19 @@ void Web_Server::handle_login()
         }
         //create Session
         if ((current_auth_level != auth_level) || (auth_level== LEVEL_GUEST)) {
-            auth_ip * current_auth = new auth_ip;
-            current_auth->level = current_auth_level;
-            current_auth->ip=_webserver->client().remoteIP();
-            strcpy(current_auth->sessionID,create_session_ID());
-            strcpy(current_auth->userID,sUser.c_str());
-            current_auth->last_time=millis();
+            auth_ip current_auth;
+            current_auth.level = current_auth_level;
+            current_auth.ip=_webserver->client().remoteIP();
+            strcpy(current_auth.sessionID,create_session_ID());
+            strncpy(current_auth.userID,sUser.c_str(),sizeof(current_auth.userID) - 1);
+            current_auth.userID[sizeof(current_auth.userID) - 1] = '\0';
+            current_auth.last_time=millis();
             if (AddAuthIP(current_auth)) {
                 String tmps ="ESPSESSIONID=";
-                tmps+=current_auth->sessionID;
+                tmps+=current_auth.sessionID;
                 _webserver->sendHeader("Set-Cookie",tmps);
                 _webserver->sendHeader("Cache-Control","no-cache");
-                switch(current_auth->level) {
+                switch(current_auth.level) {
                     case LEVEL_ADMIN:
                         auths = "admin";
                         break;
@@ -658,7 +1048,6 @@ void Web_Server::handle_login()
                         break;
                     }
             } else {
-                delete current_auth;
                 msg_alert_error=true;
                 code = 500;
                 smsg = "Error: Too many connections";
@@ -733,6 +1122,7 @@ void Web_Server::handleFileList ()
     }
     //check if query need some action
     if (_webserver->hasArg ("action") ) {
+        spiffs_changed();
         //delete a file
         if (_webserver->arg ("action") == "delete" && _webserver->hasArg ("filename") ) {
             String filename;
@@ -815,14 +1205,40 @@ void Web_Server::handleFileList ()
             }
         }
     }
-    String jsonfile = "{";
+    //the listing is kept in a buffer that keeps its allocation from one request to the next
+    static String listing;
+#ifdef SPIFFS_LIST_CACHE
+    if (!_spiffs_list_valid || _spiffs_list_path != path) {
+        build_spiffs_listing(path, &listing);
+        _spiffs_list_path = path;
+        _spiffs_list_valid = true;
+    }
+#else
+    build_spiffs_listing(path, &listing);
+#endif
+    //the status is the only member that changes without SPIFFS changing
+    static String response;
+    response = listing;
+    response += ",\"status\":\"";
+    response += status;
+    response += "\"}";
+    _webserver->sendHeader("Cache-Control", "no-cache");
+    _webserver->send(200, "application/json", response);
+    _upload_status = UPLOAD_STATUS_NONE;
+}
+
+// Encodes the SPIFFS listing of path into out, as an object that is left open
+// for handleFileList() to add the status member and close.
+void Web_Server::build_spiffs_listing(const String& path, String* out)
+{
+    JSONencoder j(false, out);
+    j.begin();
     String ptmp = path;
-    if ( (path != "/") && (path[path.length() - 1] = '/') ) {
+    if ( (path != "/") && (path[path.length() - 1] == '/') ) {
         ptmp = path.substring (0, path.length() - 1);
     }
     File dir = SPIFFS.open (ptmp);
-    jsonfile += "\"files\":[";
-    bool firstentry = true;
+    j.begin_array("files");
     String subdirlist = "";
     File fileparsed = dir.openNextFile();
     while (fileparsed) {
@@ -857,38 +1273,20 @@ void Web_Server::handleFileList ()
             }
         }
         if (addtolist) {
-            if (!firstentry) {
-                jsonfile += ",";
-            } else {
-                firstentry = false;
-            }
-            jsonfile += "{";
-            jsonfile += "\"name\":\"";
-            jsonfile += filename;
-            jsonfile += "\",\"size\":\"";
-            jsonfile += size;
-            jsonfile += "\"";
-            jsonfile += "}";
+            j.begin_object();
+            j.member("name", filename);
+            j.member("size", size);
+            j.end_object();
         }
         fileparsed = dir.openNextFile();
     }
-    jsonfile += "],";
-    jsonfile += "\"path\":\"" + path + "\",";
-    jsonfile += "\"status\":\"" + status + "\",";
-    size_t totalBytes;
-    size_t usedBytes;
-    totalBytes = SPIFFS.totalBytes();
-    usedBytes = SPIFFS.usedBytes();
-    jsonfile += "\"total\":\"" + ESPResponseStream::formatBytes (totalBytes) + "\",";
-    jsonfile += "\"used\":\"" + ESPResponseStream::formatBytes (usedBytes) + "\",";
-    jsonfile.concat (F ("\"occupation\":\"") );
-    jsonfile += String (100 * usedBytes / totalBytes);
-    jsonfile += "\"";
-    jsonfile += "}";
-    path = "";
-    _webserver->sendHeader("Cache-Control", "no-cache");
-    _webserver->send(200, "application/json", jsonfile);
-    _upload_status = UPLOAD_STATUS_NONE;
+    j.end_array();
+    j.member("path", path);
+    size_t totalBytes = SPIFFS.totalBytes();
+    size_t usedBytes = SPIFFS.usedBytes();
+    j.member("total", ESPResponseStream::formatBytes (totalBytes));
+    j.member("used", ESPResponseStream::formatBytes (usedBytes));
+    j.member("occupation", totalBytes ? (int)(100 * usedBytes / totalBytes) : 0);
 }
 
 //push error code and message to websocket
@@ -896,7 +1294,9 @@ void Web_Server::pushError(int code, const char * st, bool web_error, uint16_t t
     if (_socket_server && st) {
         String s = "ERROR:" + String(code) + ":";
         s+=st;
+        Serial2Socket.lock();
         _socket_server->sendTXT(_id_connection, s);
+        Serial2Socket.unlock();
         if (web_error != 0) {
             if (_webserver) {
                 if (_webserver->client().available() > 0) {
@@ -906,7 +1306,9 @@ void Web_Server::pushError(int code, const char * st, bool web_error, uint16_t t
         }
         uint32_t t = millis();
         while (millis() - t < timeout) {
+            Serial2Socket.lock();
             _socket_server->loop();
+            Serial2Socket.unlock();
             delay(10);
         }
     }
@@ -944,6 +1346,7 @@ void Web_Server::SPIFFSFileupload ()
             //**************
             if(upload.status == UPLOAD_FILE_START) {
                 _upload_status= UPLOAD_STATUS_ONGOING;
+                spiffs_changed();
                 String upload_filename = upload.filename;
                 if (upload_filename[0] != '/') filename = "/" + upload_filename;
                 else filename = upload.filename;
@@ -1111,6 +1514,13 @@ void Web_Server::WebUpdateUpload ()
                     _upload_status=UPLOAD_STATUS_FAILED;
                     grbl_send(CLIENT_ALL,"[MSG:Update cancelled]\r\n");
                 }
+#ifdef OTA_WRITER
+                if (_upload_status != UPLOAD_STATUS_FAILED && !ota_writer_allowed()) {
+                    pushError(ESP_ERROR_UPLOAD_CANCELLED, "Upload rejected, the machine is not idle");
+                    _upload_status=UPLOAD_STATUS_FAILED;
+                    grbl_send(CLIENT_ALL,"[MSG:Update cancelled, the machine is not idle]\r\n");
+                }
+#endif
                 if (_upload_status != UPLOAD_STATUS_FAILED) {
                     last_upload_update = 0;
                     if(!Update.begin()) { //start with max available size
@@ -1118,6 +1528,13 @@ void Web_Server::WebUpdateUpload ()
                         grbl_send(CLIENT_ALL,"[MSG:Update cancelled]\r\n");
                         pushError(ESP_ERROR_NOT_ENOUGH_SPACE, "Upload rejected, not enough space");
                     } else {
+#ifdef OTA_WRITER
+                        if (!ota_writer_begin(maxSketchSpace)) {
+                            _upload_status=UPLOAD_STATUS_FAILED;
+                            grbl_send(CLIENT_ALL,"[MSG:Update cancelled]\r\n");
+                            pushError(ESP_ERROR_UPLOAD, "Update upload failed");
+                        } else
+#endif
                         grbl_send(CLIENT_ALL,"\n[MSG:Update 0%]\r\n");
                     }
                 }
@@ -1127,6 +1544,14 @@ void Web_Server::WebUpdateUpload ()
                 vTaskDelay(1 / portTICK_RATE_MS);
                 //check if no error
                 if (_upload_status == UPLOAD_STATUS_ONGOING) {
+#ifdef OTA_WRITER
+                    // The writer task reports the progress of what reached the flash
+                    if(!ota_writer_write(upload.buf, upload.currentSize)) {
+                        _upload_status=UPLOAD_STATUS_FAILED;
+                        grbl_send(CLIENT_ALL,"[MSG:Update write failed]\r\n");
+                        pushError(ESP_ERROR_FILE_WRITE, "File write failed");
+                    }
+#else
                     if ( ((100 * upload.totalSize) / maxSketchSpace) !=last_upload_update) {
                         if ( maxSketchSpace > 0)last_upload_update = (100 * upload.totalSize) / maxSketchSpace;
                         else last_upload_update = upload.totalSize;
@@ -1140,11 +1565,16 @@ void Web_Server::WebUpdateUpload ()
                         grbl_send(CLIENT_ALL,"[MSG:Update write failed]\r\n");
                         pushError(ESP_ERROR_FILE_WRITE, "File write failed");
                     }
+#endif
                 }
                 //Upload end
                 //**************
             } else if(upload.status == UPLOAD_FILE_END) {
+#ifdef OTA_WRITER
+                if(_upload_status == UPLOAD_STATUS_ONGOING && ota_writer_end()) {
+#else
                 if(Update.end(true)) { //true to set the size to the current progress
+#endif
                     //Now Reboot
                     grbl_send(CLIENT_ALL,"[MSG:Update 100%]\r\n");
                     _upload_status=UPLOAD_STATUS_SUCCESSFUL;
@@ -1162,6 +1592,9 @@ void Web_Server::WebUpdateUpload ()
     }
     if (_upload_status == UPLOAD_STATUS_FAILED) {
         cancelUpload();
+#ifdef OTA_WRITER
+        ota_writer_abort();
+#endif
         Update.end();
     }
     COMMANDS::wait(0);
@@ -1170,6 +1603,57 @@ void Web_Server::WebUpdateUpload ()
 
 #ifdef ENABLE_SD_CARD
 
+#ifdef SD_UPLOAD_BUFFER
+// The upload chunks, of HTTP_UPLOAD_BUFLEN bytes at most, are gathered in one RAM buffer and
+// written when it is full. With a buffer a multiple of the 512 byte sector size, every write but
+// the last starts and ends on a sector, so the FAT code writes whole sectors instead of reading,
+// patching and writing back a partial one for every chunk.
+static uint8_t* sd_upload_buffer = NULL;
+static size_t sd_upload_used;
+static uint32_t sd_upload_start_ms;
+static uint32_t sd_upload_bytes;
+
+static bool sd_upload_begin() {
+    if (sd_upload_buffer == NULL)
+        sd_upload_buffer = (uint8_t*)malloc(SD_UPLOAD_BUFFER_SIZE);
+    sd_upload_used = 0;
+    sd_upload_start_ms = millis();
+    sd_upload_bytes = 0;
+    return sd_upload_buffer != NULL;
+}
+
+static bool sd_upload_flush(File& file) {
+    size_t used = sd_upload_used;
+    sd_upload_used = 0;
+    return used == 0 || file.write(sd_upload_buffer, used) == used;
+}
+
+static bool sd_upload_write(File& file, const uint8_t* data, size_t len) {
+    sd_upload_bytes += len;
+    while (len) {
+        size_t count = MIN(len, SD_UPLOAD_BUFFER_SIZE - sd_upload_used);
+        memcpy(sd_upload_buffer + sd_upload_used, data, count);
+        sd_upload_used += count;
+        data += count;
+        len -= count;
+        if (sd_upload_used == SD_UPLOAD_BUFFER_SIZE && !sd_upload_flush(file))
+            return false;
+    }
+    return true;
+}
+
+// Frees the buffer. Called when an upload ends, so the RAM is only taken while uploading.
+static void sd_upload_end(bool report) {
+    if (report) {
+        uint32_t ms = millis() - sd_upload_start_ms;
+        grbl_sendf(CLIENT_ALL, "[MSG:Upload %lu bytes in %lu ms, %lu KB/s]\r\n",
+                   sd_upload_bytes, ms, ms ? sd_upload_bytes / ms : 0);
+    }
+    free(sd_upload_buffer);
+    sd_upload_buffer = NULL;
+}
+#endif
+
 //Function to delete not empty directory on SD card
 bool  Web_Server::deleteRecursive(String path)
 {
@@ -1229,12 +1713,21 @@ void Web_Server::handle_direct_SDFileList()
     bool list_files = true;
     uint64_t totalspace = 0;
     uint64_t usedspace = 0;
-    if (get_sd_state(true) != SDCARD_IDLE) {
+    uint8_t sd_card_state = get_sd_state(true);
+#ifdef SD_DIR_CACHE
+    //listings come from RAM, so they do not wait for a job to end
+    bool list_only = (sd_card_state == SDCARD_BUSY_PRINTING) && !_webserver->hasArg("action");
+#else
+    bool list_only = false;
+#endif
+    if ((sd_card_state != SDCARD_IDLE) && !list_only) {
         _webserver->sendHeader("Cache-Control","no-cache");
         _webserver->send(200, "application/json", "{\"status\":\"No SD Card\"}");
         return;
     }
-    set_sd_state(SDCARD_BUSY_PARSING);
+    if (!list_only) {
+        set_sd_state(SDCARD_BUSY_PARSING);
+    }
     //get current path
     if(_webserver->hasArg("path")) {
         path += _webserver->arg("path") ;
@@ -1258,6 +1751,9 @@ void Web_Server::handle_direct_SDFileList()
                 sstatus = shortname + " does not exist!";
             } else {
                 if (SD.remove((char *)filename.c_str())) {
+#ifdef SD_DIR_CACHE
+                    sd_dir_cache_removed(filename.c_str());
+#endif
                     sstatus = shortname + " deleted";
                 } else {
                     sstatus = "Cannot deleted " ;
@@ -1276,7 +1772,12 @@ void Web_Server::handle_direct_SDFileList()
                 if(!SD.exists((char *)filename.c_str())) {
                     sstatus = shortname + " does not exist!";
                 } else {
-                    if (!deleteRecursive(filename)) {
+                    bool deleted = deleteRecursive(filename);
+#ifdef SD_DIR_CACHE
+                    //even a part deleted directory must be listed again
+                    sd_dir_cache_removed(filename.c_str());
+#endif
+                    if (!deleted) {
                         sstatus ="Error deleting: ";
                         sstatus += shortname ;
                     } else {
@@ -1302,6 +1803,9 @@ void Web_Server::handle_direct_SDFileList()
                     sstatus = "Cannot create ";
                     sstatus += shortname ;
                 } else {
+#ifdef SD_DIR_CACHE
+                    sd_dir_cache_added(filename.c_str(), 0, true);
+#endif
                     sstatus = shortname + " created";
                 }
             }
@@ -1318,6 +1822,8 @@ void Web_Server::handle_direct_SDFileList()
     jsonfile+="\"files\":[";
 
     if (path!="/")path = path.substring(0,path.length()-1);
+#ifndef SD_DIR_CACHE
+    //with the cache a missing directory is found when it is listed
     if (path!="/" && !SD.exists((char *)path.c_str())) {
 
         String s =  "{\"status\":\" ";
@@ -1326,6 +1832,54 @@ void Web_Server::handle_direct_SDFileList()
          _webserver->send(200, "application/json", s.c_str());
         return;
     }
+#else
+    if (list_files) {
+        //wait for the background task if the directory is not listed yet
+        const sd_dir_entry_t* entries;
+        uint32_t count = 0;
+        uint32_t wait_start = millis();
+        uint8_t dir_state;
+        while (((dir_state = sd_dir_cache_get(path.c_str(), &entries, &count)) == SD_DIR_BUILDING) &&
+                ((millis() - wait_start) < SD_DIR_CACHE_WAIT_MS)) {
+            vTaskDelay(10 / portTICK_RATE_MS);
+        }
+        if (dir_state == SD_DIR_READY) {
+            //a page of the listing if asked for
+            uint32_t first = _webserver->hasArg("start") ? _webserver->arg("start").toInt() : 0;
+            uint32_t last = count;
+            if (_webserver->hasArg("count")) {
+                last = MIN(count, first + _webserver->arg("count").toInt());
+            }
+            for (uint32_t i = first; i < last; i++) {
+                if (i > first) {
+                    jsonfile+=",";
+                }
+                jsonfile+="{\"name\":\"";
+                jsonfile+=entries[i].name;
+                jsonfile+="\",\"shortname\":\"";
+                jsonfile+=entries[i].name;
+                jsonfile+="\",\"size\":\"";
+                if (entries[i].is_dir) {
+                    jsonfile+="-1";
+                } else {
+                    jsonfile+=ESPResponseStream::formatBytes(entries[i].size);
+                }
+                jsonfile+="\",\"datetime\":\"";
+                jsonfile+="\"}";
+            }
+            sd_dir_cache_release(entries);
+            jsonfile+="],\"count\":\"";
+            jsonfile+=String(count);
+            jsonfile+="\"";
+        } else {
+            sstatus = (dir_state == SD_DIR_BUILDING) ? "Listing in progress, try again" : path + " does not exist on SD Card";
+            jsonfile+="]";
+        }
+    } else {
+        jsonfile+="]";
+    }
+    jsonfile+=",\"path\":\"";
+#else
     if (list_files) {
         File dir = SD.open((char *)path.c_str());
         if (!dir) {
@@ -1365,19 +1919,27 @@ void Web_Server::handle_direct_SDFileList()
         dir.close();
     }
     jsonfile+="],\"path\":\"";
+#endif
     jsonfile+=path + "\",";
     jsonfile+="\"total\":\"";
     String stotalspace,susedspace;
     //SDCard are in GB or MB but no less
+#ifdef SD_DIR_CACHE
+    //counted by the background task, as the used space reads the whole FAT
+    sd_dir_cache_space(&totalspace, &usedspace);
+#else
     totalspace = SD.totalBytes();
     usedspace = SD.usedBytes();
+#endif
     stotalspace = ESPResponseStream::formatBytes(totalspace);
     susedspace =  ESPResponseStream::formatBytes(usedspace+1);
 
     uint32_t  occupedspace = 1;
     uint32_t  usedspace2 = usedspace/(1024*1024);
     uint32_t  totalspace2 = totalspace/(1024*1024);
-    occupedspace = (usedspace2 * 100)/totalspace2;
+    if (totalspace2) {
+        occupedspace = (usedspace2 * 100)/totalspace2;
+    }
     //minimum if even one byte is used is 1%
     if ( occupedspace <= 1) {
         occupedspace=1;
@@ -1403,7 +1965,9 @@ void Web_Server::handle_direct_SDFileList()
     _webserver->sendHeader("Cache-Control","no-cache");
     _webserver->send (200, "application/json", jsonfile.c_str());
     _upload_status=UPLOAD_STATUS_NONE;
-    set_sd_state(SDCARD_IDLE);
+    if (!list_only) {
+        set_sd_state(SDCARD_IDLE);
+    }
 }
 
 //SD File upload with direct access to SD///////////////////////////////
@@ -1440,6 +2004,9 @@ void Web_Server::SDFile_direct_upload()
                     //delete file on SD Card if already present
                     if(SD.exists((char *)filename.c_str())) {
                         SD.remove((char *)filename.c_str());
+#ifdef SD_DIR_CACHE
+                        sd_dir_cache_removed(filename.c_str());
+#endif
                     }
                     String  sizeargname  = upload.filename + "S";
                     if (_webserver->hasArg (sizeargname.c_str()) ) {
@@ -1455,6 +2022,12 @@ void Web_Server::SDFile_direct_upload()
                     if (_upload_status != UPLOAD_STATUS_FAILED){
                         //Create file for writing
                         sdUploadFile = SD.open((char *)filename.c_str(), FILE_WRITE);
+#ifdef SD_UPLOAD_BUFFER
+                        if (sdUploadFile && !sd_upload_begin()) {
+                            sdUploadFile.close();
+                            sdUploadFile = File();
+                        }
+#endif
                         //check if creation succeed
                         if (!sdUploadFile) {
                             //if creation failed
@@ -1474,7 +2047,11 @@ void Web_Server::SDFile_direct_upload()
                 vTaskDelay(1 / portTICK_RATE_MS);
                 if(sdUploadFile && (_upload_status == UPLOAD_STATUS_ONGOING) && (get_sd_state(false) == SDCARD_BUSY_UPLOADING)) {
                     //no error write post data
+#ifdef SD_UPLOAD_BUFFER
+                    if (!sd_upload_write(sdUploadFile, upload.buf, upload.currentSize)) {
+#else
                     if (upload.currentSize != sdUploadFile.write(upload.buf, upload.currentSize)) {
+#endif
                     _upload_status = UPLOAD_STATUS_FAILED;
                     grbl_send(CLIENT_ALL,"[MSG:Upload failed]\r\n");
                     pushError(ESP_ERROR_FILE_WRITE, "File write failed");
@@ -1489,6 +2066,13 @@ void Web_Server::SDFile_direct_upload()
             } else if(upload.status == UPLOAD_FILE_END) {
                 //if file is open close it
                 if(sdUploadFile) {
+#ifdef SD_UPLOAD_BUFFER
+                    if (!sd_upload_flush(sdUploadFile)) {
+                        _upload_status = UPLOAD_STATUS_FAILED;
+                        pushError(ESP_ERROR_FILE_WRITE, "File write failed");
+                    }
+                    sd_upload_end(_upload_status == UPLOAD_STATUS_ONGOING);
+#endif
                     sdUploadFile.close();
                     //TODO Check size
                     String  sizeargname  = upload.filename + "S";
@@ -1510,6 +2094,9 @@ void Web_Server::SDFile_direct_upload()
                 }
                 if (_upload_status == UPLOAD_STATUS_ONGOING) {
                     _upload_status = UPLOAD_STATUS_SUCCESSFUL;
+#ifdef SD_DIR_CACHE
+                    sd_dir_cache_added(filename.c_str(), upload.totalSize, false);
+#endif
                     set_sd_state(SDCARD_IDLE);
                 } else {
                     _upload_status = UPLOAD_STATUS_FAILED;
@@ -1523,6 +2110,9 @@ void Web_Server::SDFile_direct_upload()
                 if(sdUploadFile) {
                     sdUploadFile.close();
                 }
+#ifdef SD_UPLOAD_BUFFER
+                sd_upload_end(false);
+#endif
                 return;
             }
         }
@@ -1532,6 +2122,9 @@ void Web_Server::SDFile_direct_upload()
         if(sdUploadFile) {
             sdUploadFile.close();
             }
+#ifdef SD_UPLOAD_BUFFER
+        sd_upload_end(false);
+#endif
         if(SD.exists((char *)filename.c_str())) {
             SD.remove((char *)filename.c_str());
             }
@@ -1544,13 +2137,20 @@ void Web_Server::SDFile_direct_upload()
 void Web_Server::handle(){
 static uint32_t timeout = millis();
     COMMANDS::wait(0);
-#ifdef ENABLE_CAPTIVE_PORTAL
-    if(WiFi.getMode() == WIFI_AP){
-        dnsServer.processNextRequest();
+    {
+        HEAP_TAG_SCOPE(HEAP_TAG_WEB_SERVER);
+        if (_webserver)_webserver->handleClient();
     }
-#endif
-    if (_webserver)_webserver->handleClient();
+    HEAP_TAG_SCOPE(HEAP_TAG_WEBSOCKETS); // The rest of handle() is socket traffic
+    Serial2Socket.lock();
     if (_socket_server && _setupdone)_socket_server->loop();
+#ifdef WEBSOCKET_STREAM
+    uint8_t stream_num;
+    String stream_ack;
+    if (_socket_server && ws_stream_ack(&stream_num, stream_ack)) {
+        _socket_server->sendTXT(stream_num, stream_ack);
+    }
+#endif
     if ((millis() - timeout) > 10000) {
         if (_socket_server){
              String s = "PING:";
@@ -1559,6 +2159,7 @@ static uint32_t timeout = millis();
             timeout=millis();
         }
     }
+    Serial2Socket.unlock();
     
 }
 
@@ -1568,6 +2169,9 @@ void Web_Server::handle_Websocket_Event(uint8_t num, uint8_t type, uint8_t * pay
     switch(type) {
         case WStype_DISCONNECTED:
             //USE_SERIAL.printf("[%u] Disconnected!\n", num);
+#ifdef WEBSOCKET_STREAM
+            ws_stream_disconnected(num);
+#endif
             break;
         case WStype_CONNECTED:
             {
@@ -1583,6 +2187,15 @@ void Web_Server::handle_Websocket_Event(uint8_t num, uint8_t type, uint8_t * pay
             break;
         case WStype_TEXT:
             //USE_SERIAL.printf("[%u] get Text: %s\n", num, payload);
+#ifdef WEBSOCKET_STREAM
+            {
+                //batches of job lines, see ws_stream.cpp
+                String reply;
+                if (ws_stream_message(num, payload, length, reply) && reply.length()) {
+                    _socket_server->sendTXT(num, reply);
+                }
+            }
+#endif
 
             // send message to client
             // webSocket.sendTXT(num, "message here");
@@ -1603,28 +2216,6 @@ void Web_Server::handle_Websocket_Event(uint8_t num, uint8_t type, uint8_t * pay
 
 }
 
-// The separator that is passed in to this function is always '\n'
-// The string that is returned does not contain the separator
-// The calling code adds back the separator, unless the string is
-// a one-character realtime command.
-String Web_Server::get_Splited_Value(String data, char separator, int index)
-{
-  int found = 0;
-  int strIndex[] = {0, -1};
-  int maxIndex = data.length()-1;
-
-  for(int i=0; i<=maxIndex && found<=index; i++){
-    if(data.charAt(i)==separator || i==maxIndex){
-        found++;
-        strIndex[0] = strIndex[1]+1;
-        strIndex[1] = (i == maxIndex) ? i+1 : i;
-    }
-  }
-
-  return found>index ? data.substring(strIndex[0], strIndex[1]) : "";
-}
-
-
 //helper to extract content type from file extension
 //Check what is the content tye according extension file
 String Web_Server::getContentType (String filename)
@@ -1686,14 +2277,83 @@ auth_t Web_Server::is_authenticated()
 
 #ifdef ENABLE_AUTHENTICATION
 
-//add the information in the linked list if possible
-bool Web_Server::AddAuthIP (auth_ip * item)
+// The sessions are kept in a table of AUTH_SESSION_SLOTS, with linear probing from the hash of
+// the session ID, so a request finds its session in a probe or two however many are open. An
+// expired session is removed when a request finds it, or when a login needs its slot. The
+// password is only checked at login.
+static uint8_t auth_slot_home(const char* sessionID)
 {
-    if (_nb_ip > MAX_AUTH_IP) {
-        return false;
+    uint32_t hash = 2166136261u; // FNV-1a
+    while (*sessionID) {
+        hash = (hash ^ (uint8_t)*sessionID++) * 16777619u;
+    }
+    return hash & (AUTH_SESSION_SLOTS - 1);
+}
+
+static bool auth_expired(const auth_ip& session)
+{
+    return (millis() - session.last_time) > AUTH_TIMEOUT_MS;
+}
+
+//Slot of the session, or -1
+int8_t Web_Server::FindAuth (const char * sessionID)
+{
+    if (sessionID[0] == '\0') {
+        return -1;
+    }
+    uint8_t slot = auth_slot_home(sessionID);
+    for (uint8_t probes = 0; probes < AUTH_SESSION_SLOTS && _sessions[slot].sessionID[0] != '\0'; probes++) {
+        if (strcmp (sessionID, _sessions[slot].sessionID) == 0) {
+            return slot;
+        }
+        slot = (slot + 1) & (AUTH_SESSION_SLOTS - 1);
     }
-    item->_next = _head;
-    _head = item;
+    return -1;
+}
+
+//Removes the session and moves the later entries of its probe chain back into the hole
+void Web_Server::RemoveAuth (uint8_t slot)
+{
+    uint8_t hole = slot;
+    _sessions[hole].sessionID[0] = '\0';
+    _nb_ip--;
+    for (uint8_t next = (hole + 1) & (AUTH_SESSION_SLOTS - 1); _sessions[next].sessionID[0] != '\0';
+            next = (next + 1) & (AUTH_SESSION_SLOTS - 1)) {
+        uint8_t home = auth_slot_home(_sessions[next].sessionID);
+        //the entry stays if its home is within (hole, next], cyclically
+        bool stays = (hole <= next) ? (hole < home && home <= next) : (hole < home || home <= next);
+        if (stays) {
+            continue;
+        }
+        _sessions[hole] = _sessions[next];
+        _sessions[next].sessionID[0] = '\0';
+        hole = next;
+    }
+}
+
+//add the information in the session table if possible
+bool Web_Server::AddAuthIP (const auth_ip & item)
+{
+    if (_nb_ip >= MAX_AUTH_IP) {
+        //make room from the expired sessions first
+        for (uint8_t slot = 0; slot < AUTH_SESSION_SLOTS; slot++) {
+            while (_sessions[slot].sessionID[0] != '\0' && auth_expired(_sessions[slot])) {
+                RemoveAuth(slot); //may move another session into the slot
+            }
+        }
+        if (_nb_ip >= MAX_AUTH_IP) {
+            return false;
+        }
+    }
+    int8_t found = FindAuth(item.sessionID);
+    if (found >= 0) {
+        RemoveAuth(found); //same ID made again in the same millisecond
+    }
+    uint8_t slot = auth_slot_home(item.sessionID);
+    while (_sessions[slot].sessionID[0] != '\0') {
+        slot = (slot + 1) & (AUTH_SESSION_SLOTS - 1);
+    }
+    _sessions[slot] = item;
     _nb_ip++;
     return true;
 }
@@ -1720,86 +2380,40 @@ char * Web_Server::create_session_ID()
 
 bool Web_Server::ClearAuthIP (IPAddress ip, const char * sessionID)
 {
-    auth_ip * current = _head;
-    auth_ip * previous = NULL;
-    bool done = false;
-    while (current) {
-        if ( (ip == current->ip) && (strcmp (sessionID, current->sessionID) == 0) ) {
-            //remove
-            done = true;
-            if (current == _head) {
-                _head = current->_next;
-                _nb_ip--;
-                delete current;
-                current = _head;
-            } else {
-                previous->_next = current->_next;
-                _nb_ip--;
-                delete current;
-                current = previous->_next;
-            }
-        } else {
-            previous = current;
-            current = current->_next;
-        }
+    int8_t slot = FindAuth(sessionID);
+    if (slot < 0 || !(ip == _sessions[slot].ip)) {
+        return false;
     }
-    return done;
+    RemoveAuth(slot);
+    return true;
 }
 
 //Get info
 auth_ip * Web_Server::GetAuth (IPAddress ip, const char * sessionID)
 {
-    auth_ip * current = _head;
-    //auth_ip * previous = NULL;
-    //get time
-    //uint32_t now = millis();
-    while (current) {
-        if (ip == current->ip) {
-            if (strcmp (sessionID, current->sessionID) == 0) {
-                //found
-                return current;
-            }
-        }
-        //previous = current;
-        current = current->_next;
+    int8_t slot = FindAuth(sessionID);
+    if (slot < 0 || !(ip == _sessions[slot].ip)) {
+        return NULL;
     }
-    return NULL;
+    return &_sessions[slot];
 }
 
-//Review all IP to reset timers
+//Check the session of a request and reset its timer
 auth_t Web_Server::ResetAuthIP (IPAddress ip, const char * sessionID)
 {
-    auth_ip * current = _head;
-    auth_ip * previous = NULL;
-    //get time
-    //uint32_t now = millis();
-    while (current) {
-        if ( (millis() - current->last_time) > 360000) {
-            //remove
-            if (current == _head) {
-                _head = current->_next;
-                _nb_ip--;
-                delete current;
-                current = _head;
-            } else {
-                previous->_next = current->_next;
-                _nb_ip--;
-                delete current;
-                current = previous->_next;
-            }
-        } else {
-            if (ip == current->ip) {
-                if (strcmp (sessionID, current->sessionID) == 0) {
-                    //reset time
-                    current->last_time = millis();
-                    return (auth_t) current->level;
-                }
-            }
-            previous = current;
-            current = current->_next;
-        }
+    int8_t slot = FindAuth(sessionID);
+    if (slot < 0) {
+        return LEVEL_GUEST;
     }
-    return LEVEL_GUEST;
+    if (auth_expired(_sessions[slot])) {
+        RemoveAuth(slot);
+        return LEVEL_GUEST;
+    }
+    if (!(ip == _sessions[slot].ip)) {
+        return LEVEL_GUEST;
+    }
+    _sessions[slot].last_time = millis();
+    return (auth_t) _sessions[slot].level;
 }
 #endif
 
@@ -25,17 +25,51 @@
 
 #include "config.h"
 #include "commands.h"
+#include "arena.h"
+// Stack and polling period of the web server task. See WEB_SERVER_TASK in config.h.
+#ifndef WEB_SERVER_TASK_STACK
+    #define WEB_SERVER_TASK_STACK 8192
+#endif
+#ifndef WEB_SERVER_TASK_PERIOD_MS
+    #define WEB_SERVER_TASK_PERIOD_MS 2
+#endif
+
+// Stack and polling period of the captive portal DNS task, which only runs in AP mode
+#ifndef CAPTIVE_PORTAL_TASK_STACK
+    #define CAPTIVE_PORTAL_TASK_STACK 3072
+#endif
+#ifndef CAPTIVE_PORTAL_PERIOD_MS
+    #define CAPTIVE_PORTAL_PERIOD_MS 10
+#endif
+
+// Size of the memory arena of WebUI command requests. See WEB_REQUEST_ARENA in config.h.
+#ifndef WEB_ARENA_SIZE
+    #define WEB_ARENA_SIZE 4096
+#endif
+
+// Browser cache lifetime and number of remembered SPIFFS ETags. See WEB_CACHE_STATIC in config.h.
+#ifndef WEB_CACHE_MAX_AGE
+    #define WEB_CACHE_MAX_AGE 3600
+#endif
+#ifndef WEB_CACHE_ETAG_SLOTS
+    #define WEB_CACHE_ETAG_SLOTS 4
+#endif
+
 class WebSocketsServer;
 class WebServer;
 
 #ifdef ENABLE_AUTHENTICATION
+// Slots of the session table, a power of two above the most sessions so the probes stay short
+#ifndef AUTH_SESSION_SLOTS
+    #define AUTH_SESSION_SLOTS 16
+#endif
+
 struct auth_ip {
     IPAddress ip;
     auth_t level;
     char userID[17];
-    char sessionID[17];
+    char sessionID[17]; // Empty when the slot is free
     uint32_t last_time;
-    auth_ip* _next;
 };
 #endif
 
@@ -48,20 +82,32 @@ class Web_Server {
     void handle();
     static long get_client_ID();
     static uint16_t port() {return _port;}
+    static void spiffs_changed();
   private:
     static bool _setupdone;
+#ifdef WEB_SERVER_TASK
+    static TaskHandle_t _task;
+    static volatile bool _task_stop;
+    static void webServerTask(void* pvParameters);
+#endif
+#ifdef ENABLE_CAPTIVE_PORTAL
+    static TaskHandle_t _dns_task;
+    static volatile bool _dns_task_stop;
+    static void captivePortalTask(void* pvParameters);
+#endif
     static WebServer* _webserver;
     static long _id_connection;
     static WebSocketsServer* _socket_server;
     static uint16_t _port;
     static uint8_t _upload_status;
     static String getContentType(String filename);
-    static String get_Splited_Value(String data, char separator, int index);
     static auth_t  is_authenticated();
 #ifdef ENABLE_AUTHENTICATION
-    static auth_ip* _head;
+    static auth_ip _sessions[AUTH_SESSION_SLOTS];
     static uint8_t _nb_ip;
-    static bool AddAuthIP(auth_ip* item);
+    static bool AddAuthIP(const auth_ip& item);
+    static int8_t FindAuth(const char* sessionID);
+    static void RemoveAuth(uint8_t slot);
     static char* create_session_ID();
     static bool ClearAuthIP(IPAddress ip, const char* sessionID);
     static auth_ip* GetAuth(IPAddress ip, const char* sessionID);
@@ -71,14 +117,33 @@ class Web_Server {
     static void handle_SSDP();
 #endif
     static void handle_root();
+    static bool send_not_modified(const String& etag);
+    static void stream_spiffs_file(const String& path, const String& contentType);
+#ifdef WEBUI_PARTITION
+    static bool send_webui_partition();
+#endif
     static void handle_login();
     static void handle_not_found();
+#ifdef SPINDLE_CAPTURE
+    static void handle_spindle_capture();
+#endif
+#ifdef EVENT_TRACE
+    static void handle_trace();
+#endif
+#ifdef WEB_METRICS
+    static void handle_metrics();
+#endif
     static void _handle_web_command(bool);
     static void handle_web_command() { _handle_web_command(false); }
     static void handle_web_command_silent() { _handle_web_command(true); }
     static void handle_Websocket_Event(uint8_t num, uint8_t type, uint8_t* payload, size_t length);
     static void SPIFFSFileupload();
     static void handleFileList();
+    static void build_spiffs_listing(const String& path, String* out);
+#ifdef SPIFFS_LIST_CACHE
+    static bool _spiffs_list_valid;
+    static String _spiffs_list_path;
+#endif
     static void handleUpdate();
     static void WebUpdateUpload();
     static bool is_realtime_cmd(char c);
@@ -92,6 +157,9 @@ class Web_Server {
 };
 
 extern Web_Server web_server;
+#ifdef WEB_REQUEST_ARENA
+extern Arena web_arena;
+#endif
 
 #endif
 
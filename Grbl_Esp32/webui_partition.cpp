@@ -0,0 +1,164 @@
+/*
+  webui_partition.cpp - keeps the WebUI page in a flash partition mapped into memory
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#if defined(ENABLE_WIFI) && defined(ENABLE_HTTP) && defined(WEBUI_PARTITION)
+
+#include <esp_partition.h>
+#include <esp_spi_flash.h>
+#include <FS.h>
+#include <SPIFFS.h>
+#include <MD5Builder.h>
+
+// SPIFFS reads the WebUI page through its page cache, a few hundred bytes at a time, and
+// the page is the largest file a browser loads. The partition holds a copy of it, laid out
+// in one piece: a header, then the page at WEBUI_DATA_AT. Mapped into the data address
+// space, the page is sent from flash with no read calls. The copy is checked against the
+// SPIFFS file by its MD5 at the first request after a boot or a SPIFFS write, and made again
+// when they differ, so a WebUI uploaded the usual way is picked up.
+
+#define WEBUI_MAGIC 0x55424557 // "WEBU"
+#define WEBUI_DATA_AT 32
+#define WEBUI_SECTOR 4096
+
+typedef struct {
+    uint32_t magic;   // Written last, so a copy cut short by a reset is not used
+    uint32_t size;
+    uint8_t md5[16];
+} webui_header_t;
+
+static const esp_partition_t* webui_part = NULL;
+static spi_flash_mmap_handle_t webui_map;
+static const uint8_t* webui_mapped = NULL;
+static bool webui_checked = false; // Since the last SPIFFS write
+static char webui_etag[35];
+
+static const webui_header_t* webui_header() {
+    const webui_header_t* header = (const webui_header_t*)webui_mapped;
+    if (header->magic != WEBUI_MAGIC || header->size > webui_part->size - WEBUI_DATA_AT)
+        return NULL;
+    return header;
+}
+
+static void webui_invalidate() {
+    if (webui_header())
+        esp_partition_erase_range(webui_part, 0, WEBUI_SECTOR);
+}
+
+static bool webui_copy(File& file, size_t size, const uint8_t* md5) {
+    size_t erase = (WEBUI_DATA_AT + size + WEBUI_SECTOR - 1) / WEBUI_SECTOR * WEBUI_SECTOR;
+    if (esp_partition_erase_range(webui_part, 0, erase) != ESP_OK)
+        return false;
+    uint8_t buffer[1024];
+    size_t done = 0;
+    while (done < size) {
+        size_t len = file.read(buffer, sizeof(buffer));
+        if (len == 0 || esp_partition_write(webui_part, WEBUI_DATA_AT + done, buffer, len) != ESP_OK)
+            return false;
+        done += len;
+        COMMANDS::wait(0);
+    }
+    webui_header_t header;
+    header.magic = WEBUI_MAGIC;
+    header.size = size;
+    memcpy(header.md5, md5, sizeof(header.md5));
+    return esp_partition_write(webui_part, 0, &header, sizeof(header)) == ESP_OK;
+}
+
+// Makes the partition match WEBUI_PARTITION_FILE
+static void webui_sync() {
+    File file = SPIFFS.open(WEBUI_PARTITION_FILE, FILE_READ);
+    if (!file) {
+        webui_invalidate();
+        return;
+    }
+    size_t size = file.size();
+    if (size > webui_part->size - WEBUI_DATA_AT) {
+        file.close();
+        webui_invalidate();
+        grbl_sendf(CLIENT_ALL, "[MSG:WebUI does not fit in the %s partition]\r\n", WEBUI_PARTITION_LABEL);
+        return;
+    }
+    MD5Builder md5;
+    md5.begin();
+    md5.addStream(file, size);
+    md5.calculate();
+    uint8_t digest[16];
+    md5.getBytes(digest);
+    const webui_header_t* header = webui_header();
+    if (!header || header->size != size || memcmp(header->md5, digest, sizeof(digest)) != 0) {
+        file.seek(0);
+        if (webui_copy(file, size, digest))
+            grbl_sendf(CLIENT_ALL, "[MSG:WebUI copied to the %s partition]\r\n", WEBUI_PARTITION_LABEL);
+        else
+            webui_invalidate();
+    }
+    file.close();
+    header = webui_header();
+    if (header) {
+        char* pos = webui_etag;
+        *pos++ = '"';
+        for (uint8_t i = 0; i < sizeof(header->md5); i++, pos += 2)
+            sprintf(pos, "%02x", header->md5[i]);
+        *pos++ = '"';
+        *pos = '\0';
+    }
+}
+
+bool webui_partition_begin() {
+    webui_checked = false;
+    if (webui_mapped)
+        return true;
+    webui_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, WEBUI_PARTITION_LABEL);
+    if (webui_part == NULL)
+        return false;
+    if (esp_partition_mmap(webui_part, 0, webui_part->size, SPI_FLASH_MMAP_DATA, (const void**)&webui_mapped, &webui_map) != ESP_OK) {
+        webui_mapped = NULL;
+        return false;
+    }
+    return true;
+}
+
+void webui_partition_end() {
+    if (webui_mapped) {
+        spi_flash_munmap(webui_map);
+        webui_mapped = NULL;
+    }
+}
+
+void webui_partition_changed() {
+    webui_checked = false;
+}
+
+const uint8_t* webui_partition_get(size_t* size, const char** etag) {
+    if (!webui_mapped)
+        return NULL;
+    if (!webui_checked) {
+        webui_sync();
+        webui_checked = true;
+    }
+    const webui_header_t* header = webui_header();
+    if (!header)
+        return NULL;
+    *size = header->size;
+    *etag = webui_etag;
+    return webui_mapped + WEBUI_DATA_AT;
+}
+
+#endif
@@ -0,0 +1,51 @@
+/*
+  webui_partition.h - keeps the WebUI page in a flash partition mapped into memory
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef webui_partition_h
+#define webui_partition_h
+
+#ifdef WEBUI_PARTITION
+
+// The label of the data partition in the partition table
+#ifndef WEBUI_PARTITION_LABEL
+    #define WEBUI_PARTITION_LABEL "webui"
+#endif
+
+// The SPIFFS file the partition is a copy of
+#define WEBUI_PARTITION_FILE "/index.html.gz"
+
+// Bytes sent to the client at a time, straight from the mapped flash
+#ifndef WEBUI_PARTITION_CHUNK
+    #define WEBUI_PARTITION_CHUNK 4096
+#endif
+
+// Maps the partition, if the partition table has one. Returns false otherwise.
+bool webui_partition_begin();
+void webui_partition_end();
+
+// Marks the copy as stale, for a SPIFFS write. It is made again on the next webui_partition_get().
+void webui_partition_changed();
+
+// Makes the copy of WEBUI_PARTITION_FILE first if it is stale, then returns the mapped page
+// and its ETag, the MD5 of its content in quotes. Returns NULL if there is no partition, no
+// file, or the file does not fit.
+const uint8_t* webui_partition_get(size_t* size, const char** etag);
+
+#endif
+
+#endif
@@ -36,6 +36,10 @@ WiFiConfig wifi_config;
 
 String WiFiConfig::_hostname = "";
 bool WiFiConfig::_events_registered = false;
+#ifdef WIFI_POWER_POLICY
+bool WiFiConfig::_machine_busy = false;
+bool WiFiConfig::_sd_job = false;
+#endif
 WiFiConfig::WiFiConfig() {
 }
 
@@ -410,9 +414,43 @@ bool WiFiConfig::Is_WiFi_on() {
 void WiFiConfig::handle() {
     //Services
     COMMANDS::wait(0);
+#ifdef WIFI_POWER_POLICY
+    applyPowerPolicy();
+#endif
+#ifdef ENABLE_ETHERNET
+    eth_config.handle();
+#endif
     wifi_services.handle();
 }
 
+#ifdef WIFI_POWER_POLICY
+/**
+ * Modem sleep saves power but holds received packets until the next beacon, which adds tens of
+ * milliseconds to the lines and realtime commands of a streamed job. It is turned off while
+ * the machine is busy and back on at idle. The automatic reconnect is held during SD jobs, as
+ * its scans take the radio and core 0 for seconds and the job does not need the network. A
+ * job streamed over WiFi does need it, so then the reconnect is left alone.
+ */
+void WiFiConfig::applyPowerPolicy() {
+    bool sd_job = false;
+#ifdef ENABLE_SD_CARD
+    sd_job = get_sd_state(false) == SDCARD_BUSY_PRINTING;
+#endif
+    bool busy = sd_job || (sys.state & (STATE_CYCLE | STATE_HOMING | STATE_JOG | STATE_HOLD));
+    if (busy != _machine_busy) {
+        _machine_busy = busy;
+        if (WiFi.getMode() == WIFI_STA)
+            esp_wifi_set_ps(busy ? WIFI_PS_NONE : WIFI_PS_MIN_MODEM);
+    }
+    if (sd_job != _sd_job) {
+        _sd_job = sd_job;
+        WiFi.setAutoReconnect(!sd_job);
+        if (!sd_job && WiFi.getMode() == WIFI_STA && WiFi.status() != WL_CONNECTED)
+            WiFi.reconnect(); // Lost during the job
+    }
+}
+#endif
+
 
 #endif // ENABLE_WIFI
 
@@ -103,11 +103,20 @@ class WiFiConfig {
     static void handle();
     static void reset_settings();
     static bool Is_WiFi_on();
+#ifdef WIFI_POWER_POLICY
+    // True while the machine moves or runs an SD job, for work that can wait for the end of it
+    static bool isMachineBusy() {return _machine_busy;}
+#endif
   private :
     static bool ConnectSTA2AP();
     static void WiFiEvent(WiFiEvent_t event);
     static String _hostname;
     static bool _events_registered;
+#ifdef WIFI_POWER_POLICY
+    static bool _machine_busy;
+    static bool _sd_job;
+    static void applyPowerPolicy();
+#endif
 };
 
 extern WiFiConfig wifi_config;
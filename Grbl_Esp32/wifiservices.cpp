@@ -40,6 +40,9 @@
 #ifdef ENABLE_TELNET
     #include "telnet_server.h"
 #endif
+#ifdef TCP_STREAM_SERVER
+    #include "tcp_stream.h"
+#endif
 #ifdef ENABLE_NOTIFICATIONS
     #include "notifications_service.h"
 #endif
@@ -47,6 +50,8 @@
 
 WiFiServices wifi_services;
 
+bool WiFiServices::_started = false;
+
 WiFiServices::WiFiServices() {
 }
 WiFiServices::~WiFiServices() {
@@ -56,7 +61,12 @@ WiFiServices::~WiFiServices() {
 bool WiFiServices::begin() {
     bool no_error = true;
     //Sanity check
+#ifdef ENABLE_ETHERNET
+    if (WiFi.getMode() == WIFI_OFF && !eth_config.connected()) return false;
+#else
     if (WiFi.getMode() == WIFI_OFF) return false;
+#endif
+    _started = true;
     String h = wifi_hostname->get();
 
     //Start SPIFFS
@@ -102,25 +112,42 @@ bool WiFiServices::begin() {
     }
 #endif
 #ifdef ENABLE_HTTP
+    int64_t http_us = esp_timer_get_time();
     web_server.begin();
+    boot_phase("HTTP", http_us);
 #endif
 #ifdef ENABLE_TELNET
     telnet_server.begin();
 #endif
+#ifdef TCP_STREAM_SERVER
+    tcp_stream_server.begin();
+#endif
+#ifdef UDP_REALTIME
+    udp_realtime_begin();
+#endif
 #ifdef ENABLE_NOTIFICATIONS
     notificationsservice.begin();
 #endif
     //be sure we are not is mixed mode in setup
-    WiFi.scanNetworks(true);
+    //the scan would turn the radio on when only Ethernet is up
+    if (WiFi.getMode() != WIFI_OFF)
+        WiFi.scanNetworks(true);
     return no_error;
 }
 void WiFiServices::end() {
+    _started = false;
 #ifdef ENABLE_NOTIFICATIONS
     notificationsservice.end();
 #endif
 #ifdef ENABLE_TELNET
     telnet_server.end();
 #endif
+#ifdef TCP_STREAM_SERVER
+    tcp_stream_server.end();
+#endif
+#ifdef UDP_REALTIME
+    udp_realtime_end();
+#endif
 #ifdef ENABLE_HTTP
     web_server.end();
 #endif
@@ -148,14 +175,22 @@ void WiFiServices::handle() {
         }
     }
 #ifdef ENABLE_OTA
-    ArduinoOTA.handle();
-#endif
-#ifdef ENABLE_HTTP
+    #ifdef OTA_WRITER
+    // ArduinoOTA does the whole update inside handle(), so an invitation is only answered
+    // while the machine is idle. espota times out and can be run again after the job.
+    if (ota_writer_allowed())
+    #endif
+        ArduinoOTA.handle();
+#endif
+#if defined(ENABLE_HTTP) && !defined(WEB_SERVER_TASK)
     web_server.handle();
 #endif
 #ifdef ENABLE_TELNET
     telnet_server.handle();
 #endif
+#ifdef TCP_STREAM_SERVER
+    tcp_stream_server.handle();
+#endif
 }
 
 #endif // ENABLE_WIFI
@@ -31,6 +31,10 @@ class WiFiServices {
     static bool begin();
     static void end();
     static void handle();
+    // True from begin() to end()
+    static bool started() {return _started;}
+  private:
+    static bool _started;
 };
 
 extern WiFiServices wifi_services;
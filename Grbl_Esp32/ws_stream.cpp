@@ -0,0 +1,169 @@
+/*
+  ws_stream.cpp - job streaming over the WebUI websocket with a credit window
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "grbl.h"
+
+#if defined(WEBSOCKET_STREAM) && defined(ENABLE_WIFI) && defined(ENABLE_HTTP)
+
+#include "spsc_ring.h"
+
+// A browser sends a job in batches of lines, each a websocket text message:
+//   STREAM:<seq>\n<lines>     a batch, taken whole if it fits in the credit, else refused
+//   STREAM_RESET              drops the bytes not run yet
+// and gets back:
+//   STREAM_ACK:<seq>:<credit>   the last batch taken and the bytes free for more
+//   STREAM_NAK:<seq>:<credit>   the batch did not fit and was dropped
+// The credit is the room left in a WS_STREAM_BUFFER_SIZE ring. serialCheckTask empties the ring
+// into the WebUI client buffer only as fast as the lines in it are run, so the credit follows the
+// planner and the client buffer, and the sender can keep the ring full without waiting for the
+// ok of each line. The ok and error lines still come as before.
+//
+// The web server fills the ring and serialCheckTask empties it, so it is a single producer and
+// single consumer ring. A reset is done by the consumer, which skips what is left.
+static uint8_t ws_stream_slots[WS_STREAM_BUFFER_SIZE];
+static SPSCRing<uint8_t, uint16_t> ws_stream_ring;
+static bool ws_stream_inited = false;
+static int16_t ws_stream_client = -1;        // Websocket client number of the sender
+static uint32_t ws_stream_seq;               // Last batch taken
+static volatile uint32_t ws_stream_in;       // Bytes taken from the sender, producer side
+static volatile uint32_t ws_stream_out;      // Bytes passed to Grbl, consumer side
+static uint32_t ws_stream_out_acked;         // ws_stream_out at the last acknowledgment
+static uint32_t ws_stream_ack_ms;
+static volatile bool ws_stream_resetting = false;
+static volatile bool ws_stream_ack_now = false; // The credit after a reset
+
+static void ws_stream_init() {
+    if (ws_stream_inited)
+        return;
+    ws_stream_ring.init(ws_stream_slots, WS_STREAM_BUFFER_SIZE);
+    ws_stream_inited = true;
+}
+
+static uint32_t ws_stream_credit() {
+    return (WS_STREAM_BUFFER_SIZE - 1) - (ws_stream_in - ws_stream_out);
+}
+
+static String ws_stream_status(const char* kind, uint32_t seq) {
+    String s = kind;
+    s += String(seq);
+    s += ":";
+    s += String(ws_stream_credit());
+    return s;
+}
+
+bool ws_stream_message(uint8_t num, const uint8_t* payload, size_t length, String& reply) {
+    static const char stream[] = "STREAM:";
+    static const char reset[] = "STREAM_RESET";
+    reply = "";
+    ws_stream_init();
+    if (length >= strlen(reset) && memcmp(payload, reset, strlen(reset)) == 0) {
+        ws_stream_client = num;
+        ws_stream_reset();
+        if (!ws_stream_resetting)
+            reply = ws_stream_status("STREAM_ACK:", ws_stream_seq); // Nothing was waiting
+        return true;
+    }
+    if (length < strlen(stream) || memcmp(payload, stream, strlen(stream)) != 0)
+        return false;
+    const uint8_t* end = payload + length;
+    const uint8_t* p = payload + strlen(stream);
+    uint32_t seq = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        seq = seq * 10 + (*p++ - '0');
+    if (p < end && *p == '\n')
+        p++;
+    size_t len = end - p;
+    if (ws_stream_resetting || len > ws_stream_credit()) {
+        reply = ws_stream_status("STREAM_NAK:", seq);
+        return true;
+    }
+    ws_stream_client = num;
+    for (size_t i = 0; i < len; i++) {
+        *ws_stream_ring.producer_slot() = p[i];
+        ws_stream_ring.push();
+    }
+    ws_stream_in += len;
+    ws_stream_seq = seq;
+    serial_notify_data();
+    return true;
+}
+
+bool ws_stream_ack(uint8_t* num, String& ack) {
+    if (ws_stream_client < 0 || ws_stream_resetting)
+        return false;
+    uint32_t out = ws_stream_out;
+    if (!ws_stream_ack_now) {
+        if (out == ws_stream_out_acked)
+            return false;
+        if ((out - ws_stream_out_acked) < WS_STREAM_ACK_BYTES && (millis() - ws_stream_ack_ms) < WS_STREAM_ACK_MS)
+            return false;
+    }
+    ws_stream_ack_now = false;
+    ws_stream_out_acked = out;
+    ws_stream_ack_ms = millis();
+    *num = ws_stream_client;
+    ack = ws_stream_status("STREAM_ACK:", ws_stream_seq);
+    return true;
+}
+
+void ws_stream_disconnected(uint8_t num) {
+    if (ws_stream_client == num) {
+        ws_stream_reset();
+        ws_stream_client = -1;
+    }
+}
+
+bool ws_stream_ready() {
+    if (!ws_stream_inited)
+        return false;
+    return ws_stream_resetting || (ws_stream_ring.count() != 0 && serial_get_rx_buffer_available(CLIENT_WEBUI) > 0);
+}
+
+size_t ws_stream_take(uint8_t* data, size_t size) {
+    if (!ws_stream_inited)
+        return 0;
+    if (ws_stream_resetting) {
+        uint32_t dropped = 0;
+        while (ws_stream_ring.consumer_slot() != NULL) {
+            ws_stream_ring.pop();
+            dropped++;
+        }
+        ws_stream_out += dropped;
+        ws_stream_ack_now = true;
+        ws_stream_resetting = false;
+        return 0;
+    }
+    size = MIN(size, (size_t)serial_get_rx_buffer_available(CLIENT_WEBUI));
+    size_t len = 0;
+    uint8_t* slot;
+    while (len < size && (slot = ws_stream_ring.consumer_slot()) != NULL) {
+        data[len++] = *slot;
+        ws_stream_ring.pop();
+    }
+    ws_stream_out += len;
+    return len;
+}
+
+void ws_stream_reset() {
+    if (ws_stream_inited && ws_stream_in != ws_stream_out) {
+        ws_stream_resetting = true;
+        serial_notify_data();
+    }
+}
+
+#endif
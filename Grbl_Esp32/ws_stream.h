@@ -0,0 +1,58 @@
+/*
+  ws_stream.h - job streaming over the WebUI websocket with a credit window
+  Part of Grbl_ESP32
+
+  Grbl is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Grbl is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with Grbl.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ws_stream_h
+#define ws_stream_h
+
+#ifdef WEBSOCKET_STREAM
+
+// Bytes of streamed lines held ahead of the WebUI client buffer. This is the credit window.
+#ifndef WS_STREAM_BUFFER_SIZE
+    #define WS_STREAM_BUFFER_SIZE 8192
+#endif
+
+// An acknowledgment is sent once this many bytes have gone to Grbl since the last one, or after
+// WS_STREAM_ACK_MS if fewer have.
+#ifndef WS_STREAM_ACK_BYTES
+    #define WS_STREAM_ACK_BYTES 1024
+#endif
+#ifndef WS_STREAM_ACK_MS
+    #define WS_STREAM_ACK_MS 100
+#endif
+
+// Takes a websocket text message from client num. Returns false if it is not a stream message.
+// reply is set to a message to send back at once, or left empty.
+bool ws_stream_message(uint8_t num, const uint8_t* payload, size_t length, String& reply);
+
+// Sets ack to the acknowledgment due to the streaming client, if one is. Called by the web server.
+bool ws_stream_ack(uint8_t* num, String& ack);
+
+// The streaming client went away.
+void ws_stream_disconnected(uint8_t num);
+
+// Called by serialCheckTask. Returns true if streamed bytes are waiting and the client buffer has
+// room, and takes up to size of them into data.
+bool ws_stream_ready();
+size_t ws_stream_take(uint8_t* data, size_t size);
+
+// Drops the streamed bytes not taken yet, as on a reset.
+void ws_stream_reset();
+
+#endif
+
+#endif
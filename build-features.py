@@ -0,0 +1,157 @@
+#!/usr/bin/env python
+
+# Builds Grbl_ESP32 once with the features of config.h as they are, then
+# once with each feature switched the other way, and prints a table of the
+# IRAM, DRAM and flash each build takes and what each feature costs. The
+# features are those of configure-features.py. config.h is put back as it
+# was afterwards, also when a build fails or the script is interrupted.
+#
+# With -p <port> each build is also uploaded, and the free heap after boot
+# is read back with $MM. That needs a board on the port and pyserial.
+#
+#   ./build-features.py                       the default features, one by one
+#   ./build-features.py -f WIFI BLUETOOTH     only these
+#   ./build-features.py -c WIFI,BLUETOOTH     also all of these together
+#   ./build-features.py -p /dev/ttyUSB0 -m test_drive.h
+#
+# The sizes are read from the sections of firmware.elf. IRAM is the .iram0
+# sections, DRAM the static data and bss, and flash the size of firmware.bin.
+
+from __future__ import print_function
+from builder import buildMachine
+import builder
+import argparse, os, re, struct, subprocess, sys, time
+
+configPath = os.path.join('Grbl_Esp32', 'config.h')
+buildDir = os.path.join('.pio', 'build', 'esp32dev')
+defaultFeatures = [
+    'BLUETOOTH',
+    'WIFI',
+    'SD_CARD',
+    'HTTP',
+    'OTA',
+    'TELNET',
+    'MDNS',
+    'SSDP',
+    'NOTIFICATIONS',
+    'SERIAL2SOCKET_IN',
+    'SERIAL2SOCKET_OUT',
+    'CAPTIVE_PORTAL',
+    'AUTHENTICATION',
+    ]
+
+def enabledFeatures(config):
+    # The ENABLE_ defines between the eyecatch lines of config.h
+    block = re.search(r'CONFIGURE_EYECATCH_BEGIN(.*)CONFIGURE_EYECATCH_END', config, re.S).group(1)
+    return set(re.findall(r'^\s*#define\s+ENABLE_(\w+)', block, re.M))
+
+def configure(enable, disable, verbose):
+    cmd = [sys.executable, 'configure-features.py']
+    if enable:
+        cmd += ['-e'] + list(enable)
+    if disable:
+        cmd += ['-d'] + list(disable)
+    out = None if verbose else open(os.devnull, 'w')
+    return subprocess.call(cmd, stdout=out, stderr=out)
+
+def sectionSizes(elfPath):
+    # Section sizes from the section headers of a 32 bit little endian ELF file
+    with open(elfPath, 'rb') as f:
+        elf = f.read()
+    shoff, = struct.unpack_from('<I', elf, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from('<HHH', elf, 0x2e)
+    headers = [struct.unpack_from('<IIIIII', elf, shoff + i * shentsize) for i in range(shnum)]
+    strtab = headers[shstrndx][4]
+    sizes = {}
+    for name, kind, flags, addr, offset, size in headers:
+        end = elf.index(b'\0', strtab + name)
+        sizes[elf[strtab + name:end].decode('ascii')] = size
+    return sizes
+
+def measure():
+    sizes = sectionSizes(os.path.join(buildDir, 'firmware.elf'))
+    iram = sum(size for name, size in sizes.items() if name.startswith('.iram0'))
+    dram = sum(size for name, size in sizes.items() if name.startswith('.dram0') or name == '.noinit')
+    flash = os.path.getsize(os.path.join(buildDir, 'firmware.bin'))
+    return [iram, dram, flash]
+
+def bootHeap(port):
+    # Waits for the boot to finish, then asks for the memory report
+    import serial
+    with serial.Serial(port, 115200, timeout=1) as link:
+        time.sleep(10)
+        link.reset_input_buffer()
+        link.write(b'$MM\n')
+        end = time.time() + 5
+        while time.time() < end:
+            m = re.search(r'\[MSG:Memory heap free:(\d+)', link.readline().decode('utf8', 'replace'))
+            if m:
+                return int(m.group(1))
+    return None
+
+def build(name, enable, disable, args):
+    print('Build: ' + name)
+    if configure(enable, disable, args.verbose) != 0:
+        return None
+    extraArgs = '--target=upload' if args.port else None
+    if buildMachine(args.machine, verbose=args.verbose, extraArgs=extraArgs) != 0:
+        return None
+    row = measure()
+    row.append(bootHeap(args.port) if args.port else None)
+    return row
+
+def main():
+    parser = argparse.ArgumentParser(description='Measure the IRAM, DRAM, flash and heap of each feature')
+    parser.add_argument('-v', '--verbose', action='store_true')
+    parser.add_argument('-m', '--machine', help='machine file, instead of the default of machine.h')
+    parser.add_argument('-p', '--port', help='upload each build to this port and read its free heap')
+    parser.add_argument('-f', '--features', nargs='*', default=defaultFeatures, help='features to switch one by one')
+    parser.add_argument('-c', '--combination', action='append', default=[],
+                        help='comma separated features to switch together, may be repeated')
+    args = parser.parse_args()
+    if args.port:
+        builder.env['PLATFORMIO_UPLOAD_PORT'] = args.port
+
+    with open(configPath) as f:
+        original = f.read()
+    baseline = enabledFeatures(original)
+    variants = [(name, [name]) for name in args.features]
+    variants += [(combination, combination.split(',')) for combination in args.combination]
+    rows = []
+    try:
+        base = build('baseline', [], [], args)
+        if base is None:
+            print('The baseline build failed')
+            return 1
+        for name, features in variants:
+            # A feature that is on is turned off, and one that is off is turned on
+            disable = [f for f in features if f in baseline]
+            enable = [f for f in features if f not in baseline]
+            label = ' '.join(['-' + f for f in disable] + ['+' + f for f in enable])
+            with open(configPath, 'w') as f:
+                f.write(original)
+            rows.append((label, build(label, enable, disable, args)))
+    finally:
+        with open(configPath, 'w') as f:
+            f.write(original)
+
+    def cell(value, baseValue):
+        if value is None:
+            return '%19s' % '-'
+        if baseValue is None:
+            return '%19d' % value
+        return '%10d %+8d' % (value, value - baseValue)
+
+    print()
+    print('Baseline features: ' + ' '.join(sorted(baseline)))
+    print('%-28s %19s %19s %19s %19s' % ('Build', 'IRAM', 'DRAM', 'Flash', 'Heap at boot'))
+    print('%-28s %s' % ('baseline', ' '.join(cell(v, None) for v in base)))
+    for label, row in rows:
+        if row is None:
+            print('%-28s build failed' % label)
+        else:
+            print('%-28s %s' % (label, ' '.join(cell(v, b) for v, b in zip(row, base))))
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
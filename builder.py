@@ -9,12 +9,13 @@ import subprocess, os
 
 env = dict(os.environ)
 
+# baseName None builds the default machine of machine.h.
 def buildMachine(baseName, verbose=True, extraArgs=None):
     cmd = ['platformio','run']
     if extraArgs:
         cmd.append(extraArgs)
-    displayName = baseName
-    flags = '-DMACHINE_FILENAME=' + baseName
+    displayName = baseName if baseName else 'default machine'
+    flags = '-DMACHINE_FILENAME=' + baseName if baseName else ''
     print('Building machine ' + displayName)
     env['PLATFORMIO_BUILD_FLAGS'] = flags
     if verbose:
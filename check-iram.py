@@ -0,0 +1,122 @@
+# Checks that the functions on the stepper ISR path were linked into IRAM.
+# Code in flash stalls, or crashes the ISR, while the flash cache is off for
+# an NVS or SPIFFS write. A function listed here that lands in flash fails
+# the build, so a missing IRAM_ATTR is caught before it reaches a machine.
+#
+# PlatformIO runs this after linking, see extra_scripts in platformio.ini.
+# It can also be run on any firmware.elf:
+#   python check-iram.py .pio/build/esp32dev/firmware.elf [xtensa-esp32-elf-nm]
+#
+# Functions that the build does not contain, because of the machine file or
+# config.h, are skipped. Add callees here when the ISR path grows.
+# NOTE: This only sees functions. Constant tables, like the jump table of a
+# large switch, are placed in flash even when their function is in IRAM.
+
+from __future__ import print_function
+import subprocess, sys
+
+IRAM_START = 0x40070000
+IRAM_END = 0x400C0000
+
+# Demangled names without the argument list
+ISR_FUNCTIONS = [
+    # stepper.cpp
+    'onStepperDriverTimer',
+    'onStepperOffTimer',
+    'stepper_pulse_func',
+    'set_stepper_pins_on',
+    'st_go_idle',
+    'Stepper_Timer_WritePeriod',
+    'Stepper_Timer_Start',
+    'Stepper_Timer_Stop',
+    'Stepper_Off_Timer_Start',
+    'st_servo_segment_update',
+    'st_i2s_probe_triggered',
+    # Motors
+    'motors_set_direction_pins',
+    'motors_set_disable',
+    'motors_step',
+    'motors_servo_segment_update',
+    'Motor::set_direction_pins',
+    'Motor::set_disable',
+    'Motor::step',
+    'StandardStepper::set_direction_pins',
+    'StandardStepper::set_disable',
+    'UnipolarMotor::set_disable',
+    'UnipolarMotor::step',
+    'RcServo::set_disable',
+    'RcServo::segment_write',
+    # Spindles
+    'NullSpindle::set_rpm',
+    'PWMSpindle::set_rpm',
+    'PWMSpindle::set_output',
+    'PWMSpindle::write_duty',
+    'PWMSpindle::rpm_to_duty',
+    'RelaySpindle::set_rpm',
+    'RelaySpindle::set_output',
+    '_10vSpindle::set_rpm',
+    'BESCSpindle::set_rpm',
+    # Others
+    'plan_get_current_block',
+    'probe_get_state',
+    'probe_state_monitor',
+    'isr_probe_edge',
+    'st_probe_edge_position',
+    'system_set_exec_state_flag',
+    'system_hold_requests',
+    'isr_control_inputs',
+    'system_control_get_state',
+    'system_set_exec_alarm',
+    'mc_reset_isr',
+    'mc_reset_steppers',
+    'sys_ledc_write_isr',
+    'sys_dac_write_isr',
+    'coolant_write',
+    'pen_z_crossed_isr',
+    'spindle_capture_segment',
+    'trace_event',
+    'map_uint32_t',
+    'digitalWrite',
+    'digitalRead',
+    'raster_release',
+    'i2s_out_push_sample',
+    'i2s_out_get_pulse_usec',
+]
+
+
+def check(elf, nm):
+    output = subprocess.check_output([nm, '-C', elf]).decode('utf8', 'replace')
+    found = set()
+    in_flash = []
+    for line in output.splitlines():
+        parts = line.split(' ', 2)
+        if len(parts) < 3 or len(parts[1]) != 1 or parts[1] not in 'tTwW':
+            continue
+        name = parts[2].split('(')[0]
+        if name not in ISR_FUNCTIONS or name in found:
+            continue
+        found.add(name)
+        address = int(parts[0], 16)
+        if not (IRAM_START <= address < IRAM_END):
+            in_flash.append((name, address))
+    for name, address in in_flash:
+        print('check-iram: %s is at 0x%08x, outside IRAM. Mark it IRAM_ATTR.' % (name, address))
+    print('check-iram: %d ISR path functions checked, %d outside IRAM' % (len(found), len(in_flash)))
+    return not in_flash
+
+
+def post_link(source, target, env):
+    nm = env.subst('$CC').replace('gcc', 'nm')
+    if not check(target[0].get_abspath(), nm):
+        env.Exit(1)
+
+
+try:
+    Import('env')
+    env.AddPostAction('$BUILD_DIR/${PROGNAME}.elf', post_link)
+except NameError:
+    if __name__ == '__main__':
+        if len(sys.argv) < 2:
+            print('usage: check-iram.py firmware.elf [nm]')
+            sys.exit(2)
+        sys.exit(0 if check(sys.argv[1], sys.argv[2] if len(sys.argv) > 2 else 'xtensa-esp32-elf-nm') else 1)
@@ -39,7 +39,8 @@ validFeatureList = [
     'SERIAL2SOCKET_IN',
     'SERIAL2SOCKET_OUT',
     'CAPTIVE_PORTAL',
-    'AUTHENTICATION'
+    'AUTHENTICATION',
+    'ETHERNET'
     ]
 eyecatchBeginString = 'CONFIGURE_EYECATCH_BEGIN'
 eyecatchEndString = 'CONFIGURE_EYECATCH_END'
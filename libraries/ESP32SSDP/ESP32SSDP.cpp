@@ -39,6 +39,9 @@ License (MIT license):
 #define SSDP_URI_SIZE     2
 #define SSDP_BUFFER_SIZE  64
 #define SSDP_MULTICAST_TTL 2
+// A client that searches again within this time gets no second response. Windows and most
+// control points send their M-SEARCH several times in a row.
+#define SSDP_REPLY_HOLDOFF 10000
 static const IPAddress SSDP_MULTICAST_ADDR(239, 255, 255, 250);
 
 
@@ -118,7 +121,9 @@ _respondToPort(0),
 _pending(false),
 _delay(0),
 _process_time(0),
-_notify_time(0)
+_notify_time(0),
+_lastReplyTime(0),
+_packetsValid(false)
 {
   _uuid[0] = '\0';
   _modelNumber[0] = '\0';
@@ -161,7 +166,8 @@ bool SSDPClass::begin(){
     (uint16_t) ((chipId >>  8) & 0xff),
     (uint16_t)   chipId        & 0xff  );
   assert(nullptr == _server);
-  _server = new WiFiUDP;
+  _packetsValid = false;
+  _lastReplyTime = 0;
 #ifdef DEBUG_SSDP
   DEBUG_SSDP.printf("SSDP UUID: %s\n", (char *)_uuid);
 #endif
@@ -180,24 +186,34 @@ bool SSDPClass::begin(){
   return true;
 }
 
+void SSDPClass::_buildPackets(IPAddress ip){
+  for(uint8_t i = 0; i < 2; i++){
+    ssdp_method_t method = (i == 0) ? NONE : NOTIFY;
+    char* buffer = (method == NONE) ? _responsePacket : _notifyPacket;
+    char valueBuffer[strlen_P(_ssdp_notify_template)+1];
+    strcpy_P(valueBuffer, (method == NONE)?_ssdp_response_template:_ssdp_notify_template);
+
+    int len = snprintf_P(buffer, SSDP_PACKET_SIZE,
+      _ssdp_packet_template,
+      valueBuffer,
+      SSDP_INTERVAL,
+      _modelName, _modelNumber,
+      _uuid,
+      (method == NONE)?"ST":"NT",
+      _deviceType,
+     ip[0], ip[1], ip[2], ip[3], _port, _schemaURL
+    );
+    if(len < 0) buffer[0] = '\0';
+  }
+  _packetIP = ip;
+  _packetsValid = true;
+}
+
 void SSDPClass::_send(ssdp_method_t method){
-  char buffer[1460];
   IPAddress ip = WiFi.localIP();
-
-  char valueBuffer[strlen_P(_ssdp_notify_template)+1];
-  strcpy_P(valueBuffer, (method == NONE)?_ssdp_response_template:_ssdp_notify_template);
-
-  int len = snprintf_P(buffer, sizeof(buffer),
-    _ssdp_packet_template,
-    valueBuffer,
-    SSDP_INTERVAL,
-    _modelName, _modelNumber,
-    _uuid,
-    (method == NONE)?"ST":"NT",
-    _deviceType,
-   ip[0], ip[1], ip[2], ip[3], _port, _schemaURL
-  );
-  if(len < 0) return;
+  if(!_packetsValid || !(ip == _packetIP)) _buildPackets(ip);
+  const char* buffer = (method == NONE) ? _responsePacket : _notifyPacket;
+  if(buffer[0] == '\0') return;
   IPAddress remoteAddr;
   uint16_t remotePort;
   if(method == NONE) {
@@ -355,13 +371,21 @@ void SSDPClass::_update(){
       }
     }
   }
-  if(packetBuffer) delete packetBuffer;
+  if(packetBuffer) delete[] packetBuffer;
   if(_pending && (millis() - _process_time) > _delay){
     _pending = false; _delay = 0;
+    if(_lastReplyTime != 0 && _respondToAddr == _lastReplyAddr && (millis() - _lastReplyTime) < SSDP_REPLY_HOLDOFF){
 #ifdef DEBUG_SSDP
-    DEBUG_SSDP.println("Send None");
+      DEBUG_SSDP.println("Already answered");
 #endif
-    _send(NONE);
+    } else {
+#ifdef DEBUG_SSDP
+      DEBUG_SSDP.println("Send None");
+#endif
+      _send(NONE);
+      _lastReplyAddr = _respondToAddr;
+      _lastReplyTime = millis();
+    }
   } else if(_notify_time == 0 || (millis() - _notify_time) > (SSDP_INTERVAL * 1000L)){
     _notify_time = millis();
     #ifdef DEBUG_SSDP
@@ -382,14 +406,17 @@ void SSDPClass::_update(){
 
 void SSDPClass::setSchemaURL(const char *url){
   strlcpy(_schemaURL, url, sizeof(_schemaURL));
+  _packetsValid = false;
 }
 
 void SSDPClass::setHTTPPort(uint16_t port){
   _port = port;
+  _packetsValid = false;
 }
 
 void SSDPClass::setDeviceType(const char *deviceType){
   strlcpy(_deviceType, deviceType, sizeof(_deviceType));
+  _packetsValid = false;
 }
 
 void SSDPClass::setName(const char *name){
@@ -410,10 +437,12 @@ void SSDPClass::setSerialNumber(const uint32_t serialNumber){
 
 void SSDPClass::setModelName(const char *name){
   strlcpy(_modelName, name, sizeof(_modelName));
+  _packetsValid = false;
 }
 
 void SSDPClass::setModelNumber(const char *num){
   strlcpy(_modelNumber, num, sizeof(_modelNumber));
+  _packetsValid = false;
 }
 
 void SSDPClass::setModelURL(const char *url){
@@ -44,6 +44,7 @@ License (MIT license):
 #define SSDP_MODEL_VERSION_SIZE     32
 #define SSDP_MANUFACTURER_SIZE      64
 #define SSDP_MANUFACTURER_URL_SIZE  128
+#define SSDP_PACKET_SIZE            512
 
 typedef enum {
   NONE,
@@ -90,6 +91,7 @@ class SSDPClass{
 
   protected:
     void _send(ssdp_method_t method);
+    void _buildPackets(IPAddress ip);
     void _update();
     void _startTimer();
     void _stopTimer();
@@ -102,6 +104,14 @@ class SSDPClass{
 
     IPAddress _respondToAddr;
     uint16_t  _respondToPort;
+    IPAddress _lastReplyAddr;
+    unsigned long _lastReplyTime;
+
+    // The response and notify packets, made again when the IP or a setting they hold changes
+    char _responsePacket[SSDP_PACKET_SIZE];
+    char _notifyPacket[SSDP_PACKET_SIZE];
+    IPAddress _packetIP;
+    bool _packetsValid;
 
     bool _pending;
     unsigned short _delay;
@@ -213,24 +213,10 @@ bool WebSocketsServer::sendTXT(uint8_t num, String & payload) {
  * @return true if ok
  */
 bool WebSocketsServer::broadcastTXT(uint8_t * payload, size_t length, bool headerToPayload) {
-    WSclient_t * client;
-    bool ret = true;
     if(length == 0) {
         length = strlen((const char *) payload);
     }
-
-    for(uint8_t i = 0; i < WEBSOCKETS_SERVER_CLIENT_MAX; i++) {
-        client = &_clients[i];
-        if(clientIsConnected(client)) {
-            if(!sendFrame(client, WSop_text, payload, length, false, true, headerToPayload)) {
-                ret = false;
-            }
-        }
-#if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266)
-        delay(0);
-#endif
-    }
-    return ret;
+    return broadcastFrame(WSop_text, payload, length, headerToPayload);
 }
 
 bool WebSocketsServer::broadcastTXT(const uint8_t * payload, size_t length) {
@@ -280,20 +266,7 @@ bool WebSocketsServer::sendBIN(uint8_t num, const uint8_t * payload, size_t leng
  * @return true if ok
  */
 bool WebSocketsServer::broadcastBIN(uint8_t * payload, size_t length, bool headerToPayload) {
-    WSclient_t * client;
-    bool ret = true;
-    for(uint8_t i = 0; i < WEBSOCKETS_SERVER_CLIENT_MAX; i++) {
-        client = &_clients[i];
-        if(clientIsConnected(client)) {
-            if(!sendFrame(client, WSop_binary, payload, length, false, true, headerToPayload)) {
-                ret = false;
-            }
-        }
-#if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266)
-        delay(0);
-#endif
-    }
-    return ret;
+    return broadcastFrame(WSop_binary, payload, length, headerToPayload);
 }
 
 bool WebSocketsServer::broadcastBIN(const uint8_t * payload, size_t length) {
@@ -589,6 +562,95 @@ void WebSocketsServer::clientDisconnect(WSclient_t * client) {
  * @param client WSclient_t *  ptr to the client struct
  * @return true = connected
  */
+/**
+ * send one unmasked frame to all clients
+ * the header is made once and the same frame is written to every client,
+ * where sendFrame would make the header and copy the payload for each of them
+ * @param opcode WSopcode_t
+ * @param payload uint8_t *
+ * @param length size_t
+ * @param headerToPayload bool  (see sendFrame for more details)
+ * @return true if ok
+ */
+bool WebSocketsServer::broadcastFrame(WSopcode_t opcode, uint8_t * payload, size_t length, bool headerToPayload) {
+    uint8_t buffer[WEBSOCKETS_MAX_HEADER_SIZE];
+    uint8_t headerSize;
+    uint8_t * frame = NULL;
+    bool useInternBuffer = false;
+    bool ret = true;
+
+    if(length < 126) {
+        headerSize = 2;
+    } else if(length < 0xFFFF) {
+        headerSize = 4;
+    } else {
+        headerSize = 10;
+    }
+
+    // same header as sendFrame with fin and without mask
+    uint8_t * headerPtr = &buffer[0];
+    *headerPtr++ = bit(7) | opcode;
+    if(length < 126) {
+        *headerPtr++ = length;
+    } else if(length < 0xFFFF) {
+        *headerPtr++ = 126;
+        *headerPtr++ = ((length >> 8) & 0xFF);
+        *headerPtr++ = (length & 0xFF);
+    } else {
+        *headerPtr++ = 127;
+        for(uint8_t x = 0; x < 4; x++) {
+            *headerPtr++ = 0x00;
+        }
+        *headerPtr++ = ((length >> 24) & 0xFF);
+        *headerPtr++ = ((length >> 16) & 0xFF);
+        *headerPtr++ = ((length >> 8) & 0xFF);
+        *headerPtr++ = (length & 0xFF);
+    }
+
+    if(headerToPayload) {
+        frame = payload + (WEBSOCKETS_MAX_HEADER_SIZE - headerSize);
+        memcpy(frame, buffer, headerSize);
+    }
+#ifdef WEBSOCKETS_USE_BIG_MEM
+    // one TCP package per client, copied once for all of them
+    else if(((length > 0) && (length < 1400)) && (GET_FREE_HEAP > 6000)) {
+        frame = (uint8_t *) malloc(length + headerSize);
+        if(frame) {
+            memcpy(frame, buffer, headerSize);
+            memcpy(frame + headerSize, payload, length);
+            useInternBuffer = true;
+        }
+    }
+#endif
+
+    for(uint8_t i = 0; i < WEBSOCKETS_SERVER_CLIENT_MAX; i++) {
+        WSclient_t * client = &_clients[i];
+        if(!clientIsConnected(client) || client->status != WSC_CONNECTED) {
+            continue;
+        }
+        if(frame) {
+            if(write(client, frame, (length + headerSize)) != (length + headerSize)) {
+                ret = false;
+            }
+        } else {
+            if(write(client, &buffer[0], headerSize) != headerSize) {
+                ret = false;
+            }
+            if(payload && length > 0 && write(client, payload, length) != length) {
+                ret = false;
+            }
+        }
+#if (WEBSOCKETS_NETWORK_TYPE == NETWORK_ESP8266)
+        delay(0);
+#endif
+    }
+
+    if(useInternBuffer) {
+        free(frame);
+    }
+    return ret;
+}
+
 bool WebSocketsServer::clientIsConnected(WSclient_t * client) {
 
     if(!client->tcp) {